@@ -13,6 +13,8 @@
 #import "GlobalConstants.h"
 #import "IconStyleManager.h"
 #import "ConcurrentPathProcessor.h"
+#import "SharedTreeWalk.h"
+#import "IconPipeline.h"
 
 @implementation AFIApplyCommand
 
@@ -58,7 +60,9 @@
         return nil;
     }
 
-    NSOperationQueue * queue = [ [ NSOperationQueue alloc ] init ];
+    NSMutableArray * processors = [ NSMutableArray arrayWithCapacity: [ listOfFiles count ] ];
+
+    globalIconWriteCounts = ( IconWriteCounts ) { 0 };
 
     /* AppleScript sends 'file' types as NSURLs */
 
@@ -70,10 +74,47 @@
                                                    forPOSIXPath: [ fileURL path ]
         ];
 
-        [ queue addOperation: processThisPath ];
+        /* Scripted runs give way to any run and previews in the window */
+
+        processThisPath.lane = taskSchedulerLaneBackground;
+
+        [ processors addObject: processThisPath ];
+    }
+
+    if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"useStagedPipeline" ] )
+    {
+        /* See "IconPipeline.h"; nested folders share tree walks within it */
+
+        IconPipeline * pipeline = [ [ IconPipeline alloc ] init ];
+
+        [ pipeline processFolders: processors ];
+        [ pipeline logStatistics ];
+    }
+    else
+    {
+        NSOperationQueue * queue = [ [ NSOperationQueue alloc ] init ];
+
+        queue.maxConcurrentOperationCount = ICON_PIPELINE_IO_WORKERS;
+
+        /* Nested folders share a tree walk; see "SharedTreeWalk.h" */
+
+        [ queue addOperations: [ SharedTreeWalk planWalksForProcessors: processors ]
+            waitUntilFinished: NO ];
+
+        [ queue addOperations: processors
+            waitUntilFinished: NO ];
+
+        [ queue waitUntilAllOperationsAreFinished ];
     }
 
-    [ queue waitUntilAllOperationsAreFinished ];
+    NSLog
+    (
+        @"%@: Folder icons written: %lu, already up to date: %lu, failed: %lu",
+        @PROGRAM_STRING,
+        ( unsigned long ) globalIconWriteCounts.written,
+        ( unsigned long ) globalIconWriteCounts.unchanged,
+        ( unsigned long ) globalIconWriteCounts.failed
+    );
 
     if ( globalErrorFlag )
     {
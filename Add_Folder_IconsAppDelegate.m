@@ -11,6 +11,7 @@
 #import "SlipCoverSupport.h"
 #import "GlobalConstants.h"
 #import "GlobalSemaphore.h"
+#import "ImageTypeClassifier.h"
 
 @implementation Add_Folder_IconsAppDelegate
 
@@ -24,6 +25,16 @@
 
     globalSemaphoreInit();
 
+    /* Build the image type tables in the background, so that the first scan
+     * doesn't have to wait for ImageIO's list of supported types.
+     */
+
+    dispatch_async
+    (
+        dispatch_get_global_queue( QOS_CLASS_UTILITY, 0 ),
+        ^{ imageTypeClassifierPrepare(); }
+    );
+
     /* Possibly wake up the update mechanism */
 
     #ifdef UPDATABLE
@@ -104,7 +115,15 @@
         @"emptyListIfSuccessful":        @NO,
         @"colourLabelsIndicateCoverArt": @YES,
         @"coverArtFilenames":            coverArtFilenames,
-        @"defaultStyle":                 defaultStyleID
+        @"defaultStyle":                 defaultStyleID,
+        @"useScanIndex":                 @NO,
+        @"useThumbnailDiskCache":        @NO,
+        @"pngIconCompressionLevel":      @1,
+        @"skipUnchangedIcons":           @NO,
+        @"useStagedPipeline":            @YES,
+        @"adaptiveConcurrency":          @YES,
+        @"adaptScanToVolume":            @YES,
+        @"logRunStatistics":             @NO
     };
 
     [ userDefaults registerDefaults: appDefaults ];
@@ -0,0 +1,44 @@
+//
+//  BasePlateCache.h
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of icon "base plates" - the background of an icon canvas, i.e. the
+//  opaque fill or cleared canvas and any standard folder icon drawn over it,
+//  before any thumbnails are added. Every folder given the same style and the
+//  same number of thumbnails starts from the same plate, so it is drawn once
+//  and later canvases simply start as a copy of its pixels.
+//
+//  Plates are keyed by a string which must describe everything that affects
+//  them, along with the canvas size and layout. Empty the cache when what
+//  those keys describe changes (e.g. on ICON_STYLES_CHANGED_NOTIFICATION). All
+//  methods are thread-safe.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+typedef struct BasePlateCacheStatistics
+{
+    uint64_t   hits;
+    uint64_t   misses;     /* Each of which drew a new plate */
+    NSUInteger count;      /* Plates held                    */
+    size_t     bytesUsed;  /* By those plates                */
+
+} BasePlateCacheStatistics;
+
+@interface BasePlateCache : NSObject
+
+- ( instancetype ) initWithMaximumPlates: ( NSUInteger ) maximumPlates;
+
+- ( void ) paintPlateForKey: ( NSString                 * ) key
+                intoContext: ( CGContextRef               ) context
+                  drawnWith: ( void ( ^ )( CGContextRef ) ) draw;
+
+- ( void ) removeAllPlates;
+
+@property ( readonly ) BasePlateCacheStatistics statistics;
+
+@end
@@ -0,0 +1,180 @@
+//
+//  BasePlateCache.m
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of icon "base plates", the backgrounds of icon canvases. See the
+//  header file for details.
+//
+
+#import "BasePlateCache.h"
+
+#import <pthread.h>
+
+@interface BasePlateCache()
+{
+    pthread_mutex_t            lock;
+    NSMutableDictionary      * plates; /* Key => NSData of pixels */
+    BasePlateCacheStatistics   counters;
+}
+
+@property ( readonly ) NSUInteger maximumPlates;
+
+@end
+
+@implementation BasePlateCache
+
+/******************************************************************************\
+ * -initWithMaximumPlates:
+ *
+ * Initialise a cache.
+ *
+ * In:  ( NSUInteger ) maximumPlates
+ *      Most plates to hold; when full, the cache is emptied before another is
+ *      added. There are only ever a few distinct plates in practice.
+\******************************************************************************/
+
+- ( instancetype ) initWithMaximumPlates: ( NSUInteger ) maximumPlates
+{
+    if ( ( self = [ super init ] ) )
+    {
+        pthread_mutex_init( &lock, NULL );
+
+        plates         = [ NSMutableDictionary dictionaryWithCapacity: 0 ];
+        _maximumPlates = maximumPlates;
+    }
+
+    return self;
+}
+
+- ( void ) dealloc
+{
+    pthread_mutex_destroy( &lock );
+}
+
+/******************************************************************************\
+ * -paintPlateForKey:intoContext:drawnWith:
+ *
+ * Fill a bitmap context with a base plate. If the plate is cached, its pixels
+ * are copied straight into the context; else the given block draws it and the
+ * result is cached.
+ *
+ * In:  ( NSString * ) key
+ *      Describes everything that affects the plate; the context's size and
+ *      layout are added to it here;
+ *
+ *      ( CGContextRef ) context
+ *      Bitmap context to fill, every pixel of which is overwritten. The
+ *      graphics state is left as it was;
+ *
+ *      ( void ( ^ )( CGContextRef ) ) draw
+ *      Block which draws the plate into the context it is given, covering
+ *      every pixel.
+\******************************************************************************/
+
+- ( void ) paintPlateForKey: ( NSString                 * ) key
+                intoContext: ( CGContextRef               ) context
+                  drawnWith: ( void ( ^ )( CGContextRef ) ) draw
+{
+    uint8_t * pixels   = CGBitmapContextGetData( context );
+    size_t    rowBytes = CGBitmapContextGetBytesPerRow( context );
+    size_t    bytes    = rowBytes * CGBitmapContextGetHeight( context );
+
+    /* Without direct pixel access there's nothing to copy into */
+
+    if ( pixels == NULL )
+    {
+        draw( context );
+        return;
+    }
+
+    NSString * fullKey = [
+        NSString stringWithFormat: @"%zux%zu:%zu:%u:%@",
+                                   CGBitmapContextGetWidth   ( context ),
+                                   CGBitmapContextGetHeight  ( context ),
+                                   rowBytes,
+                                   ( unsigned int ) CGBitmapContextGetBitmapInfo( context ),
+                                   key
+    ];
+
+    pthread_mutex_lock( &lock );
+
+    NSData * plate = plates[ fullKey ];
+
+    if ( plate ) counters.hits   ++;
+    else         counters.misses ++;
+
+    pthread_mutex_unlock( &lock );
+
+    if ( plate )
+    {
+        memcpy( pixels, [ plate bytes ], bytes );
+        return;
+    }
+
+    CGContextSaveGState   ( context );
+    draw                  ( context );
+    CGContextRestoreGState( context );
+    CGContextFlush        ( context );
+
+    plate = [ NSData dataWithBytes: pixels length: bytes ];
+
+    pthread_mutex_lock( &lock );
+
+    if ( plates[ fullKey ] == nil )
+    {
+        if ( counters.count >= self.maximumPlates )
+        {
+            [ plates removeAllObjects ];
+
+            counters.count     = 0;
+            counters.bytesUsed = 0;
+        }
+
+        plates[ fullKey ] = plate;
+
+        counters.count     ++;
+        counters.bytesUsed += bytes;
+    }
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * -removeAllPlates
+ *
+ * Empty the cache.
+\******************************************************************************/
+
+- ( void ) removeAllPlates
+{
+    pthread_mutex_lock( &lock );
+
+    [ plates removeAllObjects ];
+
+    counters.count     = 0;
+    counters.bytesUsed = 0;
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * -statistics
+ *
+ * Out: A snapshot of the cache's counters.
+\******************************************************************************/
+
+- ( BasePlateCacheStatistics ) statistics
+{
+    BasePlateCacheStatistics snapshot;
+
+    pthread_mutex_lock( &lock );
+    snapshot = counters;
+    pthread_mutex_unlock( &lock );
+
+    return snapshot;
+}
+
+@end
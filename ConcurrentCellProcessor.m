@@ -14,6 +14,7 @@
 
 #import "GlobalConstants.h"
 #import "CustomIconGenerator.h"
+#import "TaskScheduler.h"
 
 @interface ConcurrentCellProcessor()
 
@@ -24,6 +25,8 @@
 @property NSMutableDictionary * rowDictionary;
 
 - ( BOOL ) rowIsVisible;
+- ( void ) drawPreviewWith: ( CustomIconGenerator * ) generator
+                      from: ( NSArray             * ) chosenImages;
 
 @end
 
@@ -150,6 +153,14 @@
  *
  * The implementation of this operation. For its behaviour, see the description
  * of -initForTableView:andRowDictionary:fromRow:.
+ *
+ * Finding the folder's images is mostly waiting for the filesystem, so it is
+ * done here, on whatever queue runs the operation. Only the drawing is handed
+ * to the task scheduler's interactive lane (see "TaskScheduler.h"), so the
+ * worker it keeps for previews is never left waiting on a slow disc. The
+ * operation waits for the drawing, so it isn't finished until the preview is.
+ * If the scheduler drops the drawing before it starts, when the list is
+ * scrolled, the row is left to be asked for again.
 \******************************************************************************/
 
 - ( void ) main
@@ -179,7 +190,73 @@
                 return;
             }
 
-            CGImageRef finalImage = [ generator generate: nil ];
+            NSArray * chosenImages = [ generator findImages: nil ];
+
+            if ( chosenImages == nil || self.isCancelled ) return;
+
+            dispatch_semaphore_t drawn = dispatch_semaphore_create( 0 );
+
+            int result = taskSchedulerSubmitBlock
+            (
+                taskSchedulerLaneInteractive,
+                ^{
+                    [ self drawPreviewWith: generator from: chosenImages ];
+                    dispatch_semaphore_signal( drawn );
+                },
+                ^{
+                    [ self cancel ];
+
+                    if ( self.rowDictionary[ @"preview" ][ @"cellProcessor" ] == self )
+                    {
+                        self.rowDictionary[ @"preview" ] = nil;
+                    }
+
+                    dispatch_semaphore_signal( drawn );
+                }
+            );
+
+            if ( result == 0 ) dispatch_semaphore_wait( drawn, DISPATCH_TIME_FOREVER );
+            else               [ self drawPreviewWith: generator from: chosenImages ];
+        }
+        @catch ( NSException * exception )
+        {
+            NSLog
+            (
+                @"%@: Exception '%@': %@",
+                @PROGRAM_STRING,
+                [ exception name   ],
+                [ exception reason ]
+            );
+        }
+    }
+}
+
+/******************************************************************************\
+ * -drawPreviewWith:from:
+ *
+ * Private method. Draw the preview icon from the images found for it, then
+ * have the main thread put it in the row, if the row still wants it.
+ *
+ * In:  ( CustomIconGenerator * ) generator
+ *      Generator which found the images;
+ *
+ *      ( NSArray * ) chosenImages
+ *      Images it found.
+\******************************************************************************/
+
+- ( void ) drawPreviewWith: ( CustomIconGenerator * ) generator
+                      from: ( NSArray             * ) chosenImages
+{
+    @autoreleasepool
+    {
+        @try
+        {
+            IconStyle * iconStyle = generator.iconStyle;
+
+            if ( self.isCancelled ) return;
+
+            CGImageRef finalImage = [ generator composeIconFrom: chosenImages
+                                                       errorsTo: nil ];
 
             if ( finalImage )
             {
@@ -187,11 +264,14 @@
                 NSSize    imageSize = NSSizeFromString( @"{64,64}" );
 
                 /* One last chance to avoid unnecessary work creating the
-                 * NSImage. After that, might as well carry on.
+                 * NSImage. After that, might as well carry on. Whether the
+                 * row is still visible is left to the main thread, rather
+                 * than having this worker wait for it.
                  */
 
-                if ( self.isCancelled || [ self rowIsVisible ] == NO )
+                if ( self.isCancelled )
                 {
+                    CFRelease( finalImage );
                     self.rowDictionary[ @"preview" ] = nil;
                     return;
                 }
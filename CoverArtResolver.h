@@ -0,0 +1,25 @@
+//
+//  CoverArtResolver.h
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Finds the cover art image in a folder, for cover art and SlipCover icon
+//  styles. Likely leafnames (e.g. "cover.jpg") are probed directly; unless
+//  the most preferred one is found that way, the folder is read, once, with
+//  no per-entry metadata fetched beyond colour labels (and those only when
+//  they are in use).
+//
+
+#import <Foundation/Foundation.h>
+
+@interface CoverArtResolver : NSObject
+
+- ( instancetype ) initWithLeafnames: ( NSArray * ) leafnames
+                     useColourLabels: ( BOOL      ) useColourLabels;
+
+- ( NSString * ) coverArtIn: ( NSString  * ) folderPath
+                      error: ( NSError  ** ) error;
+
+@end
@@ -0,0 +1,268 @@
+//
+//  CoverArtResolver.m
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Finds the cover art image in a folder, for cover art and SlipCover icon
+//  styles. Likely leafnames (e.g. "cover.jpg") are probed directly; unless
+//  the most preferred one is found that way, the folder is read, once, with
+//  no per-entry metadata fetched beyond colour labels (and those only when
+//  they are in use).
+//
+
+#import "CoverArtResolver.h"
+
+#import "GlobalSemaphore.h"
+#import "ImageTypeClassifier.h"
+#import "Miscellaneous.h"
+
+#import <sys/stat.h>
+
+/* Extensions tried when probing for cover art directly, in order of
+ * preference. Kept short, since each miss costs a stat() - which on a file
+ * server means a network round trip. Anything else is found by reading the
+ * folder instead.
+ */
+
+static NSString * const probeExtensions[] = { @"jpg", @"jpeg", @"png" };
+
+@interface CoverArtResolver()
+
+@property ( readonly ) NSArray      * probeLeafnames; /* E.g. "cover.jpg", in order of preference */
+@property ( readonly ) NSDictionary * foldedRanks;    /* Folded leafname => NSNumber preference   */
+@property ( readonly ) BOOL           useColourLabels;
+
++ ( NSString * ) fold: ( NSString * ) leafname;
+
+- ( NSString * ) probeIn:  ( NSString   * ) folderPath
+                     rank: ( NSUInteger * ) rank;
+- ( NSString * ) searchIn: ( NSString   * ) folderPath
+                    error: ( NSError   ** ) error;
+
+@end
+
+@implementation CoverArtResolver
+
+/******************************************************************************\
+ * -initWithLeafnames:useColourLabels:
+ *
+ * Initialise a resolver. Leafnames are case-folded and the direct probe list
+ * is built here, once, rather than for every folder searched.
+ *
+ * In:  ( NSArray * ) leafnames
+ *      Cover art leafnames, without extensions (e.g. "cover", "folder"), in
+ *      order of preference;
+ *
+ *      ( BOOL ) useColourLabels
+ *      If YES, any image with a Finder colour label is taken as cover art in
+ *      preference to one with a matching leafname.
+\******************************************************************************/
+
+- ( instancetype ) initWithLeafnames: ( NSArray * ) leafnames
+                     useColourLabels: ( BOOL      ) useColourLabels
+{
+    if ( ( self = [ super init ] ) )
+    {
+        NSMutableArray      * probes = [ NSMutableArray      arrayWithCapacity: 0 ];
+        NSMutableDictionary * ranks  = [ NSMutableDictionary dictionaryWithCapacity: 0 ];
+
+        for ( NSString * leafname in leafnames )
+        {
+            NSString * folded = [ CoverArtResolver fold: leafname ];
+
+            if ( ranks[ folded ] != nil ) continue;
+
+            ranks[ folded ] = @( [ ranks count ] );
+
+            for ( size_t index = 0; index < sizeof( probeExtensions ) / sizeof( probeExtensions[ 0 ] ); index ++ )
+            {
+                NSString * probe = [ leafname stringByAppendingPathExtension: probeExtensions[ index ] ];
+
+                if ( probe && imageTypeClassifyName( [ probe fileSystemRepresentation ] ) == imageTypeClassYes )
+                {
+                    [ probes addObject: probe ];
+                }
+            }
+        }
+
+        _probeLeafnames  = [ probes copy ];
+        _foldedRanks     = [ ranks  copy ];
+        _useColourLabels = useColourLabels;
+    }
+
+    return self;
+}
+
+/******************************************************************************\
+ * -coverArtIn:error:
+ *
+ * Find the cover art image in a folder. Subfolders are not searched. Hidden
+ * files are ignored. As with a generic folder scan, MAXIMUM_IMAGE_SIZE is not
+ * obeyed, since the user has explicitly picked these images out.
+ *
+ * If colour labels are in use, the first labelled image found wins; else the
+ * image whose leafname comes earliest in the configured list wins, compared
+ * without regard to case. The folder is only read if colour labels are in use
+ * or the most preferred leafname could not be found by probing for it
+ * directly. Probing only tries a few common extensions, so an image found
+ * under any other leafname might yet be beaten by, say, a TIFF with a more
+ * preferred one.
+ *
+ * In:  ( NSString * ) folderPath
+ *      Full POSIX path of the folder to search;
+ *
+ *      ( NSError ** ) error
+ *      Updated with an error if the folder can't be read, else left alone.
+ *      May be nil.
+ *
+ * Out: Full POSIX path of the cover art image, or nil if there is none or
+ *      the folder could not be read.
+\******************************************************************************/
+
+- ( NSString * ) coverArtIn: ( NSString  * ) folderPath
+                      error: ( NSError  ** ) error
+{
+    NSString   * found = nil;
+    NSUInteger   rank  = NSNotFound;
+
+    if ( self.useColourLabels == NO )
+    {
+        found = [ self probeIn: folderPath rank: &rank ];
+        if ( found && rank == 0 ) return found;
+    }
+
+    NSString * best = [ self searchIn: folderPath error: error ];
+
+    return best ? best : found;
+}
+
+/******************************************************************************\
+ * +fold:
+ *
+ * Return a leafname in a form which compares equal to any other leafname that
+ * differs only by case or Unicode composition (HFS+ decomposes names).
+\******************************************************************************/
+
++ ( NSString * ) fold: ( NSString * ) leafname
+{
+    return [
+               [ leafname decomposedStringWithCanonicalMapping ]
+               stringByFoldingWithOptions: NSCaseInsensitiveSearch
+                                   locale: nil
+           ];
+}
+
+/******************************************************************************\
+ * -probeIn:
+ *
+ * Look for each likely cover art leafname directly. On case-insensitive
+ * volumes (the default) a probe also finds names in any other case.
+ *
+ * In:  ( NSString * ) folderPath
+ *      Full POSIX path of the folder to search;
+ *
+ *      ( NSUInteger * ) rank
+ *      Updated with the preference of the leafname found, 0 being the most
+ *      preferred, if anything is found.
+ *
+ * Out: Full POSIX path of the first regular file found, else nil.
+\******************************************************************************/
+
+- ( NSString * ) probeIn: ( NSString   * ) folderPath
+                    rank: ( NSUInteger * ) rank
+{
+    for ( NSString * probe in self.probeLeafnames )
+    {
+        NSString    * path = [ folderPath stringByAppendingPathComponent: probe ];
+        struct stat   info;
+
+        if ( lstat( [ path fileSystemRepresentation ], &info ) == 0 && S_ISREG( info.st_mode ) )
+        {
+            NSString * folded = [ CoverArtResolver fold: [ probe stringByDeletingPathExtension ] ];
+
+            *rank = [ self.foldedRanks[ folded ] unsignedIntegerValue ];
+            return path;
+        }
+    }
+
+    return nil;
+}
+
+/******************************************************************************\
+ * -searchIn:error:
+ *
+ * Read the folder once, prefetching only what's needed to pick out regular
+ * files and (if in use) colour labels, and choose the best cover art image.
+ *
+ * Only one such search runs at a time. This helps avoid excessive filesystem
+ * thrashing when many folders are queued.
+ *
+ * In:  ( NSString * ) folderPath
+ *      Full POSIX path of the folder to search;
+ *
+ *      ( NSError ** ) error
+ *      Updated with an error if the folder can't be read. May be nil.
+ *
+ * Out: Full POSIX path of the chosen image, or nil.
+\******************************************************************************/
+
+- ( NSString * ) searchIn: ( NSString  * ) folderPath
+                    error: ( NSError  ** ) error
+{
+    NSFileManager * fileMgr  = [ [ NSFileManager alloc ] init ];
+    NSURL         * url      = [ [ NSURL alloc ] initFileURLWithPath: folderPath isDirectory: YES ];
+    NSArray       * keys     = self.useColourLabels ? @[ NSURLIsRegularFileKey, NSURLLabelNumberKey ]
+                                                    : @[ NSURLIsRegularFileKey ];
+    NSArray       * contents;
+    NSString      * bestPath = nil;
+    NSUInteger      bestRank = NSNotFound;
+
+    globalSemaphoreClaim();
+
+    contents = [ fileMgr contentsOfDirectoryAtURL: url
+                       includingPropertiesForKeys: keys
+                                          options: NSDirectoryEnumerationSkipsHiddenFiles
+                                            error: error ];
+
+    globalSemaphoreRelease();
+
+    for ( NSURL * itemURL in contents )
+    {
+        NSNumber * isRegularFile = nil;
+
+        [ itemURL getResourceValue: &isRegularFile forKey: NSURLIsRegularFileKey error: NULL ];
+        if ( [ isRegularFile boolValue ] == NO ) continue;
+
+        /* Name and label checks are cheap; only then is the (possibly more
+         * costly, if it has to sniff contents) image check made.
+         */
+
+        NSString * leaf   = [ [ itemURL lastPathComponent ] stringByDeletingPathExtension ];
+        NSNumber * rank   = self.foldedRanks[ [ CoverArtResolver fold: leaf ] ];
+        NSNumber * label  = nil;
+
+        if ( self.useColourLabels )
+        {
+            [ itemURL getResourceValue: &label forKey: NSURLLabelNumberKey error: NULL ];
+        }
+
+        if ( [ label integerValue ] > 0 )
+        {
+            if ( isImageFile( [ itemURL path ] ) ) return [ itemURL path ];
+        }
+        else if ( rank != nil && [ rank unsignedIntegerValue ] < bestRank )
+        {
+            if ( isImageFile( [ itemURL path ] ) )
+            {
+                bestPath = [ itemURL path ];
+                bestRank = [ rank unsignedIntegerValue ];
+            }
+        }
+    }
+
+    return bestPath;
+}
+
+@end
@@ -10,6 +10,9 @@
 
 #import "IconStyle.h"
 #import "CaseDefinition.h"
+#import "ThumbnailCache.h"
+#import "SpriteCache.h"
+#import "BasePlateCache.h"
 
 /* Border width around cropped images when at their intermediate stage of being
  * at full canvas size (see "GlobalConstants.h"); blur radius and offset for
@@ -26,12 +29,78 @@
 #define ROTATION_PAD 40
 
 /* Image search loop exit conditions (values are inclusive); zero equals
- * unlimited in either case (not recommended...).
+ * unlimited in either case (not recommended...). The time limit is measured
+ * in wall-clock time, per folder scanned. There is no limit on the number of
+ * images found, since images are sampled as they are found rather than being
+ * collected up first.
  */
 
 #define MAXIMUM_IMAGE_SIZE      67108864 /* 64MiB */
-#define MAXIMUM_IMAGES_FOUND    5000
-#define MAXIMUM_LOOP_TIME_TICKS CLOCKS_PER_SEC /* I.e. 1 second */
+#define MAXIMUM_LOOP_TIME_MS    1000     /* I.e. 1 second */
+
+/* Number of threads used to scan any one folder. Several folders are usually
+ * being processed at once anyway, so the default keeps each scan on its
+ * caller's thread.
+ */
+
+#define SCAN_THREADS_PER_FOLDER 1
+
+/* Number of threads used for a shared walk of a folder tree on behalf of
+ * several queued folders at once (see "SharedTreeWalk.h"), which otherwise
+ * each scan their own subtree. If the "adaptScanToVolume" preference is set,
+ * scans choose their batch size and thread count by the volume being read
+ * (see "FolderScanner.h"); since that keeps network and slow volumes down to
+ * a couple of threads, shared walks may then use more on fast local ones.
+ */
+
+#define SCAN_THREADS_PER_SHARED_WALK          4
+#define SCAN_THREADS_PER_ADAPTIVE_SHARED_WALK 8
+
+/* Optional persistent index of folder scan results, kept in the Application
+ * Support directory and used if the "useScanIndex" preference is set. The
+ * file is created at its full size, which bounds the disk space used; when
+ * it fills up it is cleared and starts again. See "ScanIndex.h".
+ */
+
+#define SCAN_INDEX_FILENAME     @"ScanIndex.dat"
+#define SCAN_INDEX_SIZE         33554432 /* 32MiB */
+
+/* Decoded thumbnails are cached in memory up to the given budget, so images
+ * shown in preview rows aren't decoded again when icons are applied. If the
+ * "useThumbnailDiskCache" preference is set, they are also kept as PNG files
+ * in a directory within Application Support, up to the given budget. See
+ * "ThumbnailCache.h".
+ */
+
+#define THUMBNAIL_CACHE_MEMORY_BUDGET 67108864  /* 64MiB  */
+#define THUMBNAIL_CACHE_DISK_BUDGET   268435456 /* 256MiB */
+#define THUMBNAIL_CACHE_DIRECTORY     @"ThumbnailCache"
+
+/* Decoded images and icon canvases are charged against a process-wide memory
+ * budget, so that many folders processed at once can't push the machine into
+ * swap. The budget is a fraction of physical memory, within the given limits.
+ * See "MemoryGovernor.h"; use memoryGovernorGetStatistics() for the current
+ * and peak reservations.
+ */
+
+#define MEMORY_BUDGET_FRACTION 4          /* I.e. a quarter of physical memory */
+#define MEMORY_BUDGET_MINIMUM  268435456  /* 256MiB */
+#define MEMORY_BUDGET_MAXIMUM  2147483648 /* 2GiB   */
+
+/* Thumbnail shadows and borders are drawn once per distinct geometry and then
+ * reused from a cache of "sprites" of up to the given size. Rotation angles
+ * are rounded so that sprites can be shared; see SPRITE_CACHE_ANGLE_STEP in
+ * "SpriteCache.h".
+ */
+
+#define SPRITE_CACHE_BUDGET 33554432 /* 32MiB */
+
+/* Icon backgrounds - fill colour and any folder icon - are drawn once per
+ * distinct combination and then copied; this many are kept at most. See
+ * "BasePlateCache.h".
+ */
+
+#define BASE_PLATE_CACHE_MAXIMUM 8
 
 /* The class interface itself */
 
@@ -43,6 +112,42 @@
 
     - ( CGImageRef   )          generate: ( NSError ** ) error;
 
+    /* The stages of -generate:, for callers which run them separately (see
+     * "IconPipeline.h"): find the images, optionally decode their thumbnails
+     * in advance, then draw the icon. Each stage of one generator must finish
+     * before the next starts.
+     */
+
+    - ( NSArray    * )        findImages: ( NSError ** ) error;
+    - ( void         )      decodeImages: ( NSArray  * ) chosenImages;
+    - ( CGImageRef   )   composeIconFrom: ( NSArray  * ) chosenImages
+                                errorsTo: ( NSError ** ) error;
+
+    /* The persistent scan index shared by all folder scans in this process,
+     * or NULL if it is not in use. See "ScanIndex.h".
+     */
+
+    + ( struct ScanIndex * ) sharedScanIndex;
+
+    /* The decoded image thumbnail cache shared by all generators in this
+     * process; see "ThumbnailCache.h". Use its "statistics" for hit and miss
+     * counts.
+     */
+
+    + ( ThumbnailCache * ) sharedThumbnailCache;
+
+    /* The shadow and border sprite cache shared by all generators in this
+     * process; see "SpriteCache.h".
+     */
+
+    + ( SpriteCache * ) sharedSpriteCache;
+
+    /* The icon background base plate cache shared by all generators in this
+     * process; see "BasePlateCache.h".
+     */
+
+    + ( BasePlateCache * ) sharedBasePlateCache;
+
     /* These properties record things that were given in the constructor */
 
     @property ( nonatomic, retain, readonly ) IconStyle * iconStyle;
@@ -71,6 +176,31 @@
     @property BOOL makeBackgroundOpaque;
     @property BOOL nonRandomImageSelectionForAPreview;
 
+    /* Seed for the random selection of images in multiple image mode. A new
+     * random seed is chosen for each instance; set the same value here on
+     * two generators to have them choose the same images from the same
+     * folder contents.
+     */
+
+    @property uint64_t imageSelectionSeed;
+
+    /* Derived from the icon style: does this generator only ever look for
+     * cover art in the folder itself, rather than scanning the folder tree
+     * for images; and how many images (1 to 4) does it want?
+     */
+
+    @property ( readonly ) BOOL       onlyUsesCoverArt;
+    @property ( readonly ) NSUInteger maximumImages;
+
+    /* In multiple image mode, images chosen on this generator's behalf by a
+     * walk of some larger folder tree, already narrowed down to no more than
+     * "maximumImages" entries and in their final order - see
+     * "SharedTreeWalk.h". If nil (the default), the generator scans the folder
+     * itself. An empty array means that no images were found.
+     */
+
+    @property ( copy ) NSArray * precomputedImages;
+
     /* If building a preview you may want to know for sure which cover art
      * filenames are in use, since the user might change them to anything.
      * You can override the cover art user preferences array here. Specify
@@ -9,12 +9,29 @@
 #import "CustomIconGenerator.h"
 
 #import "Add_Folder_IconsAppDelegate.h"
+#import "ApplicationSupport.h"
 #import "GlobalConstants.h"
-#import "GlobalSemaphore.h"
 #import "Icons.h"
 #import "IconStyleManager.h"
 #import "SlipCoverSupport.h"
 #import "CaseGenerator.h"
+#import "CoverArtResolver.h"
+#import "FolderScanner.h"
+#import "ReservoirSampler.h"
+#import "ReducedDecode.h"
+#import "EmbeddedPreview.h"
+#import "ScanIndex.h"
+#import "ImageTypeClassifier.h"
+#import "MemoryGovernor.h"
+#import "TaskScheduler.h"
+
+#ifdef USE_RASTER_ENGINE
+    #import "RasterEngine.h"
+#endif
+
+#import <fcntl.h>
+#import <sys/stat.h>
+#import <unistd.h>
 
 /* Pre-computed locations inside a CANVAS_SIZE square canvas for cropped
  * thumbnail icons for when there are between 1 and 4 icons available. See
@@ -87,15 +104,850 @@ static CGRect locations_os_x_10_10_or_later[ 4 ][ 4 ] =
 
 static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
 
+/* Persistent scan index shared by all generators; see sharedScanIndex() */
+
+static ScanIndex * scanIndex = NULL;
+
+/******************************************************************************\
+ * syncScanIndex()
+ *
+ * atexit() handler - mark the shared scan index as consistent on the way out.
+ * The index is not closed, since other threads might still be scanning.
+\******************************************************************************/
+
+static void syncScanIndex( void )
+{
+    if ( scanIndex != NULL ) scanIndexSync( scanIndex );
+}
+
+/******************************************************************************\
+ * sharedScanIndex()
+ *
+ * Return the persistent scan index used to skip unchanged directories, opening
+ * it on first use. Returns NULL if the "useScanIndex" preference is off (it is
+ * read once per process) or if the index can't be opened - e.g. because the
+ * application and the command line tool are both running, in which case only
+ * the first to start gets to use it. Scans just run in full without an index.
+\******************************************************************************/
+
+static ScanIndex * sharedScanIndex( void )
+{
+    static dispatch_once_t onceToken;
+
+    dispatch_once( &onceToken, ^{
+
+        if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"useScanIndex" ] == NO ) return;
+
+        NSString * directory = [ ApplicationSupport applicationSupportDirectory ];
+        NSString * path      = [ directory stringByAppendingPathComponent: SCAN_INDEX_FILENAME ];
+        int        error     = 0;
+
+        ( void ) [ [ NSFileManager defaultManager ] createDirectoryAtPath: directory
+                                              withIntermediateDirectories: YES
+                                                               attributes: nil
+                                                                    error: NULL ];
+
+        scanIndex = scanIndexOpen( [ path fileSystemRepresentation ], SCAN_INDEX_SIZE, &error );
+
+        if ( scanIndex == NULL )
+        {
+            NSLog( @"Scan index at %@ is unavailable (error %d); folders will be scanned in full", path, error );
+        }
+        else
+        {
+            atexit( syncScanIndex );
+        }
+    });
+
+    return scanIndex;
+}
+
+/******************************************************************************\
+ * sharedThumbnailCache()
+ *
+ * Return the cache of decoded image thumbnails shared by all generators in
+ * this process, creating it on first use. The disk tier is only used if the
+ * "useThumbnailDiskCache" preference is set (it is read once per process).
+\******************************************************************************/
+
+static ThumbnailCache * sharedThumbnailCache( void )
+{
+    static ThumbnailCache  * thumbnailCache = nil;
+    static dispatch_once_t   onceToken;
+
+    dispatch_once( &onceToken, ^{
+
+        NSString * directory = nil;
+
+        if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"useThumbnailDiskCache" ] )
+        {
+            directory = [ [ ApplicationSupport applicationSupportDirectory ] stringByAppendingPathComponent: THUMBNAIL_CACHE_DIRECTORY ];
+        }
+
+        thumbnailCache = [ [ ThumbnailCache alloc ] initWithByteBudget: THUMBNAIL_CACHE_MEMORY_BUDGET
+                                                         diskDirectory: directory
+                                                            diskBudget: THUMBNAIL_CACHE_DISK_BUDGET ];
+    });
+
+    return thumbnailCache;
+}
+
+/******************************************************************************\
+ * sharedSpriteCache()
+ *
+ * Return the cache of shadow and border sprites shared by all generators in
+ * this process, creating it on first use.
+\******************************************************************************/
+
+static SpriteCache * sharedSpriteCache( void )
+{
+    static SpriteCache     * spriteCache = nil;
+    static dispatch_once_t   onceToken;
+
+    dispatch_once( &onceToken, ^{
+        spriteCache = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_CACHE_BUDGET ];
+    });
+
+    return spriteCache;
+}
+
+/******************************************************************************\
+ * sharedBasePlateCache()
+ *
+ * Return the cache of icon background base plates shared by all generators in
+ * this process, creating it on first use. It is emptied whenever icon styles
+ * change.
+\******************************************************************************/
+
+static BasePlateCache * sharedBasePlateCache( void )
+{
+    static BasePlateCache  * basePlateCache = nil;
+    static dispatch_once_t   onceToken;
+
+    dispatch_once( &onceToken, ^{
+
+        basePlateCache = [ [ BasePlateCache alloc ] initWithMaximumPlates: BASE_PLATE_CACHE_MAXIMUM ];
+
+        [
+            [ NSNotificationCenter defaultCenter ] addObserverForName: ICON_STYLES_CHANGED_NOTIFICATION
+                                                               object: nil
+                                                                queue: nil
+                                                           usingBlock: ^( NSNotification * notification )
+            {
+                ( void ) notification;
+                [ basePlateCache removeAllPlates ];
+            }
+        ];
+    });
+
+    return basePlateCache;
+}
+
+/******************************************************************************\
+ * establishMemoryBudget()
+ *
+ * Set the memory governor's budget from the amount of physical memory, once
+ * per process. See MEMORY_BUDGET_FRACTION in "CustomIconGenerator.h".
+\******************************************************************************/
+
+static void establishMemoryBudget( void )
+{
+    static dispatch_once_t onceToken;
+
+    dispatch_once( &onceToken, ^{
+
+        unsigned long long budget = [ NSProcessInfo processInfo ].physicalMemory / MEMORY_BUDGET_FRACTION;
+
+        budget = MAX( budget, MEMORY_BUDGET_MINIMUM );
+        budget = MIN( budget, MEMORY_BUDGET_MAXIMUM );
+
+        memoryGovernorSetBudget( ( size_t ) budget );
+    });
+}
+
+/******************************************************************************\
+ * reserveMemory()
+ *
+ * Reserve memory from the governor for the calling thread's work. Previews
+ * are drawn in the task scheduler's interactive lane, including the helpers
+ * of their parallel loops; their reservations go ahead of any waiting for
+ * folders being processed, so a preview isn't held up behind a run's worth
+ * of images. Release with memoryGovernorRelease() as usual.
+ *
+ * In:  Kind of reservation;
+ *
+ *      Number of bytes.
+\******************************************************************************/
+
+static void reserveMemory( MemoryGovernorKind kind, size_t bytes )
+{
+    MemoryGovernorPriority priority = taskSchedulerCurrentLane() == taskSchedulerLaneInteractive
+                                      ? memoryGovernorPriorityInteractive
+                                      : memoryGovernorPriorityBulk;
+
+    memoryGovernorReserveWithPriority( kind, priority, bytes );
+}
+
+/******************************************************************************\
+ * scannerAcceptFile()
+ *
+ * FolderScanner callback - is the file at the given full POSIX path an image?
+ * Uses the image type classifier directly, avoiding any per-file Objective C
+ * object creation. May be called on any thread.
+\******************************************************************************/
+
+static bool scannerAcceptFile( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+
+    return imageTypeClassifierIsImageFile( fullPath, leafname, SNIFF_EXTENSIONLESS_IMAGES );
+}
+
+/******************************************************************************\
+ * scannerDescendInto()
+ *
+ * FolderScanner callback - should the directory at the given full POSIX path
+ * be scanned? Package-like directories (e.g. applications) are skipped if
+ * SKIP_PACKAGES says so. Most directories are classified by leafname and
+ * bundle bit alone; see isLikeAPackage(). May be called on any thread.
+\******************************************************************************/
+
+static bool scannerDescendInto( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+
+    if ( ! SKIP_PACKAGES ) return true;
+
+    switch ( imageTypeClassifyPackage( fullPath, leafname ) )
+    {
+        case imageTypeClassYes: return false;
+        case imageTypeClassNo:  return true;
+        default:                break;
+    }
+
+    @autoreleasepool
+    {
+        return ! isLikeAPackage( @( fullPath ) );
+    }
+}
+
+/******************************************************************************\
+ * scannerFoundFile()
+ *
+ * FolderScanner callback - offer the found image's full POSIX path to the
+ * ReservoirSampler given as the context. Calls for any one scan are serialised
+ * by the scanner, so no locking is needed here.
+\******************************************************************************/
+
+static bool scannerFoundFile( void * context, const char * fullPath, uint64_t size )
+{
+    ( void ) size;
+
+    return reservoirSamplerOffer( ( ReservoirSampler * ) context, fullPath );
+}
+
+/******************************************************************************\
+ * createImageFromPreview()
+ *
+ * Decode a JPEG preview embedded in an image file (see "EmbeddedPreview.h"),
+ * reducing it further if it is still bigger than the target needs, and
+ * cropping it to its content area if it is letterboxed or pillarboxed.
+ *
+ * In:  Full POSIX path of the image file;
+ *
+ *      Pointer to the preview's description;
+ *
+ *      Size of the target area in device pixels;
+ *
+ *      true if a square crop will be drawn over the target, false if the whole
+ *      image will be fitted within it.
+ *
+ * Out: Decoded preview, which the caller must release, or NULL on failure.
+\******************************************************************************/
+
+static CGImageRef createImageFromPreview( const char * path, const EmbeddedPreview * preview, CGSize target, bool crop )
+{
+    NSMutableData * data   = [ NSMutableData dataWithLength: ( NSUInteger ) preview->length ];
+    CGImageRef      image  = NULL;
+    int             fd     = open( path, O_RDONLY );
+
+    if ( fd < 0 || data == nil ) return NULL;
+
+    ssize_t got = pread( fd, [ data mutableBytes ], ( size_t ) preview->length, ( off_t ) preview->offset );
+    close( fd );
+
+    if ( got != ( ssize_t ) preview->length ) return NULL;
+
+    CGImageSourceRef source = CGImageSourceCreateWithData( ( __bridge CFDataRef ) data, NULL );
+    if ( source == NULL ) return NULL;
+
+    /* Plan for the picture area alone; the same scale then applies to the
+     * whole preview, bars and all.
+     */
+
+    ReducedDecodePlan plan;
+    reducedDecodePlan( preview->contentWidth, preview->contentHeight, target.width, target.height, crop, &plan );
+
+    if ( plan.maximumPixelSize == 0 )
+    {
+        image = CGImageSourceCreateImageAtIndex( source, 0, NULL );
+    }
+    else
+    {
+        uint32_t longer = MAX( preview->width, preview->height );
+
+        NSDictionary * options =
+        @{
+            ( id ) kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+            ( id ) kCGImageSourceCreateThumbnailWithTransform:   @NO,
+            ( id ) kCGImageSourceThumbnailMaxPixelSize:          @( ( uint32_t ) ceil( longer * plan.scale ) ),
+            ( id ) kCGImageSourceShouldCacheImmediately:         @YES
+        };
+
+        image = CGImageSourceCreateThumbnailAtIndex( source, 0, ( __bridge CFDictionaryRef ) options );
+    }
+
+    CFRelease( source );
+
+    /* Cut away any letterbox or pillarbox bars, rounding inwards */
+
+    if ( image != NULL && ( preview->contentWidth  != preview->width ||
+                            preview->contentHeight != preview->height ) )
+    {
+        double scaleX = ( double ) CGImageGetWidth ( image ) / preview->width;
+        double scaleY = ( double ) CGImageGetHeight( image ) / preview->height;
+        double left   = ceil ( preview->contentX * scaleX );
+        double top    = ceil ( preview->contentY * scaleY );
+        double right  = floor( ( preview->contentX + preview->contentWidth  ) * scaleX );
+        double bottom = floor( ( preview->contentY + preview->contentHeight ) * scaleY );
+
+        CGImageRef content = CGImageCreateWithImageInRect( image, CGRectMake( left, top, right - left, bottom - top ) );
+
+        CGImageRelease( image );
+        image = content;
+    }
+
+    return image;
+}
+
+/******************************************************************************\
+ * createImageForTarget()
+ *
+ * Decode an image from an image source at the smallest size which still covers
+ * the target area, rather than at full size; see "ReducedDecode.h". If the
+ * file carries an embedded preview (an EXIF thumbnail, MPF preview or camera
+ * RAW preview) which is big enough, that is decoded instead and the main image
+ * is not touched; see "EmbeddedPreview.h". Otherwise ImageIO decodes JPEGs at
+ * reduced size in the DCT domain and subsamples other formats as best it can.
+ * For multi-resolution formats (icons), the smallest image in the file which
+ * covers the target is used; for anything else, the first.
+ *
+ * The result is not rotated according to any EXIF orientation and any pixel
+ * aspect ratio is left alone, just as for a full size decode.
+ *
+ * Before decoding, the memory the decode is expected to need is reserved from
+ * the memory governor (see "MemoryGovernor.h"), along with whatever the caller
+ * says it needs alongside it, waiting if the budget is exhausted. ImageIO can
+ * only decode JPEGs at reduced size directly; other formats are charged at
+ * full size, since that is what is decoded before being scaled down.
+ *
+ * In:  Image source;
+ *
+ *      Full POSIX path of the file the source reads from;
+ *
+ *      Size of the target area in device pixels;
+ *
+ *      true if a square crop will be drawn over the target, false if the whole
+ *      image will be fitted within it;
+ *
+ *      Pointer to a size_t updated with the index of the decoded image in the
+ *      source, for reading its properties;
+ *
+ *      Pointer to a size_t holding the number of bytes the caller needs while
+ *      it uses the decoded image (e.g. for a bitmap to draw it into), updated
+ *      with the total reserved from the memory governor as a decode kind
+ *      reservation. Unless the result is NULL, in which case nothing remains
+ *      reserved and this is set to 0, the caller must release it after
+ *      releasing the image.
+ *
+ * Out: Decoded image, which the caller must release, or NULL on failure.
+\******************************************************************************/
+
+static CGImageRef createImageForTarget( CGImageSourceRef source, const char * path, CGSize target, bool crop, size_t * index, size_t * reserved )
+{
+    CFStringRef type   = CGImageSourceGetType ( source );
+    size_t      count  = CGImageSourceGetCount( source );
+    size_t      chosen = 0;
+    uint32_t    width  = 0;
+    uint32_t    height = 0;
+
+    BOOL multiResolution = type != NULL &&
+                           ( UTTypeConformsTo( type, kUTTypeAppleICNS ) ||
+                             UTTypeConformsTo( type, kUTTypeICO       ) );
+
+    for ( size_t item = 0; item < ( multiResolution ? count : MIN( count, 1 ) ); item ++ )
+    {
+        NSDictionary * properties = ( __bridge_transfer NSDictionary * /* Toll-free bridge */ )
+        CGImageSourceCopyPropertiesAtIndex( source, item, NULL );
+
+        uint32_t w = [ properties[ ( id ) kCGImagePropertyPixelWidth  ] unsignedIntValue ];
+        uint32_t h = [ properties[ ( id ) kCGImagePropertyPixelHeight ] unsignedIntValue ];
+
+        /* Prefer the smallest image which covers the target; failing that,
+         * the largest image there is.
+         */
+
+        BOOL covers     = reducedDecodeCovers( w, h, target.width, target.height, crop );
+        BOOL bestCovers = reducedDecodeCovers( width, height, target.width, target.height, crop );
+
+        if ( item == 0 ||
+             (   covers &&   bestCovers && ( uint64_t ) w * h < ( uint64_t ) width * height ) ||
+             (   covers && ! bestCovers                                                     ) ||
+             ( ! covers && ! bestCovers && ( uint64_t ) w * h > ( uint64_t ) width * height ) )
+        {
+            chosen = item;
+            width  = w;
+            height = h;
+        }
+    }
+
+    *index = chosen;
+
+    ReducedDecodePlan plan;
+    reducedDecodePlan( width, height, target.width, target.height, crop, &plan );
+
+    size_t     callerBytes = *reserved;
+    size_t     fullBytes   = memoryGovernorImageBytes( width, height );
+    CGImageRef image       = NULL;
+
+    if ( plan.maximumPixelSize == 0 )
+    {
+        *reserved = callerBytes + fullBytes;
+        reserveMemory( memoryGovernorDecode, *reserved );
+
+        image = CGImageSourceCreateImageAtIndex( source, chosen, NULL );
+    }
+    else
+    {
+        size_t outputBytes = memoryGovernorImageBytes( width * plan.scale, height * plan.scale );
+
+        /* Try for an embedded preview which is big enough. Previews share the
+         * main image's orientation, so its metadata still applies.
+         */
+
+        EmbeddedPreview preview;
+
+        if ( multiResolution == NO && path != NULL &&
+             embeddedPreviewFind( path, width, height, target.width, target.height, crop, &preview ) )
+        {
+            *reserved = callerBytes + outputBytes + memoryGovernorImageBytes( preview.width, preview.height );
+            reserveMemory( memoryGovernorDecode, *reserved );
+
+            image = createImageFromPreview( path, &preview, target, crop );
+
+            if ( image == NULL ) memoryGovernorRelease( memoryGovernorDecode, *reserved );
+        }
+
+        /* Always decode from the full image, never from any small embedded
+         * thumbnail, which may be of far too low a resolution.
+         */
+
+        if ( image == NULL )
+        {
+            NSDictionary * options =
+            @{
+                ( id ) kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                ( id ) kCGImageSourceCreateThumbnailWithTransform:   @NO,
+                ( id ) kCGImageSourceThumbnailMaxPixelSize:          @( plan.maximumPixelSize ),
+                ( id ) kCGImageSourceShouldCacheImmediately:         @YES
+            };
+
+            size_t decodeBytes = fullBytes;
+
+            if ( type != NULL && UTTypeConformsTo( type, kUTTypeJPEG ) )
+            {
+                decodeBytes = memoryGovernorImageBytes
+                (
+                    ceil( ( double ) width  / plan.jpegScaleDenominator ),
+                    ceil( ( double ) height / plan.jpegScaleDenominator )
+                );
+            }
+
+            *reserved = callerBytes + outputBytes + decodeBytes;
+            reserveMemory( memoryGovernorDecode, *reserved );
+
+            image = CGImageSourceCreateThumbnailAtIndex( source, chosen, ( __bridge CFDictionaryRef ) options );
+        }
+    }
+
+    if ( image == NULL )
+    {
+        memoryGovernorRelease( memoryGovernorDecode, *reserved );
+        *reserved = 0;
+    }
+
+    return image;
+}
+
+/******************************************************************************\
+ * isOpaque()
+ *
+ * Out: true if an image's pixel format has no alpha channel, else false.
+\******************************************************************************/
+
+static bool isOpaque( CGImageRef image )
+{
+    CGImageAlphaInfo alphaInfo = CGImageGetAlphaInfo( image );
+
+    return alphaInfo == kCGImageAlphaNone         ||
+           alphaInfo == kCGImageAlphaNoneSkipFirst ||
+           alphaInfo == kCGImageAlphaNoneSkipLast;
+}
+
+/******************************************************************************\
+ * createThumbnail()
+ *
+ * Decode an image and draw it, oriented and cropped or fitted as required,
+ * into a new bitmap of (at most) the given pixel size. The result is what
+ * ThumbnailCache holds; drawing it into the target is then little more than a
+ * copy.
+ *
+ * EXIF rotation is in the metadata and the decoders ignore it, so there is
+ * more to do than just decoding. If we used NSImage this would all go away,
+ * but tests of early NSImage-based code showed it was very much slower than
+ * CoreGraphics.
+ *
+ * Orientation, pixel aspect ratio, cropping and scaling are combined into one
+ * transformation by reducedDecodeOrient() (see "ReducedDecode.h") and the
+ * decoded image is drawn once, straight into the thumbnail bitmap. No full
+ * size copy is made. The memory for the decode and the bitmap is reserved
+ * from the memory governor beforehand and released once drawing is done; the
+ * thumbnail itself belongs to ThumbnailCache, which has a budget of its own.
+ *
+ * In:  Full POSIX path of the image to load;
+ *
+ *      Thumbnail size in pixels;
+ *
+ *      How to fit the image into that size. In "fit" mode the thumbnail is
+ *      smaller than the given size along one axis for non-square images.
+ *
+ * Out: Thumbnail which the caller must release, or NULL on failure.
+\******************************************************************************/
+
+static CGImageRef createThumbnail( CFStringRef fullPosixPath, CGSize pixelSize, ThumbnailCacheMode mode )
+{
+    /* Turn the POSIX path into a URL, the URL into an image source and the
+     * image source into an image object based on index 0 from the source
+     * file (i.e. for multi-page TIFFs etc., take the first of however many
+     * sub-images are contained within; for icon files, which hold the same
+     * picture at several sizes, createImageForTarget() picks one that's big
+     * enough). The image is decoded at no more than the size needed to cover
+     * the thumbnail.
+     */
+
+    CGImageSourceRef imageSource = NULL;
+    CGImageRef       image       = NULL;
+    CGImageRef       thumbnail   = NULL;
+    size_t           imageIndex  = 0;
+    size_t           reserved    = memoryGovernorImageBytes( pixelSize.width, pixelSize.height );
+    CFURLRef         url         = CFURLCreateWithFileSystemPath
+    (
+        kCFAllocatorDefault,
+        fullPosixPath,
+        kCFURLPOSIXPathStyle,
+        false
+    );
+
+    if ( url         ) imageSource = CGImageSourceCreateWithURL( url, NULL );
+    if ( imageSource ) image       = createImageForTarget
+                                     (
+                                         imageSource,
+                                         [ ( __bridge NSString * ) fullPosixPath fileSystemRepresentation ],
+                                         pixelSize,
+                                         mode == thumbnailCacheModeCrop,
+                                         &imageIndex,
+                                         &reserved
+                                     );
+    if ( image       )
+    {
+        size_t width  = CGImageGetWidth  ( image );
+        size_t height = CGImageGetHeight ( image );
+
+        CGFloat x           = 1;
+        CGFloat y           = 1;
+        int     orientation = 1;
+
+        NSDictionary * metadata = (__bridge_transfer  NSDictionary * /* Toll-free bridge */ )
+        CGImageSourceCopyPropertiesAtIndex( imageSource, imageIndex, NULL );
+
+        if ( metadata )
+        {
+            NSNumber * val;
+            CGFloat    dpi, xdpi, ydpi;
+
+            val  = metadata[ ( id ) kCGImagePropertyDPIWidth ];
+            dpi  = val.floatValue;
+            xdpi = ( dpi == 0 ) ? 72.0 : dpi;
+
+            val  = metadata[ ( id ) kCGImagePropertyDPIHeight ];
+            dpi  = val.floatValue;
+            ydpi = ( dpi == 0 ) ? 72.0 : dpi;
+
+            val  = metadata[ ( id ) kCGImagePropertyOrientation ];
+            orientation = val.intValue;
+            if ( orientation < 1 || orientation > 8 ) orientation = 1;
+
+            x = ( ydpi > xdpi ) ? ydpi / xdpi : 1;
+            y = ( xdpi > ydpi ) ? xdpi / ydpi : 1;
+        }
+
+        /* Work out the thumbnail's size and how to orient, correct, crop or
+         * fit and scale the image into it, all in one transformation.
+         */
+
+        ReducedDecodeDraw draw;
+
+        reducedDecodeOrient
+        (
+            ( uint32_t ) width,
+            ( uint32_t ) height,
+            ( unsigned int ) orientation,
+            x,
+            y,
+            pixelSize.width,
+            pixelSize.height,
+            ( ReducedDecodeFit ) mode,
+            &draw
+        );
+
+        size_t contextWidth  = draw.width;
+        size_t contextHeight = draw.height;
+
+        /* The image always covers the whole thumbnail, so an opaque image
+         * gives an opaque thumbnail. Say so in its format; the compositor
+         * can then use a cached shadow for it (see "SpriteCache.h").
+         */
+
+        CGImageAlphaInfo alphaInfo  = isOpaque( image ) ? kCGImageAlphaNoneSkipFirst
+                                                        : kCGImageAlphaPremultipliedFirst;
+        CGColorSpaceRef  colorSpace = CGColorSpaceCreateDeviceRGB();
+        CGContextRef     context    = NULL;
+
+        if ( colorSpace )
+        {
+            context = CGBitmapContextCreate
+            (
+                NULL,
+                contextWidth,
+                contextHeight,
+                8,                /* Bits per component */
+                contextWidth * 4, /* Bytes per row      */
+                colorSpace,
+                alphaInfo
+            );
+
+            CGColorSpaceRelease( colorSpace );
+        }
+
+        if ( context )
+        {
+            CGContextSetInterpolationQuality( context, kCGInterpolationHigh );
+
+            CGContextConcatCTM
+            (
+                context,
+                CGAffineTransformMake
+                (
+                    draw.transform.a,
+                    draw.transform.b,
+                    draw.transform.c,
+                    draw.transform.d,
+                    draw.transform.tx,
+                    draw.transform.ty
+                )
+            );
+
+            CGContextDrawImage( context, CGRectMake( 0, 0, width, height ), image );
+
+            thumbnail = CGBitmapContextCreateImage( context );
+            CFRelease( context );
+        }
+    }
+
+    /* Make sure everything is released */
+
+    if ( image       ) CFRelease( image       );
+    if ( imageSource ) CFRelease( imageSource );
+    if ( url         ) CFRelease( url         );
+
+    if ( image       ) memoryGovernorRelease( memoryGovernorDecode, reserved );
+
+    return thumbnail;
+}
+
+/******************************************************************************\
+ * thumbnailRect()
+ *
+ * Work out where a thumbnail made by createThumbnail() is drawn within a
+ * rectangle. Cropped or stretched thumbnails fill the rectangle; fitted ones
+ * are centred within it with their aspect ratio intact, so not all of a square
+ * rectangle will be painted upon for non-square images.
+ *
+ * In:  Thumbnail;
+ *
+ *      Rectangle to draw into;
+ *
+ *      true if the thumbnail was made in "fit" mode, else false.
+ *
+ * Out: Rectangle the thumbnail covers.
+\******************************************************************************/
+
+static CGRect thumbnailRect( CGImageRef image, CGRect rect, bool maintainAspectRatio )
+{
+    if ( maintainAspectRatio )
+    {
+        /* Adjust the plotting rectangle to avoid image cropping */
+
+        size_t  width      = CGImageGetWidth  ( image );
+        size_t  height     = CGImageGetHeight ( image );
+        CGFloat rectWidth  = rect.size.width;
+        CGFloat rectHeight = rect.size.height;
+
+        if ( width > height )
+        {
+            CGFloat scaledHeight = height * ( rectWidth / width );
+            CGFloat yOffset      = ( rectHeight - scaledHeight ) / 2;
+
+            rect.origin.y    += yOffset;
+            rect.size.height  = scaledHeight;
+        }
+        else
+        {
+            CGFloat scaledWidth = width * ( rectHeight / height );
+            CGFloat xOffset     = ( rectWidth - scaledWidth ) / 2;
+
+            rect.origin.x   += xOffset;
+            rect.size.width  = scaledWidth;
+        }
+    }
+
+    return rect;
+}
+
+#ifdef USE_RASTER_ENGINE
+
+/******************************************************************************\
+ * drawThumbnailWithRasterEngine()
+ *
+ * Draw a thumbnail into a slot with the portable raster engine rather than
+ * CoreGraphics - border, rotation and shadow included. The thumbnail is
+ * copied into the engine's pixel format first.
+ *
+ * In:  Bitmap context to draw into, created with premultiplied-first alpha;
+ *
+ *      Thumbnail to draw;
+ *
+ *      Slot to draw into, in context pixels;
+ *
+ *      Pointer to a description of how to draw it.
+\******************************************************************************/
+
+static void drawThumbnailWithRasterEngine( CGContextRef context, CGImageRef image, CGRect slot, const RasterThumbnailStyle * style )
+{
+    RasterImage canvas;
+    RasterImage thumbnail;
+    size_t      width  = CGImageGetWidth ( image );
+    size_t      height = CGImageGetHeight( image );
+
+    if ( ! rasterImageCreate( &thumbnail, ( uint32_t ) width, ( uint32_t ) height ) ) return;
+
+    CGContextRef    thumbnailContext = NULL;
+    CGColorSpaceRef colorSpace       = CGColorSpaceCreateDeviceRGB();
+
+    if ( colorSpace )
+    {
+        thumbnailContext = CGBitmapContextCreate
+        (
+            thumbnail.pixels,
+            width,
+            height,
+            8,
+            thumbnail.rowBytes,
+            colorSpace,
+            kCGImageAlphaPremultipliedFirst
+        );
+
+        CGColorSpaceRelease( colorSpace );
+    }
+
+    if ( thumbnailContext )
+    {
+        CGContextDrawImage( thumbnailContext, CGRectMake( 0, 0, width, height ), image );
+        CFRelease( thumbnailContext );
+
+        /* Make sure everything CoreGraphics has drawn so far is in memory */
+
+        CGContextFlush( context );
+
+        rasterImageWrap
+        (
+            &canvas,
+            CGBitmapContextGetData       ( context ),
+            ( uint32_t ) CGBitmapContextGetWidth ( context ),
+            ( uint32_t ) CGBitmapContextGetHeight( context ),
+            CGBitmapContextGetBytesPerRow( context )
+        );
+
+        rasterDrawThumbnail
+        (
+            &canvas,
+            slot.origin.x,
+            slot.origin.y,
+            slot.size.width,
+            slot.size.height,
+            &thumbnail,
+            style
+        );
+    }
+
+    rasterImageFree( &thumbnail );
+}
+
+#endif
+
+/* Thumbnail geometry for the custom icon styles, in canvas pixels; see
+ * -getThumbnailGeometry:.
+ */
+
+typedef struct ThumbnailGeometry
+{
+    NSUInteger canvasSize;
+    CGFloat    thumbSize;    /* Of the square each thumbnail is laid out in */
+    CGFloat    borderSize;   /* Of the white border square, if any, else 0  */
+    CGSize     shadowOffset;
+    CGFloat    shadowBlur;   /* 0 for no shadow                             */
+
+} ThumbnailGeometry;
+
+static NSString * decodedThumbnailKey( NSString * path, CGSize pixelSize, ThumbnailCacheMode mode );
+
 @interface CustomIconGenerator()
 
 - ( NSArray    * ) allocFoundImagePathArray: ( NSError      ** ) error;
 
-- ( BOOL         )             paintImageAt: ( CFStringRef     ) fullPosixPath
-                                   intoRect: ( CGRect          ) rect
-                               usingContext: ( CGContextRef    ) context
+- ( CGImageRef   )        allocThumbnailFor: ( NSString      * ) path
+                                  pixelSize: ( CGSize          ) pixelSize
                      maintainingAspectRatio: ( BOOL            ) maintainAspectRatio;
 
+- ( CGImageRef   )        allocThumbnailFor: ( NSString      * ) path
+                                  pixelSize: ( CGSize          ) pixelSize
+                                       mode: ( ThumbnailCacheMode ) mode;
+
+- ( void         )     getThumbnailGeometry: ( ThumbnailGeometry * ) geometry;
+
+- ( void         )                 getSlots: ( CGRect        * ) slots
+                          forThumbnailCount: ( NSUInteger      ) count;
+
 - ( CGImageRef   )      allocCustomIconFrom: ( NSArray       * ) chosenImages
                              withBackground: ( CGImageRef      ) backgroundImage
                                    errorsTo: ( NSError      ** ) error;
@@ -104,6 +956,15 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
                                    errorsTo: ( NSError      ** ) error;
 
 @property CGImageRef backgroundImage;
+@property CoverArtResolver * coverArtResolver;
+
+/* Thumbnails made in advance by -decodeImages:, keyed by
+ * decodedThumbnailKey(); values are CGImageRefs. Set only between that call
+ * and the end of -composeIconFrom:errorsTo:, and never changed while being
+ * read.
+ */
+
+@property ( copy ) NSDictionary * decodedThumbnails;
 
 @end
 
@@ -158,9 +1019,12 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
 
         _coverArtFilenames                  = [ [ NSArray alloc ] initWithArray: filenames copyItems: YES ];
         _useColourLabelsToIdentifyCoverArt  = [ defaults boolForKey: @"colourLabelsIndicateCoverArt" ];
+        _coverArtResolver                   = [ [ CoverArtResolver alloc ] initWithLeafnames: _coverArtFilenames
+                                                                             useColourLabels: _useColourLabelsToIdentifyCoverArt ];
 
         _makeBackgroundOpaque               = NO;
         _nonRandomImageSelectionForAPreview = NO;
+        _imageSelectionSeed                 = ( ( uint64_t ) arc4random() << 32 ) | arc4random();
 
         if ( _iconStyle.usesSlipCover.boolValue == YES )
         {
@@ -179,29 +1043,110 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
 
         _backgroundImage = [ ( Add_Folder_IconsAppDelegate * ) [ NSApp delegate ] standardFolderIcon ];
 
+        establishMemoryBudget();
+
         /* This is a lazy-initialised static variable defined towards the top
          * of this source file.
          */
 
-        if ( locations == NULL )
-        {
-            if ( [ [ NSProcessInfo processInfo ] respondsToSelector: @selector( operatingSystemVersion ) ] )
-            {
-                /* The above interface only exists in OS X 10.10 or later and,
-                 * happily, that's the version at which we change our position
-                 * matrix for the thumbnails.
-                 */
+        if ( locations == NULL )
+        {
+            if ( [ [ NSProcessInfo processInfo ] respondsToSelector: @selector( operatingSystemVersion ) ] )
+            {
+                /* The above interface only exists in OS X 10.10 or later and,
+                 * happily, that's the version at which we change our position
+                 * matrix for the thumbnails.
+                 */
+
+                locations = locations_os_x_10_10_or_later;
+            }
+            else
+            {
+                locations = locations_os_x_10_6_to_10_9;
+            }
+        }
+    }
+
+    return self;
+}
+
+/******************************************************************************\
+ * +sharedScanIndex
+ *
+ * Return the persistent scan index shared by all folder scans in this process,
+ * or NULL if there isn't one. See sharedScanIndex() for details.
+\******************************************************************************/
+
++ ( struct ScanIndex * ) sharedScanIndex
+{
+    return sharedScanIndex();
+}
+
+/******************************************************************************\
+ * +sharedThumbnailCache
+ *
+ * Return the decoded thumbnail cache shared by all generators in this process.
+ * See sharedThumbnailCache() for details.
+\******************************************************************************/
+
++ ( ThumbnailCache * ) sharedThumbnailCache
+{
+    return sharedThumbnailCache();
+}
+
+/******************************************************************************\
+ * +sharedSpriteCache
+ *
+ * Return the shadow and border sprite cache shared by all generators in this
+ * process. See sharedSpriteCache() for details.
+\******************************************************************************/
+
++ ( SpriteCache * ) sharedSpriteCache
+{
+    return sharedSpriteCache();
+}
+
+/******************************************************************************\
+ * +sharedBasePlateCache
+ *
+ * Return the icon background base plate cache shared by all generators in
+ * this process. See sharedBasePlateCache() for details.
+\******************************************************************************/
+
++ ( BasePlateCache * ) sharedBasePlateCache
+{
+    return sharedBasePlateCache();
+}
+
+/******************************************************************************\
+ * -onlyUsesCoverArt
+ *
+ * We consider ourselves in cover art mode if using that flag explicitly or if
+ * using SlipCover code for icon generation.
+ *
+ * Out: YES if only cover art in the folder itself is used, else NO.
+\******************************************************************************/
+
+- ( BOOL ) onlyUsesCoverArt
+{
+    return self.iconStyle.onlyUseCoverArt.boolValue |
+           self.iconStyle.usesSlipCover.boolValue;
+}
+
+/******************************************************************************\
+ * -maximumImages
+ *
+ * Out: The number of images wanted by the icon style; 1 to 4.
+\******************************************************************************/
+
+- ( NSUInteger ) maximumImages
+{
+    NSUInteger maxImages = self.iconStyle.maxImages.unsignedIntegerValue;
 
-                locations = locations_os_x_10_10_or_later;
-            }
-            else
-            {
-                locations = locations_os_x_10_6_to_10_9;
-            }
-        }
-    }
+    if      ( maxImages < 1 ) maxImages = 1;
+    else if ( maxImages > 4 ) maxImages = 4;
 
-    return self;
+    return maxImages;
 }
 
 /******************************************************************************\
@@ -215,16 +1160,19 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
  * Images may be enumerated from the given directory freely, or be constrainted
  * by some of the settings in this instance's configured icon style. Results
  * are always narrowed down to a collection no larger than the icon style's
- * "maxImages" property. The order of results will always be random even if
- * there were fewer images found than this maximum; results of this call thus
- * may differ from call to call even if most other parameters are equal. This
- * can be prevented by setting the nonRandomImageSelectionForAPreview property
- * to YES prior to calling. Returned results are then drawn sequentially from
- * the found pool, in order of enumeration.
+ * "maxImages" property. In multiple image mode this is a uniform random sample
+ * over every image found, taken in a single pass while scanning, so only that
+ * many paths are ever held in memory. The order of results will always be
+ * random even if there were fewer images found than this maximum; results of
+ * this call thus may differ from call to call unless the imageSelectionSeed
+ * property is set to the same value each time. Alternatively, setting the
+ * nonRandomImageSelectionForAPreview property to YES prior to calling returns
+ * the first images found, in order of enumeration.
  *
  * This function allows re-entrant callers from multiple threads using
- * independent execution contexts, as it protects thread-sensitive sections
- * using the global semaphore.
+ * independent execution contexts. Multiple image searches run in parallel,
+ * each with its own wall-clock time budget; cover art searches which have to
+ * read the folder are serialised using the global semaphore.
  *
  * In:  ( NSError ** ) error
  *      Pointer to an NSError *, which is filled in with 'nil' if no errors
@@ -237,32 +1185,33 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
 
 - ( NSArray * ) allocFoundImagePathArray: ( NSError ** ) error
 {
-    NSFileManager  * fileMgr      = [ [ NSFileManager alloc ] init ]; /* http://developer.apple.com/mac/library/documentation/Cocoa/Reference/Foundation/Classes/NSFileManager_Class/Reference/Reference.html */
     NSString       * enumPath     = _posixPath;
-    NSString       * currFile;
     NSMutableArray * images       = [ NSMutableArray arrayWithCapacity: 0 ];
-    NSMutableArray * chosenImages = nil;
+    NSArray        * chosenImages = nil;
     BOOL             failed       = NO;
 
     errno = 0;
     if ( error ) *error = nil;
 
-    /* We consider ourselves in cover art mode if using that flag explicitly or
-     * if using SlipCover code for icon generation.
-     */
+    /* See -onlyUsesCoverArt and -maximumImages */
+
+    BOOL       onlyUseCoverArt = self.onlyUsesCoverArt;
+    NSUInteger maxImages       = self.maximumImages;
 
-    BOOL onlyUseCoverArt = self.iconStyle.onlyUseCoverArt.boolValue |
-                           self.iconStyle.usesSlipCover.boolValue;
+    srandomdev(); /* Randomise the random number generator */
 
-    /* Directory enumeration is needed in multiple image mode and may be needed
-     * in cover art mode; besides, this gives us a quick way to discover if the
-     * path to the folder seems to be invalid.
+    /* Check up front that the folder exists and can be read, so that an
+     * invalid path is reported the same way whichever mode is in use.
      */
 
-    NSDirectoryEnumerator * dirEnum  = [ fileMgr enumeratorAtPath: enumPath ];
-    NSDictionary          * dirAttrs = [ dirEnum directoryAttributes ];
+    struct stat   folderInfo;
+    const char  * folderPath     = [ enumPath fileSystemRepresentation ];
+    BOOL          folderReadable = folderPath != NULL                          &&
+                                   stat( folderPath, &folderInfo ) == 0        &&
+                                   S_ISDIR( folderInfo.st_mode )               &&
+                                   access( folderPath, R_OK | X_OK ) == 0;
 
-    if ( ! dirAttrs )
+    if ( ! folderReadable )
     {
         if ( error )
         {
@@ -277,7 +1226,7 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
                                       userInfo: dict ];
         }
 
-        __Require( dirAttrs, nothingToDo );
+        __Require( folderReadable, nothingToDo );
     }
 
     /* Look for image files. The search is exited early if a certain number
@@ -287,215 +1236,109 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
 
     if ( onlyUseCoverArt )
     {
-        /* Although we got hold of a directory enumerator earlier, we get
-         * a new one here as we're only interested in finding the right
-         * label colour or files with the right start to their names.
-         * Subdirectories are explicitly NOT scanned.
+        /* Only the folder itself is searched, for an image with the right
+         * label colour or leafname; likely leafnames are probed for directly
+         * and the folder is only read if need be. See "CoverArtResolver.h".
          */
 
-        NSString * found         = nil;
-        NSURL    * enumPathAsURL = [ [ NSURL alloc ] initFileURLWithPath: enumPath
-                                                             isDirectory: YES ];
-
-        dirEnum = [ fileMgr enumeratorAtURL: enumPathAsURL
-                 includingPropertiesForKeys: @[
-                                                 NSURLIsDirectoryKey,
-                                                 NSURLIsRegularFileKey,
-                                                 NSURLLabelColorKey,
-                                                 NSURLLabelNumberKey
-                                             ]
-                                    options: NSDirectoryEnumerationSkipsHiddenFiles
-                               errorHandler: nil ];
-
-        @try
-        {
-            /* Semaphore use rationale - see multiple image code below */
-
-            globalSemaphoreClaim();
+        NSError  * resolverError = nil;
+        NSString * found         = [ self.coverArtResolver coverArtIn: enumPath
+                                                                error: &resolverError ];
 
-            for ( NSURL * theURL in dirEnum )
-            {
-                NSString * fullPath = [ theURL path ];
-
-                /* Extract the cached directory and color label data */
-
-                NSError      * resourceError = nil;
-                NSDictionary * info          =
-                [
-                    theURL resourceValuesForKeys: @[
-                                                      NSURLIsDirectoryKey,
-                                                      NSURLIsRegularFileKey,
-                                                      NSURLLabelColorKey,
-                                                      NSURLLabelNumberKey
-                                                  ]
-                                           error: &resourceError
-                ];
-
-                /* Assuming no errors, skip subdirectories and look for
-                 * labelled, "cover" or "folder" leafname images.
-                 *
-                 * MAXIMUM_IMAGE_SIZE is not obeyed as we're looking for
-                 * specific leafnames or a colour label in cover art
-                 * mode and the implication is that the user wants us to
-                 * use that image regardless. This is quite different
-                 * from a generic directory scan.
-                 */
-
-                if ( resourceError == nil )
-                {
-                    BOOL       isDirectory;
-                    BOOL       isRegularFile;
-                    NSColor  * labelColour;
-                    NSNumber * labelNumber;
-
-                    isDirectory   = [ info[ @"NSURLIsDirectoryKey"   ] boolValue ];
-                    isRegularFile = [ info[ @"NSURLIsRegularFileKey" ] boolValue ];
-                    labelColour   =   info[ @"NSURLLabelColorKey"    ];
-                    labelNumber   =   info[ @"NSURLLabelNumberKey"   ];
-
-                    if ( isDirectory == YES )
-                    {
-                        [ dirEnum skipDescendants ];
-                    }
-                    else if ( isRegularFile == YES && isImageFile( fullPath ) == YES )
-                    {
-                        NSString * leaf = [ [ fullPath lastPathComponent ] stringByDeletingPathExtension ];
-
-                        if (
-                               self.useColourLabelsToIdentifyCoverArt &&
-                               (
-                                   labelColour != nil ||
-                                   [ labelNumber integerValue ] > 0
-                               )
-                           )
-                        {
-                            found = fullPath;
-                            break;
-                        }
-
-                        NSUInteger foundIndex =
-                        [
-                            self.coverArtFilenames indexOfObjectWithOptions: NSEnumerationConcurrent
-                            passingTest: ^BOOL ( NSString * obj, NSUInteger idx, BOOL * stop )
-                            {
-                                if ( [ obj localizedCaseInsensitiveCompare: leaf ] == NSOrderedSame )
-                                {
-                                    *stop = YES;
-                                    return YES;
-                                }
-                                else
-                                {
-                                    return NO;
-                                }
-                            }
-                        ];
-
-                        if ( foundIndex != NSNotFound )
-                        {
-                            found = fullPath;
-                            break;
-                        }
-                    }
-                }
-            }
+        if ( found )
+        {
+            [ images addObject: found ];
         }
-        @catch ( id ignored )
+        else if ( resolverError )
         {
             if ( error )
             {
                 NSDictionary * dict =
                 @{
                     NSLocalizedDescriptionKey:        @"Unable to generate icon",
-                    NSLocalizedFailureReasonErrorKey: @"An unexpected internal error occured while reading the folder contents"
+                    NSLocalizedFailureReasonErrorKey: @"An unexpected internal error occured while reading the folder contents",
+                    NSUnderlyingErrorKey:             resolverError
                 };
 
-                *error = [ NSError errorWithDomain: NSPOSIXErrorDomain
-                                              code: errno
+                *error = [ NSError errorWithDomain: [ resolverError domain ]
+                                              code: [ resolverError code   ]
                                           userInfo: dict ];
             }
 
             failed = YES;
         }
-        @finally
+    }
+    else if ( self.precomputedImages != nil )
+    {
+        /* A walk of some larger folder tree has already chosen the images */
+
+        NSArray * precomputed = self.precomputedImages;
+
+        if ( [ precomputed count ] > maxImages )
         {
-            globalSemaphoreRelease();
+            precomputed = [ precomputed subarrayWithRange: NSMakeRange( 0, maxImages ) ];
         }
 
-        if ( found ) [ images addObject: found ];
+        [ images addObjectsFromArray: precomputed ];
     }
     else /* "if ( onlyUseCoverArt )" */
     {
-        srandomdev(); /* Randomise the random number generator */
-
-        /* Directory scanning is timed to avoid excessively long / deep folder
-         * recursion holding up process completion. To keep this timer sane, only
-         * one scan is run at a time. This helps avoid excessive filesystem
-         * thrashing in passing (i.e. there's a very good chance that the code
-         * will complete more quickly when this section runs in series rather
-         * than if it attempts to run in parallel).
+        /* Directory scanning is timed against the wall clock to avoid
+         * excessively long / deep folder recursion holding up process
+         * completion, even when blocked on a slow volume. Each scan has its
+         * own budget, so scans for different folders can now run in
+         * parallel without one eating into another's time; see
+         * "FolderScanner.h" for the engine that does the walk.
+         *
+         * Found images are fed straight into a reservoir sampler, which
+         * keeps a uniform random sample of 'maxImages' of them however many
+         * are found, so there is no cap on the number of images considered.
          */
 
-        @try
-        {
-            globalSemaphoreClaim();
-            clock_t startTime = clock();
-
-            while ( ( currFile = [ dirEnum nextObject ] ) )
-            {
-                NSDictionary * currAttrs = [ dirEnum fileAttributes ];
-                if ( ! currAttrs ) continue;
+        ReservoirSampler sampler;
 
-                NSString * fileType = currAttrs[ NSFileType ];
-                NSString * fullPath = [
-                                       enumPath stringByAppendingPathComponent: currFile
-                                       ];
+        reservoirSamplerInit
+        (
+            &sampler,
+            maxImages,
+            self.imageSelectionSeed,
+            self.nonRandomImageSelectionForAPreview
+        );
 
-                /* Only interested in regular files or directories, nothing more. Skip
-                 * directories that appear to have filename extensions because
-                 * they're probably packaged formats of some kind (e.g. applications).
-                 */
+        FolderScannerRoot root =
+        {
+            .path        = [ enumPath fileSystemRepresentation ],
+            .timeLimitMs = MAXIMUM_LOOP_TIME_MS,
+            .foundLimit  = 0,
+            .context     = &sampler
+        };
 
-                if ( [ fileType isEqualToString: NSFileTypeRegular ] )
-                {
-                    if ( isImageFile( fullPath ) == YES )
-                    {
-#ifdef MAXIMUM_IMAGE_SIZE
-                        {
-                            NSNumber * size = currAttrs[ NSFileSize ];
-                            if ( size.unsignedLongLongValue > MAXIMUM_IMAGE_SIZE ) continue;
-                        }
-#endif
+        FolderScannerOptions options =
+        {
+            .threadCount     = SCAN_THREADS_PER_FOLDER,
+            .maximumFileSize = MAXIMUM_IMAGE_SIZE,
+            .index           = sharedScanIndex(),
+            .adaptToVolume   = [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"adaptScanToVolume" ]
+        };
 
-                        [ images addObject: fullPath ];
+        FolderScannerCallbacks callbacks =
+        {
+            .acceptFile  = scannerAcceptFile,
+            .descendInto = scannerDescendInto,
+            .foundFile   = scannerFoundFile
+        };
 
-                        /* Once we have enough images, bail */
+        int scanError = folderScannerRun( &root, 1, &options, &callbacks );
 
-                        if (
-                               MAXIMUM_IMAGES_FOUND != 0 &&
-                               [ images count ] >= MAXIMUM_IMAGES_FOUND
-                           )
-                           break;
-                    }
-                }
-                else if (
-                            SKIP_PACKAGES
-                            && [ fileType isEqualToString: NSFileTypeDirectory ]
-                            && isLikeAPackage( fullPath )
-                        )
-                {
-                    [ dirEnum skipDescendents ];
-                }
+        /* A scan which couldn't start leaves the root untouched, so report
+         * why from the result; otherwise only an unreadable root is a
+         * failure, since running out of time or hitting a cap still leaves
+         * whatever was found to use.
+         */
 
-                /* If we've run for too long, bail */
+        if ( scanError == 0 && root.status == folderScannerStatusError ) scanError = root.error;
 
-                if (
-                       MAXIMUM_LOOP_TIME_TICKS != 0 &&
-                       clock() - startTime >= MAXIMUM_LOOP_TIME_TICKS
-                   )
-                   break;
-            }
-        }
-        @catch ( id ignored )
+        if ( scanError != 0 )
         {
             if ( error )
             {
@@ -506,275 +1349,302 @@ static CGRect (*locations)[4] = NULL; /* Initialised in the constructor */
                 };
 
                 *error = [ NSError errorWithDomain: NSPOSIXErrorDomain
-                                              code: errno
+                                              code: scanError
                                           userInfo: dict ];
             }
 
             failed = YES;
         }
-        @finally
+        else
         {
-            globalSemaphoreRelease();
+            size_t sampleSize = reservoirSamplerFinish( &sampler );
+
+            for ( size_t index = 0; index < sampleSize; index ++ )
+            {
+                [ images addObject: @( reservoirSamplerItem( &sampler, index ) ) ];
+            }
         }
 
+        reservoirSamplerFree( &sampler );
+
     } /* "else" of "if ( onlyUseCoverArt )" */
 
     /* If there are no images, exit; the standard folder icon will be used */
 
     if ( [ images count ] == 0 ) __Require( false, nothingToDo );
 
-    /* Otherwise, choose up to four images at random */
-
-    NSUInteger maxImages = self.iconStyle.maxImages.unsignedIntegerValue;
-
-    if      ( maxImages < 1 ) maxImages = 1;
-    else if ( maxImages > 4 ) maxImages = 4;
+    /* Otherwise, the images found are the ones to use */
 
-    chosenImages = [ [ NSMutableArray alloc ] initWithCapacity: 0 ];
+    chosenImages = [ images copy ];
 
-    while ( [ images count ] > 0 && [ chosenImages count ] < maxImages )
-    {
-        /* Using random() in this way is fine - unlike rand(), all bits are
-         * considered sufficiently random in the generated integer.
-         */
-        
-        NSUInteger randomIndex;
-        
-        if ( self.nonRandomImageSelectionForAPreview == YES ) randomIndex = 0;
-        else                                                  randomIndex = random() % [ images count ];
-        
-        [ chosenImages addObject: images[ randomIndex ] ];
-        [ images removeObjectAtIndex: randomIndex ];
-    }
-    
 nothingToDo:
     
     return chosenImages;
 }
 
 /******************************************************************************\
- * -paintImageAt:intoRect:usingContext:maintainingAspectRatio:
- *
- * Paint an image found at the given fully specified POSIX-style file path
- * into the given rectangle under the given context. The image is cropped to
- * a square before being painted; if the target rectangle is not also square
- * the image will be distorted when painted.
- *
- * Note the prevailing use of Core Foundation / Core Graphics types herein.
+ * -allocThumbnailFor:pixelSize:maintainingAspectRatio:
  *
- * In:  ( CFStringRef ) fullPosixPath
- *      Full POSIX path of the image to load and paint;
+ * Return a thumbnail of the image found at the given fully specified POSIX-
+ * style file path, oriented and cropped to a square (or fitted, maintaining
+ * aspect ratio) at the given size in pixels. It is taken from the shared
+ * ThumbnailCache if possible, else made with createThumbnail() and added to
+ * the cache.
  *
- *      ( CGRect ) rect
- *      Rectangle into which the cropped image should be painted;
+ * In:  ( NSString * ) path
+ *      Full POSIX path of the image;
  *
- *      ( CGContextRef ) context
- *      Core Graphics context for the painting operation;
+ *      ( CGSize ) pixelSize
+ *      Size of the area the thumbnail will be drawn into, in device pixels;
  *
  *      ( BOOL ) maintainAspectRatio
- *      If NO the image is cropped to a square to fill the parameter in 'rect'.
- *      If YES the image is scaled to fit, maintaing aspect ratio, so not all
- *      of the given rectangle will be painted upon for non-square images.
+ *      If NO the image is cropped to a square to fill the given size. If YES
+ *      the image is scaled to fit, maintaing aspect ratio, so the thumbnail is
+ *      smaller than the given size along one axis for non-square images.
  *
- * Out: YES if successful, NO if failed.
+ * Out: Thumbnail which the caller must CFRelease(), or NULL on failure.
 \******************************************************************************/
 
-- ( BOOL ) paintImageAt: ( CFStringRef  ) fullPosixPath
-               intoRect: ( CGRect       ) rect
-           usingContext: ( CGContextRef ) context
- maintainingAspectRatio: ( BOOL         ) maintainAspectRatio
+- ( CGImageRef ) allocThumbnailFor: ( NSString * ) path
+                         pixelSize: ( CGSize     ) pixelSize
+            maintainingAspectRatio: ( BOOL       ) maintainAspectRatio
 {
-    BOOL   success = YES;
-    size_t width, height;
+    return [ self allocThumbnailFor: path
+                          pixelSize: pixelSize
+                               mode: maintainAspectRatio ? thumbnailCacheModeFit
+                                                         : thumbnailCacheModeCrop ];
+}
 
-    /* Turn the POSIX path into a URL, the URL into an image source and the
-     * image source into an image object based on index 0 from the source
-     * file (i.e. for multi-page TIFFs, Icon files etc., take the first of
-     * however many sub-images are contained within).
-     */
+/******************************************************************************\
+ * -allocThumbnailFor:pixelSize:mode:
+ *
+ * As -allocThumbnailFor:pixelSize:maintainingAspectRatio:, but taking the
+ * ThumbnailCache mode directly (so that the stretched SlipCover covers can be
+ * asked for too). A thumbnail made in advance by -decodeImages: is used in
+ * preference to anything else.
+\******************************************************************************/
 
-    CGImageSourceRef imageSource = NULL;
-    CGImageRef       image       = NULL;
-    CFURLRef         url         = CFURLCreateWithFileSystemPath
-    (
-        kCFAllocatorDefault,
-        fullPosixPath,
-        kCFURLPOSIXPathStyle,
-        false
-    );
+- ( CGImageRef ) allocThumbnailFor: ( NSString           * ) path
+                         pixelSize: ( CGSize               ) pixelSize
+                              mode: ( ThumbnailCacheMode   ) mode
+{
+    NSDictionary * decoded = self.decodedThumbnails;
 
-    if ( url         ) imageSource = CGImageSourceCreateWithURL( url, NULL );
-    if ( imageSource ) image       = CGImageSourceCreateImageAtIndex( imageSource, 0, NULL );
-    if ( image       )
+    if ( decoded != nil )
     {
-        width  = CGImageGetWidth  ( image );
-        height = CGImageGetHeight ( image );
-
-        /* EXIF rotation is in the metadata and the above ignores it, so there
-         * is more work to do still. If we used NSImage this would all go away,
-         * but tests of early NSImage-based code showed it was very much slower
-         * than CoreGraphics. Since calculating the correct top-or-middle
-         * cropping rectangles and persuading all the coordinate space
-         * transformations to work properly would be particularly thorny and
-         * open to mistakes for edge case image types, we simply recreate a new
-         * image in the transformed orientation at full size and continue to
-         * work with that later in the code.
-         *
-         * Allocation failures are ignored as correct orientation inside the
-         * thumbnail is not considered critical.
-         *
-         * The code is derived from:
-         *
-         *   http://developer.apple.com/library/mac/#samplecode/MyPhoto/Listings/Step8_ImageView_m.html
-         *   http://developer.apple.com/library/mac/#samplecode/CGRotation/Introduction/Intro.html
-         */
+        CGImageRef image = ( __bridge CGImageRef ) decoded[ decodedThumbnailKey( path, pixelSize, mode ) ];
 
-        NSDictionary * metadata = (__bridge_transfer  NSDictionary * /* Toll-free bridge */ )
-        CGImageSourceCopyPropertiesAtIndex( imageSource, 0, NULL );
-
-        if ( metadata )
-        {
-            NSNumber * val;
-            CGFloat    dpi, xdpi, ydpi;
-            int        orientation;
+        if ( image != NULL ) return CGImageRetain( image ); // Note early exit!
+    }
 
-            val  = metadata[ ( id ) kCGImagePropertyDPIWidth ];
-            dpi  = val.floatValue;
-            xdpi = ( dpi == 0 ) ? 72.0 : dpi;
+    ThumbnailCache * cache = sharedThumbnailCache();
+    CGImageRef       image = [ cache copyImageForPath: path pixelSize: pixelSize mode: mode ];
 
-            val  = metadata[ ( id ) kCGImagePropertyDPIHeight ];
-            dpi  = val.floatValue;
-            ydpi = ( dpi == 0 ) ? 72.0 : dpi;
+    if ( image == NULL )
+    {
+        image = createThumbnail( ( __bridge CFStringRef ) path, pixelSize, mode );
 
-            val  = metadata[ ( id ) kCGImagePropertyOrientation ];
-            orientation = val.intValue;
-            if ( orientation < 1 || orientation > 8 ) orientation = 1;
+        [ cache storeImage: image forPath: path pixelSize: pixelSize mode: mode ];
+    }
 
-            CGFloat x = ( ydpi > xdpi ) ? ydpi / xdpi : 1;
-            CGFloat y = ( xdpi > ydpi ) ? xdpi / ydpi : 1;
+    return image;
+}
 
-            if ( x != 1.0 || y != 1.0 || orientation != 1 )
-            {
-                CGFloat w = x * width;
-                CGFloat h = y * height;
+/******************************************************************************\
+ * -getThumbnailGeometry:
+ *
+ * Work out the size of the square in which each thumbnail of a custom icon is
+ * laid out, along with its border and shadow, according to the icon style.
+ *
+ * In:  ( ThumbnailGeometry * ) geometry
+ *      Updated with the geometry, in canvas pixels (see dpiValue()).
+\******************************************************************************/
 
-                CGAffineTransform ctms[ 8 ] =
-                {
-                    {  x,  0,  0,  y, 0, 0 }, // 1 = row 0 top, col 0 lhs = normal
-                    { -x,  0,  0,  y, w, 0 }, // 2 = row 0 top, col 0 rhs = flip horizontal
-                    { -x,  0,  0, -y, w, h }, // 3 = row 0 bot, col 0 rhs = rotate 180
-                    {  x,  0,  0, -y, 0, h }, // 4 = row 0 bot, col 0 lhs = flip vertical
-                    {  0, -x, -y,  0, h, w }, // 5 = row 0 lhs, col 0 top = rot -90, flip vert
-                    {  0, -x,  y,  0, 0, w }, // 6 = row 0 rhs, col 0 top = rot 90
-                    {  0,  x,  y,  0, 0, 0 }, // 7 = row 0 rhs, col 0 bot = rot 90, flip vert
-                    {  0,  x, -y,  0, h, 0 }  // 8 = row 0 lhs, col 0 bot = rotate -90
-                };
+- ( void ) getThumbnailGeometry: ( ThumbnailGeometry * ) geometry
+{
+    /* Each thumbnail is laid out in a square the size of the whole canvas,
+     * centred on the origin, then scaled into its slot. To start with, set a
+     * thumbnail size to match the entire canvas. As things like shadows,
+     * rotation and border get applied, reduce these values as appropriate to
+     * make sure that the final scaled thumbnail fits within the canvas, even
+     * with any effects applied.
+     */
 
-                /* Create a context big enough to hold the image's actual pixel
-                 * size, regardless of pixel aspect ratio, but accounting for a
-                 * possible rotation at ±90 degrees (orientations 5-8).
-                 */
+    BOOL       onlyUseCoverArt = self.iconStyle.onlyUseCoverArt.boolValue;
+    NSUInteger canvasSize      = dpiValue( CANVAS_SIZE );
+    CGFloat    thumbSize       = canvasSize;
+    CGFloat    borderSize      = 0;
+    CGSize     shadowOffset    = CGSizeZero;
+    CGFloat    shadowBlur      = 0;
 
-                CGContextRef transformationContext;
-                size_t contextWidth, contextHeight;
+    if ( self.iconStyle.randomRotation.boolValue == YES )
+    {
+        thumbSize -= dpiValue( ROTATION_PAD );
+    }
 
-                if ( orientation <= 4 ) { contextWidth = width; contextHeight = height; }
-                else                    { contextWidth = height; contextHeight = width; }
+    if ( self.iconStyle.dropShadow.boolValue == YES )
+    {
+        /* Go for a symmetrical border-like drop shadow in multi-image mode,
+         * else for the larger icon-filling cover art mode, use a drop shadow
+         * modelled on the Finder's typical shadow style - offset downwards.
+         */
 
-                transformationContext = CGBitmapContextCreate
-                (
-                    NULL,
-                    contextWidth,
-                    contextHeight,
-                    8,                /* Bits per component */
-                    contextWidth * 4, /* Bytes per row      */
-                    CGImageGetColorSpace( image ),
-                    kCGImageAlphaPremultipliedFirst
-                );
+        if ( onlyUseCoverArt == NO )
+        {
+            shadowOffset = CGSizeMake( 0, dpiValue( -BLUR_OFFSET ) );
+            shadowBlur   = dpiValue( BLUR_RADIUS );
 
-                if ( transformationContext != NULL )
-                {
-                    CGContextConcatCTM( transformationContext, ctms[ orientation - 1 ] );
-                    CGContextDrawImage( transformationContext, CGRectMake( 0, 0, width, height ), image );
+            /* "* 2" on the blur offset is basically a fudge factor. AFAICS
+             * just adding the radius and offset should give a correct
+             * adjustment to make room for the shadow but in practice it gets
+             * cut off at the bottom unless a bit of extra room is provided.
+             */
 
-                    /* Release the old image first to avoid accumulating lots
-                     * of copies in RAM. Worse case, we end up with a NULL
-                     * 'image' and no thumbnail plotted for this image.
-                     */
+            thumbSize -= dpiValue( BLUR_RADIUS + BLUR_OFFSET * 2 );
+        }
+        else
+        {
+            shadowOffset = CGSizeMake( 0, dpiValue( -( BLUR_OFFSET / 2 ) ) );
+            shadowBlur   = dpiValue( ( BLUR_RADIUS / 3 ) * ( BLUR_OFFSET / 2 ) );
 
-                    CFRelease( image );
-                    image = CGBitmapContextCreateImage( transformationContext );
-                    CFRelease( transformationContext );
+            /* Unlike the case above, here just adding the blur radius and
+             * offset is sufficient for some reason.
+             */
 
-                    if ( image )
-                    {
-                        width  = CGImageGetWidth  ( image );
-                        height = CGImageGetHeight ( image );
-                    }
-                }
-            }
+            thumbSize -= dpiValue( BLUR_RADIUS * ( BLUR_OFFSET / 2 ) + ( BLUR_OFFSET / 2 ) );
         }
+    }
 
-        if ( maintainAspectRatio == NO && image )
-        {
-            /* Create a sub-image based on a square crop of the original. If
-             * the image is wider than tall (landscape), use a center crop.
-             * If the image is taller than wide (portrait), use the top part
-             * of it - on average this works well for pictures of people.
-             */
+    /* Hide the border in cover art mode or if borders are disabled, putting
+     * the shadow beneath the image.
+     */
+
+    if ( self.iconStyle.whiteBackground.boolValue == YES )
+    {
+        borderSize  = thumbSize;
+        thumbSize  -= dpiValue( THUMB_BORDER * 2 );
+    }
+
+    geometry->canvasSize   = canvasSize;
+    geometry->thumbSize    = thumbSize;
+    geometry->borderSize   = borderSize;
+    geometry->shadowOffset = shadowOffset;
+    geometry->shadowBlur   = shadowBlur;
+}
+
+/******************************************************************************\
+ * -getSlots:forThumbnailCount:
+ *
+ * Work out where on the canvas each thumbnail goes. Everything drawn for a
+ * thumbnail - border, shadow and rotation included - is laid out as if it
+ * filled the whole canvas and then scaled into its slot.
+ *
+ * In:  ( CGRect * ) slots
+ *      Array of at least 'count' rectangles, updated with the slots in canvas
+ *      pixels (see dpiValue());
+ *
+ *      ( NSUInteger ) count
+ *      Number of thumbnails being drawn; 1 to 4.
+\******************************************************************************/
 
-            BOOL       isSquare = NO;
-            CGRect     cropRect;
-            CGImageRef croppedImage;
+- ( void ) getSlots: ( CGRect     * ) slots
+  forThumbnailCount: ( NSUInteger   ) count
+{
+    if ( self.iconStyle.onlyUseCoverArt.boolValue == YES )
+    {
+        slots[ 0 ] = CGRectMake( 0, 0, dpiValue( CANVAS_SIZE ), dpiValue( CANVAS_SIZE ) );
+        return;
+    }
+
+    /* Adjust plot positions and sizes according to the various effects that
+     * might be in use.
+     */
+
+    CGFloat adjustSize             = 0;
+    CGRect  adjustedLocations[ 4 ] =
+    {
+        locations[ count - 1 ][ 0 ],
+        locations[ count - 1 ][ 1 ],
+        locations[ count - 1 ][ 2 ],
+        locations[ count - 1 ][ 3 ]
+    };
+
+    if ( self.iconStyle.dropShadow.boolValue     == YES ) adjustSize += ( BLUR_RADIUS + BLUR_OFFSET * 2 );
+    if ( self.iconStyle.randomRotation.boolValue == YES ) adjustSize += ROTATION_PAD;
 
-            if      ( width > height ) cropRect = CGRectMake( ( width - height ) / 2, 0, height, height );
-            else if ( height > width ) cropRect = CGRectMake( 0, 0, width, width ); /* Image *top* left is (0,0) */
-            else                       isSquare = YES;
+    if ( adjustSize > 0 )
+    {
+        adjustSize /= 3;   /* "Looks about right" adjustment that works
+                            * even though thumbnail scaling sizes in
+                            * 'adjustedLocations' vary according to the
+                            * number of images.
+                            */
 
-            if ( isSquare == NO )
+        switch ( count )
+        {
+            case 2:
             {
-                croppedImage = CGImageCreateWithImageInRect( image, cropRect );
-                CFRelease( image );
-                image = croppedImage;
+                adjustedLocations[ 0 ].origin.x    -= adjustSize;
+                adjustedLocations[ 0 ].origin.y    -= adjustSize / 2;
+                adjustedLocations[ 0 ].size.width  += adjustSize;
+                adjustedLocations[ 0 ].size.height += adjustSize;
+
+                adjustedLocations[ 1 ].origin.y    -= adjustSize / 2;
+                adjustedLocations[ 1 ].size.width  += adjustSize;
+                adjustedLocations[ 1 ].size.height += adjustSize;
             }
-        }
-        else
-        {
-            /* Adjust the plotting rectangle to avoid image cropping */
-
-            CGFloat rectWidth  = rect.size.width;
-            CGFloat rectHeight = rect.size.height;
+            break;
 
-            if ( width > height )
+            case 3:
             {
-                CGFloat scaledHeight = height * ( rectWidth / width );
-                CGFloat yOffset      = ( rectHeight - scaledHeight ) / 2;
+                adjustedLocations[ 0 ].origin.x    -= adjustSize;
+                adjustedLocations[ 0 ].size.width  += adjustSize;
+                adjustedLocations[ 0 ].size.height += adjustSize;
 
-                rect.origin.y    += yOffset;
-                rect.size.height  = scaledHeight;
+                adjustedLocations[ 1 ].size.width  += adjustSize;
+                adjustedLocations[ 1 ].size.height += adjustSize;
+
+                adjustedLocations[ 2 ].origin.x    -= adjustSize / 2;
+                adjustedLocations[ 2 ].origin.y    -= adjustSize;
+                adjustedLocations[ 2 ].size.width  += adjustSize;
+                adjustedLocations[ 2 ].size.height += adjustSize;
             }
-            else
+            break;
+
+            case 4:
             {
-                CGFloat scaledWidth = width * ( rectHeight / height );
-                CGFloat xOffset     = ( rectWidth - scaledWidth ) / 2;
+                adjustedLocations[ 0 ].origin.x    -= adjustSize;
+                adjustedLocations[ 0 ].size.width  += adjustSize;
+                adjustedLocations[ 0 ].size.height += adjustSize;
+
+                adjustedLocations[ 1 ].size.width  += adjustSize;
+                adjustedLocations[ 1 ].size.height += adjustSize;
 
-                rect.origin.x   += xOffset;
-                rect.size.width  = scaledWidth;
+                adjustedLocations[ 2 ].origin.x    -= adjustSize;
+                adjustedLocations[ 2 ].origin.y    -= adjustSize;
+                adjustedLocations[ 2 ].size.width  += adjustSize;
+                adjustedLocations[ 2 ].size.height += adjustSize;
+
+                adjustedLocations[ 3 ].origin.y    -= adjustSize;
+                adjustedLocations[ 3 ].size.width  += adjustSize;
+                adjustedLocations[ 3 ].size.height += adjustSize;
             }
+            break;
         }
     }
 
-    /* Check 'image' again in case cropping was attempted but failed */
+    for ( NSUInteger index = 0; index < count; index ++ )
+    {
+        CGRect thisRect = adjustedLocations[ index ];
 
-    if ( image ) CGContextDrawImage( context, rect, image );
-    
-    /* Make sure everything is released */
-    
-    if ( image       ) CFRelease( image       ); else success = NO;
-    if ( imageSource ) CFRelease( imageSource ); else success = NO;
-    if ( url         ) CFRelease( url         ); else success = NO;
-    
-    return success;
+        slots[ index ] = CGRectMake
+        (
+            dpiValue( thisRect.origin.x    ),
+            dpiValue( thisRect.origin.y    ),
+            dpiValue( thisRect.size.width  ),
+            dpiValue( thisRect.size.height )
+        );
+    }
 }
 
 /******************************************************************************\
@@ -785,6 +1655,11 @@ nothingToDo:
  * using custom icon generation parameters. The caller is responsible
  * for releasing the returned object when it is no longer needed.
  *
+ * Each thumbnail, with its border, shadow and rotation, is laid out as if it
+ * filled the whole canvas but is drawn straight into its final slot, scaled
+ * down; the images are decoded at slot size too. Nothing is drawn at full
+ * canvas size only to be scaled down afterwards.
+ *
  * This function allows re-entrant callers from multiple threads using
  * independent execution contexts.
  *
@@ -828,243 +1703,173 @@ nothingToDo:
      * This method should never be called for Slip Cover icon styles.
      */
 
-    BOOL onlyUseCoverArt = self.iconStyle.onlyUseCoverArt.boolValue;
+    BOOL       onlyUseCoverArt     = self.iconStyle.onlyUseCoverArt.boolValue;
+    BOOL       maintainAspectRatio = ! self.iconStyle.cropToSquare.boolValue;
+    NSUInteger count               = MIN( [ chosenImages count ], onlyUseCoverArt ? 1 : 4 );
+
+    if ( count == 0 ) return NULL; // Note early exit!
 
     /**************************************************************************\
-     * Create layers representing thumbnails of the images
+     * Work out the thumbnail geometry
     \**************************************************************************/
 
-    /* Get a graphics context for painting things. This is constructed as a
-     * bespoke bitmap context rather than using the one we could obtain from
-     * Quick Look because it opens up more possibilities later (there is
-     * direct control over alpha channel provision, though transparency is
-     * extremely problematic under Quick Look - most of the time, you don't
-     * get it, regardless of context).
-     */
-
-    NSUInteger      canvasSize = dpiValue( CANVAS_SIZE );
-    CGSize          pixelSize  = CGSizeMake(       canvasSize, canvasSize );
-    CGRect          pixelRect  = CGRectMake( 0, 0, canvasSize, canvasSize );
-    CGContextRef    context    = NULL;
-    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-
-    if ( colorSpace )
-    {
-        context = CGBitmapContextCreate
-        (
-            NULL,           /* OS X 10.3 or later => CG allocates for us */
-            canvasSize,
-            canvasSize,
-            8,              /* Bits per component */
-            canvasSize * 4, /* Bytes per row      */
-            colorSpace,
-            kCGImageAlphaPremultipliedFirst
-        );
+    ThumbnailGeometry geometry;
 
-        CGColorSpaceRelease( colorSpace );
-    }
+    [ self getThumbnailGeometry: &geometry ];
 
-    if ( ! context ) return nil; // Note early exit!
+    NSUInteger canvasSize   = geometry.canvasSize;
+    CGRect     pixelRect    = CGRectMake( 0, 0, canvasSize, canvasSize );
+    CGFloat    thumbSize    = geometry.thumbSize;
+    CGFloat    borderSize   = geometry.borderSize;
+    CGSize     shadowOffset = geometry.shadowOffset;
+    CGFloat    shadowBlur   = geometry.shadowBlur;
 
-    CGContextSetShouldAntialias      ( context, true                 );
-    CGContextSetInterpolationQuality ( context, kCGInterpolationHigh );
+    /**************************************************************************\
+     * Get thumbnails of the images
+    \**************************************************************************/
 
-    /* Create layers into which thumbnails will be drawn. These will be
-     * scaled down again when drawn into the final icon and will use anti-
-     * aliasing then, but we need to keep high quality settings on the
-     * layers to make sure that the rotated edges look good.
+    /* Decode the images in parallel at the size of the slots they will go
+     * into, assuming that they will all work. The loop runs on the shared
+     * task scheduler (see "TaskScheduler.h"), so with many folders on the go
+     * at once their decodes share the cores instead of piling up on GCD.
+     *
+     * The thumbnails are written into an array which is filled with 'count'
+     * NULL items first, so that concurrent blocks can each set their own
+     * index without locking. If we just tried to extend the array within the
+     * processing loop then we'd have to serialise the operation (as two
+     * threads attempting to extend the same array simultaneously could just
+     * corrupt the data structure).
      */
 
-    NSUInteger        count  = [ chosenImages count ];
-    CFMutableArrayRef layers = CFArrayCreateMutable
+    CGRect            slots[ 4 ];
+    CGRect          * predicted  = slots; /* Blocks can't capture arrays */
+    CFMutableArrayRef thumbnails = CFArrayCreateMutable
     (
         kCFAllocatorDefault,
         count,
         NULL
     );
 
+    [ self getSlots: slots forThumbnailCount: count ];
+
     for ( size_t index = 0; index < count; index ++ )
     {
-        /* Ensure the array actually contains 'count' NULL items. Within the
-         * Grand Central processing loop below, used layers are written into
-         * the array at specific indices. Doing this means that the array can
-         * be written to by concurrent processes without locking. If we just
-         * tried to extend the array within the processing loop then we'd have
-         * to serialise the operation (as two threads attempting to extend the
-         * same array simultaneously could just corrupt the data structure).
-         */
-
-        CFArrayAppendValue( layers, NULL );
+        CFArrayAppendValue( thumbnails, NULL );
     }
 
-    dispatch_apply
+    taskSchedulerApplyBlock
     (
-        count,
-        dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 ),
-        ^( size_t index )
-        {
-            NSString * currFile = chosenImages[ ( NSUInteger ) index ];
-
-            CGLayerRef   layer    = CGLayerCreateWithContext( context, pixelSize, NULL );
-            CGContextRef layerCtx = CGLayerGetContext( layer );
-
-            CGContextSetShouldAntialias      ( layerCtx, true                 );
-            CGContextSetInterpolationQuality ( layerCtx, kCGInterpolationHigh );
-
-            /* To start with, set a thumbnail size to match the entire canvas.
-             * As things like shadows, rotation and border get applied, reduce
-             * these values as appropriate to make sure that the final scaled
-             * thumbnail fits within the canvas, even with any effects applied.
-             */
-
-            CGFloat thumbSize = canvasSize;
-
-            /* Paint in a transparency layer using a shadow offset to the bottom
-             * and right by BLUR_OFFSET with a radius of BLUR_RADIUS.
-             */
-
-            CGContextBeginTransparencyLayer( layerCtx, NULL );
-            CGContextTranslateCTM( layerCtx, canvasSize / 2, canvasSize / 2 );
-
-            if ( self.iconStyle.randomRotation.boolValue == YES )
-            {
-                CGContextRotateCTM( layerCtx, ( ( random() % 300 ) - 150 ) / 2000.0 );
-
-                thumbSize -= dpiValue( ROTATION_PAD );
-            }
-
-            if ( self.iconStyle.dropShadow.boolValue == YES )
-            {
-                /* Go for a symmetrical border-like drop shadow in multi-image
-                 * mode, else for the larger icon-filling cover art mode,
-                 * use a drop shadow modelled on the Finder's typical shadow
-                 * style - offset downwards.
-                 */
-            
-                if ( onlyUseCoverArt == NO )
-                {
-                    CGContextSetShadow
-                    (
-                        layerCtx,
-                        CGSizeMake( 0, dpiValue( -BLUR_OFFSET ) ),
-                        dpiValue( BLUR_RADIUS )
-                    );
-
-                    /* "* 2" on the blur offset is basically a fudge factor.
-                     * AFAICS just adding the radius and offset should give a
-                     * correct adjustment to make room for the shadow but in
-                     * practice it gets cut off at the bottom unless a bit of
-                     * extra room is provided.
-                     */
-
-                    thumbSize -= dpiValue( BLUR_RADIUS + BLUR_OFFSET * 2 );
-                }
-                else
-                {
-                    /* The default shadow colour is much lighter than shown in e.g.
-                     * the Finder's thumbnails for image files (probably because of
-                     * colour space issues), so darken it by specifying an exact
-                     * colour in generic RGB space (noting that we used device RGB
-                     * when the outer graphics bitmap context was created).
-                     */
-
-                    CGColorRef c = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
-
-                    if ( c )
-                    {
-                        CGContextSetShadowWithColor
-                        (
-                            layerCtx,
-                            CGSizeMake( 0, dpiValue( -( BLUR_OFFSET / 2 ) ) ),
-                            dpiValue( ( BLUR_RADIUS / 3 ) * ( BLUR_OFFSET / 2 ) ),
-                            c
-                        );
-
-                        CGColorRelease( c );
-
-                        /* Unlike the case above, here just adding the blur
-                         * radius and offset is sufficient for some reason.
-                         */
-
-                        thumbSize -= dpiValue( BLUR_RADIUS * ( BLUR_OFFSET / 2 ) + ( BLUR_OFFSET / 2 ) );
-                    }
-                }
-            }
+        count,
+        ^( size_t index )
+        {
+            CGRect     slot      = predicted[ index ];
+            CGSize     pixelSize = CGSizeMake( thumbSize * slot.size.width  / canvasSize,
+                                               thumbSize * slot.size.height / canvasSize );
+            CGImageRef thumbnail = [ self allocThumbnailFor: chosenImages[ ( NSUInteger ) index ]
+                                                  pixelSize: pixelSize
+                                     maintainingAspectRatio: maintainAspectRatio ];
+
+            CFArraySetValueAtIndex( thumbnails, index, thumbnail );
+
+        } /* End of loop block                  */
+    );    /* End of taskSchedulerApplyBlock call */
+
+    /* Gather up the thumbnails which worked, keeping their order. If any
+     * failed, the rest are laid out differently, so get them again at the
+     * size of their new slots (usually this means a fresh decode, but it
+     * is rare for an image to fail).
+     */
 
-            /* Hide the border in cover art mode or if borders are disabled,
-             * putting the shadow beneath the image.
-             */
+    CGImageRef used[ 4 ];
+    NSUInteger usedIndex[ 4 ];
+    NSUInteger layerCount = 0;
 
-            if ( self.iconStyle.whiteBackground.boolValue == YES )
-            {
-                CGFloat borderSize = thumbSize;
-                thumbSize -= dpiValue( THUMB_BORDER * 2 );
+    for ( NSUInteger index = 0; index < count; index ++ )
+    {
+        CGImageRef thumbnail = ( CGImageRef ) CFArrayGetValueAtIndex( thumbnails, index );
 
-                CGContextSetRGBFillColor( layerCtx, 1, 1, 1, 1.0 );
-                CGContextFillRect
-                (
-                    layerCtx,
-                    CGRectMake
-                    (
-                        -borderSize / 2,
-                        -borderSize / 2,
-                        borderSize,
-                        borderSize
-                    )
-                );
+        if ( thumbnail != NULL )
+        {
+            used     [ layerCount   ] = thumbnail;
+            usedIndex[ layerCount ++ ] = index;
+        }
+    }
 
-                /* Don't want another shadow under the inset image so turn off
-                 * shadows before calling the painting routine.
-                 */
+    CFRelease( thumbnails );
 
-                CGContextSetShadowWithColor
-                (
-                    layerCtx,
-                    CGSizeMake( 0, 0 ),
-                    0,
-                    NULL /* NULL colour => disable shadows */
-                );
-            }
+    if ( layerCount == 0 ) return NULL; // Note early exit!
 
-            BOOL success = [ self paintImageAt: ( __bridge CFStringRef ) currFile /* Toll-free bridge */
-                                      intoRect: CGRectMake
-                                                (
-                                                    -thumbSize / 2,
-                                                    -thumbSize / 2,
-                                                    thumbSize,
-                                                    thumbSize
-                                                )
-                                  usingContext: layerCtx
-                        maintainingAspectRatio: ! self.iconStyle.cropToSquare.boolValue
-            ];
+    if ( layerCount < count )
+    {
+        [ self getSlots: slots forThumbnailCount: layerCount ];
 
-            CGContextEndTransparencyLayer( layerCtx );
+        for ( NSUInteger index = 0; index < layerCount; index ++ )
+        {
+            CGSize     pixelSize = CGSizeMake( thumbSize * slots[ index ].size.width  / canvasSize,
+                                               thumbSize * slots[ index ].size.height / canvasSize );
+            CGImageRef resized   = [ self allocThumbnailFor: chosenImages[ usedIndex[ index ] ]
+                                                  pixelSize: pixelSize
+                                     maintainingAspectRatio: maintainAspectRatio ];
 
-            if ( success ) CFArraySetValueAtIndex( layers, index, layer );
-            else CGLayerRelease( layer );
+            /* If it fails this time, just scale the one we already have */
 
-        } /* End of Grand Central dispatch block      */
-    );    /* End of Grand Central dispatch_apply call */
+            if ( resized != NULL )
+            {
+                CFRelease( used[ index ] );
+                used[ index ] = resized;
+            }
+        }
+    }
 
     /**************************************************************************\
      * Construct the final thumbnail
     \**************************************************************************/
 
-    /* Count the number of layers which were actually used. If non-zero,
-     * iterate through any thumbnails, painting them into the right location
-     * on the final canvas, freeing layers as we go.
+    /* Reserve memory for the canvas, its transparency layer and that of the
+     * thumbnail being drawn (no bigger than its slot), waiting if other icons
+     * are using up the budget. The images were decoded and charged for
+     * separately, above, so nothing is held while waiting here.
      */
 
-    CFIndex layerCount = 0;
+    size_t reserved = memoryGovernorImageBytes( canvasSize, canvasSize ) * 3;
 
-    for ( size_t index = 0; index < count; index ++ )
+    reserveMemory( memoryGovernorComposition, reserved );
+
+    /* Get a graphics context for painting things. This is constructed as a
+     * bespoke bitmap context rather than using the one we could obtain from
+     * Quick Look because it opens up more possibilities later (there is
+     * direct control over alpha channel provision, though transparency is
+     * extremely problematic under Quick Look - most of the time, you don't
+     * get it, regardless of context).
+     */
+
+    CGContextRef    context    = NULL;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+
+    if ( colorSpace )
     {
-        if ( CFArrayGetValueAtIndex( layers, index ) != NULL ) layerCount ++;
+        context = CGBitmapContextCreate
+        (
+            NULL,           /* OS X 10.3 or later => CG allocates for us */
+            canvasSize,
+            canvasSize,
+            8,              /* Bits per component */
+            canvasSize * 4, /* Bytes per row      */
+            colorSpace,
+            kCGImageAlphaPremultipliedFirst
+        );
+
+        CGColorSpaceRelease( colorSpace );
     }
 
-    if ( layerCount > 0 )
+    if ( context )
     {
-        CGContextBeginTransparencyLayer( context, NULL );
+        /* Keep high quality settings to make sure that the rotated edges
+         * look good.
+         */
+
+        CGContextSetShouldAntialias      ( context, true                 );
+        CGContextSetInterpolationQuality ( context, kCGInterpolationHigh );
 
         /* Quick Look enforces an opaque thumbnail. If we use a clear
          * background then it'll (bizarrely) work fine if looking at the
@@ -1075,144 +1880,264 @@ nothingToDo:
          * Callers can anticipate this and ask for an opaque thumbnail
          * if Quick Look is being invoked in 'for Finder-style file icon'
          * mode.
+         *
+         * For one or two thumbnails only when in multiple image mode, plot
+         * the standard folder icon underneath.
+         *
+         * This background is the same for every folder given the same style
+         * and number of thumbnails, so after the first time it is copied
+         * from a cached base plate rather than drawn.
          */
 
-        if ( self.makeBackgroundOpaque )
-        {
-            if ( layerCount < 3 ) CGContextSetRGBFillColor( context, 1.00, 1.00, 1.00, 1.0 );
-            else                  CGContextSetRGBFillColor( context, 0.62, 0.77, 0.85, 1.0 );
+        BOOL       opaque = self.makeBackgroundOpaque;
+        BOOL       folder = onlyUseCoverArt == NO &&
+                            backgroundImage       &&
+                            layerCount <= self.iconStyle.showFolderInBackground.unsignedIntValue;
+        NSString * key    = [
+            NSString stringWithFormat: @"%d:%p",
+                                       opaque ? ( layerCount < 3 ? 1 : 2 ) : 0,
+                                       folder ? backgroundImage : NULL
+        ];
+
+        [
+            sharedBasePlateCache() paintPlateForKey: key
+                                        intoContext: context
+                                          drawnWith: ^( CGContextRef plateContext )
+            {
+                if ( opaque )
+                {
+                    if ( layerCount < 3 ) CGContextSetRGBFillColor( plateContext, 1.00, 1.00, 1.00, 1.0 );
+                    else                  CGContextSetRGBFillColor( plateContext, 0.62, 0.77, 0.85, 1.0 );
 
-            CGContextFillRect( context, pixelRect );
-        }
-        else
-        {
-            CGContextClearRect( context, pixelRect );
-        }
+                    CGContextFillRect( plateContext, pixelRect );
+                }
+                else
+                {
+                    CGContextClearRect( plateContext, pixelRect );
+                }
 
-        /* For one or two thumbnails only when in multiple image mode, plot
-         * the standard folder icon underneath.
+                if ( folder ) CGContextDrawImage( plateContext, pixelRect, backgroundImage );
+            }
+        ];
+
+        /* Thumbnails are grouped in a transparency layer over the plate. The
+         * raster engine writes straight into the context's pixels, which
+         * such a layer would hide.
+         */
+
+        #ifndef USE_RASTER_ENGINE
+            CGContextBeginTransparencyLayer( context, NULL );
+        #endif
+
+        /* The default shadow colour in cover art mode is much lighter than
+         * shown in e.g. the Finder's thumbnails for image files (probably
+         * because of colour space issues), so darken it by specifying an
+         * exact colour in generic RGB space (noting that we used device RGB
+         * when the bitmap context was created).
          */
 
-        if ( onlyUseCoverArt == NO &&
-             backgroundImage       &&
-             layerCount <= self.iconStyle.showFolderInBackground.unsignedIntValue )
+        CGColorRef shadowColour = NULL;
+
+        if ( onlyUseCoverArt == YES && shadowBlur > 0 )
         {
-            CGContextDrawImage( context, pixelRect, backgroundImage );
+            shadowColour = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
         }
 
-        /* Now plot the thumbnails themselves */
+        /* Now plot the thumbnails themselves, in order, so that each overlaps
+         * the last with its drop shadow part hanging above it.
+         */
 
-        if ( onlyUseCoverArt == YES )
+        for ( NSUInteger index = 0; index < layerCount; index ++ )
         {
-            CGLayerRef layer = ( CGLayerRef ) CFArrayGetValueAtIndex( layers, 0 );
+            CGRect  slot   = slots[ index ];
+            CGFloat scaleX = slot.size.width  / canvasSize;
+            CGFloat scaleY = slot.size.height / canvasSize;
+            CGFloat angle  = 0;
 
-            CGContextDrawLayerInRect
-            (
-                context,
-                CGRectMake( 0, 0, canvasSize, canvasSize ),
-                layer
-            );
+            if ( self.iconStyle.randomRotation.boolValue == YES )
+            {
+                angle = ( ( random() % 300 ) - 150 ) / 2000.0;
+            }
 
-            CGLayerRelease( layer );
-        }
-        else
-        {
-            /* Adjust plot positions and sizes according to the various
-             * effects that might be in use.
+            #ifdef USE_RASTER_ENGINE
+
+            /* CoreGraphics' default shadow colour is black at one third
+             * opacity; its blur value is roughly twice the Gaussian standard
+             * deviation.
              */
 
-            CGFloat adjustSize             = 0;
-            CGRect  adjustedLocations[ 4 ] =
+            RasterThumbnailStyle style =
             {
-                locations[ layerCount - 1 ][ 0 ],
-                locations[ layerCount - 1 ][ 1 ],
-                locations[ layerCount - 1 ][ 2 ],
-                locations[ layerCount - 1 ][ 3 ]
+                .layoutSize    = canvasSize,
+                .thumbSize     = thumbSize,
+                .borderSize    = borderSize,
+                .angle         = angle,
+                .fit           = maintainAspectRatio,
+                .shadowOffsetX = shadowOffset.width  * scaleX,
+                .shadowOffsetY = shadowOffset.height * scaleY,
+                .shadowSigma   = shadowBlur * sqrt( scaleX * scaleY ) / 2,
+                .shadowColour  = { 85, 0, 0, 0 },
+                .filter        = rasterFilterBicubic
             };
 
-            if ( self.iconStyle.dropShadow.boolValue     == YES ) adjustSize += ( BLUR_RADIUS + BLUR_OFFSET * 2 );
-            if ( self.iconStyle.randomRotation.boolValue == YES ) adjustSize += ROTATION_PAD;
+            if ( shadowColour )
+            {
+                static const uint8_t grey[ 4 ] = { 255, 77, 77, 77 };
+                memcpy( style.shadowColour, grey, sizeof( grey ) );
+            }
+
+            drawThumbnailWithRasterEngine( context, used[ index ], slot, &style );
 
-            if ( adjustSize > 0 )
+            #else
+
+            /* Whatever goes under the thumbnail - its shadow, and its border
+             * if it has one - comes from a cached sprite where possible,
+             * drawn straight onto the canvas. Without a border the shadow is
+             * cast by the image itself, so that only works for opaque images,
+             * which cast the shape of the rectangle they're drawn into.
+             */
+
+            CGImageRef image      = used[ index ];
+            CGRect     imageRect  = thumbnailRect
+            (
+                image,
+                CGRectMake( -thumbSize / 2, -thumbSize / 2, thumbSize, thumbSize ),
+                maintainAspectRatio
+            );
+            CGImageRef sprite     = NULL;
+
+            if ( ( shadowBlur > 0 || borderSize > 0 ) && ( borderSize > 0 || isOpaque( image ) ) )
             {
-                adjustSize /= 3;   /* "Looks about right" adjustment that works
-                                    * even though thumbnail scaling sizes in
-                                    * 'adjustedLocations' vary according to the
-                                    * number of images.
-                                    */
+                /* Sprites are shared between angles within a step of each
+                 * other, so the image must then be drawn at the sprite's
+                 * angle too. Nothing else is rounded.
+                 */
+
+                angle = [ SpriteCache quantisedAngle: angle ];
 
-                switch ( layerCount )
+                SpriteGeometry geometry =
                 {
-                    case 2:
-                    {
-                        adjustedLocations[ 0 ].origin.x    -= adjustSize;
-                        adjustedLocations[ 0 ].origin.y    -= adjustSize / 2;
-                        adjustedLocations[ 0 ].size.width  += adjustSize;
-                        adjustedLocations[ 0 ].size.height += adjustSize;
-
-                        adjustedLocations[ 1 ].origin.y    -= adjustSize / 2;
-                        adjustedLocations[ 1 ].size.width  += adjustSize;
-                        adjustedLocations[ 1 ].size.height += adjustSize;
-                    }
-                    break;
-                    
-                    case 3:
-                    {
-                        adjustedLocations[ 0 ].origin.x    -= adjustSize;
-                        adjustedLocations[ 0 ].size.width  += adjustSize;
-                        adjustedLocations[ 0 ].size.height += adjustSize;
-
-                        adjustedLocations[ 1 ].size.width  += adjustSize;
-                        adjustedLocations[ 1 ].size.height += adjustSize;
-
-                        adjustedLocations[ 2 ].origin.x    -= adjustSize / 2;
-                        adjustedLocations[ 2 ].origin.y    -= adjustSize;
-                        adjustedLocations[ 2 ].size.width  += adjustSize;
-                        adjustedLocations[ 2 ].size.height += adjustSize;
-                    }
-                    break;
-                    
-                    case 4:
-                    {
-                        adjustedLocations[ 0 ].origin.x    -= adjustSize;
-                        adjustedLocations[ 0 ].size.width  += adjustSize;
-                        adjustedLocations[ 0 ].size.height += adjustSize;
-
-                        adjustedLocations[ 1 ].size.width  += adjustSize;
-                        adjustedLocations[ 1 ].size.height += adjustSize;
-
-                        adjustedLocations[ 2 ].origin.x    -= adjustSize;
-                        adjustedLocations[ 2 ].origin.y    -= adjustSize;
-                        adjustedLocations[ 2 ].size.width  += adjustSize;
-                        adjustedLocations[ 2 ].size.height += adjustSize;
-
-                        adjustedLocations[ 3 ].origin.y    -= adjustSize;
-                        adjustedLocations[ 3 ].size.width  += adjustSize;
-                        adjustedLocations[ 3 ].size.height += adjustSize;
-                    }
-                    break;
-                }                
+                    .slotSize       = slot.size,
+                    .slotPhase      = CGPointMake( slot.origin.x - floor( slot.origin.x ),
+                                                   slot.origin.y - floor( slot.origin.y ) ),
+                    .layoutSize     = canvasSize,
+                    .casterSize     = borderSize > 0 ? CGSizeMake( borderSize, borderSize ) : imageRect.size,
+                    .border         = borderSize > 0,
+                    .shadowOffset   = shadowOffset,
+                    .shadowBlur     = shadowBlur,
+                    .darkGreyShadow = shadowColour != NULL,
+                    .angle          = angle
+                };
+
+                sprite = [ sharedSpriteCache() copySpriteFor: geometry ];
+            }
+
+            if ( sprite )
+            {
+                CGContextDrawImage
+                (
+                    context,
+                    CGRectMake
+                    (
+                        floor( slot.origin.x ),
+                        floor( slot.origin.y ),
+                        CGImageGetWidth ( sprite ),
+                        CGImageGetHeight( sprite )
+                    ),
+                    sprite
+                );
+
+                CGImageRelease( sprite );
+            }
+
+            /* Map the canvas-sized layout square onto the slot, drawing
+             * nothing outside it. Without a sprite, the thumbnail is grouped
+             * in a transparency layer which need only cover what is drawn:
+             * the square holding the border (or image), rotated, plus the
+             * spread of the shadow - CoreGraphics shadows fade out within
+             * about twice the blur value.
+             */
+
+            CGContextSaveGState  ( context );
+            CGContextTranslateCTM( context, slot.origin.x, slot.origin.y );
+            CGContextScaleCTM    ( context, scaleX, scaleY );
+            CGContextClipToRect  ( context, pixelRect );
+
+            if ( sprite == NULL )
+            {
+                CGFloat extent = MAX( borderSize, thumbSize ) / 2 * ( fabs( cos( angle ) ) + fabs( sin( angle ) ) ) +
+                                 fabs( shadowOffset.height ) + shadowBlur * 2;
+                CGRect  bounds = CGRectIntersection
+                (
+                    CGRectMake( canvasSize / 2.0 - extent, canvasSize / 2.0 - extent, extent * 2, extent * 2 ),
+                    pixelRect
+                );
+
+                CGContextBeginTransparencyLayerWithRect( context, bounds, NULL );
             }
 
-            /* Plot in the adjusted rectangles */
+            CGContextTranslateCTM( context, canvasSize / 2.0, canvasSize / 2.0 );
+            CGContextRotateCTM   ( context, angle );
 
-            for ( CFIndex index = 0; index < layerCount; index ++ )
+            if ( sprite == NULL )
             {
-                CGLayerRef layer    = ( CGLayerRef ) CFArrayGetValueAtIndex( layers, index );
-                CGRect     thisRect = adjustedLocations[ index ];
-                CGRect     dpiRect  = CGRectMake(
-                                                    dpiValue( thisRect.origin.x    ),
-                                                    dpiValue( thisRect.origin.y    ),
-                                                    dpiValue( thisRect.size.width  ),
-                                                    dpiValue( thisRect.size.height )
-                                                );
-
-                CGContextDrawLayerInRect( context, dpiRect, layer );
-                CGLayerRelease( layer );
+                /* Shadow offsets and blur are given in device space, so
+                 * unlike everything else they must be scaled down to the
+                 * slot here.
+                 */
+
+                if ( shadowBlur > 0 )
+                {
+                    CGSize  offset = CGSizeMake( shadowOffset.width * scaleX, shadowOffset.height * scaleY );
+                    CGFloat blur   = shadowBlur * sqrt( scaleX * scaleY );
+
+                    if ( shadowColour ) CGContextSetShadowWithColor( context, offset, blur, shadowColour );
+                    else                CGContextSetShadow         ( context, offset, blur               );
+                }
+
+                if ( borderSize > 0 )
+                {
+                    CGContextSetRGBFillColor( context, 1, 1, 1, 1.0 );
+                    CGContextFillRect
+                    (
+                        context,
+                        CGRectMake
+                        (
+                            -borderSize / 2,
+                            -borderSize / 2,
+                            borderSize,
+                            borderSize
+                        )
+                    );
+
+                    /* Don't want another shadow under the inset image so turn
+                     * off shadows before painting it.
+                     */
+
+                    CGContextSetShadowWithColor
+                    (
+                        context,
+                        CGSizeMake( 0, 0 ),
+                        0,
+                        NULL /* NULL colour => disable shadows */
+                    );
+                }
             }
+
+            CGContextDrawImage( context, imageRect, image );
+
+            if ( sprite == NULL ) CGContextEndTransparencyLayer( context );
+
+            CGContextRestoreGState( context );
+
+            #endif
         }
 
-        CGContextEndTransparencyLayer( context );
+        if ( shadowColour ) CGColorRelease( shadowColour );
+
+        #ifndef USE_RASTER_ENGINE
+            CGContextEndTransparencyLayer( context );
+        #endif
 
         /* Flush out any pending graphics operations and set the thumbnail
          * response for this generator, or set a custom icon for the folder.
@@ -1220,14 +2145,20 @@ nothingToDo:
 
         CGContextFlush( context );
         finalImage = CGBitmapContextCreateImage( context );
+
+        CFRelease( context );
     }
 
     /**************************************************************************\
      * Tidy up
     \**************************************************************************/
 
-    CFRelease( layers  );
-    CFRelease( context );
+    for ( NSUInteger index = 0; index < layerCount; index ++ )
+    {
+        CFRelease( used[ index ] );
+    }
+
+    memoryGovernorRelease( memoryGovernorComposition, reserved );
 
     return finalImage;
 }
@@ -1271,9 +2202,40 @@ nothingToDo:
     NSImage    * sourceImage = nil;
     NSImage    * caseImage   = nil;
 
+    /* Use the shared thumbnail cache for the cover, at the size of the case's
+     * cover area (in which SlipCover stretches it to fit), so that a preview
+     * and the real icon need only decode it once.
+     */
+
+    NSString   * coverPath = chosenImages[ 0 ];
+    NSRect       caseRect  = [ self.slipCoverCase caseRectForSize: case512 ];
+    CGSize       pixelSize = CGSizeMake( caseRect.size.width  * dpiValue( 1 ),
+                                         caseRect.size.height * dpiValue( 1 ) );
+    CGImageRef   cover     = [ self allocThumbnailFor: coverPath
+                                            pixelSize: pixelSize
+                                                 mode: thumbnailCacheModeStretch ];
+
+    /* SlipCover draws the case at canvas size; allow for that image, its TIFF
+     * representation and the decoded result. The cover has already been
+     * decoded, so nothing is held while waiting for this.
+     */
+
+    size_t canvasBytes = memoryGovernorImageBytes( dpiValue( CANVAS_SIZE ), dpiValue( CANVAS_SIZE ) );
+    size_t reserved    = canvasBytes * 3;
+
+    reserveMemory( memoryGovernorComposition, reserved );
+
     @try
     {
-        sourceImage = [ [ NSImage alloc ] initByReferencingFile: chosenImages[ 0 ] ];
+        if ( cover != NULL )
+        {
+            sourceImage = [ [ NSImage alloc ] initWithCGImage: cover size: caseRect.size ];
+        }
+        else
+        {
+            sourceImage = [ [ NSImage alloc ] initByReferencingFile: coverPath ];
+        }
+
         caseImage   = [ CaseGenerator caseImageAtSize: case512
                                                 cover: sourceImage
                                        caseDefinition: self.slipCoverCase ];
@@ -1283,7 +2245,13 @@ nothingToDo:
         ( void ) exception; /* Ignore exception; caseImage is 'nil' */
     }
 
-    if ( ! caseImage ) return nil; // Note early exit!
+    if ( cover ) CFRelease( cover );
+
+    if ( ! caseImage )
+    {
+        memoryGovernorRelease( memoryGovernorComposition, reserved );
+        return nil; // Note early exit!
+    }
 
     /* The custom generator has historically always used CoreGraphics calls
      * directly and deals with CGImageRef values rather than NSImage pointers.
@@ -1302,12 +2270,168 @@ nothingToDo:
         CFRelease( imageSourceRef );
     }
 
+    memoryGovernorRelease( memoryGovernorComposition, reserved );
+
 imageGenerationFailed:
 
     return finalImage;
 }
 
 
+/******************************************************************************\
+ * -findImages:
+ *
+ * Search the folder for images to use in its icon. This is the first stage of
+ * -generate:, for callers which run the stages separately (see
+ * "IconPipeline.h"); it only reads the filesystem.
+ *
+ * In:  ( NSError ** )
+ *      Pointer to an NSError * updated on exit to point to an initialised
+ *      NSError if anything went wrong, else "nil". If you can't do anything
+ *      about errors anyway, just pass "nil".
+ *
+ * Out: Array of full POSIX paths of the images, or "nil" if either none were
+ *      found or an error occurs. See "-allocFoundImagePathArray:".
+\******************************************************************************/
+
+- ( NSArray * ) findImages: ( NSError ** ) error
+{
+    return [ self allocFoundImagePathArray: error ];
+}
+
+/******************************************************************************\
+ * -decodeImages:
+ *
+ * Optional second stage of -generate:. Decode thumbnails of the given images
+ * at the sizes -composeIconFrom:errorsTo: will want, in parallel, and hold
+ * them in this instance until that call, which then only has to draw. Images
+ * which fail to decode are left for the composition stage to deal with.
+ *
+ * In:  ( NSArray * ) chosenImages
+ *      Array from -findImages:.
+\******************************************************************************/
+
+- ( void ) decodeImages: ( NSArray * ) chosenImages
+{
+    CGSize             sizes[ 4 ];
+    CGSize           * wanted = sizes; /* Blocks can't capture arrays */
+    NSUInteger         count;
+    ThumbnailCacheMode mode;
+
+    if ( self.slipCoverCase != nil )
+    {
+        NSRect caseRect = [ self.slipCoverCase caseRectForSize: case512 ];
+
+        count      = MIN( [ chosenImages count ], 1 );
+        mode       = thumbnailCacheModeStretch;
+        sizes[ 0 ] = CGSizeMake( caseRect.size.width  * dpiValue( 1 ),
+                                 caseRect.size.height * dpiValue( 1 ) );
+    }
+    else
+    {
+        ThumbnailGeometry geometry;
+        CGRect            slots[ 4 ];
+
+        count = MIN( [ chosenImages count ], self.iconStyle.onlyUseCoverArt.boolValue ? 1 : 4 );
+        mode  = self.iconStyle.cropToSquare.boolValue ? thumbnailCacheModeCrop
+                                                      : thumbnailCacheModeFit;
+
+        [ self getThumbnailGeometry: &geometry ];
+        [ self getSlots: slots forThumbnailCount: count ];
+
+        for ( NSUInteger index = 0; index < count; index ++ )
+        {
+            sizes[ index ] = CGSizeMake( geometry.thumbSize * slots[ index ].size.width  / geometry.canvasSize,
+                                         geometry.thumbSize * slots[ index ].size.height / geometry.canvasSize );
+        }
+    }
+
+    if ( count == 0 ) return;
+
+    /* As in -allocCustomIconFrom:withBackground:errorsTo:, each block sets
+     * only its own entry of an array filled with NULLs first.
+     */
+
+    CFMutableArrayRef thumbnails = CFArrayCreateMutable( kCFAllocatorDefault, count, NULL );
+
+    for ( NSUInteger index = 0; index < count; index ++ )
+    {
+        CFArrayAppendValue( thumbnails, NULL );
+    }
+
+    taskSchedulerApplyBlock
+    (
+        count,
+        ^( size_t index )
+        {
+            CGImageRef thumbnail = [ self allocThumbnailFor: chosenImages[ ( NSUInteger ) index ]
+                                                  pixelSize: wanted[ index ]
+                                                       mode: mode ];
+
+            CFArraySetValueAtIndex( thumbnails, index, thumbnail );
+        }
+    );
+
+    NSMutableDictionary * decoded = [ NSMutableDictionary dictionaryWithCapacity: count ];
+
+    for ( NSUInteger index = 0; index < count; index ++ )
+    {
+        CGImageRef thumbnail = ( CGImageRef ) CFArrayGetValueAtIndex( thumbnails, index );
+
+        if ( thumbnail != NULL )
+        {
+            decoded[ decodedThumbnailKey( chosenImages[ index ], sizes[ index ], mode ) ] = ( __bridge_transfer id ) thumbnail;
+        }
+    }
+
+    CFRelease( thumbnails );
+
+    self.decodedThumbnails = decoded;
+}
+
+/******************************************************************************\
+ * -composeIconFrom:errorsTo:
+ *
+ * Final stage of -generate:, drawing the icon from the given images using any
+ * thumbnails held from -decodeImages:, which are then discarded.
+ *
+ * In:  ( NSArray * ) chosenImages
+ *      Array from -findImages:;
+ *
+ *      ( NSError ** )
+ *      As for -generate:.
+ *
+ * Out: As for -generate:.
+\******************************************************************************/
+
+- ( CGImageRef ) composeIconFrom: ( NSArray   * ) chosenImages
+                        errorsTo: ( NSError  ** ) error
+{
+    CGImageRef generatedImage = NULL;
+
+    if ( error ) *error = nil;
+
+    /* Generate the image using either the custom painting routines or
+     * with SlipCover code.
+     */
+
+    if ( self.slipCoverCase == nil )
+    {
+        generatedImage = [ self allocCustomIconFrom: chosenImages
+                                     withBackground: self.backgroundImage
+                                           errorsTo: error ];
+    }
+    else
+    {
+        generatedImage = [ self allocSlipCoverIcon: chosenImages
+                                          errorsTo: error ];
+    }
+
+    self.decodedThumbnails = nil;
+
+    return generatedImage;
+}
+
 /******************************************************************************\
  * -generate:
  *
@@ -1334,28 +2458,35 @@ imageGenerationFailed:
     if ( error ) *error = nil;
 
     CGImageRef   generatedImage = NULL;
-    NSArray    * chosenImages   = [ self allocFoundImagePathArray: error ];
+    NSArray    * chosenImages   = [ self findImages: error ];
 
     if ( chosenImages != nil )
     {
-        /* Generate the image using either the custom painting routines or
-         * with SlipCover code.
-         */
-        
-        if ( self.slipCoverCase == nil )
-        {
-            generatedImage = [ self allocCustomIconFrom: chosenImages
-                                         withBackground: self.backgroundImage
-                                               errorsTo: error ];
-        }
-        else
-        {
-            generatedImage = [ self allocSlipCoverIcon: chosenImages
-                                              errorsTo: error ];
-        }
+        generatedImage = [ self composeIconFrom: chosenImages
+                                       errorsTo: error ];
     }
 
     return generatedImage;
 }
 
 @end
+
+/******************************************************************************\
+ * decodedThumbnailKey()
+ *
+ * Build the key under which -decodeImages: holds a thumbnail.
+ *
+ * In:  Full POSIX path of the image;
+ *
+ *      Size of the thumbnail in pixels;
+ *
+ *      How the image was fitted to that size.
+ *
+ * Out: Key string.
+\******************************************************************************/
+
+static NSString * decodedThumbnailKey( NSString * path, CGSize pixelSize, ThumbnailCacheMode mode )
+{
+    return [ NSString stringWithFormat: @"%d:%.2fx%.2f:%@", ( int ) mode, pixelSize.width, pixelSize.height, path ];
+}
+
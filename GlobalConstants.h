@@ -23,13 +23,23 @@
 
 #define SKIP_PACKAGES YES
 
-/* Usually only 512x512 and 32x32 size icons are generated as this is visually
- * sufficient in the majority of cases and is much faster than generating every
- * possible size. Change from #undef to #define below if you want to also make
- * the 256x256, 128x128 and 16x16 size icons.
+/* Image files are recognised by filename extension. Should files with no
+ * extension have their first few bytes read to look for an image signature?
+ * This costs an open and read per extensionless file during folder scans.
  */
 
-#undef GENERATE_ALL_ICON_SIZES
+#define SNIFF_EXTENSIONLESS_IMAGES YES
+
+/* The 512x512, 128x128 and 32x32 size icons are always generated. Smaller sizes
+ * are cheap to make now that each is halved from the one above rather than
+ * drawn afresh: the 256x256 size is made on the way to 128x128 anyway, and
+ * the whole chain down to 16x16 takes well under a millisecond per icon (see
+ * "Tests/IconPyramidBenchmark.c"), so the 256x256 and 16x16 sizes are written
+ * too by default. Change from #define to #undef below to leave them out and
+ * keep icon files smaller.
+ */
+
+#define GENERATE_ALL_ICON_SIZES
 
 /* Dump icon data (the original full size CGImage as a PNG) to a file for
  * debugging purposes? The filename is the folder name with
@@ -39,6 +49,19 @@
 
 #undef DUMP_ICON_MASTER_IMAGE_TO_PNG_FILE
 
+/* Draw each thumbnail's border, rotation and drop shadow in the custom icon
+ * styles with the portable raster engine in "RasterEngine.h" instead of with
+ * CoreGraphics? Results are very close but not identical, so existing icons
+ * would all change. The CoreGraphics path also takes each border and shadow
+ * from the sprite cache ("SpriteCache.h") after the first, leaving only the
+ * image to draw, whereas the engine redraws and reblurs the lot every time
+ * (see "Tests/RasterEngineBenchmark.c"). So the engine is left for headless
+ * rendering and profiling, where the tests hold it to golden images of each
+ * preset style. Change from #undef to #define below to use it here too.
+ */
+
+#undef USE_RASTER_ENGINE
+
 /* This global flag is set by the concurrent path processor if an error is
  * detected. Error messages are logged to the system console, printed to stderr
  * for direct command line users, and the global error flag is set so that the
@@ -50,3 +73,19 @@
  */
 
 extern Boolean globalErrorFlag; /* See main.m */
+
+/* Alongside the error flag, the concurrent path processor counts the folder
+ * icons it writes, finds already in place (see the "skipUnchangedIcons"
+ * preference) or fails to write, for a summary at the end of a run. Update
+ * and read the counts while holding the global semaphore.
+ */
+
+typedef struct IconWriteCounts
+{
+    NSUInteger written;
+    NSUInteger unchanged;
+    NSUInteger failed;
+
+} IconWriteCounts;
+
+extern IconWriteCounts globalIconWriteCounts;
@@ -13,3 +13,7 @@
 // to other files via the 'extern' declaration in GlobalConstants.h.
 //
 Boolean globalErrorFlag;
+
+// Likewise the counts of icons written, skipped as unchanged, or failed.
+//
+IconWriteCounts globalIconWriteCounts;
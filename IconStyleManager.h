@@ -29,6 +29,13 @@
 
 #define PREFERENCES_DEFAULT_STYLE_KEY        @"defaultStyle"
 
+/* Posted on the main thread whenever icon styles are inserted, changed or
+ * deleted in the manager's managed object context, so that anything derived
+ * from them can be thrown away. The notification object is the manager.
+ */
+
+#define ICON_STYLES_CHANGED_NOTIFICATION     @"IconStylesChanged"
+
 @interface IconStyleManager : NSObject < SCEventListenerProtocol,
                                          NSAlertDelegate >
 {
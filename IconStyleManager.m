@@ -21,6 +21,7 @@
 
 @interface IconStyleManager ()
   - ( void ) checkIconStylesForValidity;
+  - ( void ) managedObjectContextChanged: ( NSNotification * ) notification;
 @end
 
 @implementation IconStyleManager
@@ -91,6 +92,15 @@
          */
 
         [ self establishSlipCoverIconStyles ];
+
+        /* Pass on any changes to styles to those interested */
+
+        [
+            [ NSNotificationCenter defaultCenter ] addObserver: self
+                                                      selector: @selector( managedObjectContextChanged: )
+                                                          name: NSManagedObjectContextObjectsDidChangeNotification
+                                                        object: [ self managedObjectContext ]
+        ];
     }
 
     return self;
@@ -105,9 +115,41 @@
 
  - ( void ) dealloc
 {
+    [ [ NSNotificationCenter defaultCenter ] removeObserver: self ];
     [ slipCoverCaseFolderWatcher stopWatchingPaths ];
 }
 
+/******************************************************************************\
+ * -managedObjectContextChanged:
+ *
+ * Objects in the managed object context have been inserted, updated or
+ * deleted. If any are icon styles, post ICON_STYLES_CHANGED_NOTIFICATION.
+ *
+ * In:  ( NSNotification * ) notification
+ *      NSManagedObjectContextObjectsDidChangeNotification.
+\******************************************************************************/
+
+- ( void ) managedObjectContextChanged: ( NSNotification * ) notification
+{
+    NSDictionary * info = [ notification userInfo ];
+
+    for ( NSString * key in @[ NSInsertedObjectsKey, NSUpdatedObjectsKey, NSDeletedObjectsKey ] )
+    {
+        for ( id object in info[ key ] )
+        {
+            if ( [ object isKindOfClass: [ IconStyle class ] ] )
+            {
+                [
+                    [ NSNotificationCenter defaultCenter ] postNotificationName: ICON_STYLES_CHANGED_NOTIFICATION
+                                                                         object: self
+                ];
+
+                return;
+            }
+        }
+    }
+}
+
 /******************************************************************************\
  * -managedObjectModel
  *
@@ -15,6 +15,9 @@
 #import "GlobalSemaphore.h"
 #import "ConcurrentCellProcessor.h"
 #import "ConcurrentPathProcessor.h"
+#import "SharedTreeWalk.h"
+#import "IconPipeline.h"
+#import "TaskScheduler.h"
 
 #import <Foundation/Foundation.h>
 
@@ -22,6 +25,8 @@
 
 @interface MainWindowController()
 @property NSOperationQueue * queue;
+@property NSOperationQueue * previewQueue;
+@property NSString         * progressMessage;
 @end
 
 @implementation MainWindowController
@@ -32,8 +37,9 @@
 
 - ( void ) awakeFromNib
 {
-    tableContents = [ [ NSMutableArray   alloc ] init ];
-    self.queue    = [ [ NSOperationQueue alloc ] init ];
+    tableContents     = [ [ NSMutableArray   alloc ] init ];
+    self.queue        = [ [ NSOperationQueue alloc ] init ];
+    self.previewQueue = [ [ NSOperationQueue alloc ] init ];
 
     /* Although documentation implies that the system should be left alone to
      * set this up, in practice doing so causes very high system workload for
@@ -51,9 +57,18 @@
      * behaviour here (was OK on 10.6, got bad in 10.7, still bad in 10.10.2)
      * there doesn't seem to be another way; though if anyone else other than
      * me ever reads this and has suggestions, I'd love to hear them!
+     *
+     * Folder icons are normally added through an IconPipeline, which tunes
+     * its own concurrency as it goes; this queue is left for when the
+     * "useStagedPipeline" preference is turned off.
+     *
+     * Previews find their images on a queue of their own, so they never wait
+     * behind folders being processed, then are drawn by the shared task
+     * scheduler; see "ConcurrentCellProcessor.m".
      */
 
-    self.queue.maxConcurrentOperationCount = 8;
+    self.queue.maxConcurrentOperationCount        = ICON_PIPELINE_IO_WORKERS;
+    self.previewQueue.maxConcurrentOperationCount = ICON_PIPELINE_IO_WORKERS;
     
     [ self initOpenPanel      ];
     [ self initWindowContents ];
@@ -218,6 +233,8 @@
 {
     /* Set up the progress indicator panel */
     
+    self.progressMessage = message;
+
     [ progressIndicatorLabel setStringValue: message ];
 
     [ progressIndicator setIndeterminate: YES  ];
@@ -284,7 +301,9 @@
  *
  * Action sent by the 'Stop' button in the modal progress panel. Changes the
  * button so it is no longer enabled and says 'Stopping...', then cancels the
- * worker thread and does nothing else - the rest is up to the thread.
+ * worker thread and any user-initiated drawing still queued in the task
+ * scheduler (see "TaskScheduler.h") and does nothing else - the rest is up to
+ * the thread.
  *
  * In:       ( id ) sender
  *           Sender of the message (ignored).
@@ -297,6 +316,8 @@
     [ progressStopButton setEnabled: NO ];
     [ progressStopButton setTitle: NSLocalizedString( @"Stopping...", @"Title shown in progress panel 'stop' button once the button has been clicked upon and worker thread cancellation is underway" ) ];
     [ workerThread cancel ];
+
+    taskSchedulerCancelLane( taskSchedulerLaneUserInitiated );
 }
 
 /******************************************************************************\
@@ -587,60 +608,198 @@
 - ( void ) createFolderIcons: ( NSArray * ) constArrayOfDictionaries
 {
     globalSemaphoreInit();
-    globalErrorFlag = NO;
+    globalErrorFlag       = NO;
+    globalIconWriteCounts = ( IconWriteCounts ) { 0 };
+
+    /* Preview latencies logged at the end should cover this run only */
+
+    taskSchedulerResetLatencies();
+
+    NSMutableArray * processors = [ NSMutableArray arrayWithCapacity: [ constArrayOfDictionaries count ] ];
 
     for ( NSDictionary * folder in constArrayOfDictionaries )
     {
         NSString  * fullPOSIXPath = folder[ @"path"  ];
         IconStyle * iconStyle     = folder[ @"style" ];
 
-        ConcurrentPathProcessor * processThisPath =
         [
-            [ ConcurrentPathProcessor alloc ] initWithIconStyle: iconStyle
-                                                   forPOSIXPath: fullPOSIXPath
+            processors addObject:
+            [
+                [ ConcurrentPathProcessor alloc ] initWithIconStyle: iconStyle
+                                                       forPOSIXPath: fullPOSIXPath
+            ]
         ];
+    }
 
-        /* Set a completion block that runs whether the operation is successful,
-         * fails or is cancelled. In the event we can see that the worker thread
-         * is cancelled (via the modal progress panel's "Stop" button, tell the
-         * queue to cancel everything. Even though we'll repeat this over and
-         * over for all remaining in-flight operations on the queue, it's
-         * harmless to do so and keeps the code simple.
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+
+    if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"useStagedPipeline" ] )
+    {
+        /* Run the folders through a staged pipeline, so that scanning and
+         * writing overlap with drawing; see "IconPipeline.h". Cancellation
+         * is noticed as each folder leaves the pipeline, as with the queue
+         * below. The "Stop" button also cancels folders queued for drawing
+         * in the task scheduler's user-initiated lane, which then leave the
+         * pipeline straight away.
          */
 
-        [
-            processThisPath setCompletionBlock: ^
+        IconPipeline        * pipeline     = [ [ IconPipeline alloc ] init ];
+        __weak IconPipeline * weakPipeline = pipeline;
+
+        pipeline.folderCompleted = ^( ConcurrentPathProcessor * processor )
+        {
+            if ( [ self->workerThread isCancelled ] == YES )
             {
-                if ( [ self->workerThread isCancelled ]  == YES )
-                {
-                    [ self.queue cancelAllOperations ];
-                }
-                else
-                {
-                    [ self performSelectorOnMainThread: @selector( advanceProgressBarFor: )
-                                            withObject: fullPOSIXPath
-                                         waitUntilDone: NO ];
-                }
+                [ weakPipeline cancel ];
             }
-        ];
+            else
+            {
+                [ self performSelectorOnMainThread: @selector( advanceProgressBarFor: )
+                                        withObject: processor.pathData
+                                     waitUntilDone: NO ];
+            }
+        };
+
+        pipeline.concurrencyChanged = ^( NSUInteger ioWorkers )
+        {
+            [ self performSelectorOnMainThread: @selector( showConcurrency: )
+                                    withObject: @( ioWorkers )
+                                 waitUntilDone: NO ];
+        };
 
-        /* Outside the completion block, here in the loop adding operations, we
-         * also need to check for thread cancellation and use that to cancel the
-         * queue operations before bailing out of the addition loop.
+        [ self performSelectorOnMainThread: @selector( showConcurrency: )
+                                withObject: @( pipeline.ioWorkers )
+                             waitUntilDone: NO ];
+
+        if ( [ workerThread isCancelled ] == NO ) [ pipeline processFolders: processors ];
+
+        [ pipeline logStatistics ];
+    }
+    else
+    {
+        /* Where folders are queued along with folders inside them, walk each
+         * such tree once for all of them rather than once per folder. The
+         * processors involved wait for their walk, so the walks can go
+         * straight onto the queue; see "SharedTreeWalk.h".
          */
 
-        if ( [ workerThread isCancelled ] == YES )
-        {
-            [ self.queue cancelAllOperations ];
-            break;
-        }
-        else
+        [ self.queue addOperations: [ SharedTreeWalk planWalksForProcessors: processors ]
+                 waitUntilFinished: NO ];
+
+        for ( ConcurrentPathProcessor * processThisPath in processors )
         {
-            [ self.queue addOperation: processThisPath ];
+            NSString * fullPOSIXPath = processThisPath.pathData;
+
+            /* Set a completion block that runs whether the operation is
+             * successful, fails or is cancelled. In the event we can see that
+             * the worker thread is cancelled (via the modal progress panel's
+             * "Stop" button, tell the queue to cancel everything. Even though
+             * we'll repeat this over and over for all remaining in-flight
+             * operations on the queue, it's harmless to do so and keeps the
+             * code simple.
+             */
+
+            [
+                processThisPath setCompletionBlock: ^
+                {
+                    if ( [ self->workerThread isCancelled ]  == YES )
+                    {
+                        [ self.queue cancelAllOperations ];
+                    }
+                    else
+                    {
+                        [ self performSelectorOnMainThread: @selector( advanceProgressBarFor: )
+                                                withObject: fullPOSIXPath
+                                             waitUntilDone: NO ];
+                    }
+                }
+            ];
+
+            /* Outside the completion block, here in the loop adding
+             * operations, we also need to check for thread cancellation and
+             * use that to cancel the queue operations before bailing out of
+             * the addition loop.
+             */
+
+            if ( [ workerThread isCancelled ] == YES )
+            {
+                [ self.queue cancelAllOperations ];
+                break;
+            }
+            else
+            {
+                [ self.queue addOperation: processThisPath ];
+            }
         }
+
+        [ self.queue waitUntilAllOperationsAreFinished ];
+    }
+
+    /* Timings for comparing the pipeline with one operation per folder, and
+     * for the task scheduler and previews, are only logged if the hidden
+     * preference "logRunStatistics" is set. The count of icons written is
+     * always logged.
+     */
+
+    if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"logRunStatistics" ] )
+    {
+        CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+
+        NSLog
+        (
+            @"%@: %lu folders in %.2fs (%.1f per second)",
+            @PROGRAM_STRING,
+            ( unsigned long ) [ processors count ],
+            elapsed,
+            elapsed > 0 ? [ processors count ] / elapsed : 0
+        );
+
+        TaskSchedulerStatistics scheduler;
+
+        taskSchedulerGetStatistics( &scheduler );
+
+        NSLog
+        (
+            @"%@: Task scheduler: %u workers, %llu tasks, %llu steals, peak queue %lu, %llu loops (%llu run inline)",
+            @PROGRAM_STRING,
+            scheduler.workers,
+            ( unsigned long long ) scheduler.submitted,
+            ( unsigned long long ) scheduler.steals,
+            ( unsigned long      ) scheduler.peakQueued,
+            ( unsigned long long ) scheduler.loops,
+            ( unsigned long long ) scheduler.inlineLoops
+        );
+
+        /* How long previews drawn during the run waited to start and took to
+         * appear, in milliseconds, while the run's own drawing kept the bulk
+         * lanes busy.
+         */
+
+        TaskSchedulerLaneStatistics * previews = &scheduler.lanes[ taskSchedulerLaneInteractive ];
+
+        NSLog
+        (
+            @"%@: Previews: %llu drawn, %llu cancelled; waited p50 %.1f, p95 %.1f, p99 %.1f; took p50 %.1f, p95 %.1f, p99 %.1f (ms)",
+            @PROGRAM_STRING,
+            ( unsigned long long ) previews->completed,
+            ( unsigned long long ) previews->cancelled,
+            latencyHistogramPercentile( &previews->waited, 50 ) / 1000.0,
+            latencyHistogramPercentile( &previews->waited, 95 ) / 1000.0,
+            latencyHistogramPercentile( &previews->waited, 99 ) / 1000.0,
+            latencyHistogramPercentile( &previews->took,   50 ) / 1000.0,
+            latencyHistogramPercentile( &previews->took,   95 ) / 1000.0,
+            latencyHistogramPercentile( &previews->took,   99 ) / 1000.0
+        );
     }
 
-    [ self.queue waitUntilAllOperationsAreFinished ];
+    NSLog
+    (
+        @"%@: Folder icons written: %lu, already up to date: %lu, failed: %lu",
+        @PROGRAM_STRING,
+        ( unsigned long ) globalIconWriteCounts.written,
+        ( unsigned long ) globalIconWriteCounts.unchanged,
+        ( unsigned long ) globalIconWriteCounts.failed
+    );
 
     /* If things went wrong tell the user in a modal alert opened from within
      * this modal loop, so the progress panel is still visible as an indication
@@ -673,6 +832,32 @@
                           waitUntilDone: NO ];
 }
 
+/******************************************************************************\
+ * -showConcurrency:
+ *
+ * Show how many folders are being scanned or written at once, after the
+ * progress panel's message.
+ *
+ * Invoke within the main processing thread only.
+ *
+ * In: ( NSNumber * ) ioWorkers
+ *     Number of folders; see "IconPipeline.h".
+\******************************************************************************/
+
+- ( void ) showConcurrency: ( NSNumber * ) ioWorkers
+{
+    NSString * format = NSLocalizedString( @"%@ (%lu folders at a time)", @"Progress panel message with the number of folders being scanned or written at once appended" );
+
+    [
+        progressIndicatorLabel setStringValue:
+        [
+            NSString stringWithFormat: format,
+                                       self.progressMessage,
+                                       ( unsigned long ) ioWorkers.unsignedIntegerValue
+        ]
+    ];
+}
+
 /******************************************************************************\
  * -advanceProgressBarFor:
  *
@@ -1130,6 +1315,12 @@
 {
     ( void ) notification;
 
+    /* Previews not yet started may be for rows scrolled out of view; drop
+     * them, and the reload asks again for those still in view.
+     */
+
+    taskSchedulerCancelLane( taskSchedulerLaneInteractive );
+
     [ NSObject cancelPreviousPerformRequestsWithTarget: folderList selector: @selector( reloadData ) object: nil ];
     [ folderList performSelector: @selector( reloadData ) withObject: nil afterDelay: 0.05 ];
 }
@@ -1376,7 +1567,15 @@
             @"cellProcessor": cellProcessor
         };
 
-        [ self.queue addOperation: cellProcessor ];
+        /* The operation finds the folder's images on the preview queue, then
+         * has the task scheduler that does all the other drawing draw them
+         * (see "TaskScheduler.h"), so previews share the cores with any
+         * folders being processed rather than adding to them; but in its
+         * interactive lane, so they go ahead of that work. It is cancelled
+         * as above, or by the scheduler when the list is scrolled.
+         */
+
+        [ self.previewQueue addOperation: cellProcessor ];
 
         /* Meanwhile, return the default folder image */
 
@@ -0,0 +1,157 @@
+/******************************************************************************\
+ * Utilities: ConcurrencyController.c
+ *
+ * Feedback controller for the number of filesystem-bound jobs to run at once.
+ * See "ConcurrencyController.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ConcurrencyController.h"
+
+/******************************************************************************\
+ * concurrencyControllerInit()
+ *
+ * Set up a controller. See "ConcurrencyController.h".
+\******************************************************************************/
+
+void concurrencyControllerInit( ConcurrencyController * controller,
+                                unsigned int            minimum,
+                                unsigned int            maximum,
+                                unsigned int            initial )
+{
+    if ( minimum < 1       ) minimum = 1;
+    if ( maximum < minimum ) maximum = minimum;
+
+    if      ( initial < minimum ) initial = minimum;
+    else if ( initial > maximum ) initial = maximum;
+
+    controller->minimum        = minimum;
+    controller->maximum        = maximum;
+    controller->current        = initial;
+    controller->lastThroughput = -1;
+    controller->lastLatency    = 0;
+    controller->bestLatency    = 0;
+    controller->hold           = 0;
+    controller->increased      = 0;
+    controller->slowStart      = 1;
+    controller->decreases      = 0;
+}
+
+/******************************************************************************\
+ * concurrencyControllerSample()
+ *
+ * Take a measurement and choose the next concurrency. See
+ * "ConcurrencyController.h".
+\******************************************************************************/
+
+unsigned int concurrencyControllerSample( ConcurrencyController * controller,
+                                          double                  completed,
+                                          double                  interval,
+                                          double                  meanLatency,
+                                          size_t                  pending )
+{
+    if ( interval <= 0 ) return controller->current;
+
+    double       throughput = completed / interval;
+    double       last       = controller->lastThroughput;
+    unsigned int increased  = controller->increased;
+    int          congested  = 0;
+
+    /* Smooth out bursts of completions */
+
+    if ( last >= 0 )
+    {
+        throughput = last + CONCURRENCY_CONTROLLER_SMOOTHING * ( throughput - last );
+    }
+
+    if ( meanLatency > 0 && controller->lastLatency > 0 )
+    {
+        meanLatency = controller->lastLatency + CONCURRENCY_CONTROLLER_SMOOTHING * ( meanLatency - controller->lastLatency );
+    }
+
+    controller->lastThroughput = throughput;
+    controller->increased      = 0;
+
+    if ( meanLatency > 0 ) controller->lastLatency = meanLatency;
+
+    /* With too little work to keep the current concurrency busy, as when a
+     * batch drains, throughput says nothing about the storage.
+     */
+
+    if ( pending < controller->current ) return controller->current;
+
+    if ( meanLatency > 0 )
+    {
+        if ( controller->bestLatency <= 0 || meanLatency < controller->bestLatency )
+        {
+            controller->bestLatency = meanLatency;
+        }
+        else
+        {
+            controller->bestLatency *= CONCURRENCY_CONTROLLER_LATENCY_MEMORY;
+
+            if ( last >= 0 &&
+                 meanLatency > controller->bestLatency * CONCURRENCY_CONTROLLER_LATENCY_LIMIT &&
+                 throughput <= last * ( 1 + CONCURRENCY_CONTROLLER_TOLERANCE ) )
+            {
+                congested = 1;
+            }
+        }
+    }
+
+    if ( last > 0 && throughput < last * ( 1 - CONCURRENCY_CONTROLLER_DROP ) )
+    {
+        congested = 1;
+    }
+
+    if ( congested )
+    {
+        unsigned int halved = controller->current / 2;
+
+        controller->current   = halved < controller->minimum ? controller->minimum : halved;
+        controller->hold      = CONCURRENCY_CONTROLLER_HOLD;
+        controller->slowStart = 0;
+        controller->decreases ++;
+    }
+    else if ( increased && throughput <= last * ( 1 + CONCURRENCY_CONTROLLER_TOLERANCE ) )
+    {
+        /* The last increase didn't pay off, or made things worse if not yet
+         * badly; undo it.
+         */
+
+        controller->current -= increased;
+
+        controller->hold      = CONCURRENCY_CONTROLLER_HOLD;
+        controller->slowStart = 0;
+    }
+    else if ( controller->slowStart )
+    {
+        /* Double for as long as that keeps paying off */
+
+        if ( last < 0 || throughput > last * ( 1 + CONCURRENCY_CONTROLLER_TOLERANCE ) )
+        {
+            unsigned int doubled = controller->current * 2;
+
+            if ( doubled > controller->maximum ) doubled = controller->maximum;
+
+            controller->increased = doubled - controller->current;
+            controller->current   = doubled;
+        }
+        else
+        {
+            controller->slowStart = 0;
+        }
+    }
+    else if ( controller->hold > 0 )
+    {
+        controller->hold --;
+    }
+    else if ( controller->current < controller->maximum )
+    {
+        controller->current   ++;
+        controller->increased = 1;
+    }
+
+    return controller->current;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************\
+ * Utilities: ConcurrencyController.h
+ *
+ * Feedback controller that chooses how many filesystem-bound jobs to run at
+ * once, from the throughput and latency measured as they run. How many is
+ * best depends on the storage: a local SSD keeps up with twice as many
+ * concurrent folder scans as there are processor cores, whereas a file server
+ * can be overwhelmed by a handful, at which point each scan takes longer and
+ * fewer folders get done in total, not more.
+ *
+ * The controller uses additive increase, multiplicative decrease (AIMD) with
+ * a "slow start", much as TCP does:
+ *
+ * - To begin with, the concurrency is doubled for each sample for as long as
+ *   throughput improves, so fast storage is soon kept busy. Start low, so that
+ *   slow storage isn't swamped before the first measurement.
+ *
+ * - After that, while nothing suggests congestion, the concurrency is raised
+ *   by one for each sample, up to the maximum.
+ *
+ * - Congestion is signalled when throughput falls sharply from the previous
+ *   sample, or when the mean latency of a job has grown well beyond the best
+ *   recently seen without throughput improving to match. The concurrency is
+ *   then halved, down to the minimum, and held there for a few samples before
+ *   increasing again.
+ *
+ * - If throughput doesn't clearly improve after an increase, that increase
+ *   is undone and the concurrency held, as in hill climbing, so it settles
+ *   close to the best level rather than repeatedly overshooting and halving.
+ *
+ * Completions are bursty, so throughput and latency are smoothed from sample
+ * to sample before any of this is judged. The best latency is slowly
+ * forgotten, so that the controller adapts if the work changes character part
+ * way through a run.
+ *
+ * Throughput also falls as a batch drains, which is no sign of congestion.
+ * So while fewer jobs are running or waiting to run than the concurrency
+ * allows, the concurrency is left as it is: there's no call to lower it, and
+ * raising it would make no difference.
+ *
+ * This is plain C with no Cocoa dependencies; it does no timing or locking of
+ * its own, so is driven entirely by the numbers given to it. One controller
+ * must only be used by one thread at a time.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef CONCURRENCY_CONTROLLER_H
+#define CONCURRENCY_CONTROLLER_H
+
+#include <stddef.h>
+
+/* Congestion thresholds: throughput below (1 - DROP) of the previous sample;
+ * or mean latency above LATENCY_LIMIT times the best, with throughput no more
+ * than (1 + TOLERANCE) of the previous sample. An increase is undone unless
+ * throughput rises above (1 + TOLERANCE) of the previous sample. After any
+ * decrease, increases resume after HOLD samples. The best latency grows by a
+ * factor of LATENCY_MEMORY per sample, so older bests are forgotten. Each
+ * sample's throughput and latency are given a weight of SMOOTHING against
+ * those smoothed so far.
+ */
+
+#define CONCURRENCY_CONTROLLER_DROP           0.25
+#define CONCURRENCY_CONTROLLER_LATENCY_LIMIT  2.0
+#define CONCURRENCY_CONTROLLER_TOLERANCE      0.05
+#define CONCURRENCY_CONTROLLER_HOLD           2
+#define CONCURRENCY_CONTROLLER_LATENCY_MEMORY 1.02
+#define CONCURRENCY_CONTROLLER_SMOOTHING      0.5
+
+typedef struct ConcurrencyController
+{
+    unsigned int minimum;
+    unsigned int maximum;
+    unsigned int current;
+
+    double       lastThroughput; /* Smoothed; negative before the first sample */
+    double       lastLatency;    /* Smoothed; 0 if none seen yet               */
+    double       bestLatency;    /* Of those smoothed; 0 if none seen yet      */
+    unsigned int hold;           /* Samples left before increasing             */
+    unsigned int increased;      /* By how much the last sample raised it      */
+    int          slowStart;      /* Still doubling?                            */
+    unsigned int decreases;      /* Congestion signals so far                  */
+
+} ConcurrencyController;
+
+/******************************************************************************\
+ * concurrencyControllerInit()
+ *
+ * Set up a controller.
+ *
+ * In:  Controller to set up;
+ *
+ *      Least and most concurrency to choose, at least 1 and with the least no
+ *      more than the most;
+ *
+ *      Concurrency to start with, clamped to that range.
+\******************************************************************************/
+
+void concurrencyControllerInit( ConcurrencyController * controller,
+                                unsigned int            minimum,
+                                unsigned int            maximum,
+                                unsigned int            initial );
+
+/******************************************************************************\
+ * concurrencyControllerSample()
+ *
+ * Give the controller a measurement taken over the last sampling interval,
+ * during which the concurrency was as last returned, and find out what it
+ * should be for the next one.
+ *
+ * In:  Controller;
+ *
+ *      Jobs completed during the interval;
+ *
+ *      Length of the interval in seconds; if not greater than zero, the sample
+ *      is ignored;
+ *
+ *      Mean time taken by each of those jobs in seconds, or 0 if unknown (in
+ *      which case only throughput is considered);
+ *
+ *      Jobs running or waiting to run at the end of the interval.
+ *
+ * Out: Concurrency to use from now on.
+\******************************************************************************/
+
+unsigned int concurrencyControllerSample( ConcurrencyController * controller,
+                                          double                  completed,
+                                          double                  interval,
+                                          double                  meanLatency,
+                                          size_t                  pending );
+
+#endif /* CONCURRENCY_CONTROLLER_H */
@@ -0,0 +1,622 @@
+/******************************************************************************\
+ * Utilities: EmbeddedPreview.c
+ *
+ * Embedded JPEG preview discovery. See "EmbeddedPreview.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "EmbeddedPreview.h"
+#include "ReducedDecode.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Limits which keep corrupt or hostile files from causing long loops */
+
+#define MAXIMUM_IFDS          64  /* Per file, across all chains         */
+#define MAXIMUM_IFD_ENTRIES   512 /* Entries examined per IFD            */
+#define MAXIMUM_SUBIFD_DEPTH  3
+#define MAXIMUM_SUBIFDS       8   /* Sub-IFDs followed from any one IFD  */
+#define MAXIMUM_MARKERS       128 /* JPEG markers walked in any one pass */
+
+/* TIFF tags and types of interest */
+
+#define TAG_COMPRESSION        0x0103
+#define TAG_STRIP_OFFSETS      0x0111
+#define TAG_STRIP_BYTE_COUNTS  0x0117
+#define TAG_SUB_IFDS           0x014A
+#define TAG_JPEG_OFFSET        0x0201
+#define TAG_JPEG_LENGTH        0x0202
+#define TAG_MP_ENTRY           0xB002
+
+#define TYPE_SHORT             3
+#define TYPE_LONG              4
+#define TYPE_IFD               13
+
+/* State for one file being examined */
+
+typedef struct Parser
+{
+    int               fd;
+    uint64_t          fileSize;
+    EmbeddedPreview * previews;
+    unsigned int      count;
+    unsigned int      ifdsVisited;
+
+} Parser;
+
+/* A TIFF structure within the file; offsets inside it are relative to 'base' */
+
+typedef struct TIFFView
+{
+    uint64_t base;
+    uint64_t limit;     /* Bytes available from 'base' */
+    bool     bigEndian;
+
+} TIFFView;
+
+static bool     readAt         ( const Parser * parser, uint64_t offset, void * buffer, size_t length );
+static uint16_t get16          ( const TIFFView * view, const unsigned char * bytes );
+static uint32_t get32          ( const TIFFView * view, const unsigned char * bytes );
+static bool     jpegFrameSize  ( const Parser * parser, uint64_t offset, uint64_t length, uint32_t * width, uint32_t * height );
+static void     addCandidate   ( Parser * parser, const TIFFView * view, uint64_t offset, uint64_t length );
+static bool     openView       ( const Parser * parser, uint64_t base, uint64_t limit, TIFFView * view, uint32_t * firstIFD );
+static uint32_t parseIFD       ( Parser * parser, const TIFFView * view, uint32_t offset, unsigned int depth );
+static void     parseTIFF      ( Parser * parser, uint64_t base, uint64_t limit );
+static void     parseMPF       ( Parser * parser, uint64_t base, uint64_t limit );
+static void     parseJPEG      ( Parser * parser );
+static bool     boxContent     ( EmbeddedPreview * preview, double sourceAspect );
+
+/******************************************************************************\
+ * embeddedPreviewList()
+ *
+ * List the usable previews in a file. See "EmbeddedPreview.h".
+\******************************************************************************/
+
+unsigned int embeddedPreviewList( const char      * path,
+                                  EmbeddedPreview * previews )
+{
+    Parser        parser = { .previews = previews };
+    struct stat   info;
+    unsigned char magic[ 4 ];
+
+    parser.fd = open( path, O_RDONLY );
+    if ( parser.fd < 0 ) return 0;
+
+    if ( fstat( parser.fd, &info ) == 0 && S_ISREG( info.st_mode ) )
+    {
+        parser.fileSize = ( uint64_t ) info.st_size;
+
+        if ( readAt( &parser, 0, magic, sizeof( magic ) ) )
+        {
+            if ( magic[ 0 ] == 0xFF && magic[ 1 ] == 0xD8 && magic[ 2 ] == 0xFF )
+            {
+                parseJPEG( &parser );
+            }
+            else if ( ( magic[ 0 ] == 'I' && magic[ 1 ] == 'I' ) ||
+                      ( magic[ 0 ] == 'M' && magic[ 1 ] == 'M' ) )
+            {
+                parseTIFF( &parser, 0, parser.fileSize );
+            }
+        }
+    }
+
+    close( parser.fd );
+
+    return parser.count;
+}
+
+/******************************************************************************\
+ * embeddedPreviewFind()
+ *
+ * Find the smallest suitable preview. See "EmbeddedPreview.h".
+\******************************************************************************/
+
+bool embeddedPreviewFind( const char      * path,
+                          uint32_t          sourceWidth,
+                          uint32_t          sourceHeight,
+                          double            targetWidth,
+                          double            targetHeight,
+                          bool              crop,
+                          EmbeddedPreview * preview )
+{
+    EmbeddedPreview previews[ EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES ];
+    unsigned int    count;
+    int             best = -1;
+
+    if ( sourceWidth == 0 || sourceHeight == 0 ) return false;
+
+    count = embeddedPreviewList( path, previews );
+
+    double   sourceAspect = ( double   ) sourceWidth / sourceHeight;
+    uint64_t sourceArea   = ( uint64_t ) sourceWidth * sourceHeight;
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        EmbeddedPreview * candidate = &previews[ index ];
+        double            aspect    = ( double   ) candidate->width / candidate->height;
+        uint64_t          area      = ( uint64_t ) candidate->width * candidate->height;
+
+        if ( area >= sourceArea ) continue;
+
+        if ( fabs( aspect / sourceAspect - 1 ) > EMBEDDED_PREVIEW_ASPECT_TOLERANCE )
+        {
+            if ( ! boxContent( candidate, sourceAspect ) ) continue;
+        }
+
+        if ( ! reducedDecodeCovers( candidate->contentWidth, candidate->contentHeight, targetWidth, targetHeight, crop ) )
+        {
+            continue;
+        }
+
+        if ( best < 0 || area < ( uint64_t ) previews[ best ].width * previews[ best ].height )
+        {
+            best = ( int ) index;
+        }
+    }
+
+    if ( best < 0 ) return false;
+
+    *preview = previews[ best ];
+    return true;
+}
+
+/******************************************************************************\
+ * readAt()
+ *
+ * Read exactly 'length' bytes from the given file offset.
+ *
+ * Out: true on success, false on error or if the file is too short.
+\******************************************************************************/
+
+static bool readAt( const Parser * parser, uint64_t offset, void * buffer, size_t length )
+{
+    if ( offset > parser->fileSize || length > parser->fileSize - offset ) return false;
+
+    return pread( parser->fd, buffer, length, ( off_t ) offset ) == ( ssize_t ) length;
+}
+
+/******************************************************************************\
+ * get16(), get32()
+ *
+ * Read unsigned integers in a TIFF structure's byte order.
+\******************************************************************************/
+
+static uint16_t get16( const TIFFView * view, const unsigned char * bytes )
+{
+    return view->bigEndian ? ( uint16_t ) ( ( bytes[ 0 ] << 8 ) | bytes[ 1 ] )
+                           : ( uint16_t ) ( ( bytes[ 1 ] << 8 ) | bytes[ 0 ] );
+}
+
+static uint32_t get32( const TIFFView * view, const unsigned char * bytes )
+{
+    return view->bigEndian
+           ? ( ( uint32_t ) bytes[ 0 ] << 24 ) | ( ( uint32_t ) bytes[ 1 ] << 16 ) | ( ( uint32_t ) bytes[ 2 ] << 8 ) | bytes[ 3 ]
+           : ( ( uint32_t ) bytes[ 3 ] << 24 ) | ( ( uint32_t ) bytes[ 2 ] << 16 ) | ( ( uint32_t ) bytes[ 1 ] << 8 ) | bytes[ 0 ];
+}
+
+/******************************************************************************\
+ * jpegFrameSize()
+ *
+ * Walk the markers of a JPEG stream up to its frame header and read the image
+ * dimensions from it.
+ *
+ * In:  Parser;
+ *
+ *      File offset and length of the JPEG stream;
+ *
+ *      Pointers to values updated with the frame width and height.
+ *
+ * Out: true if the stream is a baseline, extended or progressive JPEG with
+ *      non-zero dimensions, else false.
+\******************************************************************************/
+
+static bool jpegFrameSize( const Parser * parser, uint64_t offset, uint64_t length, uint32_t * width, uint32_t * height )
+{
+    unsigned char bytes[ 9 ];
+    uint64_t      end      = offset + length;
+    uint64_t      position = offset + 2;
+
+    if ( ! readAt( parser, offset, bytes, 2 ) || bytes[ 0 ] != 0xFF || bytes[ 1 ] != 0xD8 ) return false;
+
+    for ( unsigned int markers = 0; markers < MAXIMUM_MARKERS && position + 4 <= end; markers ++ )
+    {
+        if ( ! readAt( parser, position, bytes, 4 ) || bytes[ 0 ] != 0xFF ) return false;
+
+        unsigned char marker = bytes[ 1 ];
+
+        if ( marker == 0xFF ) { position ++; continue; } /* Fill byte */
+
+        if ( marker == 0xC0 || marker == 0xC1 || marker == 0xC2 )
+        {
+            if ( ! readAt( parser, position + 4, bytes, 5 ) ) return false;
+
+            *height = ( ( uint32_t ) bytes[ 1 ] << 8 ) | bytes[ 2 ];
+            *width  = ( ( uint32_t ) bytes[ 3 ] << 8 ) | bytes[ 4 ];
+
+            return *width != 0 && *height != 0;
+        }
+
+        /* Any other frame type (lossless, hierarchical, arithmetic coded), a
+         * scan before any frame, or the end of the image: give up.
+         */
+
+        if ( ( marker >= 0xC3 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC ) ||
+             marker == 0xDA || marker == 0xD9 )
+        {
+            return false;
+        }
+
+        position += 2 + ( ( ( uint32_t ) bytes[ 2 ] << 8 ) | bytes[ 3 ] );
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * addCandidate()
+ *
+ * Record a possible preview, if it lies within the TIFF structure and the file
+ * and is a JPEG stream we can use. Duplicates (e.g. the same data described
+ * by both JPEGInterchangeFormat and strip tags) are ignored.
+ *
+ * In:  Parser;
+ *
+ *      View of the TIFF structure describing the preview;
+ *
+ *      Offset and length of the preview relative to the view's base.
+\******************************************************************************/
+
+static void addCandidate( Parser * parser, const TIFFView * view, uint64_t offset, uint64_t length )
+{
+    uint32_t width, height;
+
+    if ( parser->count >= EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES ) return;
+    if ( length < 4 || offset > view->limit || length > view->limit - offset ) return;
+
+    offset += view->base;
+
+    for ( unsigned int index = 0; index < parser->count; index ++ )
+    {
+        if ( parser->previews[ index ].offset == offset ) return;
+    }
+
+    if ( jpegFrameSize( parser, offset, length, &width, &height ) )
+    {
+        EmbeddedPreview * preview = &parser->previews[ parser->count ++ ];
+
+        preview->offset = offset;
+        preview->length = length;
+        preview->width  = width;
+        preview->height = height;
+
+        preview->contentX      = 0;
+        preview->contentY      = 0;
+        preview->contentWidth  = width;
+        preview->contentHeight = height;
+    }
+}
+
+/******************************************************************************\
+ * openView()
+ *
+ * Read a TIFF header at the given file offset.
+ *
+ * In:  Parser;
+ *
+ *      File offset of the header and number of bytes available from there;
+ *
+ *      Pointer to a view to fill in;
+ *
+ *      Pointer to a value updated with the offset of the first IFD.
+ *
+ * Out: true if a header was found, else false. The magic number is not
+ *      checked, since several RAW formats use their own (e.g. ORF, RW2).
+\******************************************************************************/
+
+static bool openView( const Parser * parser, uint64_t base, uint64_t limit, TIFFView * view, uint32_t * firstIFD )
+{
+    unsigned char header[ 8 ];
+
+    if ( limit < sizeof( header ) || ! readAt( parser, base, header, sizeof( header ) ) ) return false;
+
+    if      ( header[ 0 ] == 'I' && header[ 1 ] == 'I' ) view->bigEndian = false;
+    else if ( header[ 0 ] == 'M' && header[ 1 ] == 'M' ) view->bigEndian = true;
+    else return false;
+
+    view->base  = base;
+    view->limit = limit;
+    *firstIFD   = get32( view, header + 4 );
+
+    return true;
+}
+
+/******************************************************************************\
+ * parseIFD()
+ *
+ * Look for previews described by an IFD and, recursively, its sub-IFDs. A
+ * preview is either JPEGInterchangeFormat data or a single JPEG-compressed
+ * strip (as used by e.g. CR2 and DNG).
+ *
+ * In:  Parser;
+ *
+ *      View of the TIFF structure;
+ *
+ *      Offset of the IFD relative to the view's base;
+ *
+ *      Sub-IFD nesting depth, 0 for the main chain.
+ *
+ * Out: Offset of the next IFD in the chain, or 0 if none or on error.
+\******************************************************************************/
+
+static uint32_t parseIFD( Parser * parser, const TIFFView * view, uint32_t offset, unsigned int depth )
+{
+    unsigned char   countBytes[ 2 ];
+    unsigned char   entries[ MAXIMUM_IFD_ENTRIES * 12 ];
+    unsigned char   nextBytes[ 4 ];
+    uint32_t        subIFDs[ MAXIMUM_SUBIFDS ];
+    unsigned int    subIFDCount = 0;
+    uint32_t        jpegOffset  = 0, jpegLength  = 0;
+    uint32_t        stripOffset = 0, stripLength = 0;
+    uint32_t        compression = 0;
+
+    if ( offset == 0 || parser->ifdsVisited >= MAXIMUM_IFDS ) return 0;
+    parser->ifdsVisited ++;
+
+    if ( ( uint64_t ) offset + 2 > view->limit ) return 0;
+    if ( ! readAt( parser, view->base + offset, countBytes, 2 ) ) return 0;
+
+    unsigned int count = get16( view, countBytes );
+    if ( count > MAXIMUM_IFD_ENTRIES ) count = MAXIMUM_IFD_ENTRIES;
+
+    if ( ( uint64_t ) offset + 2 + count * 12 + 4 > view->limit ) return 0;
+    if ( ! readAt( parser, view->base + offset + 2, entries, count * 12 ) ) return 0;
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        const unsigned char * entry      = entries + index * 12;
+        uint16_t              tag        = get16( view, entry     );
+        uint16_t              type       = get16( view, entry + 2 );
+        uint32_t              valueCount = get32( view, entry + 4 );
+        uint32_t              value;
+
+        /* Only single SHORT or LONG values are of interest, except for
+         * sub-IFD lists.
+         */
+
+        if      ( type == TYPE_SHORT ) value = get16( view, entry + 8 );
+        else if ( type == TYPE_LONG || type == TYPE_IFD ) value = get32( view, entry + 8 );
+        else continue;
+
+        switch ( tag )
+        {
+            case TAG_COMPRESSION:       if ( valueCount == 1 ) compression = value; break;
+            case TAG_STRIP_OFFSETS:     if ( valueCount == 1 ) stripOffset = value; break;
+            case TAG_STRIP_BYTE_COUNTS: if ( valueCount == 1 ) stripLength = value; break;
+            case TAG_JPEG_OFFSET:       if ( valueCount == 1 ) jpegOffset  = value; break;
+            case TAG_JPEG_LENGTH:       if ( valueCount == 1 ) jpegLength  = value; break;
+
+            case TAG_SUB_IFDS:
+            {
+                if ( type == TYPE_SHORT ) break;
+
+                unsigned int room = MAXIMUM_SUBIFDS - subIFDCount;
+
+                if ( valueCount == 1 && room > 0 )
+                {
+                    subIFDs[ subIFDCount ++ ] = value;
+                }
+                else if ( valueCount > 1 && room > 0 )
+                {
+                    unsigned char list[ MAXIMUM_SUBIFDS * 4 ];
+                    unsigned int  listCount = valueCount > room ? room : valueCount;
+
+                    if ( ( uint64_t ) value + listCount * 4 <= view->limit &&
+                         readAt( parser, view->base + value, list, listCount * 4 ) )
+                    {
+                        for ( unsigned int item = 0; item < listCount; item ++ )
+                        {
+                            subIFDs[ subIFDCount ++ ] = get32( view, list + item * 4 );
+                        }
+                    }
+                }
+            }
+            break;
+        }
+    }
+
+    if ( jpegOffset != 0 && jpegLength != 0 )
+    {
+        addCandidate( parser, view, jpegOffset, jpegLength );
+    }
+
+    if ( ( compression == 6 || compression == 7 ) && stripOffset != 0 && stripLength != 0 )
+    {
+        addCandidate( parser, view, stripOffset, stripLength );
+    }
+
+    if ( depth < MAXIMUM_SUBIFD_DEPTH )
+    {
+        for ( unsigned int index = 0; index < subIFDCount; index ++ )
+        {
+            ( void ) parseIFD( parser, view, subIFDs[ index ], depth + 1 );
+        }
+    }
+
+    if ( ! readAt( parser, view->base + offset + 2 + count * 12, nextBytes, 4 ) ) return 0;
+
+    return get32( view, nextBytes );
+}
+
+/******************************************************************************\
+ * parseTIFF()
+ *
+ * Look for previews throughout a TIFF structure's main IFD chain (IFD0 holds
+ * the main image or a preview, IFD1 the EXIF thumbnail, and RAW formats often
+ * add more).
+ *
+ * In:  Parser;
+ *
+ *      File offset of the TIFF header and number of bytes available there.
+\******************************************************************************/
+
+static void parseTIFF( Parser * parser, uint64_t base, uint64_t limit )
+{
+    TIFFView view;
+    uint32_t offset;
+
+    if ( ! openView( parser, base, limit, &view, &offset ) ) return;
+
+    while ( offset != 0 )
+    {
+        offset = parseIFD( parser, &view, offset, 0 );
+    }
+}
+
+/******************************************************************************\
+ * parseMPF()
+ *
+ * Look for preview images listed in a Multi-Picture Format index, which many
+ * cameras use to append a large preview after the primary image in a JPEG.
+ *
+ * In:  Parser;
+ *
+ *      File offset of the MP header (which is TIFF-structured) and number of
+ *      bytes available from there; image offsets are relative to it.
+\******************************************************************************/
+
+static void parseMPF( Parser * parser, uint64_t base, uint64_t limit )
+{
+    TIFFView      view;
+    uint32_t      offset;
+    unsigned char countBytes[ 2 ];
+    unsigned char entry[ 12 ];
+
+    if ( ! openView( parser, base, limit, &view, &offset ) ) return;
+    if ( ( uint64_t ) offset + 2 > limit || ! readAt( parser, base + offset, countBytes, 2 ) ) return;
+
+    unsigned int count = get16( &view, countBytes );
+    if ( count > MAXIMUM_IFD_ENTRIES ) count = MAXIMUM_IFD_ENTRIES;
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        if ( ! readAt( parser, base + offset + 2 + index * 12, entry, sizeof( entry ) ) ) return;
+        if ( get16( &view, entry ) != TAG_MP_ENTRY ) continue;
+
+        /* 16 bytes per image: attributes, size, offset, two dependencies */
+
+        uint32_t      images      = get32( &view, entry + 4 ) / 16;
+        uint32_t      entryOffset = get32( &view, entry + 8 );
+        unsigned char image[ 16 ];
+
+        if ( images > EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES ) images = EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES;
+
+        for ( uint32_t item = 0; item < images; item ++ )
+        {
+            if ( ( uint64_t ) entryOffset + ( item + 1 ) * 16 > limit ) break;
+            if ( ! readAt( parser, base + entryOffset + item * 16, image, sizeof( image ) ) ) break;
+
+            uint32_t size        = get32( &view, image + 4 );
+            uint32_t imageOffset = get32( &view, image + 8 );
+
+            /* An offset of zero denotes the primary image */
+
+            if ( imageOffset != 0 ) addCandidate( parser, &view, imageOffset, size );
+        }
+
+        return;
+    }
+}
+
+/******************************************************************************\
+ * parseJPEG()
+ *
+ * Walk the markers of a JPEG file up to its first scan, looking for an EXIF
+ * segment (APP1) and a Multi-Picture Format segment (APP2).
+\******************************************************************************/
+
+static void parseJPEG( Parser * parser )
+{
+    unsigned char bytes[ 10 ];
+    uint64_t      position = 2;
+
+    for ( unsigned int markers = 0; markers < MAXIMUM_MARKERS; markers ++ )
+    {
+        if ( ! readAt( parser, position, bytes, 4 ) || bytes[ 0 ] != 0xFF ) return;
+
+        unsigned char marker = bytes[ 1 ];
+        uint32_t      length = ( ( uint32_t ) bytes[ 2 ] << 8 ) | bytes[ 3 ];
+
+        if ( marker == 0xFF ) { position ++; continue; } /* Fill byte */
+        if ( marker == 0xDA || marker == 0xD9 || length < 2 ) return;
+
+        uint64_t data      = position + 4;
+        uint64_t available = length - 2;
+
+        if ( marker == 0xE1 && available > 6 &&
+             readAt( parser, data, bytes, 6 ) && memcmp( bytes, "Exif\0\0", 6 ) == 0 )
+        {
+            parseTIFF( parser, data + 6, available - 6 );
+        }
+        else if ( marker == 0xE2 && available > 4 &&
+                  readAt( parser, data, bytes, 4 ) && memcmp( bytes, "MPF\0", 4 ) == 0 &&
+                  data + 4 < parser->fileSize )
+        {
+            /* MPF images follow the primary image, outside this segment */
+
+            parseMPF( parser, data + 4, parser->fileSize - ( data + 4 ) );
+        }
+
+        position = data + available;
+    }
+}
+
+/******************************************************************************\
+ * boxContent()
+ *
+ * Set a preview's content area to the centred region of the main image's
+ * shape, on the assumption that bars fill the rest. The region is rounded
+ * down (allowing for floating point error in exact ratios), and by one more pixel if need be to split the bars evenly, so that
+ * no part of a bar is included whichever way the writer rounded.
+ *
+ * In:  Preview to update;
+ *
+ *      Aspect ratio of the main image (width over height).
+ *
+ * Out: true if the bars are small enough to be believable, else false, in
+ *      which case the preview is left alone.
+\******************************************************************************/
+
+static bool boxContent( EmbeddedPreview * preview, double sourceAspect )
+{
+    uint32_t width  = preview->width;
+    uint32_t height = preview->height;
+
+    if ( ( double ) width / height > sourceAspect )
+    {
+        width = ( uint32_t ) floor( height * sourceAspect + 1e-9 );
+        if ( ( preview->width - width ) & 1 ) width --;
+    }
+    else
+    {
+        height = ( uint32_t ) floor( width / sourceAspect + 1e-9 );
+        if ( ( preview->height - height ) & 1 ) height --;
+    }
+
+    if ( width  == 0 || width  < preview->width  * ( 1 - EMBEDDED_PREVIEW_MAXIMUM_BARS ) ||
+         height == 0 || height < preview->height * ( 1 - EMBEDDED_PREVIEW_MAXIMUM_BARS ) )
+    {
+        return false;
+    }
+
+    preview->contentX      = ( preview->width  - width  ) / 2;
+    preview->contentY      = ( preview->height - height ) / 2;
+    preview->contentWidth  = width;
+    preview->contentHeight = height;
+
+    return true;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************\
+ * Utilities: EmbeddedPreview.h
+ *
+ * Find reduced-size JPEG previews embedded in image files, by parsing container
+ * headers only - the main image is never decoded. Many files carry such
+ * previews: the EXIF thumbnail and Multi-Picture Format (MPF) preview images
+ * in a camera JPEG, or the preview JPEGs held in IFD chains and sub-IFDs of
+ * TIFF-based camera RAW files (CR2, NEF, ARW, DNG, ORF, PEF, RW2 and others).
+ * When one is big enough for the thumbnail being drawn, decoding it instead
+ * of the main image saves almost all of the work.
+ *
+ * Each candidate's dimensions are read from its own JPEG frame header rather
+ * than trusted from container tags. Only baseline, extended and progressive
+ * JPEG previews are reported, since those are what general purpose decoders
+ * handle (DNG's lossless JPEG main images, for example, are not).
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef EMBEDDED_PREVIEW_H
+#define EMBEDDED_PREVIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Most candidate previews collected from any one file */
+
+#define EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES 16
+
+/* Largest difference in aspect ratio from the main image, as a fraction, for
+ * a preview to be taken as the whole picture; this allows for the odd row or
+ * column of rounding. A preview of a different shape is assumed to hold the
+ * picture between black bars, as DCF requires of e.g. the 160x120 EXIF
+ * thumbnail of a 3:2 original, and only the picture area within is used.
+ */
+
+#define EMBEDDED_PREVIEW_ASPECT_TOLERANCE 0.02
+
+/* Largest fraction of a preview's width or height which letterbox or
+ * pillarbox bars may take up; anything more shaped is not a boxed copy of
+ * the main image.
+ */
+
+#define EMBEDDED_PREVIEW_MAXIMUM_BARS 0.5
+
+typedef struct EmbeddedPreview
+{
+    uint64_t offset; /* Of the preview's JPEG data within the file */
+    uint64_t length;
+    uint32_t width;
+    uint32_t height;
+
+    /* Area of the preview holding the picture, less any bars around it */
+
+    uint32_t contentX;
+    uint32_t contentY;
+    uint32_t contentWidth;
+    uint32_t contentHeight;
+
+} EmbeddedPreview;
+
+/******************************************************************************\
+ * embeddedPreviewList()
+ *
+ * List the usable JPEG previews embedded in a file.
+ *
+ * In:  Full path of the file;
+ *
+ *      Array to fill in, EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES entries long.
+ *
+ * Out: Number of previews found; 0 if none, or if the file can't be read or
+ *      isn't a JPEG or TIFF-based file. Each preview's content area is the
+ *      whole of it, since the main image's shape isn't known here.
+\******************************************************************************/
+
+unsigned int embeddedPreviewList( const char      * path,
+                                  EmbeddedPreview * previews );
+
+/******************************************************************************\
+ * embeddedPreviewFind()
+ *
+ * Find the smallest embedded preview whose picture still covers a target area
+ * (see "ReducedDecode.h" for what "covers" means). A preview of a different
+ * aspect ratio from the main image is taken to be letterboxed or pillarboxed
+ * and its content area is set to the centred region of the main image's
+ * shape; the caller must draw only that region.
+ *
+ * In:  Full path of the file;
+ *
+ *      Width and height of the main image in pixels, unrotated;
+ *
+ *      Width and height of the target area in device pixels;
+ *
+ *      true if a square crop will be drawn over the target, false if the
+ *      whole image will be fitted within it;
+ *
+ *      Pointer to a preview updated on success.
+ *
+ * Out: true if a suitable preview was found, else false, in which case the
+ *      main image should be decoded as usual.
+\******************************************************************************/
+
+bool embeddedPreviewFind( const char      * path,
+                          uint32_t          sourceWidth,
+                          uint32_t          sourceHeight,
+                          double            targetWidth,
+                          double            targetHeight,
+                          bool              crop,
+                          EmbeddedPreview * preview );
+
+#endif /* EMBEDDED_PREVIEW_H */
@@ -0,0 +1,1248 @@
+/******************************************************************************\
+ * Utilities: FolderScanner.c
+ *
+ * Parallel, breadth-first folder scanning engine. See "FolderScanner.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "FolderScanner.h"
+#include "ScanIndex.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #include <sys/attr.h>
+    #include <sys/vnode.h>
+#endif
+
+/* Internal state for one root while a scan is running */
+
+typedef struct ScanRootState
+{
+    FolderScannerRoot * root;
+    pthread_mutex_t     lock;        /* Serialises 'foundFile' and the counters */
+    uint64_t            deadline;    /* Monotonic nanoseconds, 0 = none         */
+    volatile int        stopped;     /* Set once, never cleared                 */
+    size_t              batchSize;
+    unsigned int        threadLimit; /* 0 = none                                */
+    unsigned int        inFlight;    /* Protected by the scan's lock            */
+    bool                profiled;    /* Has root->volume been filled in?        */
+
+} ScanRootState;
+
+/* A directory waiting to be read; queued in FIFO order */
+
+typedef struct ScanItem
+{
+    struct ScanItem * next;
+    size_t            rootIndex;
+    char              path[]; /* Full path, NUL terminated */
+
+} ScanItem;
+
+/* One pass over a directory's entries, whether read through the backend or
+ * taken from the index.
+ */
+
+typedef struct DirectoryPass
+{
+    ScanItem        * item;
+    void            * handle;   /* Backend handle; NULL if replaying the index */
+    ScanIndexRecord * record;   /* Entries to store in the index, or NULL      */
+    char            * path;     /* Reusable buffer for full entry paths        */
+    size_t            pathSize;
+    size_t            pathBase; /* Length of the directory's own path          */
+
+} DirectoryPass;
+
+/* State shared by all threads in one call to folderScannerRun() */
+
+typedef struct ScanState
+{
+    pthread_mutex_t                lock;
+    pthread_cond_t                 changed;
+    ScanItem                     * head;
+    ScanItem                     * tail;
+    unsigned int                   inFlight;
+
+    ScanRootState                * roots;
+    const FolderScannerOptions   * options;
+    const FolderScannerCallbacks * callbacks;
+    const FolderScannerBackend   * backend;
+
+} ScanState;
+
+/* Local functions */
+
+static uint64_t   monotonicNanoseconds ( void );
+static ScanItem * allocScanItem        ( size_t rootIndex, const char * parent, const char * leaf );
+static void       stopRoot             ( ScanRootState * state, FolderScannerStatus status );
+static bool       rootIsFinished       ( ScanRootState * state );
+static ScanItem * takeScanItem         ( ScanState * scan );
+static void       processEntries       ( ScanState * scan, DirectoryPass * pass, FolderScannerEntry * entries, size_t count );
+static void       readOneDirectory     ( ScanState * scan, ScanItem * item );
+static void     * scanWorker           ( void * arg );
+
+/******************************************************************************\
+ * POSIX backend
+\******************************************************************************/
+
+typedef struct POSIXDirectory
+{
+    DIR    * dir;
+    char   * names;     /* Arena of leafnames for the current batch */
+    size_t   namesSize;
+
+} POSIXDirectory;
+
+static void * posixOpenDirectory( const char * path, void * context )
+{
+    ( void ) context;
+
+    DIR * dir = opendir( path );
+    if ( dir == NULL ) return NULL;
+
+    POSIXDirectory * handle = calloc( 1, sizeof( POSIXDirectory ) );
+
+    if ( handle == NULL )
+    {
+        closedir( dir );
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    handle->dir = dir;
+    return handle;
+}
+
+static long posixReadBatch( void * opaque, FolderScannerEntry * entries, size_t maximum )
+{
+    POSIXDirectory * handle = opaque;
+    size_t           count  = 0;
+    size_t           used   = 0;
+
+    /* Names are copied into a per-handle arena, since readdir() is free to
+     * reuse its buffer on every call. Offsets are recorded first and turned
+     * into pointers at the end, in case the arena moves when it grows.
+     */
+
+    while ( count < maximum )
+    {
+        errno = 0;
+
+        struct dirent * dirent = readdir( handle->dir );
+
+        if ( dirent == NULL )
+        {
+            if ( errno != 0 && count == 0 ) return -1;
+            break;
+        }
+
+        const char * name = dirent->d_name;
+
+        if ( name[ 0 ] == '.' && ( name[ 1 ] == '\0' || ( name[ 1 ] == '.' && name[ 2 ] == '\0' ) ) )
+        {
+            continue;
+        }
+
+        size_t length = strlen( name ) + 1;
+
+        if ( used + length > handle->namesSize )
+        {
+            size_t newSize  = handle->namesSize ? handle->namesSize * 2 : 4096;
+            while ( newSize < used + length ) newSize *= 2;
+
+            char * newNames = realloc( handle->names, newSize );
+            if ( newNames == NULL ) return -1;
+
+            handle->names     = newNames;
+            handle->namesSize = newSize;
+        }
+
+        memcpy( handle->names + used, name, length );
+
+        FolderScannerEntry * entry = &entries[ count ++ ];
+
+        entry->name = ( const char * ) ( uintptr_t ) used;
+        entry->size = FOLDER_SCANNER_SIZE_UNKNOWN;
+
+        unsigned char type = DT_UNKNOWN;
+
+        #ifdef _DIRENT_HAVE_D_TYPE
+            type = dirent->d_type;
+        #elif defined( DT_UNKNOWN )
+            type = dirent->d_type;
+        #endif
+
+        if ( type == DT_UNKNOWN )
+        {
+            struct stat info;
+
+            if ( fstatat( dirfd( handle->dir ), name, &info, AT_SYMLINK_NOFOLLOW ) == 0 )
+            {
+                if      ( S_ISREG( info.st_mode ) ) type = DT_REG;
+                else if ( S_ISDIR( info.st_mode ) ) type = DT_DIR;
+
+                entry->size = ( uint64_t ) info.st_size;
+            }
+        }
+
+        switch ( type )
+        {
+            case DT_REG: entry->type = folderScannerEntryTypeFile;      break;
+            case DT_DIR: entry->type = folderScannerEntryTypeDirectory; break;
+            default:     entry->type = folderScannerEntryTypeOther;     break;
+        }
+
+        used += length;
+    }
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        entries[ index ].name = handle->names + ( uintptr_t ) entries[ index ].name;
+    }
+
+    return ( long ) count;
+}
+
+static uint64_t posixSizeOfEntry( void * opaque, const FolderScannerEntry * entry )
+{
+    POSIXDirectory * handle = opaque;
+    struct stat      info;
+
+    if ( fstatat( dirfd( handle->dir ), entry->name, &info, AT_SYMLINK_NOFOLLOW ) != 0 )
+    {
+        return FOLDER_SCANNER_SIZE_UNKNOWN;
+    }
+
+    return ( uint64_t ) info.st_size;
+}
+
+static void posixCloseDirectory( void * opaque )
+{
+    POSIXDirectory * handle = opaque;
+
+    closedir( handle->dir );
+    free( handle->names );
+    free( handle );
+}
+
+static const FolderScannerBackend posixBackend =
+{
+    .name           = "posix",
+    .openDirectory  = posixOpenDirectory,
+    .readBatch      = posixReadBatch,
+    .sizeOfEntry    = posixSizeOfEntry,
+    .closeDirectory = posixCloseDirectory,
+    .context        = NULL
+};
+
+const FolderScannerBackend * folderScannerPOSIXBackend( void )
+{
+    return &posixBackend;
+}
+
+/******************************************************************************\
+ * getattrlistbulk() backend (macOS only)
+\******************************************************************************/
+
+#ifdef __APPLE__
+
+/* The buffer holds at least BULK_BUFFER_SIZE bytes, or more for batch sizes
+ * large enough to need it at around BULK_BYTES_PER_ENTRY each, so that large
+ * batches on a network volume do take fewer round trips to the server.
+ */
+
+#define BULK_BUFFER_SIZE     65536
+#define BULK_BYTES_PER_ENTRY 128
+
+typedef struct BulkDirectory
+{
+    int      fd;
+    char   * cursor;     /* Next unread record in 'buffer'   */
+    int      remaining;  /* Records left in 'buffer'         */
+    char   * buffer;     /* Allocated on first read          */
+    size_t   bufferSize;
+
+} BulkDirectory;
+
+static void * bulkOpenDirectory( const char * path, void * context )
+{
+    ( void ) context;
+
+    int fd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( fd < 0 ) return NULL;
+
+    BulkDirectory * handle = calloc( 1, sizeof( BulkDirectory ) );
+
+    if ( handle == NULL )
+    {
+        close( fd );
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    handle->fd = fd;
+
+    return handle;
+}
+
+static long bulkReadBatch( void * opaque, FolderScannerEntry * entries, size_t maximum )
+{
+    BulkDirectory * handle = opaque;
+    size_t          count  = 0;
+
+    if ( handle->buffer == NULL )
+    {
+        size_t size = maximum * BULK_BYTES_PER_ENTRY;
+
+        if ( size < BULK_BUFFER_SIZE ) size = BULK_BUFFER_SIZE;
+
+        handle->buffer = malloc( size );
+
+        if ( handle->buffer == NULL )
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        handle->bufferSize = size;
+    }
+
+    if ( handle->remaining == 0 )
+    {
+        struct attrlist request;
+
+        memset( &request, 0, sizeof( request ) );
+
+        request.bitmapcount = ATTR_BIT_MAP_COUNT;
+        request.commonattr  = ATTR_CMN_RETURNED_ATTRS |
+                              ATTR_CMN_NAME           |
+                              ATTR_CMN_ERROR          |
+                              ATTR_CMN_OBJTYPE;
+        request.fileattr    = ATTR_FILE_DATALENGTH;
+
+        int found = getattrlistbulk( handle->fd, &request, handle->buffer, handle->bufferSize, 0 );
+
+        if ( found <  0 ) return -1;
+        if ( found == 0 ) return  0;
+
+        handle->cursor    = handle->buffer;
+        handle->remaining = found;
+    }
+
+    /* Record layout is described in "man getattrlistbulk"; the error field,
+     * when present, always comes straight after the returned attribute set.
+     */
+
+    while ( handle->remaining > 0 && count < maximum )
+    {
+        char            * record = handle->cursor;
+        char            * field  = record + sizeof( uint32_t );
+        uint32_t          length;
+        uint32_t          error  = 0;
+        attribute_set_t   returned;
+        fsobj_type_t      type   = VNON;
+        const char      * name   = NULL;
+        uint64_t          size   = FOLDER_SCANNER_SIZE_UNKNOWN;
+
+        memcpy( &length,   record, sizeof( length   ) );
+        memcpy( &returned, field,  sizeof( returned ) );
+        field += sizeof( attribute_set_t );
+
+        if ( returned.commonattr & ATTR_CMN_ERROR )
+        {
+            memcpy( &error, field, sizeof( error ) );
+            field += sizeof( uint32_t );
+        }
+
+        if ( returned.commonattr & ATTR_CMN_NAME )
+        {
+            attrreference_t reference;
+
+            memcpy( &reference, field, sizeof( reference ) );
+            name   = field + reference.attr_dataoffset;
+            field += sizeof( attrreference_t );
+        }
+
+        if ( returned.commonattr & ATTR_CMN_OBJTYPE )
+        {
+            memcpy( &type, field, sizeof( type ) );
+            field += sizeof( fsobj_type_t );
+        }
+
+        if ( returned.fileattr & ATTR_FILE_DATALENGTH )
+        {
+            off_t dataLength;
+
+            memcpy( &dataLength, field, sizeof( dataLength ) );
+            size   = ( uint64_t ) dataLength;
+            field += sizeof( off_t );
+        }
+
+        handle->cursor += length;
+        handle->remaining --;
+
+        if ( error != 0 || name == NULL ) continue;
+
+        FolderScannerEntry * entry = &entries[ count ++ ];
+
+        entry->name = name;
+        entry->size = size;
+
+        switch ( type )
+        {
+            case VREG: entry->type = folderScannerEntryTypeFile;      break;
+            case VDIR: entry->type = folderScannerEntryTypeDirectory; break;
+            default:   entry->type = folderScannerEntryTypeOther;     break;
+        }
+    }
+
+    /* If every record in this buffer was an error, go around for more rather
+     * than returning zero, which the caller would take as end-of-directory.
+     */
+
+    if ( count == 0 ) return bulkReadBatch( opaque, entries, maximum );
+
+    return ( long ) count;
+}
+
+static uint64_t bulkSizeOfEntry( void * opaque, const FolderScannerEntry * entry )
+{
+    BulkDirectory * handle = opaque;
+    struct stat     info;
+
+    if ( fstatat( handle->fd, entry->name, &info, AT_SYMLINK_NOFOLLOW ) != 0 )
+    {
+        return FOLDER_SCANNER_SIZE_UNKNOWN;
+    }
+
+    return ( uint64_t ) info.st_size;
+}
+
+static void bulkCloseDirectory( void * opaque )
+{
+    BulkDirectory * handle = opaque;
+
+    close( handle->fd );
+    free( handle->buffer );
+    free( handle );
+}
+
+static const FolderScannerBackend bulkBackend =
+{
+    .name           = "getattrlistbulk",
+    .openDirectory  = bulkOpenDirectory,
+    .readBatch      = bulkReadBatch,
+    .sizeOfEntry    = bulkSizeOfEntry,
+    .closeDirectory = bulkCloseDirectory,
+    .context        = NULL
+};
+
+#endif /* __APPLE__ */
+
+const FolderScannerBackend * folderScannerDefaultBackend( void )
+{
+    #ifdef __APPLE__
+        return &bulkBackend;
+    #else
+        return &posixBackend;
+    #endif
+}
+
+/******************************************************************************\
+ * Simulated high latency backend
+\******************************************************************************/
+
+typedef struct SlowDirectory
+{
+    FolderScannerSlowBackend * slow;
+    void                     * handle; /* The wrapped backend's */
+
+} SlowDirectory;
+
+/* Wait for a request's turn, if there's a limit, then for its delay */
+
+static void slowRequest( FolderScannerSlowBackend * slow, uint32_t microseconds )
+{
+    if ( microseconds == 0 ) return;
+
+    pthread_mutex_lock( &slow->lock );
+
+    while ( slow->concurrentRequests != 0 && slow->activeRequests >= slow->concurrentRequests )
+    {
+        pthread_cond_wait( &slow->changed, &slow->lock );
+    }
+
+    slow->activeRequests ++;
+    pthread_mutex_unlock( &slow->lock );
+
+    struct timespec delay =
+    {
+        .tv_sec  = microseconds / 1000000,
+        .tv_nsec = ( long ) ( microseconds % 1000000 ) * 1000
+    };
+
+    while ( nanosleep( &delay, &delay ) != 0 && errno == EINTR );
+
+    pthread_mutex_lock( &slow->lock );
+
+    slow->activeRequests --;
+
+    pthread_cond_signal( &slow->changed );
+    pthread_mutex_unlock( &slow->lock );
+}
+
+static void * slowOpenDirectory( const char * path, void * context )
+{
+    FolderScannerSlowBackend * slow = context;
+
+    slowRequest( slow, slow->openMicroseconds );
+
+    void * inner = slow->wrapped->openDirectory( path, slow->wrapped->context );
+    if ( inner == NULL ) return NULL;
+
+    SlowDirectory * handle = malloc( sizeof( SlowDirectory ) );
+
+    if ( handle == NULL )
+    {
+        slow->wrapped->closeDirectory( inner );
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    handle->slow   = slow;
+    handle->handle = inner;
+
+    return handle;
+}
+
+static long slowReadBatch( void * opaque, FolderScannerEntry * entries, size_t maximum )
+{
+    SlowDirectory * handle = opaque;
+
+    slowRequest( handle->slow, handle->slow->batchMicroseconds );
+
+    return handle->slow->wrapped->readBatch( handle->handle, entries, maximum );
+}
+
+static uint64_t slowSizeOfEntry( void * opaque, const FolderScannerEntry * entry )
+{
+    SlowDirectory              * handle  = opaque;
+    const FolderScannerBackend * wrapped = handle->slow->wrapped;
+
+    if ( wrapped->sizeOfEntry == NULL ) return FOLDER_SCANNER_SIZE_UNKNOWN;
+
+    slowRequest( handle->slow, handle->slow->batchMicroseconds );
+
+    return wrapped->sizeOfEntry( handle->handle, entry );
+}
+
+static void slowCloseDirectory( void * opaque )
+{
+    SlowDirectory * handle = opaque;
+
+    handle->slow->wrapped->closeDirectory( handle->handle );
+    free( handle );
+}
+
+/******************************************************************************\
+ * folderScannerSlowBackendInit()
+ *
+ * Set up a backend which adds simulated latency to another. See
+ * "FolderScanner.h" for details.
+\******************************************************************************/
+
+int folderScannerSlowBackendInit( FolderScannerSlowBackend   * slow,
+                                  const FolderScannerBackend * wrapped,
+                                  uint32_t                     openMicroseconds,
+                                  uint32_t                     batchMicroseconds,
+                                  unsigned int                 concurrentRequests )
+{
+    memset( slow, 0, sizeof( FolderScannerSlowBackend ) );
+
+    int result = pthread_mutex_init( &slow->lock, NULL );
+    if ( result != 0 ) return result;
+
+    result = pthread_cond_init( &slow->changed, NULL );
+
+    if ( result != 0 )
+    {
+        pthread_mutex_destroy( &slow->lock );
+        return result;
+    }
+
+    slow->wrapped            = wrapped ? wrapped : folderScannerDefaultBackend();
+    slow->openMicroseconds   = openMicroseconds;
+    slow->batchMicroseconds  = batchMicroseconds;
+    slow->concurrentRequests = concurrentRequests;
+
+    slow->backend.name           = "slow";
+    slow->backend.openDirectory  = slowOpenDirectory;
+    slow->backend.readBatch      = slowReadBatch;
+    slow->backend.sizeOfEntry    = slowSizeOfEntry;
+    slow->backend.closeDirectory = slowCloseDirectory;
+    slow->backend.context        = slow;
+
+    return 0;
+}
+
+/******************************************************************************\
+ * folderScannerSlowBackendDestroy()
+ *
+ * Release a backend set up by folderScannerSlowBackendInit(). See
+ * "FolderScanner.h".
+\******************************************************************************/
+
+void folderScannerSlowBackendDestroy( FolderScannerSlowBackend * slow )
+{
+    pthread_cond_destroy ( &slow->changed );
+    pthread_mutex_destroy( &slow->lock    );
+}
+
+/******************************************************************************\
+ * folderScannerChooseStrategy()
+ *
+ * Choose how to read a root on a volume with the given profile. See
+ * "FolderScanner.h" for details.
+\******************************************************************************/
+
+void folderScannerChooseStrategy( const VolumeProfile   * volume,
+                                  unsigned int            threadCount,
+                                  size_t                  batchSize,
+                                  FolderScannerStrategy * strategy )
+{
+    unsigned int threads = threadCount;
+
+    if ( batchSize == 0 ) batchSize = FOLDER_SCANNER_DEFAULT_BATCH_SIZE;
+
+    if ( volume->kind == volumeKindNetwork || volume->latency == volumeLatencyHigh )
+    {
+        threads   = FOLDER_SCANNER_HIGH_LATENCY_THREADS;
+        batchSize = FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE;
+    }
+    else if ( volume->latency == volumeLatencyMedium )
+    {
+        threads   = FOLDER_SCANNER_MEDIUM_LATENCY_THREADS;
+        batchSize = FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE;
+    }
+
+    if ( threadCount != 0 && threads > threadCount ) threads = threadCount;
+
+    strategy->threadCount = threads;
+    strategy->batchSize   = batchSize;
+}
+
+/******************************************************************************\
+ * folderScannerRun()
+ *
+ * Walk all of the given roots, breadth first, calling back as files are found.
+ * See "FolderScanner.h" for details.
+\******************************************************************************/
+
+int folderScannerRun( FolderScannerRoot            * roots,
+                      size_t                         rootCount,
+                      const FolderScannerOptions   * options,
+                      const FolderScannerCallbacks * callbacks )
+{
+    static const FolderScannerOptions   defaultOptions   = { 0 };
+    static const FolderScannerCallbacks defaultCallbacks = { 0 };
+
+    if ( rootCount == 0 ) return 0;
+    if ( options   == NULL ) options   = &defaultOptions;
+    if ( callbacks == NULL ) callbacks = &defaultCallbacks;
+
+    ScanState scan;
+
+    memset( &scan, 0, sizeof( scan ) );
+
+    scan.options   = options;
+    scan.callbacks = callbacks;
+    scan.backend   = options->backend ? options->backend : folderScannerDefaultBackend();
+    scan.roots     = calloc( rootCount, sizeof( ScanRootState ) );
+
+    if ( scan.roots == NULL ) return ENOMEM;
+
+    unsigned int threadCount = options->threadCount;
+
+    if ( threadCount == 0 )
+    {
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+        threadCount = ( unsigned int ) rootCount;
+        if ( cpus > 0 && threadCount > ( unsigned int ) cpus ) threadCount = ( unsigned int ) cpus;
+    }
+
+    pthread_mutex_init( &scan.lock,    NULL );
+    pthread_cond_init ( &scan.changed, NULL );
+
+    /* Queue up the roots themselves. Each root's clock starts now, not when a
+     * thread first gets around to it, so queueing delays count against it, as
+     * does profiling its volume.
+     */
+
+    uint64_t     now           = monotonicNanoseconds();
+    unsigned int threadsUsable = 0;
+
+    for ( size_t index = 0; index < rootCount; index ++ )
+    {
+        FolderScannerRoot * root  = &roots[ index ];
+        ScanRootState     * state = &scan.roots[ index ];
+
+        root->status               = folderScannerStatusComplete;
+        root->error                = 0;
+        root->directoriesRead      = 0;
+        root->directoriesFromIndex = 0;
+        root->entriesSeen          = 0;
+        root->filesFound           = 0;
+
+        memset( &root->volume, 0, sizeof( root->volume ) );
+
+        root->strategy.threadCount = 0;
+        root->strategy.batchSize   = options->batchSize ? options->batchSize : FOLDER_SCANNER_DEFAULT_BATCH_SIZE;
+
+        /* An unprofiled volume gets the caller's strategy, which is as good a
+         * guess as any; if the root can't be read, the scan will say so.
+         */
+
+        if ( options->adaptToVolume )
+        {
+            state->profiled = volumeProfileForPath( root->path, scan.backend, &root->volume );
+
+            folderScannerChooseStrategy( &root->volume, threadCount, options->batchSize, &root->strategy );
+            threadsUsable += root->strategy.threadCount;
+        }
+
+        state->root        = root;
+        state->deadline    = root->timeLimitMs ? now + ( uint64_t ) root->timeLimitMs * 1000000ULL : 0;
+        state->batchSize   = root->strategy.batchSize;
+        state->threadLimit = root->strategy.threadCount;
+
+        pthread_mutex_init( &state->lock, NULL );
+
+        ScanItem * item = allocScanItem( index, root->path, NULL );
+
+        if ( item == NULL )
+        {
+            root->status   = folderScannerStatusError;
+            root->error    = ENOMEM;
+            state->stopped = 1;
+            continue;
+        }
+
+        if ( scan.tail ) scan.tail->next = item;
+        else             scan.head       = item;
+
+        scan.tail = item;
+    }
+
+    /* Start helper threads; the calling thread is always one of the workers.
+     * There's no point starting more than the roots' strategies could use.
+     */
+
+    if ( options->adaptToVolume && threadsUsable < threadCount ) threadCount = threadsUsable;
+
+    pthread_t    * helpers     = NULL;
+    unsigned int   helperCount = 0;
+
+    if ( threadCount > 1 )
+    {
+        helpers = calloc( threadCount - 1, sizeof( pthread_t ) );
+
+        if ( helpers != NULL )
+        {
+            for ( unsigned int index = 0; index < threadCount - 1; index ++ )
+            {
+                if ( pthread_create( &helpers[ helperCount ], NULL, scanWorker, &scan ) == 0 )
+                {
+                    helperCount ++;
+                }
+            }
+        }
+    }
+
+    scanWorker( &scan );
+
+    for ( unsigned int index = 0; index < helperCount; index ++ )
+    {
+        pthread_join( helpers[ index ], NULL );
+    }
+
+    free( helpers );
+
+    uint64_t taken = ( monotonicNanoseconds() - now ) / 1000;
+
+    for ( size_t index = 0; index < rootCount; index ++ )
+    {
+        FolderScannerRoot * root = &roots[ index ];
+
+        if ( scan.roots[ index ].profiled )
+        {
+            volumeProfileRecordScan
+            (
+                root->volume.device,
+                root->directoriesRead - root->directoriesFromIndex,
+                root->entriesSeen,
+                taken
+            );
+        }
+
+        pthread_mutex_destroy( &scan.roots[ index ].lock );
+    }
+
+    pthread_cond_destroy ( &scan.changed );
+    pthread_mutex_destroy( &scan.lock    );
+    free( scan.roots );
+
+    return 0;
+}
+
+/******************************************************************************\
+ * monotonicNanoseconds()
+ *
+ * Internal - return a monotonic wall-clock time in nanoseconds. Unlike clock(),
+ * this keeps advancing while a thread is blocked on a slow filesystem.
+\******************************************************************************/
+
+static uint64_t monotonicNanoseconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t ) now.tv_sec * 1000000000ULL + ( uint64_t ) now.tv_nsec;
+}
+
+/******************************************************************************\
+ * allocScanItem()
+ *
+ * Internal - allocate a queue item for the directory made by joining the given
+ * parent path and leafname, or for just the parent if the leafname is NULL.
+ * Returns NULL if out of memory.
+\******************************************************************************/
+
+static ScanItem * allocScanItem( size_t rootIndex, const char * parent, const char * leaf )
+{
+    size_t parentLength = strlen( parent );
+    size_t leafLength   = leaf ? strlen( leaf ) : 0;
+
+    while ( leaf && parentLength > 1 && parent[ parentLength - 1 ] == '/' ) parentLength --;
+
+    ScanItem * item = malloc( sizeof( ScanItem ) + parentLength + leafLength + 2 );
+    if ( item == NULL ) return NULL;
+
+    item->next      = NULL;
+    item->rootIndex = rootIndex;
+
+    memcpy( item->path, parent, parentLength );
+
+    if ( leaf )
+    {
+        item->path[ parentLength ] = '/';
+        memcpy( item->path + parentLength + 1, leaf, leafLength + 1 );
+    }
+    else
+    {
+        item->path[ parentLength ] = '\0';
+    }
+
+    return item;
+}
+
+/******************************************************************************\
+ * stopRoot()
+ *
+ * Internal - mark a root as finished early with the given status. Only the
+ * first reason given is recorded.
+\******************************************************************************/
+
+static void stopRoot( ScanRootState * state, FolderScannerStatus status )
+{
+    pthread_mutex_lock( &state->lock );
+
+    if ( state->stopped == 0 )
+    {
+        state->root->status = status;
+        state->stopped      = 1;
+    }
+
+    pthread_mutex_unlock( &state->lock );
+}
+
+/******************************************************************************\
+ * rootIsFinished()
+ *
+ * Internal - has the given root been stopped, or has it run out of time (in
+ * which case it is stopped in passing)?
+\******************************************************************************/
+
+static bool rootIsFinished( ScanRootState * state )
+{
+    if ( state->stopped ) return true;
+
+    if ( state->deadline != 0 && monotonicNanoseconds() >= state->deadline )
+    {
+        stopRoot( state, folderScannerStatusTimeLimit );
+        return true;
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * processEntries()
+ *
+ * Internal - report files and queue subdirectories for one batch of entries
+ * from the directory being handled by the given pass, recording them in the
+ * pass's index record (if any) along the way.
+\******************************************************************************/
+
+static void processEntries( ScanState * scan, DirectoryPass * pass, FolderScannerEntry * entries, size_t count )
+{
+    ScanRootState                * state      = &scan->roots[ pass->item->rootIndex ];
+    FolderScannerRoot            * root       = state->root;
+    const FolderScannerCallbacks * callbacks  = scan->callbacks;
+    const FolderScannerBackend   * backend    = scan->backend;
+    uint64_t                       sizeLimit  = scan->options->maximumFileSize;
+    ScanItem                     * firstChild = NULL;
+    ScanItem                     * lastChild  = NULL;
+
+    for ( size_t index = 0; index < count && ! state->stopped; index ++ )
+    {
+        FolderScannerEntry * entry = &entries[ index ];
+
+        if ( scan->options->skipHidden && entry->name[ 0 ] == '.' ) continue;
+        if ( entry->type == folderScannerEntryTypeOther           ) continue;
+
+        /* Build the full path in a reusable buffer */
+
+        size_t leafLength = strlen( entry->name );
+
+        if ( pass->pathBase + leafLength + 2 > pass->pathSize )
+        {
+            size_t newSize = pass->pathBase + leafLength + 256;
+            char * newPath = realloc( pass->path, newSize );
+
+            if ( newPath == NULL )
+            {
+                if ( pass->record ) pass->record->failed = true;
+                continue;
+            }
+
+            pass->path     = newPath;
+            pass->pathSize = newSize;
+
+            memcpy( pass->path, pass->item->path, pass->pathBase );
+            pass->path[ pass->pathBase ] = '/';
+        }
+
+        char * path = pass->path;
+
+        memcpy( path + pass->pathBase + 1, entry->name, leafLength + 1 );
+
+        if ( entry->type == folderScannerEntryTypeDirectory )
+        {
+            if ( pass->record ) scanIndexRecordAdd( pass->record, entry );
+
+            if (
+                   callbacks->descendInto == NULL ||
+                   callbacks->descendInto( root->context, path, entry->name )
+               )
+            {
+                ScanItem * child = allocScanItem( pass->item->rootIndex, path, NULL );
+                if ( child == NULL ) continue;
+
+                if ( lastChild ) lastChild->next = child;
+                else             firstChild      = child;
+
+                lastChild = child;
+            }
+        }
+        else if (
+                    pass->handle          == NULL || /* Accepted when recorded */
+                    callbacks->acceptFile == NULL ||
+                    callbacks->acceptFile( root->context, path, entry->name )
+                )
+        {
+            uint64_t size = entry->size;
+
+            /* Recording a file reads its size along with its time */
+
+            if ( pass->record )
+            {
+                size = scanIndexRecordAddFile( pass->record, entry, path );
+            }
+            else if ( sizeLimit != 0 && size == FOLDER_SCANNER_SIZE_UNKNOWN )
+            {
+                if ( pass->handle != NULL )
+                {
+                    if ( backend->sizeOfEntry ) size = backend->sizeOfEntry( pass->handle, entry );
+                }
+                else
+                {
+                    struct stat info;
+                    if ( lstat( path, &info ) == 0 ) size = ( uint64_t ) info.st_size;
+                }
+            }
+
+            if ( sizeLimit != 0 && ( size == FOLDER_SCANNER_SIZE_UNKNOWN || size > sizeLimit ) ) continue;
+
+            pthread_mutex_lock( &state->lock );
+
+            if ( state->stopped == 0 )
+            {
+                root->filesFound ++;
+
+                if (
+                       callbacks->foundFile &&
+                       callbacks->foundFile( root->context, path, size ) == false
+                   )
+                {
+                    root->status   = folderScannerStatusStopped;
+                    state->stopped = 1;
+                }
+                else if ( root->foundLimit != 0 && root->filesFound >= root->foundLimit )
+                {
+                    root->status   = folderScannerStatusFoundLimit;
+                    state->stopped = 1;
+                }
+            }
+
+            pthread_mutex_unlock( &state->lock );
+        }
+    }
+
+    pthread_mutex_lock( &state->lock );
+    root->entriesSeen += count;
+    pthread_mutex_unlock( &state->lock );
+
+    /* Queue subdirectories found in this batch straight away, so that idle
+     * threads can start on them while this directory continues.
+     */
+
+    if ( firstChild )
+    {
+        pthread_mutex_lock( &scan->lock );
+
+        if ( scan->tail ) scan->tail->next = firstChild;
+        else              scan->head       = firstChild;
+
+        scan->tail = lastChild;
+
+        pthread_cond_broadcast( &scan->changed );
+        pthread_mutex_unlock( &scan->lock );
+    }
+}
+
+/******************************************************************************\
+ * readOneDirectory()
+ *
+ * Internal - read the directory described by the given queue item in batches,
+ * or take its entries from the index if it has not changed since last time.
+\******************************************************************************/
+
+static void readOneDirectory( ScanState * scan, ScanItem * item )
+{
+    ScanRootState              * state   = &scan->roots[ item->rootIndex ];
+    FolderScannerRoot          * root    = state->root;
+    const FolderScannerBackend * backend = scan->backend;
+    ScanIndex                  * index   = scan->options->index;
+    bool                         isRoot  = ( strcmp( item->path, root->path ) == 0 );
+    DirectoryPass                pass    = { .item = item };
+    ScanIndexRecord              record  = { 0 };
+    ScanIndexKey                 key;
+
+    pass.pathBase = strlen( item->path );
+    while ( pass.pathBase > 1 && item->path[ pass.pathBase - 1 ] == '/' ) pass.pathBase --;
+
+    /* Try the index first. The key is taken before any reading, so that if
+     * the directory changes while being read, the stored time is too old.
+     */
+
+    if ( index != NULL && scanIndexKeyForPath( item->path, &key ) )
+    {
+        size_t               count;
+        FolderScannerEntry * cached = scanIndexCopyEntries( index, &key, item->path, &count );
+
+        if ( cached != NULL )
+        {
+            pthread_mutex_lock( &state->lock );
+            root->directoriesRead ++;
+            root->directoriesFromIndex ++;
+            pthread_mutex_unlock( &state->lock );
+
+            processEntries( scan, &pass, cached, count );
+
+            free( pass.path );
+            free( cached    );
+            return;
+        }
+
+        pass.record = &record;
+    }
+
+    pass.handle = backend->openDirectory( item->path, backend->context );
+
+    if ( pass.handle == NULL )
+    {
+        /* Unreadable subdirectories are silently skipped, as they always
+         * were with NSDirectoryEnumerator; an unreadable root is an error.
+         */
+
+        if ( isRoot )
+        {
+            int error = errno != 0 ? errno : EIO;
+
+            /* Set both together, so that a root stopped for any other reason
+             * first never reports an error, nor an error root a zero errno.
+             */
+
+            pthread_mutex_lock( &state->lock );
+
+            if ( state->stopped == 0 )
+            {
+                root->status   = folderScannerStatusError;
+                root->error    = error;
+                state->stopped = 1;
+            }
+
+            pthread_mutex_unlock( &state->lock );
+        }
+
+        return;
+    }
+
+    FolderScannerEntry * entries = malloc( state->batchSize * sizeof( FolderScannerEntry ) );
+    long                 count   = -1;
+
+    if ( entries == NULL )
+    {
+        backend->closeDirectory( pass.handle );
+        return;
+    }
+
+    pthread_mutex_lock( &state->lock );
+    root->directoriesRead ++;
+    pthread_mutex_unlock( &state->lock );
+
+    while ( ! rootIsFinished( state ) )
+    {
+        count = backend->readBatch( pass.handle, entries, state->batchSize );
+        if ( count <= 0 ) break;
+
+        processEntries( scan, &pass, entries, ( size_t ) count );
+    }
+
+    /* Only a directory read right through to the end can go in the index */
+
+    if ( pass.record != NULL && count == 0 && state->stopped == 0 )
+    {
+        ( void ) scanIndexStore( index, &key, pass.record );
+    }
+
+    scanIndexRecordFree( &record );
+
+    free( pass.path );
+    free( entries   );
+    backend->closeDirectory( pass.handle );
+}
+
+/******************************************************************************\
+ * takeScanItem()
+ *
+ * Internal - with the scan's lock held, unlink and return the first queued
+ * directory whose root isn't already being read by as many threads as its
+ * strategy allows, or NULL if there isn't one. Finished roots never count as
+ * being at their limit, so that their directories are taken and dropped.
+\******************************************************************************/
+
+static ScanItem * takeScanItem( ScanState * scan )
+{
+    ScanItem * previous = NULL;
+    ScanItem * item     = scan->head;
+
+    while ( item != NULL )
+    {
+        ScanRootState * state = &scan->roots[ item->rootIndex ];
+
+        if ( state->threadLimit == 0 || state->inFlight < state->threadLimit || state->stopped ) break;
+
+        previous = item;
+        item     = item->next;
+    }
+
+    if ( item == NULL ) return NULL;
+
+    if ( previous ) previous->next = item->next;
+    else            scan->head     = item->next;
+
+    if ( scan->tail == item ) scan->tail = previous;
+
+    return item;
+}
+
+/******************************************************************************\
+ * scanWorker()
+ *
+ * Internal - thread body. Takes directories from the head of the shared queue
+ * until the queue is empty and no other thread could add anything more to it.
+\******************************************************************************/
+
+static void * scanWorker( void * arg )
+{
+    ScanState * scan = arg;
+
+    pthread_mutex_lock( &scan->lock );
+
+    for ( ;; )
+    {
+        ScanItem * item = takeScanItem( scan );
+
+        /* Nothing can be taken now; if nothing is in flight either, the queue
+         * is empty, since only a root with directories in flight can be
+         * holding queued ones back.
+         */
+
+        if ( item == NULL )
+        {
+            if ( scan->inFlight == 0 ) break;
+
+            pthread_cond_wait( &scan->changed, &scan->lock );
+            continue;
+        }
+
+        ScanRootState * state = &scan->roots[ item->rootIndex ];
+
+        if ( rootIsFinished( state ) )
+        {
+            free( item );
+            continue;
+        }
+
+        scan->inFlight ++;
+        state->inFlight ++;
+        pthread_mutex_unlock( &scan->lock );
+
+        readOneDirectory( scan, item );
+        free( item );
+
+        pthread_mutex_lock( &scan->lock );
+        scan->inFlight --;
+        state->inFlight --;
+
+        pthread_cond_broadcast( &scan->changed );
+    }
+
+    pthread_cond_broadcast( &scan->changed );
+    pthread_mutex_unlock( &scan->lock );
+
+    return NULL;
+}
@@ -0,0 +1,374 @@
+/******************************************************************************\
+ * Utilities: FolderScanner.h
+ *
+ * Parallel, breadth-first folder scanning engine. One or more root folders are
+ * walked concurrently by a small pool of threads which share a FIFO queue of
+ * directories still to be read. Each root gets its own wall-clock time budget
+ * and found-file cap, so a slow volume or an enormous tree under one root does
+ * not hold up the others.
+ *
+ * Directories are read in batches through a pluggable backend. A POSIX backend
+ * (opendir/readdir) is always available, so the engine builds and runs on any
+ * POSIX system for benchmarking against synthetic trees; on macOS a backend
+ * based on getattrlistbulk() is used by default, since it returns names, types
+ * and sizes in bulk without a separate stat() per entry.
+ *
+ * Optionally, a persistent index (see "ScanIndex.h") lets directories which
+ * have not changed since a previous scan be skipped rather than read again.
+ *
+ * Optionally, the scan can adapt to the volume each root is on (see
+ * "VolumeProfile.h"): network mounts and slow disks are read in large batches
+ * by few threads, since each request costs a round trip or a seek and more of
+ * them at once just queue up; fast local volumes are read by as many threads
+ * as the caller allows. A backend which adds simulated latency to another is
+ * provided, for trying this out against local synthetic trees.
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef FOLDER_SCANNER_H
+#define FOLDER_SCANNER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "VolumeProfile.h"
+
+/* Default number of directory entries requested from a backend per read */
+
+#define FOLDER_SCANNER_DEFAULT_BATCH_SIZE 256
+
+/* When adapting to volumes, the most threads and the batch size used for
+ * roots on medium latency volumes (such as spinning disks) and on network or
+ * high latency volumes. Low latency volumes use the caller's thread count and
+ * batch size.
+ */
+
+#define FOLDER_SCANNER_MEDIUM_LATENCY_THREADS    2
+#define FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE 1024
+#define FOLDER_SCANNER_HIGH_LATENCY_THREADS      2
+#define FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE   4096
+
+/* File size value used when a backend cannot, or has not yet, worked out the
+ * size of an entry.
+ */
+
+#define FOLDER_SCANNER_SIZE_UNKNOWN UINT64_MAX
+
+/* See "ScanIndex.h" */
+
+struct ScanIndex;
+
+/******************************************************************************\
+ * Directory entries and backends
+\******************************************************************************/
+
+typedef enum FolderScannerEntryType
+{
+    folderScannerEntryTypeOther = 0, /* Symbolic links, devices, etc. */
+    folderScannerEntryTypeFile,
+    folderScannerEntryTypeDirectory
+
+} FolderScannerEntryType;
+
+typedef struct FolderScannerEntry
+{
+    const char             * name; /* Leafname; owned by the backend */
+    FolderScannerEntryType   type;
+    uint64_t                 size; /* Or FOLDER_SCANNER_SIZE_UNKNOWN  */
+
+} FolderScannerEntry;
+
+/* A backend reads directories on behalf of the engine. All functions must be
+ * safe to call from several threads at once for different directory handles.
+ *
+ * openDirectory:  Open the directory at the given full path. Return an opaque
+ *                 handle, or NULL with errno set on failure.
+ *
+ * readBatch:      Fill in up to 'maximum' entries. Names must stay valid until
+ *                 the next call for the same handle. Return the number filled
+ *                 in; 0 at the end of the directory; -1 with errno on error.
+ *                 The "." and ".." entries must not be returned.
+ *
+ * sizeOfEntry:    Optional. Called only for entries which the engine needs a
+ *                 size for but which readBatch returned with a size of
+ *                 FOLDER_SCANNER_SIZE_UNKNOWN. Return the size, or
+ *                 FOLDER_SCANNER_SIZE_UNKNOWN on failure.
+ *
+ * closeDirectory: Release the handle.
+ *
+ * context:        Passed through to openDirectory, for backends (such as test
+ *                 doubles) which need their own state.
+ */
+
+typedef struct FolderScannerBackend
+{
+    const char * name;
+
+    void *   ( * openDirectory  ) ( const char               * path,
+                                    void                     * context );
+
+    long     ( * readBatch      ) ( void                     * handle,
+                                    FolderScannerEntry       * entries,
+                                    size_t                     maximum );
+
+    uint64_t ( * sizeOfEntry    ) ( void                     * handle,
+                                    const FolderScannerEntry * entry );
+
+    void     ( * closeDirectory ) ( void                     * handle );
+
+    void     * context;
+
+} FolderScannerBackend;
+
+/* Backend adding simulated latency to another; see
+ * folderScannerSlowBackendInit().
+ */
+
+typedef struct FolderScannerSlowBackend
+{
+    FolderScannerBackend         backend;
+
+    /* Internal */
+
+    const FolderScannerBackend * wrapped;
+    uint32_t                     openMicroseconds;
+    uint32_t                     batchMicroseconds;
+    unsigned int                 concurrentRequests;
+    unsigned int                 activeRequests;
+    pthread_mutex_t              lock;
+    pthread_cond_t               changed;
+
+} FolderScannerSlowBackend;
+
+/******************************************************************************\
+ * Scan roots, options and callbacks
+\******************************************************************************/
+
+typedef enum FolderScannerStatus
+{
+    folderScannerStatusComplete = 0, /* The whole tree was walked            */
+    folderScannerStatusTimeLimit,    /* Stopped early; time budget exhausted */
+    folderScannerStatusFoundLimit,   /* Stopped early; found-file cap hit    */
+    folderScannerStatusStopped,      /* Stopped early at a callback's behest */
+    folderScannerStatusError         /* The root itself could not be read    */
+
+} FolderScannerStatus;
+
+/* Callbacks. Each receives the 'context' pointer of the root being scanned.
+ * All are optional.
+ *
+ * acceptFile:  Should this regular file be reported? Called with the full
+ *              path and leafname before any size check, so keep it cheap.
+ *              If omitted, all regular files are accepted.
+ *
+ * descendInto: Should this subdirectory be scanned? If omitted, all are.
+ *
+ * foundFile:   Report an accepted file which also passed any size limit.
+ *              Calls for any one root are serialised, so the callback can
+ *              update per-root state without locking; calls for different
+ *              roots may happen concurrently. Return false to stop scanning
+ *              this root.
+ *
+ * acceptFile and descendInto may run concurrently even for the same root.
+ */
+
+typedef struct FolderScannerCallbacks
+{
+    bool ( * acceptFile  ) ( void       * context,
+                             const char * fullPath,
+                             const char * leafname );
+
+    bool ( * descendInto ) ( void       * context,
+                             const char * fullPath,
+                             const char * leafname );
+
+    bool ( * foundFile   ) ( void       * context,
+                             const char * fullPath,
+                             uint64_t     size );
+
+} FolderScannerCallbacks;
+
+/* How a root is to be read */
+
+typedef struct FolderScannerStrategy
+{
+    unsigned int threadCount; /* Most threads reading the root at once, 0 = any */
+    size_t       batchSize;
+
+} FolderScannerStrategy;
+
+typedef struct FolderScannerRoot
+{
+    /* Filled in by the caller */
+
+    const char          * path;
+    uint32_t              timeLimitMs;  /* Wall-clock budget, 0 = unlimited */
+    size_t                foundLimit;   /* Cap on found files, 0 = no cap   */
+    void                * context;      /* Passed to callbacks              */
+
+    /* Filled in by folderScannerRun() */
+
+    FolderScannerStatus   status;
+    int                   error;        /* errno if folderScannerStatusError, else 0 */
+    size_t                directoriesRead;
+    size_t                directoriesFromIndex; /* Of those "read" */
+    size_t                entriesSeen;
+    size_t                filesFound;
+    FolderScannerStrategy strategy;
+    VolumeProfile         volume;       /* If adapting; else all zero   */
+
+} FolderScannerRoot;
+
+typedef struct FolderScannerOptions
+{
+    unsigned int                 threadCount;     /* 0 => one per root, capped to CPU count */
+    size_t                       batchSize;       /* 0 => FOLDER_SCANNER_DEFAULT_BATCH_SIZE */
+    uint64_t                     maximumFileSize; /* 0 => no limit (inclusive)              */
+    bool                         skipHidden;      /* Skip leafnames starting with "."       */
+    const FolderScannerBackend * backend;         /* NULL => folderScannerDefaultBackend()  */
+    struct ScanIndex           * index;           /* NULL => no persistent index            */
+    bool                         adaptToVolume;   /* Choose a strategy per root's volume    */
+
+} FolderScannerOptions;
+
+/******************************************************************************\
+ * folderScannerPOSIXBackend()
+ *
+ * Return the portable opendir/readdir backend. Types come from d_type where
+ * the filesystem supplies it, else from lstat(); sizes are found lazily via
+ * fstatat() only for files which pass the caller's "acceptFile" test.
+ *
+ * Out: Pointer to a static, read-only backend description.
+\******************************************************************************/
+
+const FolderScannerBackend * folderScannerPOSIXBackend( void );
+
+/******************************************************************************\
+ * folderScannerDefaultBackend()
+ *
+ * Return the best backend for the host OS - getattrlistbulk() on macOS, else
+ * the POSIX backend.
+ *
+ * Out: Pointer to a static, read-only backend description.
+\******************************************************************************/
+
+const FolderScannerBackend * folderScannerDefaultBackend( void );
+
+/******************************************************************************\
+ * folderScannerSlowBackendInit()
+ *
+ * Set up a backend which passes every call on to another, but first waits for
+ * a given time on each directory opened and each batch read, as if each were
+ * a request to a file server. Optionally, only so many requests are served at
+ * once, with the rest waiting their turn, as a busy server would. Scanning a
+ * local tree through this gives a repeatable stand-in for a network volume.
+ * The waits show up in volume probes too, so when adapting to volumes, roots
+ * scanned through it get the latency class of the simulated delays, not of
+ * the volume they are really on. Profiles are kept by device, so call
+ * volumeProfileForget() between runs with different delays.
+ *
+ * In:  Structure to set up; pass a pointer to its 'backend' field to the
+ *      engine, and keep the structure in place until the scan has finished;
+ *
+ *      Backend to pass calls on to, or NULL for the default backend;
+ *
+ *      Delay per directory opened in microseconds;
+ *
+ *      Delay per batch read in microseconds;
+ *
+ *      Most requests to serve at once, 0 for no limit.
+ *
+ * Out: 0 if set up, else an errno value.
+\******************************************************************************/
+
+int folderScannerSlowBackendInit( FolderScannerSlowBackend   * slow,
+                                  const FolderScannerBackend * wrapped,
+                                  uint32_t                     openMicroseconds,
+                                  uint32_t                     batchMicroseconds,
+                                  unsigned int                 concurrentRequests );
+
+/******************************************************************************\
+ * folderScannerSlowBackendDestroy()
+ *
+ * Release the resources of a backend set up by folderScannerSlowBackendInit().
+ *
+ * In:  Structure to release.
+\******************************************************************************/
+
+void folderScannerSlowBackendDestroy( FolderScannerSlowBackend * slow );
+
+/******************************************************************************\
+ * folderScannerChooseStrategy()
+ *
+ * Choose how to read a root on a volume with the given profile. Network and
+ * high latency volumes get FOLDER_SCANNER_HIGH_LATENCY_*, medium latency
+ * volumes FOLDER_SCANNER_MEDIUM_LATENCY_*, and low or unknown latency volumes
+ * the given thread count and batch size; the thread count is never raised
+ * above that given. Used by folderScannerRun() when adapting to volumes.
+ *
+ * In:  Volume profile;
+ *
+ *      Most threads to use for the root, 0 for no limit;
+ *
+ *      Batch size for low latency volumes, 0 for the default;
+ *
+ *      Strategy to fill in.
+\******************************************************************************/
+
+void folderScannerChooseStrategy( const VolumeProfile   * volume,
+                                  unsigned int            threadCount,
+                                  size_t                  batchSize,
+                                  FolderScannerStrategy * strategy );
+
+/******************************************************************************\
+ * folderScannerRun()
+ *
+ * Walk all of the given roots, breadth first, calling back as files are found.
+ * Blocks until every root is complete or has been stopped early. The calling
+ * thread takes part in the scan, so a single root with a thread count of 1
+ * never starts any other threads.
+ *
+ * Symbolic links are never followed and are reported to no callback.
+ *
+ * If an index is given in the options, each directory's identity and
+ * modification time are looked up before it is read. Directories found
+ * unchanged, whose recorded files are also unchanged in size and modification
+ * time, have their entries taken from the index and are not read; other
+ * directories which are read through to the end are recorded in the index.
+ * Only files which passed "acceptFile" are recorded, so files from the index
+ * are not offered to "acceptFile" again; subdirectories still go through
+ * "descendInto". All scans sharing an index must therefore use the same
+ * "acceptFile" test and "skipHidden" setting.
+ *
+ * If "adaptToVolume" is set in the options, each root's volume is profiled
+ * (see "VolumeProfile.h") and a strategy chosen for it by
+ * folderScannerChooseStrategy(), from the options' thread count and batch
+ * size. The strategy is followed for the whole of that root's tree, even
+ * where it crosses onto other volumes, and fewer threads are started if the
+ * roots' strategies allow no more. The time taken and directories read are
+ * added to each volume's totals afterwards.
+ *
+ * In:  Array of roots, with the caller's fields filled in; results are
+ *      written back into each root on exit;
+ *
+ *      Number of roots in the array;
+ *
+ *      Pointer to options, or NULL for defaults;
+ *
+ *      Pointer to callbacks, or NULL to just count regular files.
+ *
+ * Out: 0 if the scan ran (check each root's 'status' for per-root outcomes),
+ *      else an errno value if the scan could not be started at all.
+\******************************************************************************/
+
+int folderScannerRun( FolderScannerRoot            * roots,
+                      size_t                         rootCount,
+                      const FolderScannerOptions   * options,
+                      const FolderScannerCallbacks * callbacks );
+
+#endif /* FOLDER_SCANNER_H */
@@ -0,0 +1,376 @@
+/******************************************************************************\
+ * Utilities: IcnsWriter.c
+ *
+ * Write and read icon families in 'icns' format. See "IcnsWriter.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "IcnsWriter.h"
+
+#include <string.h>
+
+/* Sizes of the family and element headers, and of the zero bytes which come
+ * before the packed planes of an 'it32' element.
+ */
+
+#define HEADER_SIZE    8
+#define IT32_PREFIX    4
+#define IT32_TYPE      0x69743332 /* 'it32' */
+#define ICNS_TYPE      0x69636E73 /* 'icns' */
+
+/* Longest runs of repeated and literal bytes in one packed chunk */
+
+#define LONGEST_RUN      130
+#define LONGEST_LITERAL  128
+
+/* Static function prototypes */
+
+static size_t   elementDataSize ( const IcnsElement * element,
+                                  uint8_t           * data );
+
+static size_t   packChannel     ( const uint8_t     * source,
+                                  size_t              count,
+                                  uint8_t           * packed );
+
+static bool     unpackChannel   ( const uint8_t    ** packed,
+                                  const uint8_t     * end,
+                                  uint8_t           * destination,
+                                  size_t              count );
+
+static void     putBigEndian    ( uint8_t           * bytes,
+                                  uint32_t            value );
+
+static uint32_t getBigEndian    ( const uint8_t     * bytes );
+
+/******************************************************************************\
+ * icnsSize()
+ *
+ * Work out how big an icon family will be. See "IcnsWriter.h".
+\******************************************************************************/
+
+size_t icnsSize( const IcnsElement * elements, size_t count )
+{
+    size_t size = HEADER_SIZE;
+
+    for ( size_t i = 0; i < count; i ++ )
+    {
+        size += HEADER_SIZE + elementDataSize( &elements[ i ], NULL );
+    }
+
+    return size;
+}
+
+/******************************************************************************\
+ * icnsWrite()
+ *
+ * Write an icon family. See "IcnsWriter.h".
+\******************************************************************************/
+
+size_t icnsWrite( const IcnsElement * elements,
+                  size_t              count,
+                  uint8_t           * buffer,
+                  size_t              bufferSize )
+{
+    size_t size = icnsSize( elements, count );
+
+    if ( size > bufferSize || size > UINT32_MAX ) return 0;
+
+    uint8_t * out = buffer + HEADER_SIZE;
+
+    putBigEndian( buffer,     ICNS_TYPE        );
+    putBigEndian( buffer + 4, ( uint32_t ) size );
+
+    for ( size_t i = 0; i < count; i ++ )
+    {
+        size_t dataSize = elementDataSize( &elements[ i ], out + HEADER_SIZE );
+
+        putBigEndian( out,     elements[ i ].type                       );
+        putBigEndian( out + 4, ( uint32_t ) ( HEADER_SIZE + dataSize ) );
+
+        out += HEADER_SIZE + dataSize;
+    }
+
+    return size;
+}
+
+/******************************************************************************\
+ * icnsRead()
+ *
+ * Read an element back from an icon family. See "IcnsWriter.h".
+\******************************************************************************/
+
+bool icnsRead( const uint8_t * icns,
+               size_t          dataSize,
+               uint32_t        type,
+               IcnsEncoding    encoding,
+               size_t          width,
+               uint8_t       * pixels )
+{
+    if ( dataSize < HEADER_SIZE || getBigEndian( icns ) != ICNS_TYPE ) return false;
+
+    size_t familySize = getBigEndian( icns + 4 );
+    size_t offset     = HEADER_SIZE;
+    size_t count      = width * width;
+
+    if ( familySize > dataSize ) return false;
+
+    while ( offset + HEADER_SIZE <= familySize )
+    {
+        const uint8_t * header      = icns + offset;
+        size_t          elementSize = getBigEndian( header + 4 );
+
+        if ( elementSize < HEADER_SIZE || elementSize > familySize - offset ) return false;
+
+        offset += elementSize;
+
+        if ( getBigEndian( header ) != type ) continue;
+
+        const uint8_t * data = header + HEADER_SIZE;
+        const uint8_t * end  = header + elementSize;
+
+        switch ( encoding )
+        {
+            case IcnsEncodingMask:
+            {
+                if ( ( size_t ) ( end - data ) != count ) return false;
+
+                for ( size_t i = 0; i < count; i ++ ) pixels[ i * 4 ] = data[ i ];
+                return true;
+            }
+
+            case IcnsEncodingRLE:
+            {
+                if ( type == IT32_TYPE ) data += IT32_PREFIX;
+
+                for ( size_t i = 0; i < count; i ++ ) pixels[ i * 4 ] = 255;
+
+                for ( size_t channel = 1; channel <= 3; channel ++ )
+                {
+                    if ( ! unpackChannel( &data, end, pixels + channel, count ) ) return false;
+                }
+
+                return data == end;
+            }
+
+            case IcnsEncodingPNG:
+            break;
+        }
+
+        return false;
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * elementDataSize()
+ *
+ * Work out the size of an element's data, excluding its header, and
+ * optionally write the data too.
+ *
+ * In:  Element of interest;
+ *
+ *      Where to write its data, or NULL to just find its size.
+ *
+ * Out: Size of the element's data in bytes.
+\******************************************************************************/
+
+static size_t elementDataSize( const IcnsElement * element, uint8_t * data )
+{
+    size_t count = element->width * element->width;
+    size_t size  = 0;
+
+    switch ( element->encoding )
+    {
+        case IcnsEncodingMask:
+        {
+            size = count;
+            if ( data ) for ( size_t i = 0; i < count; i ++ ) data[ i ] = element->pixels[ i * 4 ];
+        }
+        break;
+
+        case IcnsEncodingPNG:
+        {
+            size = element->pngSize;
+            if ( data ) memcpy( data, element->png, size );
+        }
+        break;
+
+        case IcnsEncodingRLE:
+        {
+            if ( element->type == IT32_TYPE )
+            {
+                if ( data ) memset( data, 0, IT32_PREFIX );
+                size = IT32_PREFIX;
+            }
+
+            for ( size_t channel = 1; channel <= 3; channel ++ )
+            {
+                size += packChannel( element->pixels + channel, count, data ? data + size : NULL );
+            }
+        }
+        break;
+    }
+
+    return size;
+}
+
+/******************************************************************************\
+ * packChannel()
+ *
+ * Run-length pack one channel of some A, R, G, B pixels. The packed data is a
+ * series of chunks, each a header byte then either:
+ *
+ *   - For headers below 0x80, (header + 1) literal bytes;
+ *   - Otherwise, one byte to be repeated (header - 0x80 + 3) times.
+ *
+ * In:  First byte of the channel, with a stride of four bytes;
+ *
+ *      Number of pixels;
+ *
+ *      Where to write the packed data, or NULL to just find its size.
+ *
+ * Out: Size of the packed data in bytes.
+\******************************************************************************/
+
+static size_t packChannel( const uint8_t * source, size_t count, uint8_t * packed )
+{
+    size_t size = 0;
+    size_t i    = 0;
+
+    #define BYTE( n ) source[ ( n ) * 4 ]
+
+    while ( i < count )
+    {
+        size_t run = 1;
+
+        while ( i + run < count && run < LONGEST_RUN && BYTE( i + run ) == BYTE( i ) ) run ++;
+
+        if ( run >= 3 )
+        {
+            if ( packed )
+            {
+                packed[ size     ] = ( uint8_t ) ( 0x80 + run - 3 );
+                packed[ size + 1 ] = BYTE( i );
+            }
+
+            size += 2;
+            i    += run;
+
+            continue;
+        }
+
+        /* Literals, up to the next run worth packing */
+
+        size_t start = i;
+
+        while ( i < count && i - start < LONGEST_LITERAL )
+        {
+            if ( i + 2 < count && BYTE( i ) == BYTE( i + 1 ) && BYTE( i ) == BYTE( i + 2 ) ) break;
+            i ++;
+        }
+
+        if ( packed )
+        {
+            packed[ size ] = ( uint8_t ) ( i - start - 1 );
+            for ( size_t n = start; n < i; n ++ ) packed[ size + 1 + n - start ] = BYTE( n );
+        }
+
+        size += 1 + i - start;
+    }
+
+    #undef BYTE
+
+    return size;
+}
+
+/******************************************************************************\
+ * unpackChannel()
+ *
+ * Unpack one channel packed by packChannel().
+ *
+ * In:  Pointer to the start of the packed data, updated on exit to point just
+ *      past it;
+ *
+ *      End of the data available;
+ *
+ *      First byte of the channel to fill in, with a stride of four bytes;
+ *
+ *      Number of pixels.
+ *
+ * Out: true if all went well, false if the data is damaged.
+\******************************************************************************/
+
+static bool unpackChannel( const uint8_t ** packed,
+                           const uint8_t  * end,
+                           uint8_t        * destination,
+                           size_t           count )
+{
+    const uint8_t * in = *packed;
+    size_t          i  = 0;
+
+    while ( i < count )
+    {
+        if ( in >= end ) return false;
+
+        unsigned int header = *in ++;
+
+        if ( header < 0x80 )
+        {
+            size_t length = header + 1;
+
+            if ( length > count - i || length > ( size_t ) ( end - in ) ) return false;
+
+            while ( length -- ) destination[ i ++ * 4 ] = *in ++;
+        }
+        else
+        {
+            size_t length = header - 0x80 + 3;
+
+            if ( length > count - i || in >= end ) return false;
+
+            uint8_t value = *in ++;
+            while ( length -- ) destination[ i ++ * 4 ] = value;
+        }
+    }
+
+    *packed = in;
+    return true;
+}
+
+/******************************************************************************\
+ * putBigEndian()
+ *
+ * Write a 32-bit value as four big-endian bytes.
+ *
+ * In:  Where to write;
+ *
+ *      Value to write.
+\******************************************************************************/
+
+static void putBigEndian( uint8_t * bytes, uint32_t value )
+{
+    bytes[ 0 ] = ( uint8_t ) ( value >> 24 );
+    bytes[ 1 ] = ( uint8_t ) ( value >> 16 );
+    bytes[ 2 ] = ( uint8_t ) ( value >>  8 );
+    bytes[ 3 ] = ( uint8_t ) ( value       );
+}
+
+/******************************************************************************\
+ * getBigEndian()
+ *
+ * Read a 32-bit value from four big-endian bytes.
+ *
+ * In:  Where to read from.
+ *
+ * Out: Value read.
+\******************************************************************************/
+
+static uint32_t getBigEndian( const uint8_t * bytes )
+{
+    return ( ( uint32_t ) bytes[ 0 ] << 24 ) |
+           ( ( uint32_t ) bytes[ 1 ] << 16 ) |
+           ( ( uint32_t ) bytes[ 2 ] <<  8 ) |
+           ( ( uint32_t ) bytes[ 3 ]       );
+}
@@ -0,0 +1,126 @@
+/******************************************************************************\
+ * Utilities: IcnsWriter.h
+ *
+ * Write an icon family in 'icns' format - the form stored in a custom icon
+ * resource - into one contiguous buffer, sized exactly up front. Read it back
+ * again, too.
+ *
+ * An 'icns' family is a big-endian header ('icns', total length) followed by
+ * elements, each a big-endian header (type, length including the header) and
+ * data. Three kinds of data are written here:
+ *
+ *   - R, G and B planes each packed with the icon family run-length scheme,
+ *     e.g. 'it32' (128x128, which has four zero bytes in front), 'il32'
+ *     (32x32) and 'is32' (16x16);
+ *
+ *   - 8-bit masks, e.g. 't8mk', 'l8mk' and 's8mk';
+ *
+ *   - PNG files, compressed beforehand (see "PngEncoder.h"), for the large
+ *     sizes 'ic09' (512x512) and 'ic08' (256x256), which would take 1MB and
+ *     256K as raw pixels.
+ *
+ * Source pixels are always square, with 8 bits per channel and alpha first in
+ * memory, as made by "IconPyramid.h". Run-length packed elements take their
+ * colour channels and masks take their alpha channel, so an image and its mask
+ * are both described by the same pixels.
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef ICNS_WRITER_H
+#define ICNS_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum IcnsEncoding
+{
+    IcnsEncodingRLE,  /* Run-length packed R, G, B planes  */
+    IcnsEncodingMask, /* Alpha bytes                       */
+    IcnsEncodingPNG   /* Ready-made PNG file               */
+
+} IcnsEncoding;
+
+typedef struct IcnsElement
+{
+    uint32_t        type;     /* E.g. 'ic09'                                  */
+    IcnsEncoding    encoding;
+    const uint8_t * pixels;   /* width * width A, R, G, B pixels, packed      */
+    size_t          width;    /* In pixels; the height is the same            */
+    const uint8_t * png;      /* IcnsEncodingPNG only - the PNG file...       */
+    size_t          pngSize;  /* ...and its size in bytes                     */
+
+} IcnsElement;
+
+/******************************************************************************\
+ * icnsSize()
+ *
+ * Work out how big an icon family will be.
+ *
+ * In:  Array of elements to include, in the order they'll be written;
+ *
+ *      Number of elements in the array.
+ *
+ * Out: Exact size of the icon family in bytes, including its header.
+\******************************************************************************/
+
+size_t icnsSize( const IcnsElement * elements, size_t count );
+
+/******************************************************************************\
+ * icnsWrite()
+ *
+ * Write an icon family.
+ *
+ * In:  Array of elements to include, in the order they'll be written;
+ *
+ *      Number of elements in the array;
+ *
+ *      Buffer to write into;
+ *
+ *      Size of the buffer in bytes, usually from icnsSize().
+ *
+ * Out: Bytes written, or 0 if the buffer was too small (in which case its
+ *      contents are undefined).
+\******************************************************************************/
+
+size_t icnsWrite( const IcnsElement * elements,
+                  size_t              count,
+                  uint8_t           * buffer,
+                  size_t              bufferSize );
+
+/******************************************************************************\
+ * icnsRead()
+ *
+ * Read an element back from an icon family, as written by icnsWrite(). Only
+ * the channels which the encoding stores are filled in: for run-length packed
+ * elements alpha is set to 255, while masks leave the colour channels alone
+ * so that reading an image then its mask into the same pixels rebuilds both.
+ * PNG elements aren't decoded, so can't be read back here.
+ *
+ * In:  Icon family, starting with its header;
+ *
+ *      Size of the icon family data in bytes;
+ *
+ *      Type of element to read, e.g. 'it32';
+ *
+ *      Its encoding;
+ *
+ *      Its width in pixels;
+ *
+ *      Where to write width * width A, R, G, B pixels.
+ *
+ * Out: true if the element was found and decoded, false if it is missing,
+ *      damaged or doesn't match the given encoding and width.
+\******************************************************************************/
+
+bool icnsRead( const uint8_t * icns,
+               size_t          dataSize,
+               uint32_t        type,
+               IcnsEncoding    encoding,
+               size_t          width,
+               uint8_t       * pixels );
+
+#endif /* ICNS_WRITER_H */
@@ -0,0 +1,293 @@
+/******************************************************************************\
+ * Utilities: IconPyramid.c
+ *
+ * Build the smaller sizes of an icon family as a pyramid. See "IconPyramid.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "IconPyramid.h"
+
+#include <stdlib.h>
+
+#if   !defined( ICON_PYRAMID_SCALAR ) && ( defined( __SSE2__ ) || defined( _M_X64 ) )
+    #define KERNELS_SSE2
+    #include <emmintrin.h>
+#elif !defined( ICON_PYRAMID_SCALAR ) && defined( __ARM_NEON )
+    #define KERNELS_NEON
+    #include <arm_neon.h>
+#endif
+
+/* Static function prototypes */
+
+static void verticalTaps   ( uint16_t      * sums,
+                             const uint8_t * row0,
+                             const uint8_t * row1,
+                             const uint8_t * row2,
+                             const uint8_t * row3,
+                             size_t          count );
+
+static void horizontalTaps ( uint8_t        * destination,
+                             const uint16_t * sums,
+                             size_t           sourceWidth );
+
+static void horizontalTap  ( uint8_t        * destination,
+                             const uint16_t * sums,
+                             size_t           sourceWidth,
+                             size_t           x );
+
+/******************************************************************************\
+ * iconPyramidKernels()
+ *
+ * Name the inner loops in use. See "IconPyramid.h".
+\******************************************************************************/
+
+const char * iconPyramidKernels( void )
+{
+    #if   defined( KERNELS_SSE2 )
+        return "SSE2";
+    #elif defined( KERNELS_NEON )
+        return "NEON";
+    #else
+        return "scalar";
+    #endif
+}
+
+/******************************************************************************\
+ * iconPyramidHalve()
+ *
+ * Make the next level down of a pyramid. See "IconPyramid.h".
+\******************************************************************************/
+
+bool iconPyramidHalve( const uint8_t * source,
+                       size_t          sourceWidth,
+                       size_t          sourceHeight,
+                       size_t          sourceRowBytes,
+                       uint8_t       * destination,
+                       size_t          destinationRowBytes,
+                       uint8_t       * colour,
+                       uint8_t       * mask )
+{
+    size_t     width  = sourceWidth  / 2;
+    size_t     height = sourceHeight / 2;
+    uint16_t * sums   = malloc( sourceWidth * 4 * sizeof( uint16_t ) );
+    uint8_t  * spare  = destination ? NULL : malloc( width * 4 );
+
+    if ( sums == NULL || ( destination == NULL && spare == NULL ) )
+    {
+        free( sums  );
+        free( spare );
+
+        return false;
+    }
+
+    for ( size_t y = 0; y < height; y ++ )
+    {
+        /* Source rows 2y - 1 to 2y + 2, repeating the edge rows */
+
+        size_t top    = y == 0          ? 0                : y * 2 - 1;
+        size_t bottom = y == height - 1 ? sourceHeight - 1 : y * 2 + 2;
+
+        verticalTaps
+        (
+            sums,
+            source + sourceRowBytes * top,
+            source + sourceRowBytes * ( y * 2     ),
+            source + sourceRowBytes * ( y * 2 + 1 ),
+            source + sourceRowBytes * bottom,
+            sourceWidth * 4
+        );
+
+        uint8_t * row = destination ? destination + y * destinationRowBytes : spare;
+
+        horizontalTaps( row, sums, sourceWidth );
+
+        /* Split out the planes while the row is to hand */
+
+        if ( colour )
+        {
+            uint8_t * out = colour + y * width * 4;
+
+            for ( size_t x = 0; x < width; x ++ )
+            {
+                out[ x * 4 + 0 ] = 255;
+                out[ x * 4 + 1 ] = row[ x * 4 + 1 ];
+                out[ x * 4 + 2 ] = row[ x * 4 + 2 ];
+                out[ x * 4 + 3 ] = row[ x * 4 + 3 ];
+            }
+        }
+
+        if ( mask )
+        {
+            uint8_t * out = mask + y * width;
+
+            for ( size_t x = 0; x < width; x ++ ) out[ x ] = row[ x * 4 ];
+        }
+    }
+
+    free( sums  );
+    free( spare );
+
+    return true;
+}
+
+/******************************************************************************\
+ * verticalTaps()
+ *
+ * Filter four source rows vertically: sums = row0 + 3 * row1 + 3 * row2 +
+ * row3, for every byte. Sums are at most 8 * 255.
+ *
+ * In:  Sums to fill in;
+ *
+ *      Four source rows, top first;
+ *
+ *      Number of bytes in each row.
+\******************************************************************************/
+
+static void verticalTaps( uint16_t      * sums,
+                          const uint8_t * row0,
+                          const uint8_t * row1,
+                          const uint8_t * row2,
+                          const uint8_t * row3,
+                          size_t          count )
+{
+    size_t i = 0;
+
+    #if defined( KERNELS_SSE2 )
+
+        const __m128i zero = _mm_setzero_si128();
+
+        for ( ; i + 16 <= count; i += 16 )
+        {
+            __m128i a = _mm_loadu_si128( ( const __m128i * ) ( row0 + i ) );
+            __m128i b = _mm_loadu_si128( ( const __m128i * ) ( row1 + i ) );
+            __m128i c = _mm_loadu_si128( ( const __m128i * ) ( row2 + i ) );
+            __m128i d = _mm_loadu_si128( ( const __m128i * ) ( row3 + i ) );
+
+            __m128i tLo = _mm_add_epi16( _mm_unpacklo_epi8( b, zero ), _mm_unpacklo_epi8( c, zero ) );
+            __m128i tHi = _mm_add_epi16( _mm_unpackhi_epi8( b, zero ), _mm_unpackhi_epi8( c, zero ) );
+            __m128i sLo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( d, zero ) );
+            __m128i sHi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( d, zero ) );
+
+            sLo = _mm_add_epi16( sLo, _mm_add_epi16( tLo, _mm_slli_epi16( tLo, 1 ) ) );
+            sHi = _mm_add_epi16( sHi, _mm_add_epi16( tHi, _mm_slli_epi16( tHi, 1 ) ) );
+
+            _mm_storeu_si128( ( __m128i * ) ( sums + i     ), sLo );
+            _mm_storeu_si128( ( __m128i * ) ( sums + i + 8 ), sHi );
+        }
+
+    #elif defined( KERNELS_NEON )
+
+        for ( ; i + 8 <= count; i += 8 )
+        {
+            uint16x8_t t = vaddl_u8( vld1_u8( row1 + i ), vld1_u8( row2 + i ) );
+            uint16x8_t s = vaddl_u8( vld1_u8( row0 + i ), vld1_u8( row3 + i ) );
+
+            vst1q_u16( sums + i, vmlaq_n_u16( s, t, 3 ) );
+        }
+
+    #endif
+
+    for ( ; i < count; i ++ )
+    {
+        sums[ i ] = ( uint16_t ) ( row0[ i ] + 3 * ( row1[ i ] + row2[ i ] ) + row3[ i ] );
+    }
+}
+
+/******************************************************************************\
+ * horizontalTaps()
+ *
+ * Filter vertically filtered sums horizontally into a row of destination
+ * pixels, each from source pixels 2x - 1 to 2x + 2, repeating the edge pixels.
+ *
+ * In:  Destination row, sourceWidth / 2 pixels;
+ *
+ *      Sums from verticalTaps();
+ *
+ *      Source width in pixels.
+\******************************************************************************/
+
+static void horizontalTaps( uint8_t * destination, const uint16_t * sums, size_t sourceWidth )
+{
+    size_t width = sourceWidth / 2;
+    size_t x     = 1;
+
+    horizontalTap( destination, sums, sourceWidth, 0 );
+
+    /* Two pixels at a time in the interior, where nothing needs clamping */
+
+    #if defined( KERNELS_SSE2 )
+
+        const __m128i round = _mm_set1_epi16( 32 );
+
+        #define PIXEL( k ) _mm_loadl_epi64( ( const __m128i * ) ( sums + ( k ) * 4 ) )
+
+        for ( ; x + 2 < width; x += 2 )
+        {
+            size_t  k = x * 2;
+            __m128i a = _mm_unpacklo_epi64( PIXEL( k - 1 ), PIXEL( k + 1 ) );
+            __m128i b = _mm_unpacklo_epi64( PIXEL( k     ), PIXEL( k + 2 ) );
+            __m128i c = _mm_unpacklo_epi64( PIXEL( k + 1 ), PIXEL( k + 3 ) );
+            __m128i d = _mm_unpacklo_epi64( PIXEL( k + 2 ), PIXEL( k + 4 ) );
+            __m128i t = _mm_add_epi16( b, c );
+            __m128i s = _mm_add_epi16( _mm_add_epi16( a, d ), _mm_add_epi16( t, _mm_slli_epi16( t, 1 ) ) );
+
+            s = _mm_srli_epi16( _mm_add_epi16( s, round ), 6 );
+
+            _mm_storel_epi64( ( __m128i * ) ( destination + x * 4 ), _mm_packus_epi16( s, s ) );
+        }
+
+        #undef PIXEL
+
+    #elif defined( KERNELS_NEON )
+
+        #define PIXEL( k ) vld1_u16( sums + ( k ) * 4 )
+
+        for ( ; x + 2 < width; x += 2 )
+        {
+            size_t     k = x * 2;
+            uint16x8_t a = vcombine_u16( PIXEL( k - 1 ), PIXEL( k + 1 ) );
+            uint16x8_t b = vcombine_u16( PIXEL( k     ), PIXEL( k + 2 ) );
+            uint16x8_t c = vcombine_u16( PIXEL( k + 1 ), PIXEL( k + 3 ) );
+            uint16x8_t d = vcombine_u16( PIXEL( k + 2 ), PIXEL( k + 4 ) );
+            uint16x8_t s = vmlaq_n_u16( vaddq_u16( a, d ), vaddq_u16( b, c ), 3 );
+
+            vst1_u8( destination + x * 4, vrshrn_n_u16( s, 6 ) );
+        }
+
+        #undef PIXEL
+
+    #endif
+
+    for ( ; x < width; x ++ ) horizontalTap( destination, sums, sourceWidth, x );
+}
+
+/******************************************************************************\
+ * horizontalTap()
+ *
+ * As horizontalTaps(), for a single destination pixel.
+ *
+ * In:  Destination row;
+ *
+ *      Sums from verticalTaps();
+ *
+ *      Source width in pixels;
+ *
+ *      Destination pixel's x coordinate.
+\******************************************************************************/
+
+static void horizontalTap( uint8_t * destination, const uint16_t * sums, size_t sourceWidth, size_t x )
+{
+    size_t left  = x == 0                   ? 0               : x * 2 - 1;
+    size_t right = x * 2 + 2 >= sourceWidth ? sourceWidth - 1 : x * 2 + 2;
+
+    for ( size_t channel = 0; channel < 4; channel ++ )
+    {
+        unsigned int sum =     sums[ left          * 4 + channel ] +
+                           3 * sums[ ( x * 2     ) * 4 + channel ] +
+                           3 * sums[ ( x * 2 + 1 ) * 4 + channel ] +
+                               sums[ right         * 4 + channel ];
+
+        destination[ x * 4 + channel ] = ( uint8_t ) ( ( sum + 32 ) >> 6 );
+    }
+}
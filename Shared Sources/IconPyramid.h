@@ -0,0 +1,74 @@
+/******************************************************************************\
+ * Utilities: IconPyramid.h
+ *
+ * Build the smaller sizes of an icon family as a pyramid: each level is made
+ * from the one above it by halving with a [1 3 3 1] / 8 filter in both
+ * directions, rather than by scaling the full size image down to every size
+ * again. For the old-style icon sizes, which store colour and an 8-bit mask
+ * separately, the two planes are split out in the same pass.
+ *
+ * Pixels have 8 bits per channel, are premultiplied by alpha and have alpha
+ * first in memory (A, R, G, B bytes - CoreGraphics' "premultiplied first"
+ * with default byte order).
+ *
+ * The inner loops have SSE2 and NEON versions chosen at compile time, with
+ * plain C for anything else; define ICON_PYRAMID_SCALAR to force plain C.
+ * Results are bit-identical whichever version is used.
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef ICON_PYRAMID_H
+#define ICON_PYRAMID_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************\
+ * iconPyramidKernels()
+ *
+ * Out: Name of the set of inner loops compiled in - "SSE2", "NEON" or
+ *      "scalar".
+\******************************************************************************/
+
+const char * iconPyramidKernels( void );
+
+/******************************************************************************\
+ * iconPyramidHalve()
+ *
+ * Make the next level down of a pyramid: an image half the width and height
+ * of the source. Anything beyond the source's edges repeats its edge pixels.
+ *
+ * In:  Source pixels, top row first;
+ *
+ *      Source width and height in pixels, each even and at least 2;
+ *
+ *      Bytes from one source row to the next;
+ *
+ *      Destination pixels for the half size image, or NULL if only the split
+ *      planes are wanted;
+ *
+ *      Bytes from one destination row to the next;
+ *
+ *      Colour plane to fill in, or NULL: the destination pixels with their
+ *      alpha bytes set to 255, packed with no padding between rows;
+ *
+ *      Mask plane to fill in, or NULL: the destination pixels' alpha bytes,
+ *      packed with no padding between rows.
+ *
+ * Out: true on success, false if out of memory.
+\******************************************************************************/
+
+bool iconPyramidHalve( const uint8_t * source,
+                       size_t          sourceWidth,
+                       size_t          sourceHeight,
+                       size_t          sourceRowBytes,
+                       uint8_t       * destination,
+                       size_t          destinationRowBytes,
+                       uint8_t       * colour,
+                       uint8_t       * mask );
+
+#endif /* ICON_PYRAMID_H */
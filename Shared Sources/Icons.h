@@ -37,7 +37,10 @@
  * been assigned as a custom icon set. Ideally the input CGImage should be
  * that size, but if not, it will be stretched to fit.
  *
- * Requires static data buffer "dataRGB" (see top of "Icons.m").
+ * The family is written in one go into a handle of exactly the right size;
+ * see "IcnsWriter.h". The 512x512 and 256x256 sizes are stored PNG
+ * compressed at the zlib level given by the "pngIconCompressionLevel"
+ * preference (1 if unset); see "PngEncoder.h".
  *
  * Heavily based upon:
  *
@@ -74,10 +77,11 @@ Boolean hasCustomIcon( NSString * fullPosixPath );
  * are not supported, but custom icons for regular files and folders should
  * work fine.
  *
- * The function is a hybrid based on adaptation and a combination of code at:
- *
- *   http://developer.apple.com/samplecode/SetCustomIcon/
- *   http://www.cocoabuilder.com/archive/message/cocoa/2004/2/3/95889
+ * Safe to call from parallel threads for different files and folders; see
+ * "ResourceForkWriter.h". The global locking semaphore must be initialised
+ * (see "globalSemaphoreInit" in "GlobalSemaphore.[h|m]"), as it is still
+ * needed for the rare case of a file with other resources in its resource
+ * fork.
  *
  * In:  Full POSIX path of file or folder to update;
  *
@@ -88,3 +92,20 @@ Boolean hasCustomIcon( NSString * fullPosixPath );
 \******************************************************************************/
 
 OSStatus saveCustomIcon( NSString * fullPosixPath, IconFamilyHandle icnsH );
+
+/******************************************************************************\
+ * hasSameCustomIcon()
+ *
+ * Does the given file or folder already have exactly the given custom icon,
+ * as written by "saveCustomIcon"? If so there's no need to write it again.
+ * See "resourceForkHasCustomIcon" in "ResourceForkWriter.h" for details.
+ *
+ * In:  Full POSIX path of file or folder of interest;
+ *
+ *      IconFamilyHandle for the icon it should have.
+ *
+ * Out: YES if the icon is already in place, NO for any other condition
+ *      (including internal errors).
+\******************************************************************************/
+
+Boolean hasSameCustomIcon( NSString * fullPosixPath, IconFamilyHandle icnsH );
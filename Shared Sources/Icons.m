@@ -7,23 +7,50 @@
 \******************************************************************************/
 
 #import "Icons.h"
-#import "GlobalConstants.h" /* For CANVAS_SIZE only */
+#import "IconPyramid.h"
+#import "IcnsWriter.h"
+#import "PngEncoder.h"
+#import "ResourceForkWriter.h"
+#import "GlobalSemaphore.h"
+#import "TaskScheduler.h"
+#import "GlobalConstants.h" /* For GENERATE_ALL_ICON_SIZES only */
+
+/* Icon family members generated, largest first. Sizes of 256 and up hold
+ * premultiplied ARGB data; smaller sizes hold run-length packed colour data
+ * and an 8-bit mask separately. Every size must be the largest size halved
+ * some number of times (see drawImages()).
+ */
+
+static const struct
+{
+    size_t size;
+    OSType colour;
+    OSType mask;   /* 0 if alpha is included in the colour data */
+}
+iconTypes[] =
+{
+    { 512, kIconServices512PixelDataARGB, 0                  },
+#ifdef GENERATE_ALL_ICON_SIZES
+    { 256, kIconServices256PixelDataARGB, 0                  },
+#endif
+    { 128, kThumbnail32BitData,           kThumbnail8BitMask },
+    {  32, kLarge32BitData,               kLarge8BitMask     },
+#ifdef GENERATE_ALL_ICON_SIZES
+    {  16, kSmall32BitData,               kSmall8BitMask     },
+#endif
+};
+
+#define ICON_TYPE_COUNT ( sizeof( iconTypes ) / sizeof( iconTypes[ 0 ] ) )
 
 /* Local functions */
 
-static OSStatus addImages      ( IconFamilyHandle iconHnd,
-                                 CGImageRef       cgImage );
+static int      pngCompressionLevel     ( void );
 
-static OSStatus addImage       ( IconFamilyHandle iconHnd,
-                                 CGImageRef       cgImage,
-                                 CGColorSpaceRef  cgColourSpace,
-                                 size_t           width );
+static OSStatus drawImages              ( CGImageRef         cgImage,
+                                          uint8_t         ** levels );
 
-static OSStatus addImageOrMask ( IconFamilyHandle iconHnd,
-                                 CGImageRef       cgImage,
-                                 CGColorSpaceRef  cgColourSpace,
-                                 size_t           width,
-                                 Boolean          mask );
+static OSStatus saveWithResourceManager ( NSString         * fullPosixPath,
+                                          IconFamilyHandle   icnsH );
 
 ///******************************************************************************\
 // * allocFolderIcon()
@@ -104,34 +131,96 @@ static OSStatus addImageOrMask ( IconFamilyHandle iconHnd,
 
 OSStatus createIconFamilyFromCGImage( CGImageRef cgImage, IconFamilyHandle * iconHndRef )
 {
-    SInt32           theSize;
+    uint8_t        * levels  [ ICON_TYPE_COUNT ] = { NULL };
+    uint8_t        * pngs    [ ICON_TYPE_COUNT ] = { NULL };
+    size_t           pngSizes[ ICON_TYPE_COUNT ] = { 0 };
+    IcnsElement      elements[ ICON_TYPE_COUNT * 2 ];
+    size_t           count   = 0;
+    size_t           size;
+    int              level   = pngCompressionLevel();
     IconFamilyHandle iconHnd = NULL;
-    OSStatus         err     = memFullErr;
+    OSStatus         err;
 
     *iconHndRef = NULL;
 
-    /* Create an icon family handle. An icon family handle is just a fixed
-     * (big-endian) header and tagged data.
+    /* Draw the images at every size */
+
+    err = drawImages( cgImage, levels );
+    __Require( err == noErr, bailOut );
+
+    /* Compress the large sizes, which have no separate mask, to PNG, all at
+     * once. Blocks can't capture arrays, hence the pointers.
      */
 
-    theSize = sizeof( OSType ) * 2;
-    iconHnd = ( IconFamilyHandle ) NewHandle( theSize );
+    uint8_t ** pngData = pngs;
+    size_t   * pngSize = pngSizes;
+    uint8_t ** pixels  = levels;
 
-    __Require( iconHnd, bailOut );
+    taskSchedulerApplyBlock( ICON_TYPE_COUNT, ^( size_t i ) {
 
-    ( *iconHnd )->resourceType = EndianU32_NtoB( kIconFamilyType );
-    ( *iconHnd )->resourceSize = EndianU32_NtoB( theSize         );
+        if ( iconTypes[ i ].mask != 0 ) return;
 
-    /* Add the images and return the handle of the populated icon family */
+        size_t width = iconTypes[ i ].size;
+        pngData[ i ] = pngEncode( pixels[ i ], width, width, width * 4, level, &pngSize[ i ] );
+    });
 
-    err = addImages( iconHnd, cgImage );
-    __Require( err == noErr, bailOut );
+    /* Describe the elements of the icon family. Sizes with a separate mask
+     * take their colour and mask data from the same pixels.
+     */
+
+    for ( size_t i = 0; i < ICON_TYPE_COUNT; i ++ )
+    {
+        err = memFullErr;
+        __Require( iconTypes[ i ].mask != 0 || pngs[ i ] != NULL, bailOut );
+
+        elements[ count ++ ] = ( IcnsElement )
+        {
+            iconTypes[ i ].colour,
+            iconTypes[ i ].mask ? IcnsEncodingRLE : IcnsEncodingPNG,
+            levels[ i ],
+            iconTypes[ i ].size,
+            pngs[ i ],
+            pngSizes[ i ]
+        };
+
+        if ( iconTypes[ i ].mask )
+        {
+            elements[ count ++ ] = ( IcnsElement )
+            {
+                iconTypes[ i ].mask,
+                IcnsEncodingMask,
+                levels[ i ],
+                iconTypes[ i ].size
+            };
+        }
+    }
+
+    /* An icon family handle is just a fixed (big-endian) header and tagged
+     * data, so allocate it at its final size and write the lot straight in,
+     * rather than growing it one element at a time.
+     */
+
+    err     = memFullErr;
+    size    = icnsSize( elements, count );
+    iconHnd = ( IconFamilyHandle ) NewHandle( size );
+
+    __Require( iconHnd, bailOut );
+
+    err = paramErr;
+    __Require( icnsWrite( elements, count, ( uint8_t * ) *iconHnd, size ) == size, bailOut );
 
     *iconHndRef = iconHnd;
-    return noErr;
+    iconHnd     = NULL;
+    err         = noErr;
 
 bailOut:
 
+    for ( size_t i = 0; i < ICON_TYPE_COUNT; i ++ )
+    {
+        free( levels[ i ] );
+        free( pngs  [ i ] );
+    }
+
     if ( iconHnd != NULL ) DisposeHandle( ( Handle ) iconHnd );
     return err;
 }
@@ -231,9 +320,112 @@ bailOut:
  * are not supported, but custom icons for regular files and folders should
  * work fine.
  *
+ * The resource fork holding the icon is built in memory and written in one go
+ * (see "ResourceForkWriter.h"), so this may be called from parallel threads
+ * for different files and folders. Only a file with other resources already
+ * in its resource fork needs the Resource Manager to merge the icon in, which
+ * is done under the global locking semaphore; see "globalSemaphoreInit" in
+ * "GlobalSemaphore.[h|m]".
+ *
+ * In:  Full POSIX path of file or folder to update;
+ *
+ *      IconFamilyHandle for the icon to set (see "createIconFamilyFromCGImage"
+ *      for one of many different ways to obtain such a thing).
+ *
+ * Out: Error indication - noErr if OK, else failed.
+\******************************************************************************/
+
+OSStatus saveCustomIcon( NSString * fullPosixPath, IconFamilyHandle icnsH )
+{
+    OSStatus err;
+    FSRef    ref;
+    Boolean  dir = false;
+
+    err = FSPathMakeRef
+    (
+        ( UInt8 * ) [ fullPosixPath fileSystemRepresentation ], &ref, &dir
+    );
+
+    __Require( err == noErr, bailOut );
+
+    int error = resourceForkSaveCustomIcon
+    (
+        [ fullPosixPath fileSystemRepresentation ],
+        dir,
+        ( const uint8_t * ) *icnsH,
+        ( size_t ) GetHandleSize( ( Handle ) icnsH )
+    );
+
+    /* A file whose resource fork holds more than an icon gets the icon merged
+     * in by the Resource Manager instead. No hash of the icon is stored then
+     * (see "ResourceForkWriter.h") and hasSameCustomIcon() never matches such
+     * a fork, so the icon is always written again.
+     */
+
+    if ( error == EEXIST )
+    {
+        globalSemaphoreClaim();
+
+        @try
+        {
+            err = saveWithResourceManager( fullPosixPath, icnsH );
+        }
+        @finally
+        {
+            globalSemaphoreRelease();
+        }
+
+        return err;
+    }
+    else if ( error != 0 )
+    {
+        errno = error;
+        err   = kPOSIXErrorBase + error;
+
+        goto bailOut;
+    }
+
+    /* Tell the finder about the change */
+
+    err = FNNotify( &ref, kFNDirectoryModifiedMessage, kNilOptions );
+
+bailOut:
+
+    return err;
+}
+
+/******************************************************************************\
+ * hasSameCustomIcon()
+ *
+ * Does the given file or folder already have exactly the given custom icon?
+ * See "Icons.h" for details.
+\******************************************************************************/
+
+Boolean hasSameCustomIcon( NSString * fullPosixPath, IconFamilyHandle icnsH )
+{
+    BOOL dir = NO;
+
+    if ( [ [ NSFileManager defaultManager ] fileExistsAtPath: fullPosixPath isDirectory: &dir ] == NO ) return NO;
+
+    return resourceForkHasCustomIcon
+    (
+        [ fullPosixPath fileSystemRepresentation ],
+        dir,
+        ( const uint8_t * ) *icnsH,
+        ( size_t ) GetHandleSize( ( Handle ) icnsH )
+    );
+}
+
+/******************************************************************************\
+ * saveWithResourceManager()
+ *
+ * Internal - as saveCustomIcon(), but using the Resource Manager, so that a
+ * custom icon can be added to a file's resource fork alongside whatever else
+ * is in there.
+ *
  * The code does not work reliably when called from parallel threads, so
- * for such use cases, consider using the global locking semaphore. See
- * "globalSemaphoreInit" in "GlobalSemaphore.[h|m]".
+ * callers must hold the global locking semaphore. See "globalSemaphoreInit"
+ * in "GlobalSemaphore.[h|m]".
  *
  * The function is a hybrid based on adaptation and a combination of code at:
  *
@@ -242,13 +434,12 @@ bailOut:
  *
  * In:  Full POSIX path of file or folder to update;
  *
- *      IconFamilyHandle for the icon to set (see "createIconFamilyFromCGImage"
- *      for one of many different ways to obtain such a thing).
+ *      IconFamilyHandle for the icon to set.
  *
  * Out: Error indication - noErr if OK, else failed.
 \******************************************************************************/
 
-OSStatus saveCustomIcon( NSString * fullPosixPath, IconFamilyHandle icnsH )
+static OSStatus saveWithResourceManager( NSString * fullPosixPath, IconFamilyHandle icnsH )
 {
     OSStatus      err;
     FSCatalogInfo info;
@@ -421,25 +612,54 @@ bailOut:
 }
 
 /******************************************************************************\
- * addImages()
+ * pngCompressionLevel()
+ *
+ * Internal - return the zlib compression level for PNG compressed icon family
+ * elements, from the "pngIconCompressionLevel" preference (read once per
+ * process), defaulting to 1.
  *
- * Internal - to the icon family identified by the given handle, add the
- * given image in various different sizes.
+ * PNG shrinks the 512x512 size from 1MB to typically 100-200K, which matters
+ * when writing icons for many folders on a slow or networked volume. Level 1
+ * is several times faster than level 9 for only slightly larger files, so is
+ * usually the best choice.
  *
- * In:  Icon family handle;
+ * Out: 1 (fastest) to 9 (smallest).
+\******************************************************************************/
+
+static int pngCompressionLevel( void )
+{
+    static int             level;
+    static dispatch_once_t onceToken;
+
+    dispatch_once( &onceToken, ^{
+
+        NSInteger preference = [ [ NSUserDefaults standardUserDefaults ] integerForKey: @"pngIconCompressionLevel" ];
+
+        level = ( int ) MAX( 1, MIN( 9, preference ) );
+    });
+
+    return level;
+}
+
+/******************************************************************************\
+ * drawImages()
  *
- *      Reference to a Core Graphics image which should be 512x512 pixels in
- *      size (other image sizes will work, but will be inefficient).
+ * Internal - draw the given image at each of the sizes in 'iconTypes'.
+ *
+ * In:  Reference to a Core Graphics image which should be 512x512 pixels in
+ *      size (other image sizes will work, but will be inefficient);
+ *
+ *      Array of ICON_TYPE_COUNT pointers, all NULL, which is filled in with
+ *      malloc'd blocks of premultiplied A, R, G, B pixels, one per entry in
+ *      'iconTypes'. The caller must free() any which are not NULL, even if
+ *      an error is returned.
  *
  * Out: OSStatus indication of error ('noErr' if all goes well).
 \******************************************************************************/
 
-static OSStatus addImages( IconFamilyHandle iconHnd,
-                           CGImageRef       cgImage )
+static OSStatus drawImages( CGImageRef   cgImage,
+                            uint8_t   ** levels )
 {
-    CGColorSpaceRef cgColourSpace = CGColorSpaceCreateDeviceRGB();
-    if ( cgColourSpace == NULL ) return memFullErr;
-
     /* The full set of icons consists of:
      *
      *   512x512 and 256x256 RGBA icons; 128x128, 32x32 and 16x16 icons
@@ -464,202 +684,82 @@ static OSStatus addImages( IconFamilyHandle iconHnd,
      * this under general use and scaling down a 128x128 icon at run-time is
      * a fair bit quicker than scaling down a 512x512 icon.
      *
-     * If the DPI value translation routine seems to be returning updated
-     * values, add in the additional icon size of 1024x1024 for high DPI modes
-     * modes (for 'correctness', the translated value of 512x512 is used, just
-     * in case the translation factor ever differs from multiply-by-two).
-     *
-     * Comment or uncomment lines below to include or exclude sizes. All
-     * relevant colour and mask variations are handled automatically for any
-     * given size out of dpiValue(512), 512, 256, 128, 32 or 16.
+     * The image is drawn once, at 512x512. Each smaller size is then made by
+     * halving the one above it - see "IconPyramid.h" - which is far cheaper
+     * than drawing the image again at every size, and twice for sizes which
+     * need a separate mask. Sizes which aren't in 'iconTypes' (such as 64x64)
+     * are still made, as steps along the way. Edit 'iconTypes' above to
+     * include or exclude sizes.
      */
 
-    OSStatus err = noErr;
-
 //    A bug in OS X 10.13 that seemed to be fixed in 10.14 reappeared in
 //    around Sonoma or Sequoia and this time, it didn't get fixed. Do
-//    not generate the high DPI variant.
+//    not generate the high DPI variant. If this is ever restored, the
+//    1024x1024 image must be drawn separately and the pyramid would
+//    then best start from it rather than from 512x512.
 //
 //    if ( dpiValue( 1 ) != 1 )
 //    {
 //        err = addImage( iconHnd, cgImage, cgColourSpace, dpiValue( 512 ) );
 //    }
 
-    if ( err == noErr ) err = addImage( iconHnd, cgImage, cgColourSpace, 512 );
-
-#ifdef GENERATE_ALL_ICON_SIZES
-    if ( err == noErr ) err = addImage( iconHnd, cgImage, cgColourSpace, 256 );
-#endif
-
-    if ( err == noErr ) err = addImage( iconHnd, cgImage, cgColourSpace, 128 );
-    if ( err == noErr ) err = addImage( iconHnd, cgImage, cgColourSpace,  32 );
+    size_t    size  = iconTypes[ 0 ].size;
+    uint8_t * level = calloc( size * size, 4 );
 
-#ifdef GENERATE_ALL_ICON_SIZES
-    if ( err == noErr ) err = addImage( iconHnd, cgImage, cgColourSpace,  16 );
-#endif
-
-    CFRelease( cgColourSpace );
-    return err;
-}
+    if ( level == NULL ) return memFullErr;
 
-/******************************************************************************\
- * addImage()
- *
- * Internal - to the icon family identified by the given handle, add the
- * given image by painting using the given colour space at the given width.
- * The icon height is set to the same value. Widths of 512, 256, 128, 32 and
- * 16 are supported. Other widths will provoke undefined behaviour.
- *
- * In:  Icon family handle;
- *
- *      Reference to a Core Graphics image which should be 512x512 pixels in
- *      size (other image sizes will work, but will be inefficient);
- *
- *      Reference to a colour space in which to work (usually created via a
- *      call to 'CGColorSpaceCreateDeviceRGB');
- *
- *      Width of icon to add in pixels. Height is set to match. Must be one
- *      value out of 512, 256, 128, 32 or 16.
- *
- * Out: OSStatus indication of error ('noErr' if all goes well).
-\******************************************************************************/
+    CGContextRef    cgContext     = NULL;
+    CGColorSpaceRef cgColourSpace = CGColorSpaceCreateDeviceRGB();
 
-static OSStatus addImage( IconFamilyHandle iconHnd,
-                          CGImageRef       cgImage,
-                          CGColorSpaceRef  cgColourSpace,
-                          size_t           width )
-{
-    OSStatus err = addImageOrMask( iconHnd, cgImage, cgColourSpace, width, NO );
+    if ( cgColourSpace )
+    {
+        cgContext = CGBitmapContextCreate
+        (
+            level,
+            size,
+            size,
+            8,
+            size * 4,
+            cgColourSpace,
+            kCGImageAlphaPremultipliedFirst
+        );
 
-    /* Note that this is a bit inefficient for images that need separate masks
-     * since the source Core Graphics image will be scaled to the same size
-     * twice, once while painting the image and once while painting its mask.
-     */
+        CFRelease( cgColourSpace );
+    }
 
-    if ( err == noErr && width < 256 )
+    if ( cgContext == NULL )
     {
-        addImageOrMask( iconHnd, cgImage, cgColourSpace, width, YES );
+        free( level );
+        return memFullErr;
     }
 
-    return err;
-}
-
-/******************************************************************************\
- * addImageOrMask()
- *
- * Internal - as "addImage", but the caller has control of whether an image or
- * image mask gets added to the icon family for widths of 128, 32 or 16. Widths
- * of 256 or 512 use a merged RGBA mask and image data format so both are
- * always added at the same time.
- *
- * The requested width will be limited so that it does not exceed CANVAS_SIZE.
- *
- * In:  Icon family handle;
- *
- *      Reference to a Core Graphics image which should be 512x512 pixels in
- *      size (other image sizes will work, but will be inefficient);
- *
- *      Reference to a colour space in which to work (usually created via a
- *      call to 'CGColorSpaceCreateDeviceRGB');
- *
- *      Width of icon to add in pixels. Height is set to match. Must be one
- *      value out of 512, 256, 128, 32 or 16, else behaviour is undefined;
- *
- *      YES to add the image mask (only for widths 128, 32 or 16), else NO.
- *      Using YES for other image widths will provoke undefined behaviour.
- *
- * Out: OSStatus indication of error ('noErr' if all goes well).
-\******************************************************************************/
+    CGContextDrawImage( cgContext, CGRectMake( 0, 0, size, size ), cgImage );
+    CFRelease( cgContext );
 
-static OSStatus addImageOrMask( IconFamilyHandle iconHnd,
-                                CGImageRef       cgImage,
-                                CGColorSpaceRef  cgColourSpace,
-                                size_t           width,
-                                Boolean          mask )
-{
-    size_t           pixelSize, dataSize;
-    CGImageAlphaInfo info;
-    OSType           type;
+    levels[ 0 ] = level;
 
-    /* Figure out the various types and sizes needed */
+    /* Halve each size to make the next, keeping only those which are wanted */
 
-    if ( mask == YES )
+    for ( size_t next = 1; next < ICON_TYPE_COUNT; )
     {
-        /* Width of 128, 32 or 16, else undefined results */
+        size_t    half   = size / 2;
+        uint8_t * halved = malloc( half * half * 4 );
+        Boolean   kept   = size == iconTypes[ next - 1 ].size;
 
-        pixelSize = 1;
-        info      = kCGImageAlphaOnly;
-
-        switch( width )
+        if ( halved == NULL || ! iconPyramidHalve( level, size, size, size * 4, halved, half * 4, NULL, NULL ) )
         {
-            default: type = kThumbnail8BitMask; break; /* 128 or unknown */
-            case 32: type = kLarge8BitMask;     break;
-            case 16: type = kSmall8BitMask;     break;
-        }
-    }
-    else
-    {
-        /* Width of 512, 256, 128, 32 or 16, else undefined results */
+            if ( ! kept ) free( level );
+            free( halved );
 
-        pixelSize = 4;
-
-        if ( width >= 256 ) info = kCGImageAlphaPremultipliedFirst;
-        else                info = kCGImageAlphaNoneSkipFirst;
-
-        switch( width )
-        {
-            default:   type = kIconServices512PixelDataARGB;  break; /* 512 or unknown     */
-            case 1024: type = kIconServices1024PixelDataARGB; break; /* OS X 10.7 or later */
-            case 256:  type = kIconServices256PixelDataARGB;  break;
-            case 128:  type = kThumbnail32BitData;            break;
-            case 32:   type = kLarge32BitData;                break;
-            case 16:   type = kSmall32BitData;                break;
+            return memFullErr;
         }
-    }
-
-    NSInteger canvasSize = dpiValue( CANVAS_SIZE );
-    if ( width > canvasSize ) width = canvasSize;
-
-    dataSize = width * width * pixelSize;
 
-    /* Clear the paint buffer and create a context within it */
+        if ( ! kept ) free( level );
+        if ( iconTypes[ next ].size == half ) levels[ next ++ ] = halved;
 
-    UInt32 * paintBuffer = calloc( dataSize, sizeof( UInt32 ) );
-    if ( ! paintBuffer ) return memFullErr;
-
-    CGContextRef cgContext = CGBitmapContextCreate
-    (
-        paintBuffer,
-        width,
-        width,
-        8,
-        width * pixelSize,
-        ( mask == YES ) ? NULL : cgColourSpace,
-        info
-    );
-
-    if ( cgContext == NULL )
-    {
-        free( paintBuffer );
-        return memFullErr;
+        level = halved;
+        size  = half;
     }
 
-    /* Paint the image */
-
-    CGContextDrawImage( cgContext, CGRectMake( 0, 0, width, width ), cgImage );
-    CFRelease( cgContext );
-
-    /* Add it to the icon collection */
-
-    Handle   tmpHnd;
-    OSStatus err;
-
-    err = PtrToHand( paintBuffer, &tmpHnd, dataSize );
-
-    free( paintBuffer );
-    if ( err != noErr ) return err;
-    
-    err = SetIconFamilyData( iconHnd, type, tmpHnd );
-    DisposeHandle( tmpHnd );
-    return err;
+    return noErr;
 }
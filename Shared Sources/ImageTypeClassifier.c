@@ -0,0 +1,480 @@
+/******************************************************************************\
+ * Utilities: ImageTypeClassifier.c
+ *
+ * Fast image and package classification by name. See "ImageTypeClassifier.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ImageTypeClassifier.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #include <CoreServices/CoreServices.h>
+    #include <ImageIO/ImageIO.h>
+    #include <sys/attr.h>
+#endif
+
+/* Longest extension considered, including the terminator; anything longer
+ * can't be in either table.
+ */
+
+#define MAXIMUM_EXTENSION 24
+
+/* Image extensions used where the OS can't supply its own list. Need not be
+ * sorted; the run-time table is sorted when built.
+ */
+
+static const char * const builtInImageExtensions[] =
+{
+    "jpg",  "jpeg", "jpe",  "jfif", "png",  "apng", "gif",  "tif",  "tiff",
+    "bmp",  "dib",  "webp", "heic", "heics","heif", "hif",  "avif", "jp2",
+    "j2k",  "jpf",  "jpx",  "jpm",  "icns", "ico",  "cur",  "psd",  "tga",
+    "exr",  "pict", "pct",  "pic",  "sgi",  "pbm",  "pgm",  "ppm",  "pnm",
+    "dds",  "ktx",  "astc", "xbm",
+
+    /* Camera RAW formats */
+
+    "3fr",  "arw",  "cr2",  "cr3",  "crw",  "dcr",  "dng",  "erf",  "fff",
+    "iiq",  "kdc",  "mos",  "mrw",  "nef",  "nrw",  "orf",  "pef",  "raf",
+    "rw2",  "rwl",  "sr2",  "srf",  "srw",  "x3f"
+};
+
+/* Package extensions. Must be kept sorted for bsearch(). */
+
+static const char * const packageExtensions[] =
+{
+    "aplibrary",
+    "app",
+    "appex",
+    "band",
+    "bundle",
+    "component",
+    "fcpbundle",
+    "framework",
+    "imovielibrary",
+    "kext",
+    "key",
+    "logicx",
+    "mdimporter",
+    "mpkg",
+    "numbers",
+    "pages",
+    "photolibrary",
+    "photoslibrary",
+    "pkg",
+    "playground",
+    "plugin",
+    "prefpane",
+    "qlgenerator",
+    "rtfd",
+    "saver",
+    "scptd",
+    "sparsebundle",
+    "systemextension",
+    "wdgt",
+    "xcodeproj",
+    "xcworkspace",
+    "xpc"
+};
+
+/* The run-time image extension table, built once by buildTable() */
+
+static pthread_once_t   tableOnce  = PTHREAD_ONCE_INIT;
+static char          ** tableNames = NULL;
+static size_t           tableCount = 0;
+static size_t           tableSpace = 0;
+
+/* Local functions */
+
+static void           buildTable       ( void );
+static void           addToTable       ( const char * extension );
+static int            compareNames     ( const void * a, const void * b );
+static ImageTypeClass lowerExtension   ( const char * leafname, char * buffer );
+static bool           inTable          ( const char * const * table, size_t count, const char * extension );
+
+/******************************************************************************\
+ * imageTypeClassifierPrepare()
+ *
+ * Build the extension table. See "ImageTypeClassifier.h" for details.
+\******************************************************************************/
+
+void imageTypeClassifierPrepare( void )
+{
+    ( void ) pthread_once( &tableOnce, buildTable );
+}
+
+/******************************************************************************\
+ * imageTypeClassifyName()
+ *
+ * Classify a leafname by extension. See "ImageTypeClassifier.h" for details.
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyName( const char * leafname )
+{
+    char           extension[ MAXIMUM_EXTENSION ];
+    ImageTypeClass result = lowerExtension( leafname, extension );
+
+    if ( result != imageTypeClassYes ) return result;
+
+    imageTypeClassifierPrepare();
+
+    return inTable( ( const char * const * ) tableNames, tableCount, extension )
+           ? imageTypeClassYes
+           : imageTypeClassNo;
+}
+
+/******************************************************************************\
+ * imageTypeClassifierSniff()
+ *
+ * Look for an image signature. See "ImageTypeClassifier.h" for details.
+\******************************************************************************/
+
+bool imageTypeClassifierSniff( const unsigned char * bytes, size_t length )
+{
+    #define STARTS_WITH( offset, literal )                                  \
+        ( length >= ( offset ) + sizeof( literal ) - 1 &&                   \
+          memcmp( bytes + ( offset ), literal, sizeof( literal ) - 1 ) == 0 )
+
+    if ( STARTS_WITH( 0, "\xFF\xD8\xFF"                         ) ) return true; /* JPEG      */
+    if ( STARTS_WITH( 0, "\x89PNG\r\n\x1A\n"                    ) ) return true; /* PNG       */
+    if ( STARTS_WITH( 0, "GIF87a"                               ) ) return true; /* GIF       */
+    if ( STARTS_WITH( 0, "GIF89a"                               ) ) return true;
+    if ( STARTS_WITH( 0, "II*\0"                                ) ) return true; /* TIFF      */
+    if ( STARTS_WITH( 0, "MM\0*"                                ) ) return true;
+    if ( STARTS_WITH( 0, "8BPS"                                 ) ) return true; /* Photoshop */
+    if ( STARTS_WITH( 0, "icns"                                 ) ) return true; /* ICNS      */
+    if ( STARTS_WITH( 0, "\x76\x2F\x31\x01"                     ) ) return true; /* OpenEXR   */
+    if ( STARTS_WITH( 0, "\0\0\0\x0CjP  \r\n\x87\n"             ) ) return true; /* JPEG 2000 */
+    if ( STARTS_WITH( 0, "\xFF\x4F\xFF\x51"                     ) ) return true; /* J2K code  */
+    if ( STARTS_WITH( 0, "RIFF" ) && STARTS_WITH( 8, "WEBP"     ) ) return true; /* WebP      */
+
+    /* Windows icon: reserved zero, type 1, non-zero image count */
+
+    if ( STARTS_WITH( 0, "\0\0\1\0" ) && length >= 6 && ( bytes[ 4 ] | bytes[ 5 ] ) != 0 ) return true;
+
+    /* BMP: "BM" alone is weak, so also require the reserved words to be zero
+     * and a plausible header size.
+     */
+
+    if (
+           STARTS_WITH( 0, "BM" ) && length >= 18              &&
+           ( bytes[ 6 ] | bytes[ 7 ] | bytes[ 8 ] | bytes[ 9 ] ) == 0 &&
+           bytes[ 14 ] >= 12 && ( bytes[ 15 ] | bytes[ 16 ] | bytes[ 17 ] ) == 0
+       )
+       return true;
+
+    /* ISO base media (HEIF, HEIC, AVIF): "ftyp" box with an image brand */
+
+    if ( STARTS_WITH( 4, "ftyp" ) && length >= 12 )
+    {
+        static const char * const brands[] =
+        {
+            "heic", "heix", "heim", "heis", "hevc", "hevx", "mif1", "msf1", "avif", "avis"
+        };
+
+        for ( size_t index = 0; index < sizeof( brands ) / sizeof( brands[ 0 ] ); index ++ )
+        {
+            if ( memcmp( bytes + 8, brands[ index ], 4 ) == 0 ) return true;
+        }
+    }
+
+    #undef STARTS_WITH
+
+    return false;
+}
+
+/******************************************************************************\
+ * imageTypeClassifierIsImageFile()
+ *
+ * Classify a file as an image. See "ImageTypeClassifier.h" for details.
+\******************************************************************************/
+
+bool imageTypeClassifierIsImageFile( const char * fullPath,
+                                     const char * leafname,
+                                     bool         sniffIfNoExtension )
+{
+    ImageTypeClass result = imageTypeClassifyName( leafname ? leafname : fullPath );
+
+    if ( result != imageTypeClassUnknown ) return result == imageTypeClassYes;
+    if ( sniffIfNoExtension == false     ) return false;
+
+    unsigned char bytes[ IMAGE_TYPE_CLASSIFIER_SNIFF_LENGTH ];
+    ssize_t       length;
+    int           fd;
+
+    /* Follow symbolic links, as FSPathMakeRef() did, so that a link to an
+     * image counts as one; but don't block if it turns out to be a FIFO.
+     */
+
+    fd = open( fullPath, O_RDONLY | O_NONBLOCK );
+
+    if ( fd < 0 ) return false;
+
+    length = read( fd, bytes, sizeof( bytes ) );
+    ( void ) close( fd );
+
+    return length > 0 && imageTypeClassifierSniff( bytes, ( size_t ) length );
+}
+
+/******************************************************************************\
+ * imageTypeClassifyPackageName()
+ *
+ * Classify a directory leafname. See "ImageTypeClassifier.h" for details.
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyPackageName( const char * leafname )
+{
+    char extension[ MAXIMUM_EXTENSION ];
+
+    if ( lowerExtension( leafname, extension ) != imageTypeClassYes ) return imageTypeClassUnknown;
+
+    return inTable
+           (
+               packageExtensions,
+               sizeof( packageExtensions ) / sizeof( packageExtensions[ 0 ] ),
+               extension
+           )
+           ? imageTypeClassYes
+           : imageTypeClassUnknown;
+}
+
+/******************************************************************************\
+ * imageTypeClassifyPackage()
+ *
+ * Classify a directory by name and bundle bit. See "ImageTypeClassifier.h".
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyPackage( const char * fullPath,
+                                         const char * leafname )
+{
+    char           extension[ MAXIMUM_EXTENSION ];
+    ImageTypeClass result = imageTypeClassifyPackageName( leafname ? leafname : fullPath );
+
+    if ( result == imageTypeClassYes ) return result;
+
+    if ( lowerExtension( leafname ? leafname : fullPath, extension ) != imageTypeClassUnknown )
+    {
+        return imageTypeClassUnknown;
+    }
+
+    #ifdef __APPLE__
+
+        /* The Finder flags are the big-endian 16-bit word at offset 8 of a
+         * directory's Finder information; kHasBundle is 0x2000.
+         */
+
+        struct attrlist request = { .bitmapcount = ATTR_BIT_MAP_COUNT,
+                                    .commonattr  = ATTR_CMN_FNDRINFO };
+        struct
+        {
+            uint32_t      length;
+            unsigned char finderInfo[ 32 ];
+
+        } __attribute__( ( aligned( 4 ), packed ) ) reply;
+
+        if ( getattrlist( fullPath, &request, &reply, sizeof( reply ), 0 ) != 0 )
+        {
+            return imageTypeClassUnknown;
+        }
+
+        return ( reply.finderInfo[ 8 ] & 0x20 ) != 0 ? imageTypeClassUnknown : imageTypeClassNo;
+
+    #else
+
+        return imageTypeClassNo;
+
+    #endif
+}
+
+/******************************************************************************\
+ * buildTable()
+ *
+ * Internal - pthread_once() handler which builds the sorted, de-duplicated
+ * image extension table. On macOS this holds the extensions of every image
+ * type ImageIO can read, as isImageFile() used to check per file; the built-in
+ * list is used if that comes up empty or on other systems.
+\******************************************************************************/
+
+static void buildTable( void )
+{
+    #ifdef __APPLE__
+
+        CFArrayRef types = CGImageSourceCopyTypeIdentifiers();
+
+        if ( types != NULL )
+        {
+            CFIndex typeCount = CFArrayGetCount( types );
+
+            for ( CFIndex typeIndex = 0; typeIndex < typeCount; typeIndex ++ )
+            {
+                CFStringRef uti = CFArrayGetValueAtIndex( types, typeIndex );
+
+                /* Make sure the supported UTI conforms to "public.image" to
+                 * skip e.g. PDFs.
+                 */
+
+                if ( ! UTTypeConformsTo( uti, CFSTR( "public.image" ) ) ) continue;
+
+                CFArrayRef tags = UTTypeCopyAllTagsWithClass( uti, kUTTagClassFilenameExtension );
+                if ( tags == NULL ) continue;
+
+                CFIndex tagCount = CFArrayGetCount( tags );
+
+                for ( CFIndex tagIndex = 0; tagIndex < tagCount; tagIndex ++ )
+                {
+                    char extension[ MAXIMUM_EXTENSION ];
+
+                    if (
+                           CFStringGetCString
+                           (
+                               CFArrayGetValueAtIndex( tags, tagIndex ),
+                               extension,
+                               sizeof( extension ),
+                               kCFStringEncodingUTF8
+                           )
+                       )
+                       addToTable( extension );
+                }
+
+                CFRelease( tags );
+            }
+
+            CFRelease( types );
+        }
+
+    #endif
+
+    if ( tableCount == 0 )
+    {
+        for ( size_t index = 0; index < sizeof( builtInImageExtensions ) / sizeof( builtInImageExtensions[ 0 ] ); index ++ )
+        {
+            addToTable( builtInImageExtensions[ index ] );
+        }
+    }
+
+    if ( tableCount == 0 ) return;
+
+    /* Sort, then squeeze out duplicates (e.g. "tif" is listed for more than
+     * one TIFF-based type).
+     */
+
+    qsort( tableNames, tableCount, sizeof( char * ), compareNames );
+
+    size_t kept = 1;
+
+    for ( size_t index = 1; index < tableCount; index ++ )
+    {
+        if ( strcmp( tableNames[ index ], tableNames[ kept - 1 ] ) == 0 )
+        {
+            free( tableNames[ index ] );
+        }
+        else
+        {
+            tableNames[ kept ++ ] = tableNames[ index ];
+        }
+    }
+
+    tableCount = kept;
+}
+
+/******************************************************************************\
+ * addToTable()
+ *
+ * Internal - add a lower-cased copy of an extension to the table being built
+ * by buildTable(). Failures just leave the extension out.
+\******************************************************************************/
+
+static void addToTable( const char * extension )
+{
+    size_t length = strlen( extension );
+
+    if ( length == 0 || length >= MAXIMUM_EXTENSION ) return;
+
+    if ( tableCount == tableSpace )
+    {
+        size_t   space = tableSpace ? tableSpace * 2 : 64;
+        char  ** names = realloc( tableNames, space * sizeof( char * ) );
+
+        if ( names == NULL ) return;
+
+        tableNames = names;
+        tableSpace = space;
+    }
+
+    char * copy = strdup( extension );
+    if ( copy == NULL ) return;
+
+    for ( char * p = copy; *p; p ++ )
+    {
+        if ( *p >= 'A' && *p <= 'Z' ) *p += 'a' - 'A';
+    }
+
+    tableNames[ tableCount ++ ] = copy;
+}
+
+/******************************************************************************\
+ * compareNames()
+ *
+ * Internal - qsort() comparator for an array of C string pointers.
+\******************************************************************************/
+
+static int compareNames( const void * a, const void * b )
+{
+    return strcmp( *( const char * const * ) a, *( const char * const * ) b );
+}
+
+/******************************************************************************\
+ * lowerExtension()
+ *
+ * Internal - find the extension of a leafname or path and copy it in lower
+ * case into the given MAXIMUM_EXTENSION byte buffer.
+ *
+ * Out: imageTypeClassUnknown if there is no extension; imageTypeClassNo if
+ *      there is one but it is empty, too long or not plain ASCII, so can't
+ *      be in any table; else imageTypeClassYes with the buffer filled in.
+\******************************************************************************/
+
+static ImageTypeClass lowerExtension( const char * leafname, char * buffer )
+{
+    const char * slash = strrchr( leafname, '/' );
+    if ( slash != NULL ) leafname = slash + 1;
+
+    const char * dot = strrchr( leafname, '.' );
+    if ( dot == NULL || dot == leafname ) return imageTypeClassUnknown;
+
+    size_t length = 0;
+
+    for ( const char * p = dot + 1; *p; p ++ )
+    {
+        char c = *p;
+
+        if ( length + 1 >= MAXIMUM_EXTENSION || ( c & 0x80 ) != 0 ) return imageTypeClassNo;
+        if ( c >= 'A' && c <= 'Z' ) c += 'a' - 'A';
+
+        buffer[ length ++ ] = c;
+    }
+
+    buffer[ length ] = '\0';
+
+    return length > 0 ? imageTypeClassYes : imageTypeClassNo;
+}
+
+/******************************************************************************\
+ * inTable()
+ *
+ * Internal - binary search a sorted table of lower case extensions.
+\******************************************************************************/
+
+static bool inTable( const char * const * table, size_t count, const char * extension )
+{
+    if ( count == 0 ) return false;
+
+    return bsearch( &extension, table, count, sizeof( char * ), compareNames ) != NULL;
+}
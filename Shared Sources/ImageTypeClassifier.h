@@ -0,0 +1,137 @@
+/******************************************************************************\
+ * Utilities: ImageTypeClassifier.h
+ *
+ * Fast classification of files as images, or of directories as packages,
+ * from their leafnames alone where possible. A sorted table of known image
+ * filename extensions is built once per process and then searched with a
+ * binary chop, so classifying a file costs a few string comparisons rather
+ * than a LaunchServices round trip and a fresh ImageIO type list per file.
+ *
+ * On macOS the table is seeded from the extensions of every type which
+ * ImageIO can read and which conforms to "public.image", so it tracks the
+ * host OS; elsewhere a built-in list of common extensions is used. Files with
+ * no extension at all can optionally be "sniffed" by reading the first few
+ * bytes and looking for well-known image format signatures.
+ *
+ * This is plain C. All functions are thread-safe.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef IMAGE_TYPE_CLASSIFIER_H
+#define IMAGE_TYPE_CLASSIFIER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of leading bytes which imageTypeClassifierSniff() wants to see */
+
+#define IMAGE_TYPE_CLASSIFIER_SNIFF_LENGTH 32
+
+typedef enum ImageTypeClass
+{
+    imageTypeClassUnknown = 0, /* No extension; the name alone can't tell */
+    imageTypeClassYes,
+    imageTypeClassNo
+
+} ImageTypeClass;
+
+/******************************************************************************\
+ * imageTypeClassifierPrepare()
+ *
+ * Build the extension table. This happens automatically on first use, but
+ * calling this early (e.g. at application startup) keeps the one-off cost of
+ * asking ImageIO for its supported types out of the first folder scan.
+\******************************************************************************/
+
+void imageTypeClassifierPrepare( void );
+
+/******************************************************************************\
+ * imageTypeClassifyName()
+ *
+ * Classify a leafname as an image, or not, by its filename extension. Case
+ * is ignored. A leading "." (as in ".hidden") does not start an extension.
+ *
+ * In:  NUL terminated leafname (a full path is also acceptable).
+ *
+ * Out: imageTypeClassYes or imageTypeClassNo if the name has an extension,
+ *      else imageTypeClassUnknown.
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyName( const char * leafname );
+
+/******************************************************************************\
+ * imageTypeClassifierSniff()
+ *
+ * Look for a well-known image format signature at the start of some file data
+ * (JPEG, PNG, GIF, TIFF, BMP, WebP, HEIF/AVIF, JPEG 2000, ICNS, Photoshop,
+ * OpenEXR or Windows icon).
+ *
+ * In:  Pointer to the first bytes of the file;
+ *
+ *      Number of bytes available, ideally IMAGE_TYPE_CLASSIFIER_SNIFF_LENGTH.
+ *
+ * Out: true if a signature was recognised, else false.
+\******************************************************************************/
+
+bool imageTypeClassifierSniff( const unsigned char * bytes, size_t length );
+
+/******************************************************************************\
+ * imageTypeClassifierIsImageFile()
+ *
+ * Classify a file as an image by its extension or, if it has none and the
+ * caller allows it, by sniffing its contents.
+ *
+ * In:  Full POSIX path of the file;
+ *
+ *      Its leafname, or NULL to have it found from the full path;
+ *
+ *      true to sniff the contents of files with no extension, else false
+ *      (such files are then never considered to be images).
+ *
+ * Out: true if the file looks like an image, else false. The file data may
+ *      still turn out to be corrupt if it is eventually loaded.
+\******************************************************************************/
+
+bool imageTypeClassifierIsImageFile( const char * fullPath,
+                                     const char * leafname,
+                                     bool         sniffIfNoExtension );
+
+/******************************************************************************\
+ * imageTypeClassifyPackageName()
+ *
+ * Classify a directory leafname as a package (application, bundle, document
+ * package and so-on) by its extension, where that is conclusive.
+ *
+ * In:  NUL terminated leafname (a full path is also acceptable).
+ *
+ * Out: imageTypeClassYes if the extension is that of a well-known package
+ *      type, else imageTypeClassUnknown, meaning only LaunchServices can tell.
+ *      A name never proves that a directory is *not* a package; a folder with
+ *      no extension at all is still a package if its bundle bit is set.
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyPackageName( const char * leafname );
+
+/******************************************************************************\
+ * imageTypeClassifyPackage()
+ *
+ * As imageTypeClassifyPackageName(), but for a directory with no extension,
+ * look at its Finder bundle bit. If that is clear, LaunchServices would not
+ * consider the directory a package either, so it can be ruled out with one
+ * attribute read instead of a LaunchServices round trip.
+ *
+ * In:  Full POSIX path of the directory (symbolic links are followed);
+ *
+ *      Its leafname, or NULL to have it found from the full path.
+ *
+ * Out: imageTypeClassYes for a well-known package extension; imageTypeClassNo
+ *      for a directory with no extension and no bundle bit (on systems with
+ *      no Finder information, any directory with no extension); otherwise
+ *      imageTypeClassUnknown, meaning only LaunchServices can tell.
+\******************************************************************************/
+
+ImageTypeClass imageTypeClassifyPackage( const char * fullPath,
+                                         const char * leafname );
+
+#endif /* IMAGE_TYPE_CLASSIFIER_H */
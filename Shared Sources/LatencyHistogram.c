@@ -0,0 +1,137 @@
+/******************************************************************************\
+ * Utilities: LatencyHistogram.c
+ *
+ * Fixed-size histogram of latencies. See "LatencyHistogram.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "LatencyHistogram.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+static unsigned int bucketFor        ( uint64_t microseconds );
+static uint64_t     bucketUpperBound ( unsigned int bucket );
+
+/******************************************************************************\
+ * latencyHistogramRecord()
+ *
+ * Record one latency. See "LatencyHistogram.h".
+\******************************************************************************/
+
+void latencyHistogramRecord( LatencyHistogram * histogram, uint64_t microseconds )
+{
+    __atomic_fetch_add( &histogram->counts[ bucketFor( microseconds ) ], 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &histogram->count,                               1, __ATOMIC_RELAXED );
+
+    uint64_t maximum = __atomic_load_n( &histogram->maximum, __ATOMIC_RELAXED );
+
+    while ( microseconds > maximum &&
+            ! __atomic_compare_exchange_n( &histogram->maximum, &maximum, microseconds, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+/******************************************************************************\
+ * latencyHistogramReset()
+ *
+ * Empty a histogram. See "LatencyHistogram.h".
+\******************************************************************************/
+
+void latencyHistogramReset( LatencyHistogram * histogram )
+{
+    for ( unsigned int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket ++ )
+    {
+        __atomic_store_n( &histogram->counts[ bucket ], 0, __ATOMIC_RELAXED );
+    }
+
+    __atomic_store_n( &histogram->count,   0, __ATOMIC_RELAXED );
+    __atomic_store_n( &histogram->maximum, 0, __ATOMIC_RELAXED );
+}
+
+/******************************************************************************\
+ * latencyHistogramCopy()
+ *
+ * Take a snapshot of a histogram. See "LatencyHistogram.h".
+\******************************************************************************/
+
+void latencyHistogramCopy( LatencyHistogram * copy, const LatencyHistogram * histogram )
+{
+    uint64_t count = 0;
+
+    for ( unsigned int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket ++ )
+    {
+        copy->counts[ bucket ] = __atomic_load_n( &histogram->counts[ bucket ], __ATOMIC_RELAXED );
+        count                 += copy->counts[ bucket ];
+    }
+
+    /* Count from the buckets, so that the copy is consistent with itself */
+
+    copy->count   = count;
+    copy->maximum = __atomic_load_n( &histogram->maximum, __ATOMIC_RELAXED );
+}
+
+/******************************************************************************\
+ * latencyHistogramPercentile()
+ *
+ * Find a percentile. See "LatencyHistogram.h".
+\******************************************************************************/
+
+uint64_t latencyHistogramPercentile( const LatencyHistogram * histogram, double percentage )
+{
+    if ( histogram->count == 0 ) return 0;
+
+    uint64_t wanted = ( uint64_t ) ceil( histogram->count * percentage / 100.0 );
+    uint64_t seen   = 0;
+
+    if ( wanted < 1                ) wanted = 1;
+    if ( wanted > histogram->count ) wanted = histogram->count;
+
+    for ( unsigned int bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket ++ )
+    {
+        seen += histogram->counts[ bucket ];
+
+        if ( seen >= wanted )
+        {
+            uint64_t bound = bucketUpperBound( bucket );
+            return bound < histogram->maximum ? bound : histogram->maximum;
+        }
+    }
+
+    return histogram->maximum;
+}
+
+/******************************************************************************\
+ * bucketFor()
+ *
+ * Internal - return the bucket for a latency. Latencies below 4us have a
+ * bucket each; above that, each power of two range from 2^e to 2^(e+1) - 1
+ * is split into four equal buckets, numbered on from 4 * (e - 1).
+\******************************************************************************/
+
+static unsigned int bucketFor( uint64_t microseconds )
+{
+    if ( microseconds < 4 ) return ( unsigned int ) microseconds;
+
+    unsigned int exponent = 63 - ( unsigned int ) __builtin_clzll( microseconds );
+    unsigned int quarter  = ( unsigned int ) ( microseconds >> ( exponent - 2 ) ) & 3;
+    unsigned int bucket   = 4 * ( exponent - 1 ) + quarter;
+
+    return bucket < LATENCY_HISTOGRAM_BUCKETS ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+/******************************************************************************\
+ * bucketUpperBound()
+ *
+ * Internal - return the largest latency which goes into the given bucket.
+\******************************************************************************/
+
+static uint64_t bucketUpperBound( unsigned int bucket )
+{
+    if ( bucket < 4 ) return bucket;
+
+    unsigned int exponent = bucket / 4 + 1;
+    uint64_t     quarter  = bucket % 4;
+    uint64_t     width    = 1ULL << ( exponent - 2 );
+
+    return ( 4 + quarter ) * width + width - 1;
+}
@@ -0,0 +1,89 @@
+/******************************************************************************\
+ * Utilities: LatencyHistogram.h
+ *
+ * Fixed-size histogram of latencies in microseconds, from which percentiles
+ * can be read. Buckets are spaced logarithmically, four to each power of two,
+ * so any percentile is reported to within 25% (rounded up) from a single
+ * microsecond to over a minute, in a structure of fixed size that never
+ * allocates.
+ *
+ * Recording is lock-free, so many threads can record into one histogram at
+ * once. Reading a histogram while it is being recorded into gives a snapshot
+ * which may be very slightly out of date, which is good enough for reporting.
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Number of buckets. Latencies beyond the last bucket's range (about 67
+ * seconds) are counted in the last bucket.
+ */
+
+#define LATENCY_HISTOGRAM_BUCKETS 100
+
+/* Fill with zeros to initialise */
+
+typedef struct LatencyHistogram
+{
+    uint64_t counts[ LATENCY_HISTOGRAM_BUCKETS ];
+    uint64_t count;   /* Total recorded */
+    uint64_t maximum; /* Largest recorded */
+
+} LatencyHistogram;
+
+/******************************************************************************\
+ * latencyHistogramRecord()
+ *
+ * Record one latency.
+ *
+ * In:  Histogram;
+ *
+ *      Latency in microseconds.
+\******************************************************************************/
+
+void latencyHistogramRecord( LatencyHistogram * histogram, uint64_t microseconds );
+
+/******************************************************************************\
+ * latencyHistogramReset()
+ *
+ * Empty a histogram, which may be being recorded into.
+ *
+ * In:  Histogram.
+\******************************************************************************/
+
+void latencyHistogramReset( LatencyHistogram * histogram );
+
+/******************************************************************************\
+ * latencyHistogramCopy()
+ *
+ * Take a snapshot of a histogram which may be being recorded into.
+ *
+ * In:  Histogram to copy into;
+ *
+ *      Histogram to copy.
+\******************************************************************************/
+
+void latencyHistogramCopy( LatencyHistogram * copy, const LatencyHistogram * histogram );
+
+/******************************************************************************\
+ * latencyHistogramPercentile()
+ *
+ * Find the latency which the given percentage of recorded latencies are no
+ * greater than.
+ *
+ * In:  Histogram;
+ *
+ *      Percentage, from 0 to 100 (e.g. 99 for the 99th percentile).
+ *
+ * Out: Upper bound in microseconds of the bucket holding that percentile,
+ *      but no more than the largest recorded; 0 if nothing was recorded.
+\******************************************************************************/
+
+uint64_t latencyHistogramPercentile( const LatencyHistogram * histogram, double percentage );
+
+#endif /* LATENCY_HISTOGRAM_H */
@@ -0,0 +1,254 @@
+/******************************************************************************\
+ * Utilities: MemoryGovernor.c
+ *
+ * Process-wide memory budget for image work. See "MemoryGovernor.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "MemoryGovernor.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+/* Governor state, all protected by 'lock'. Each kind has its own queue of
+ * waiters per priority class, each served strictly in ticket order; a decode
+ * waiting behind a large composition would otherwise hold up the icons which
+ * that composition is waiting for. A queue is only served while those of
+ * higher priority for the same kind are empty.
+ */
+
+static pthread_mutex_t          lock                                                         = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           changed[ memoryGovernorKindCount ]                           = { PTHREAD_COND_INITIALIZER,
+                                                                                                 PTHREAD_COND_INITIALIZER };
+static uint64_t                 nextTicket   [ memoryGovernorKindCount ][ memoryGovernorPriorityCount ];
+static uint64_t                 servingTicket[ memoryGovernorKindCount ][ memoryGovernorPriorityCount ];
+static MemoryGovernorStatistics state;
+
+static bool fits          ( MemoryGovernorKind kind, size_t bytes, bool * oversized );
+static bool waitingAbove  ( MemoryGovernorKind kind, MemoryGovernorPriority priority );
+static void wakeAllLocked ( void );
+
+/******************************************************************************\
+ * memoryGovernorSetBudget()
+ *
+ * Set the total number of bytes which may be reserved at once. See
+ * "MemoryGovernor.h" for details.
+\******************************************************************************/
+
+void memoryGovernorSetBudget( size_t budget )
+{
+    pthread_mutex_lock( &lock );
+
+    state.budget = budget;
+    wakeAllLocked();
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * memoryGovernorReserve()
+ *
+ * Reserve memory at bulk priority, waiting until it's available. See
+ * "MemoryGovernor.h".
+\******************************************************************************/
+
+void memoryGovernorReserve( MemoryGovernorKind kind, size_t bytes )
+{
+    memoryGovernorReserveWithPriority( kind, memoryGovernorPriorityBulk, bytes );
+}
+
+/******************************************************************************\
+ * memoryGovernorReserveWithPriority()
+ *
+ * Reserve memory at a given priority, waiting until it's available. See
+ * "MemoryGovernor.h".
+\******************************************************************************/
+
+void memoryGovernorReserveWithPriority( MemoryGovernorKind     kind,
+                                        MemoryGovernorPriority priority,
+                                        size_t                 bytes )
+{
+    if ( bytes == 0 ) return;
+
+    pthread_mutex_lock( &lock );
+
+    uint64_t ticket    = nextTicket[ kind ][ priority ] ++;
+    bool     waited    = false;
+    bool     oversized = false;
+    bool     jumped    = false;
+
+    /* Note whether lower priority waiters are queued now, rather than once
+     * granted, when they may have been served in the meantime.
+     */
+
+    for ( int lower = priority + 1; lower < memoryGovernorPriorityCount; lower ++ )
+    {
+        if ( nextTicket[ kind ][ lower ] != servingTicket[ kind ][ lower ] ) jumped = true;
+    }
+
+    while ( ticket != servingTicket[ kind ][ priority ] ||
+            waitingAbove( kind, priority )            ||
+            ! fits( kind, bytes, &oversized ) )
+    {
+        waited = true;
+        pthread_cond_wait( &changed[ kind ], &lock );
+    }
+
+    /* Let the next waiter of this kind check whether it fits too */
+
+    servingTicket[ kind ][ priority ] ++;
+    pthread_cond_broadcast( &changed[ kind ] );
+
+    state.reservedByKind[ kind ] += bytes;
+    state.reserved               += bytes;
+    state.reservations           ++;
+
+    if ( waited    ) state.waits     ++;
+    if ( oversized ) state.oversized ++;
+    if ( jumped    ) state.jumps     ++;
+
+    if ( state.reserved > state.peak ) state.peak = state.reserved;
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * memoryGovernorRelease()
+ *
+ * Release reserved memory. See "MemoryGovernor.h".
+\******************************************************************************/
+
+void memoryGovernorRelease( MemoryGovernorKind kind, size_t bytes )
+{
+    if ( bytes == 0 ) return;
+
+    pthread_mutex_lock( &lock );
+
+    state.reservedByKind[ kind ] -= bytes;
+    state.reserved               -= bytes;
+
+    /* Compositions are limited by the total as well as by their own share,
+     * so a release of either kind can let either kind proceed.
+     */
+
+    wakeAllLocked();
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * memoryGovernorGetStatistics()
+ *
+ * Read the governor's figures. See "MemoryGovernor.h".
+\******************************************************************************/
+
+void memoryGovernorGetStatistics( MemoryGovernorStatistics * statistics )
+{
+    pthread_mutex_lock( &lock );
+    *statistics = state;
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * memoryGovernorImageBytes()
+ *
+ * Estimate a 32-bit-per-pixel bitmap's size. See "MemoryGovernor.h".
+\******************************************************************************/
+
+size_t memoryGovernorImageBytes( double width, double height )
+{
+    if ( ! ( width > 0 ) || ! ( height > 0 ) ) return 0;
+
+    double bytes = ceil( width ) * ceil( height ) * 4;
+
+    return bytes >= ( double ) SIZE_MAX ? SIZE_MAX : ( size_t ) bytes;
+}
+
+/******************************************************************************\
+ * fits()
+ *
+ * Can a reservation be granted now? Call with the lock held.
+ *
+ * In:  Kind of reservation;
+ *
+ *      Number of bytes;
+ *
+ *      Pointer to a bool set to true if the reservation is only granted
+ *      because it can run on its own, else left alone.
+ *
+ * Out: true if the reservation can be granted, else false.
+\******************************************************************************/
+
+static bool fits( MemoryGovernorKind kind, size_t bytes, bool * oversized )
+{
+    if ( state.budget == 0 ) return true;
+
+    size_t allowance = state.budget;
+
+    if ( kind == memoryGovernorComposition )
+    {
+        allowance = ( size_t ) ( state.budget * MEMORY_GOVERNOR_COMPOSITION_SHARE );
+    }
+
+    size_t ofKind = state.reservedByKind[ kind ];
+
+    if ( bytes <= allowance    - ofKind         && ofKind         <= allowance    &&
+         bytes <= state.budget - state.reserved && state.reserved <= state.budget )
+    {
+        return true;
+    }
+
+    /* Too big to fit alongside what's there; grant it anyway if it needn't
+     * share. A decode needs no other decode held (compositions only wait on
+     * decodes, so those will finish regardless); a composition, nothing at
+     * all - its decodes will still need room.
+     */
+
+    if ( ofKind == 0 && ( kind == memoryGovernorDecode || state.reserved == 0 ) )
+    {
+        *oversized = true;
+        return true;
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * waitingAbove()
+ *
+ * Are reservations of a kind waiting at higher priority than that given?
+ * Call with the lock held.
+ *
+ * In:  Kind of reservation;
+ *
+ *      Priority class.
+ *
+ * Out: true if any are waiting, else false.
+\******************************************************************************/
+
+static bool waitingAbove( MemoryGovernorKind kind, MemoryGovernorPriority priority )
+{
+    for ( int higher = 0; higher < ( int ) priority; higher ++ )
+    {
+        if ( nextTicket[ kind ][ higher ] != servingTicket[ kind ][ higher ] ) return true;
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * wakeAllLocked()
+ *
+ * Wake every waiter of every kind to re-check its reservation. Call with the
+ * lock held.
+\******************************************************************************/
+
+static void wakeAllLocked( void )
+{
+    for ( int kind = 0; kind < memoryGovernorKindCount; kind ++ )
+    {
+        pthread_cond_broadcast( &changed[ kind ] );
+    }
+}
@@ -0,0 +1,159 @@
+/******************************************************************************\
+ * Utilities: MemoryGovernor.h
+ *
+ * Process-wide budget for the memory used by image decoding and icon drawing.
+ * Before making a big allocation - a decoded image, a bitmap context, a layer
+ * - code reserves its estimated size here and releases it once the memory is
+ * freed. A reservation which would take the total over budget waits until
+ * enough has been released. With many folders processed at once this keeps
+ * the total bounded, instead of every thread decoding large images together
+ * and pushing the machine into swap.
+ *
+ * Reservations come in two kinds so that waiting can never deadlock:
+ *
+ * - Composition reservations cover the drawing of a whole icon (its canvas
+ *   and any layers) and may be held while images are decoded. Between them
+ *   these may only hold part of the budget - MEMORY_GOVERNOR_COMPOSITION_SHARE.
+ *
+ * - Decode reservations are held only while a single image is decoded and
+ *   drawn into a thumbnail. Code holding one must never wait for another.
+ *
+ * A request bigger than its allowance would otherwise wait forever, so it is
+ * granted regardless once it can run on its own - a decode when no other
+ * decode is held, a composition when nothing at all is held. A huge image is
+ * charged in full and simply excludes everything else of its kind while it's
+ * decoded. Waiters of each kind are served in order of arrival, so big
+ * requests aren't starved by a stream of small ones - except that
+ * reservations made for interactive work, such as previews someone is
+ * looking at, go ahead of any waiting for bulk work of the same kind. Bulk
+ * waiters are then held back only while interactive ones are waiting.
+ *
+ * This is plain C with no Cocoa dependencies. All functions are thread-safe.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fraction of the budget which composition reservations may hold in total */
+
+#define MEMORY_GOVERNOR_COMPOSITION_SHARE 0.5
+
+typedef enum MemoryGovernorKind
+{
+    memoryGovernorComposition = 0,
+    memoryGovernorDecode,
+
+    memoryGovernorKindCount
+
+} MemoryGovernorKind;
+
+/* Priority classes, highest first */
+
+typedef enum MemoryGovernorPriority
+{
+    memoryGovernorPriorityInteractive = 0,
+    memoryGovernorPriorityBulk,
+
+    memoryGovernorPriorityCount
+
+} MemoryGovernorPriority;
+
+typedef struct MemoryGovernorStatistics
+{
+    size_t   budget;       /* 0 if unlimited                      */
+    size_t   reserved;     /* Now, of both kinds                  */
+    size_t   peak;         /* Highest 'reserved' value seen       */
+    size_t   reservedByKind[ memoryGovernorKindCount ];
+    uint64_t reservations;
+    uint64_t waits;        /* Reservations which had to wait      */
+    uint64_t jumps;        /* Went ahead of bulk ones waiting     */
+    uint64_t oversized;    /* Granted alone, over their allowance */
+
+} MemoryGovernorStatistics;
+
+/******************************************************************************\
+ * memoryGovernorSetBudget()
+ *
+ * Set the total number of bytes which may be reserved at once. Until this is
+ * called, or after it is called with 0, the budget is unlimited; reservations
+ * never wait but are still counted. Any waiting reservations are re-checked
+ * against the new budget.
+ *
+ * In:  Budget in bytes, or 0 for no limit.
+\******************************************************************************/
+
+void memoryGovernorSetBudget( size_t budget );
+
+/******************************************************************************\
+ * memoryGovernorReserve()
+ *
+ * Reserve memory, waiting until it's available if need be. Every reservation
+ * must be matched by a call to memoryGovernorRelease() with the same kind and
+ * byte count.
+ *
+ * In:  Kind of reservation (see above);
+ *
+ *      Number of bytes to reserve; 0 returns immediately.
+\******************************************************************************/
+
+void memoryGovernorReserve( MemoryGovernorKind kind, size_t bytes );
+
+/******************************************************************************\
+ * memoryGovernorReserveWithPriority()
+ *
+ * As memoryGovernorReserve(), which reserves at bulk priority, but at the
+ * given priority. Release as usual.
+ *
+ * In:  Kind of reservation;
+ *
+ *      Priority class;
+ *
+ *      Number of bytes to reserve; 0 returns immediately.
+\******************************************************************************/
+
+void memoryGovernorReserveWithPriority( MemoryGovernorKind     kind,
+                                        MemoryGovernorPriority priority,
+                                        size_t                 bytes );
+
+/******************************************************************************\
+ * memoryGovernorRelease()
+ *
+ * Release memory reserved by memoryGovernorReserve(), waking any reservations
+ * which now fit.
+ *
+ * In:  Kind of reservation, as given to memoryGovernorReserve();
+ *
+ *      Number of bytes, as given to memoryGovernorReserve().
+\******************************************************************************/
+
+void memoryGovernorRelease( MemoryGovernorKind kind, size_t bytes );
+
+/******************************************************************************\
+ * memoryGovernorGetStatistics()
+ *
+ * Read the current budget, reservation and peak figures, for monitoring.
+ *
+ * In:  Pointer to a structure to fill in.
+\******************************************************************************/
+
+void memoryGovernorGetStatistics( MemoryGovernorStatistics * statistics );
+
+/******************************************************************************\
+ * memoryGovernorImageBytes()
+ *
+ * Estimate the memory needed for a 32-bit-per-pixel bitmap, for use as a
+ * reservation size. Non-integral sizes are rounded up.
+ *
+ * In:  Width and height in pixels.
+ *
+ * Out: Estimated size in bytes, saturating at SIZE_MAX.
+\******************************************************************************/
+
+size_t memoryGovernorImageBytes( double width, double height );
+
+#endif /* MEMORY_GOVERNOR_H */
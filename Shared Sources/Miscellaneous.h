@@ -42,6 +42,10 @@ CF_IMPLICIT_BRIDGING_DISABLED
  * kind of directory, else the NO return value is ambiguous (could be a file
  * or a folder with no package-like behaviour).
  *
+ * Leafnames with a well known package extension (e.g. ".app"), or with no
+ * extension at all, are classified by name alone; LaunchServices is only
+ * asked about anything else.
+ *
  * In:  Full POSIX path of file of interest.
  *
  * Out: YES if the directory has package-like behaviour, NO if it is just a
@@ -54,15 +58,16 @@ Boolean isLikeAPackage( NSString * fullPosixPath );
  * isImageFile()
  *
  * Pass a fully specified POSIX-style file path. Returns YES if the path
- * points to a recognised image file, else NO. Adpted from:
- *
- *   http://developer.apple.com/qa/qa2007/qa1518.html
+ * points to a recognised image file, else NO. Classification is by filename
+ * extension against the table of types ImageIO can read, built once by
+ * "ImageTypeClassifier.h"; files with no extension are sniffed for known
+ * image signatures if SNIFF_EXTENSIONLESS_IMAGES says so.
  *
  * In:  Full POSIX path of file of interest.
  *
- * Out: YES if the file is an image which the OS can display, else NO. This is
- *      based purely on the file UTI; the actual file data may turn out to be
- *      corrupt in some way if it is eventually loaded.
+ * Out: YES if the file is an image which the OS can display, else NO. The
+ *      actual file data may turn out to be corrupt in some way if it is
+ *      eventually loaded.
 \******************************************************************************/
 
 Boolean isImageFile( NSString * fullPosixPath );
@@ -7,6 +7,8 @@
 \******************************************************************************/
 
 #import "Miscellaneous.h"
+#import "GlobalConstants.h" /* For SNIFF_EXTENSIONLESS_IMAGES only */
+#import "ImageTypeClassifier.h"
 
 /******************************************************************************\
  * getUti()
@@ -50,6 +52,10 @@ CFStringRef getUti( FSRef * fsRef )
  * kind of directory, else the NO return value is ambiguous (could be a file
  * or a folder with no package-like behaviour).
  *
+ * Leafnames with a well known package extension (e.g. ".app") are classified
+ * by name alone, and directories with no extension and no bundle bit are
+ * ruled out without further ado; LaunchServices is asked about anything else.
+ *
  * In:  Full POSIX path of file of interest.
  *
  * Out: YES if the directory has package-like behaviour, NO if it is just a
@@ -58,19 +64,19 @@ CFStringRef getUti( FSRef * fsRef )
 
 Boolean isLikeAPackage( NSString * fullPosixPath )
 {
-    Boolean isLikeAPackage = NO;
-    FSRef   fileRef;
-    Boolean isDirectory;
-
-    if (
-           FSPathMakeRef
-           (
-               ( const UInt8 * ) [ fullPosixPath fileSystemRepresentation ],
-               &fileRef,
-               &isDirectory
-           )
-           == noErr
-       )
+    Boolean        isLikeAPackage = NO;
+    FSRef          fileRef;
+    Boolean        isDirectory;
+    const char   * path           = [ fullPosixPath fileSystemRepresentation ];
+    ImageTypeClass quick          = imageTypeClassifyPackage( path, NULL );
+
+    /* Well known package extensions, or a plain directory with neither an
+     * extension nor a bundle bit, settle the matter without LaunchServices.
+     */
+
+    if ( quick != imageTypeClassUnknown ) return quick == imageTypeClassYes;
+
+    if ( FSPathMakeRef( ( const UInt8 * ) path, &fileRef, &isDirectory ) == noErr )
     {
         LSItemInfoRecord info;
 
@@ -100,69 +106,26 @@ Boolean isLikeAPackage( NSString * fullPosixPath )
  * isImageFile()
  *
  * Pass a fully specified POSIX-style file path. Returns YES if the path
- * points to a recognised image file, else NO. Adpted from:
- *
- *   http://developer.apple.com/qa/qa2007/qa1518.html
+ * points to a recognised image file, else NO. Classification is by filename
+ * extension against the table of types ImageIO can read, built once by
+ * "ImageTypeClassifier.h"; files with no extension are sniffed for known
+ * image signatures if SNIFF_EXTENSIONLESS_IMAGES says so.
  *
  * In:  Full POSIX path of file of interest.
  *
- * Out: YES if the file is an image which the OS can display, else NO. This is
- *      based purely on the file UTI; the actual file data may turn out to be
- *      corrupt in some way if it is eventually loaded.
+ * Out: YES if the file is an image which the OS can display, else NO. The
+ *      actual file data may turn out to be corrupt in some way if it is
+ *      eventually loaded.
 \******************************************************************************/
 
 Boolean isImageFile( NSString * fullPosixPath )
 {
-    Boolean isImageFile = NO;
-    FSRef   fileRef;
-    Boolean isDirectory;
-
-    if (
-           FSPathMakeRef
-           (
-               ( const UInt8 * ) [ fullPosixPath fileSystemRepresentation ],
-               &fileRef,
-               &isDirectory
-           )
-           == noErr
-       )
-    {
-        CFStringRef uti = getUti( &fileRef );
-
-        if ( uti != NULL )
-        {
-            CFArrayRef supportedTypes = CGImageSourceCopyTypeIdentifiers();
-            CFIndex    typeCount      = CFArrayGetCount( supportedTypes );
-            CFIndex    i;
-
-            for ( i = 0; i < typeCount; i++ )
-            {
-                CFStringRef supportedUTI = CFArrayGetValueAtIndex
-                (
-                    supportedTypes,
-                    i
-                );
-
-                /* Make sure the supported UTI conforms only to
-                 * "public.image" to skip e.g. PDFs.
-                 */
-
-                if ( UTTypeConformsTo( supportedUTI, CFSTR( "public.image" ) ) )
-                {
-                    if ( UTTypeConformsTo( uti, supportedUTI ) )
-                    {
-                        isImageFile = YES;
-                        break;
-                    }
-                }
-            }
-
-            CFRelease( supportedTypes );
-            CFRelease( uti            );
-        }
-    }
-
-    return isImageFile;
+    return imageTypeClassifierIsImageFile
+    (
+        [ fullPosixPath fileSystemRepresentation ],
+        NULL,
+        SNIFF_EXTENSIONLESS_IMAGES
+    );
 }
 
 /******************************************************************************\
@@ -0,0 +1,344 @@
+/******************************************************************************\
+ * Utilities: PngEncoder.c
+ *
+ * Compress an image to a PNG file in memory. See "PngEncoder.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "PngEncoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/* PNG framing: the file signature, then chunks, each a big-endian length,
+ * four character type, data and CRC of the type and data.
+ */
+
+#define SIGNATURE_SIZE  8
+#define CHUNK_OVERHEAD  12
+#define IHDR_SIZE       13
+
+/* Bytes per pixel and the PNG row filter types */
+
+#define BPP             4
+
+enum { FilterNone, FilterSub, FilterUp, FilterAverage, FilterPaeth, FilterCount };
+
+/* Static function prototypes */
+
+static void      unpremultiplyRow ( uint8_t       * rgba,
+                                    const uint8_t * argb,
+                                    size_t          width );
+
+static void      filterRow        ( uint8_t       * filtered,
+                                    const uint8_t * row,
+                                    const uint8_t * above,
+                                    size_t          count,
+                                    int             filter );
+
+static uint8_t   paeth            ( uint8_t         a,
+                                    uint8_t         b,
+                                    uint8_t         c );
+
+static uint8_t * putChunk         ( uint8_t       * out,
+                                    const char    * type,
+                                    size_t          dataSize );
+
+static void      putBigEndian     ( uint8_t       * bytes,
+                                    uint32_t        value );
+
+/******************************************************************************\
+ * pngEncode()
+ *
+ * Compress an image to a PNG file in memory. See "PngEncoder.h".
+\******************************************************************************/
+
+uint8_t * pngEncode( const uint8_t * pixels,
+                     size_t          width,
+                     size_t          height,
+                     size_t          rowBytes,
+                     int             level,
+                     size_t        * size )
+{
+    size_t    count    = width * BPP;
+    size_t    rawSize  = ( count + 1 ) * height;
+    uint8_t * raw      = malloc( rawSize );
+    uint8_t * rows     = malloc( count * 2 );
+    uint8_t * trial    = malloc( count );
+    uint8_t * png      = NULL;
+    z_stream  stream   = { 0 };
+
+    *size = 0;
+
+    if ( raw == NULL || rows == NULL || trial == NULL ) goto bailOut;
+
+    /* Un-premultiply and filter every row. The filter for each is chosen by
+     * the usual heuristic: smallest sum of the filtered bytes, taken as
+     * signed values.
+     */
+
+    uint8_t * row   = rows;
+    uint8_t * above = rows + count;
+
+    memset( above, 0, count );
+
+    for ( size_t y = 0; y < height; y ++ )
+    {
+        uint8_t * out      = raw + y * ( count + 1 );
+        uint64_t  bestCost = UINT64_MAX;
+
+        unpremultiplyRow( row, pixels + y * rowBytes, width );
+
+        for ( int filter = FilterNone; filter < FilterCount; filter ++ )
+        {
+            uint64_t cost = 0;
+
+            filterRow( trial, row, above, count, filter );
+
+            for ( size_t i = 0; i < count; i ++ ) cost += trial[ i ] < 128 ? trial[ i ] : 256 - trial[ i ];
+
+            if ( cost < bestCost )
+            {
+                bestCost = cost;
+                out[ 0 ] = ( uint8_t ) filter;
+                memcpy( out + 1, trial, count );
+            }
+        }
+
+        uint8_t * swap = above;
+        above = row;
+        row   = swap;
+    }
+
+    /* Deflate straight into the IDAT chunk of the output */
+
+    if ( deflateInit( &stream, level ) != Z_OK ) goto bailOut;
+
+    size_t bound = deflateBound( &stream, rawSize );
+
+    png = malloc( SIGNATURE_SIZE + CHUNK_OVERHEAD * 3 + IHDR_SIZE + bound );
+
+    if ( png == NULL ) goto bailOut;
+
+    uint8_t * idat = png + SIGNATURE_SIZE + CHUNK_OVERHEAD + IHDR_SIZE;
+
+    stream.next_in   = raw;
+    stream.avail_in  = ( uInt ) rawSize;
+    stream.next_out  = idat + 8;
+    stream.avail_out = ( uInt ) bound;
+
+    if ( deflate( &stream, Z_FINISH ) != Z_STREAM_END )
+    {
+        free( png );
+        png = NULL;
+
+        goto bailOut;
+    }
+
+    /* Fill in the framing around it */
+
+    uint8_t * ihdr = png + SIGNATURE_SIZE;
+
+    memcpy( png, "\x89PNG\r\n\x1A\n", SIGNATURE_SIZE );
+
+    putBigEndian( ihdr + 8,  ( uint32_t ) width  );
+    putBigEndian( ihdr + 12, ( uint32_t ) height );
+
+    ihdr[ 16 ] = 8; /* Bits per channel                 */
+    ihdr[ 17 ] = 6; /* Colour type: RGB with alpha      */
+    ihdr[ 18 ] = 0; /* Compression method: deflate      */
+    ihdr[ 19 ] = 0; /* Filter method: adaptive          */
+    ihdr[ 20 ] = 0; /* Interlace method: none           */
+
+    putChunk( ihdr, "IHDR", IHDR_SIZE );
+
+    uint8_t * iend = putChunk( idat, "IDAT", stream.total_out );
+
+    *size = ( size_t ) ( putChunk( iend, "IEND", 0 ) - png );
+
+bailOut:
+
+    deflateEnd( &stream );
+
+    free( raw   );
+    free( rows  );
+    free( trial );
+
+    return png;
+}
+
+/******************************************************************************\
+ * unpremultiplyRow()
+ *
+ * Turn a row of premultiplied A, R, G, B pixels into straight R, G, B, A.
+ *
+ * In:  Where to write the converted row;
+ *
+ *      Row to convert;
+ *
+ *      Width of the row in pixels.
+\******************************************************************************/
+
+static void unpremultiplyRow( uint8_t * rgba, const uint8_t * argb, size_t width )
+{
+    for ( size_t x = 0; x < width; x ++, rgba += 4, argb += 4 )
+    {
+        unsigned int alpha = argb[ 0 ];
+
+        if ( alpha == 255 || alpha == 0 )
+        {
+            rgba[ 0 ] = argb[ 1 ];
+            rgba[ 1 ] = argb[ 2 ];
+            rgba[ 2 ] = argb[ 3 ];
+        }
+        else
+        {
+            for ( int c = 0; c < 3; c ++ )
+            {
+                unsigned int value = ( argb[ c + 1 ] * 255 + alpha / 2 ) / alpha;
+                rgba[ c ] = ( uint8_t ) ( value > 255 ? 255 : value );
+            }
+        }
+
+        rgba[ 3 ] = ( uint8_t ) alpha;
+    }
+}
+
+/******************************************************************************\
+ * filterRow()
+ *
+ * Apply a PNG filter to one row.
+ *
+ * In:  Where to write the filtered bytes;
+ *
+ *      Row to filter;
+ *
+ *      Row above it, all zero for the first row;
+ *
+ *      Bytes in the row;
+ *
+ *      Filter type (FilterNone, FilterSub etc.).
+\******************************************************************************/
+
+static void filterRow( uint8_t       * filtered,
+                       const uint8_t * row,
+                       const uint8_t * above,
+                       size_t          count,
+                       int             filter )
+{
+    /* The first pixel has nothing to its left, so is done separately to keep
+     * the main loops simple.
+     */
+
+    for ( size_t i = 0; i < BPP; i ++ )
+    {
+        uint8_t predicted = 0;
+
+        if      ( filter == FilterUp || filter == FilterPaeth ) predicted = above[ i ];
+        else if ( filter == FilterAverage                     ) predicted = above[ i ] / 2;
+
+        filtered[ i ] = ( uint8_t ) ( row[ i ] - predicted );
+    }
+
+    switch ( filter )
+    {
+        case FilterNone:
+        {
+            memcpy( filtered + BPP, row + BPP, count - BPP );
+        }
+        break;
+
+        case FilterSub:
+        {
+            for ( size_t i = BPP; i < count; i ++ ) filtered[ i ] = ( uint8_t ) ( row[ i ] - row[ i - BPP ] );
+        }
+        break;
+
+        case FilterUp:
+        {
+            for ( size_t i = BPP; i < count; i ++ ) filtered[ i ] = ( uint8_t ) ( row[ i ] - above[ i ] );
+        }
+        break;
+
+        case FilterAverage:
+        {
+            for ( size_t i = BPP; i < count; i ++ ) filtered[ i ] = ( uint8_t ) ( row[ i ] - ( row[ i - BPP ] + above[ i ] ) / 2 );
+        }
+        break;
+
+        case FilterPaeth:
+        {
+            for ( size_t i = BPP; i < count; i ++ ) filtered[ i ] = ( uint8_t ) ( row[ i ] - paeth( row[ i - BPP ], above[ i ], above[ i - BPP ] ) );
+        }
+        break;
+    }
+}
+
+/******************************************************************************\
+ * paeth()
+ *
+ * PNG's Paeth predictor.
+ *
+ * In:  Bytes to the left, above and above left of the one being predicted.
+ *
+ * Out: Whichever is closest to left + above - above left.
+\******************************************************************************/
+
+static uint8_t paeth( uint8_t a, uint8_t b, uint8_t c )
+{
+    int p  = a + b - c;
+    int pa = abs( p - a );
+    int pb = abs( p - b );
+    int pc = abs( p - c );
+
+    if ( pa <= pb && pa <= pc ) return a;
+    if ( pb <= pc )             return b;
+    return c;
+}
+
+/******************************************************************************\
+ * putChunk()
+ *
+ * Fill in the framing of a PNG chunk whose data is already in place.
+ *
+ * In:  Start of the chunk, where its length goes; the data must be at 8 bytes
+ *      in;
+ *
+ *      Four character chunk type;
+ *
+ *      Size of the data in bytes.
+ *
+ * Out: Pointer just past the end of the chunk.
+\******************************************************************************/
+
+static uint8_t * putChunk( uint8_t * out, const char * type, size_t dataSize )
+{
+    putBigEndian( out, ( uint32_t ) dataSize );
+    memcpy( out + 4, type, 4 );
+
+    uLong crc = crc32( 0, out + 4, ( uInt ) ( dataSize + 4 ) );
+
+    putBigEndian( out + 8 + dataSize, ( uint32_t ) crc );
+
+    return out + CHUNK_OVERHEAD + dataSize;
+}
+
+/******************************************************************************\
+ * putBigEndian()
+ *
+ * Write a 32-bit value as four big-endian bytes.
+ *
+ * In:  Where to write;
+ *
+ *      Value to write.
+\******************************************************************************/
+
+static void putBigEndian( uint8_t * bytes, uint32_t value )
+{
+    bytes[ 0 ] = ( uint8_t ) ( value >> 24 );
+    bytes[ 1 ] = ( uint8_t ) ( value >> 16 );
+    bytes[ 2 ] = ( uint8_t ) ( value >>  8 );
+    bytes[ 3 ] = ( uint8_t ) ( value       );
+}
@@ -0,0 +1,53 @@
+/******************************************************************************\
+ * Utilities: PngEncoder.h
+ *
+ * Compress an image to a PNG file in memory, for storing large icon family
+ * elements ('ic08', 'ic09') in a fraction of the space of raw ARGB data.
+ *
+ * Source pixels have 8 bits per channel, are premultiplied by alpha and have
+ * alpha first in memory (A, R, G, B bytes), as made by "IconPyramid.h". PNG
+ * stores straight alpha, so colours are un-premultiplied on the way out.
+ *
+ * Each row is filtered with whichever of PNG's five filters looks likely to
+ * compress best, then the lot is deflated with zlib at the requested level.
+ * Level 1 is several times faster than level 9 and for icon artwork usually
+ * costs only a few percent in size; see "Tests/PngEncoderBenchmark.c".
+ *
+ * This is plain C with no Cocoa dependencies; it needs zlib.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef PNG_ENCODER_H
+#define PNG_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/******************************************************************************\
+ * pngEncode()
+ *
+ * Compress an image to a PNG file in memory.
+ *
+ * In:  Source pixels, top row first;
+ *
+ *      Width and height in pixels;
+ *
+ *      Bytes from one source row to the next;
+ *
+ *      zlib compression level, 1 (fastest) to 9 (smallest);
+ *
+ *      Pointer to a size_t updated with the size of the PNG file in bytes.
+ *
+ * Out: malloc'd PNG file which the caller must free(), or NULL if out of
+ *      memory or compression failed.
+\******************************************************************************/
+
+uint8_t * pngEncode( const uint8_t * pixels,
+                     size_t          width,
+                     size_t          height,
+                     size_t          rowBytes,
+                     int             level,
+                     size_t        * size );
+
+#endif /* PNG_ENCODER_H */
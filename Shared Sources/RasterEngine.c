@@ -0,0 +1,1182 @@
+/******************************************************************************\
+ * Utilities: RasterEngine.c
+ *
+ * Portable raster drawing for the custom icon styles. See "RasterEngine.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "RasterEngine.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Choose the inner loops. AVX2 builds use SSE2 for anything without an AVX2
+ * version. The floating point sampling code needs round-to-nearest-even
+ * conversions, which 32-bit ARM lacks, so there NEON is only used for the
+ * integer loops.
+ */
+
+#if   !defined( RASTER_ENGINE_SCALAR ) && defined( __AVX2__ )
+    #define KERNELS_AVX2
+    #define LANES_SSE
+    #include <immintrin.h>
+#elif !defined( RASTER_ENGINE_SCALAR ) && ( defined( __SSE2__ ) || defined( _M_X64 ) )
+    #define KERNELS_SSE2
+    #define LANES_SSE
+    #include <emmintrin.h>
+#elif !defined( RASTER_ENGINE_SCALAR ) && defined( __ARM_NEON )
+    #define KERNELS_NEON
+    #include <arm_neon.h>
+    #if defined( __aarch64__ )
+        #define LANES_NEON
+    #endif
+#endif
+
+/* Per-pixel access; 'y' counts upwards from the bottom row */
+
+#define PIXEL( image, x, y ) ( ( image )->pixels + ( size_t ) ( ( image )->height - 1 - ( y ) ) * ( image )->rowBytes + ( size_t ) ( x ) * 4 )
+#define MASK(  mask,  x, y ) ( ( mask  )->alpha  + ( size_t ) ( ( mask  )->height - 1 - ( y ) ) * ( mask  )->rowBytes + ( size_t ) ( x ) )
+
+/* Exact rounded division of 0 to 65025 by 255 */
+
+#define DIV255( x ) ( ( ( x ) + 128 + ( ( ( x ) + 128 ) >> 8 ) ) >> 8 )
+
+/******************************************************************************\
+ * Four floating point lanes, one per channel, for filtered sampling
+\******************************************************************************/
+
+#if defined( LANES_SSE )
+
+    typedef __m128 Lanes;
+
+    static inline Lanes lanesSplat( float x            ) { return _mm_set1_ps( x );    }
+    static inline Lanes lanesAdd  ( Lanes a, Lanes b   ) { return _mm_add_ps( a, b );  }
+    static inline Lanes lanesMul  ( Lanes a, Lanes b   ) { return _mm_mul_ps( a, b );  }
+
+    static inline Lanes lanesLoad( const uint8_t * pixel )
+    {
+        int32_t word;
+        memcpy( &word, pixel, 4 );
+
+        __m128i zero    = _mm_setzero_si128();
+        __m128i widened = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( word ), zero ), zero );
+
+        return _mm_cvtepi32_ps( widened );
+    }
+
+    static inline void lanesStore( uint8_t * pixel, Lanes value )
+    {
+        /* Keep the result a valid premultiplied colour after any overshoot */
+
+        Lanes   alpha   = _mm_min_ps( _mm_max_ps( _mm_shuffle_ps( value, value, 0 ), _mm_setzero_ps() ), _mm_set1_ps( 255 ) );
+        __m128i rounded = _mm_cvtps_epi32( _mm_max_ps( _mm_min_ps( value, alpha ), _mm_setzero_ps() ) );
+        int32_t word    = _mm_cvtsi128_si32( _mm_packus_epi16( _mm_packs_epi32( rounded, rounded ), rounded ) );
+
+        memcpy( pixel, &word, 4 );
+    }
+
+#elif defined( LANES_NEON )
+
+    typedef float32x4_t Lanes;
+
+    static inline Lanes lanesSplat( float x            ) { return vdupq_n_f32( x );    }
+    static inline Lanes lanesAdd  ( Lanes a, Lanes b   ) { return vaddq_f32( a, b );   }
+    static inline Lanes lanesMul  ( Lanes a, Lanes b   ) { return vmulq_f32( a, b );   }
+
+    static inline Lanes lanesLoad( const uint8_t * pixel )
+    {
+        uint32_t word;
+        memcpy( &word, pixel, 4 );
+
+        uint16x8_t widened = vmovl_u8( vreinterpret_u8_u32( vdup_n_u32( word ) ) );
+
+        return vcvtq_f32_u32( vmovl_u16( vget_low_u16( widened ) ) );
+    }
+
+    static inline void lanesStore( uint8_t * pixel, Lanes value )
+    {
+        Lanes     alpha   = vminq_f32( vmaxq_f32( vdupq_laneq_f32( value, 0 ), vdupq_n_f32( 0 ) ), vdupq_n_f32( 255 ) );
+        int32x4_t rounded = vcvtnq_s32_f32( vmaxq_f32( vminq_f32( value, alpha ), vdupq_n_f32( 0 ) ) );
+        uint8x8_t narrow  = vqmovn_u16( vcombine_u16( vqmovun_s32( rounded ), vdup_n_u16( 0 ) ) );
+        uint32_t  word    = vget_lane_u32( vreinterpret_u32_u8( narrow ), 0 );
+
+        memcpy( pixel, &word, 4 );
+    }
+
+#else
+
+    typedef struct Lanes { float v[ 4 ]; } Lanes;
+
+    static inline Lanes lanesSplat( float x )
+    {
+        Lanes r = { { x, x, x, x } };
+        return r;
+    }
+
+    static inline Lanes lanesAdd( Lanes a, Lanes b )
+    {
+        for ( int i = 0; i < 4; i ++ ) a.v[ i ] += b.v[ i ];
+        return a;
+    }
+
+    static inline Lanes lanesMul( Lanes a, Lanes b )
+    {
+        for ( int i = 0; i < 4; i ++ ) a.v[ i ] *= b.v[ i ];
+        return a;
+    }
+
+    static inline Lanes lanesLoad( const uint8_t * pixel )
+    {
+        Lanes r = { { pixel[ 0 ], pixel[ 1 ], pixel[ 2 ], pixel[ 3 ] } };
+        return r;
+    }
+
+    static inline void lanesStore( uint8_t * pixel, Lanes value )
+    {
+        float alpha = fminf( fmaxf( value.v[ 0 ], 0 ), 255 );
+
+        for ( int i = 0; i < 4; i ++ )
+        {
+            pixel[ i ] = ( uint8_t ) nearbyintf( fmaxf( fminf( value.v[ i ], alpha ), 0 ) );
+        }
+    }
+
+#endif
+
+/* Static function prototypes */
+
+static void            spanOver            ( uint8_t * destination, const uint8_t * source, size_t count );
+static void            accumulateRows      ( uint16_t * sums, const uint8_t * add, const uint8_t * subtract, size_t count );
+static void            emitRow             ( uint8_t * destination, const uint16_t * sums, uint16_t multiplier, size_t count );
+static uint16_t        boxMultiplier       ( uint32_t radius );
+static void            drawTransformed     ( RasterImage           * destination,
+                                             const RasterTransform * transform,
+                                             double                  width,
+                                             double                  height,
+                                             const RasterImage     * source,
+                                             const uint8_t         * colour,
+                                             RasterFilter            filter );
+static Lanes           sampleBilinear      ( const RasterImage * image, double u, double v );
+static Lanes           sampleBicubic       ( const RasterImage * image, double u, double v );
+static double          edgeCoverage        ( double distance );
+static RasterTransform transformThen       ( RasterTransform first, RasterTransform second );
+static RasterTransform transformTranslate  ( double x, double y );
+static RasterTransform transformScale      ( double x, double y );
+static RasterTransform transformRotate     ( double angle );
+
+/******************************************************************************\
+ * rasterEngineKernels()
+ *
+ * Name the inner loops in use. See "RasterEngine.h".
+\******************************************************************************/
+
+const char * rasterEngineKernels( void )
+{
+    #if   defined( KERNELS_AVX2 )
+        return "AVX2";
+    #elif defined( KERNELS_SSE2 )
+        return "SSE2";
+    #elif defined( KERNELS_NEON )
+        return "NEON";
+    #else
+        return "scalar";
+    #endif
+}
+
+/******************************************************************************\
+ * rasterImageCreate()
+ *
+ * Allocate a transparent image. See "RasterEngine.h".
+\******************************************************************************/
+
+bool rasterImageCreate( RasterImage * image, uint32_t width, uint32_t height )
+{
+    memset( image, 0, sizeof( *image ) );
+
+    if ( width == 0 || height == 0 ) return false;
+
+    image->pixels = calloc( height, ( size_t ) width * 4 );
+    if ( image->pixels == NULL ) return false;
+
+    image->width    = width;
+    image->height   = height;
+    image->rowBytes = ( size_t ) width * 4;
+    image->owned    = true;
+
+    return true;
+}
+
+/******************************************************************************\
+ * rasterImageWrap()
+ *
+ * Describe existing pixels as an image. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterImageWrap( RasterImage * image, uint8_t * pixels, uint32_t width, uint32_t height, size_t rowBytes )
+{
+    image->pixels   = pixels;
+    image->width    = width;
+    image->height   = height;
+    image->rowBytes = rowBytes;
+    image->owned    = false;
+}
+
+/******************************************************************************\
+ * rasterImageFree()
+ *
+ * Free an image. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterImageFree( RasterImage * image )
+{
+    if ( image->owned ) free( image->pixels );
+
+    memset( image, 0, sizeof( *image ) );
+}
+
+/******************************************************************************\
+ * rasterMaskCreate()
+ *
+ * Allocate a mask cleared to zero. See "RasterEngine.h".
+\******************************************************************************/
+
+bool rasterMaskCreate( RasterMask * mask, uint32_t width, uint32_t height )
+{
+    memset( mask, 0, sizeof( *mask ) );
+
+    if ( width == 0 || height == 0 ) return false;
+
+    mask->alpha = calloc( height, width );
+    if ( mask->alpha == NULL ) return false;
+
+    mask->width    = width;
+    mask->height   = height;
+    mask->rowBytes = width;
+
+    return true;
+}
+
+/******************************************************************************\
+ * rasterMaskFree()
+ *
+ * Free a mask. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterMaskFree( RasterMask * mask )
+{
+    free( mask->alpha );
+
+    memset( mask, 0, sizeof( *mask ) );
+}
+
+/******************************************************************************\
+ * rasterFillRect()
+ *
+ * Fill a transformed rectangle. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterFillRect( RasterImage           * destination,
+                     const RasterTransform * transform,
+                     double                  width,
+                     double                  height,
+                     const uint8_t           colour[ 4 ] )
+{
+    drawTransformed( destination, transform, width, height, NULL, colour, rasterFilterBilinear );
+}
+
+/******************************************************************************\
+ * rasterDrawImage()
+ *
+ * Draw a transformed image. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterDrawImage( RasterImage           * destination,
+                      const RasterImage     * source,
+                      const RasterTransform * transform,
+                      RasterFilter            filter )
+{
+    drawTransformed( destination, transform, source->width, source->height, source, NULL, filter );
+}
+
+/******************************************************************************\
+ * rasterExtractAlpha()
+ *
+ * Copy an image's alpha channel into a mask. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterExtractAlpha( const RasterImage * image, RasterMask * mask, uint32_t x, uint32_t y )
+{
+    for ( uint32_t row = 0; row < image->height; row ++ )
+    {
+        const uint8_t * from = PIXEL( image, 0, row );
+        uint8_t       * to   = MASK( mask, x, y + row );
+
+        for ( uint32_t column = 0; column < image->width; column ++ )
+        {
+            to[ column ] = from[ column * 4 ];
+        }
+    }
+}
+
+/******************************************************************************\
+ * rasterBoxBlur()
+ *
+ * Box blur a mask. See "RasterEngine.h".
+\******************************************************************************/
+
+bool rasterBoxBlur( RasterMask * mask, uint32_t radius )
+{
+    if ( radius > RASTER_MAXIMUM_BOX_RADIUS ) radius = RASTER_MAXIMUM_BOX_RADIUS;
+    if ( radius == 0 ) return true;
+
+    uint32_t   width      = mask->width;
+    uint32_t   height     = mask->height;
+    uint16_t   multiplier = boxMultiplier( radius );
+    uint8_t  * copy       = malloc( ( size_t ) width * height );
+    uint16_t * sums       = malloc( ( size_t ) width * sizeof( uint16_t ) );
+    uint8_t  * zeros      = calloc( width, 1 );
+
+    if ( copy == NULL || sums == NULL || zeros == NULL )
+    {
+        free( copy  );
+        free( sums  );
+        free( zeros );
+
+        return false;
+    }
+
+    /* Horizontally, from the mask into the copy, with a running sum along
+     * each row. The multiply-and-shift is exactly that of emitRow().
+     */
+
+    for ( uint32_t row = 0; row < height; row ++ )
+    {
+        const uint8_t * in  = mask->alpha + ( size_t ) row * mask->rowBytes;
+        uint8_t       * out = copy        + ( size_t ) row * width;
+        uint32_t        sum = 0;
+
+        for ( uint32_t x = 0; x < radius && x < width; x ++ ) sum += in[ x ];
+
+        for ( uint32_t x = 0; x < width; x ++ )
+        {
+            if ( x + radius < width ) sum += in[ x + radius ];
+
+            out[ x ] = ( uint8_t ) ( ( sum * multiplier ) >> 16 );
+
+            if ( x >= radius ) sum -= in[ x - radius ];
+        }
+    }
+
+    /* Vertically, from the copy back into the mask, with running sums for
+     * every column at once.
+     */
+
+    memset( sums, 0, ( size_t ) width * sizeof( uint16_t ) );
+
+    for ( uint32_t row = 0; row < radius && row < height; row ++ )
+    {
+        accumulateRows( sums, copy + ( size_t ) row * width, zeros, width );
+    }
+
+    for ( uint32_t row = 0; row < height; row ++ )
+    {
+        const uint8_t * add      = row + radius < height ? copy + ( size_t ) ( row + radius ) * width : zeros;
+        const uint8_t * subtract = row >= radius         ? copy + ( size_t ) ( row - radius ) * width : zeros;
+
+        accumulateRows( sums, add, zeros, width );
+        emitRow       ( mask->alpha + ( size_t ) row * mask->rowBytes, sums, multiplier, width );
+        accumulateRows( sums, zeros, subtract, width );
+    }
+
+    free( copy  );
+    free( sums  );
+    free( zeros );
+
+    return true;
+}
+
+/******************************************************************************\
+ * rasterGaussianBlur()
+ *
+ * Approximate a Gaussian blur of a mask. See "RasterEngine.h".
+\******************************************************************************/
+
+bool rasterGaussianBlur( RasterMask * mask, double sigma )
+{
+    if ( ! ( sigma > 0 ) ) return true;
+
+    /* Choose three box widths whose combined variance matches sigma
+     * squared: 'm' boxes of odd width 'lower' and the rest two wider.
+     */
+
+    double ideal = sqrt( 4 * sigma * sigma + 1 );
+    int    lower = ( int ) floor( ideal );
+
+    if ( lower % 2 == 0 ) lower --;
+    if ( lower < 1      ) lower = 1;
+
+    int m = ( int ) lround( ( 12 * sigma * sigma - 3.0 * lower * lower - 12.0 * lower - 9 ) / ( -4.0 * lower - 4 ) );
+
+    for ( int pass = 0; pass < 3; pass ++ )
+    {
+        int size = pass < m ? lower : lower + 2;
+
+        if ( ! rasterBoxBlur( mask, ( uint32_t ) ( size - 1 ) / 2 ) ) return false;
+    }
+
+    return true;
+}
+
+/******************************************************************************\
+ * rasterDrawMask()
+ *
+ * Draw a colour through a mask. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterDrawMask( RasterImage      * destination,
+                     const RasterMask * mask,
+                     int32_t            x,
+                     int32_t            y,
+                     const uint8_t      colour[ 4 ],
+                     const RasterRect * clip )
+{
+    int64_t left   = 0;
+    int64_t bottom = 0;
+    int64_t right  = destination->width;
+    int64_t top    = destination->height;
+
+    if ( clip )
+    {
+        if ( clip->x                          > left   ) left   = clip->x;
+        if ( clip->y                          > bottom ) bottom = clip->y;
+        if ( ( int64_t ) clip->x + clip->width  < right  ) right  = ( int64_t ) clip->x + clip->width;
+        if ( ( int64_t ) clip->y + clip->height < top    ) top    = ( int64_t ) clip->y + clip->height;
+    }
+
+    if ( x                          > left   ) left   = x;
+    if ( y                          > bottom ) bottom = y;
+    if ( ( int64_t ) x + mask->width  < right  ) right  = ( int64_t ) x + mask->width;
+    if ( ( int64_t ) y + mask->height < top    ) top    = ( int64_t ) y + mask->height;
+
+    if ( left >= right || bottom >= top ) return;
+
+    size_t    count = ( size_t ) ( right - left );
+    uint8_t * span  = malloc( count * 4 );
+
+    if ( span == NULL ) return;
+
+    for ( int64_t row = bottom; row < top; row ++ )
+    {
+        const uint8_t * coverage = MASK( mask, left - x, row - y );
+
+        for ( size_t i = 0; i < count; i ++ )
+        {
+            unsigned int m = coverage[ i ];
+
+            span[ i * 4 + 0 ] = ( uint8_t ) DIV255( colour[ 0 ] * m );
+            span[ i * 4 + 1 ] = ( uint8_t ) DIV255( colour[ 1 ] * m );
+            span[ i * 4 + 2 ] = ( uint8_t ) DIV255( colour[ 2 ] * m );
+            span[ i * 4 + 3 ] = ( uint8_t ) DIV255( colour[ 3 ] * m );
+        }
+
+        spanOver( PIXEL( destination, left, row ), span, count );
+    }
+
+    free( span );
+}
+
+/******************************************************************************\
+ * rasterComposite()
+ *
+ * Draw one image over another. See "RasterEngine.h".
+\******************************************************************************/
+
+void rasterComposite( RasterImage * destination, const RasterImage * source, int32_t x, int32_t y )
+{
+    int64_t left   = x < 0 ? 0 : x;
+    int64_t bottom = y < 0 ? 0 : y;
+    int64_t right  = ( int64_t ) x + source->width;
+    int64_t top    = ( int64_t ) y + source->height;
+
+    if ( right > destination->width  ) right = destination->width;
+    if ( top   > destination->height ) top   = destination->height;
+
+    if ( left >= right || bottom >= top ) return;
+
+    for ( int64_t row = bottom; row < top; row ++ )
+    {
+        spanOver
+        (
+            PIXEL( destination, left,     row     ),
+            PIXEL( source,      left - x, row - y ),
+            ( size_t ) ( right - left )
+        );
+    }
+}
+
+/******************************************************************************\
+ * rasterDrawThumbnail()
+ *
+ * Draw a thumbnail in the style of a custom icon. See "RasterEngine.h".
+\******************************************************************************/
+
+bool rasterDrawThumbnail( RasterImage                * destination,
+                          double                       slotX,
+                          double                       slotY,
+                          double                       slotWidth,
+                          double                       slotHeight,
+                          const RasterImage          * thumbnail,
+                          const RasterThumbnailStyle * style )
+{
+    /* Draw into a layer covering just the slot, so that nothing lands
+     * outside it.
+     */
+
+    double left   = fmax( 0, floor( slotX ) );
+    double bottom = fmax( 0, floor( slotY ) );
+    double right  = fmin( destination->width,  ceil( slotX + slotWidth  ) );
+    double top    = fmin( destination->height, ceil( slotY + slotHeight ) );
+
+    if ( left >= right || bottom >= top ) return true;
+
+    RasterImage layer;
+
+    if ( ! rasterImageCreate( &layer, ( uint32_t ) ( right - left ), ( uint32_t ) ( top - bottom ) ) ) return false;
+
+    /* Lay out around the centre of the layout square, rotated, then scale
+     * that square into the slot.
+     */
+
+    double          size     = style->layoutSize;
+    RasterTransform toLayer  = transformThen
+    (
+        transformThen( transformRotate( style->angle ), transformTranslate( size / 2, size / 2 ) ),
+        transformThen( transformScale( slotWidth / size, slotHeight / size ),
+                       transformTranslate( slotX - left, slotY - bottom ) )
+    );
+
+    if ( style->borderSize > 0 )
+    {
+        static const uint8_t white[ 4 ] = { 255, 255, 255, 255 };
+
+        double          border    = style->borderSize;
+        RasterTransform transform = transformThen( transformTranslate( -border / 2, -border / 2 ), toLayer );
+
+        rasterFillRect( &layer, &transform, border, border, white );
+    }
+
+    /* Centre fitted images in the thumbnail square with their aspect ratio
+     * intact; the rest fill it.
+     */
+
+    double x = -style->thumbSize / 2, w = style->thumbSize;
+    double y = -style->thumbSize / 2, h = style->thumbSize;
+
+    if ( style->fit )
+    {
+        if ( thumbnail->width > thumbnail->height )
+        {
+            double scaled = thumbnail->height * ( w / thumbnail->width );
+
+            y += ( h - scaled ) / 2;
+            h  = scaled;
+        }
+        else
+        {
+            double scaled = thumbnail->width * ( h / thumbnail->height );
+
+            x += ( w - scaled ) / 2;
+            w  = scaled;
+        }
+    }
+
+    RasterTransform transform = transformThen
+    (
+        transformThen( transformScale( w / thumbnail->width, h / thumbnail->height ), transformTranslate( x, y ) ),
+        toLayer
+    );
+
+    rasterDrawImage( &layer, thumbnail, &transform, style->filter );
+
+    /* The shadow is the layer's outline, blurred, offset and coloured. Leave
+     * room around the outline for the blur to spread into and for the
+     * offset to bring into view; then draw it under the layer, still within
+     * the slot.
+     */
+
+    bool success = true;
+
+    if ( style->shadowSigma > 0 && style->shadowColour[ 0 ] > 0 )
+    {
+        int32_t    offsetX = ( int32_t ) lround( style->shadowOffsetX );
+        int32_t    offsetY = ( int32_t ) lround( style->shadowOffsetY );
+        uint32_t   margin  = ( uint32_t ) ceil( style->shadowSigma * 3 ) +
+                             ( uint32_t ) ( abs( offsetX ) > abs( offsetY ) ? abs( offsetX ) : abs( offsetY ) );
+        RasterMask shadow;
+        RasterRect clip    = { ( int32_t ) left, ( int32_t ) bottom, layer.width, layer.height };
+
+        success = rasterMaskCreate( &shadow, layer.width + margin * 2, layer.height + margin * 2 );
+
+        if ( success )
+        {
+            rasterExtractAlpha( &layer, &shadow, margin, margin );
+
+            success = rasterGaussianBlur( &shadow, style->shadowSigma );
+
+            if ( success )
+            {
+                rasterDrawMask
+                (
+                    destination,
+                    &shadow,
+                    ( int32_t ) left   - ( int32_t ) margin + offsetX,
+                    ( int32_t ) bottom - ( int32_t ) margin + offsetY,
+                    style->shadowColour,
+                    &clip
+                );
+            }
+
+            rasterMaskFree( &shadow );
+        }
+    }
+
+    if ( success ) rasterComposite( destination, &layer, ( int32_t ) left, ( int32_t ) bottom );
+
+    rasterImageFree( &layer );
+
+    return success;
+}
+
+/******************************************************************************\
+ * spanOver()
+ *
+ * Composite a row of premultiplied pixels over another: each channel becomes
+ * source + destination * ( 255 - source alpha ) / 255, rounded and saturated.
+ *
+ * In:  Destination pixels, updated;
+ *
+ *      Source pixels;
+ *
+ *      Number of pixels.
+\******************************************************************************/
+
+static void spanOver( uint8_t * destination, const uint8_t * source, size_t count )
+{
+    #if defined( KERNELS_AVX2 )
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i c255 = _mm256_set1_epi16( 255 );
+        const __m256i c128 = _mm256_set1_epi16( 128 );
+
+        for ( ; count >= 8; count -= 8, destination += 32, source += 32 )
+        {
+            __m256i s = _mm256_loadu_si256( ( const __m256i * ) source      );
+            __m256i d = _mm256_loadu_si256( ( const __m256i * ) destination );
+
+            __m256i sLo = _mm256_unpacklo_epi8( s, zero ), sHi = _mm256_unpackhi_epi8( s, zero );
+            __m256i dLo = _mm256_unpacklo_epi8( d, zero ), dHi = _mm256_unpackhi_epi8( d, zero );
+
+            __m256i aLo = _mm256_sub_epi16( c255, _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( sLo, 0 ), 0 ) );
+            __m256i aHi = _mm256_sub_epi16( c255, _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( sHi, 0 ), 0 ) );
+
+            __m256i pLo = _mm256_add_epi16( _mm256_mullo_epi16( dLo, aLo ), c128 );
+            __m256i pHi = _mm256_add_epi16( _mm256_mullo_epi16( dHi, aHi ), c128 );
+
+            pLo = _mm256_srli_epi16( _mm256_add_epi16( pLo, _mm256_srli_epi16( pLo, 8 ) ), 8 );
+            pHi = _mm256_srli_epi16( _mm256_add_epi16( pHi, _mm256_srli_epi16( pHi, 8 ) ), 8 );
+
+            __m256i r = _mm256_packus_epi16( _mm256_add_epi16( pLo, sLo ), _mm256_add_epi16( pHi, sHi ) );
+
+            _mm256_storeu_si256( ( __m256i * ) destination, r );
+        }
+
+    #elif defined( KERNELS_SSE2 )
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c255 = _mm_set1_epi16( 255 );
+        const __m128i c128 = _mm_set1_epi16( 128 );
+
+        for ( ; count >= 4; count -= 4, destination += 16, source += 16 )
+        {
+            __m128i s = _mm_loadu_si128( ( const __m128i * ) source      );
+            __m128i d = _mm_loadu_si128( ( const __m128i * ) destination );
+
+            __m128i sLo = _mm_unpacklo_epi8( s, zero ), sHi = _mm_unpackhi_epi8( s, zero );
+            __m128i dLo = _mm_unpacklo_epi8( d, zero ), dHi = _mm_unpackhi_epi8( d, zero );
+
+            __m128i aLo = _mm_sub_epi16( c255, _mm_shufflehi_epi16( _mm_shufflelo_epi16( sLo, 0 ), 0 ) );
+            __m128i aHi = _mm_sub_epi16( c255, _mm_shufflehi_epi16( _mm_shufflelo_epi16( sHi, 0 ), 0 ) );
+
+            __m128i pLo = _mm_add_epi16( _mm_mullo_epi16( dLo, aLo ), c128 );
+            __m128i pHi = _mm_add_epi16( _mm_mullo_epi16( dHi, aHi ), c128 );
+
+            pLo = _mm_srli_epi16( _mm_add_epi16( pLo, _mm_srli_epi16( pLo, 8 ) ), 8 );
+            pHi = _mm_srli_epi16( _mm_add_epi16( pHi, _mm_srli_epi16( pHi, 8 ) ), 8 );
+
+            __m128i r = _mm_packus_epi16( _mm_add_epi16( pLo, sLo ), _mm_add_epi16( pHi, sHi ) );
+
+            _mm_storeu_si128( ( __m128i * ) destination, r );
+        }
+
+    #elif defined( KERNELS_NEON )
+
+        for ( ; count >= 8; count -= 8, destination += 32, source += 32 )
+        {
+            uint8x8x4_t s       = vld4_u8( source      );
+            uint8x8x4_t d       = vld4_u8( destination );
+            uint8x8_t   inverse = vsub_u8( vdup_n_u8( 255 ), s.val[ 0 ] );
+
+            for ( int channel = 0; channel < 4; channel ++ )
+            {
+                uint16x8_t p = vaddq_u16( vmull_u8( d.val[ channel ], inverse ), vdupq_n_u16( 128 ) );
+
+                p = vaddq_u16( p, vshrq_n_u16( p, 8 ) );
+
+                d.val[ channel ] = vqadd_u8( vshrn_n_u16( p, 8 ), s.val[ channel ] );
+            }
+
+            vst4_u8( destination, d );
+        }
+
+    #endif
+
+    for ( ; count > 0; count --, destination += 4, source += 4 )
+    {
+        unsigned int inverse = 255u - source[ 0 ];
+
+        for ( int channel = 0; channel < 4; channel ++ )
+        {
+            unsigned int value = source[ channel ] + DIV255( destination[ channel ] * inverse );
+
+            destination[ channel ] = ( uint8_t ) ( value > 255 ? 255 : value );
+        }
+    }
+}
+
+/******************************************************************************\
+ * accumulateRows()
+ *
+ * Update column sums for a vertical box blur: sums += add - subtract, modulo
+ * 65536 (the true sums never exceed 65535, so wrapping part way is harmless).
+ *
+ * In:  Sums, updated;
+ *
+ *      Row to add;
+ *
+ *      Row to subtract;
+ *
+ *      Number of columns.
+\******************************************************************************/
+
+static void accumulateRows( uint16_t * sums, const uint8_t * add, const uint8_t * subtract, size_t count )
+{
+    #if defined( KERNELS_AVX2 )
+
+        for ( ; count >= 16; count -= 16, sums += 16, add += 16, subtract += 16 )
+        {
+            __m256i a = _mm256_cvtepu8_epi16( _mm_loadu_si128( ( const __m128i * ) add      ) );
+            __m256i s = _mm256_cvtepu8_epi16( _mm_loadu_si128( ( const __m128i * ) subtract ) );
+            __m256i t = _mm256_loadu_si256( ( const __m256i * ) sums );
+
+            _mm256_storeu_si256( ( __m256i * ) sums, _mm256_sub_epi16( _mm256_add_epi16( t, a ), s ) );
+        }
+
+    #elif defined( KERNELS_SSE2 )
+
+        const __m128i zero = _mm_setzero_si128();
+
+        for ( ; count >= 8; count -= 8, sums += 8, add += 8, subtract += 8 )
+        {
+            __m128i a = _mm_unpacklo_epi8( _mm_loadl_epi64( ( const __m128i * ) add      ), zero );
+            __m128i s = _mm_unpacklo_epi8( _mm_loadl_epi64( ( const __m128i * ) subtract ), zero );
+            __m128i t = _mm_loadu_si128( ( const __m128i * ) sums );
+
+            _mm_storeu_si128( ( __m128i * ) sums, _mm_sub_epi16( _mm_add_epi16( t, a ), s ) );
+        }
+
+    #elif defined( KERNELS_NEON )
+
+        for ( ; count >= 8; count -= 8, sums += 8, add += 8, subtract += 8 )
+        {
+            uint16x8_t t = vld1q_u16( sums );
+
+            t = vaddw_u8( t, vld1_u8( add      ) );
+            t = vsubw_u8( t, vld1_u8( subtract ) );
+
+            vst1q_u16( sums, t );
+        }
+
+    #endif
+
+    for ( ; count > 0; count --, sums ++, add ++, subtract ++ )
+    {
+        *sums = ( uint16_t ) ( *sums + *add - *subtract );
+    }
+}
+
+/******************************************************************************\
+ * emitRow()
+ *
+ * Turn column sums into box blurred values: ( sum * multiplier ) >> 16.
+ *
+ * In:  Row of the mask to write;
+ *
+ *      Sums;
+ *
+ *      Multiplier from boxMultiplier();
+ *
+ *      Number of columns.
+\******************************************************************************/
+
+static void emitRow( uint8_t * destination, const uint16_t * sums, uint16_t multiplier, size_t count )
+{
+    #if defined( KERNELS_AVX2 )
+
+        const __m256i m = _mm256_set1_epi16( ( short ) multiplier );
+
+        for ( ; count >= 16; count -= 16, destination += 16, sums += 16 )
+        {
+            __m256i v = _mm256_mulhi_epu16( _mm256_loadu_si256( ( const __m256i * ) sums ), m );
+            __m256i p = _mm256_permute4x64_epi64( _mm256_packus_epi16( v, v ), _MM_SHUFFLE( 3, 1, 2, 0 ) );
+
+            _mm_storeu_si128( ( __m128i * ) destination, _mm256_castsi256_si128( p ) );
+        }
+
+    #elif defined( KERNELS_SSE2 )
+
+        const __m128i m = _mm_set1_epi16( ( short ) multiplier );
+
+        for ( ; count >= 8; count -= 8, destination += 8, sums += 8 )
+        {
+            __m128i v = _mm_mulhi_epu16( _mm_loadu_si128( ( const __m128i * ) sums ), m );
+
+            _mm_storel_epi64( ( __m128i * ) destination, _mm_packus_epi16( v, v ) );
+        }
+
+    #elif defined( KERNELS_NEON )
+
+        for ( ; count >= 8; count -= 8, destination += 8, sums += 8 )
+        {
+            uint16x8_t t  = vld1q_u16( sums );
+            uint32x4_t lo = vmull_n_u16( vget_low_u16 ( t ), multiplier );
+            uint32x4_t hi = vmull_n_u16( vget_high_u16( t ), multiplier );
+
+            vst1_u8( destination, vmovn_u16( vcombine_u16( vshrn_n_u32( lo, 16 ), vshrn_n_u32( hi, 16 ) ) ) );
+        }
+
+    #endif
+
+    for ( ; count > 0; count --, destination ++, sums ++ )
+    {
+        *destination = ( uint8_t ) ( ( ( uint32_t ) *sums * multiplier ) >> 16 );
+    }
+}
+
+/******************************************************************************\
+ * boxMultiplier()
+ *
+ * Return the fixed point reciprocal of a box's width, rounded up so that a box
+ * full of 255s still gives 255: ( sum * multiplier ) >> 16 is then the mean.
+ *
+ * In:  Box radius, 1 to RASTER_MAXIMUM_BOX_RADIUS.
+\******************************************************************************/
+
+static uint16_t boxMultiplier( uint32_t radius )
+{
+    uint32_t width = radius * 2 + 1;
+
+    return ( uint16_t ) ( ( 65536 + width - 1 ) / width );
+}
+
+/******************************************************************************\
+ * drawTransformed()
+ *
+ * Draw a transformed rectangle, filled either with a colour or from a source
+ * image, antialiasing its edges. Each destination pixel centre within its
+ * bounds is mapped back into the rectangle; the pixel's coverage is estimated
+ * from its distance to each edge, measured in destination pixels.
+ *
+ * In:  Image to draw into;
+ *
+ *      Transformation from the rectangle's space to the destination's;
+ *
+ *      Width and height of the rectangle;
+ *
+ *      Source image to sample (of the same size as the rectangle), or NULL;
+ *
+ *      Colour to fill with if there is no source image;
+ *
+ *      Filter for sampling any source image.
+\******************************************************************************/
+
+static void drawTransformed( RasterImage           * destination,
+                             const RasterTransform * transform,
+                             double                  width,
+                             double                  height,
+                             const RasterImage     * source,
+                             const uint8_t         * colour,
+                             RasterFilter            filter )
+{
+    const RasterTransform * t           = transform;
+    double                  determinant = t->a * t->d - t->b * t->c;
+
+    if ( width <= 0 || height <= 0 || fabs( determinant ) < 1e-12 ) return;
+
+    /* Bounds of the transformed rectangle, plus a pixel for antialiasing */
+
+    double xs[ 4 ] = { 0, width, 0,      width  };
+    double ys[ 4 ] = { 0, 0,     height, height };
+    double minX    = INFINITY, maxX = -INFINITY;
+    double minY    = INFINITY, maxY = -INFINITY;
+
+    for ( int corner = 0; corner < 4; corner ++ )
+    {
+        double x = t->a * xs[ corner ] + t->c * ys[ corner ] + t->tx;
+        double y = t->b * xs[ corner ] + t->d * ys[ corner ] + t->ty;
+
+        minX = fmin( minX, x ); maxX = fmax( maxX, x );
+        minY = fmin( minY, y ); maxY = fmax( maxY, y );
+    }
+
+    int64_t left   = ( int64_t ) fmax( 0,                   floor( minX ) - 1 );
+    int64_t bottom = ( int64_t ) fmax( 0,                   floor( minY ) - 1 );
+    int64_t right  = ( int64_t ) fmin( destination->width,  ceil ( maxX ) + 1 );
+    int64_t top    = ( int64_t ) fmin( destination->height, ceil ( maxY ) + 1 );
+
+    if ( left >= right || bottom >= top ) return;
+
+    /* The inverse maps destination points back into the rectangle. Its rows
+     * are the gradients of the rectangle's coordinates across the
+     * destination, giving the scale for measuring edge distances.
+     */
+
+    RasterTransform inverse =
+    {
+         t->d / determinant,
+        -t->b / determinant,
+        -t->c / determinant,
+         t->a / determinant,
+        ( t->c * t->ty - t->d * t->tx ) / determinant,
+        ( t->b * t->tx - t->a * t->ty ) / determinant
+    };
+
+    double uScale = 1 / hypot( inverse.a, inverse.c );
+    double vScale = 1 / hypot( inverse.b, inverse.d );
+
+    size_t    count = ( size_t ) ( right - left );
+    uint8_t * span  = malloc( count * 4 );
+    Lanes     fill  = lanesSplat( 0 );
+
+    if ( span == NULL ) return;
+
+    if ( source == NULL )
+    {
+        uint8_t solid[ 4 ] = { colour[ 0 ], colour[ 1 ], colour[ 2 ], colour[ 3 ] };
+        fill = lanesLoad( solid );
+    }
+
+    for ( int64_t row = bottom; row < top; row ++ )
+    {
+        double y = row + 0.5;
+
+        for ( size_t i = 0; i < count; i ++ )
+        {
+            double x = left + ( double ) i + 0.5;
+            double u = inverse.a * x + inverse.c * y + inverse.tx;
+            double v = inverse.b * x + inverse.d * y + inverse.ty;
+
+            double coverage = edgeCoverage(          u   * uScale ) *
+                              edgeCoverage( ( width  - u ) * uScale ) *
+                              edgeCoverage(          v   * vScale ) *
+                              edgeCoverage( ( height - v ) * vScale );
+
+            uint8_t * pixel = span + i * 4;
+
+            if ( coverage <= 0 )
+            {
+                memset( pixel, 0, 4 );
+                continue;
+            }
+
+            Lanes sample = fill;
+
+            if ( source != NULL )
+            {
+                sample = filter == rasterFilterBicubic ? sampleBicubic ( source, u, v )
+                                                       : sampleBilinear( source, u, v );
+            }
+
+            lanesStore( pixel, lanesMul( sample, lanesSplat( ( float ) coverage ) ) );
+        }
+
+        spanOver( PIXEL( destination, left, row ), span, count );
+    }
+
+    free( span );
+}
+
+/******************************************************************************\
+ * sampleBilinear()
+ *
+ * Sample an image at a point with bilinear filtering, clamping to its edges.
+ *
+ * In:  Image;
+ *
+ *      Point in the image's pixel space (y up).
+ *
+ * Out: Premultiplied sample, one channel per lane.
+\******************************************************************************/
+
+static Lanes sampleBilinear( const RasterImage * image, double u, double v )
+{
+    double fx = u - 0.5;
+    double fy = v - 0.5;
+    double x0 = floor( fx );
+    double y0 = floor( fy );
+    float  tx = ( float ) ( fx - x0 );
+    float  ty = ( float ) ( fy - y0 );
+
+    int64_t maxX = ( int64_t ) image->width  - 1;
+    int64_t maxY = ( int64_t ) image->height - 1;
+    int64_t xa   = ( int64_t ) x0, xb = xa + 1;
+    int64_t ya   = ( int64_t ) y0, yb = ya + 1;
+
+    xa = xa < 0 ? 0 : xa > maxX ? maxX : xa;
+    xb = xb < 0 ? 0 : xb > maxX ? maxX : xb;
+    ya = ya < 0 ? 0 : ya > maxY ? maxY : ya;
+    yb = yb < 0 ? 0 : yb > maxY ? maxY : yb;
+
+    Lanes r = lanesMul( lanesLoad( PIXEL( image, xa, ya ) ), lanesSplat( ( 1 - tx ) * ( 1 - ty ) ) );
+
+    r = lanesAdd( r, lanesMul( lanesLoad( PIXEL( image, xb, ya ) ), lanesSplat(       tx   * ( 1 - ty ) ) ) );
+    r = lanesAdd( r, lanesMul( lanesLoad( PIXEL( image, xa, yb ) ), lanesSplat( ( 1 - tx ) *       ty   ) ) );
+    r = lanesAdd( r, lanesMul( lanesLoad( PIXEL( image, xb, yb ) ), lanesSplat(       tx   *       ty   ) ) );
+
+    return r;
+}
+
+/******************************************************************************\
+ * sampleBicubic()
+ *
+ * Sample an image at a point with Catmull-Rom bicubic filtering, clamping to
+ * its edges.
+ *
+ * In:  Image;
+ *
+ *      Point in the image's pixel space (y up).
+ *
+ * Out: Premultiplied sample, one channel per lane; may overshoot.
+\******************************************************************************/
+
+static Lanes sampleBicubic( const RasterImage * image, double u, double v )
+{
+    double fx = u - 0.5;
+    double fy = v - 0.5;
+    double x0 = floor( fx );
+    double y0 = floor( fy );
+    float  tx = ( float ) ( fx - x0 );
+    float  ty = ( float ) ( fy - y0 );
+
+    float wx[ 4 ] =
+    {
+        ( ( -0.5f * tx + 1.0f ) * tx - 0.5f ) * tx,
+        (  ( 1.5f * tx - 2.5f ) * tx        ) * tx + 1.0f,
+        ( ( -1.5f * tx + 2.0f ) * tx + 0.5f ) * tx,
+        (  ( 0.5f * tx - 0.5f ) * tx        ) * tx
+    };
+
+    float wy[ 4 ] =
+    {
+        ( ( -0.5f * ty + 1.0f ) * ty - 0.5f ) * ty,
+        (  ( 1.5f * ty - 2.5f ) * ty        ) * ty + 1.0f,
+        ( ( -1.5f * ty + 2.0f ) * ty + 0.5f ) * ty,
+        (  ( 0.5f * ty - 0.5f ) * ty        ) * ty
+    };
+
+    int64_t maxX = ( int64_t ) image->width  - 1;
+    int64_t maxY = ( int64_t ) image->height - 1;
+    Lanes   r    = lanesSplat( 0 );
+
+    for ( int j = 0; j < 4; j ++ )
+    {
+        int64_t y   = ( int64_t ) y0 - 1 + j;
+        Lanes   row = lanesSplat( 0 );
+
+        y = y < 0 ? 0 : y > maxY ? maxY : y;
+
+        for ( int i = 0; i < 4; i ++ )
+        {
+            int64_t x = ( int64_t ) x0 - 1 + i;
+
+            x = x < 0 ? 0 : x > maxX ? maxX : x;
+
+            row = lanesAdd( row, lanesMul( lanesLoad( PIXEL( image, x, y ) ), lanesSplat( wx[ i ] ) ) );
+        }
+
+        r = lanesAdd( r, lanesMul( row, lanesSplat( wy[ j ] ) ) );
+    }
+
+    return r;
+}
+
+/******************************************************************************\
+ * edgeCoverage()
+ *
+ * Return how much of a pixel lies inside an edge, given the distance of its
+ * centre inside the edge in pixels (negative if outside).
+\******************************************************************************/
+
+static double edgeCoverage( double distance )
+{
+    double coverage = distance + 0.5;
+
+    return coverage < 0 ? 0 : coverage > 1 ? 1 : coverage;
+}
+
+/******************************************************************************\
+ * transformThen()
+ *
+ * Return a transformation which applies 'first' and then 'second', as with
+ * CGAffineTransformConcat( first, second ).
+\******************************************************************************/
+
+static RasterTransform transformThen( RasterTransform first, RasterTransform second )
+{
+    RasterTransform r =
+    {
+        second.a * first.a  + second.c * first.b,
+        second.b * first.a  + second.d * first.b,
+        second.a * first.c  + second.c * first.d,
+        second.b * first.c  + second.d * first.d,
+        second.a * first.tx + second.c * first.ty + second.tx,
+        second.b * first.tx + second.d * first.ty + second.ty
+    };
+
+    return r;
+}
+
+/******************************************************************************\
+ * transformTranslate() / transformScale() / transformRotate()
+ *
+ * Return basic transformations; angles are in radians, anticlockwise.
+\******************************************************************************/
+
+static RasterTransform transformTranslate( double x, double y )
+{
+    RasterTransform r = { 1, 0, 0, 1, x, y };
+    return r;
+}
+
+static RasterTransform transformScale( double x, double y )
+{
+    RasterTransform r = { x, 0, 0, y, 0, 0 };
+    return r;
+}
+
+static RasterTransform transformRotate( double angle )
+{
+    RasterTransform r = { cos( angle ), sin( angle ), -sin( angle ), cos( angle ), 0, 0 };
+    return r;
+}
@@ -0,0 +1,334 @@
+/******************************************************************************\
+ * Utilities: ReducedDecode.c
+ *
+ * Reduced-size image decode planning. See "ReducedDecode.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ReducedDecode.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef REDUCED_DECODE_LIBJPEG
+    #include <setjmp.h>
+    #include <stdio.h>
+    #include <jpeglib.h>
+#endif
+
+/******************************************************************************\
+ * requiredScale()
+ *
+ * Return the factor by which an image must be scaled to cover the target, or
+ * 0 if any dimension is zero.
+\******************************************************************************/
+
+static double requiredScale( uint32_t sourceWidth,
+                             uint32_t sourceHeight,
+                             double   targetWidth,
+                             double   targetHeight,
+                             bool     crop )
+{
+    if ( sourceWidth == 0 || sourceHeight == 0 ) return 0;
+    if ( targetWidth <= 0 || targetHeight <= 0 ) return 0;
+
+    if ( crop )
+    {
+        /* The square from the shorter edge is drawn over the whole target */
+
+        double shorter = sourceWidth < sourceHeight ? sourceWidth : sourceHeight;
+        double larger  = targetWidth > targetHeight ? targetWidth : targetHeight;
+
+        return larger / shorter;
+    }
+    else
+    {
+        /* The whole image is fitted within the target */
+
+        double x = targetWidth  / sourceWidth;
+        double y = targetHeight / sourceHeight;
+
+        return x < y ? x : y;
+    }
+}
+
+/******************************************************************************\
+ * reducedDecodePlan()
+ *
+ * Plan the decoding of an image. See "ReducedDecode.h" for details.
+\******************************************************************************/
+
+void reducedDecodePlan( uint32_t            sourceWidth,
+                        uint32_t            sourceHeight,
+                        double              targetWidth,
+                        double              targetHeight,
+                        bool                crop,
+                        ReducedDecodePlan * plan )
+{
+    double scale = requiredScale( sourceWidth, sourceHeight, targetWidth, targetHeight, crop );
+
+    plan->scale                = scale > 0 ? scale : 1;
+    plan->maximumPixelSize     = 0;
+    plan->jpegScaleDenominator = 1;
+
+    if ( scale <= 0 || scale >= 1 ) return;
+
+    uint32_t longer = sourceWidth > sourceHeight ? sourceWidth : sourceHeight;
+
+    plan->maximumPixelSize = ( uint32_t ) ceil( longer * scale );
+
+    /* libjpeg rounds scaled dimensions up, so a denominator is acceptable if
+     * both rounded-up dimensions still cover what's needed.
+     */
+
+    uint32_t neededWidth  = ( uint32_t ) ceil( sourceWidth  * scale );
+    uint32_t neededHeight = ( uint32_t ) ceil( sourceHeight * scale );
+
+    for ( unsigned int denominator = REDUCED_DECODE_MAXIMUM_DENOMINATOR; denominator > 1; denominator /= 2 )
+    {
+        if ( ( sourceWidth  + denominator - 1 ) / denominator >= neededWidth &&
+             ( sourceHeight + denominator - 1 ) / denominator >= neededHeight )
+        {
+            plan->jpegScaleDenominator = denominator;
+            break;
+        }
+    }
+}
+
+/******************************************************************************\
+ * reducedDecodeCovers()
+ *
+ * Does an image of the given size cover a target? See "ReducedDecode.h".
+\******************************************************************************/
+
+bool reducedDecodeCovers( uint32_t sourceWidth,
+                          uint32_t sourceHeight,
+                          double   targetWidth,
+                          double   targetHeight,
+                          bool     crop )
+{
+    double scale = requiredScale( sourceWidth, sourceHeight, targetWidth, targetHeight, crop );
+
+    return scale > 0 && scale <= 1;
+}
+
+/******************************************************************************\
+ * reducedDecodeOrient()
+ *
+ * Work out how to draw a decoded image. See "ReducedDecode.h" for details.
+ *
+ * The orientation matrices are derived from:
+ *
+ *   http://developer.apple.com/library/mac/#samplecode/MyPhoto/Listings/Step8_ImageView_m.html
+ *   http://developer.apple.com/library/mac/#samplecode/CGRotation/Introduction/Intro.html
+\******************************************************************************/
+
+void reducedDecodeOrient( uint32_t            width,
+                          uint32_t            height,
+                          unsigned int        orientation,
+                          double              pixelAspectX,
+                          double              pixelAspectY,
+                          double              targetWidth,
+                          double              targetHeight,
+                          ReducedDecodeFit    fit,
+                          ReducedDecodeDraw * draw )
+{
+    double x = pixelAspectX;
+    double y = pixelAspectY;
+
+    if ( orientation < 1 || orientation > 8 ) orientation = 1;
+
+    /* Size of the image once oriented and corrected for pixel aspect ratio,
+     * allowing for rotation by +/-90 degrees (orientations 5-8).
+     */
+
+    double w = x * width;
+    double h = y * height;
+
+    double orientedWidth  = ( orientation <= 4 ) ? w : h;
+    double orientedHeight = ( orientation <= 4 ) ? h : w;
+
+    const ReducedDecodeTransform orientations[ 8 ] =
+    {
+        {  x,  0,  0,  y, 0, 0 }, /* 1 = row 0 top, col 0 lhs = normal                */
+        { -x,  0,  0,  y, w, 0 }, /* 2 = row 0 top, col 0 rhs = flip horizontal       */
+        { -x,  0,  0, -y, w, h }, /* 3 = row 0 bot, col 0 rhs = rotate 180            */
+        {  x,  0,  0, -y, 0, h }, /* 4 = row 0 bot, col 0 lhs = flip vertical         */
+        {  0, -x, -y,  0, h, w }, /* 5 = row 0 lhs, col 0 top = rot -90, flip vert    */
+        {  0, -x,  y,  0, 0, w }, /* 6 = row 0 rhs, col 0 top = rot 90                */
+        {  0,  x,  y,  0, 0, 0 }, /* 7 = row 0 rhs, col 0 bot = rot 90, flip vert     */
+        {  0,  x, -y,  0, h, 0 }  /* 8 = row 0 lhs, col 0 bot = rotate -90            */
+    };
+
+    /* Work out which part of the oriented image to draw, in its own
+     * coordinates, and how big the thumbnail is.
+     */
+
+    double sourceX      = 0;
+    double sourceY      = 0;
+    double sourceWidth  = orientedWidth;
+    double sourceHeight = orientedHeight;
+    double bitmapWidth  = targetWidth;
+    double bitmapHeight = targetHeight;
+
+    if ( fit == reducedDecodeFitCrop )
+    {
+        if ( orientedWidth > orientedHeight )
+        {
+            sourceX     = ( orientedWidth - orientedHeight ) / 2;
+            sourceWidth = orientedHeight;
+        }
+        else if ( orientedHeight > orientedWidth )
+        {
+            sourceY      = orientedHeight - orientedWidth; /* Top, origin bottom left */
+            sourceHeight = orientedWidth;
+        }
+    }
+    else if ( fit == reducedDecodeFitWhole )
+    {
+        double scaleX = targetWidth  / orientedWidth;
+        double scaleY = targetHeight / orientedHeight;
+        double scale  = scaleX < scaleY ? scaleX : scaleY;
+
+        bitmapWidth  = orientedWidth  * scale;
+        bitmapHeight = orientedHeight * scale;
+    }
+
+    draw->width  = bitmapWidth  >= 1 ? ( uint32_t ) ceil( bitmapWidth  ) : 1;
+    draw->height = bitmapHeight >= 1 ? ( uint32_t ) ceil( bitmapHeight ) : 1;
+
+    /* Orient the image, then map the source rectangle onto the whole bitmap */
+
+    const ReducedDecodeTransform * orient = &orientations[ orientation - 1 ];
+
+    double scaleX = draw->width  / sourceWidth;
+    double scaleY = draw->height / sourceHeight;
+
+    draw->transform.a  = scaleX * orient->a;
+    draw->transform.c  = scaleX * orient->c;
+    draw->transform.tx = scaleX * ( orient->tx - sourceX );
+    draw->transform.b  = scaleY * orient->b;
+    draw->transform.d  = scaleY * orient->d;
+    draw->transform.ty = scaleY * ( orient->ty - sourceY );
+}
+
+#ifdef REDUCED_DECODE_LIBJPEG
+
+/* libjpeg reports fatal errors by calling error_exit(), which must not
+ * return; jump back out to reducedDecodeJPEG() instead.
+ */
+
+typedef struct JPEGErrorManager
+{
+    struct jpeg_error_mgr manager;
+    jmp_buf               recovery;
+
+} JPEGErrorManager;
+
+static void jpegErrorExit( j_common_ptr info )
+{
+    longjmp( ( ( JPEGErrorManager * ) info->err )->recovery, 1 );
+}
+
+static void jpegOutputMessage( j_common_ptr info )
+{
+    ( void ) info; /* Stay quiet; corrupt images are just skipped */
+}
+
+/******************************************************************************\
+ * reducedDecodeJPEG()
+ *
+ * Decode a JPEG file with DCT-domain scaling. See "ReducedDecode.h".
+\******************************************************************************/
+
+int reducedDecodeJPEG( const char              * path,
+                       const ReducedDecodePlan * plan,
+                       ReducedDecodeImage      * image )
+{
+    struct jpeg_decompress_struct   info;
+    JPEGErrorManager                errors;
+    FILE                          * file;
+    uint8_t              * volatile pixels = NULL;
+
+    image->pixels   = NULL;
+    image->width    = 0;
+    image->height   = 0;
+    image->rowBytes = 0;
+
+    file = fopen( path, "rb" );
+    if ( file == NULL ) return errno;
+
+    info.err                     = jpeg_std_error( &errors.manager );
+    errors.manager.error_exit     = jpegErrorExit;
+    errors.manager.output_message = jpegOutputMessage;
+
+    if ( setjmp( errors.recovery ) )
+    {
+        jpeg_destroy_decompress( &info );
+        fclose( file );
+        free( pixels );
+
+        return EINVAL;
+    }
+
+    jpeg_create_decompress( &info );
+    jpeg_stdio_src( &info, file );
+    ( void ) jpeg_read_header( &info, TRUE );
+
+    info.out_color_space = JCS_RGB;
+    info.scale_num       = 1;
+    info.scale_denom     = plan ? plan->jpegScaleDenominator : 1;
+    info.dct_method      = JDCT_ISLOW;
+
+    ( void ) jpeg_start_decompress( &info );
+
+    size_t rowBytes = ( size_t ) info.output_width * 3;
+
+    pixels = malloc( rowBytes * info.output_height );
+
+    if ( pixels == NULL )
+    {
+        jpeg_destroy_decompress( &info );
+        fclose( file );
+
+        return ENOMEM;
+    }
+
+    while ( info.output_scanline < info.output_height )
+    {
+        JSAMPROW row = pixels + rowBytes * info.output_scanline;
+        ( void ) jpeg_read_scanlines( &info, &row, 1 );
+    }
+
+    ( void ) jpeg_finish_decompress( &info );
+
+    image->pixels   = pixels;
+    image->width    = info.output_width;
+    image->height   = info.output_height;
+    image->rowBytes = rowBytes;
+
+    jpeg_destroy_decompress( &info );
+    fclose( file );
+
+    return 0;
+}
+
+/******************************************************************************\
+ * reducedDecodeImageFree()
+ *
+ * Release an image's pixels. See "ReducedDecode.h".
+\******************************************************************************/
+
+void reducedDecodeImageFree( ReducedDecodeImage * image )
+{
+    free( image->pixels );
+
+    image->pixels   = NULL;
+    image->width    = 0;
+    image->height   = 0;
+    image->rowBytes = 0;
+}
+
+#endif /* REDUCED_DECODE_LIBJPEG */
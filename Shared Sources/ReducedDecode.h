@@ -0,0 +1,196 @@
+/******************************************************************************\
+ * Utilities: ReducedDecode.h
+ *
+ * Work out how small an image can be decoded while still covering the area it
+ * will be drawn into, so that large originals (e.g. 20-50 megapixel camera
+ * images) needn't be decoded at full size only to be scaled down to a few
+ * hundred pixels across. Decoders which can produce reduced sizes cheaply -
+ * JPEG's DCT-domain scaling by 1/2, 1/4 or 1/8, or picking a smaller image from
+ * a multi-resolution file - do a fraction of the work and use a fraction of
+ * the memory.
+ *
+ * Once decoded, the image still has to be rotated according to its EXIF
+ * orientation, corrected for any non-square pixels, cropped or fitted and
+ * scaled into the thumbnail. reducedDecodeOrient() works out a single affine
+ * transformation which does all of that, so the decoded image can be drawn
+ * just once, straight into the thumbnail bitmap.
+ *
+ * On macOS, ImageIO does the decoding given a maximum pixel size from the plan.
+ * A portable libjpeg (or libjpeg-turbo) backend is also provided, so that the
+ * savings can be measured on any POSIX system; it is only built if
+ * REDUCED_DECODE_LIBJPEG is defined, and the application does not define it.
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef REDUCED_DECODE_H
+#define REDUCED_DECODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest JPEG DCT-domain scale denominator */
+
+#define REDUCED_DECODE_MAXIMUM_DENOMINATOR 8
+
+typedef struct ReducedDecodePlan
+{
+    double       scale;                /* Scale needed to cover the target; > 0  */
+    uint32_t     maximumPixelSize;     /* Longer edge to decode to, 0 => full    */
+    unsigned int jpegScaleDenominator; /* 1, 2, 4 or 8; DCT scaling which covers */
+
+} ReducedDecodePlan;
+
+/* How an image is made to fit a thumbnail; as ThumbnailCacheMode */
+
+typedef enum ReducedDecodeFit
+{
+    reducedDecodeFitCrop = 0, /* Square crop filling the thumbnail          */
+    reducedDecodeFitWhole,    /* Whole image within it, aspect ratio intact */
+    reducedDecodeFitStretch   /* Whole image stretched to fill it           */
+
+} ReducedDecodeFit;
+
+/* An affine transformation laid out as a CoreGraphics CGAffineTransform, so
+ * that a point (x, y) maps to (a x + c y + tx, b x + d y + ty).
+ */
+
+typedef struct ReducedDecodeTransform
+{
+    double a, b, c, d, tx, ty;
+
+} ReducedDecodeTransform;
+
+/* Where and how to draw a decoded image; see reducedDecodeOrient() */
+
+typedef struct ReducedDecodeDraw
+{
+    uint32_t               width;     /* Of the thumbnail bitmap, in pixels */
+    uint32_t               height;
+    ReducedDecodeTransform transform;
+
+} ReducedDecodeDraw;
+
+/******************************************************************************\
+ * reducedDecodePlan()
+ *
+ * Plan the decoding of an image which is to be drawn into a target area.
+ *
+ * In:  Width and height of the full size image in pixels;
+ *
+ *      Width and height of the target area in device pixels;
+ *
+ *      true if the image will be cropped to a square from its shorter edge
+ *      and that square drawn over the whole target, or false if the whole
+ *      image will be drawn within the target preserving its aspect ratio;
+ *
+ *      Pointer to a plan to fill in. If the image is no bigger than needed,
+ *      or any dimension is zero, the plan is for a full size decode.
+\******************************************************************************/
+
+void reducedDecodePlan( uint32_t            sourceWidth,
+                        uint32_t            sourceHeight,
+                        double              targetWidth,
+                        double              targetHeight,
+                        bool                crop,
+                        ReducedDecodePlan * plan );
+
+/******************************************************************************\
+ * reducedDecodeCovers()
+ *
+ * Out: true if an image of the given size covers the target described by the
+ *      same parameters as for reducedDecodePlan(), else false. Useful for
+ *      choosing between the images in a multi-resolution file.
+\******************************************************************************/
+
+bool reducedDecodeCovers( uint32_t sourceWidth,
+                          uint32_t sourceHeight,
+                          double   targetWidth,
+                          double   targetHeight,
+                          bool     crop );
+
+/******************************************************************************\
+ * reducedDecodeOrient()
+ *
+ * Work out how to draw a decoded image into a thumbnail bitmap in one pass:
+ * oriented according to its EXIF orientation, corrected for non-square pixels,
+ * cropped or fitted, and scaled to the thumbnail.
+ *
+ * Coordinates are those of CoreGraphics, with the origin at the bottom left.
+ * The image is to be drawn into the rectangle (0, 0, width, height) through
+ * the transformation, which maps it onto a bitmap with its origin at (0, 0).
+ * Crops are taken from the middle of landscape images and from the top of
+ * portrait ones, which on average works well for pictures of people.
+ *
+ * In:  Width and height of the decoded image in pixels;
+ *
+ *      EXIF orientation, 1 to 8; anything else is taken as 1;
+ *
+ *      Horizontal and vertical factors by which pixels must be stretched to
+ *      be square; 1 and 1 for square pixels;
+ *
+ *      Width and height of the thumbnail in pixels;
+ *
+ *      How to fit the image. For reducedDecodeFitWhole, the bitmap is smaller
+ *      than the thumbnail along one axis for non-square images;
+ *
+ *      Pointer to a structure filled in with the bitmap size (at least 1x1)
+ *      and the transformation to draw through.
+\******************************************************************************/
+
+void reducedDecodeOrient( uint32_t            width,
+                          uint32_t            height,
+                          unsigned int        orientation,
+                          double              pixelAspectX,
+                          double              pixelAspectY,
+                          double              targetWidth,
+                          double              targetHeight,
+                          ReducedDecodeFit    fit,
+                          ReducedDecodeDraw * draw );
+
+#ifdef REDUCED_DECODE_LIBJPEG
+
+/* 8-bit RGB pixels, top row first */
+
+typedef struct ReducedDecodeImage
+{
+    uint8_t  * pixels;
+    uint32_t   width;
+    uint32_t   height;
+    size_t     rowBytes;
+
+} ReducedDecodeImage;
+
+/******************************************************************************\
+ * reducedDecodeJPEG()
+ *
+ * Decode a JPEG file at the reduced size given by a plan, using DCT-domain
+ * scaling. Only the scaled image is ever held in memory.
+ *
+ * In:  Full path of the JPEG file;
+ *
+ *      Pointer to a plan for the file, or NULL to decode at full size;
+ *
+ *      Pointer to an image to fill in; free with reducedDecodeImageFree().
+ *
+ * Out: 0 on success, else an errno value (EINVAL for corrupt data).
+\******************************************************************************/
+
+int reducedDecodeJPEG( const char              * path,
+                       const ReducedDecodePlan * plan,
+                       ReducedDecodeImage      * image );
+
+/******************************************************************************\
+ * reducedDecodeImageFree()
+ *
+ * Release an image's pixels and reset it to empty.
+\******************************************************************************/
+
+void reducedDecodeImageFree( ReducedDecodeImage * image );
+
+#endif /* REDUCED_DECODE_LIBJPEG */
+
+#endif /* REDUCED_DECODE_H */
@@ -0,0 +1,180 @@
+/******************************************************************************\
+ * Utilities: ReservoirSampler.c
+ *
+ * Single-pass uniform random sampling. See "ReservoirSampler.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ReservoirSampler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Local functions */
+
+static uint64_t nextRandom   ( ReservoirSampler * sampler );
+static uint64_t randomBelow  ( ReservoirSampler * sampler, uint64_t limit );
+
+/******************************************************************************\
+ * reservoirSamplerInit()
+ *
+ * Initialise a sampler. See "ReservoirSampler.h" for details.
+\******************************************************************************/
+
+void reservoirSamplerInit( ReservoirSampler * sampler,
+                           size_t             capacity,
+                           uint64_t           seed,
+                           bool               keepFirst )
+{
+    if      ( capacity < 1                         ) capacity = 1;
+    else if ( capacity > RESERVOIR_SAMPLER_MAXIMUM ) capacity = RESERVOIR_SAMPLER_MAXIMUM;
+
+    memset( sampler, 0, sizeof( ReservoirSampler ) );
+
+    sampler->capacity  = capacity;
+    sampler->state     = seed;
+    sampler->keepFirst = keepFirst;
+}
+
+/******************************************************************************\
+ * reservoirSamplerOffer()
+ *
+ * Offer an item to the sampler. See "ReservoirSampler.h" for details.
+\******************************************************************************/
+
+bool reservoirSamplerOffer( ReservoirSampler * sampler, const char * item )
+{
+    size_t slot;
+
+    if ( sampler->count < sampler->capacity )
+    {
+        slot = sampler->count;
+    }
+    else if ( sampler->keepFirst )
+    {
+        return false;
+    }
+    else
+    {
+        /* Item number 'seen' (counting from zero) replaces a random held item
+         * with probability capacity / ( seen + 1 ).
+         */
+
+        uint64_t pick = randomBelow( sampler, sampler->seen + 1 );
+
+        if ( pick >= sampler->capacity )
+        {
+            sampler->seen ++;
+            return true;
+        }
+
+        slot = ( size_t ) pick;
+    }
+
+    char * copy = strdup( item );
+    if ( copy == NULL ) return false;
+
+    if ( slot < sampler->count )
+    {
+        free( sampler->items[ slot ] );
+    }
+    else
+    {
+        sampler->count ++;
+    }
+
+    sampler->items[ slot ] = copy;
+    sampler->seen ++;
+
+    return true;
+}
+
+/******************************************************************************\
+ * reservoirSamplerFinish()
+ *
+ * Shuffle the sample in random mode. See "ReservoirSampler.h" for details.
+\******************************************************************************/
+
+size_t reservoirSamplerFinish( ReservoirSampler * sampler )
+{
+    if ( sampler->keepFirst == false )
+    {
+        for ( size_t index = sampler->count; index > 1; index -- )
+        {
+            size_t other = ( size_t ) randomBelow( sampler, index );
+            char * swap  = sampler->items[ index - 1 ];
+
+            sampler->items[ index - 1 ] = sampler->items[ other ];
+            sampler->items[ other     ] = swap;
+        }
+    }
+
+    return sampler->count;
+}
+
+/******************************************************************************\
+ * reservoirSamplerItem()
+ *
+ * Return an item from the sample. See "ReservoirSampler.h" for details.
+\******************************************************************************/
+
+const char * reservoirSamplerItem( const ReservoirSampler * sampler, size_t index )
+{
+    return index < sampler->count ? sampler->items[ index ] : NULL;
+}
+
+/******************************************************************************\
+ * reservoirSamplerFree()
+ *
+ * Release memory held by a sampler. See "ReservoirSampler.h" for details.
+\******************************************************************************/
+
+void reservoirSamplerFree( ReservoirSampler * sampler )
+{
+    for ( size_t index = 0; index < sampler->count; index ++ )
+    {
+        free( sampler->items[ index ] );
+        sampler->items[ index ] = NULL;
+    }
+
+    sampler->count = 0;
+}
+
+/******************************************************************************\
+ * nextRandom()
+ *
+ * Internal - advance the sampler's SplitMix64 generator and return the next
+ * 64-bit pseudo-random value.
+\******************************************************************************/
+
+static uint64_t nextRandom( ReservoirSampler * sampler )
+{
+    uint64_t z = ( sampler->state += 0x9E3779B97F4A7C15ULL );
+
+    z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+
+    return z ^ ( z >> 31 );
+}
+
+/******************************************************************************\
+ * randomBelow()
+ *
+ * Internal - return a uniformly distributed value from 0 to limit - 1, using
+ * rejection to avoid the bias that a plain modulus would introduce.
+\******************************************************************************/
+
+static uint64_t randomBelow( ReservoirSampler * sampler, uint64_t limit )
+{
+    uint64_t threshold = ( 0 - limit ) % limit;
+    uint64_t value;
+
+    do
+    {
+        value = nextRandom( sampler );
+    }
+    while ( value < threshold );
+
+    return value % limit;
+}
@@ -0,0 +1,112 @@
+/******************************************************************************\
+ * Utilities: ReservoirSampler.h
+ *
+ * Single-pass uniform random sampling of up to RESERVOIR_SAMPLER_MAXIMUM
+ * strings from a stream of unknown length ("Algorithm R"). Memory use is
+ * constant however many items are offered, and every item offered has an
+ * equal chance of being in the final sample. The pseudo-random sequence is
+ * driven by an explicit seed, so a given seed and input stream always give
+ * the same result.
+ *
+ * This is plain C with no Cocoa dependencies. A sampler is not thread-safe;
+ * callers offering items from several threads must serialise their calls.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef RESERVOIR_SAMPLER_H
+#define RESERVOIR_SAMPLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most items a sampler can hold; matches the most thumbnails in an icon */
+
+#define RESERVOIR_SAMPLER_MAXIMUM 4
+
+typedef struct ReservoirSampler
+{
+    size_t     capacity;  /* Sample size requested, 1 to RESERVOIR_SAMPLER_MAXIMUM */
+    size_t     count;     /* Items currently held                               */
+    uint64_t   seen;      /* Items offered so far                               */
+    uint64_t   state;     /* Pseudo-random generator state                      */
+    bool       keepFirst; /* Keep the first items offered rather than sampling  */
+    char     * items[ RESERVOIR_SAMPLER_MAXIMUM ];
+
+} ReservoirSampler;
+
+/******************************************************************************\
+ * reservoirSamplerInit()
+ *
+ * Initialise a sampler.
+ *
+ * In:  Pointer to the sampler to initialise;
+ *
+ *      Sample size wanted; clamped to 1 to RESERVOIR_SAMPLER_MAXIMUM;
+ *
+ *      Seed for the pseudo-random generator;
+ *
+ *      true to keep the first items offered, in order, rather than sampling
+ *      (useful for stable previews); false for a uniform random sample.
+\******************************************************************************/
+
+void reservoirSamplerInit( ReservoirSampler * sampler,
+                           size_t             capacity,
+                           uint64_t           seed,
+                           bool               keepFirst );
+
+/******************************************************************************\
+ * reservoirSamplerOffer()
+ *
+ * Offer an item to the sampler. A private copy is taken if it is kept.
+ *
+ * In:  Pointer to the sampler;
+ *
+ *      NUL terminated string to offer.
+ *
+ * Out: false if more items are pointless (only in "keep first" mode, once
+ *      full) or if memory ran out copying the item; else true.
+\******************************************************************************/
+
+bool reservoirSamplerOffer( ReservoirSampler * sampler, const char * item );
+
+/******************************************************************************\
+ * reservoirSamplerFinish()
+ *
+ * Call once all items have been offered. In random mode the held items are
+ * shuffled, since Algorithm R leaves early items in early slots.
+ *
+ * In:  Pointer to the sampler.
+ *
+ * Out: Number of items in the sample, which can be read with
+ *      reservoirSamplerItem().
+\******************************************************************************/
+
+size_t reservoirSamplerFinish( ReservoirSampler * sampler );
+
+/******************************************************************************\
+ * reservoirSamplerItem()
+ *
+ * Return an item from the sample.
+ *
+ * In:  Pointer to the sampler;
+ *
+ *      Index from 0 to one less than the number of items held.
+ *
+ * Out: Pointer to the sampler's copy of the item; valid until the sampler is
+ *      freed.
+\******************************************************************************/
+
+const char * reservoirSamplerItem( const ReservoirSampler * sampler, size_t index );
+
+/******************************************************************************\
+ * reservoirSamplerFree()
+ *
+ * Release memory held by a sampler. The sampler structure itself is owned by
+ * the caller and is not freed; it may be initialised again and reused.
+\******************************************************************************/
+
+void reservoirSamplerFree( ReservoirSampler * sampler );
+
+#endif /* RESERVOIR_SAMPLER_H */
@@ -0,0 +1,612 @@
+/******************************************************************************\
+ * Utilities: ResourceForkWriter.c
+ *
+ * Give a file or folder a custom icon without the Carbon Resource Manager.
+ * See "ResourceForkWriter.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ResourceForkWriter.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/xattr.h>
+
+/* Extended attribute names and calls, which differ between platforms */
+
+#ifdef __APPLE__
+    #define RESOURCE_FORK_ATTRIBUTE XATTR_RESOURCEFORK_NAME
+    #define FINDER_INFO_ATTRIBUTE   XATTR_FINDERINFO_NAME
+    #define ICON_HASH_ATTRIBUTE     "uk.org.pond.addfoldericons.icnshash"
+    #define NO_ATTRIBUTE            ENOATTR
+
+    #define getAttribute( path, name, value, size ) getxattr   ( path, name, value, size, 0, XATTR_NOFOLLOW )
+    #define setAttribute( path, name, value, size ) setxattr   ( path, name, value, size, 0, XATTR_NOFOLLOW )
+    #define removeAttribute( path, name )           removexattr( path, name, XATTR_NOFOLLOW )
+#else
+    #define RESOURCE_FORK_ATTRIBUTE "user.com.apple.ResourceFork"
+    #define FINDER_INFO_ATTRIBUTE   "user.com.apple.FinderInfo"
+    #define ICON_HASH_ATTRIBUTE     "user.uk.org.pond.addfoldericons.icnshash"
+    #define NO_ATTRIBUTE            ENODATA
+
+    #define getAttribute( path, name, value, size ) lgetxattr   ( path, name, value, size )
+    #define setAttribute( path, name, value, size ) lsetxattr   ( path, name, value, size, 0 )
+    #define removeAttribute( path, name )           lremovexattr( path, name )
+#endif
+
+/* Resource fork layout: a header, then the resource data starting at a fixed
+ * offset (each resource being a 4-byte length then its bytes), then the map.
+ * The map built here has a header, a type list with one type and a reference
+ * list with one resource, and an empty name list.
+ */
+
+#define FORK_HEADER_SIZE   16
+#define DATA_OFFSET        256
+#define MAP_HEADER_SIZE    28
+#define TYPE_LIST_SIZE     10
+#define REFERENCE_SIZE     12
+#define MAP_SIZE           ( MAP_HEADER_SIZE + TYPE_LIST_SIZE + REFERENCE_SIZE )
+#define LARGEST_FORK       0x1000000 /* 16MB, the Resource Manager's limit */
+
+/* Finder information: 32 bytes, with the type and creator (files only) then
+ * the Finder flags, big-endian.
+ */
+
+#define FINDER_INFO_SIZE   32
+#define FINDER_FLAGS       8
+#define HAS_CUSTOM_ICON    0x0400 /* kHasCustomIcon */
+#define IS_INVISIBLE       0x4000 /* kIsInvisible   */
+#define ICON_FILE_TYPE     0x69636F6E /* 'icon' */
+#define ICON_FILE_CREATOR  0x4D414353 /* 'MACS' */
+
+/* Static function prototypes */
+
+static int      updateFinderInfo ( const char    * path,
+                                   uint32_t        type,
+                                   uint32_t        creator,
+                                   uint16_t        flags );
+
+static int      checkExistingFork( const char    * path );
+
+static char   * iconFilePath     ( const char    * path );
+
+static void     put64            ( uint8_t       * bytes,
+                                   uint64_t        value );
+
+static void     put32            ( uint8_t       * bytes,
+                                   uint32_t        value );
+
+static void     put16            ( uint8_t       * bytes,
+                                   uint16_t        value );
+
+static uint32_t get32            ( const uint8_t * bytes );
+
+static uint16_t get16            ( const uint8_t * bytes );
+
+static uint64_t get64            ( const uint8_t * bytes );
+
+/******************************************************************************\
+ * resourceForkSize()
+ *
+ * Work out how big a resource fork holding just a custom icon will be. See
+ * "ResourceForkWriter.h".
+\******************************************************************************/
+
+size_t resourceForkSize( size_t icnsSize )
+{
+    return DATA_OFFSET + 4 + icnsSize + MAP_SIZE;
+}
+
+/******************************************************************************\
+ * resourceForkBuild()
+ *
+ * Build a resource fork holding just a custom icon. See "ResourceForkWriter.h".
+\******************************************************************************/
+
+size_t resourceForkBuild( const uint8_t * icns,
+                          size_t          icnsSize,
+                          uint8_t       * fork,
+                          size_t          forkSize )
+{
+    size_t size = resourceForkSize( icnsSize );
+
+    if ( size > forkSize || size > LARGEST_FORK ) return 0;
+
+    size_t    mapOffset = DATA_OFFSET + 4 + icnsSize;
+    uint8_t * map       = fork + mapOffset;
+
+    /* Header, then the unused space up to the data */
+
+    memset( fork, 0, DATA_OFFSET );
+
+    put32( fork,      DATA_OFFSET                     );
+    put32( fork + 4,  ( uint32_t ) mapOffset          );
+    put32( fork + 8,  ( uint32_t ) ( 4 + icnsSize )   );
+    put32( fork + 12, MAP_SIZE                        );
+
+    /* The one resource */
+
+    put32 ( fork + DATA_OFFSET, ( uint32_t ) icnsSize );
+    memcpy( fork + DATA_OFFSET + 4, icns, icnsSize );
+
+    /* The map, starting with a copy of the header; the next map handle, file
+     * reference number and attributes are all zero.
+     */
+
+    memset( map, 0, MAP_SIZE );
+    memcpy( map, fork, FORK_HEADER_SIZE );
+
+    put16( map + 24, MAP_HEADER_SIZE ); /* Offset to type list         */
+    put16( map + 26, MAP_SIZE        ); /* Offset to (empty) name list */
+
+    uint8_t * types = map + MAP_HEADER_SIZE;
+
+    put16( types,     0                       ); /* Number of types - 1      */
+    put32( types + 2, RESOURCE_FORK_ICON_TYPE ); /* Type                     */
+    put16( types + 6, 0                       ); /* Number of resources - 1  */
+    put16( types + 8, TYPE_LIST_SIZE          ); /* Offset to reference list */
+
+    uint8_t * reference = types + TYPE_LIST_SIZE;
+
+    put16( reference,     ( uint16_t ) RESOURCE_FORK_ICON_ID ); /* ID      */
+    put16( reference + 2, 0xFFFF                             ); /* No name */
+
+    /* Attributes and the offset to the data, both zero, then a zero handle */
+
+    return size;
+}
+
+/******************************************************************************\
+ * resourceForkFind()
+ *
+ * Find a resource in a resource fork. See "ResourceForkWriter.h".
+\******************************************************************************/
+
+bool resourceForkFind( const uint8_t  * fork,
+                       size_t           forkSize,
+                       uint32_t         type,
+                       int16_t          id,
+                       const uint8_t ** data,
+                       size_t         * dataSize )
+{
+    if ( resourceForkCount( fork, forkSize ) < 0 ) return false;
+
+    size_t          dataOffset = get32( fork );
+    size_t          dataLength = get32( fork + 8 );
+    const uint8_t * map        = fork + get32( fork + 4 );
+    const uint8_t * types      = map  + get16( map  + 24 );
+    size_t          typeCount  = ( get16( types ) + 1 ) & 0xFFFF;
+
+    for ( size_t t = 0; t < typeCount; t ++ )
+    {
+        const uint8_t * entry = types + 2 + t * 8;
+
+        if ( get32( entry ) != type ) continue;
+
+        size_t          count      = get16( entry + 4 ) + 1;
+        const uint8_t * references = types + get16( entry + 6 );
+
+        for ( size_t r = 0; r < count; r ++ )
+        {
+            const uint8_t * reference = references + r * REFERENCE_SIZE;
+
+            if ( ( int16_t ) get16( reference ) != id ) continue;
+
+            size_t offset = get32( reference + 4 ) & 0xFFFFFF;
+
+            if ( offset + 4 > dataLength ) return false;
+
+            size_t length = get32( fork + dataOffset + offset );
+
+            if ( length > dataLength - offset - 4 ) return false;
+
+            *data     = fork + dataOffset + offset + 4;
+            *dataSize = length;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * resourceForkCount()
+ *
+ * Count the resources in a resource fork. See "ResourceForkWriter.h". Checks
+ * that the whole map lies within the fork, so that resourceForkFind() can walk
+ * it without further checks.
+\******************************************************************************/
+
+long resourceForkCount( const uint8_t * fork, size_t forkSize )
+{
+    if ( forkSize < FORK_HEADER_SIZE ) return -1;
+
+    size_t dataOffset = get32( fork );
+    size_t mapOffset  = get32( fork + 4 );
+    size_t dataLength = get32( fork + 8 );
+    size_t mapLength  = get32( fork + 12 );
+
+    if ( dataOffset > forkSize || dataLength > forkSize - dataOffset ) return -1;
+    if ( mapOffset  > forkSize || mapLength  > forkSize - mapOffset  ) return -1;
+    if ( mapLength  < MAP_HEADER_SIZE + 2                            ) return -1;
+
+    const uint8_t * map        = fork + mapOffset;
+    size_t          typeOffset = get16( map + 24 );
+
+    if ( typeOffset + 2 > mapLength ) return -1;
+
+    const uint8_t * types     = map + typeOffset;
+    size_t          typeCount = ( get16( types ) + 1 ) & 0xFFFF;
+    long            total     = 0;
+
+    if ( typeOffset + 2 + typeCount * 8 > mapLength ) return -1;
+
+    for ( size_t t = 0; t < typeCount; t ++ )
+    {
+        const uint8_t * entry           = types + 2 + t * 8;
+        size_t          count           = get16( entry + 4 ) + 1;
+        size_t          referenceOffset = typeOffset + get16( entry + 6 );
+
+        if ( referenceOffset + count * REFERENCE_SIZE > mapLength ) return -1;
+
+        total += ( long ) count;
+    }
+
+    return total;
+}
+
+/******************************************************************************\
+ * resourceForkSaveCustomIcon()
+ *
+ * Give a file or folder a custom icon. See "ResourceForkWriter.h".
+\******************************************************************************/
+
+int resourceForkSaveCustomIcon( const char    * path,
+                                bool            isDirectory,
+                                const uint8_t * icns,
+                                size_t          icnsSize )
+{
+    size_t    size   = resourceForkSize( icnsSize );
+    uint8_t * fork   = malloc( size );
+    char    * target = NULL;
+    int       error  = 0;
+
+    if ( fork == NULL ) return ENOMEM;
+
+    if ( resourceForkBuild( icns, icnsSize, fork, size ) != size )
+    {
+        error = EFBIG;
+        goto bailOut;
+    }
+
+    if ( isDirectory )
+    {
+        /* The "Icon\r" file is ours, so any existing fork is just replaced */
+
+        target = iconFilePath( path );
+
+        if ( target == NULL )
+        {
+            error = ENOMEM;
+            goto bailOut;
+        }
+
+        int fd = open( target, O_WRONLY | O_CREAT, 0644 );
+
+        if ( fd < 0 )
+        {
+            error = errno;
+            goto bailOut;
+        }
+
+        close( fd );
+
+        error = updateFinderInfo( target, ICON_FILE_TYPE, ICON_FILE_CREATOR, IS_INVISIBLE );
+        if ( error ) goto bailOut;
+    }
+    else
+    {
+        error = checkExistingFork( path );
+
+        /* The caller will merge the icon in with the Resource Manager, which
+         * knows nothing of hashes, so drop any left from when the fork held
+         * only an icon written here.
+         */
+
+        if ( error == EEXIST ) ( void ) removeAttribute( path, ICON_HASH_ATTRIBUTE );
+        if ( error ) goto bailOut;
+    }
+
+    /* Remove any old fork first, as writing a shorter one over it may leave
+     * the end of the old one in place. Its hash goes first of all, so that a
+     * hash is never left describing a fork it doesn't match.
+     */
+
+    const char * forkPath = target ? target : path;
+
+    if ( ( removeAttribute( forkPath, ICON_HASH_ATTRIBUTE     ) != 0 && errno != NO_ATTRIBUTE ) ||
+         ( removeAttribute( forkPath, RESOURCE_FORK_ATTRIBUTE ) != 0 && errno != NO_ATTRIBUTE ) )
+    {
+        error = errno;
+        goto bailOut;
+    }
+
+    if ( setAttribute( forkPath, RESOURCE_FORK_ATTRIBUTE, fork, size ) != 0 )
+    {
+        error = errno;
+        goto bailOut;
+    }
+
+    /* The hash is only an optimisation for resourceForkHasCustomIcon(), so
+     * failing to store it doesn't matter.
+     */
+
+    uint8_t hash[ 8 ];
+
+    put64( hash, resourceForkHash( icns, icnsSize ) );
+    ( void ) setAttribute( forkPath, ICON_HASH_ATTRIBUTE, hash, sizeof( hash ) );
+
+    error = updateFinderInfo( path, 0, 0, HAS_CUSTOM_ICON );
+
+bailOut:
+
+    free( fork   );
+    free( target );
+
+    return error;
+}
+
+/******************************************************************************\
+ * resourceForkHasCustomIcon()
+ *
+ * Does a file or folder already have exactly the given custom icon? See
+ * "ResourceForkWriter.h".
+\******************************************************************************/
+
+bool resourceForkHasCustomIcon( const char    * path,
+                                bool            isDirectory,
+                                const uint8_t * icns,
+                                size_t          icnsSize )
+{
+    uint8_t info[ FINDER_INFO_SIZE ];
+    uint8_t hash[ 8 ];
+    bool    same   = false;
+    char  * target = NULL;
+
+    if ( getAttribute( path, FINDER_INFO_ATTRIBUTE, info, sizeof( info ) ) != sizeof( info ) ) return false;
+    if ( ( get16( info + FINDER_FLAGS ) & HAS_CUSTOM_ICON ) == 0                            ) return false;
+
+    if ( isDirectory && ( target = iconFilePath( path ) ) == NULL ) return false;
+
+    const char * forkPath = target ? target : path;
+    size_t       size     = resourceForkSize( icnsSize );
+
+    if ( getAttribute( forkPath, RESOURCE_FORK_ATTRIBUTE, NULL, 0 ) != ( ssize_t ) size ) goto bailOut;
+
+    if ( getAttribute( forkPath, ICON_HASH_ATTRIBUTE, hash, sizeof( hash ) ) == sizeof( hash ) )
+    {
+        same = get64( hash ) == resourceForkHash( icns, icnsSize );
+    }
+    else
+    {
+        uint8_t * fork = malloc( size );
+
+        if ( fork && getAttribute( forkPath, RESOURCE_FORK_ATTRIBUTE, fork, size ) == ( ssize_t ) size )
+        {
+            const uint8_t * data;
+            size_t          dataSize;
+
+            same = resourceForkFind( fork, size, RESOURCE_FORK_ICON_TYPE, RESOURCE_FORK_ICON_ID, &data, &dataSize ) &&
+                   dataSize == icnsSize &&
+                   memcmp( data, icns, icnsSize ) == 0;
+        }
+
+        free( fork );
+    }
+
+bailOut:
+
+    free( target );
+    return same;
+}
+
+/******************************************************************************\
+ * resourceForkHash()
+ *
+ * Hash a block of data quickly. See "ResourceForkWriter.h". Works through the
+ * data eight bytes at a time, multiplying and rotating, then mixes the result
+ * thoroughly at the end.
+\******************************************************************************/
+
+uint64_t resourceForkHash( const uint8_t * data, size_t size )
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ ( size * 0xC2B2AE3D27D4EB4FULL );
+    size_t   i    = 0;
+
+    for ( ; i + 8 <= size; i += 8 )
+    {
+        uint64_t word;
+
+        memcpy( &word, data + i, sizeof( word ) );
+
+        hash ^= word * 0xC2B2AE3D27D4EB4FULL;
+        hash  = ( ( hash << 31 ) | ( hash >> 33 ) ) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    for ( ; i < size; i ++ )
+    {
+        hash = ( hash ^ data[ i ] ) * 0x100000001B3ULL;
+    }
+
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94D049BB133111EBULL;
+
+    return hash ^ ( hash >> 31 );
+}
+
+/******************************************************************************\
+ * updateFinderInfo()
+ *
+ * Set Finder flags, and optionally the file type and creator, in an item's
+ * Finder information, leaving everything else as it was.
+ *
+ * In:  POSIX path of the item;
+ *
+ *      File type to set, or 0 to leave it alone;
+ *
+ *      File creator to set, or 0 to leave it alone;
+ *
+ *      Finder flags to set.
+ *
+ * Out: 0 if all went well, else an errno value.
+\******************************************************************************/
+
+static int updateFinderInfo( const char * path,
+                             uint32_t     type,
+                             uint32_t     creator,
+                             uint16_t     flags )
+{
+    uint8_t info[ FINDER_INFO_SIZE ] = { 0 };
+    ssize_t length                   = getAttribute( path, FINDER_INFO_ATTRIBUTE, info, sizeof( info ) );
+
+    if ( length < 0 && errno != NO_ATTRIBUTE ) return errno;
+
+    if ( type    ) put32( info,     type    );
+    if ( creator ) put32( info + 4, creator );
+
+    put16( info + FINDER_FLAGS, get16( info + FINDER_FLAGS ) | flags );
+
+    return setAttribute( path, FINDER_INFO_ATTRIBUTE, info, sizeof( info ) ) == 0 ? 0 : errno;
+}
+
+/******************************************************************************\
+ * checkExistingFork()
+ *
+ * Check that a file's resource fork, if it has one, can safely be replaced by
+ * one holding just a custom icon.
+ *
+ * In:  POSIX path of the file.
+ *
+ * Out: 0 if there's no fork, it's empty or it holds only a custom icon; EEXIST
+ *      if it holds anything else (or can't be understood); else an errno
+ *      value.
+\******************************************************************************/
+
+static int checkExistingFork( const char * path )
+{
+    ssize_t size = getAttribute( path, RESOURCE_FORK_ATTRIBUTE, NULL, 0 );
+
+    if ( size < 0 ) return errno == NO_ATTRIBUTE ? 0 : errno;
+    if ( size == 0 ) return 0;
+
+    uint8_t * fork = malloc( ( size_t ) size );
+
+    if ( fork == NULL ) return ENOMEM;
+
+    int     error = EEXIST;
+    ssize_t got   = getAttribute( path, RESOURCE_FORK_ATTRIBUTE, fork, ( size_t ) size );
+
+    if ( got < 0 )
+    {
+        error = errno;
+    }
+    else
+    {
+        const uint8_t * data;
+        size_t          dataSize;
+        long            count = resourceForkCount( fork, ( size_t ) got );
+
+        if ( count == 0 ||
+             ( count == 1 && resourceForkFind( fork, ( size_t ) got, RESOURCE_FORK_ICON_TYPE, RESOURCE_FORK_ICON_ID, &data, &dataSize ) ) )
+        {
+            error = 0;
+        }
+    }
+
+    free( fork );
+    return error;
+}
+
+/******************************************************************************\
+ * iconFilePath()
+ *
+ * Build the path of the "Icon\r" file inside a folder.
+ *
+ * In:  POSIX path of the folder.
+ *
+ * Out: malloc'd path which the caller must free(), or NULL if out of memory.
+\******************************************************************************/
+
+static char * iconFilePath( const char * path )
+{
+    size_t length = strlen( path ) + sizeof( "/Icon\r" );
+    char * target = malloc( length );
+
+    if ( target ) snprintf( target, length, "%s/Icon\r", path );
+
+    return target;
+}
+
+/******************************************************************************\
+ * put64(), put32(), put16()
+ *
+ * Write a 64, 32 or 16-bit value as big-endian bytes.
+ *
+ * In:  Where to write;
+ *
+ *      Value to write.
+\******************************************************************************/
+
+static void put64( uint8_t * bytes, uint64_t value )
+{
+    put32( bytes,     ( uint32_t ) ( value >> 32 ) );
+    put32( bytes + 4, ( uint32_t ) ( value       ) );
+}
+
+static void put32( uint8_t * bytes, uint32_t value )
+{
+    bytes[ 0 ] = ( uint8_t ) ( value >> 24 );
+    bytes[ 1 ] = ( uint8_t ) ( value >> 16 );
+    bytes[ 2 ] = ( uint8_t ) ( value >>  8 );
+    bytes[ 3 ] = ( uint8_t ) ( value       );
+}
+
+static void put16( uint8_t * bytes, uint16_t value )
+{
+    bytes[ 0 ] = ( uint8_t ) ( value >> 8 );
+    bytes[ 1 ] = ( uint8_t ) ( value      );
+}
+
+/******************************************************************************\
+ * get64(), get32(), get16()
+ *
+ * Read a 64, 32 or 16-bit value from big-endian bytes.
+ *
+ * In:  Where to read from.
+ *
+ * Out: Value read.
+\******************************************************************************/
+
+static uint64_t get64( const uint8_t * bytes )
+{
+    return ( ( uint64_t ) get32( bytes ) << 32 ) | get32( bytes + 4 );
+}
+
+static uint32_t get32( const uint8_t * bytes )
+{
+    return ( ( uint32_t ) bytes[ 0 ] << 24 ) |
+           ( ( uint32_t ) bytes[ 1 ] << 16 ) |
+           ( ( uint32_t ) bytes[ 2 ] <<  8 ) |
+           ( ( uint32_t ) bytes[ 3 ]       );
+}
+
+static uint16_t get16( const uint8_t * bytes )
+{
+    return ( uint16_t ) ( ( bytes[ 0 ] << 8 ) | bytes[ 1 ] );
+}
@@ -0,0 +1,184 @@
+/******************************************************************************\
+ * Utilities: ResourceForkWriter.h
+ *
+ * Give a file or folder a custom icon without the Carbon Resource Manager.
+ * The Resource Manager keeps process-wide state (the current resource file,
+ * the resource chain), so callers of it must take turns; this builds a whole
+ * resource fork holding just one 'icns' resource in memory instead, writes it
+ * in a single operation and sets the "has custom icon" Finder flag directly,
+ * so icons for different folders can be written at the same time.
+ *
+ * Folders keep their custom icon in the resource fork of an invisible file
+ * called "Icon\r" inside them; files keep it in their own resource fork.
+ * Forks and Finder information are written via the "com.apple.ResourceFork"
+ * and "com.apple.FinderInfo" extended attributes, which on macOS map to the
+ * real thing. Elsewhere (e.g. Linux, for testing) they are ordinary "user."
+ * namespace attributes of the same names.
+ *
+ * Alongside each fork written, a hash of the icon family is kept in another
+ * extended attribute so that a later run can tell that the icon it's about to
+ * write is already there without reading the fork back.
+ *
+ * This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef RESOURCE_FORK_WRITER_H
+#define RESOURCE_FORK_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Type and ID of the custom icon resource (kCustomIconResource) */
+
+#define RESOURCE_FORK_ICON_TYPE  0x69636E73 /* 'icns' */
+#define RESOURCE_FORK_ICON_ID    ( -16455 )
+
+/******************************************************************************\
+ * resourceForkSize()
+ *
+ * Work out how big a resource fork holding just a custom icon will be.
+ *
+ * In:  Size of the icon family data in bytes.
+ *
+ * Out: Size of the resource fork in bytes.
+\******************************************************************************/
+
+size_t resourceForkSize( size_t icnsSize );
+
+/******************************************************************************\
+ * resourceForkBuild()
+ *
+ * Build a resource fork holding just a custom icon: the fork header, the
+ * icon family data, and a resource map listing it as 'icns' ID -16455.
+ *
+ * In:  Icon family data, e.g. from icnsWrite() in "IcnsWriter.h";
+ *
+ *      Size of the icon family data in bytes;
+ *
+ *      Buffer to write the fork into;
+ *
+ *      Size of the buffer in bytes, usually from resourceForkSize().
+ *
+ * Out: Bytes written, or 0 if the buffer was too small or the icon family is
+ *      too big for a resource fork.
+\******************************************************************************/
+
+size_t resourceForkBuild( const uint8_t * icns,
+                          size_t          icnsSize,
+                          uint8_t       * fork,
+                          size_t          forkSize );
+
+/******************************************************************************\
+ * resourceForkFind()
+ *
+ * Find a resource in a resource fork - any fork, not just one built here.
+ *
+ * In:  Resource fork data;
+ *
+ *      Size of the resource fork data in bytes;
+ *
+ *      Type and ID of the resource to find;
+ *
+ *      Pointer to a pointer updated to point at the resource's data;
+ *
+ *      Pointer to a size_t updated with the size of that data in bytes.
+ *
+ * Out: true if found, false if not found or the fork is damaged.
+\******************************************************************************/
+
+bool resourceForkFind( const uint8_t  * fork,
+                       size_t           forkSize,
+                       uint32_t         type,
+                       int16_t          id,
+                       const uint8_t ** data,
+                       size_t         * dataSize );
+
+/******************************************************************************\
+ * resourceForkCount()
+ *
+ * Count the resources in a resource fork.
+ *
+ * In:  Resource fork data;
+ *
+ *      Size of the resource fork data in bytes.
+ *
+ * Out: Number of resources, or -1 if the fork is damaged.
+\******************************************************************************/
+
+long resourceForkCount( const uint8_t * fork, size_t forkSize );
+
+/******************************************************************************\
+ * resourceForkSaveCustomIcon()
+ *
+ * Give a file or folder a custom icon. Safe to call from several threads at
+ * once, provided that they're working on different paths.
+ *
+ * A file's existing resource fork is replaced, so if it holds anything other
+ * than a custom icon, nothing is written and EEXIST is returned; the caller
+ * must then fall back to the Resource Manager, which can merge the icon in.
+ * Any hash stored with an earlier fork is removed first, as it won't describe
+ * what the Resource Manager writes.
+ *
+ * In:  POSIX path of the file or folder;
+ *
+ *      true if it's a folder, else false;
+ *
+ *      Icon family data;
+ *
+ *      Size of the icon family data in bytes.
+ *
+ * Out: 0 if all went well, else an errno value.
+\******************************************************************************/
+
+int resourceForkSaveCustomIcon( const char    * path,
+                                bool            isDirectory,
+                                const uint8_t * icns,
+                                size_t          icnsSize );
+
+/******************************************************************************\
+ * resourceForkHasCustomIcon()
+ *
+ * Does a file or folder already have exactly the given custom icon? True only
+ * if its Finder flags say it has a custom icon, its resource fork is the size
+ * that resourceForkSaveCustomIcon() would write, and the icon family in it is
+ * the same. The last is judged by the hash stored when the fork was written
+ * or, for forks written some other way, by reading the fork and comparing.
+ *
+ * Something else rewriting the fork with one of exactly the same size, but
+ * not updating the hash, would fool this; nothing known does that.
+ *
+ * In:  POSIX path of the file or folder;
+ *
+ *      true if it's a folder, else false;
+ *
+ *      Icon family data;
+ *
+ *      Size of the icon family data in bytes.
+ *
+ * Out: true if the icon is already in place, else false (including on any
+ *      error reading what's there).
+\******************************************************************************/
+
+bool resourceForkHasCustomIcon( const char    * path,
+                                bool            isDirectory,
+                                const uint8_t * icns,
+                                size_t          icnsSize );
+
+/******************************************************************************\
+ * resourceForkHash()
+ *
+ * Hash a block of data quickly (this is not a cryptographic hash).
+ *
+ * In:  Data to hash;
+ *
+ *      Size of the data in bytes.
+ *
+ * Out: 64-bit hash.
+\******************************************************************************/
+
+uint64_t resourceForkHash( const uint8_t * data, size_t size );
+
+#endif /* RESOURCE_FORK_WRITER_H */
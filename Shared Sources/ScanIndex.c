@@ -0,0 +1,775 @@
+/******************************************************************************\
+ * Utilities: ScanIndex.c
+ *
+ * Persistent index of folder scan results. See "ScanIndex.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "ScanIndex.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* File format identification; bump the version if the layout changes */
+
+#define INDEX_MAGIC   0x49534641u /* "AFSI" when read as little-endian bytes */
+#define INDEX_VERSION 2u
+
+/* Each serialised entry is a 64-bit size, 64-bit modification seconds and
+ * nanoseconds (zero for directories), a type byte and the NUL terminated
+ * name; numbers are copied with memcpy() as they are not aligned.
+ */
+
+#define ENTRY_NUMBERS     3
+#define ENTRY_HEADER_SIZE ( ENTRY_NUMBERS * sizeof( uint64_t ) + 1 )
+
+/* File layout: header, hash table of slots, entry arena. The header and slot
+ * sizes are multiples of 8 so that everything is naturally aligned.
+ */
+
+typedef struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dirty;       /* Changed since last synchronised; set at open => crashed */
+    uint32_t slotCount;   /* Power of two                                */
+    uint64_t fileSize;
+    uint64_t arenaOffset;
+    uint64_t arenaUsed;
+    uint64_t slotsUsed;
+    uint64_t reserved[ 2 ];
+
+} IndexHeader;
+
+typedef struct IndexSlot
+{
+    uint64_t device;
+    uint64_t inode;
+    int64_t  modifiedSeconds;
+    int64_t  modifiedNanoseconds;
+    int64_t  recordedSeconds; /* Wall-clock time when the record was stored */
+    uint64_t offset;          /* Of the entry record, within the arena     */
+    uint32_t length;
+    uint32_t count;
+    uint32_t used;
+    uint32_t padding;
+
+} IndexSlot;
+
+struct ScanIndex
+{
+    int                fd;
+    size_t             size;
+    unsigned char    * base;
+    IndexHeader      * header;
+    IndexSlot        * slots;
+    unsigned char    * arena;
+    size_t             arenaSize;
+    pthread_rwlock_t   lock;
+
+    uint64_t           hits;   /* Updated with atomic operations */
+    uint64_t           misses;
+    uint64_t           stores;
+    uint64_t           resets;
+    uint64_t           unconfirmed;
+    uint64_t           stale;
+};
+
+/* Local functions */
+
+static uint32_t    slotCountForSize ( size_t size );
+static void        layOut           ( ScanIndex * index );
+static bool        headerIsValid    ( ScanIndex * index );
+static void        resetLocked      ( ScanIndex * index );
+static IndexSlot * findSlot         ( ScanIndex * index, const ScanIndexKey * key );
+static int         reserveSpace     ( int fd, size_t size );
+static void        modifiedTime     ( const struct stat * info, int64_t * seconds, int64_t * nanoseconds );
+static bool        filesUnchanged   ( const char * directory, const FolderScannerEntry * entries, size_t count );
+static void        recordAdd        ( ScanIndexRecord * record, const FolderScannerEntry * entry, int64_t seconds, int64_t nanoseconds );
+
+/******************************************************************************\
+ * scanIndexOpen()
+ *
+ * Open an index file. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+ScanIndex * scanIndexOpen( const char * path, size_t size, int * error )
+{
+    ScanIndex * index  = NULL;
+    int         result = 0;
+    int         fd;
+
+    size &= ~( size_t ) 7;
+
+    if ( size < SCAN_INDEX_MINIMUM_SIZE )
+    {
+        if ( error ) *error = EINVAL;
+        return NULL;
+    }
+
+    fd = open( path, O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+
+    if ( fd < 0 )
+    {
+        if ( error ) *error = errno;
+        return NULL;
+    }
+
+    /* One process at a time; the lock goes away when the file is closed */
+
+    if ( flock( fd, LOCK_EX | LOCK_NB ) != 0 )
+    {
+        result = errno;
+        goto bailOut;
+    }
+
+    /* Allocate the whole file up front, so that running out of disk space
+     * shows up now rather than as a fault when touching the mapping later.
+     */
+
+    struct stat info;
+
+    if ( fstat( fd, &info ) != 0 )
+    {
+        result = errno;
+        goto bailOut;
+    }
+
+    if ( ( uint64_t ) info.st_size != ( uint64_t ) size )
+    {
+        if ( ftruncate( fd, 0 ) != 0 || ( result = reserveSpace( fd, size ) ) != 0 )
+        {
+            if ( result == 0 ) result = errno;
+            goto bailOut;
+        }
+    }
+
+    index = calloc( 1, sizeof( ScanIndex ) );
+
+    if ( index == NULL )
+    {
+        result = ENOMEM;
+        goto bailOut;
+    }
+
+    void * base = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+    if ( base == MAP_FAILED )
+    {
+        result = errno;
+        goto bailOut;
+    }
+
+    index->fd   = fd;
+    index->size = size;
+    index->base = base;
+
+    layOut( index );
+
+    if ( headerIsValid( index ) == false ) resetLocked( index );
+
+    pthread_rwlock_init( &index->lock, NULL );
+
+    return index;
+
+bailOut:
+
+    free( index );
+    close( fd );
+
+    if ( error ) *error = result;
+    return NULL;
+}
+
+/******************************************************************************\
+ * scanIndexClose()
+ *
+ * Flush and close an index. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexClose( ScanIndex * index )
+{
+    if ( index == NULL ) return;
+
+    scanIndexSync( index );
+
+    ( void ) munmap( index->base, index->size );
+    ( void ) close ( index->fd );
+
+    pthread_rwlock_destroy( &index->lock );
+    free( index );
+}
+
+/******************************************************************************\
+ * scanIndexSync()
+ *
+ * Mark an index as consistent. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexSync( ScanIndex * index )
+{
+    pthread_rwlock_wrlock( &index->lock );
+
+    index->header->dirty = 0;
+    ( void ) msync( index->base, index->size, MS_ASYNC );
+
+    pthread_rwlock_unlock( &index->lock );
+}
+
+/******************************************************************************\
+ * scanIndexKeyForPath()
+ *
+ * Fill in a key for a directory. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+bool scanIndexKeyForPath( const char * path, ScanIndexKey * key )
+{
+    struct stat info;
+
+    if ( stat( path, &info ) != 0 ) return false;
+
+    key->device = ( uint64_t ) info.st_dev;
+    key->inode  = ( uint64_t ) info.st_ino;
+
+    modifiedTime( &info, &key->modifiedSeconds, &key->modifiedNanoseconds );
+
+    return true;
+}
+
+/******************************************************************************\
+ * scanIndexCopyEntries()
+ *
+ * Look up a directory. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+FolderScannerEntry * scanIndexCopyEntries( ScanIndex          * index,
+                                           const ScanIndexKey * key,
+                                           const char         * path,
+                                           size_t             * count )
+{
+    FolderScannerEntry * entries   = NULL;
+    size_t               length    = 0;
+    size_t               found     = 0;
+    bool                 confirmed = true;
+
+    pthread_rwlock_rdlock( &index->lock );
+
+    IndexSlot * slot = findSlot( index, key );
+
+    if (
+           slot != NULL                                             &&
+           slot->used                                               &&
+           slot->modifiedSeconds     == key->modifiedSeconds        &&
+           slot->modifiedNanoseconds == key->modifiedNanoseconds    &&
+           slot->offset <= index->arenaSize                         &&
+           slot->length <= index->arenaSize - slot->offset
+       )
+    {
+        /* A directory changed again within the same second as it was read
+         * may still have the modification time which was recorded, on file
+         * systems with one second timestamps such as HFS+. Until the record
+         * is older than the directory's time, it can't be trusted.
+         */
+
+        confirmed = slot->recordedSeconds > slot->modifiedSeconds;
+    }
+    else
+    {
+        slot = NULL;
+    }
+
+    if ( slot != NULL && confirmed )
+    {
+        found   = slot->count;
+        length  = slot->length;
+        entries = malloc( found * sizeof( FolderScannerEntry ) + length + 1 );
+
+        if ( entries != NULL )
+        {
+            memcpy( ( char * ) ( entries + found ), index->arena + slot->offset, length );
+        }
+    }
+
+    pthread_rwlock_unlock( &index->lock );
+
+    /* Unpack outside the lock; names stay where they are in the copied data */
+
+    if ( entries != NULL )
+    {
+        char   * data   = ( char * ) ( entries + found );
+        size_t   offset = 0;
+
+        data[ length ] = '\0'; /* Guard against a corrupt final name */
+
+        for ( size_t item = 0; item < found; item ++ )
+        {
+            if ( offset + ENTRY_HEADER_SIZE >= length )
+            {
+                free( entries );
+                entries = NULL;
+                break;
+            }
+
+            memcpy( &entries[ item ].size, data + offset, sizeof( uint64_t ) );
+
+            entries[ item ].type = ( FolderScannerEntryType ) ( unsigned char ) data[ offset + ENTRY_NUMBERS * sizeof( uint64_t ) ];
+            entries[ item ].name = data + offset + ENTRY_HEADER_SIZE;
+
+            offset += ENTRY_HEADER_SIZE + strlen( entries[ item ].name ) + 1;
+        }
+    }
+
+    /* A file rewritten in place doesn't change its directory's time */
+
+    if ( entries != NULL && filesUnchanged( path, entries, found ) == false )
+    {
+        free( entries );
+        entries = NULL;
+
+        __atomic_fetch_add( &index->stale, 1, __ATOMIC_RELAXED );
+    }
+
+    if ( ! confirmed ) __atomic_fetch_add( &index->unconfirmed, 1, __ATOMIC_RELAXED );
+
+    __atomic_fetch_add( entries ? &index->hits : &index->misses, 1, __ATOMIC_RELAXED );
+
+    *count = entries ? found : 0;
+    return entries;
+}
+
+/******************************************************************************\
+ * scanIndexRecordAdd()
+ *
+ * Add an entry to a record. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexRecordAdd( ScanIndexRecord * record, const FolderScannerEntry * entry )
+{
+    recordAdd( record, entry, 0, 0 );
+}
+
+/******************************************************************************\
+ * scanIndexRecordAddFile()
+ *
+ * Add a file to a record. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+uint64_t scanIndexRecordAddFile( ScanIndexRecord          * record,
+                                 const FolderScannerEntry * entry,
+                                 const char               * fullPath )
+{
+    FolderScannerEntry sized = *entry;
+    struct stat        info;
+    int64_t            seconds;
+    int64_t            nanoseconds;
+
+    if ( lstat( fullPath, &info ) != 0 )
+    {
+        record->failed = true;
+        return entry->size;
+    }
+
+    modifiedTime( &info, &seconds, &nanoseconds );
+
+    sized.size = ( uint64_t ) info.st_size;
+    recordAdd( record, &sized, seconds, nanoseconds );
+
+    return sized.size;
+}
+
+/******************************************************************************\
+ * recordAdd()
+ *
+ * Internal - add an entry with the given modification time to a record.
+\******************************************************************************/
+
+static void recordAdd( ScanIndexRecord          * record,
+                       const FolderScannerEntry * entry,
+                       int64_t                    seconds,
+                       int64_t                    nanoseconds )
+{
+    if ( record->failed ) return;
+
+    size_t nameLength = strlen( entry->name ) + 1;
+    size_t needed     = ENTRY_HEADER_SIZE + nameLength;
+
+    if ( record->used + needed > record->size )
+    {
+        size_t newSize = record->size ? record->size * 2 : 1024;
+        while ( newSize < record->used + needed ) newSize *= 2;
+
+        char * newData = realloc( record->data, newSize );
+
+        if ( newData == NULL )
+        {
+            record->failed = true;
+            return;
+        }
+
+        record->data = newData;
+        record->size = newSize;
+    }
+
+    char * position = record->data + record->used;
+
+    memcpy( position,                            &entry->size, sizeof( uint64_t ) );
+    memcpy( position +     sizeof( uint64_t ), &seconds,     sizeof( uint64_t ) );
+    memcpy( position + 2 * sizeof( uint64_t ), &nanoseconds, sizeof( uint64_t ) );
+    position[ ENTRY_NUMBERS * sizeof( uint64_t ) ] = ( char ) entry->type;
+    memcpy( position + ENTRY_HEADER_SIZE, entry->name, nameLength );
+
+    record->used += needed;
+    record->count ++;
+}
+
+/******************************************************************************\
+ * scanIndexRecordFree()
+ *
+ * Release memory held by a record. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexRecordFree( ScanIndexRecord * record )
+{
+    free( record->data );
+    memset( record, 0, sizeof( ScanIndexRecord ) );
+}
+
+/******************************************************************************\
+ * scanIndexStore()
+ *
+ * Store a directory's entries. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+bool scanIndexStore( ScanIndex             * index,
+                     const ScanIndexKey    * key,
+                     const ScanIndexRecord * record )
+{
+    if ( record->failed || record->used > index->arenaSize || record->used > UINT32_MAX ) return false;
+
+    pthread_rwlock_wrlock( &index->lock );
+
+    IndexHeader * header = index->header;
+
+    header->dirty = 1;
+
+    /* When full, start again; the file never grows */
+
+    if (
+           header->arenaUsed + record->used > index->arenaSize ||
+           header->slotsUsed * 4 >= ( uint64_t ) header->slotCount * 3
+       )
+    {
+        resetLocked( index );
+        __atomic_fetch_add( &index->resets, 1, __ATOMIC_RELAXED );
+    }
+
+    IndexSlot * slot = findSlot( index, key );
+
+    if ( record->used > 0 )
+    {
+        memcpy( index->arena + header->arenaUsed, record->data, record->used );
+    }
+
+    if ( slot->used == 0 )
+    {
+        slot->device = key->device;
+        slot->inode  = key->inode;
+        slot->used   = 1;
+
+        header->slotsUsed ++;
+    }
+
+    slot->modifiedSeconds     = key->modifiedSeconds;
+    slot->modifiedNanoseconds = key->modifiedNanoseconds;
+    slot->recordedSeconds     = ( int64_t ) time( NULL );
+    slot->offset              = header->arenaUsed;
+    slot->length              = ( uint32_t ) record->used;
+    slot->count               = ( uint32_t ) record->count;
+
+    header->arenaUsed += record->used;
+
+    pthread_rwlock_unlock( &index->lock );
+
+    __atomic_fetch_add( &index->stores, 1, __ATOMIC_RELAXED );
+
+    return true;
+}
+
+/******************************************************************************\
+ * scanIndexReset()
+ *
+ * Remove everything from an index. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexReset( ScanIndex * index )
+{
+    pthread_rwlock_wrlock( &index->lock );
+
+    resetLocked( index );
+
+    pthread_rwlock_unlock( &index->lock );
+}
+
+/******************************************************************************\
+ * scanIndexGetStatistics()
+ *
+ * Read usage counters. See "ScanIndex.h" for details.
+\******************************************************************************/
+
+void scanIndexGetStatistics( ScanIndex * index, ScanIndexStatistics * statistics )
+{
+    pthread_rwlock_rdlock( &index->lock );
+
+    statistics->directories = ( size_t ) index->header->slotsUsed;
+    statistics->bytesUsed   = ( size_t ) index->header->arenaUsed;
+    statistics->bytesTotal  = index->size;
+
+    pthread_rwlock_unlock( &index->lock );
+
+    statistics->hits   = __atomic_load_n( &index->hits,   __ATOMIC_RELAXED );
+    statistics->misses = __atomic_load_n( &index->misses, __ATOMIC_RELAXED );
+    statistics->stores = __atomic_load_n( &index->stores, __ATOMIC_RELAXED );
+    statistics->resets = __atomic_load_n( &index->resets, __ATOMIC_RELAXED );
+
+    statistics->unconfirmed = __atomic_load_n( &index->unconfirmed, __ATOMIC_RELAXED );
+    statistics->stale       = __atomic_load_n( &index->stale,       __ATOMIC_RELAXED );
+}
+
+/******************************************************************************\
+ * slotCountForSize()
+ *
+ * Internal - return the number of hash table slots for an index file of the
+ * given size; the largest power of two giving roughly one slot per KiB.
+\******************************************************************************/
+
+static uint32_t slotCountForSize( size_t size )
+{
+    uint32_t count = 64;
+
+    while ( count < UINT32_MAX / 2 && ( size_t ) count * 2 <= size / 1024 ) count *= 2;
+
+    return count;
+}
+
+/******************************************************************************\
+ * layOut()
+ *
+ * Internal - work out where the header, slots and arena are in the mapping.
+\******************************************************************************/
+
+static void layOut( ScanIndex * index )
+{
+    size_t slotBytes = ( size_t ) slotCountForSize( index->size ) * sizeof( IndexSlot );
+
+    index->header    = ( IndexHeader * ) index->base;
+    index->slots     = ( IndexSlot   * ) ( index->base + sizeof( IndexHeader ) );
+    index->arena     = index->base + sizeof( IndexHeader ) + slotBytes;
+    index->arenaSize = index->size - sizeof( IndexHeader ) - slotBytes;
+}
+
+/******************************************************************************\
+ * headerIsValid()
+ *
+ * Internal - can the existing contents of a newly mapped file be trusted?
+\******************************************************************************/
+
+static bool headerIsValid( ScanIndex * index )
+{
+    IndexHeader * header = index->header;
+
+    return header->magic       == INDEX_MAGIC                                   &&
+           header->version     == INDEX_VERSION                                 &&
+           header->dirty       == 0                                             &&
+           header->slotCount   == slotCountForSize( index->size )               &&
+           header->fileSize    == ( uint64_t ) index->size                      &&
+           header->arenaOffset == ( uint64_t ) ( index->arena - index->base )   &&
+           header->arenaUsed   <= ( uint64_t ) index->arenaSize                 &&
+           header->slotsUsed   <= ( uint64_t ) header->slotCount;
+}
+
+/******************************************************************************\
+ * resetLocked()
+ *
+ * Internal - clear an index to empty. The caller must hold the write lock, or
+ * be the only thread with access to the index.
+\******************************************************************************/
+
+static void resetLocked( ScanIndex * index )
+{
+    IndexHeader * header = index->header;
+
+    memset( index->slots, 0, ( size_t ) slotCountForSize( index->size ) * sizeof( IndexSlot ) );
+
+    header->magic       = INDEX_MAGIC;
+    header->version     = INDEX_VERSION;
+    header->slotCount   = slotCountForSize( index->size );
+    header->fileSize    = ( uint64_t ) index->size;
+    header->arenaOffset = ( uint64_t ) ( index->arena - index->base );
+    header->arenaUsed   = 0;
+    header->slotsUsed   = 0;
+    header->dirty       = 1;
+}
+
+/******************************************************************************\
+ * findSlot()
+ *
+ * Internal - return the slot for a directory; either the one it already has,
+ * or the empty slot it would be put into. Linear probing is used; slots are
+ * never removed individually, so no tombstones are needed. The table is never
+ * allowed to fill up, so this always returns a slot.
+\******************************************************************************/
+
+static IndexSlot * findSlot( ScanIndex * index, const ScanIndexKey * key )
+{
+    uint32_t mask = index->header->slotCount - 1;
+    uint64_t hash = key->device * 0x9E3779B97F4A7C15ULL ^ key->inode;
+
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94D049BB133111EBULL;
+    hash =   hash ^ ( hash >> 31 );
+
+    for ( uint32_t probe = ( uint32_t ) hash & mask; ; probe = ( probe + 1 ) & mask )
+    {
+        IndexSlot * slot = &index->slots[ probe ];
+
+        if ( slot->used == 0 ) return slot;
+
+        if ( slot->device == key->device && slot->inode == key->inode ) return slot;
+    }
+}
+
+/******************************************************************************\
+ * reserveSpace()
+ *
+ * Internal - extend a file to the given size, writing zeros so that disk space
+ * is actually allocated. Returns 0 on success, else an errno value.
+\******************************************************************************/
+
+static int reserveSpace( int fd, size_t size )
+{
+    static const char zeros[ 65536 ];
+    size_t            done = 0;
+
+    while ( done < size )
+    {
+        size_t  chunk   = size - done < sizeof( zeros ) ? size - done : sizeof( zeros );
+        ssize_t written = pwrite( fd, zeros, chunk, ( off_t ) done );
+
+        if ( written < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return errno;
+        }
+
+        done += ( size_t ) written;
+    }
+
+    return 0;
+}
+
+/******************************************************************************\
+ * modifiedTime()
+ *
+ * Internal - extract the modification time from a stat() result.
+\******************************************************************************/
+
+static void modifiedTime( const struct stat * info, int64_t * seconds, int64_t * nanoseconds )
+{
+    #ifdef __APPLE__
+        *seconds     = ( int64_t ) info->st_mtimespec.tv_sec;
+        *nanoseconds = ( int64_t ) info->st_mtimespec.tv_nsec;
+    #else
+        *seconds     = ( int64_t ) info->st_mtim.tv_sec;
+        *nanoseconds = ( int64_t ) info->st_mtim.tv_nsec;
+    #endif
+}
+
+/******************************************************************************\
+ * filesUnchanged()
+ *
+ * Internal - check the files among entries copied from the index against
+ * their recorded sizes and modification times.
+ *
+ * In:  Full path of the directory holding them;
+ *
+ *      Entries, with names still pointing into the serialised data;
+ *
+ *      Number of entries.
+ *
+ * Out: true if every file is as it was recorded, else false.
+\******************************************************************************/
+
+static bool filesUnchanged( const char               * directory,
+                            const FolderScannerEntry * entries,
+                            size_t                     count )
+{
+    char   * path      = NULL;
+    size_t   pathSize  = 0;
+    size_t   baseSize  = strlen( directory );
+    bool     unchanged = true;
+
+    for ( size_t item = 0; item < count && unchanged; item ++ )
+    {
+        const FolderScannerEntry * entry = &entries[ item ];
+
+        if ( entry->type != folderScannerEntryTypeFile ) continue;
+
+        /* The recorded times sit just before the type byte, before the name */
+
+        const char * numbers    = entry->name - ENTRY_HEADER_SIZE;
+        size_t       leafLength = strlen( entry->name );
+        int64_t      seconds;
+        int64_t      nanoseconds;
+        struct stat  info;
+
+        memcpy( &seconds,     numbers +     sizeof( uint64_t ), sizeof( uint64_t ) );
+        memcpy( &nanoseconds, numbers + 2 * sizeof( uint64_t ), sizeof( uint64_t ) );
+
+        if ( baseSize + leafLength + 2 > pathSize )
+        {
+            pathSize = baseSize + leafLength + 256;
+
+            char * newPath = realloc( path, pathSize );
+
+            if ( newPath == NULL )
+            {
+                unchanged = false;
+                break;
+            }
+
+            path = newPath;
+        }
+
+        memcpy( path, directory, baseSize );
+        path[ baseSize ] = '/';
+        memcpy( path + baseSize + 1, entry->name, leafLength + 1 );
+
+        if ( lstat( path, &info ) != 0 )
+        {
+            unchanged = false;
+        }
+        else
+        {
+            int64_t nowSeconds;
+            int64_t nowNanoseconds;
+
+            modifiedTime( &info, &nowSeconds, &nowNanoseconds );
+
+            unchanged = ( uint64_t ) info.st_size == entry->size &&
+                        nowSeconds                == seconds     &&
+                        nowNanoseconds            == nanoseconds;
+        }
+    }
+
+    free( path );
+    return unchanged;
+}
@@ -0,0 +1,241 @@
+/******************************************************************************\
+ * Utilities: ScanIndex.h
+ *
+ * Persistent index of folder scan results, for use with "FolderScanner.h".
+ * For each directory read, the index records the directory's identity (device
+ * and inode), its modification time and the entries of interest found in it.
+ * A later scan which finds the same directory with the same modification time
+ * can take the entries from the index instead of reading the directory again.
+ *
+ * A directory's modification time only changes when entries are added to,
+ * removed from or renamed within that directory itself, not when anything
+ * deeper down changes; so each subdirectory is still checked individually and
+ * a changed subdirectory is re-read even if its parent came from the index.
+ * Nor does rewriting a file in place change its directory's time, so each
+ * file's size and modification time are recorded too and checked on lookup.
+ *
+ * Some file systems (e.g. HFS+) only keep times to the second, so a directory
+ * changed again in the same second as it was read can keep the time that was
+ * recorded. Records made no later than the second of the directory's time are
+ * therefore not trusted; the directory is read again until a record is made
+ * in some later second.
+ *
+ * The index lives in a single memory-mapped file of fixed, caller-chosen size,
+ * holding a hash table of directories and an append-only arena of entry
+ * records. Replacing a directory's record appends a new one; when the arena or
+ * the table fills up, the whole index is cleared and starts again, so the file
+ * never grows beyond its initial size.
+ *
+ * Lookups from many threads can run at once; updates are serialised. Only one
+ * process at a time can have a given index file open - others get an error
+ * from scanIndexOpen() and should just scan without an index. This is plain C
+ * with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef SCAN_INDEX_H
+#define SCAN_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FolderScanner.h"
+
+/* Smallest index file size accepted by scanIndexOpen() */
+
+#define SCAN_INDEX_MINIMUM_SIZE 262144 /* 256KiB */
+
+typedef struct ScanIndex ScanIndex;
+
+/* Identity and modification time of a directory */
+
+typedef struct ScanIndexKey
+{
+    uint64_t device;
+    uint64_t inode;
+    int64_t  modifiedSeconds;
+    int64_t  modifiedNanoseconds;
+
+} ScanIndexKey;
+
+/* A directory's entries, built up while it is read and then handed to
+ * scanIndexStore(). Fill with zeros to initialise.
+ */
+
+typedef struct ScanIndexRecord
+{
+    char   * data;   /* Serialised entries */
+    size_t   used;
+    size_t   size;
+    size_t   count;
+    bool     failed; /* Out of memory; the record will not be stored */
+
+} ScanIndexRecord;
+
+typedef struct ScanIndexStatistics
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t resets;
+    uint64_t unconfirmed; /* Misses for records too recent to trust */
+    uint64_t stale;       /* Misses for files changed in place     */
+    size_t   directories; /* Directories currently held            */
+    size_t   bytesUsed;   /* Of the arena; excludes the hash table */
+    size_t   bytesTotal;
+
+} ScanIndexStatistics;
+
+/******************************************************************************\
+ * scanIndexOpen()
+ *
+ * Open an index file, creating it if need be. Existing files of the wrong size
+ * or format, or which were changed after they were last synchronised (e.g.
+ * because the process crashed), are cleared.
+ *
+ * In:  Full path of the index file;
+ *
+ *      Size of the file in bytes; at least SCAN_INDEX_MINIMUM_SIZE;
+ *
+ *      Pointer to an int updated with an errno value on failure, or NULL.
+ *      EWOULDBLOCK means that another process has the file open.
+ *
+ * Out: Pointer to the opened index, or NULL on failure.
+\******************************************************************************/
+
+ScanIndex * scanIndexOpen( const char * path, size_t size, int * error );
+
+/******************************************************************************\
+ * scanIndexClose()
+ *
+ * Flush and close an index. The pointer must not be used again. NULL is
+ * ignored.
+\******************************************************************************/
+
+void scanIndexClose( ScanIndex * index );
+
+/******************************************************************************\
+ * scanIndexSync()
+ *
+ * Mark an index as consistent and ask for it to be written out. Call this
+ * at points where the process might exit without closing the index, such as
+ * from an atexit() handler, since other threads could still be using it.
+ * Any later update marks the index as changed again.
+\******************************************************************************/
+
+void scanIndexSync( ScanIndex * index );
+
+/******************************************************************************\
+ * scanIndexKeyForPath()
+ *
+ * Fill in a key for the directory at the given path, following symbolic links.
+ *
+ * Out: true on success, false if the path can't be examined.
+\******************************************************************************/
+
+bool scanIndexKeyForPath( const char * path, ScanIndexKey * key );
+
+/******************************************************************************\
+ * scanIndexCopyEntries()
+ *
+ * Look up a directory in the index.
+ *
+ * In:  Pointer to the index;
+ *
+ *      Pointer to the directory's key; the modification time must match
+ *      the one stored exactly;
+ *
+ *      Full path of the directory, used to check the files in it;
+ *
+ *      Pointer to a size_t updated with the number of entries found.
+ *
+ * Out: NULL if the directory is not in the index, has changed, was recorded
+ *      too soon after it last changed, or holds a file whose size or
+ *      modification time has changed, else a
+ *      pointer to an array of entries (which may be empty) that the caller
+ *      must free(). Entry names point into the same block of memory.
+\******************************************************************************/
+
+FolderScannerEntry * scanIndexCopyEntries( ScanIndex          * index,
+                                           const ScanIndexKey * key,
+                                           const char         * path,
+                                           size_t             * count );
+
+/******************************************************************************\
+ * scanIndexRecordAdd()
+ *
+ * Add a directory entry to a record which is being built up. The name is
+ * copied. Failure to allocate memory marks the record as failed.
+\******************************************************************************/
+
+void scanIndexRecordAdd( ScanIndexRecord * record, const FolderScannerEntry * entry );
+
+/******************************************************************************\
+ * scanIndexRecordAddFile()
+ *
+ * As scanIndexRecordAdd(), for a file: its current size and modification time
+ * are read and recorded, so that lookups can tell if it changes in place.
+ * Failure to examine the file marks the record as failed.
+ *
+ * In:  Pointer to the record;
+ *
+ *      Pointer to the file's entry; its size is ignored;
+ *
+ *      Full path of the file.
+ *
+ * Out: The file's size, or the entry's size if it can't be examined.
+\******************************************************************************/
+
+uint64_t scanIndexRecordAddFile( ScanIndexRecord          * record,
+                                 const FolderScannerEntry * entry,
+                                 const char               * fullPath );
+
+/******************************************************************************\
+ * scanIndexRecordFree()
+ *
+ * Release memory held by a record and reset it to empty.
+\******************************************************************************/
+
+void scanIndexRecordFree( ScanIndexRecord * record );
+
+/******************************************************************************\
+ * scanIndexStore()
+ *
+ * Store a complete record of a directory's entries, replacing any older one.
+ * The key should be taken before the directory was read, so that a change
+ * made while reading leaves the stored time older than the directory's.
+ *
+ * In:  Pointer to the index;
+ *
+ *      Pointer to the directory's key;
+ *
+ *      Pointer to the record to store.
+ *
+ * Out: true if stored, else false (e.g. the record had failed, or is too big
+ *      to ever fit in the index).
+\******************************************************************************/
+
+bool scanIndexStore( ScanIndex             * index,
+                     const ScanIndexKey    * key,
+                     const ScanIndexRecord * record );
+
+/******************************************************************************\
+ * scanIndexReset()
+ *
+ * Remove everything from an index.
+\******************************************************************************/
+
+void scanIndexReset( ScanIndex * index );
+
+/******************************************************************************\
+ * scanIndexGetStatistics()
+ *
+ * Read an index's usage counters. Hits, misses, stores and resets are counted
+ * since the index was opened.
+\******************************************************************************/
+
+void scanIndexGetStatistics( ScanIndex * index, ScanIndexStatistics * statistics );
+
+#endif /* SCAN_INDEX_H */
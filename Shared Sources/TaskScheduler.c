@@ -0,0 +1,1022 @@
+/******************************************************************************\
+ * Utilities: TaskScheduler.c
+ *
+ * Process-wide, work-stealing scheduler for CPU-bound work. See
+ * "TaskScheduler.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TaskScheduler.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+    #include <AvailabilityMacros.h>
+
+    #if MAC_OS_X_VERSION_MIN_REQUIRED >= 101000
+        #include <pthread/qos.h>
+        #define USE_QOS_CLASSES
+    #endif
+#endif
+
+#ifdef __BLOCKS__
+    #include <Block.h>
+#endif
+
+/* Initial number of tasks each queue has room for; queues grow as needed */
+
+#define INITIAL_QUEUE_CAPACITY 64
+
+typedef struct Task
+{
+    TaskSchedulerFunction   function;
+    TaskSchedulerFunction   cancelled; /* May be NULL */
+    void                  * context;
+    TaskSchedulerLane       lane;
+    uint64_t                queuedAt;  /* Monotonic nanoseconds; 0 if untimed */
+
+} Task;
+
+/* A double-ended queue of tasks, held as a ring buffer */
+
+typedef struct TaskQueue
+{
+    pthread_mutex_t   lock;
+    Task            * items;
+    size_t            capacity;
+    size_t            head;     /* Index of the oldest task */
+    size_t            count;
+
+} TaskQueue;
+
+/* A parallel loop. Iterations are handed out by 'next'; the loop is finished
+ * once 'done' reaches 'count'. Helper tasks may not start until after the
+ * loop has finished, so the loop is freed when the last reference to it goes.
+ */
+
+typedef struct TaskLoop
+{
+    TaskSchedulerIndexedFunction   function;
+    void                         * context;
+    size_t                         count;
+    size_t                         next;     /* Updated with atomic operations */
+    size_t                         done;     /* Updated with atomic operations */
+    unsigned int                   references;
+    pthread_mutex_t                lock;
+    pthread_cond_t                 finished;
+
+} TaskLoop;
+
+/* Scheduler state. Tasks are counted and queued with 'lock' held, so that a
+ * worker which finds nothing it may take with 'lock' held can safely go to
+ * sleep; they are taken without it. Counters are updated with atomic
+ * operations.
+ *
+ * A worker must hold one of 'bulkLimit' slots, counted by 'bulkRunning', to
+ * take bulk-lane tasks. It keeps its slot for as long as it finds more bulk
+ * work, so that a busy pool doesn't keep waking the reserved worker.
+ */
+
+static pthread_once_t           once    = PTHREAD_ONCE_INIT;
+static pthread_mutex_t          lock    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t           wake    = PTHREAD_COND_INITIALIZER;
+static TaskQueue              * queues;  /* Per worker, per lane */
+static TaskQueue                shared[ taskSchedulerLaneCount ];
+static unsigned int             queueCount;
+static unsigned int             bulkLimit;
+static unsigned int             bulkRunning;
+static TaskSchedulerStatistics  state;
+
+/* Hold 1 + the index of each worker thread's queues, NULL for other threads;
+ * and 1 + the lane of any thread whose lane has been set.
+ */
+
+static pthread_key_t workerKey;
+static pthread_key_t laneKey;
+
+static void        startPool           ( void );
+static size_t      workerNumber        ( void );
+static TaskQueue * queueFor            ( size_t worker, TaskSchedulerLane lane );
+static void      * worker              ( void * arg );
+static void        runTask             ( Task * task, TaskSchedulerLane * serviceLane );
+static void        setServiceLane      ( TaskSchedulerLane lane );
+static uint64_t    monotonicNanoseconds( void );
+static bool        isBulk              ( TaskSchedulerLane lane );
+static size_t      bulkQueued          ( void );
+static bool        workAvailable       ( void );
+static bool        reserveBulkSlot     ( void );
+static void        releaseBulkSlot     ( void );
+static int         enqueue             ( Task task );
+static bool        takeFromLane        ( size_t self, TaskSchedulerLane lane, Task * task );
+static bool        takeTask            ( Task * task, bool * holdingBulk );
+static void        runIterations       ( TaskLoop * loop );
+static void        runLoopHelper       ( void * context );
+static void        cancelLoopHelper    ( void * context );
+static void        releaseLoop         ( TaskLoop * loop );
+static void        initQueue           ( TaskQueue * queue );
+static int         push                ( TaskQueue * queue, Task task );
+static bool        drain               ( TaskQueue * queue, Task ** tasks, size_t * count, size_t * capacity );
+static bool        popBack             ( TaskQueue * queue, Task * task );
+static bool        popFront            ( TaskQueue * queue, Task * task );
+
+/******************************************************************************\
+ * taskSchedulerSubmit()
+ *
+ * Queue a task to run on the pool. See "TaskScheduler.h" for details.
+\******************************************************************************/
+
+int taskSchedulerSubmit( TaskSchedulerLane       lane,
+                         TaskSchedulerFunction   function,
+                         TaskSchedulerFunction   cancelled,
+                         void                  * context )
+{
+    if ( lane >= taskSchedulerLaneCount ) return EINVAL;
+
+    pthread_once( &once, startPool );
+
+    if ( state.workers == 0 ) return EAGAIN;
+
+    Task task = { function, cancelled, context, lane, monotonicNanoseconds() };
+
+    return enqueue( task );
+}
+
+/******************************************************************************\
+ * taskSchedulerApply()
+ *
+ * Run a parallel loop. See "TaskScheduler.h" for details.
+\******************************************************************************/
+
+void taskSchedulerApply( size_t                       count,
+                         void                       * context,
+                         TaskSchedulerIndexedFunction function )
+{
+    if ( count == 0 ) return;
+
+    pthread_once( &once, startPool );
+
+    __atomic_fetch_add( &state.loops, 1, __ATOMIC_RELAXED );
+
+    /* Only ask for as many helpers as there are workers idle to run them,
+     * and for bulk lanes, free to take bulk work; with none, the pool is
+     * saturated and the caller may as well get on with it alone.
+     */
+
+    TaskSchedulerLane lane    = taskSchedulerCurrentLane();
+    size_t            helpers = __atomic_load_n( &state.idle, __ATOMIC_SEQ_CST );
+    TaskLoop        * loop    = NULL;
+
+    if ( isBulk( lane ) )
+    {
+        unsigned int running = __atomic_load_n( &bulkRunning, __ATOMIC_SEQ_CST );
+        size_t       spare   = running < bulkLimit ? bulkLimit - running : 0;
+
+        if ( helpers > spare ) helpers = spare;
+    }
+
+    if ( helpers > count - 1 ) helpers = count - 1;
+    if ( helpers > 0         ) loop    = calloc( 1, sizeof( TaskLoop ) );
+
+    if ( loop == NULL )
+    {
+        __atomic_fetch_add( &state.inlineLoops, 1, __ATOMIC_RELAXED );
+
+        for ( size_t index = 0; index < count; index ++ ) function( context, index );
+        return;
+    }
+
+    loop->function   = function;
+    loop->context    = context;
+    loop->count      = count;
+    loop->references = 1 + ( unsigned int ) helpers;
+
+    pthread_mutex_init( &loop->lock,     NULL );
+    pthread_cond_init ( &loop->finished, NULL );
+
+    for ( size_t helper = 0; helper < helpers; helper ++ )
+    {
+        Task task = { runLoopHelper, cancelLoopHelper, loop, lane, 0 };
+
+        if ( enqueue( task ) != 0 ) releaseLoop( loop );
+    }
+
+    runIterations( loop );
+
+    /* Iterations still running are on threads which are running them right
+     * now, so this can't be left waiting for a helper which never starts.
+     */
+
+    pthread_mutex_lock( &loop->lock );
+
+    while ( __atomic_load_n( &loop->done, __ATOMIC_SEQ_CST ) < count )
+    {
+        pthread_cond_wait( &loop->finished, &loop->lock );
+    }
+
+    pthread_mutex_unlock( &loop->lock );
+
+    releaseLoop( loop );
+}
+
+/******************************************************************************\
+ * taskSchedulerSetLane(), taskSchedulerCurrentLane()
+ *
+ * Set or read the calling thread's lane. See "TaskScheduler.h".
+\******************************************************************************/
+
+void taskSchedulerSetLane( TaskSchedulerLane lane )
+{
+    if ( lane >= taskSchedulerLaneCount ) return;
+
+    pthread_once( &once, startPool );
+    pthread_setspecific( laneKey, ( void * ) ( uintptr_t ) ( lane + 1 ) );
+}
+
+TaskSchedulerLane taskSchedulerCurrentLane( void )
+{
+    pthread_once( &once, startPool );
+
+    uintptr_t lane = ( uintptr_t ) pthread_getspecific( laneKey );
+
+    return lane == 0 ? taskSchedulerLaneUserInitiated : ( TaskSchedulerLane ) ( lane - 1 );
+}
+
+/******************************************************************************\
+ * taskSchedulerCancelLane()
+ *
+ * Cancel the tasks queued in a lane. See "TaskScheduler.h" for details.
+\******************************************************************************/
+
+size_t taskSchedulerCancelLane( TaskSchedulerLane lane )
+{
+    if ( lane >= taskSchedulerLaneCount ) return 0;
+
+    pthread_once( &once, startPool );
+
+    Task   * tasks    = NULL;
+    size_t   count    = 0;
+    size_t   capacity = 0;
+
+    /* Holding 'lock' means no task can be counted but not yet queued. If
+     * memory runs out part way, whatever couldn't be taken is left to run.
+     */
+
+    pthread_mutex_lock( &lock );
+
+    bool drained = drain( &shared[ lane ], &tasks, &count, &capacity );
+
+    for ( size_t index = 0; drained && index < queueCount; index ++ )
+    {
+        drained = drain( queueFor( index + 1, lane ), &tasks, &count, &capacity );
+    }
+
+    __atomic_sub_fetch( &state.queued,                  count, __ATOMIC_SEQ_CST );
+    __atomic_sub_fetch( &state.lanes[ lane ].queued,    count, __ATOMIC_SEQ_CST );
+    __atomic_add_fetch( &state.lanes[ lane ].cancelled, count, __ATOMIC_RELAXED );
+
+    pthread_mutex_unlock( &lock );
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        if ( tasks[ index ].cancelled != NULL ) tasks[ index ].cancelled( tasks[ index ].context );
+    }
+
+    free( tasks );
+
+    return count;
+}
+
+/******************************************************************************\
+ * taskSchedulerGetStatistics()
+ *
+ * Take a snapshot of the scheduler's counters. See "TaskScheduler.h".
+\******************************************************************************/
+
+void taskSchedulerGetStatistics( TaskSchedulerStatistics * statistics )
+{
+    pthread_once( &once, startPool );
+
+    pthread_mutex_lock( &lock );
+
+    statistics->workers     = state.workers;
+    statistics->reserved    = state.reserved;
+    statistics->idle        = __atomic_load_n( &state.idle,        __ATOMIC_RELAXED );
+    statistics->queued      = __atomic_load_n( &state.queued,      __ATOMIC_RELAXED );
+    statistics->peakQueued  = state.peakQueued;
+    statistics->submitted   = __atomic_load_n( &state.submitted,   __ATOMIC_RELAXED );
+    statistics->steals      = __atomic_load_n( &state.steals,      __ATOMIC_RELAXED );
+    statistics->loops       = __atomic_load_n( &state.loops,       __ATOMIC_RELAXED );
+    statistics->inlineLoops = __atomic_load_n( &state.inlineLoops, __ATOMIC_RELAXED );
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ )
+    {
+        TaskSchedulerLaneStatistics * from = &state.lanes[ lane ];
+        TaskSchedulerLaneStatistics * to   = &statistics->lanes[ lane ];
+
+        to->queued    = __atomic_load_n( &from->queued,    __ATOMIC_RELAXED );
+        to->running   = __atomic_load_n( &from->running,   __ATOMIC_RELAXED );
+        to->submitted = __atomic_load_n( &from->submitted, __ATOMIC_RELAXED );
+        to->completed = __atomic_load_n( &from->completed, __ATOMIC_RELAXED );
+        to->cancelled = __atomic_load_n( &from->cancelled, __ATOMIC_RELAXED );
+
+        latencyHistogramCopy( &to->waited, &from->waited );
+        latencyHistogramCopy( &to->took,   &from->took   );
+    }
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * taskSchedulerResetLatencies()
+ *
+ * Empty the latency histograms. See "TaskScheduler.h".
+\******************************************************************************/
+
+void taskSchedulerResetLatencies( void )
+{
+    pthread_once( &once, startPool );
+
+    /* Holding 'lock' means a snapshot taken at the same time sees each
+     * histogram either as it was or empty, never part way through.
+     */
+
+    pthread_mutex_lock( &lock );
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ )
+    {
+        latencyHistogramReset( &state.lanes[ lane ].waited );
+        latencyHistogramReset( &state.lanes[ lane ].took   );
+    }
+
+    pthread_mutex_unlock( &lock );
+}
+
+#ifdef __BLOCKS__
+
+/******************************************************************************\
+ * taskSchedulerSubmitBlock(), taskSchedulerApplyBlock()
+ *
+ * Block-based versions of taskSchedulerSubmit() and taskSchedulerApply(). See
+ * "TaskScheduler.h".
+\******************************************************************************/
+
+typedef struct TaskBlocks
+{
+    void ( ^ block     )( void );
+    void ( ^ cancelled )( void ); /* May be NULL */
+
+} TaskBlocks;
+
+static void releaseBlocks( TaskBlocks * blocks )
+{
+    Block_release( blocks->block );
+    if ( blocks->cancelled != NULL ) Block_release( blocks->cancelled );
+
+    free( blocks );
+}
+
+static void runBlock( void * context )
+{
+    TaskBlocks * blocks = context;
+
+    blocks->block();
+    releaseBlocks( blocks );
+}
+
+static void cancelBlock( void * context )
+{
+    TaskBlocks * blocks = context;
+
+    if ( blocks->cancelled != NULL ) blocks->cancelled();
+    releaseBlocks( blocks );
+}
+
+static void runIndexedBlock( void * context, size_t index )
+{
+    void ( ^ block )( size_t ) = ( void ( ^ )( size_t ) ) context;
+
+    block( index );
+}
+
+int taskSchedulerSubmitBlock( TaskSchedulerLane    lane,
+                              void ( ^ block     )( void ),
+                              void ( ^ cancelled )( void ) )
+{
+    TaskBlocks * blocks = malloc( sizeof( TaskBlocks ) );
+
+    if ( blocks == NULL ) return ENOMEM;
+
+    blocks->block     = Block_copy( block );
+    blocks->cancelled = cancelled != NULL ? Block_copy( cancelled ) : NULL;
+
+    int result = taskSchedulerSubmit( lane, runBlock, cancelBlock, blocks );
+
+    if ( result != 0 ) releaseBlocks( blocks );
+
+    return result;
+}
+
+void taskSchedulerApplyBlock( size_t count, void ( ^ block )( size_t index ) )
+{
+    taskSchedulerApply( count, ( void * ) block, runIndexedBlock );
+}
+
+#endif /* __BLOCKS__ */
+
+/******************************************************************************\
+ * startPool()
+ *
+ * Internal - start one worker per active processor core. Called once only.
+ * If no worker can be started, submitted tasks are refused and loops run on
+ * their callers' threads.
+\******************************************************************************/
+
+static void startPool( void )
+{
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+
+    if ( cpus < 1 ) cpus = 1;
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ ) initQueue( &shared[ lane ] );
+
+    if ( pthread_key_create( &laneKey,   NULL ) != 0 ) return;
+    if ( pthread_key_create( &workerKey, NULL ) != 0 ) return;
+
+    queues = calloc( ( size_t ) cpus * taskSchedulerLaneCount, sizeof( TaskQueue ) );
+    if ( queues == NULL ) return;
+
+    queueCount = ( unsigned int ) cpus;
+
+    for ( unsigned int index = 0; index < queueCount * taskSchedulerLaneCount; index ++ )
+    {
+        initQueue( &queues[ index ] );
+    }
+
+    /* Queues whose worker fails to start are never pushed to, so can stay */
+
+    for ( unsigned int index = 0; index < queueCount; index ++ )
+    {
+        pthread_t      thread;
+        pthread_attr_t attributes;
+
+        pthread_attr_init( &attributes );
+        pthread_attr_setdetachstate( &attributes, PTHREAD_CREATE_DETACHED );
+
+        if ( pthread_create( &thread, &attributes, worker, ( void * ) ( uintptr_t ) ( index + 1 ) ) == 0 )
+        {
+            state.workers ++;
+        }
+
+        pthread_attr_destroy( &attributes );
+    }
+
+    /* With a single worker there is nobody to keep back */
+
+    state.reserved = state.workers > TASK_SCHEDULER_RESERVED_WORKERS ? TASK_SCHEDULER_RESERVED_WORKERS : 0;
+    bulkLimit      = state.workers - state.reserved;
+}
+
+/******************************************************************************\
+ * workerNumber()
+ *
+ * Internal - return 1 + the index of the calling worker thread's queues, or
+ * 0 if the caller isn't a worker.
+\******************************************************************************/
+
+static size_t workerNumber( void )
+{
+    return ( size_t ) ( uintptr_t ) pthread_getspecific( workerKey );
+}
+
+/******************************************************************************\
+ * queueFor()
+ *
+ * Internal - return the queue for a lane of the worker with the given number
+ * (as returned by workerNumber()), or of the shared queues if 0.
+\******************************************************************************/
+
+static TaskQueue * queueFor( size_t worker, TaskSchedulerLane lane )
+{
+    return worker ? &queues[ ( worker - 1 ) * taskSchedulerLaneCount + lane ] : &shared[ lane ];
+}
+
+/******************************************************************************\
+ * worker()
+ *
+ * Internal - thread body for a worker. Runs tasks for as long as there are
+ * any it may take, then sleeps until more are queued. Never exits.
+\******************************************************************************/
+
+static void * worker( void * arg )
+{
+    bool              holdingBulk = false;
+    TaskSchedulerLane serviceLane = taskSchedulerLaneCount; /* None yet */
+
+    pthread_setspecific( workerKey, arg );
+
+    for ( ;; )
+    {
+        Task task;
+
+        if ( takeTask( &task, &holdingBulk ) )
+        {
+            runTask( &task, &serviceLane );
+            continue;
+        }
+
+        pthread_mutex_lock( &lock );
+        __atomic_add_fetch( &state.idle, 1, __ATOMIC_SEQ_CST );
+
+        while ( workAvailable() == false )
+        {
+            pthread_cond_wait( &wake, &lock );
+        }
+
+        __atomic_sub_fetch( &state.idle, 1, __ATOMIC_SEQ_CST );
+        pthread_mutex_unlock( &lock );
+    }
+
+    return NULL;
+}
+
+/******************************************************************************\
+ * runTask()
+ *
+ * Internal - run a task taken by a worker in the task's lane, recording how
+ * long it waited and took if it is timed. Also given the lane whose quality
+ * of service the worker last took on, updated if it changes.
+\******************************************************************************/
+
+static void runTask( Task * task, TaskSchedulerLane * serviceLane )
+{
+    TaskSchedulerLaneStatistics * lane = &state.lanes[ task->lane ];
+
+    pthread_setspecific( laneKey, ( void * ) ( uintptr_t ) ( task->lane + 1 ) );
+
+    if ( *serviceLane != task->lane )
+    {
+        setServiceLane( task->lane );
+        *serviceLane = task->lane;
+    }
+
+    if ( task->queuedAt != 0 )
+    {
+        latencyHistogramRecord( &lane->waited, ( monotonicNanoseconds() - task->queuedAt ) / 1000 );
+    }
+
+    __atomic_add_fetch( &lane->running, 1, __ATOMIC_RELAXED );
+
+    task->function( task->context );
+
+    __atomic_sub_fetch( &lane->running,   1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( &lane->completed, 1, __ATOMIC_RELAXED );
+
+    if ( task->queuedAt != 0 )
+    {
+        latencyHistogramRecord( &lane->took, ( monotonicNanoseconds() - task->queuedAt ) / 1000 );
+    }
+}
+
+/******************************************************************************\
+ * setServiceLane()
+ *
+ * Internal - give the calling worker the quality of service class for a lane,
+ * where there are such things. Background work is given the "utility" class
+ * rather than "background", which would throttle its disc access far more
+ * than automation that someone is waiting on deserves.
+\******************************************************************************/
+
+static void setServiceLane( TaskSchedulerLane lane )
+{
+    #ifdef USE_QOS_CLASSES
+
+        static const qos_class_t classes[ taskSchedulerLaneCount ] =
+        {
+            QOS_CLASS_USER_INTERACTIVE,
+            QOS_CLASS_USER_INITIATED,
+            QOS_CLASS_UTILITY
+        };
+
+        pthread_set_qos_class_self_np( classes[ lane ], 0 );
+
+    #else
+
+        ( void ) lane;
+
+    #endif
+}
+
+/******************************************************************************\
+ * monotonicNanoseconds()
+ *
+ * Internal - return a monotonic wall-clock time in nanoseconds, never 0.
+\******************************************************************************/
+
+static uint64_t monotonicNanoseconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t ) now.tv_sec * 1000000000ULL + ( uint64_t ) now.tv_nsec + 1;
+}
+
+/******************************************************************************\
+ * isBulk()
+ *
+ * Internal - return true if a lane's tasks need a bulk slot to run.
+\******************************************************************************/
+
+static bool isBulk( TaskSchedulerLane lane )
+{
+    return lane != taskSchedulerLaneInteractive;
+}
+
+/******************************************************************************\
+ * bulkQueued()
+ *
+ * Internal - return the number of tasks queued in bulk lanes.
+\******************************************************************************/
+
+static size_t bulkQueued( void )
+{
+    size_t queued = 0;
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ )
+    {
+        if ( isBulk( lane ) ) queued += __atomic_load_n( &state.lanes[ lane ].queued, __ATOMIC_SEQ_CST );
+    }
+
+    return queued;
+}
+
+/******************************************************************************\
+ * workAvailable()
+ *
+ * Internal - return true if there are tasks queued that a worker without a
+ * bulk slot could take now.
+\******************************************************************************/
+
+static bool workAvailable( void )
+{
+    if ( __atomic_load_n( &state.lanes[ taskSchedulerLaneInteractive ].queued, __ATOMIC_SEQ_CST ) > 0 )
+    {
+        return true;
+    }
+
+    return bulkQueued() > 0 && __atomic_load_n( &bulkRunning, __ATOMIC_SEQ_CST ) < bulkLimit;
+}
+
+/******************************************************************************\
+ * reserveBulkSlot(), releaseBulkSlot()
+ *
+ * Internal - take a bulk slot, returning false if none is free; or give one
+ * back, waking a sleeping worker if there is bulk work it could now take.
+\******************************************************************************/
+
+static bool reserveBulkSlot( void )
+{
+    unsigned int running = __atomic_load_n( &bulkRunning, __ATOMIC_SEQ_CST );
+
+    do
+    {
+        if ( running >= bulkLimit ) return false;
+    }
+    while ( ! __atomic_compare_exchange_n( &bulkRunning, &running, running + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) );
+
+    return true;
+}
+
+static void releaseBulkSlot( void )
+{
+    __atomic_sub_fetch( &bulkRunning, 1, __ATOMIC_SEQ_CST );
+
+    if ( __atomic_load_n( &state.idle, __ATOMIC_SEQ_CST ) > 0 && bulkQueued() > 0 )
+    {
+        pthread_mutex_lock  ( &lock );
+        pthread_cond_signal ( &wake );
+        pthread_mutex_unlock( &lock );
+    }
+}
+
+/******************************************************************************\
+ * enqueue()
+ *
+ * Internal - queue a task on the back of the calling worker's queue for its
+ * lane, else on the shared queue for the lane, and wake a worker for it.
+ * Returns 0 if queued, else ENOMEM.
+\******************************************************************************/
+
+static int enqueue( Task task )
+{
+    TaskQueue * queue = queueFor( workerNumber(), task.lane );
+
+    pthread_mutex_lock( &lock );
+
+    /* Count before pushing, so the count can never be less than the number
+     * of tasks really queued
+     */
+
+    size_t queued = __atomic_add_fetch( &state.queued, 1, __ATOMIC_SEQ_CST );
+
+    __atomic_add_fetch( &state.lanes[ task.lane ].queued, 1, __ATOMIC_SEQ_CST );
+
+    int result = push( queue, task );
+
+    if ( result == 0 )
+    {
+        if ( queued > state.peakQueued ) state.peakQueued = queued;
+
+        __atomic_fetch_add( &state.submitted,                    1, __ATOMIC_RELAXED );
+        __atomic_fetch_add( &state.lanes[ task.lane ].submitted, 1, __ATOMIC_RELAXED );
+
+        if ( __atomic_load_n( &state.idle, __ATOMIC_SEQ_CST ) > 0 ) pthread_cond_signal( &wake );
+    }
+    else
+    {
+        __atomic_sub_fetch( &state.queued,                    1, __ATOMIC_SEQ_CST );
+        __atomic_sub_fetch( &state.lanes[ task.lane ].queued, 1, __ATOMIC_SEQ_CST );
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    return result;
+}
+
+/******************************************************************************\
+ * takeFromLane()
+ *
+ * Internal - take the next task in a lane for the calling worker: the newest
+ * from its own queue, else the oldest from the shared queue, else the oldest
+ * from some other worker's queue. Returns false if there are none to be had.
+\******************************************************************************/
+
+static bool takeFromLane( size_t self, TaskSchedulerLane lane, Task * task )
+{
+    bool found = popBack( queueFor( self + 1, lane ), task ) || popFront( &shared[ lane ], task );
+
+    /* Start looking for a victim just after this worker, so that workers
+     * don't all descend on the same one.
+     */
+
+    for ( size_t offset = 1; ! found && offset < queueCount; offset ++ )
+    {
+        if ( popFront( queueFor( ( self + offset ) % queueCount + 1, lane ), task ) )
+        {
+            __atomic_fetch_add( &state.steals, 1, __ATOMIC_RELAXED );
+            found = true;
+        }
+    }
+
+    if ( found )
+    {
+        __atomic_sub_fetch( &state.queued,               1, __ATOMIC_SEQ_CST );
+        __atomic_sub_fetch( &state.lanes[ lane ].queued, 1, __ATOMIC_SEQ_CST );
+    }
+
+    return found;
+}
+
+/******************************************************************************\
+ * takeTask()
+ *
+ * Internal - take the next task for the calling worker from the highest
+ * priority lane that has one it may take. A bulk slot is taken as needed to
+ * take bulk work, and given back on taking interactive work or finding no
+ * work. Returns false if there are no tasks to be had.
+\******************************************************************************/
+
+static bool takeTask( Task * task, bool * holdingBulk )
+{
+    size_t self = workerNumber() - 1;
+
+    if ( takeFromLane( self, taskSchedulerLaneInteractive, task ) )
+    {
+        if ( *holdingBulk ) releaseBulkSlot();
+
+        *holdingBulk = false;
+        return true;
+    }
+
+    if ( *holdingBulk == false )
+    {
+        if ( bulkQueued() == 0 || reserveBulkSlot() == false ) return false;
+
+        *holdingBulk = true;
+    }
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ )
+    {
+        if ( isBulk( lane ) && takeFromLane( self, lane, task ) ) return true;
+    }
+
+    releaseBulkSlot();
+
+    *holdingBulk = false;
+    return false;
+}
+
+/******************************************************************************\
+ * runIterations()
+ *
+ * Internal - run iterations of a loop until none are left to hand out,
+ * signalling the loop's caller if this finishes the last of them.
+\******************************************************************************/
+
+static void runIterations( TaskLoop * loop )
+{
+    size_t index;
+
+    while ( ( index = __atomic_fetch_add( &loop->next, 1, __ATOMIC_RELAXED ) ) < loop->count )
+    {
+        loop->function( loop->context, index );
+
+        if ( __atomic_add_fetch( &loop->done, 1, __ATOMIC_SEQ_CST ) == loop->count )
+        {
+            pthread_mutex_lock    ( &loop->lock     );
+            pthread_cond_broadcast( &loop->finished );
+            pthread_mutex_unlock  ( &loop->lock     );
+        }
+    }
+}
+
+/******************************************************************************\
+ * runLoopHelper(), cancelLoopHelper()
+ *
+ * Internal - task body helping with a loop, and its cancellation function;
+ * a cancelled helper leaves its share of the loop to the others.
+\******************************************************************************/
+
+static void runLoopHelper( void * context )
+{
+    TaskLoop * loop = context;
+
+    runIterations( loop );
+    releaseLoop( loop );
+}
+
+static void cancelLoopHelper( void * context )
+{
+    releaseLoop( context );
+}
+
+/******************************************************************************\
+ * releaseLoop()
+ *
+ * Internal - drop a reference to a loop, freeing it if that was the last.
+\******************************************************************************/
+
+static void releaseLoop( TaskLoop * loop )
+{
+    if ( __atomic_sub_fetch( &loop->references, 1, __ATOMIC_ACQ_REL ) != 0 ) return;
+
+    pthread_cond_destroy ( &loop->finished );
+    pthread_mutex_destroy( &loop->lock     );
+    free( loop );
+}
+
+/******************************************************************************\
+ * initQueue()
+ *
+ * Internal - set up an empty queue.
+\******************************************************************************/
+
+static void initQueue( TaskQueue * queue )
+{
+    memset( queue, 0, sizeof( TaskQueue ) );
+    pthread_mutex_init( &queue->lock, NULL );
+}
+
+/******************************************************************************\
+ * push()
+ *
+ * Internal - add a task to the back of a queue, growing it if need be.
+ * Returns 0 if added, else ENOMEM.
+\******************************************************************************/
+
+static int push( TaskQueue * queue, Task task )
+{
+    pthread_mutex_lock( &queue->lock );
+
+    if ( queue->count == queue->capacity )
+    {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : INITIAL_QUEUE_CAPACITY;
+        Task * items    = malloc( capacity * sizeof( Task ) );
+
+        if ( items == NULL )
+        {
+            pthread_mutex_unlock( &queue->lock );
+            return ENOMEM;
+        }
+
+        /* Unwrap the ring into the start of the new buffer */
+
+        for ( size_t index = 0; index < queue->count; index ++ )
+        {
+            items[ index ] = queue->items[ ( queue->head + index ) % queue->capacity ];
+        }
+
+        free( queue->items );
+
+        queue->items    = items;
+        queue->capacity = capacity;
+        queue->head     = 0;
+    }
+
+    queue->items[ ( queue->head + queue->count ) % queue->capacity ] = task;
+    queue->count ++;
+
+    pthread_mutex_unlock( &queue->lock );
+
+    return 0;
+}
+
+/******************************************************************************\
+ * drain()
+ *
+ * Internal - move every task in a queue, oldest first, onto the end of a
+ * growing array given by pointers to the array, its count and its capacity.
+ * Returns false, leaving the queue as it was, if the array can't grow.
+\******************************************************************************/
+
+static bool drain( TaskQueue * queue, Task ** tasks, size_t * count, size_t * capacity )
+{
+    pthread_mutex_lock( &queue->lock );
+
+    if ( *count + queue->count > *capacity )
+    {
+        size_t wanted = *count + queue->count;
+        Task * grown  = realloc( *tasks, wanted * sizeof( Task ) );
+
+        if ( grown == NULL )
+        {
+            pthread_mutex_unlock( &queue->lock );
+            return false;
+        }
+
+        *tasks    = grown;
+        *capacity = wanted;
+    }
+
+    for ( size_t index = 0; index < queue->count; index ++ )
+    {
+        ( *tasks )[ ( *count ) ++ ] = queue->items[ ( queue->head + index ) % queue->capacity ];
+    }
+
+    queue->head  = 0;
+    queue->count = 0;
+
+    pthread_mutex_unlock( &queue->lock );
+
+    return true;
+}
+
+/******************************************************************************\
+ * popBack(), popFront()
+ *
+ * Internal - take the newest or oldest task from a queue. Return false if the
+ * queue is empty.
+\******************************************************************************/
+
+static bool popBack( TaskQueue * queue, Task * task )
+{
+    bool found = false;
+
+    pthread_mutex_lock( &queue->lock );
+
+    if ( queue->count > 0 )
+    {
+        queue->count --;
+        *task = queue->items[ ( queue->head + queue->count ) % queue->capacity ];
+        found = true;
+    }
+
+    pthread_mutex_unlock( &queue->lock );
+
+    return found;
+}
+
+static bool popFront( TaskQueue * queue, Task * task )
+{
+    bool found = false;
+
+    pthread_mutex_lock( &queue->lock );
+
+    if ( queue->count > 0 )
+    {
+        *task         = queue->items[ queue->head ];
+        queue->head   = ( queue->head + 1 ) % queue->capacity;
+        queue->count --;
+        found         = true;
+    }
+
+    pthread_mutex_unlock( &queue->lock );
+
+    return found;
+}
@@ -0,0 +1,211 @@
+/******************************************************************************\
+ * Utilities: TaskScheduler.h
+ *
+ * Process-wide, work-stealing scheduler for CPU-bound work. A fixed pool of
+ * threads, one per active processor core, runs every task; so however many
+ * folders are being processed and previews drawn at once, and however deeply
+ * their parallel loops nest, no more CPU-bound work runs at once than there
+ * are cores to run it.
+ *
+ * Each worker thread has its own double-ended queue of tasks. Tasks submitted
+ * by a worker go on the back of its own queue and it takes its next task from
+ * there too, newest first, so related work stays on one core while its data
+ * is still in cache. A worker whose queue is empty takes the oldest task from
+ * the queue shared by other threads, else steals the oldest task from another
+ * worker's queue. Idle workers sleep until more work arrives.
+ *
+ * Parallel loops hand out their iterations one at a time to whichever threads
+ * ask for one next - the caller and as many idle workers as there are - so a
+ * slow iteration doesn't hold up the others. If no worker is idle, the loop is
+ * simply run on the caller's thread, since queueing it would only add to the
+ * backlog and the caller would otherwise be left waiting for it.
+ *
+ * Every task belongs to one of three lanes which are served in strict order
+ * of priority: interactive work such as previews of visible rows, then the
+ * work of a run the user started, then background work such as automation.
+ * Queues are kept per lane, so a worker always takes the oldest interactive
+ * task there is before any other; and where there is more than one worker,
+ * one is kept back from the two lower "bulk" lanes, so however many folders
+ * are queued, an interactive task never waits for more than whatever
+ * interactive work is ahead of it. Each lane's queued work can be cancelled
+ * as a group, and the time tasks spend waiting to start and to finish is
+ * recorded per lane (see "LatencyHistogram.h").
+ *
+ * The pool is started on first use. This is plain C with no Cocoa
+ * dependencies; where the compiler supports blocks, block-based versions of
+ * the functions are provided too. All functions are thread-safe.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LatencyHistogram.h"
+
+/* Lanes, highest priority first. Anything but the interactive lane counts
+ * as bulk work. On macOS, workers take on the quality of service class of
+ * their task's lane, so the system schedules them to match.
+ */
+
+typedef enum TaskSchedulerLane
+{
+    taskSchedulerLaneInteractive,   /* Previews of visible rows         */
+    taskSchedulerLaneUserInitiated, /* Runs started by the user         */
+    taskSchedulerLaneBackground,    /* Automation, scripting, the shell */
+
+    taskSchedulerLaneCount
+
+} TaskSchedulerLane;
+
+/* Number of workers kept back from bulk lanes, when there's more than one */
+
+#define TASK_SCHEDULER_RESERVED_WORKERS 1
+
+typedef void ( * TaskSchedulerFunction        ) ( void * context );
+typedef void ( * TaskSchedulerIndexedFunction ) ( void * context, size_t index );
+
+/* Latencies cover submitted tasks only, not loop helpers, in microseconds */
+
+typedef struct TaskSchedulerLaneStatistics
+{
+    size_t           queued;    /* Tasks waiting to run now                 */
+    size_t           running;   /* Tasks running now                        */
+    uint64_t         submitted; /* Tasks, including loop helpers            */
+    uint64_t         completed;
+    uint64_t         cancelled;
+    LatencyHistogram waited;    /* From submission to starting              */
+    LatencyHistogram took;      /* From submission to finishing             */
+
+} TaskSchedulerLaneStatistics;
+
+typedef struct TaskSchedulerStatistics
+{
+    unsigned int workers;
+    unsigned int reserved;      /* Workers kept back from bulk lanes        */
+    unsigned int idle;          /* Workers asleep, waiting for tasks now    */
+    size_t       queued;        /* Tasks waiting to run now, in all queues  */
+    size_t       peakQueued;
+    uint64_t     submitted;     /* Tasks, including loop helpers            */
+    uint64_t     steals;        /* Tasks taken from another worker's queue  */
+    uint64_t     loops;         /* Parallel loops run                       */
+    uint64_t     inlineLoops;   /* Of those, run on the caller's thread     */
+
+    TaskSchedulerLaneStatistics lanes[ taskSchedulerLaneCount ];
+
+} TaskSchedulerStatistics;
+
+/******************************************************************************\
+ * taskSchedulerSubmit()
+ *
+ * Queue a task to run on the pool as soon as a worker is free for its lane.
+ *
+ * In:  Lane to run the task in;
+ *
+ *      Function to call;
+ *
+ *      Function to call instead if the task is cancelled before it starts by
+ *      taskSchedulerCancelLane(), or NULL if there is nothing to tidy up;
+ *
+ *      Context pointer to pass to either.
+ *
+ * Out: 0 if queued, else an errno value (in which case neither function is
+ *      ever called).
+\******************************************************************************/
+
+int taskSchedulerSubmit( TaskSchedulerLane       lane,
+                         TaskSchedulerFunction   function,
+                         TaskSchedulerFunction   cancelled,
+                         void                  * context );
+
+/******************************************************************************\
+ * taskSchedulerApply()
+ *
+ * Call a function once for each index from 0 to one less than a count, in
+ * parallel where workers are free, returning once every call has returned.
+ * The caller takes part, so this works (serially) even if the pool could not
+ * be started. May be called from within a task or another loop. Helpers run
+ * in the calling thread's lane; see taskSchedulerSetLane().
+ *
+ * In:  Number of iterations;
+ *
+ *      Context pointer to pass to the function;
+ *
+ *      Function to call with the context and each index.
+\******************************************************************************/
+
+void taskSchedulerApply( size_t                       count,
+                         void                       * context,
+                         TaskSchedulerIndexedFunction function );
+
+/******************************************************************************\
+ * taskSchedulerSetLane(), taskSchedulerCurrentLane()
+ *
+ * Set or read the lane of the calling thread, used for the helpers of any
+ * parallel loops it runs. Tasks run in their own lane. Other threads start
+ * in the user-initiated lane.
+ *
+ * In:  Lane (set only).
+ *
+ * Out: Lane (read only).
+\******************************************************************************/
+
+void              taskSchedulerSetLane    ( TaskSchedulerLane lane );
+TaskSchedulerLane taskSchedulerCurrentLane( void );
+
+/******************************************************************************\
+ * taskSchedulerCancelLane()
+ *
+ * Cancel every task queued in a lane that has yet to start, calling each
+ * one's cancellation function on the caller's thread. Tasks already running
+ * are unaffected. Loops whose helpers are cancelled are finished by their
+ * callers.
+ *
+ * In:  Lane to cancel.
+ *
+ * Out: Number of tasks cancelled.
+\******************************************************************************/
+
+size_t taskSchedulerCancelLane( TaskSchedulerLane lane );
+
+/******************************************************************************\
+ * taskSchedulerGetStatistics()
+ *
+ * Take a snapshot of the scheduler's counters.
+ *
+ * In:  Statistics structure to fill in.
+\******************************************************************************/
+
+void taskSchedulerGetStatistics( TaskSchedulerStatistics * statistics );
+
+/******************************************************************************\
+ * taskSchedulerResetLatencies()
+ *
+ * Empty every lane's latency histograms, e.g. at the start of a run so that
+ * they cover only that run. Other counters are unaffected.
+\******************************************************************************/
+
+void taskSchedulerResetLatencies( void );
+
+#ifdef __BLOCKS__
+
+    /**************************************************************************\
+     * taskSchedulerSubmitBlock(), taskSchedulerApplyBlock()
+     *
+     * As taskSchedulerSubmit() and taskSchedulerApply(), for blocks. The
+     * submitted blocks are copied, and released once one or other has run.
+     * The cancellation block may be NULL.
+    \**************************************************************************/
+
+    int  taskSchedulerSubmitBlock( TaskSchedulerLane    lane,
+                                   void ( ^ block     )( void ),
+                                   void ( ^ cancelled )( void ) );
+
+    void taskSchedulerApplyBlock ( size_t count, void ( ^ block )( size_t index ) );
+
+#endif
+
+#endif /* TASK_SCHEDULER_H */
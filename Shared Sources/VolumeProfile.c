@@ -0,0 +1,353 @@
+/******************************************************************************\
+ * Utilities: VolumeProfile.c
+ *
+ * Profiles of the volumes that folders are scanned on. See "VolumeProfile.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "VolumeProfile.h"
+#include "FolderScanner.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef __APPLE__
+    #include <sys/mount.h>
+    #include <sys/param.h>
+#else
+    #include <sys/vfs.h>
+#endif
+
+/* One slot in the table; 'probedAt' is monotonic nanoseconds, 0 if unused */
+
+typedef struct VolumeSlot
+{
+    VolumeProfile profile;
+    uint64_t      probedAt;
+
+} VolumeSlot;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static VolumeSlot      table[ VOLUME_PROFILE_TABLE_SIZE ];
+
+static uint64_t monotonicNanoseconds ( void );
+static void     classifyFileSystem   ( const char * path, VolumeProfile * profile );
+static void     probeLatency         ( const char * path, const FolderScannerBackend * backend, VolumeProfile * profile );
+
+/******************************************************************************\
+ * volumeProfileForPath()
+ *
+ * Find, or probe for, the profile of the volume holding a directory. See
+ * "VolumeProfile.h" for details.
+\******************************************************************************/
+
+bool volumeProfileForPath( const char                 * path,
+                           const FolderScannerBackend * backend,
+                           VolumeProfile              * profile )
+{
+    struct stat info;
+
+    if ( stat( path, &info ) != 0 ) return false;
+
+    uint64_t device = ( uint64_t ) info.st_dev;
+    uint64_t now    = monotonicNanoseconds();
+    uint64_t expiry = ( uint64_t ) VOLUME_PROFILE_LIFETIME_S * 1000000000ULL;
+
+    pthread_mutex_lock( &lock );
+
+    for ( size_t index = 0; index < VOLUME_PROFILE_TABLE_SIZE; index ++ )
+    {
+        VolumeSlot * slot = &table[ index ];
+
+        if ( slot->probedAt != 0 && slot->profile.device == device && now - slot->probedAt < expiry )
+        {
+            *profile = slot->profile;
+            pthread_mutex_unlock( &lock );
+
+            return true;
+        }
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    /* Not known, or known too long ago; probe it afresh */
+
+    VolumeProfile probed;
+
+    memset( &probed, 0, sizeof( probed ) );
+
+    probed.device = device;
+
+    classifyFileSystem( path, &probed );
+    probeLatency( path, backend, &probed );
+
+    /* Store it over any older profile of the same volume, else in an empty
+     * slot, else over the profile probed longest ago. Totals carry over from
+     * an older profile of the same volume.
+     */
+
+    pthread_mutex_lock( &lock );
+
+    VolumeSlot * target = NULL;
+
+    for ( size_t index = 0; index < VOLUME_PROFILE_TABLE_SIZE; index ++ )
+    {
+        VolumeSlot * slot = &table[ index ];
+
+        if ( slot->probedAt != 0 && slot->profile.device == device )
+        {
+            probed.scans            = slot->profile.scans;
+            probed.directoriesRead  = slot->profile.directoriesRead;
+            probed.entriesSeen      = slot->profile.entriesSeen;
+            probed.scanMicroseconds = slot->profile.scanMicroseconds;
+
+            target = slot;
+            break;
+        }
+
+        if ( target == NULL || slot->probedAt < target->probedAt ) target = slot;
+    }
+
+    target->profile  = probed;
+    target->probedAt = monotonicNanoseconds();
+
+    pthread_mutex_unlock( &lock );
+
+    *profile = probed;
+    return true;
+}
+
+/******************************************************************************\
+ * volumeProfileRecordScan()
+ *
+ * Add the results of a scan to the totals for a volume. See "VolumeProfile.h".
+\******************************************************************************/
+
+void volumeProfileRecordScan( uint64_t device,
+                              uint64_t directoriesRead,
+                              uint64_t entriesSeen,
+                              uint64_t microseconds )
+{
+    pthread_mutex_lock( &lock );
+
+    for ( size_t index = 0; index < VOLUME_PROFILE_TABLE_SIZE; index ++ )
+    {
+        VolumeSlot * slot = &table[ index ];
+
+        if ( slot->probedAt != 0 && slot->profile.device == device )
+        {
+            slot->profile.scans            ++;
+            slot->profile.directoriesRead  += directoriesRead;
+            slot->profile.entriesSeen      += entriesSeen;
+            slot->profile.scanMicroseconds += microseconds;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * volumeProfileCopyAll()
+ *
+ * Copy out the profiles currently held. See "VolumeProfile.h".
+\******************************************************************************/
+
+size_t volumeProfileCopyAll( VolumeProfile * profiles, size_t maximum )
+{
+    VolumeSlot copied[ VOLUME_PROFILE_TABLE_SIZE ];
+    size_t     count = 0;
+
+    pthread_mutex_lock( &lock );
+
+    for ( size_t index = 0; index < VOLUME_PROFILE_TABLE_SIZE; index ++ )
+    {
+        if ( table[ index ].probedAt != 0 ) copied[ count ++ ] = table[ index ];
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    /* Insertion sort, newest first; there are only a few */
+
+    for ( size_t index = 1; index < count; index ++ )
+    {
+        VolumeSlot slot  = copied[ index ];
+        size_t     place = index;
+
+        while ( place > 0 && copied[ place - 1 ].probedAt < slot.probedAt )
+        {
+            copied[ place ] = copied[ place - 1 ];
+            place --;
+        }
+
+        copied[ place ] = slot;
+    }
+
+    if ( count > maximum ) count = maximum;
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        profiles[ index ] = copied[ index ].profile;
+    }
+
+    return count;
+}
+
+/******************************************************************************\
+ * volumeProfileForget()
+ *
+ * Discard all profiles. See "VolumeProfile.h".
+\******************************************************************************/
+
+void volumeProfileForget( void )
+{
+    pthread_mutex_lock( &lock );
+    memset( table, 0, sizeof( table ) );
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * volumeKindName(), volumeLatencyName()
+ *
+ * Describe a volume kind or latency class. See "VolumeProfile.h".
+\******************************************************************************/
+
+const char * volumeKindName( VolumeKind kind )
+{
+    switch ( kind )
+    {
+        case volumeKindLocal:   return "local";
+        case volumeKindNetwork: return "network";
+        default:                return "unknown";
+    }
+}
+
+const char * volumeLatencyName( VolumeLatency latency )
+{
+    switch ( latency )
+    {
+        case volumeLatencyLow:    return "low";
+        case volumeLatencyMedium: return "medium";
+        case volumeLatencyHigh:   return "high";
+        default:                  return "unknown";
+    }
+}
+
+/******************************************************************************\
+ * monotonicNanoseconds()
+ *
+ * Internal - return a monotonic wall-clock time in nanoseconds, never 0.
+\******************************************************************************/
+
+static uint64_t monotonicNanoseconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( uint64_t ) now.tv_sec * 1000000000ULL + ( uint64_t ) now.tv_nsec + 1;
+}
+
+/******************************************************************************\
+ * classifyFileSystem()
+ *
+ * Internal - fill in the filesystem name and kind of volume holding the given
+ * path, leaving them empty and unknown if the filesystem can't be examined.
+\******************************************************************************/
+
+static void classifyFileSystem( const char * path, VolumeProfile * profile )
+{
+    struct statfs info;
+
+    if ( statfs( path, &info ) != 0 ) return;
+
+    #ifdef __APPLE__
+
+        snprintf( profile->fileSystem, sizeof( profile->fileSystem ), "%s", info.f_fstypename );
+
+        profile->kind = ( info.f_flags & MNT_LOCAL ) ? volumeKindLocal : volumeKindNetwork;
+
+    #else
+
+        /* Linux has no "local" flag, so go by the filesystem's magic number.
+         * FUSE could be anything, so is left to the latency probe.
+         */
+
+        static const struct
+        {
+            unsigned long   magic;
+            const char    * name;
+            VolumeKind      kind;
+        }
+        fileSystems[] =
+        {
+            { 0xEF53,     "ext4",    volumeKindLocal   },
+            { 0x58465342, "xfs",     volumeKindLocal   },
+            { 0x9123683E, "btrfs",   volumeKindLocal   },
+            { 0x01021994, "tmpfs",   volumeKindLocal   },
+            { 0x794C7630, "overlay", volumeKindLocal   },
+            { 0x4D44,     "msdos",   volumeKindLocal   },
+            { 0x2011BAB0, "exfat",   volumeKindLocal   },
+            { 0x5346544E, "ntfs",    volumeKindLocal   },
+            { 0x482B,     "hfsplus", volumeKindLocal   },
+            { 0x6969,     "nfs",     volumeKindNetwork },
+            { 0x517B,     "smb",     volumeKindNetwork },
+            { 0xFF534D42, "cifs",    volumeKindNetwork },
+            { 0xFE534D42, "smb2",    volumeKindNetwork },
+            { 0x01021997, "9p",      volumeKindNetwork },
+            { 0x00C36400, "ceph",    volumeKindNetwork },
+            { 0x5346414F, "afs",     volumeKindNetwork },
+            { 0x65735546, "fuse",    volumeKindUnknown }
+        };
+
+        unsigned long magic = ( unsigned long ) ( uint32_t ) info.f_type;
+
+        for ( size_t index = 0; index < sizeof( fileSystems ) / sizeof( fileSystems[ 0 ] ); index ++ )
+        {
+            if ( fileSystems[ index ].magic == magic )
+            {
+                snprintf( profile->fileSystem, sizeof( profile->fileSystem ), "%s", fileSystems[ index ].name );
+
+                profile->kind = fileSystems[ index ].kind;
+                return;
+            }
+        }
+
+        snprintf( profile->fileSystem, sizeof( profile->fileSystem ), "0x%lx", magic );
+
+    #endif
+}
+
+/******************************************************************************\
+ * probeLatency()
+ *
+ * Internal - time opening the given directory and reading its first batch of
+ * entries through the given backend, and classify the volume's latency from
+ * that. Leaves the latency unknown if the directory can't be read.
+\******************************************************************************/
+
+static void probeLatency( const char * path, const FolderScannerBackend * backend, VolumeProfile * profile )
+{
+    FolderScannerEntry entries[ VOLUME_PROFILE_PROBE_ENTRIES ];
+    uint64_t           started = monotonicNanoseconds();
+    void             * handle  = backend->openDirectory( path, backend->context );
+
+    if ( handle == NULL ) return;
+
+    long count = backend->readBatch( handle, entries, VOLUME_PROFILE_PROBE_ENTRIES );
+
+    backend->closeDirectory( handle );
+
+    if ( count < 0 ) return;
+
+    uint64_t taken = ( monotonicNanoseconds() - started ) / 1000;
+
+    profile->probeMicroseconds = taken > UINT32_MAX ? UINT32_MAX : ( uint32_t ) taken;
+
+    if      ( taken >= VOLUME_PROFILE_HIGH_LATENCY_US   ) profile->latency = volumeLatencyHigh;
+    else if ( taken >= VOLUME_PROFILE_MEDIUM_LATENCY_US ) profile->latency = volumeLatencyMedium;
+    else                                                  profile->latency = volumeLatencyLow;
+}
@@ -0,0 +1,161 @@
+/******************************************************************************\
+ * Utilities: VolumeProfile.h
+ *
+ * Profiles of the volumes that folders are scanned on, for use with
+ * "FolderScanner.h". A volume is classified by filesystem type - local or
+ * network - and by latency, measured by timing the open and first read of a
+ * directory on it through the backend that will be used to scan it. The
+ * scanner picks its strategy from the profile: a network mount or slow disk
+ * is best read in large batches by few threads, whereas a local SSD keeps up
+ * with many threads at once.
+ *
+ * Profiles are kept in a small process-wide table keyed by device, so each
+ * volume is only probed once in a while however many folders on it are
+ * scanned. Scan totals are accumulated against each volume too, so they can
+ * be reported at the end of a run.
+ *
+ * All functions are thread safe. This is plain C with no Cocoa dependencies.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef VOLUME_PROFILE_H
+#define VOLUME_PROFILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Latency class boundaries, in microseconds taken to open a directory and
+ * read its first batch of entries. A warm local SSD takes tens; a spinning
+ * disk which has to seek takes milliseconds; a file server takes at least a
+ * network round trip per request.
+ */
+
+#define VOLUME_PROFILE_MEDIUM_LATENCY_US 2000
+#define VOLUME_PROFILE_HIGH_LATENCY_US   20000
+
+/* Entries read by the probe, most volumes held in the table, and how long a
+ * profile lasts in seconds before the volume is probed again (device numbers
+ * are reused once a volume is unmounted, and a disk may spin down).
+ */
+
+#define VOLUME_PROFILE_PROBE_ENTRIES  64
+#define VOLUME_PROFILE_TABLE_SIZE     32
+#define VOLUME_PROFILE_LIFETIME_S     300
+
+/* See "FolderScanner.h" */
+
+struct FolderScannerBackend;
+
+typedef enum VolumeKind
+{
+    volumeKindUnknown = 0,
+    volumeKindLocal,
+    volumeKindNetwork
+
+} VolumeKind;
+
+typedef enum VolumeLatency
+{
+    volumeLatencyUnknown = 0, /* The probe could not read the directory */
+    volumeLatencyLow,
+    volumeLatencyMedium,
+    volumeLatencyHigh
+
+} VolumeLatency;
+
+typedef struct VolumeProfile
+{
+    uint64_t      device;
+    char          fileSystem[ 16 ];  /* E.g. "apfs", "smbfs"; "" if unknown */
+    VolumeKind    kind;
+    VolumeLatency latency;
+    uint32_t      probeMicroseconds;
+
+    /* Totals for all scans recorded against the volume */
+
+    uint64_t      scans;
+    uint64_t      directoriesRead;   /* Through the backend, not an index   */
+    uint64_t      entriesSeen;
+    uint64_t      scanMicroseconds;
+
+} VolumeProfile;
+
+/******************************************************************************\
+ * volumeProfileForPath()
+ *
+ * Find the profile of the volume holding the given directory, probing it
+ * through the given backend if it has not been seen recently. The probe is
+ * done without holding any lock, so a slow volume does not hold up lookups
+ * for others; if two threads probe the same volume at once, the later result
+ * wins.
+ *
+ * In:  Full path of a directory;
+ *
+ *      Backend to probe through;
+ *
+ *      Profile to fill in.
+ *
+ * Out: True if the profile was filled in, else false (with errno set) if the
+ *      path could not be examined at all.
+\******************************************************************************/
+
+bool volumeProfileForPath( const char                        * path,
+                           const struct FolderScannerBackend * backend,
+                           VolumeProfile                     * profile );
+
+/******************************************************************************\
+ * volumeProfileRecordScan()
+ *
+ * Add the results of a scan to the totals for a volume. Ignored if the volume
+ * is no longer in the table.
+ *
+ * In:  Device, as in a profile from volumeProfileForPath();
+ *
+ *      Directories read through the backend;
+ *
+ *      Entries seen;
+ *
+ *      Wall-clock time taken in microseconds.
+\******************************************************************************/
+
+void volumeProfileRecordScan( uint64_t device,
+                              uint64_t directoriesRead,
+                              uint64_t entriesSeen,
+                              uint64_t microseconds );
+
+/******************************************************************************\
+ * volumeProfileCopyAll()
+ *
+ * Copy out the profiles currently held, most recently probed first.
+ *
+ * In:  Array to fill in;
+ *
+ *      Number of entries in that array.
+ *
+ * Out: Number of profiles copied.
+\******************************************************************************/
+
+size_t volumeProfileCopyAll( VolumeProfile * profiles, size_t maximum );
+
+/******************************************************************************\
+ * volumeProfileForget()
+ *
+ * Discard all profiles, so that every volume is probed again when next used.
+\******************************************************************************/
+
+void volumeProfileForget( void );
+
+/******************************************************************************\
+ * volumeKindName(), volumeLatencyName()
+ *
+ * In:  Volume kind or latency class.
+ *
+ * Out: A short, static, lower case description, for logging.
+\******************************************************************************/
+
+const char * volumeKindName   ( VolumeKind    kind    );
+const char * volumeLatencyName( VolumeLatency latency );
+
+#endif /* VOLUME_PROFILE_H */
@@ -11,6 +11,9 @@
 
 #import <Cocoa/Cocoa.h>
 #import "CustomIconGenerator.h"
+#import "TaskScheduler.h"
+
+@class SharedTreeWalk;
 
 @interface ConcurrentPathProcessor : NSOperation
 {
@@ -19,8 +22,41 @@
 @property          CustomIconGenerator * iconGenerator;
 @property ( copy ) NSString            * pathData;
 
+/* If set, a walk on which this processor depends and which may already have
+ * chosen images for the folder; see "SharedTreeWalk.h".
+ */
+
+@property          SharedTreeWalk      * treeWalk;
+
+/* Task scheduler lane for the folder's drawing; see "TaskScheduler.h". The
+ * default is taskSchedulerLaneUserInitiated.
+ */
+
+@property          TaskSchedulerLane     lane;
+
 - ( instancetype ) init NS_UNAVAILABLE; /* Use -initWithIconStyle:... instead */
 - ( instancetype ) initWithIconStyle: ( IconStyle * ) theIconStyle
                         forPOSIXPath: ( NSString  * ) thePosixPath;
 
+/* The work done by -main, split into stages which can be run one at a time,
+ * in order, on different threads - see "IconPipeline.h". -performStage:
+ * returns NO once there is nothing more to do for the folder, whether it is
+ * finished, failed or cancelled; -finish must then be called, once, to record
+ * the outcome.
+ */
+
+typedef NS_ENUM( NSUInteger, ConcurrentPathProcessorStage )
+{
+    concurrentPathProcessorStageScan,      /* Find images; file I/O         */
+    concurrentPathProcessorStageDecode,    /* Decode thumbnails; CPU        */
+    concurrentPathProcessorStageComposite, /* Draw the icon; CPU            */
+    concurrentPathProcessorStageEncode,    /* Build the icon family; CPU    */
+    concurrentPathProcessorStageWrite,     /* Apply it to the folder; I/O   */
+
+    concurrentPathProcessorStageCount
+};
+
+- ( BOOL ) performStage: ( ConcurrentPathProcessorStage ) stage;
+- ( void ) finish;
+
 @end /* @interface ConcurrentPathProcessor : NSOperation */
@@ -17,8 +17,24 @@
 #import "GlobalSemaphore.h"
 #import "Icons.h"
 #import "CustomIconGenerator.h"
+#import "SharedTreeWalk.h"
 
-/* Application communication */
+/* State carried from one stage to the next */
+
+@interface ConcurrentPathProcessor()
+{
+    NSArray          * chosenImages;
+    CGImageRef         finalImage;
+    IconFamilyHandle   iconHnd;
+}
+
+@property OSStatus status;
+@property int      errorNumber; /* Value of errno when status was set */
+@property BOOL     written;
+@property BOOL     unchanged;
+@property BOOL     failed; /* Set by an exception */
+
+@end
 
 @implementation ConcurrentPathProcessor
 
@@ -53,6 +69,8 @@
     if ( ( self = [ super init ] ) )
     {
         _pathData      = posixPath;
+        _status        = noErr;
+        _lane          = taskSchedulerLaneUserInitiated;
         _iconGenerator = [
             [ CustomIconGenerator alloc ] initWithIconStyle: iconStyle
                                                forPOSIXPath: posixPath
@@ -62,132 +80,67 @@
     return self;
 }
 
+- ( void ) dealloc
+{
+    if ( finalImage != NULL ) CFRelease( finalImage );
+    if ( iconHnd    != NULL ) DisposeHandle( ( Handle ) iconHnd );
+}
+
 /******************************************************************************\
  * - main
  *
  * Main processing loop. Usually invoked only by the Grand Central Dispatch
  * mechanism's Cocoa code. The folder given in "initWithPathAndBackground"
  * will have gained an updated icon on exit provided there were no errors.
+ * Runs each stage in turn on the calling thread.
 \******************************************************************************/
 
 -( void ) main
 {
+    for ( ConcurrentPathProcessorStage stage = 0; stage < concurrentPathProcessorStageCount; stage ++ )
+    {
+        if ( [ self performStage: stage ] == NO ) break;
+    }
+
+    [ self finish ];
+}
+
+/******************************************************************************\
+ * - performStage:
+ *
+ * Run one stage of the work for the folder. Stages must be run in order, one
+ * at a time, though not necessarily on the same thread.
+ *
+ * In:  ( ConcurrentPathProcessorStage ) stage
+ *      Stage to run.
+ *
+ * Out: YES if there is more to do, so the next stage should be run; NO if not
+ *      (including after the last stage), after which call -finish.
+\******************************************************************************/
+
+- ( BOOL ) performStage: ( ConcurrentPathProcessorStage ) stage
+{
+    BOOL more = NO;
+
     @autoreleasepool
     {
         @try
         {
-            NSError  * error  = nil;
-            OSStatus   status = noErr;
+            if ( self.isCancelled ) return NO;
 
-            if ( self.isCancelled ) return;
+            /* Stages may run on any thread, so set its lane each time */
 
-            /* Generate the thumbnail */
+            taskSchedulerSetLane( self.lane );
 
-            CGImageRef finalImage = [ _iconGenerator generate: & error ];
-
-            if ( self.isCancelled ) return;
-
-            if ( finalImage )
+            switch ( stage )
             {
-                /* Debugging option - dump the icon data to a file with a name based
-                 * on the folder's name, alongside that folder.
-                 *
-                 * See also "GlobalConstants.h".
-                 */
-                
-                #ifdef DUMP_ICON_MASTER_IMAGE_TO_PNG_FILE
-
-                    NSString * dumpPath = [ _pathData stringByAppendingString: @"/__AddFolderIconsDumpedIcon__.png" ];
-                    NSURL    * dumpURL  = [ NSURL fileURLWithPath: dumpPath ];
-
-                    CGImageDestinationRef imageDest = CGImageDestinationCreateWithURL
-                    (
-                        ( CFURLRef ) dumpURL, /* "Toll-free bridge" */
-                        kUTTypePNG,
-                        1,
-                        NULL
-                    );
-
-                    /* Since this is a debugging function, we're not interested in
-                     * detecting or attempting to report problems at run-time.
-                     */
-                    
-                    if ( imageDest )
-                    {
-                        CGImageDestinationAddImage( imageDest, finalImage, NULL );
-                        ( void ) CGImageDestinationFinalize( imageDest );
-                        CFRelease( imageDest );
-                    }
-
-                #endif    
-
-                /* The Finder gets buggier with each OS release and by
-                 * Mavericks and especially Yosemite is extremely reluctant
-                 * to update the view when a folder icon *changes* but tends
-                 * to perform better if the icon is *removed then added*, so
-                 * remove it first here.
-                 *
-                 * It's pretty depressing how consistently changes to objects
-                 * result in no Finder view updates, even if QuickLook shows
-                 * the changes immediately.
-                 */
-
-                [ [ NSWorkspace sharedWorkspace ] setIcon: nil forFile: self.pathData options: 0 ];
-
-                /* Apply the thumbnail to the folder. Since the global
-                 * semaphore is needed here, an inned try...catch construct
-                 * is required to ensure it gets released whatever happens.
-                 */
-
-                IconFamilyHandle iconHnd = NULL;
-                status = createIconFamilyFromCGImage( finalImage, &iconHnd );
-
-                if ( status == noErr && iconHnd != NULL )
-                {
-                    @try
-                    {
-                        globalSemaphoreClaim();
-                        status = saveCustomIcon( self.pathData, iconHnd );
-                        globalSemaphoreRelease();
-                    }
-                    @catch ( NSException * exception )
-                    {
-                        globalSemaphoreRelease();
-
-                        NSLog
-                        (
-                            @"%@ (saveCustomIcon()): Exception '%@': %@",
-                            @PROGRAM_STRING,
-                            [ exception name   ],
-                            [ exception reason ]
-                        );
-                        
-                        @throw exception;
-                    }
-
-                    DisposeHandle( ( Handle ) iconHnd );
-                }
-
-                CFRelease( finalImage );
-            }
+                case concurrentPathProcessorStageScan:      more = [ self scan      ]; break;
+                case concurrentPathProcessorStageDecode:    more = [ self decode    ]; break;
+                case concurrentPathProcessorStageComposite: more = [ self composite ]; break;
+                case concurrentPathProcessorStageEncode:    more = [ self encode    ]; break;
+                case concurrentPathProcessorStageWrite:     more = [ self write     ]; break;
 
-            if ( status != noErr )
-            {
-                NSLog
-                (
-                    @"%@: Failed for '%@' with OSStatus code %d (&%04X) and errno value %d (&%04X): %@",
-                    @PROGRAM_STRING,
-                    self.pathData,
-                    ( int          ) status,
-                    ( unsigned int ) status,
-                    ( int          ) errno,
-                    ( unsigned int ) errno,
-                    @( strerror( errno ) )
-                );
-
-                globalSemaphoreClaim();
-                globalErrorFlag = YES;
-                globalSemaphoreRelease();
+                default: break;
             }
         }
         @catch ( NSException * exception )
@@ -200,12 +153,225 @@
                 [ exception reason ]
             );
 
-            globalSemaphoreClaim();
-            globalErrorFlag = YES;
-            globalSemaphoreRelease();
+            self.failed = YES;
+            more        = NO;
         }
 
     } // @autoreleasepool
+
+    return more;
+}
+
+/******************************************************************************\
+ * - scan
+ *
+ * Find the images to use, or pick up any chosen by a shared walk of a larger
+ * tree.
+ *
+ * Out: YES if images were found, else NO.
+\******************************************************************************/
+
+- ( BOOL ) scan
+{
+    NSError * error = nil;
+
+    if ( self.treeWalk != nil )
+    {
+        /* Under an NSOperationQueue the dependency has already seen to this */
+
+        [ self.treeWalk waitUntilFinished ];
+
+        _iconGenerator.precomputedImages = [ self.treeWalk imagesFor: self.pathData ];
+        self.treeWalk                    = nil;
+    }
+
+    chosenImages = [ _iconGenerator findImages: & error ];
+
+    return chosenImages != nil;
+}
+
+/******************************************************************************\
+ * - decode
+ *
+ * Decode thumbnails of the images found.
+ *
+ * Out: YES.
+\******************************************************************************/
+
+- ( BOOL ) decode
+{
+    [ _iconGenerator decodeImages: chosenImages ];
+
+    return YES;
+}
+
+/******************************************************************************\
+ * - composite
+ *
+ * Draw the icon from the decoded thumbnails.
+ *
+ * Out: YES if an icon was drawn, else NO.
+\******************************************************************************/
+
+- ( BOOL ) composite
+{
+    NSError * error = nil;
+
+    finalImage   = [ _iconGenerator composeIconFrom: chosenImages errorsTo: & error ];
+    chosenImages = nil;
+
+    if ( finalImage == NULL ) return NO;
+
+    /* Debugging option - dump the icon data to a file with a name based
+     * on the folder's name, alongside that folder.
+     *
+     * See also "GlobalConstants.h".
+     */
+
+    #ifdef DUMP_ICON_MASTER_IMAGE_TO_PNG_FILE
+
+        NSString * dumpPath = [ _pathData stringByAppendingString: @"/__AddFolderIconsDumpedIcon__.png" ];
+        NSURL    * dumpURL  = [ NSURL fileURLWithPath: dumpPath ];
+
+        CGImageDestinationRef imageDest = CGImageDestinationCreateWithURL
+        (
+            ( CFURLRef ) dumpURL, /* "Toll-free bridge" */
+            kUTTypePNG,
+            1,
+            NULL
+        );
+
+        /* Since this is a debugging function, we're not interested in
+         * detecting or attempting to report problems at run-time.
+         */
+
+        if ( imageDest )
+        {
+            CGImageDestinationAddImage( imageDest, finalImage, NULL );
+            ( void ) CGImageDestinationFinalize( imageDest );
+            CFRelease( imageDest );
+        }
+
+    #endif
+
+    return YES;
+}
+
+/******************************************************************************\
+ * - encode
+ *
+ * Build the icon family from the icon.
+ *
+ * Out: YES if the family was built, else NO.
+\******************************************************************************/
+
+- ( BOOL ) encode
+{
+    self.status      = createIconFamilyFromCGImage( finalImage, &iconHnd );
+    self.errorNumber = errno;
+
+    CFRelease( finalImage );
+    finalImage = NULL;
+
+    return self.status == noErr && iconHnd != NULL;
+}
+
+/******************************************************************************\
+ * - write
+ *
+ * Apply the icon family to the folder.
+ *
+ * Out: NO; this is the last stage.
+\******************************************************************************/
+
+- ( BOOL ) write
+{
+    /* Re-runs over folders which haven't changed produce exactly the icons
+     * already there, so if asked to, leave those alone rather than rewriting
+     * them and provoking the Finder into refreshing.
+     */
+
+    if ( [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"skipUnchangedIcons" ] )
+    {
+        self.unchanged = hasSameCustomIcon( self.pathData, iconHnd );
+    }
+
+    if ( self.unchanged == NO )
+    {
+        /* The Finder gets buggier with each OS release and by Mavericks and
+         * especially Yosemite is extremely reluctant to update the view when
+         * a folder icon *changes* but tends to perform better if the icon is
+         * *removed then added*, so remove it first here.
+         *
+         * It's pretty depressing how consistently changes to objects result
+         * in no Finder view updates, even if QuickLook shows the changes
+         * immediately.
+         */
+
+        [ [ NSWorkspace sharedWorkspace ] setIcon: nil forFile: self.pathData options: 0 ];
+
+        /* Apply the thumbnail to the folder. This runs in parallel with other
+         * processors; saveCustomIcon() takes the global semaphore itself in
+         * the rare cases that it needs it.
+         */
+
+        self.status      = saveCustomIcon( self.pathData, iconHnd );
+        self.errorNumber = errno;
+        self.written     = ( self.status == noErr );
+    }
+
+    DisposeHandle( ( Handle ) iconHnd );
+    iconHnd = NULL;
+
+    return NO;
+}
+
+/******************************************************************************\
+ * - finish
+ *
+ * Record the outcome for the folder once no more stages are to be run, in the
+ * global error flag and icon write counts (see "GlobalConstants.h"), and free
+ * anything left over from an unfinished run.
+\******************************************************************************/
+
+- ( void ) finish
+{
+    if ( finalImage != NULL ) CFRelease( finalImage );
+    if ( iconHnd    != NULL ) DisposeHandle( ( Handle ) iconHnd );
+
+    finalImage   = NULL;
+    iconHnd      = NULL;
+    chosenImages = nil;
+
+    if ( self.status != noErr )
+    {
+        NSLog
+        (
+            @"%@: Failed for '%@' with OSStatus code %d (&%04X) and errno value %d (&%04X): %@",
+            @PROGRAM_STRING,
+            self.pathData,
+            ( int          ) self.status,
+            ( unsigned int ) self.status,
+            ( int          ) self.errorNumber,
+            ( unsigned int ) self.errorNumber,
+            @( strerror( self.errorNumber ) )
+        );
+    }
+
+    if ( self.status != noErr || self.failed )
+    {
+        globalSemaphoreClaim();
+        globalErrorFlag = YES;
+        globalIconWriteCounts.failed ++;
+        globalSemaphoreRelease();
+    }
+    else if ( self.written || self.unchanged )
+    {
+        globalSemaphoreClaim();
+        if ( self.written ) globalIconWriteCounts.written   ++;
+        else                globalIconWriteCounts.unchanged ++;
+        globalSemaphoreRelease();
+    }
 }
 
 @end /* @implementation ConcurrentPathProcessor */
@@ -0,0 +1,98 @@
+/******************************************************************************\
+ * addfoldericons: IconPipeline.h
+ *
+ * Process a batch of ConcurrentPathProcessor instances as a staged pipeline
+ * rather than as one NSOperation per folder. Folders go through each stage of
+ * the work (see "ConcurrentPathProcessor.h") in turn:
+ *
+ *   scan -> decode -> composite -> encode -> write
+ *
+ * Scanning and writing are mostly waiting for the filesystem, so each has its
+ * own worker threads taking folders from a bounded buffer. How many of them
+ * to run at once is tuned as the pipeline runs, from measured throughput and
+ * latency (see "ConcurrencyController.h"), unless the "adaptiveConcurrency"
+ * preference is turned off.
+ *
+ * Decoding, compositing and encoding are CPU-bound, so once a folder has been
+ * scanned they are run as one task for it on the task scheduler, in the
+ * folder's lane (see "TaskScheduler.h"). They share its worker per processor
+ * core with previews and every other CPU-bound job, rather than adding threads
+ * to compete with it. The drawn folder then goes into the write stage's
+ * buffer. While one folder is being drawn, others can be scanned or written.
+ *
+ * Only so many folders may be drawn or waiting to be written at once. Scan
+ * workers wait for room before handing a folder on, so slow drawing or
+ * writing holds back scanning rather than letting decoded images pile up in
+ * memory; the feed into the scan stage's buffer waits likewise.
+ *
+ * Each pipeline runs one batch. Use "-statisticsForStage:" during or after the
+ * run to see how busy each stage is and how fast folders are getting through.
+ * "-logStatistics" logs what was learned about each volume scanned, and the
+ * stage statistics too if the hidden "logRunStatistics" preference is set.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#import <Cocoa/Cocoa.h>
+#import "ConcurrentPathProcessor.h"
+
+/* Workers for each of the I/O stages: a fixed number if not adaptive; else
+ * bounds per active processor core and a number to start with, low enough not
+ * to swamp a file server before the first sample is taken. The controller is
+ * sampled at the given interval in seconds. Each I/O stage's input buffer
+ * holds this many folders per worker thread, and this many folders per
+ * active processor core may be drawn or waiting to be written at once.
+ */
+
+#define ICON_PIPELINE_IO_WORKERS          8
+#define ICON_PIPELINE_MINIMUM_IO_WORKERS  1
+#define ICON_PIPELINE_IO_WORKERS_PER_CORE 2
+#define ICON_PIPELINE_INITIAL_IO_WORKERS  2
+#define ICON_PIPELINE_SAMPLE_INTERVAL     2.0
+#define ICON_PIPELINE_BUFFER_FACTOR       2
+
+/* For the stages run as tasks, "workers" and "limit" are 0; "queued" counts
+ * folders whose tasks have yet to start, and "capacity" is the most folders
+ * drawn or waiting to be written at once for decoding, else 0.
+ */
+
+typedef struct IconPipelineStageStatistics
+{
+    NSUInteger     workers;     /* Threads                                   */
+    NSUInteger     limit;       /* Of those, how many may run it at once     */
+    NSUInteger     capacity;    /* Of the stage's input buffer               */
+    NSUInteger     queued;      /* Folders in that buffer now                */
+    NSUInteger     peakQueued;
+    NSUInteger     busy;        /* Workers running the stage now             */
+    uint64_t       completed;   /* Folders through the stage so far          */
+    NSTimeInterval busyTime;    /* Total across workers running the stage    */
+    NSTimeInterval blockedTime; /* Total waiting for room in the next stage  */
+    double         throughput;  /* Completed per second since the run began  */
+
+} IconPipelineStageStatistics;
+
+@interface IconPipeline : NSObject
+
+/* Called on a worker thread whenever a folder leaves the pipeline, whether it
+ * was finished, failed, or was cancelled.
+ */
+
+@property ( copy ) void ( ^ folderCompleted )( ConcurrentPathProcessor * processor );
+
+/* Called on a background thread whenever the number of I/O workers allowed
+ * to run at once changes, with the new number.
+ */
+
+@property ( copy ) void ( ^ concurrencyChanged )( NSUInteger ioWorkers );
+
+- ( void ) processFolders: ( NSArray * ) processors;
+- ( void ) cancel;
+
+- ( IconPipelineStageStatistics ) statisticsForStage: ( ConcurrentPathProcessorStage ) stage;
+- ( void                        ) logStatistics;
+
+@property ( readonly ) BOOL       isCancelled;
+@property ( readonly ) BOOL       adaptive;  /* Tuning I/O concurrency?        */
+@property ( readonly ) NSUInteger ioWorkers; /* How many may run at once, now  */
+
+@end /* @interface IconPipeline : NSObject */
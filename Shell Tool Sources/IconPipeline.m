@@ -0,0 +1,880 @@
+/******************************************************************************\
+ * addfoldericons: IconPipeline.m
+ *
+ * Process a batch of ConcurrentPathProcessor instances as a staged pipeline.
+ * See "IconPipeline.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#import "IconPipeline.h"
+
+#import "GlobalConstants.h"
+#import "SharedTreeWalk.h"
+#import "ConcurrencyController.h"
+#import "TaskScheduler.h"
+#import "VolumeProfile.h"
+
+#import <pthread.h>
+
+static const char * stageNames[ concurrentPathProcessorStageCount ] =
+{
+    "scan",
+    "decode",
+    "composite",
+    "encode",
+    "write"
+};
+
+/******************************************************************************\
+ * One stage of a pipeline: a bounded buffer of folders waiting for the stage,
+ * and the counters for the workers running it. Stages run as tasks on the
+ * task scheduler have no buffer or workers of their own, just the counters.
+\******************************************************************************/
+
+@interface IconPipelineStage : NSObject
+{
+    pthread_mutex_t               lock;
+    pthread_cond_t                notEmpty;
+    pthread_cond_t                notFull;
+    NSMutableArray              * buffer;
+    BOOL                          closed;
+    NSUInteger                    running;  /* Workers yet to exit */
+    IconPipelineStageStatistics   counters;
+}
+
+@property ( readonly ) ConcurrentPathProcessorStage   stage;
+@property              IconPipelineStage            * next;
+
+- ( instancetype ) initForStage: ( ConcurrentPathProcessorStage ) stage
+                        workers: ( NSUInteger                   ) workers
+                       capacity: ( NSUInteger                   ) capacity;
+
+- ( void                      ) put: ( ConcurrentPathProcessor * ) processor;
+- ( ConcurrentPathProcessor * ) take;
+- ( void                      ) close;
+
+- ( void ) setLimit:      ( NSUInteger     ) limit;
+
+- ( void ) taskQueued;
+- ( void ) taskDequeued;
+- ( void ) willRun;
+
+- ( void ) didRunFor:     ( NSTimeInterval ) busyTime;
+- ( void ) didBlockFor:   ( NSTimeInterval ) blockedTime;
+- ( BOOL ) workerExiting;
+
+- ( IconPipelineStageStatistics ) statistics;
+
+@end
+
+@implementation IconPipelineStage
+
+/******************************************************************************\
+ * -initForStage:workers:capacity:
+ *
+ * Initialise a stage.
+ *
+ * In:  ( ConcurrentPathProcessorStage ) stage
+ *      Which stage this is;
+ *
+ *      ( NSUInteger ) workers
+ *      Number of worker threads that will run it, or 0 if it is run as tasks
+ *      on the task scheduler;
+ *
+ *      ( NSUInteger ) capacity
+ *      Most folders the input buffer may hold, or for stages run as tasks,
+ *      the capacity to report.
+\******************************************************************************/
+
+- ( instancetype ) initForStage: ( ConcurrentPathProcessorStage ) stage
+                        workers: ( NSUInteger                   ) workers
+                       capacity: ( NSUInteger                   ) capacity
+{
+    if ( ( self = [ super init ] ) )
+    {
+        pthread_mutex_init( &lock,     NULL );
+        pthread_cond_init ( &notEmpty, NULL );
+        pthread_cond_init ( &notFull,  NULL );
+
+        _stage            = stage;
+        running           = workers;
+        counters.workers  = workers;
+        counters.limit    = workers;
+        counters.capacity = capacity;
+        buffer            = [ NSMutableArray arrayWithCapacity: counters.capacity ];
+    }
+
+    return self;
+}
+
+- ( void ) dealloc
+{
+    pthread_cond_destroy ( &notFull  );
+    pthread_cond_destroy ( &notEmpty );
+    pthread_mutex_destroy( &lock     );
+}
+
+/******************************************************************************\
+ * -put:
+ *
+ * Add a folder to the stage's buffer, waiting for room if it is full.
+ *
+ * In:  ( ConcurrentPathProcessor * ) processor
+ *      Processor for the folder, having completed all earlier stages.
+\******************************************************************************/
+
+- ( void ) put: ( ConcurrentPathProcessor * ) processor
+{
+    pthread_mutex_lock( &lock );
+
+    while ( [ buffer count ] >= counters.capacity )
+    {
+        pthread_cond_wait( &notFull, &lock );
+    }
+
+    [ buffer addObject: processor ];
+
+    counters.queued     = [ buffer count ];
+    counters.peakQueued = MAX( counters.peakQueued, counters.queued );
+
+    pthread_cond_signal  ( &notEmpty );
+    pthread_mutex_unlock ( &lock     );
+}
+
+/******************************************************************************\
+ * -take
+ *
+ * Take the next folder from the stage's buffer, waiting for one if it is
+ * empty, or while as many workers as the stage's limit allows are busy. The
+ * caller counts as busy until it calls -didRunFor:.
+ *
+ * Out: Processor for the folder, or nil if the buffer is empty and closed, in
+ *      which case the worker should exit.
+\******************************************************************************/
+
+- ( ConcurrentPathProcessor * ) take
+{
+    ConcurrentPathProcessor * processor = nil;
+
+    pthread_mutex_lock( &lock );
+
+    while ( ( [ buffer count ] == 0 && closed == NO ) ||
+            ( [ buffer count ]  > 0 && counters.busy >= counters.limit ) )
+    {
+        pthread_cond_wait( &notEmpty, &lock );
+    }
+
+    if ( [ buffer count ] > 0 )
+    {
+        processor = buffer[ 0 ];
+        [ buffer removeObjectAtIndex: 0 ];
+
+        counters.queued = [ buffer count ];
+        counters.busy ++;
+
+        pthread_cond_signal( &notFull );
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    return processor;
+}
+
+/******************************************************************************\
+ * -close
+ *
+ * Note that nothing more will be added to the buffer, so that workers exit
+ * once it is empty.
+\******************************************************************************/
+
+- ( void ) close
+{
+    pthread_mutex_lock    ( &lock     );
+    closed = YES;
+    pthread_cond_broadcast( &notEmpty );
+    pthread_mutex_unlock  ( &lock     );
+}
+
+/******************************************************************************\
+ * -setLimit:
+ *
+ * Change how many of the stage's workers may run it at once. Workers already
+ * running carry on if the limit is lowered below their number.
+ *
+ * In:  ( NSUInteger ) limit
+ *      New limit, from 1 to the number of workers.
+\******************************************************************************/
+
+- ( void ) setLimit: ( NSUInteger ) limit
+{
+    pthread_mutex_lock    ( &lock );
+    counters.limit = MAX( 1, MIN( limit, counters.workers ) );
+    pthread_cond_broadcast( &notEmpty );
+    pthread_mutex_unlock  ( &lock );
+}
+
+/******************************************************************************\
+ * -taskQueued, -taskDequeued, -willRun
+ *
+ * For stages run as tasks: count a folder as waiting for its task to start;
+ * as no longer waiting, because the task has started or been cancelled; and
+ * as being run, until -didRunFor: is called.
+\******************************************************************************/
+
+- ( void ) taskQueued
+{
+    pthread_mutex_lock  ( &lock );
+    counters.queued ++;
+    counters.peakQueued = MAX( counters.peakQueued, counters.queued );
+    pthread_mutex_unlock( &lock );
+}
+
+- ( void ) taskDequeued
+{
+    pthread_mutex_lock  ( &lock );
+    counters.queued --;
+    pthread_mutex_unlock( &lock );
+}
+
+- ( void ) willRun
+{
+    pthread_mutex_lock  ( &lock );
+    counters.busy ++;
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * -didRunFor:
+ *
+ * Count a folder through the stage.
+ *
+ * In:  ( NSTimeInterval ) busyTime
+ *      Time spent running the stage for it.
+\******************************************************************************/
+
+- ( void ) didRunFor: ( NSTimeInterval ) busyTime
+{
+    pthread_mutex_lock( &lock );
+
+    counters.busy      --;
+    counters.completed ++;
+    counters.busyTime  += busyTime;
+
+    /* Let in any worker held back by the limit */
+
+    pthread_cond_signal ( &notEmpty );
+    pthread_mutex_unlock( &lock     );
+}
+
+/******************************************************************************\
+ * -didBlockFor:
+ *
+ * Count time spent handing a folder on to the next stage.
+ *
+ * In:  ( NSTimeInterval ) blockedTime
+ *      Time spent waiting for room in the next stage's buffer.
+\******************************************************************************/
+
+- ( void ) didBlockFor: ( NSTimeInterval ) blockedTime
+{
+    pthread_mutex_lock  ( &lock );
+    counters.blockedTime += blockedTime;
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * -workerExiting
+ *
+ * Out: YES if the calling worker is the last of the stage's workers to exit,
+ *      so the next stage can be closed.
+\******************************************************************************/
+
+- ( BOOL ) workerExiting
+{
+    BOOL last;
+
+    pthread_mutex_lock  ( &lock );
+    last = ( -- running == 0 );
+    pthread_mutex_unlock( &lock );
+
+    return last;
+}
+
+/******************************************************************************\
+ * -statistics
+ *
+ * Out: A snapshot of the stage's counters, throughput not filled in.
+\******************************************************************************/
+
+- ( IconPipelineStageStatistics ) statistics
+{
+    IconPipelineStageStatistics snapshot;
+
+    pthread_mutex_lock  ( &lock );
+    snapshot = counters;
+    pthread_mutex_unlock( &lock );
+
+    return snapshot;
+}
+
+@end /* @implementation IconPipelineStage */
+
+/******************************************************************************\
+ * The pipeline itself
+\******************************************************************************/
+
+@interface IconPipeline()
+{
+    NSArray          * stages;
+    dispatch_group_t   workers;
+    NSOperationQueue * walks;
+    CFAbsoluteTime     startTime;
+    CFAbsoluteTime     endTime;
+    BOOL               logging;
+
+    /* Folders being drawn on the task scheduler or waiting to be written;
+     * scan workers waiting for room take a ticket, so get it in turn.
+     */
+
+    pthread_mutex_t    drawLock;
+    pthread_cond_t     drawRoom;
+    NSUInteger         drawing;
+    NSUInteger         drawLimit;
+    uint64_t           drawTickets;
+    uint64_t           drawServing;
+    dispatch_group_t   drawings;
+
+    /* Adaptive I/O concurrency, sampled on a timer */
+
+    dispatch_source_t             sampler;
+    ConcurrencyController         controller;
+    CFAbsoluteTime                sampleTime;
+    IconPipelineStageStatistics   lastScan;
+    IconPipelineStageStatistics   lastWrite;
+}
+
+@property ( readwrite ) BOOL isCancelled;
+
+- ( void ) runWorkerFor:  ( IconPipelineStage       * ) stage;
+- ( void ) draw:          ( ConcurrentPathProcessor * ) processor;
+- ( void ) runDrawingFor: ( ConcurrentPathProcessor * ) processor;
+- ( void ) drawingLeft;
+- ( void ) leave:         ( ConcurrentPathProcessor * ) processor;
+- ( void ) sample;
+
+@end
+
+@implementation IconPipeline
+
+/******************************************************************************\
+ * -init
+ *
+ * Initialise a pipeline, ready for -processFolders:.
+\******************************************************************************/
+
+- ( instancetype ) init
+{
+    if ( ( self = [ super init ] ) )
+    {
+        NSUInteger       cores    = MAX( 1, [ [ NSProcessInfo processInfo ] activeProcessorCount ] );
+        NSUInteger       ioMost   = MAX( ICON_PIPELINE_IO_WORKERS, cores * ICON_PIPELINE_IO_WORKERS_PER_CORE );
+        BOOL             adaptive = [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"adaptiveConcurrency" ];
+        NSMutableArray * built    = [ NSMutableArray arrayWithCapacity: concurrentPathProcessorStageCount ];
+
+        /* The I/O stages get enough threads for the most the controller may
+         * choose, limited to what it chooses; see "ConcurrencyController.h".
+         * Without it, they're limited to a fixed number.
+         */
+
+        concurrencyControllerInit
+        (
+            &controller,
+            ICON_PIPELINE_MINIMUM_IO_WORKERS,
+            ( unsigned int ) ( cores * ICON_PIPELINE_IO_WORKERS_PER_CORE ),
+            ICON_PIPELINE_INITIAL_IO_WORKERS
+        );
+
+        _adaptive  = adaptive;
+        _ioWorkers = adaptive ? controller.current : ICON_PIPELINE_IO_WORKERS;
+        logging    = [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"logRunStatistics" ];
+        drawLimit  = cores * ICON_PIPELINE_BUFFER_FACTOR;
+
+        /* Only scanning and writing get threads of their own. The stages in
+         * between are run as one task per folder on the task scheduler, in
+         * the folder's lane, so that they share its one worker per core with
+         * every other CPU-bound job rather than competing with it.
+         */
+
+        for ( ConcurrentPathProcessorStage stage = 0; stage < concurrentPathProcessorStageCount; stage ++ )
+        {
+            BOOL                io       = ( stage == concurrentPathProcessorStageScan ||
+                                             stage == concurrentPathProcessorStageWrite );
+            NSUInteger          capacity = io                                         ? ioMost * ICON_PIPELINE_BUFFER_FACTOR :
+                                           stage == concurrentPathProcessorStageDecode ? drawLimit                            :
+                                                                                         0;
+            IconPipelineStage * created  = [
+                [ IconPipelineStage alloc ] initForStage: stage
+                                                 workers: io ? ioMost : 0
+                                                capacity: capacity
+            ];
+
+            if ( io ) [ created setLimit: _ioWorkers ];
+
+            [ built addObject: created ];
+        }
+
+        /* Drawn folders go straight into the write stage's buffer. It has
+         * room for more than may be drawing at once, so tasks never wait.
+         */
+
+        [ built[ concurrentPathProcessorStageScan ] setNext: built[ concurrentPathProcessorStageWrite ] ];
+
+        pthread_mutex_init( &drawLock, NULL );
+        pthread_cond_init ( &drawRoom, NULL );
+
+        stages   = [ built copy ];
+        workers  = dispatch_group_create();
+        drawings = dispatch_group_create();
+        walks    = [ [ NSOperationQueue alloc ] init ];
+
+        /* Shared tree walks run alongside the scan workers that wait for them */
+
+        walks.maxConcurrentOperationCount = ICON_PIPELINE_IO_WORKERS;
+    }
+
+    return self;
+}
+
+- ( void ) dealloc
+{
+    pthread_cond_destroy ( &drawRoom );
+    pthread_mutex_destroy( &drawLock );
+}
+
+/******************************************************************************\
+ * -processFolders:
+ *
+ * Run the given folders through the pipeline, returning once all are done or
+ * the pipeline is cancelled and all in flight have left it. Folders nested
+ * within others in the batch share tree walks; see "SharedTreeWalk.h". Call
+ * only once per pipeline.
+ *
+ * In:  ( NSArray * ) processors
+ *      Array of ConcurrentPathProcessor instances, not added to any queue.
+\******************************************************************************/
+
+- ( void ) processFolders: ( NSArray * ) processors
+{
+    startTime  = CFAbsoluteTimeGetCurrent();
+    sampleTime = startTime;
+
+    if ( self.adaptive )
+    {
+        uint64_t interval = ( uint64_t ) ( ICON_PIPELINE_SAMPLE_INTERVAL * NSEC_PER_SEC );
+
+        sampler = dispatch_source_create
+        (
+            DISPATCH_SOURCE_TYPE_TIMER,
+            0,
+            0,
+            dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 )
+        );
+
+        __weak IconPipeline * weakSelf = self;
+
+        dispatch_source_set_timer         ( sampler, dispatch_time( DISPATCH_TIME_NOW, interval ), interval, interval / 10 );
+        dispatch_source_set_event_handler ( sampler, ^{ [ weakSelf sample ]; } );
+        dispatch_resume                   ( sampler );
+    }
+
+    [ walks addOperations: [ SharedTreeWalk planWalksForProcessors: processors ]
+        waitUntilFinished: NO ];
+
+    for ( IconPipelineStage * stage in stages )
+    {
+        NSUInteger count = [ stage statistics ].workers;
+
+        for ( NSUInteger worker = 0; worker < count; worker ++ )
+        {
+            dispatch_group_enter( workers );
+
+            [ NSThread detachNewThreadSelector: @selector( runWorkerFor: )
+                                      toTarget: self
+                                    withObject: stage ];
+        }
+    }
+
+    /* Feeding the first stage blocks while its buffer is full, so folders go
+     * in no faster than they can be scanned.
+     */
+
+    IconPipelineStage * first = stages[ 0 ];
+
+    for ( ConcurrentPathProcessor * processor in processors )
+    {
+        if ( self.isCancelled ) break;
+
+        [ first put: processor ];
+    }
+
+    [ first close ];
+
+    dispatch_group_wait( workers, DISPATCH_TIME_FOREVER );
+
+    [ walks waitUntilAllOperationsAreFinished ];
+
+    if ( sampler != NULL )
+    {
+        dispatch_source_cancel( sampler );
+        sampler = NULL;
+    }
+
+    endTime = CFAbsoluteTimeGetCurrent();
+}
+
+/******************************************************************************\
+ * -cancel
+ *
+ * Stop feeding folders into the pipeline; those already in it leave at their
+ * next stage without further work.
+\******************************************************************************/
+
+- ( void ) cancel
+{
+    self.isCancelled = YES;
+
+    [ walks cancelAllOperations ];
+}
+
+/******************************************************************************\
+ * -runWorkerFor:
+ *
+ * Worker thread body for the scan or write stage. Run the stage for folders
+ * from its buffer until it is closed and empty. Scanned folders are handed on
+ * to be drawn, and written or otherwise finished folders leave the pipeline.
+ * The last scan worker to exit closes the write stage, once every folder it
+ * handed on has been drawn.
+ *
+ * In:  ( IconPipelineStage * ) stage
+ *      Stage to run.
+\******************************************************************************/
+
+- ( void ) runWorkerFor: ( IconPipelineStage * ) stage
+{
+    @autoreleasepool
+    {
+        ConcurrentPathProcessor * processor;
+
+        [ [ NSThread currentThread ] setName: [ NSString stringWithFormat: @"%@ %s", @PROGRAM_STRING, stageNames[ stage.stage ] ] ];
+
+        while ( ( processor = [ stage take ] ) != nil )
+        {
+            /* A folder taken for writing no longer counts towards those being
+             * drawn, so let another be scanned into its place.
+             */
+
+            if ( stage.stage == concurrentPathProcessorStageWrite ) [ self drawingLeft ];
+
+            if ( self.isCancelled ) [ processor cancel ];
+
+            CFAbsoluteTime started = CFAbsoluteTimeGetCurrent();
+            BOOL           more    = [ processor performStage: stage.stage ];
+
+            [ stage didRunFor: CFAbsoluteTimeGetCurrent() - started ];
+
+            if ( more && stage.next != nil ) [ self draw:  processor ];
+            else                             [ self leave: processor ];
+        }
+
+        if ( [ stage workerExiting ] && stage.next != nil )
+        {
+            dispatch_group_wait( drawings, DISPATCH_TIME_FOREVER );
+            [ stage.next close ];
+        }
+    }
+
+    dispatch_group_leave( workers );
+}
+
+/******************************************************************************\
+ * -draw:
+ *
+ * Called on a scan worker. Wait, in turn with other scan workers, until fewer
+ * than the limit of folders are being drawn or waiting to be written, then
+ * submit a task to decode, composite and encode the given folder. If the task
+ * scheduler can't take it, the folder is drawn on the calling thread instead.
+ *
+ * In:  ( ConcurrentPathProcessor * ) processor
+ *      Processor for the folder, having been scanned.
+\******************************************************************************/
+
+- ( void ) draw: ( ConcurrentPathProcessor * ) processor
+{
+    IconPipelineStage * scan    = stages[ concurrentPathProcessorStageScan   ];
+    IconPipelineStage * decode  = stages[ concurrentPathProcessorStageDecode ];
+    CFAbsoluteTime      started = CFAbsoluteTimeGetCurrent();
+
+    pthread_mutex_lock( &drawLock );
+
+    uint64_t ticket = drawTickets ++;
+
+    while ( ticket != drawServing || drawing >= drawLimit ) pthread_cond_wait( &drawRoom, &drawLock );
+
+    drawServing ++;
+    drawing     ++;
+
+    pthread_cond_broadcast( &drawRoom );
+    pthread_mutex_unlock  ( &drawLock );
+
+    [ scan didBlockFor: CFAbsoluteTimeGetCurrent() - started ];
+    [ decode taskQueued ];
+
+    dispatch_group_enter( drawings );
+
+    int result = taskSchedulerSubmitBlock
+    (
+        processor.lane,
+        ^{
+            [ decode taskDequeued ];
+            [ self runDrawingFor: processor ];
+            dispatch_group_leave( self->drawings );
+        },
+        ^{
+            /* Cancelled before it started, e.g. by the "Stop" button */
+
+            [ decode taskDequeued ];
+            [ processor cancel ];
+            [ self leave: processor ];
+            [ self drawingLeft ];
+            dispatch_group_leave( self->drawings );
+        }
+    );
+
+    if ( result != 0 )
+    {
+        [ decode taskDequeued ];
+        [ self runDrawingFor: processor ];
+        dispatch_group_leave( drawings );
+    }
+}
+
+/******************************************************************************\
+ * -runDrawingFor:
+ *
+ * Decode, composite and encode the given folder's icon, then hand the folder
+ * on to the write stage or, if there is no more to do for it, finish it.
+ *
+ * In:  ( ConcurrentPathProcessor * ) processor
+ *      Processor for the folder, having been scanned.
+\******************************************************************************/
+
+- ( void ) runDrawingFor: ( ConcurrentPathProcessor * ) processor
+{
+    @autoreleasepool
+    {
+        BOOL more = YES;
+
+        for ( ConcurrentPathProcessorStage stage = concurrentPathProcessorStageDecode;
+              more && stage <= concurrentPathProcessorStageEncode;
+              stage ++ )
+        {
+            IconPipelineStage * running = stages[ stage ];
+
+            if ( self.isCancelled ) [ processor cancel ];
+
+            [ running willRun ];
+
+            CFAbsoluteTime started = CFAbsoluteTimeGetCurrent();
+
+            more = [ processor performStage: stage ];
+
+            [ running didRunFor: CFAbsoluteTimeGetCurrent() - started ];
+        }
+
+        if ( more )
+        {
+            [ stages[ concurrentPathProcessorStageWrite ] put: processor ];
+        }
+        else
+        {
+            [ self leave: processor ];
+            [ self drawingLeft ];
+        }
+    }
+}
+
+/******************************************************************************\
+ * -drawingLeft
+ *
+ * Note that a folder is no longer being drawn or waiting to be written, so
+ * that another may be drawn.
+\******************************************************************************/
+
+- ( void ) drawingLeft
+{
+    pthread_mutex_lock    ( &drawLock );
+    drawing --;
+    pthread_cond_broadcast( &drawRoom );
+    pthread_mutex_unlock  ( &drawLock );
+}
+
+/******************************************************************************\
+ * -leave:
+ *
+ * Finish a folder with no more to be done for it, so that it leaves the
+ * pipeline.
+ *
+ * In:  ( ConcurrentPathProcessor * ) processor
+ *      Processor for the folder.
+\******************************************************************************/
+
+- ( void ) leave: ( ConcurrentPathProcessor * ) processor
+{
+    [ processor finish ];
+
+    if ( self.folderCompleted ) self.folderCompleted( processor );
+}
+
+/******************************************************************************\
+ * -sample
+ *
+ * Timer handler. Measure how many folders have been scanned since the last
+ * sample and how long each took in the I/O stages, give that to the
+ * concurrency controller along with how many are being or waiting to be
+ * scanned, and apply its choice to those stages.
+\******************************************************************************/
+
+- ( void ) sample
+{
+    CFAbsoluteTime              now       = CFAbsoluteTimeGetCurrent();
+    IconPipelineStageStatistics scan      = [ stages[ concurrentPathProcessorStageScan  ] statistics ];
+    IconPipelineStageStatistics write     = [ stages[ concurrentPathProcessorStageWrite ] statistics ];
+    uint64_t                    scanned   = scan.completed  - lastScan.completed;
+    uint64_t                    written   = write.completed - lastWrite.completed;
+    NSTimeInterval              scanBusy  = scan.busyTime  - lastScan.busyTime;
+    NSTimeInterval              writeBusy = write.busyTime - lastWrite.busyTime;
+    double                      latency   = scanned + written ? ( scanBusy + writeBusy ) / ( scanned + written ) : 0;
+    double                      elapsed   = now - sampleTime;
+    unsigned int                before    = controller.current;
+    unsigned int                after     = concurrencyControllerSample( &controller, scanned, elapsed, latency,
+                                                                             scan.queued + scan.busy );
+
+    sampleTime = now;
+    lastScan   = scan;
+    lastWrite  = write;
+
+    if ( after == before ) return;
+
+    _ioWorkers = after;
+
+    [ stages[ concurrentPathProcessorStageScan  ] setLimit: after ];
+    [ stages[ concurrentPathProcessorStageWrite ] setLimit: after ];
+
+    NSLog
+    (
+        @"%@: Pipeline I/O workers %u -> %u (%.1f folders/s; scan %.0fms, write %.0fms per folder)",
+        @PROGRAM_STRING,
+        before,
+        after,
+        elapsed > 0 ? scanned / elapsed : 0,
+        scanned ? 1000 * scanBusy  / scanned : 0,
+        written ? 1000 * writeBusy / written : 0
+    );
+
+    if ( self.concurrencyChanged ) self.concurrencyChanged( after );
+}
+
+/******************************************************************************\
+ * -statisticsForStage:
+ *
+ * In:  ( ConcurrentPathProcessorStage ) stage
+ *      Stage of interest.
+ *
+ * Out: A snapshot of that stage's counters. Occupancy of the buffer and of
+ *      the workers can be found from "queued" over "capacity" and "busy" over
+ *      "workers" respectively.
+\******************************************************************************/
+
+- ( IconPipelineStageStatistics ) statisticsForStage: ( ConcurrentPathProcessorStage ) stage
+{
+    IconPipelineStageStatistics snapshot = [ stages[ stage ] statistics ];
+    CFAbsoluteTime              now      = endTime > 0 ? endTime : CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime              elapsed  = startTime > 0 ? now - startTime : 0;
+
+    snapshot.throughput = elapsed > 0 ? snapshot.completed / elapsed : 0;
+
+    return snapshot;
+}
+
+/******************************************************************************\
+ * -logStatistics
+ *
+ * Log a line for each volume that folders have been scanned on if scans have
+ * been adapting to their volumes. If the hidden "logRunStatistics" preference
+ * is set, first log a line of timings for each stage.
+\******************************************************************************/
+
+- ( void ) logStatistics
+{
+    for ( ConcurrentPathProcessorStage stage = 0; logging && stage < concurrentPathProcessorStageCount; stage ++ )
+    {
+        IconPipelineStageStatistics statistics = [ self statisticsForStage: stage ];
+
+        if ( statistics.workers == 0 )
+        {
+            NSLog
+            (
+                @"%@: Pipeline %s: task scheduler, %llu folders (%.1f/s), busy %.2fs, peak queue %lu",
+                @PROGRAM_STRING,
+                stageNames[ stage ],
+                ( unsigned long long ) statistics.completed,
+                statistics.throughput,
+                statistics.busyTime,
+                ( unsigned long      ) statistics.peakQueued
+            );
+
+            continue;
+        }
+
+        NSLog
+        (
+            @"%@: Pipeline %s: %lu/%lu workers, %llu folders (%.1f/s), busy %.2fs, blocked %.2fs, peak queue %lu/%lu",
+            @PROGRAM_STRING,
+            stageNames[ stage ],
+            ( unsigned long      ) statistics.limit,
+            ( unsigned long      ) statistics.workers,
+            ( unsigned long long ) statistics.completed,
+            statistics.throughput,
+            statistics.busyTime,
+            statistics.blockedTime,
+            ( unsigned long      ) statistics.peakQueued,
+            ( unsigned long      ) statistics.capacity
+        );
+    }
+
+    VolumeProfile volumes[ VOLUME_PROFILE_TABLE_SIZE ];
+    size_t        count = volumeProfileCopyAll( volumes, VOLUME_PROFILE_TABLE_SIZE );
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        VolumeProfile * volume = &volumes[ index ];
+
+        NSLog
+        (
+            @"%@: Volume %llu (%s, %s, %s latency, probe %.1fms): %llu scans, %llu directories, %llu entries, %.2fs",
+            @PROGRAM_STRING,
+            ( unsigned long long ) volume->device,
+            volume->fileSystem,
+            volumeKindName( volume->kind ),
+            volumeLatencyName( volume->latency ),
+            volume->probeMicroseconds / 1000.0,
+            ( unsigned long long ) volume->scans,
+            ( unsigned long long ) volume->directoriesRead,
+            ( unsigned long long ) volume->entriesSeen,
+            volume->scanMicroseconds / 1000000.0
+        );
+    }
+}
+
+@end /* @implementation IconPipeline */
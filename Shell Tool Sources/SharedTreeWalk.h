@@ -0,0 +1,28 @@
+/******************************************************************************\
+ * addfoldericons: SharedTreeWalk.h
+ *
+ * Derive a class from NSOperation which walks a folder tree once on behalf of
+ * several queued ConcurrentPathProcessor instances for folders nested within
+ * that tree, such as a parent folder queued along with its subfolders. Each
+ * folder's images are chosen just as they would have been had the folder been
+ * scanned on its own, but each directory in the tree is read only once rather
+ * than once for every queued folder above it.
+ *
+ * Use +planWalksForProcessors: before queueing the processors; each processor
+ * served by a walk is made dependent upon it, so the walk operations can just
+ * be added to the same queue.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#import <Cocoa/Cocoa.h>
+
+@interface SharedTreeWalk : NSOperation
+
++ ( NSArray  * ) planWalksForProcessors: ( NSArray  * ) processors;
+
+- ( NSArray  * ) imagesFor: ( NSString * ) posixPath;
+
+@property ( readonly ) NSUInteger directoriesRead;
+
+@end /* @interface SharedTreeWalk : NSOperation */
@@ -0,0 +1,714 @@
+/******************************************************************************\
+ * addfoldericons: SharedTreeWalk.m
+ *
+ * Derive a class from NSOperation which walks a folder tree once on behalf of
+ * several queued ConcurrentPathProcessor instances for folders nested within
+ * that tree, such as a parent folder queued along with its subfolders. Each
+ * folder's images are chosen just as they would have been had the folder been
+ * scanned on its own, but each directory in the tree is read only once rather
+ * than once for every queued folder above it.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#import "SharedTreeWalk.h"
+
+#import "GlobalConstants.h"
+#import "ConcurrentPathProcessor.h"
+#import "CustomIconGenerator.h"
+#import "FolderScanner.h"
+#import "ImageTypeClassifier.h"
+#import "ReservoirSampler.h"
+#import "Miscellaneous.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A queued folder served by a walk, with the sampler choosing its images */
+
+typedef struct WalkMember
+{
+    char             * path;   /* No trailing '/' */
+    size_t             length;
+    ReservoirSampler   sampler;
+
+} WalkMember;
+
+/* Scanner callback context. Members are sorted by comparePaths(), so the walk
+ * root - an ancestor of all the others - comes first. The owner cache is only
+ * touched by walkFoundFile(), calls to which are serialised by the scanner.
+ * Boundaries are packages which the walk enters only because queued folders
+ * lie at or within them; they are added by walkDescendInto() on any thread,
+ * so are guarded by the lock.
+ */
+
+typedef struct WalkContext
+{
+    void            * operation;     /* The SharedTreeWalk, not retained        */
+    WalkMember      * members;
+    size_t            memberCount;
+
+    char            * lastDirectory; /* Directory whose owners are cached below */
+    size_t            lastLength;
+    size_t            lastSize;
+    size_t          * owners;        /* Indices into 'members'                  */
+    size_t            ownerCount;
+
+    pthread_mutex_t   lock;
+    char           ** boundaries;    /* malloc()'d paths, no trailing '/'       */
+    size_t            boundaryCount;
+    size_t            boundarySize;
+
+} WalkContext;
+
+/******************************************************************************\
+ * comparePaths()
+ *
+ * Compare two paths of the given lengths (which need not be NUL terminated)
+ * as strcmp() would, except that '/' sorts before any other character. This
+ * keeps every path's descendants immediately after it in a sorted list - a
+ * plain strcmp() would put e.g. "/a b" between "/a" and "/a/b".
+ *
+ * Out: Negative, zero or positive as for strcmp().
+\******************************************************************************/
+
+static int comparePaths( const char * a, size_t aLength, const char * b, size_t bLength )
+{
+    size_t index;
+
+    for ( index = 0; index < aLength && index < bLength; index ++ )
+    {
+        unsigned char ca = ( unsigned char ) a[ index ];
+        unsigned char cb = ( unsigned char ) b[ index ];
+
+        if ( ca == cb  ) continue;
+        if ( ca == '/' ) return -1;
+        if ( cb == '/' ) return  1;
+
+        return ca < cb ? -1 : 1;
+    }
+
+    return ( aLength > index ) - ( bLength > index );
+}
+
+/******************************************************************************\
+ * isNestedWithin()
+ *
+ * Out: true if the path of the given length lies strictly inside the folder
+ *      with the given path and length, else false.
+\******************************************************************************/
+
+static bool isNestedWithin( const char * path, size_t length, const char * folder, size_t folderLength )
+{
+    return length > folderLength          &&
+           path[ folderLength ] == '/'    &&
+           memcmp( path, folder, folderLength ) == 0;
+}
+
+/******************************************************************************\
+ * copyTrimmedPath()
+ *
+ * Return a malloc()'d copy of a POSIX path's file system representation with
+ * any trailing '/' characters removed, so that paths compare reliably. The
+ * length of the copy is written to '*length'. Returns NULL if out of memory.
+\******************************************************************************/
+
+static char * copyTrimmedPath( NSString * posixPath, size_t * length )
+{
+    const char * path = [ posixPath fileSystemRepresentation ];
+    size_t       used = strlen( path );
+
+    while ( used > 1 && path[ used - 1 ] == '/' ) used --;
+
+    char * copy = malloc( used + 1 );
+
+    if ( copy != NULL )
+    {
+        memcpy( copy, path, used );
+        copy[ used ] = '\0';
+        *length      = used;
+    }
+
+    return copy;
+}
+
+/******************************************************************************\
+ * findMember()
+ *
+ * Binary search for a member with the given path and length (which need not
+ * be NUL terminated).
+ *
+ * Out: Index of the member, or -1 if there is none.
+\******************************************************************************/
+
+static long findMember( const WalkContext * context, const char * path, size_t length )
+{
+    size_t low  = 0;
+    size_t high = context->memberCount;
+
+    while ( low < high )
+    {
+        size_t       middle = low + ( high - low ) / 2;
+        WalkMember * member = &context->members[ middle ];
+        int          result = comparePaths( path, length, member->path, member->length );
+
+        if      ( result == 0 ) return ( long ) middle;
+        else if ( result <  0 ) high = middle;
+        else                    low  = middle + 1;
+    }
+
+    return -1;
+}
+
+/******************************************************************************\
+ * hasMemberWithin()
+ *
+ * Out: true if some member lies strictly inside the folder with the given
+ *      path and length (which need not be NUL terminated), else false.
+\******************************************************************************/
+
+static bool hasMemberWithin( const WalkContext * context, const char * path, size_t length )
+{
+    size_t low  = 0;
+    size_t high = context->memberCount;
+
+    /* Find the first member sorting after the folder; since descendants sort
+     * immediately after their ancestors, it is inside the folder if any is.
+     */
+
+    while ( low < high )
+    {
+        size_t       middle = low + ( high - low ) / 2;
+        WalkMember * member = &context->members[ middle ];
+
+        if ( comparePaths( member->path, member->length, path, length ) <= 0 ) low  = middle + 1;
+        else                                                                   high = middle;
+    }
+
+    return low < context->memberCount &&
+           isNestedWithin( context->members[ low ].path, context->members[ low ].length, path, length );
+}
+
+/******************************************************************************\
+ * addBoundary(), isBoundary()
+ *
+ * Record, or check for, a package which the walk enters only for the sake of
+ * queued folders at or within it. Paths need not be NUL terminated. Adding
+ * fails silently if out of memory, which at worst lets a folder outside the
+ * package sample images from inside it.
+\******************************************************************************/
+
+static void addBoundary( WalkContext * context, const char * path, size_t length )
+{
+    char * copy = malloc( length + 1 );
+
+    if ( copy == NULL ) return;
+
+    memcpy( copy, path, length );
+    copy[ length ] = '\0';
+
+    pthread_mutex_lock( &context->lock );
+
+    if ( context->boundaryCount == context->boundarySize )
+    {
+        size_t   newSize = context->boundarySize ? context->boundarySize * 2 : 8;
+        char  ** grown   = realloc( context->boundaries, newSize * sizeof( char * ) );
+
+        if ( grown == NULL )
+        {
+            pthread_mutex_unlock( &context->lock );
+            free( copy );
+            return;
+        }
+
+        context->boundaries   = grown;
+        context->boundarySize = newSize;
+    }
+
+    context->boundaries[ context->boundaryCount ++ ] = copy;
+
+    pthread_mutex_unlock( &context->lock );
+}
+
+static bool isBoundary( WalkContext * context, const char * path, size_t length )
+{
+    bool found = false;
+
+    pthread_mutex_lock( &context->lock );
+
+    for ( size_t index = 0; index < context->boundaryCount && ! found; index ++ )
+    {
+        const char * boundary = context->boundaries[ index ];
+
+        found = strncmp( boundary, path, length ) == 0 && boundary[ length ] == '\0';
+    }
+
+    pthread_mutex_unlock( &context->lock );
+
+    return found;
+}
+
+/******************************************************************************\
+ * isPackageDirectory()
+ *
+ * Should the directory at the given full POSIX path be skipped by a folder's
+ * own scan, as CustomIconGenerator's scans skip it? May be called on any
+ * thread.
+\******************************************************************************/
+
+static bool isPackageDirectory( const char * fullPath, const char * leafname )
+{
+    if ( ! SKIP_PACKAGES ) return false;
+
+    switch ( imageTypeClassifyPackage( fullPath, leafname ) )
+    {
+        case imageTypeClassYes: return true;
+        case imageTypeClassNo:  return false;
+        default:                break;
+    }
+
+    @autoreleasepool
+    {
+        return isLikeAPackage( @( fullPath ) );
+    }
+}
+
+/******************************************************************************\
+ * walkAcceptFile()
+ *
+ * FolderScanner callback - is the file at the given full POSIX path an image?
+ * This must match the test used by CustomIconGenerator's own scans, since any
+ * persistent scan index is shared with them. May be called on any thread.
+\******************************************************************************/
+
+static bool walkAcceptFile( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+
+    return imageTypeClassifierIsImageFile( fullPath, leafname, SNIFF_EXTENSIONLESS_IMAGES );
+}
+
+/******************************************************************************\
+ * walkDescendInto()
+ *
+ * FolderScanner callback - should the directory at the given full POSIX path
+ * be scanned? Directories are treated as CustomIconGenerator treats them,
+ * except that a package which is, or holds, a queued folder is still entered,
+ * since a folder's own scan never skips the folder itself. Such a package is
+ * recorded as a boundary, so that its images are only offered to the queued
+ * folders at or within it, just as the folders outside it would have skipped
+ * it in their own scans. May be called on any thread.
+\******************************************************************************/
+
+static bool walkDescendInto( void * context, const char * fullPath, const char * leafname )
+{
+    WalkContext * walk   = context;
+    size_t        length = strlen( fullPath );
+
+    if ( isPackageDirectory( fullPath, leafname ) == false ) return true;
+
+    if ( findMember( walk, fullPath, length ) < 0 && ! hasMemberWithin( walk, fullPath, length ) ) return false;
+
+    addBoundary( walk, fullPath, length );
+    return true;
+}
+
+/******************************************************************************\
+ * walkFoundFile()
+ *
+ * FolderScanner callback - offer the found image's full POSIX path to the
+ * sampler of every queued folder which contains it. Files arrive a directory
+ * at a time, so the list of those folders is cached for the last directory
+ * seen. Calls are serialised by the scanner.
+ *
+ * Out: false to stop the walk if the operation has been cancelled.
+\******************************************************************************/
+
+static bool walkFoundFile( void * context, const char * fullPath, uint64_t size )
+{
+    WalkContext * walk = context;
+    const char  * leaf = strrchr( fullPath, '/' );
+    size_t        used = leaf ? ( size_t ) ( leaf - fullPath ) : 0;
+
+    ( void ) size;
+
+    if ( [ ( __bridge SharedTreeWalk * ) walk->operation isCancelled ] ) return false;
+
+    if ( walk->lastDirectory == NULL                      ||
+         walk->lastLength    != used                      ||
+         memcmp( walk->lastDirectory, fullPath, used ) != 0 )
+    {
+        if ( used + 1 > walk->lastSize )
+        {
+            char * grown = realloc( walk->lastDirectory, used + 1 );
+            if ( grown == NULL ) return false;
+
+            walk->lastDirectory = grown;
+            walk->lastSize      = used + 1;
+        }
+
+        memcpy( walk->lastDirectory, fullPath, used );
+        walk->lastDirectory[ used ] = '\0';
+        walk->lastLength            = used;
+        walk->ownerCount            = 0;
+
+        /* Try each ancestor of the file from the walk root downwards; a
+         * package boundary hides the file from queued folders above it.
+         */
+
+        for ( size_t index = walk->members[ 0 ].length; index <= used; index ++ )
+        {
+            if ( index == used || fullPath[ index ] == '/' )
+            {
+                if ( isBoundary( walk, fullPath, index ) ) walk->ownerCount = 0;
+
+                long found = findMember( walk, fullPath, index );
+                if ( found >= 0 ) walk->owners[ walk->ownerCount ++ ] = ( size_t ) found;
+            }
+        }
+    }
+
+    for ( size_t index = 0; index < walk->ownerCount; index ++ )
+    {
+        ( void ) reservoirSamplerOffer( &walk->members[ walk->owners[ index ] ].sampler, fullPath );
+    }
+
+    return true;
+}
+
+@interface SharedTreeWalk()
+{
+    WalkMember * members;
+    size_t       memberCount;
+}
+
+- ( instancetype ) initWithMembers: ( WalkMember * ) theMembers
+                             count: ( size_t       ) theCount;
+
+@property ( copy ) NSDictionary * results;
+
+@end
+
+@implementation SharedTreeWalk
+
+/******************************************************************************\
+ * +planWalksForProcessors:
+ *
+ * Find queued folders nested within other queued folders and create a walk
+ * for each outermost folder with queued folders inside it. Each processor so
+ * grouped has its "treeWalk" property set and is made dependent upon the walk,
+ * so must not yet have been added to a queue. Processors using icon styles
+ * which only look for cover art in the folder itself do no tree scan and are
+ * left alone, as is any folder queued more than once after the first.
+ *
+ * In:  ( NSArray * ) processors
+ *      Array of ConcurrentPathProcessor instances about to be queued.
+ *
+ * Out: Array of SharedTreeWalk instances, possibly empty, to add to the same
+ *      queue as the processors (the order in which they are added does not
+ *      matter).
+\******************************************************************************/
+
++ ( NSArray * ) planWalksForProcessors: ( NSArray * ) processors
+{
+    typedef struct Candidate
+    {
+        char                                     * path;
+        size_t                                     length;
+        __unsafe_unretained ConcurrentPathProcessor * processor;
+
+    } Candidate;
+
+    NSMutableArray * walks      = [ NSMutableArray arrayWithCapacity: 0 ];
+    Candidate      * candidates = calloc( [ processors count ] + 1, sizeof( Candidate ) );
+    size_t           count      = 0;
+
+    if ( candidates == NULL ) return walks;
+
+    for ( ConcurrentPathProcessor * processor in processors )
+    {
+        if ( processor.iconGenerator.onlyUsesCoverArt == YES || processor.treeWalk != nil ) continue;
+
+        Candidate * candidate = &candidates[ count ];
+
+        candidate->path      = copyTrimmedPath( processor.pathData, &candidate->length );
+        candidate->processor = processor;
+
+        if ( candidate->path != NULL && candidate->length > 1 ) count ++;
+        else free( candidate->path );
+    }
+
+    qsort_b
+    (
+        candidates,
+        count,
+        sizeof( Candidate ),
+        ^ int ( const void * a, const void * b )
+        {
+            const Candidate * ca = a;
+            const Candidate * cb = b;
+
+            return comparePaths( ca->path, ca->length, cb->path, cb->length );
+        }
+    );
+
+    /* Since descendants sort immediately after their ancestors, each group is
+     * a run of candidates nested within the first one of that run.
+     */
+
+    for ( size_t first = 0; first < count; )
+    {
+        size_t next = first + 1;
+
+        while ( next < count && isNestedWithin( candidates[ next ].path,  candidates[ next  ].length,
+                                                candidates[ first ].path, candidates[ first ].length ) )
+        {
+            next ++;
+        }
+
+        /* Count group members other than duplicates, which scan for themselves */
+
+        size_t unique = 1;
+
+        for ( size_t index = first + 1; index < next; index ++ )
+        {
+            if ( comparePaths( candidates[ index     ].path, candidates[ index     ].length,
+                               candidates[ index - 1 ].path, candidates[ index - 1 ].length ) != 0 )
+            {
+                unique ++;
+            }
+        }
+
+        WalkMember * groupMembers = unique > 1 ? calloc( unique, sizeof( WalkMember ) ) : NULL;
+
+        if ( groupMembers != NULL )
+        {
+            NSMutableArray * grouped = [ NSMutableArray arrayWithCapacity: unique ];
+            size_t           used    = 0;
+
+            for ( size_t index = first; index < next; index ++ )
+            {
+                Candidate * candidate = &candidates[ index ];
+
+                if ( index > first && comparePaths( candidate->path, candidate->length,
+                                                    candidates[ index - 1 ].path,
+                                                    candidates[ index - 1 ].length ) == 0 )
+                {
+                    continue;
+                }
+
+                CustomIconGenerator * generator = candidate->processor.iconGenerator;
+                WalkMember          * member    = &groupMembers[ used ++ ];
+
+                member->path      = candidate->path;
+                member->length    = candidate->length;
+                candidate->path   = NULL; /* Now owned by the member */
+
+                reservoirSamplerInit
+                (
+                    &member->sampler,
+                    generator.maximumImages,
+                    generator.imageSelectionSeed,
+                    generator.nonRandomImageSelectionForAPreview
+                );
+
+                [ grouped addObject: candidate->processor ];
+            }
+
+            SharedTreeWalk * walk = [ [ SharedTreeWalk alloc ] initWithMembers: groupMembers
+                                                                         count: used ];
+
+            for ( ConcurrentPathProcessor * processor in grouped )
+            {
+                processor.treeWalk = walk;
+                [ processor addDependency: walk ];
+            }
+
+            [ walks addObject: walk ];
+        }
+
+        first = next;
+    }
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        free( candidates[ index ].path );
+    }
+
+    free( candidates );
+
+    return walks;
+}
+
+/******************************************************************************\
+ * -initWithMembers:count:
+ *
+ * Initialise a walk. Ownership of the members array, its paths and samplers
+ * passes to the walk.
+ *
+ * In:  ( WalkMember * ) theMembers
+ *      malloc()'d array of members with initialised samplers, sorted with
+ *      comparePaths() so that the walk root comes first;
+ *
+ *      ( size_t ) theCount
+ *      Number of members.
+\******************************************************************************/
+
+- ( instancetype ) initWithMembers: ( WalkMember * ) theMembers
+                             count: ( size_t       ) theCount
+{
+    if ( ( self = [ super init ] ) )
+    {
+        members     = theMembers;
+        memberCount = theCount;
+    }
+
+    return self;
+}
+
+/******************************************************************************\
+ * -dealloc
+ *
+ * Release member paths and any samplers still holding images.
+\******************************************************************************/
+
+- ( void ) dealloc
+{
+    for ( size_t index = 0; index < memberCount; index ++ )
+    {
+        reservoirSamplerFree( &members[ index ].sampler );
+        free( members[ index ].path );
+    }
+
+    free( members );
+}
+
+/******************************************************************************\
+ * -main
+ *
+ * Walk the tree from the outermost queued folder, sampling images for every
+ * queued folder at once. The walk gets the same time budget as the outermost
+ * folder's own scan would have had. If it finishes within that budget, every
+ * queued folder is served; if not, only the outermost folder is served (with
+ * the same result its own scan would have given) and the others fall back to
+ * scanning for themselves, so a large tree costs no more than it did before.
+\******************************************************************************/
+
+- ( void ) main
+{
+    @autoreleasepool
+    {
+        if ( self.isCancelled || memberCount == 0 ) return;
+
+        WalkContext context =
+        {
+            .operation   = ( __bridge void * ) self,
+            .members     = members,
+            .memberCount = memberCount,
+            .owners      = calloc( memberCount, sizeof( size_t ) )
+        };
+
+        if ( context.owners == NULL ) return;
+
+        pthread_mutex_init( &context.lock, NULL );
+
+        FolderScannerRoot root =
+        {
+            .path        = members[ 0 ].path,
+            .timeLimitMs = MAXIMUM_LOOP_TIME_MS,
+            .foundLimit  = 0,
+            .context     = &context
+        };
+
+        BOOL adaptive = [ [ NSUserDefaults standardUserDefaults ] boolForKey: @"adaptScanToVolume" ];
+
+        FolderScannerOptions options =
+        {
+            .threadCount     = adaptive ? SCAN_THREADS_PER_ADAPTIVE_SHARED_WALK : SCAN_THREADS_PER_SHARED_WALK,
+            .maximumFileSize = MAXIMUM_IMAGE_SIZE,
+            .index           = [ CustomIconGenerator sharedScanIndex ],
+            .adaptToVolume   = adaptive
+        };
+
+        FolderScannerCallbacks callbacks =
+        {
+            .acceptFile  = walkAcceptFile,
+            .descendInto = walkDescendInto,
+            .foundFile   = walkFoundFile
+        };
+
+        size_t served = 0;
+
+        if ( folderScannerRun( &root, 1, &options, &callbacks ) == 0 )
+        {
+            if      ( root.status == folderScannerStatusComplete  ) served = memberCount;
+            else if ( root.status == folderScannerStatusTimeLimit ) served = 1;
+        }
+
+        _directoriesRead = root.directoriesRead;
+
+        NSMutableDictionary * results = [ NSMutableDictionary dictionaryWithCapacity: served ];
+
+        for ( size_t index = 0; index < served; index ++ )
+        {
+            ReservoirSampler * sampler    = &members[ index ].sampler;
+            size_t             sampleSize = reservoirSamplerFinish( sampler );
+            NSMutableArray   * images     = [ NSMutableArray arrayWithCapacity: sampleSize ];
+
+            for ( size_t item = 0; item < sampleSize; item ++ )
+            {
+                [ images addObject: @( reservoirSamplerItem( sampler, item ) ) ];
+            }
+
+            results[ @( members[ index ].path ) ] = images;
+        }
+
+        for ( size_t index = 0; index < memberCount; index ++ )
+        {
+            reservoirSamplerFree( &members[ index ].sampler );
+        }
+
+        self.results = results;
+
+        for ( size_t index = 0; index < context.boundaryCount; index ++ )
+        {
+            free( context.boundaries[ index ] );
+        }
+
+        pthread_mutex_destroy( &context.lock );
+
+        free( context.boundaries );
+        free( context.lastDirectory );
+        free( context.owners );
+    }
+}
+
+/******************************************************************************\
+ * -imagesFor:
+ *
+ * Return the images chosen for a queued folder, once the walk has finished.
+ *
+ * In:  ( NSString * ) posixPath
+ *      Full POSIX path of a folder given to +planWalksForProcessors:.
+ *
+ * Out: Array of full POSIX paths of images, in final order and possibly empty;
+ *      or nil if the walk did not serve this folder, which should then be
+ *      scanned as usual.
+\******************************************************************************/
+
+- ( NSArray * ) imagesFor: ( NSString * ) posixPath
+{
+    size_t   length  = 0;
+    char   * trimmed = copyTrimmedPath( posixPath, &length );
+
+    if ( trimmed == NULL ) return nil;
+
+    NSArray * images = self.results[ @( trimmed ) ];
+
+    free( trimmed );
+
+    return images;
+}
+
+@end /* @implementation SharedTreeWalk */
@@ -0,0 +1,69 @@
+//
+//  SpriteCache.h
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of pre-drawn drop shadow and white border "sprites" for the custom
+//  icon styles. What goes under a thumbnail depends only on the geometry of
+//  its slot and the style - never on the image itself, so long as the image
+//  is opaque or sits on a white border - so one style applied to thousands of
+//  folders needs only a handful of sprites. Each sprite is drawn once, with
+//  CoreGraphics' shadow blur, and is then simply drawn under each thumbnail.
+//
+//  Rotation angles must be quantised for sprites to be shared, and the image
+//  drawn over a sprite at the same quantised angle; see +quantisedAngle:.
+//  All methods are thread-safe.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/* Random rotation angles of thumbnails drawn with a sprite are rounded to
+ * this step in radians so that sprites can be shared; the step is too small
+ * to see.
+ */
+
+#define SPRITE_CACHE_ANGLE_STEP 0.01
+
+/* Everything which determines a sprite's pixels. Layout follows
+ * -allocCustomIconFrom:... in "CustomIconGenerator.m": the shadow caster is
+ * centred in a square 'layoutSize' units across and rotated, and that square
+ * is then scaled into the slot.
+ */
+
+typedef struct SpriteGeometry
+{
+    CGSize  slotSize;       /* Slot size in canvas pixels                    */
+    CGPoint slotPhase;      /* Fractional part of the slot's origin          */
+    CGFloat layoutSize;
+    CGSize  casterSize;     /* Border square, or image if there's no border  */
+    BOOL    border;         /* Caster drawn white, else left transparent     */
+    CGSize  shadowOffset;   /* In layout units; zero blur for no shadow      */
+    CGFloat shadowBlur;
+    BOOL    darkGreyShadow; /* Cover art mode's shadow colour, else default  */
+    CGFloat angle;          /* Radians, already quantised                    */
+
+} SpriteGeometry;
+
+typedef struct SpriteCacheStatistics
+{
+    uint64_t hits;
+    uint64_t misses;  /* Each of which drew a new sprite */
+
+} SpriteCacheStatistics;
+
+@interface SpriteCache : NSObject
+
+- ( instancetype ) initWithByteBudget: ( size_t ) byteBudget;
+
+- ( CGImageRef   )    copySpriteFor: ( SpriteGeometry ) geometry CF_RETURNS_RETAINED;
+
+- ( void         ) removeAllSprites;
+
++ ( CGFloat      )   quantisedAngle: ( CGFloat        ) angle;
+
+@property ( readonly ) SpriteCacheStatistics statistics;
+
+@end
@@ -0,0 +1,312 @@
+//
+//  SpriteCache.m
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of pre-drawn drop shadow and white border "sprites" for the custom
+//  icon styles. See the header file for details.
+//
+
+#import "SpriteCache.h"
+
+#import <pthread.h>
+
+@interface SpriteCache()
+{
+    pthread_mutex_t       lock;
+    SpriteCacheStatistics counters;
+}
+
+@property ( readonly ) NSCache * sprites; /* Key => CGImageRef, cost in bytes */
+
++ ( NSString * ) keyFor: ( SpriteGeometry ) geometry;
+
+@end
+
+static CGImageRef createSprite( SpriteGeometry geometry );
+
+@implementation SpriteCache
+
+/******************************************************************************\
+ * -initWithByteBudget:
+ *
+ * Initialise a cache.
+ *
+ * In:  ( size_t ) byteBudget
+ *      Approximate most bytes of sprites to hold; the least recently used are
+ *      discarded first, as well as whenever the system is short of memory.
+\******************************************************************************/
+
+- ( instancetype ) initWithByteBudget: ( size_t ) byteBudget
+{
+    if ( ( self = [ super init ] ) )
+    {
+        pthread_mutex_init( &lock, NULL );
+
+        _sprites                = [ [ NSCache alloc ] init ];
+        _sprites.totalCostLimit = byteBudget;
+    }
+
+    return self;
+}
+
+- ( void ) dealloc
+{
+    pthread_mutex_destroy( &lock );
+}
+
+/******************************************************************************\
+ * -copySpriteFor:
+ *
+ * Return the sprite for the given geometry, drawing it if it isn't cached.
+ * Draw it with its bottom left corner at the slot's origin rounded down to a
+ * whole pixel, at the sprite's own size in pixels.
+ *
+ * In:  ( SpriteGeometry ) geometry
+ *      Geometry of the slot, shadow and caster.
+ *
+ * Out: Sprite which the caller must release, or NULL on failure.
+\******************************************************************************/
+
+- ( CGImageRef ) copySpriteFor: ( SpriteGeometry ) geometry
+{
+    /* NSCache is thread-safe but may discard an object at any moment, so
+     * hold a strong reference to it while retaining the sprite.
+     */
+
+    NSString   * key    = [ SpriteCache keyFor: geometry ];
+    id           cached = [ self.sprites objectForKey: key ];
+    CGImageRef   sprite = ( __bridge CGImageRef ) cached;
+
+    if ( sprite ) CGImageRetain( sprite );
+
+    pthread_mutex_lock( &lock );
+
+    if ( sprite ) counters.hits   ++;
+    else          counters.misses ++;
+
+    pthread_mutex_unlock( &lock );
+
+    if ( sprite ) return sprite;
+
+    /* Two threads may both miss and draw the same sprite; the second simply
+     * replaces the first, which is cheaper than making one wait for the
+     * other.
+     */
+
+    sprite = createSprite( geometry );
+
+    if ( sprite )
+    {
+        [
+            self.sprites setObject: ( __bridge id ) sprite
+                            forKey: key
+                              cost: CGImageGetBytesPerRow( sprite ) * CGImageGetHeight( sprite )
+        ];
+    }
+
+    return sprite;
+}
+
+/******************************************************************************\
+ * -removeAllSprites
+ *
+ * Empty the cache.
+\******************************************************************************/
+
+- ( void ) removeAllSprites
+{
+    [ self.sprites removeAllObjects ];
+}
+
+/******************************************************************************\
+ * -statistics
+ *
+ * Out: A snapshot of the cache's counters.
+\******************************************************************************/
+
+- ( SpriteCacheStatistics ) statistics
+{
+    SpriteCacheStatistics snapshot;
+
+    pthread_mutex_lock( &lock );
+    snapshot = counters;
+    pthread_mutex_unlock( &lock );
+
+    return snapshot;
+}
+
+/******************************************************************************\
+ * +quantisedAngle:
+ *
+ * Round a rotation angle to the nearest SPRITE_CACHE_ANGLE_STEP, so that any
+ * two angles within half a step of the same multiple share a sprite.
+ *
+ * In:  ( CGFloat ) angle
+ *      Angle in radians.
+ *
+ * Out: Quantised angle in radians, at which both the sprite and the image
+ *      over it must be drawn.
+\******************************************************************************/
+
++ ( CGFloat ) quantisedAngle: ( CGFloat ) angle
+{
+    CGFloat quantised = round( angle / SPRITE_CACHE_ANGLE_STEP ) * SPRITE_CACHE_ANGLE_STEP;
+
+    /* Small negative angles round to -0, which would otherwise get a key,
+     * and so a sprite, of its own.
+     */
+
+    return quantised == 0 ? 0 : quantised;
+}
+
+/******************************************************************************\
+ * +keyFor:
+ *
+ * Build a cache key from a sprite's geometry. Values are rounded well below
+ * anything visible, so that floating point noise doesn't defeat the cache.
+\******************************************************************************/
+
++ ( NSString * ) keyFor: ( SpriteGeometry ) geometry
+{
+    return [
+        NSString stringWithFormat: @"%.2fx%.2f+%.2f,%.2f:%.2f:%.2fx%.2f:%d:%.2f,%.2f,%.2f:%d:%.4f",
+                                   geometry.slotSize.width,
+                                   geometry.slotSize.height,
+                                   geometry.slotPhase.x,
+                                   geometry.slotPhase.y,
+                                   geometry.layoutSize,
+                                   geometry.casterSize.width,
+                                   geometry.casterSize.height,
+                                   geometry.border ? 1 : 0,
+                                   geometry.shadowOffset.width,
+                                   geometry.shadowOffset.height,
+                                   geometry.shadowBlur,
+                                   geometry.darkGreyShadow ? 1 : 0,
+                                   geometry.angle
+    ];
+}
+
+@end
+
+/******************************************************************************\
+ * createSprite()
+ *
+ * Draw a sprite: the caster's drop shadow and, if it has a border, the white
+ * border square over it. Without a border the caster is cut back out of the
+ * shadow, leaving a hole for the (opaque) thumbnail to be drawn into.
+ *
+ * In:  Geometry of the slot, shadow and caster.
+ *
+ * Out: Sprite which the caller must release, or NULL on failure.
+\******************************************************************************/
+
+static CGImageRef createSprite( SpriteGeometry geometry )
+{
+    size_t width  = MAX( 1, ( size_t ) ceil( geometry.slotPhase.x + geometry.slotSize.width  ) );
+    size_t height = MAX( 1, ( size_t ) ceil( geometry.slotPhase.y + geometry.slotSize.height ) );
+
+    CGContextRef    context    = NULL;
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef      sprite     = NULL;
+
+    if ( colorSpace )
+    {
+        context = CGBitmapContextCreate
+        (
+            NULL,
+            width,
+            height,
+            8,          /* Bits per component */
+            width * 4,  /* Bytes per row      */
+            colorSpace,
+            kCGImageAlphaPremultipliedFirst
+        );
+
+        CGColorSpaceRelease( colorSpace );
+    }
+
+    if ( context == NULL ) return NULL;
+
+    CGFloat layoutSize = geometry.layoutSize;
+    CGFloat scaleX     = geometry.slotSize.width  / layoutSize;
+    CGFloat scaleY     = geometry.slotSize.height / layoutSize;
+    CGRect  caster     = CGRectMake
+    (
+        -geometry.casterSize.width  / 2,
+        -geometry.casterSize.height / 2,
+         geometry.casterSize.width,
+         geometry.casterSize.height
+    );
+
+    CGContextSetShouldAntialias( context, true );
+    CGContextClearRect         ( context, CGRectMake( 0, 0, width, height ) );
+
+    CGContextTranslateCTM( context, geometry.slotPhase.x, geometry.slotPhase.y );
+    CGContextScaleCTM    ( context, scaleX, scaleY );
+    CGContextClipToRect  ( context, CGRectMake( 0, 0, layoutSize, layoutSize ) );
+    CGContextTranslateCTM( context, layoutSize / 2, layoutSize / 2 );
+    CGContextRotateCTM   ( context, geometry.angle );
+
+    /* Shadow offsets and blur are given in device space, so unlike
+     * everything else they must be scaled down to the slot here.
+     */
+
+    if ( geometry.shadowBlur > 0 )
+    {
+        CGSize  offset = CGSizeMake( geometry.shadowOffset.width * scaleX, geometry.shadowOffset.height * scaleY );
+        CGFloat blur   = geometry.shadowBlur * sqrt( scaleX * scaleY );
+
+        if ( geometry.darkGreyShadow )
+        {
+            /* See -allocCustomIconFrom:... for why this colour is used */
+
+            CGColorRef colour = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
+
+            CGContextSetShadowWithColor( context, offset, blur, colour );
+            CGColorRelease( colour );
+        }
+        else
+        {
+            CGContextSetShadow( context, offset, blur );
+        }
+    }
+
+    CGContextSetRGBFillColor( context, 1, 1, 1, 1.0 );
+    CGContextFillRect       ( context, caster );
+
+    /* Without a border, cut the caster back out so only its shadow is left.
+     * An antialiased hole would leave a ring of half-cleared white and shadow
+     * for the image's own antialiased edge to blend over, so whole pixels are
+     * cleared: when unrotated, every pixel the caster touches, found in
+     * device space; otherwise those whose centres it covers.
+     */
+
+    if ( geometry.border == NO )
+    {
+        CGContextSetShadowWithColor( context, CGSizeMake( 0, 0 ), 0, NULL );
+        CGContextSetShouldAntialias( context, false );
+        CGContextSetBlendMode      ( context, kCGBlendModeClear );
+
+        if ( geometry.angle == 0 )
+        {
+            CGRect hole = CGContextConvertRectToDeviceSpace( context, caster );
+
+            hole = CGRectIntegral( CGRectInset( hole, 0.001, 0.001 ) );
+
+            CGContextConcatCTM( context, CGAffineTransformInvert( CGContextGetCTM( context ) ) );
+            CGContextFillRect ( context, hole );
+        }
+        else
+        {
+            CGContextFillRect( context, caster );
+        }
+    }
+
+    sprite = CGBitmapContextCreateImage( context );
+    CFRelease( context );
+
+    return sprite;
+}
@@ -0,0 +1,113 @@
+/******************************************************************************\
+ * Tests: BasePlateCacheBenchmark.m
+ *
+ * Time to set up a custom icon's canvas, in microseconds per icon: making the
+ * bitmap context, filling it and drawing the standard folder icon over it, as
+ * the icon generator used to for every icon, against making the context and
+ * copying the same plate in from "BasePlateCache.h". The difference is the
+ * saving per icon. Standard (512x512) and Retina (1024x1024) canvases are
+ * timed, with and without the folder icon. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#import <AppKit/AppKit.h>
+
+#import "BasePlateCache.h"
+
+#define CANVAS_SIZE 512 /* See "GlobalConstants.h" */
+
+static CGContextRef createContext( size_t size )
+{
+    CGColorSpaceRef space   = CGColorSpaceCreateDeviceRGB();
+    CGContextRef    context = CGBitmapContextCreate( NULL, size, size, 8, size * 4, space, kCGImageAlphaPremultipliedFirst );
+
+    CGColorSpaceRelease( space );
+
+    return context;
+}
+
+/* As -standardFolderIcon in "Add_Folder_IconsAppDelegate.m" */
+
+static CGImageRef createFolderIcon( void )
+{
+    NSImage  * folder    = [ NSImage imageNamed: NSImageNameFolder ];
+    NSRect     imageRect = NSMakeRect( 0, 0, CANVAS_SIZE, CANVAS_SIZE );
+    CGImageRef image     = [ folder CGImageForProposedRect: &imageRect context: nil hints: nil ];
+
+    return image ? CGImageCreateCopy( image ) : NULL;
+}
+
+/* Out: Microseconds per canvas set up, drawing the plate each time or
+ *      copying it from a cache.
+ */
+
+static double timeCanvases( size_t size, CGImageRef folder, bool cached, unsigned int rounds )
+{
+    BasePlateCache * cache   = [ [ BasePlateCache alloc ] initWithMaximumPlates: 4 ];
+    CGRect           rect    = CGRectMake( 0, 0, size, size );
+    double           started = 0;
+
+    void ( ^ draw )( CGContextRef ) = ^ ( CGContextRef context )
+    {
+        CGContextSetRGBFillColor( context, 1.00, 1.00, 1.00, 1.0 );
+        CGContextFillRect       ( context, rect );
+
+        if ( folder ) CGContextDrawImage( context, rect, folder );
+    };
+
+    /* One untimed round, which fills the cache */
+
+    for ( unsigned int round = 0; round <= rounds; round ++ )
+    {
+        if ( round == 1 ) started = testSeconds();
+
+        @autoreleasepool
+        {
+            CGContextRef context = createContext( size );
+
+            CGContextSetInterpolationQuality( context, kCGInterpolationHigh );
+
+            if ( cached ) [ cache paintPlateForKey: @"plate" intoContext: context drawnWith: draw ];
+            else          draw( context );
+
+            CGContextFlush  ( context );
+            CGContextRelease( context );
+        }
+    }
+
+    return ( testSeconds() - started ) / rounds * 1e6;
+}
+
+int main( int argc, char ** argv )
+{
+    @autoreleasepool
+    {
+        bool         quick  = benchmarkIsQuick( argc, argv );
+        unsigned int rounds = quick ? 5 : 500;
+        CGImageRef   folder = createFolderIcon();
+
+        if ( folder == NULL ) fprintf( stderr, "No standard folder icon; timing fills only\n" );
+
+        printf( "Canvas      Plate          Drawn       Cached      Saving\n" );
+
+        for ( size_t size = CANVAS_SIZE; size <= CANVAS_SIZE * 2; size *= 2 )
+        {
+            for ( int withFolder = 0; withFolder <= ( folder ? 1 : 0 ); withFolder ++ )
+            {
+                CGImageRef image  = withFolder ? folder : NULL;
+                double     drawn  = timeCanvases( size, image, false, rounds );
+                double     cached = timeCanvases( size, image, true,  rounds );
+
+                printf( "%4zux%-4zu   %-11s %8.1fus  %8.1fus  %8.1fus\n",
+                        size, size, withFolder ? "Fill+folder" : "Fill", drawn, cached, drawn - cached );
+            }
+        }
+
+        if ( folder ) CGImageRelease( folder );
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/******************************************************************************\
+ * Tests: BasePlateCacheTests.m
+ *
+ * Tests for "BasePlateCache.h": a plate is drawn once per key and context
+ * shape and then copied, pixel for pixel, with the hit, miss, count and byte
+ * counters following along; a full cache and removeAllPlates empty it; and
+ * many threads asking for the same plate at once all get it. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#import "BasePlateCache.h"
+
+static CGContextRef createContext( size_t size )
+{
+    CGColorSpaceRef space   = CGColorSpaceCreateDeviceRGB();
+    CGContextRef    context = CGBitmapContextCreate( NULL, size, size, 8, 0, space, kCGImageAlphaPremultipliedFirst );
+
+    CGColorSpaceRelease( space );
+
+    return context;
+}
+
+static size_t contextBytes( CGContextRef context )
+{
+    return CGBitmapContextGetBytesPerRow( context ) * CGBitmapContextGetHeight( context );
+}
+
+/* Paint the plate for the given key, counting calls to the drawing block,
+ * which fills the context with the given grey.
+ */
+
+static void paint( BasePlateCache * cache, NSString * key, CGContextRef context, CGFloat grey, unsigned int * draws )
+{
+    [ cache paintPlateForKey: key
+                 intoContext: context
+                   drawnWith: ^ ( CGContextRef into )
+    {
+        ( *draws ) ++;
+
+        CGContextSetRGBFillColor( into, grey, grey, grey, 1 );
+        CGContextFillRect       ( into, CGRectMake( 0, 0, CGBitmapContextGetWidth( into ), CGBitmapContextGetHeight( into ) ) );
+    } ];
+}
+
+/* The first request for a key draws and counts a miss; later ones copy the
+ * same pixels into a scribbled-over context and count hits. The context's
+ * size is part of the key.
+ */
+
+static void testHitsAndMisses( void )
+{
+    BasePlateCache * cache   = [ [ BasePlateCache alloc ] initWithMaximumPlates: 4 ];
+    CGContextRef     context = createContext( 32 );
+    CGContextRef     small   = createContext( 16 );
+    size_t           bytes   = contextBytes( context );
+    unsigned int     draws   = 0;
+
+    paint( cache, @"grey", context, 0.5, &draws );
+
+    uint8_t * expected = malloc( bytes );
+    memcpy( expected, CGBitmapContextGetData( context ), bytes );
+
+    memset( CGBitmapContextGetData( context ), 0x5a, bytes );
+    paint( cache, @"grey", context, 0.5, &draws );
+    paint( cache, @"grey", context, 0.5, &draws );
+
+    CHECK_EQUAL( draws, 1 );
+    CHECK( memcmp( CGBitmapContextGetData( context ), expected, bytes ) == 0 );
+
+    paint( cache, @"grey", small,   0.5, &draws );
+    paint( cache, @"dark", context, 0.2, &draws );
+
+    CHECK_EQUAL( draws, 3 );
+
+    BasePlateCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.hits,      2                                 );
+    CHECK_EQUAL( statistics.misses,    3                                 );
+    CHECK_EQUAL( statistics.count,     3                                 );
+    CHECK_EQUAL( statistics.bytesUsed, bytes * 2 + contextBytes( small ) );
+
+    free( expected );
+    CGContextRelease( small   );
+    CGContextRelease( context );
+}
+
+/* Adding a plate to a full cache empties it first; so does removeAllPlates,
+ * after which the next request draws again. Hits and misses keep counting.
+ */
+
+static void testEmptying( void )
+{
+    BasePlateCache * cache   = [ [ BasePlateCache alloc ] initWithMaximumPlates: 2 ];
+    CGContextRef     context = createContext( 32 );
+    size_t           bytes   = contextBytes( context );
+    unsigned int     draws   = 0;
+
+    paint( cache, @"a", context, 0.1, &draws );
+    paint( cache, @"b", context, 0.2, &draws );
+
+    CHECK_EQUAL( cache.statistics.count,     2         );
+    CHECK_EQUAL( cache.statistics.bytesUsed, bytes * 2 );
+
+    paint( cache, @"c", context, 0.3, &draws );
+    paint( cache, @"c", context, 0.3, &draws );
+    paint( cache, @"a", context, 0.1, &draws );
+
+    CHECK_EQUAL( draws, 4 );
+
+    [ cache removeAllPlates ];
+
+    CHECK_EQUAL( cache.statistics.count,     0 );
+    CHECK_EQUAL( cache.statistics.bytesUsed, 0 );
+
+    paint( cache, @"c", context, 0.3, &draws );
+
+    BasePlateCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( draws,                5     );
+    CHECK_EQUAL( statistics.hits,      1     );
+    CHECK_EQUAL( statistics.misses,    5     );
+    CHECK_EQUAL( statistics.count,     1     );
+    CHECK_EQUAL( statistics.bytesUsed, bytes );
+
+    CGContextRelease( context );
+}
+
+/* Threads racing for a plate may each draw it while it's missing, but every
+ * request is counted once, only one copy is kept and all get its pixels.
+ */
+
+#define RACERS 64
+
+static void testConcurrent( void )
+{
+    BasePlateCache * cache = [ [ BasePlateCache alloc ] initWithMaximumPlates: 4 ];
+    __block int      wrong = 0;
+    __block size_t   bytes = 0;
+
+    dispatch_apply( RACERS, dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 ), ^ ( size_t index )
+    {
+        CGContextRef    context = createContext( 64 );
+        unsigned int    draws   = 0;
+        const uint8_t * pixels  = CGBitmapContextGetData( context );
+
+        ( void ) index;
+
+        paint( cache, @"shared", context, 1, &draws );
+
+        for ( size_t offset = 0; offset < contextBytes( context ); offset ++ )
+        {
+            if ( pixels[ offset ] != 0xff )
+            {
+                __atomic_add_fetch( &wrong, 1, __ATOMIC_RELAXED );
+                break;
+            }
+        }
+
+        bytes = contextBytes( context );
+        CGContextRelease( context );
+    } );
+
+    BasePlateCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( wrong,                               0      );
+    CHECK_EQUAL( statistics.hits + statistics.misses, RACERS );
+    CHECK      ( statistics.misses >= 1                      );
+    CHECK_EQUAL( statistics.count,                    1      );
+    CHECK_EQUAL( statistics.bytesUsed,                bytes  );
+}
+
+int main( void )
+{
+    @autoreleasepool
+    {
+        testHitsAndMisses();
+        testEmptying();
+        testConcurrent();
+    }
+
+    return testFinish( "BasePlateCacheTests" );
+}
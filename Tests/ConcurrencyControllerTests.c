@@ -0,0 +1,219 @@
+/******************************************************************************\
+ * Tests: ConcurrencyControllerTests.c
+ *
+ * Tests for "ConcurrencyController.h": throughput falling as a batch drains
+ * must not halve the concurrency, though the same fall with work waiting
+ * must; bursty completions must not make it swing; and, scanning a folder
+ * over and over through a simulated file server which serves only a few
+ * requests at once, it must settle near the server's limit rather than at
+ * either end of its range, getting close to the best throughput on the way.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <pthread.h>
+
+#include "ConcurrencyController.h"
+#include "FolderScanner.h"
+
+#define BACKLOG 1000 /* Jobs waiting, when there's plenty of work */
+
+/* With work waiting, a sharp fall in throughput halves the concurrency; as a
+ * batch drains, with fewer jobs left than the concurrency, it doesn't. The
+ * doubling which made no difference to throughput is undone first.
+ */
+
+static void testDraining( void )
+{
+    ConcurrencyController draining, congested;
+
+    concurrencyControllerInit( &draining, 1, 16, 8 );
+
+    CHECK_EQUAL( concurrencyControllerSample( &draining, 100, 1, 0.01, BACKLOG ), 16 );
+    CHECK_EQUAL( concurrencyControllerSample( &draining, 100, 1, 0.01, BACKLOG ), 8  );
+
+    congested = draining;
+
+    CHECK_EQUAL( concurrencyControllerSample( &draining, 40, 1, 0.01, 6 ), 8 );
+    CHECK_EQUAL( concurrencyControllerSample( &draining, 10, 1, 0.01, 3 ), 8 );
+    CHECK_EQUAL( concurrencyControllerSample( &draining, 1,  1, 0.01, 0 ), 8 );
+    CHECK_EQUAL( draining.decreases, 0 );
+
+    CHECK_EQUAL( concurrencyControllerSample( &congested, 40, 1, 0.01, BACKLOG ), 4 );
+    CHECK_EQUAL( congested.decreases, 1 );
+}
+
+/* Completions alternating well above and below a steady rate average out,
+ * rather than each dip being taken for congestion.
+ */
+
+static void testBursts( void )
+{
+    ConcurrencyController controller;
+
+    concurrencyControllerInit( &controller, 1, 16, 4 );
+
+    for ( int sample = 0; sample < 40; sample ++ )
+    {
+        concurrencyControllerSample( &controller, sample % 2 ? 140 : 60, 1, 0.01, BACKLOG );
+    }
+
+    CHECK_EQUAL( controller.decreases, 0 );
+    CHECK      ( controller.current >= 8 );
+}
+
+/******************************************************************************\
+ * Convergence on a simulated file server: up to MAXIMUM workers scan the same
+ * folder over and over, of which only as many as the controller allows run at
+ * once. It is sampled every INTERVAL for SAMPLES samples; the concurrency
+ * chosen over the last SETTLED is judged.
+\******************************************************************************/
+
+#define SERVER_REQUESTS   4
+#define OPEN_MICROSECONDS 3000
+#define READ_MICROSECONDS 500
+#define MAXIMUM           16
+#define INTERVAL          0.1 /* Seconds */
+#define SAMPLES           30
+#define SETTLED           10
+
+typedef struct Server
+{
+    const char               * folder;
+    FolderScannerSlowBackend   slow;
+    unsigned int               allowed;  /* Workers which may scan now */
+    bool                       finished;
+
+    pthread_mutex_t            lock;
+    uint64_t                   completed;
+    double                     latency;  /* Total, of those completed  */
+    unsigned int               failures;
+
+} Server;
+
+typedef struct Worker
+{
+    Server       * server;
+    unsigned int   number;
+
+} Worker;
+
+static void * runWorker( void * context )
+{
+    Worker               * worker  = context;
+    Server               * server  = worker->server;
+    FolderScannerOptions   options = { .threadCount = 1, .backend = &server->slow.backend };
+
+    while ( ! __atomic_load_n( &server->finished, __ATOMIC_ACQUIRE ) )
+    {
+        if ( worker->number >= __atomic_load_n( &server->allowed, __ATOMIC_ACQUIRE ) )
+        {
+            usleep( 1000 );
+            continue;
+        }
+
+        FolderScannerRoot root    = { .path = server->folder };
+        double            started = testSeconds();
+        int               error   = folderScannerRun( &root, 1, &options, NULL );
+        double            took    = testSeconds() - started;
+
+        pthread_mutex_lock( &server->lock );
+
+        if ( error != 0 || root.filesFound == 0 ) server->failures ++;
+
+        server->completed ++;
+        server->latency += took;
+
+        pthread_mutex_unlock( &server->lock );
+    }
+
+    return NULL;
+}
+
+static void testConvergesOnSlowVolume( void )
+{
+    char                * scratch = testMakeDirectory( "ConcurrencyControllerTests" );
+    Server                server  = { .folder = scratch, .lock = PTHREAD_MUTEX_INITIALIZER };
+    Worker                workers[ MAXIMUM ];
+    pthread_t             threads[ MAXIMUM ];
+    ConcurrencyController controller;
+    double                best    = 0, settled = 0, first = 0;
+    unsigned int          lowest  = MAXIMUM, highest = 0;
+
+    testMakeTree( scratch, 0, 0, 4, ".jpg", 64 );
+
+    CHECK_EQUAL( folderScannerSlowBackendInit( &server.slow, folderScannerPOSIXBackend(),
+                                               OPEN_MICROSECONDS, READ_MICROSECONDS, SERVER_REQUESTS ), 0 );
+
+    concurrencyControllerInit( &controller, 1, MAXIMUM, 1 );
+    server.allowed = controller.current;
+
+    for ( unsigned int index = 0; index < MAXIMUM; index ++ )
+    {
+        workers[ index ] = ( Worker ) { &server, index };
+        pthread_create( &threads[ index ], NULL, runWorker, &workers[ index ] );
+    }
+
+    double last = testSeconds();
+
+    for ( int sample = 0; sample < SAMPLES; sample ++ )
+    {
+        usleep( ( useconds_t ) ( INTERVAL * 1e6 ) );
+
+        pthread_mutex_lock( &server.lock );
+
+        double   now       = testSeconds();
+        uint64_t completed = server.completed;
+        double   latency   = completed ? server.latency / completed : 0;
+
+        server.completed = 0;
+        server.latency   = 0;
+
+        pthread_mutex_unlock( &server.lock );
+
+        double       throughput = completed / ( now - last );
+        unsigned int allowed    = concurrencyControllerSample( &controller, completed, now - last, latency, BACKLOG );
+
+        last = now;
+
+        if ( sample == 0 ) first = throughput;
+        if ( throughput > best ) best = throughput;
+
+        if ( sample >= SAMPLES - SETTLED )
+        {
+            settled += throughput / SETTLED;
+            lowest   = allowed < lowest  ? allowed : lowest;
+            highest  = allowed > highest ? allowed : highest;
+        }
+
+        __atomic_store_n( &server.allowed, allowed, __ATOMIC_RELEASE );
+    }
+
+    __atomic_store_n( &server.finished, true, __ATOMIC_RELEASE );
+
+    for ( unsigned int index = 0; index < MAXIMUM; index ++ ) pthread_join( threads[ index ], NULL );
+
+    printf( "Slow volume: %.0f/s with one worker, best %.0f/s, settled %.0f/s at %u to %u workers\n",
+            first, best, settled, lowest, highest );
+
+    CHECK_EQUAL( server.failures, 0 );
+    CHECK      ( lowest  >= SERVER_REQUESTS / 2 );
+    CHECK      ( highest <= SERVER_REQUESTS * 2 );
+    CHECK      ( settled >= best * 0.75         );
+    CHECK      ( settled >= first * 2           );
+
+    folderScannerSlowBackendDestroy( &server.slow );
+    testRemoveTree( scratch );
+    free( scratch );
+}
+
+int main( void )
+{
+    testDraining();
+    testBursts();
+    testConvergesOnSlowVolume();
+
+    return testFinish( "ConcurrencyControllerTests" );
+}
@@ -0,0 +1,165 @@
+/******************************************************************************\
+ * Tests: CoverArtResolverTests.m
+ *
+ * Tests for "CoverArtResolver.h" over scratch folders: the leafname earliest
+ * in the configured list wins whatever the image type, even when a later one
+ * could be found by probing; leafnames match regardless of case and Unicode
+ * composition; non-images, directories and other names are passed over; a
+ * labelled image beats any leafname when colour labels are in use; and a
+ * folder which can't be read gives an error. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#import "CoverArtResolver.h"
+#import "GlobalSemaphore.h"
+#import "ImageTypeClassifier.h"
+
+/* As isImageFile() in "Miscellaneous.m", which drags in Carbon. Only the
+ * extension matters to the tests, so no sniffing.
+ */
+
+Boolean isImageFile( NSString * fullPosixPath )
+{
+    return imageTypeClassifierIsImageFile( [ fullPosixPath fileSystemRepresentation ], NULL, false );
+}
+
+static NSString * scratch;
+
+/* Make a new, empty folder holding the given files; leafnames ending in "/"
+ * are made as directories instead.
+ *
+ * Out: Full POSIX path of the folder.
+ */
+
+static NSString * makeFolder( NSString * name, NSArray * leafnames )
+{
+    NSString * folder = [ scratch stringByAppendingPathComponent: name ];
+
+    mkdir( [ folder fileSystemRepresentation ], 0755 );
+
+    for ( NSString * leafname in leafnames )
+    {
+        NSString * path = [ folder stringByAppendingPathComponent: leafname ];
+
+        if ( [ leafname hasSuffix: @"/" ] ) CHECK( mkdir( [ path fileSystemRepresentation ], 0755 ) == 0 );
+        else                                CHECK( testWriteFile( [ path fileSystemRepresentation ], 64 ) );
+    }
+
+    return folder;
+}
+
+static void setLabel( NSString * folder, NSString * leafname, NSInteger label )
+{
+    NSURL * url = [ NSURL fileURLWithPath: [ folder stringByAppendingPathComponent: leafname ] ];
+
+    CHECK( [ url setResourceValue: @( label ) forKey: NSURLLabelNumberKey error: NULL ] );
+}
+
+/* Out: Leafname of the cover art found in a folder, or nil */
+
+static NSString * resolve( CoverArtResolver * resolver, NSString * folder )
+{
+    NSError  * error = nil;
+    NSString * found = [ resolver coverArtIn: folder error: &error ];
+
+    CHECK( error == nil );
+
+    return [ found lastPathComponent ];
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+static void testRanking( void )
+{
+    CoverArtResolver * resolver = [ [ CoverArtResolver alloc ] initWithLeafnames: @[ @"cover", @"folder", @"front" ]
+                                                                 useColourLabels: NO ];
+
+    /* Found by probing */
+
+    CHECK( [ resolve( resolver, makeFolder( @"probed", @[ @"folder.jpg", @"cover.jpg", @"front.png" ] ) ) isEqualToString: @"cover.jpg" ] );
+
+    /* A later leafname could be probed for, but an earlier one exists with
+     * an extension that isn't probed for and must still win.
+     */
+
+    CHECK( [ resolve( resolver, makeFolder( @"unprobed", @[ @"cover.tif", @"folder.jpg" ] ) ) isEqualToString: @"cover.tif" ] );
+    CHECK( [ resolve( resolver, makeFolder( @"later",    @[ @"front.gif", @"folder.jpg" ] ) ) isEqualToString: @"folder.jpg" ] );
+
+    /* Non-images, directories and other leafnames don't count */
+
+    CHECK( [ resolve( resolver, makeFolder( @"others", @[ @"cover.txt", @"cover.jpeg/", @"back.jpg", @"front.bmp" ] ) ) isEqualToString: @"front.bmp" ] );
+    CHECK( resolve( resolver, makeFolder( @"none", @[ @"back.jpg", @"cover.txt" ] ) ) == nil );
+    CHECK( resolve( resolver, makeFolder( @"empty", @[] ) ) == nil );
+}
+
+/* Leafnames match without regard to case or to how accented letters are
+ * composed; duplicates in the list that differ only so are ignored.
+ */
+
+static void testFolding( void )
+{
+    CoverArtResolver * resolver = [ [ CoverArtResolver alloc ] initWithLeafnames: @[ @"Caf\u00e9", @"COVER", @"cover", @"folder" ]
+                                                                 useColourLabels: NO ];
+
+    /* Precomposed in the list, decomposed on disc */
+
+    NSString * decomposed = @"CAFE\u0301.gif";
+
+    CHECK( [ resolve( resolver, makeFolder( @"cased",    @[ @"folder.jpg", @"Cover.TIF" ] ) ) isEqualToString: @"Cover.TIF" ] );
+    CHECK( [ resolve( resolver, makeFolder( @"composed", @[ @"cover.jpg",  decomposed   ] ) ) compare: decomposed ] == NSOrderedSame );
+}
+
+/* Any labelled image wins over a matching leafname, but a labelled file that
+ * isn't an image doesn't; without labels in use, labels are ignored.
+ */
+
+static void testLabels( void )
+{
+    CoverArtResolver * labels   = [ [ CoverArtResolver alloc ] initWithLeafnames: @[ @"cover" ] useColourLabels: YES ];
+    CoverArtResolver * noLabels = [ [ CoverArtResolver alloc ] initWithLeafnames: @[ @"cover" ] useColourLabels: NO  ];
+    NSString         * labelled = makeFolder( @"labelled",    @[ @"cover.jpg", @"snapshot.png", @"notes.txt" ] );
+    NSString         * text     = makeFolder( @"labelledText", @[ @"cover.jpg", @"notes.txt" ] );
+
+    setLabel( labelled, @"snapshot.png", 2 );
+    setLabel( text,     @"notes.txt",    6 );
+
+    CHECK( [ resolve( labels,   labelled ) isEqualToString: @"snapshot.png" ] );
+    CHECK( [ resolve( noLabels, labelled ) isEqualToString: @"cover.jpg"    ] );
+    CHECK( [ resolve( labels,   text     ) isEqualToString: @"cover.jpg"    ] );
+}
+
+static void testUnreadable( void )
+{
+    CoverArtResolver * resolver = [ [ CoverArtResolver alloc ] initWithLeafnames: @[ @"cover" ] useColourLabels: NO ];
+    NSError          * error    = nil;
+
+    CHECK( [ resolver coverArtIn: [ scratch stringByAppendingPathComponent: @"missing" ] error: &error ] == nil );
+    CHECK( error != nil );
+}
+
+int main( void )
+{
+    @autoreleasepool
+    {
+        char * directory = testMakeDirectory( "CoverArtResolverTests" );
+
+        scratch = [ NSString stringWithUTF8String: directory ];
+
+        globalSemaphoreInit();
+
+        testRanking   ();
+        testFolding   ();
+        testLabels    ();
+        testUnreadable();
+
+        testRemoveTree( directory );
+        free( directory );
+    }
+
+    return testFinish( "CoverArtResolverTests" );
+}
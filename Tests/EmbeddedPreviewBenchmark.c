@@ -0,0 +1,173 @@
+/******************************************************************************\
+ * Tests: EmbeddedPreviewBenchmark.c
+ *
+ * Run "EmbeddedPreview.h" over a corpus of camera-style files, in the shapes
+ * and preview layouts cameras commonly write, for a range of thumbnail sizes.
+ * For each size, report how many files can be drawn from a preview, both
+ * taking letterboxed thumbnails into account and counting only previews of
+ * the picture's own shape, as before; the pixels which must then be decoded,
+ * with DCT-domain scaling (see "ReducedDecode.h"), against decoding the main
+ * image every time; and the time taken to find previews.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#include "EmbeddedPreview.h"
+#include "EmbeddedPreviewSupport.h"
+#include "ReducedDecode.h"
+
+/* Main image, EXIF thumbnail and MPF preview sizes (0 for none) */
+
+typedef struct Shape
+{
+    uint32_t width,          height;
+    uint32_t thumbnailWidth, thumbnailHeight;
+    uint32_t previewWidth,   previewHeight;
+
+} Shape;
+
+static const Shape shapes[] =
+{
+    { 6000, 4000, 160, 120, 1620, 1080 }, /* 3:2 camera, letterboxed thumbnail */
+    { 6000, 4000, 160, 120,    0,    0 },
+    { 4000, 6000, 160, 120, 1080, 1620 }, /* Portrait, pillarboxed thumbnail   */
+    { 4032, 3024, 160, 120, 1440, 1080 }, /* 4:3 phone or compact              */
+    { 4032, 3024, 160, 120,    0,    0 },
+    { 5472, 3078, 160, 120,    0,    0 }, /* 16:9, letterboxed thumbnail       */
+    { 6000, 4000, 160, 107,    0,    0 }, /* 3:2 thumbnail                     */
+    { 6000, 4000,   0,   0,    0,    0 }  /* No previews                       */
+};
+
+#define SHAPES ( sizeof( shapes ) / sizeof( shapes[ 0 ] ) )
+
+/* Pixels decoded for the given image and target with DCT-domain scaling */
+
+static uint64_t decodePixels( uint32_t width, uint32_t height, uint32_t contentWidth, uint32_t contentHeight, double target )
+{
+    ReducedDecodePlan plan;
+
+    reducedDecodePlan( contentWidth, contentHeight, target, target, true, &plan );
+
+    return ( uint64_t ) ( ( width  + plan.jpegScaleDenominator - 1 ) / plan.jpegScaleDenominator ) *
+                        ( ( height + plan.jpegScaleDenominator - 1 ) / plan.jpegScaleDenominator );
+}
+
+/* embeddedPreviewFind() as it was, accepting only previews of the picture's
+ * own shape.
+ */
+
+static bool sameShapeFind( const char * path, const Shape * shape, double target, EmbeddedPreview * preview )
+{
+    EmbeddedPreview previews[ EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES ];
+    unsigned int    count  = embeddedPreviewList( path, previews );
+    double          aspect = ( double ) shape->width / shape->height;
+    bool            found  = false;
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        const EmbeddedPreview * candidate = &previews[ index ];
+        uint64_t                area      = ( uint64_t ) candidate->width * candidate->height;
+
+        if ( area >= ( uint64_t ) shape->width * shape->height ) continue;
+        if ( fabs( ( double ) candidate->width / candidate->height / aspect - 1 ) > EMBEDDED_PREVIEW_ASPECT_TOLERANCE ) continue;
+        if ( ! reducedDecodeCovers( candidate->width, candidate->height, target, target, true ) ) continue;
+
+        if ( ! found || area < ( uint64_t ) preview->width * preview->height )
+        {
+            *preview = *candidate;
+            found    = true;
+        }
+    }
+
+    return found;
+}
+
+/* Look for a preview by either rule; return the pixels then to be decoded */
+
+static uint64_t findAndCount( const char * path, const Shape * shape, double target, bool boxes, unsigned int * used )
+{
+    EmbeddedPreview preview;
+    bool            found = boxes ? embeddedPreviewFind( path, shape->width, shape->height, target, target, true, &preview )
+                                  : sameShapeFind( path, shape, target, &preview );
+
+    if ( ! found ) return decodePixels( shape->width, shape->height, shape->width, shape->height, target );
+
+    ( *used ) ++;
+
+    return decodePixels( preview.width, preview.height, preview.contentWidth, preview.contentHeight, target );
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    unsigned int copies  = quick ? 2 : 50;
+    unsigned int files   = copies * SHAPES;
+    char       * scratch = testMakeDirectory( "EmbeddedPreviewBenchmark" );
+    char      ** paths   = calloc( files, sizeof( char * ) );
+
+    static const double targets[] = { 32, 64, 100, 128, 256, 512 };
+
+    for ( unsigned int file = 0; file < files; file ++ )
+    {
+        const Shape * shape = &shapes[ file % SHAPES ];
+        char          path[ 4096 ];
+
+        snprintf( path, sizeof( path ), "%s/image%u.jpg", scratch, file );
+
+        if ( ! embeddedPreviewSupportWrite( path, shape->width,          shape->height,
+                                                  shape->thumbnailWidth, shape->thumbnailHeight,
+                                                  shape->previewWidth,   shape->previewHeight ) )
+        {
+            fprintf( stderr, "Can't write %s\n", path );
+            return EXIT_FAILURE;
+        }
+
+        paths[ file ] = strdup( path );
+    }
+
+    printf( "%u files, %zu shapes\n\n", files, SHAPES );
+    printf( "        Previews used             Decoded Mpx                  Find time\n" );
+    printf( "Target  Same shape  With boxes   Main   Same shape  With boxes  (with boxes)\n" );
+
+    for ( size_t item = 0; item < sizeof( targets ) / sizeof( targets[ 0 ] ); item ++ )
+    {
+        double       target     = targets[ item ];
+        unsigned int sameShape  = 0, boxed = 0;
+        uint64_t     mainPixels = 0, sameShapePixels = 0, boxedPixels = 0;
+
+        for ( unsigned int file = 0; file < files; file ++ )
+        {
+            const Shape * shape = &shapes[ file % SHAPES ];
+
+            mainPixels      += decodePixels( shape->width, shape->height, shape->width, shape->height, target );
+            sameShapePixels += findAndCount( paths[ file ], shape, target, false, &sameShape );
+        }
+
+        double started = testSeconds();
+
+        for ( unsigned int file = 0; file < files; file ++ )
+        {
+            boxedPixels += findAndCount( paths[ file ], &shapes[ file % SHAPES ], target, true, &boxed );
+        }
+
+        double elapsed = ( testSeconds() - started ) / files;
+
+        printf( "%6.0f  %4u (%2.0f%%)  %4u (%2.0f%%)  %6.1f  %8.1f    %8.1f    %8.2fus\n",
+                target,
+                sameShape, 100.0 * sameShape / files,
+                boxed,     100.0 * boxed     / files,
+                mainPixels / 1e6, sameShapePixels / 1e6, boxedPixels / 1e6, elapsed * 1e6 );
+    }
+
+    for ( unsigned int file = 0; file < files; file ++ ) free( paths[ file ] );
+    free( paths );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
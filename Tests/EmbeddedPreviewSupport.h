@@ -0,0 +1,194 @@
+/******************************************************************************\
+ * Tests: EmbeddedPreviewSupport.h
+ *
+ * Write synthetic camera JPEG files for tests and benchmarks of
+ * "EmbeddedPreview.h": a primary image with an EXIF thumbnail and, optionally,
+ * a Multi-Picture Format preview appended after it. Only the headers are real;
+ * no image data is encoded, since previews are found by parsing alone.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef EMBEDDED_PREVIEW_SUPPORT_H
+#define EMBEDDED_PREVIEW_SUPPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Length of the stand-in JPEG stream written by embeddedPreviewSupportFrame() */
+
+#define EMBEDDED_PREVIEW_SUPPORT_FRAME 23
+
+static inline unsigned char * embeddedPreviewSupportPut16( unsigned char * out, uint32_t value )
+{
+    out[ 0 ] = ( unsigned char ) ( value >> 8 );
+    out[ 1 ] = ( unsigned char ) ( value      );
+
+    return out + 2;
+}
+
+static inline unsigned char * embeddedPreviewSupportPut32( unsigned char * out, uint32_t value )
+{
+    out = embeddedPreviewSupportPut16( out, value >> 16 );
+    return embeddedPreviewSupportPut16( out, value & 0xFFFF );
+}
+
+/* A baseline frame header of the given size, without the SOI/EOI markers */
+
+static inline unsigned char * embeddedPreviewSupportSOF( unsigned char * out, uint32_t width, uint32_t height )
+{
+    static const unsigned char components[] = { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+
+    *out ++ = 0xFF;
+    *out ++ = 0xC0;
+    out     = embeddedPreviewSupportPut16( out, 17 );
+    *out ++ = 8;
+    out     = embeddedPreviewSupportPut16( out, height );
+    out     = embeddedPreviewSupportPut16( out, width  );
+
+    memcpy( out, components, sizeof( components ) );
+
+    return out + sizeof( components );
+}
+
+/* A complete stand-in JPEG stream: SOI, frame header, EOI */
+
+static inline unsigned char * embeddedPreviewSupportFrame( unsigned char * out, uint32_t width, uint32_t height )
+{
+    *out ++ = 0xFF;
+    *out ++ = 0xD8;
+    out     = embeddedPreviewSupportSOF( out, width, height );
+    *out ++ = 0xFF;
+    *out ++ = 0xD9;
+
+    return out;
+}
+
+/******************************************************************************\
+ * embeddedPreviewSupportWrite()
+ *
+ * Write a camera-style JPEG file.
+ *
+ * In:  Full path of the file to write;
+ *
+ *      Width and height of the primary image;
+ *
+ *      Width and height of the EXIF thumbnail, or 0, 0 for none;
+ *
+ *      Width and height of an MPF preview, or 0, 0 for none.
+ *
+ * Out: true if written.
+\******************************************************************************/
+
+static inline bool embeddedPreviewSupportWrite( const char * path,
+                                                uint32_t     width,
+                                                uint32_t     height,
+                                                uint32_t     thumbnailWidth,
+                                                uint32_t     thumbnailHeight,
+                                                uint32_t     previewWidth,
+                                                uint32_t     previewHeight )
+{
+    unsigned char   bytes[ 512 ];
+    unsigned char * out = bytes;
+
+    *out ++ = 0xFF;
+    *out ++ = 0xD8;
+
+    /* APP1: EXIF, an empty IFD0 then IFD1 describing the thumbnail, which
+     * follows straight after at TIFF offset 44.
+     */
+
+    if ( thumbnailWidth != 0 )
+    {
+        *out ++ = 0xFF;
+        *out ++ = 0xE1;
+        out     = embeddedPreviewSupportPut16( out, 2 + 6 + 44 + EMBEDDED_PREVIEW_SUPPORT_FRAME );
+
+        memcpy( out, "Exif\0\0MM\0\x2A", 10 );
+        out += 10;
+
+        out = embeddedPreviewSupportPut32( out, 8  ); /* IFD0   */
+        out = embeddedPreviewSupportPut16( out, 0  );
+        out = embeddedPreviewSupportPut32( out, 14 ); /* IFD1   */
+        out = embeddedPreviewSupportPut16( out, 2  );
+
+        out = embeddedPreviewSupportPut16( out, 0x0201 ); /* JPEGInterchangeFormat */
+        out = embeddedPreviewSupportPut16( out, 4      );
+        out = embeddedPreviewSupportPut32( out, 1      );
+        out = embeddedPreviewSupportPut32( out, 44     );
+
+        out = embeddedPreviewSupportPut16( out, 0x0202 ); /* ...Length             */
+        out = embeddedPreviewSupportPut16( out, 4      );
+        out = embeddedPreviewSupportPut32( out, 1      );
+        out = embeddedPreviewSupportPut32( out, EMBEDDED_PREVIEW_SUPPORT_FRAME );
+
+        out = embeddedPreviewSupportPut32( out, 0 );
+        out = embeddedPreviewSupportFrame( out, thumbnailWidth, thumbnailHeight );
+    }
+
+    /* APP2: MPF, one IFD holding an MP Entry for the primary image and one
+     * for the preview, which goes after the primary image's EOI. Offsets are
+     * relative to the MP header (the "MM").
+     */
+
+    unsigned char * previewOffset = NULL;
+    unsigned char * mpHeader      = NULL;
+
+    if ( previewWidth != 0 )
+    {
+        *out ++ = 0xFF;
+        *out ++ = 0xE2;
+        out     = embeddedPreviewSupportPut16( out, 2 + 4 + 26 + 32 );
+
+        memcpy( out, "MPF\0", 4 );
+        out += 4;
+
+        mpHeader = out;
+
+        memcpy( out, "MM\0\x2A", 4 );
+        out += 4;
+
+        out = embeddedPreviewSupportPut32( out, 8      );
+        out = embeddedPreviewSupportPut16( out, 1      );
+        out = embeddedPreviewSupportPut16( out, 0xB002 );
+        out = embeddedPreviewSupportPut16( out, 7      );
+        out = embeddedPreviewSupportPut32( out, 32     );
+        out = embeddedPreviewSupportPut32( out, 26     );
+        out = embeddedPreviewSupportPut32( out, 0      );
+
+        out = embeddedPreviewSupportPut32( out, 0x20030000 ); /* Primary */
+        out = embeddedPreviewSupportPut32( out, 0          );
+        out = embeddedPreviewSupportPut32( out, 0          );
+        out = embeddedPreviewSupportPut32( out, 0          );
+
+        out = embeddedPreviewSupportPut32( out, 0x00020002 ); /* Preview */
+        out = embeddedPreviewSupportPut32( out, EMBEDDED_PREVIEW_SUPPORT_FRAME );
+
+        previewOffset = out;
+
+        out = embeddedPreviewSupportPut32( out, 0 );
+        out = embeddedPreviewSupportPut32( out, 0 );
+    }
+
+    out     = embeddedPreviewSupportSOF( out, width, height );
+    *out ++ = 0xFF;
+    *out ++ = 0xD9;
+
+    if ( previewOffset != NULL )
+    {
+        embeddedPreviewSupportPut32( previewOffset, ( uint32_t ) ( out - mpHeader ) );
+        out = embeddedPreviewSupportFrame( out, previewWidth, previewHeight );
+    }
+
+    FILE * file = fopen( path, "wb" );
+
+    if ( file == NULL ) return false;
+
+    size_t written = fwrite( bytes, 1, ( size_t ) ( out - bytes ), file );
+
+    return fclose( file ) == 0 && written == ( size_t ) ( out - bytes );
+}
+
+#endif /* EMBEDDED_PREVIEW_SUPPORT_H */
@@ -0,0 +1,117 @@
+/******************************************************************************\
+ * Tests: EmbeddedPreviewTests.c
+ *
+ * Tests for "EmbeddedPreview.h": finding EXIF thumbnails and MPF previews,
+ * and using only the picture area of letterboxed or pillarboxed thumbnails.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "EmbeddedPreview.h"
+#include "EmbeddedPreviewSupport.h"
+
+static char path[ 4096 ];
+
+/* Both previews are listed, each with itself as the content area */
+
+static void testList( void )
+{
+    EmbeddedPreview previews[ EMBEDDED_PREVIEW_MAXIMUM_CANDIDATES ];
+
+    CHECK( embeddedPreviewSupportWrite( path, 6000, 4000, 160, 120, 1620, 1080 ) );
+    CHECK_EQUAL( embeddedPreviewList( path, previews ), 2 );
+
+    CHECK_EQUAL( previews[ 0 ].width,         160  );
+    CHECK_EQUAL( previews[ 0 ].height,        120  );
+    CHECK_EQUAL( previews[ 0 ].contentWidth,  160  );
+    CHECK_EQUAL( previews[ 0 ].contentHeight, 120  );
+    CHECK_EQUAL( previews[ 1 ].width,         1620 );
+    CHECK_EQUAL( previews[ 1 ].contentHeight, 1080 );
+}
+
+/* A 4:3 thumbnail of a 3:2 picture holds it between bars top and bottom; of
+ * a 2:3 one, between bars to either side. Either way the picture area is
+ * centred and rounded inwards.
+ */
+
+static void testBoxed( void )
+{
+    EmbeddedPreview preview;
+
+    CHECK( embeddedPreviewSupportWrite( path, 6000, 4000, 160, 120, 0, 0 ) );
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 64, 64, true, &preview ) );
+
+    CHECK_EQUAL( preview.width,         160 );
+    CHECK_EQUAL( preview.contentX,      0   );
+    CHECK_EQUAL( preview.contentY,      7   );
+    CHECK_EQUAL( preview.contentWidth,  160 );
+    CHECK_EQUAL( preview.contentHeight, 106 );
+
+    CHECK( embeddedPreviewFind( path, 4000, 6000, 64, 64, true, &preview ) );
+
+    CHECK_EQUAL( preview.contentX,      40  );
+    CHECK_EQUAL( preview.contentY,      0   );
+    CHECK_EQUAL( preview.contentWidth,  80  );
+    CHECK_EQUAL( preview.contentHeight, 120 );
+
+    /* The picture area, not the whole thumbnail, must cover the target */
+
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 110, 110, true,  &preview ) == false );
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 150, 100, false, &preview ) );
+
+    /* Bars over half the thumbnail mean it isn't a copy of this picture */
+
+    CHECK( embeddedPreviewFind( path, 8000, 2000, 32, 32, true, &preview ) == false );
+}
+
+/* A thumbnail within rounding of the picture's shape is used whole */
+
+static void testSameShape( void )
+{
+    EmbeddedPreview preview;
+
+    CHECK( embeddedPreviewSupportWrite( path, 6000, 4000, 160, 107, 0, 0 ) );
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 64, 64, true, &preview ) );
+
+    CHECK_EQUAL( preview.contentX,      0   );
+    CHECK_EQUAL( preview.contentY,      0   );
+    CHECK_EQUAL( preview.contentWidth,  160 );
+    CHECK_EQUAL( preview.contentHeight, 107 );
+}
+
+/* The smallest preview which covers is chosen, and nothing if none does */
+
+static void testChoice( void )
+{
+    EmbeddedPreview preview;
+
+    CHECK( embeddedPreviewSupportWrite( path, 6000, 4000, 160, 120, 1620, 1080 ) );
+
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 64, 64, true, &preview ) );
+    CHECK_EQUAL( preview.width, 160 );
+
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 512, 512, true, &preview ) );
+    CHECK_EQUAL( preview.width, 1620 );
+
+    CHECK( embeddedPreviewFind( path, 6000, 4000, 2048, 2048, true, &preview ) == false );
+    CHECK( embeddedPreviewFind( path, 150,  100,  64,   64,   true, &preview ) == false );
+}
+
+int main( void )
+{
+    char * scratch = testMakeDirectory( "EmbeddedPreviewTests" );
+
+    snprintf( path, sizeof( path ), "%s/camera.jpg", scratch );
+
+    testList     ();
+    testBoxed    ();
+    testSameShape();
+    testChoice   ();
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return testFinish( "EmbeddedPreviewTests" );
+}
@@ -0,0 +1,157 @@
+/******************************************************************************\
+ * Tests: FolderScannerBenchmark.c
+ *
+ * Scanning throughput of "FolderScanner.h", in directory entries per second,
+ * for 1, 2, 4 and 8 threads, scanning a large synthetic tree as one root and
+ * as eight roots (its top level subtrees). The tree holds about a million
+ * entries; "--quick" makes it tiny. The same is done for a smaller tree on a
+ * simulated slow volume, where opening and reading directories is what costs
+ * and more threads should help even on one core.
+ *
+ * Building the big tree takes a while and needs about a million inodes in
+ * the temporary directory (see "TMPDIR").
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "FolderScanner.h"
+
+#define PARTS 8 /* Top level subtrees, each of which can be a root */
+
+static bool acceptJPEG( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+    ( void ) fullPath;
+
+    const char * dot = strrchr( leafname, '.' );
+
+    return dot != NULL && strcmp( dot, ".jpg" ) == 0;
+}
+
+static const FolderScannerCallbacks callbacks = { acceptJPEG, NULL, NULL };
+
+/* Build PARTS subtrees of the given shape under 'tree'.
+ *
+ * Out: Entries made, files and directories, below 'tree'.
+ */
+
+static size_t makeTree( const char * tree, unsigned int depth, unsigned int fanout, unsigned int files )
+{
+    char   path[ 4096 ];
+    size_t entries     = 0;
+    size_t directories = 1;
+    size_t level       = 1;
+
+    for ( unsigned int below = 0; below < depth; below ++ ) directories += ( level *= fanout );
+
+    mkdir( tree, 0755 );
+
+    for ( unsigned int part = 0; part < PARTS; part ++ )
+    {
+        snprintf( path, sizeof( path ), "%s/part%u", tree, part );
+        mkdir( path, 0755 );
+
+        entries += testMakeTree( path, depth, fanout, files, ".jpg", 0 ) + directories;
+    }
+
+    return entries;
+}
+
+/* Out: Seconds taken to scan the tree once with the given setup; the entries
+ *      seen are written to 'entries'.
+ */
+
+static double timeScan( const char                 * tree,
+                        unsigned int                 rootCount,
+                        unsigned int                 threads,
+                        const FolderScannerBackend * backend,
+                        size_t                     * entries )
+{
+    FolderScannerOptions options = { .threadCount = threads, .backend = backend };
+    FolderScannerRoot    roots[ PARTS ];
+    char                 paths[ PARTS ][ 4096 ];
+    double               started, seconds;
+
+    memset( roots, 0, sizeof( roots ) );
+
+    for ( unsigned int root = 0; root < rootCount; root ++ )
+    {
+        if ( rootCount == 1 ) snprintf( paths[ root ], sizeof( paths[ root ] ), "%s", tree );
+        else                  snprintf( paths[ root ], sizeof( paths[ root ] ), "%s/part%u", tree, root );
+
+        roots[ root ].path = paths[ root ];
+    }
+
+    started = testSeconds();
+    folderScannerRun( roots, rootCount, &options, &callbacks );
+    seconds = testSeconds() - started;
+
+    *entries = 0;
+    for ( unsigned int root = 0; root < rootCount; root ++ ) *entries += roots[ root ].entriesSeen;
+
+    return seconds;
+}
+
+static void report( const char * volume, const char * tree, const FolderScannerBackend * backend, size_t made )
+{
+    static const unsigned int rootCounts  [] = { 1, PARTS };
+    static const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+
+    size_t entries;
+
+    /* Warm the caches, so that the first figures aren't out of line */
+
+    timeScan( tree, 1, 1, backend, &entries );
+
+    if ( entries != made ) fprintf( stderr, "%s: saw %zu entries of %zu\n", volume, entries, made );
+
+    for ( size_t r = 0; r < sizeof( rootCounts ) / sizeof( rootCounts[ 0 ] ); r ++ )
+    {
+        for ( size_t t = 0; t < sizeof( threadCounts ) / sizeof( threadCounts[ 0 ] ); t ++ )
+        {
+            double seconds = timeScan( tree, rootCounts[ r ], threadCounts[ t ], backend, &entries );
+
+            printf( "%-8s %5u  %7u  %9zu  %9.1fms  %11.0f\n",
+                    volume, rootCounts[ r ], threadCounts[ t ], entries, seconds * 1e3, entries / seconds );
+        }
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    bool   quick   = benchmarkIsQuick( argc, argv );
+    char * scratch = testMakeDirectory( "FolderScannerBenchmark" );
+    char   local[ 4096 ], slow[ 4096 ];
+    size_t localEntries, slowEntries;
+
+    snprintf( local, sizeof( local ), "%s/local", scratch );
+    snprintf( slow,  sizeof( slow  ), "%s/slow",  scratch );
+
+    /* Eight parts of 1,111 directories holding 120 files each, or of 4
+     * directories holding 5 files each with "--quick".
+     */
+
+    localEntries = quick ? makeTree( local, 1, 3,  5   )
+                         : makeTree( local, 3, 10, 120 );
+    slowEntries  = quick ? makeTree( slow,  1, 3,  5   )
+                         : makeTree( slow,  2, 5,  8   );
+
+    FolderScannerSlowBackend slowBackend;
+
+    folderScannerSlowBackendInit( &slowBackend, folderScannerPOSIXBackend(), 2000, 200, 4 );
+
+    printf( "Local tree: %zu entries; slow tree: %zu entries\n\n", localEntries, slowEntries );
+    printf( "Volume   Roots  Threads    Entries       Time    Entries/s\n" );
+
+    report( "Local", local, folderScannerPOSIXBackend(), localEntries );
+    report( "Slow",  slow,  &slowBackend.backend,        slowEntries  );
+
+    folderScannerSlowBackendDestroy( &slowBackend );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
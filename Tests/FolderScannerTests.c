@@ -0,0 +1,219 @@
+/******************************************************************************\
+ * Tests: FolderScannerTests.c
+ *
+ * Tests for "FolderScanner.h": whole walks, the found-file cap, the
+ * wall-clock deadline (against a simulated slow volume) and error reporting.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "FolderScanner.h"
+
+/* Synthetic tree: 1 + 3 + 9 directories of 5 files each */
+
+#define TREE_DEPTH        2
+#define TREE_FANOUT       3
+#define TREE_FILES        5
+#define TREE_DIRECTORIES  13
+#define TREE_FILE_SIZE    100
+
+typedef struct Found
+{
+    size_t count;
+    size_t stopAfter; /* 0 = never stop */
+
+} Found;
+
+static bool acceptJPEG( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+    ( void ) fullPath;
+
+    const char * dot = strrchr( leafname, '.' );
+
+    return dot != NULL && strcmp( dot, ".jpg" ) == 0;
+}
+
+static bool foundFile( void * context, const char * fullPath, uint64_t size )
+{
+    Found * found = context;
+
+    ( void ) fullPath;
+    ( void ) size;
+
+    found->count ++;
+
+    return found->stopAfter == 0 || found->count < found->stopAfter;
+}
+
+static const FolderScannerCallbacks callbacks = { acceptJPEG, NULL, foundFile };
+
+static void initRoot( FolderScannerRoot * root, const char * path, Found * found )
+{
+    memset( root,  0, sizeof( *root  ) );
+    memset( found, 0, sizeof( *found ) );
+
+    root->path    = path;
+    root->context = found;
+}
+
+/* The whole tree is walked, only accepted files are reported, and files over
+ * the size limit are left out.
+ */
+
+static void testCompleteWalk( const char * tree )
+{
+    FolderScannerRoot    root;
+    Found                found;
+    FolderScannerOptions options = { .threadCount = 4 };
+
+    initRoot( &root, tree, &found );
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+    CHECK_EQUAL( root.status,          folderScannerStatusComplete );
+    CHECK_EQUAL( root.error,           0 );
+    CHECK_EQUAL( root.directoriesRead, TREE_DIRECTORIES );
+    CHECK_EQUAL( root.filesFound,      TREE_DIRECTORIES * TREE_FILES );
+    CHECK_EQUAL( found.count,          TREE_DIRECTORIES * TREE_FILES );
+
+    options.maximumFileSize = TREE_FILE_SIZE - 1;
+    initRoot( &root, tree, &found );
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+    CHECK_EQUAL( root.status, folderScannerStatusComplete );
+    CHECK_EQUAL( found.count, 0 );
+}
+
+/* The found-file cap stops the scan at exactly the cap, and a callback can
+ * stop it too; neither is an error.
+ */
+
+static void testFoundLimit( const char * tree )
+{
+    FolderScannerRoot    root;
+    Found                found;
+    FolderScannerOptions options = { .threadCount = 4 };
+
+    initRoot( &root, tree, &found );
+    root.foundLimit = 7;
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+    CHECK_EQUAL( root.status,     folderScannerStatusFoundLimit );
+    CHECK_EQUAL( root.error,      0 );
+    CHECK_EQUAL( root.filesFound, 7 );
+    CHECK_EQUAL( found.count,     7 );
+
+    initRoot( &root, tree, &found );
+    found.stopAfter = 3;
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+    CHECK_EQUAL( root.status, folderScannerStatusStopped );
+    CHECK_EQUAL( root.error,  0 );
+    CHECK_EQUAL( found.count, 3 );
+}
+
+/* On a volume slow enough that the tree can't be read in time, the scan
+ * stops soon after the deadline, with what it found so far; it is not an
+ * error. Each request takes 20ms, one at a time, so the whole tree would
+ * take over half a second.
+ */
+
+static void testDeadline( const char * tree )
+{
+    FolderScannerSlowBackend slow;
+    FolderScannerRoot        root;
+    Found                    found;
+
+    CHECK_EQUAL( folderScannerSlowBackendInit( &slow, folderScannerPOSIXBackend(), 20000, 20000, 1 ), 0 );
+
+    FolderScannerOptions options = { .threadCount = 4, .backend = &slow.backend };
+
+    initRoot( &root, tree, &found );
+    root.timeLimitMs = 100;
+
+    double started = testSeconds();
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+
+    double taken = testSeconds() - started;
+
+    CHECK_EQUAL( root.status, folderScannerStatusTimeLimit );
+    CHECK_EQUAL( root.error,  0 );
+    CHECK( root.directoriesRead < TREE_DIRECTORIES );
+    CHECK( found.count          < TREE_DIRECTORIES * TREE_FILES );
+
+    /* Requests already under way when time runs out are allowed to finish;
+     * with four threads queueing for one request at a time, that's at most
+     * four requests of each kind, plus some leeway for a loaded machine.
+     */
+
+    CHECK( taken < 0.1 + 8 * 0.02 + 0.25 );
+
+    folderScannerSlowBackendDestroy( &slow );
+}
+
+/* An unreadable root is an error with its errno; a missing one included */
+
+static void testUnreadableRoot( const char * tree )
+{
+    FolderScannerRoot    root;
+    Found                found;
+    FolderScannerOptions options = { .threadCount = 2 };
+    char                 path[ 4096 ];
+
+    snprintf( path, sizeof( path ), "%s/missing", tree );
+    initRoot( &root, path, &found );
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+    CHECK_EQUAL( root.status, folderScannerStatusError );
+    CHECK_EQUAL( root.error,  ENOENT );
+    CHECK_EQUAL( found.count, 0 );
+}
+
+/* Several roots get their own outcomes */
+
+static void testSeveralRoots( const char * tree )
+{
+    FolderScannerRoot    roots[ 3 ];
+    Found                found[ 3 ];
+    FolderScannerOptions options = { .threadCount = 3 };
+    char                 missing[ 4096 ];
+    char                 branch [ 4096 ];
+
+    snprintf( missing, sizeof( missing ), "%s/missing", tree );
+    snprintf( branch,  sizeof( branch  ), "%s/dir1",    tree );
+
+    initRoot( &roots[ 0 ], tree,    &found[ 0 ] );
+    initRoot( &roots[ 1 ], missing, &found[ 1 ] );
+    initRoot( &roots[ 2 ], branch,  &found[ 2 ] );
+
+    roots[ 0 ].foundLimit = 4;
+
+    CHECK_EQUAL( folderScannerRun( roots, 3, &options, &callbacks ), 0 );
+    CHECK_EQUAL( roots[ 0 ].status, folderScannerStatusFoundLimit );
+    CHECK_EQUAL( roots[ 1 ].status, folderScannerStatusError );
+    CHECK_EQUAL( roots[ 2 ].status, folderScannerStatusComplete );
+    CHECK_EQUAL( found[ 0 ].count,  4 );
+    CHECK_EQUAL( found[ 2 ].count,  ( 1 + TREE_FANOUT ) * TREE_FILES );
+}
+
+int main( void )
+{
+    char * tree = testMakeDirectory( "FolderScannerTests" );
+
+    testMakeTree( tree, TREE_DEPTH, TREE_FANOUT, TREE_FILES, ".jpg", TREE_FILE_SIZE );
+    testMakeTree( tree, 0,          0,           2,          ".txt", TREE_FILE_SIZE );
+
+    testCompleteWalk  ( tree );
+    testFoundLimit    ( tree );
+    testDeadline      ( tree );
+    testUnreadableRoot( tree );
+    testSeveralRoots  ( tree );
+
+    testRemoveTree( tree );
+    free( tree );
+
+    return testFinish( "FolderScannerTests" );
+}
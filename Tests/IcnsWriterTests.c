@@ -0,0 +1,439 @@
+/******************************************************************************\
+ * Tests: IcnsWriterTests.c
+ *
+ * Tests for "IcnsWriter.h": run-length packed 'it32', 'il32' and 'is32'
+ * elements and 't8mk', 'l8mk' and 's8mk' masks read from "Sparkle.icns", an
+ * icon family made by Apple's tools, must be written back byte for byte;
+ * families of awkward pixels must read back as written, with damage detected;
+ * and the large 'ic09' and 'ic08' elements must hold PNG files (see
+ * "PngEncoder.h") which decode to the source pixels.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <zlib.h>
+
+#include "IcnsWriter.h"
+#include "PngEncoder.h"
+
+#define FOUR_CC( a, b, c, d ) ( ( uint32_t ) ( a ) << 24 | ( uint32_t ) ( b ) << 16 | ( uint32_t ) ( c ) << 8 | ( uint32_t ) ( d ) )
+
+static uint32_t getBigEndian( const uint8_t * bytes )
+{
+    return ( uint32_t ) bytes[ 0 ] << 24 | ( uint32_t ) bytes[ 1 ] << 16 | ( uint32_t ) bytes[ 2 ] << 8 | bytes[ 3 ];
+}
+
+/* Find an element in an icon family by walking its headers. Return its header
+ * and set its size, including the header; NULL if it isn't there.
+ */
+
+static const uint8_t * findElement( const uint8_t * icns, size_t size, uint32_t type, size_t * elementSize )
+{
+    for ( size_t offset = 8; offset + 8 <= size; offset += getBigEndian( icns + offset + 4 ) )
+    {
+        if ( getBigEndian( icns + offset + 4 ) < 8 ) return NULL;
+
+        if ( getBigEndian( icns + offset ) == type )
+        {
+            *elementSize = getBigEndian( icns + offset + 4 );
+            return icns + offset;
+        }
+    }
+
+    return NULL;
+}
+
+/* Check that a family's header gives its size and that its elements, in the
+ * given order, exactly fill it.
+ */
+
+static void checkLayout( const uint8_t * icns, size_t size, const uint32_t * types, size_t count )
+{
+    size_t offset = 8;
+
+    CHECK_EQUAL( getBigEndian( icns     ), FOUR_CC( 'i', 'c', 'n', 's' ) );
+    CHECK_EQUAL( getBigEndian( icns + 4 ), size                          );
+
+    for ( size_t i = 0; i < count && offset + 8 <= size; i ++ )
+    {
+        CHECK_EQUAL( getBigEndian( icns + offset ), types[ i ] );
+        offset += getBigEndian( icns + offset + 4 );
+    }
+
+    CHECK_EQUAL( offset, size );
+}
+
+/******************************************************************************\
+ * Apple's own packing
+\******************************************************************************/
+
+static void testSparkle( void )
+{
+    FILE    * file = fopen( SPARKLE_ICNS, "rb" );
+    uint8_t * icns = malloc( 65536 );
+    size_t    size = file ? fread( icns, 1, 65536, file ) : 0;
+
+    if ( file ) fclose( file );
+
+    CHECK_EQUAL( size, 50219 );
+
+    static const struct { uint32_t image, mask; size_t width; } sizes[] =
+    {
+        { FOUR_CC( 'i', 't', '3', '2' ), FOUR_CC( 't', '8', 'm', 'k' ), 128 },
+        { FOUR_CC( 'i', 'l', '3', '2' ), FOUR_CC( 'l', '8', 'm', 'k' ), 32  },
+        { FOUR_CC( 'i', 's', '3', '2' ), FOUR_CC( 's', '8', 'm', 'k' ), 16  }
+    };
+
+    for ( size_t item = 0; item < sizeof( sizes ) / sizeof( sizes[ 0 ] ); item ++ )
+    {
+        size_t    width  = sizes[ item ].width;
+        uint8_t * pixels = calloc( width * width, 4 );
+
+        CHECK( icnsRead( icns, size, sizes[ item ].image, IcnsEncodingRLE,  width, pixels ) );
+        CHECK( icnsRead( icns, size, sizes[ item ].mask,  IcnsEncodingMask, width, pixels ) );
+
+        IcnsElement elements[] =
+        {
+            { sizes[ item ].image, IcnsEncodingRLE,  pixels, width, NULL, 0 },
+            { sizes[ item ].mask,  IcnsEncodingMask, pixels, width, NULL, 0 }
+        };
+
+        size_t    writtenSize = icnsSize( elements, 2 );
+        uint8_t * written     = malloc( writtenSize );
+
+        CHECK_EQUAL( icnsWrite( elements, 2, written, writtenSize ), writtenSize );
+        checkLayout( written, writtenSize, ( uint32_t[] ) { sizes[ item ].image, sizes[ item ].mask }, 2 );
+
+        for ( size_t element = 0; element < 2; element ++ )
+        {
+            uint32_t        type = element ? sizes[ item ].mask : sizes[ item ].image;
+            size_t          appleSize = 0, ourSize = 0;
+            const uint8_t * apple     = findElement( icns,    size,        type, &appleSize );
+            const uint8_t * ours      = findElement( written, writtenSize, type, &ourSize   );
+
+            CHECK( apple != NULL && ours != NULL );
+            CHECK_EQUAL( ourSize, appleSize );
+
+            if ( apple && ours && ourSize == appleSize ) CHECK( memcmp( apple, ours, ourSize ) == 0 );
+        }
+
+        /* 'it32' alone has four zero bytes before its packed planes */
+
+        size_t          it32Size;
+        const uint8_t * it32 = findElement( written, writtenSize, FOUR_CC( 'i', 't', '3', '2' ), &it32Size );
+
+        if ( it32 ) CHECK_EQUAL( getBigEndian( it32 + 8 ), 0 );
+
+        free( written );
+        free( pixels  );
+    }
+
+    free( icns );
+}
+
+/******************************************************************************\
+ * Round trips and damage
+\******************************************************************************/
+
+/* Long runs longer than one packed chunk, short runs, literals longer than
+ * one chunk and single repeats, in every channel, with a varying mask.
+ */
+
+static void fillAwkward( uint8_t * pixels, size_t width, unsigned int seed )
+{
+    for ( size_t i = 0; i < width * width; i ++ )
+    {
+        uint8_t * pixel = pixels + i * 4;
+        size_t    x     = i % width;
+
+        pixel[ 0 ] = ( uint8_t ) ( i / 300 );
+        pixel[ 1 ] = x < width / 2 ? 200 : ( uint8_t ) rand_r( &seed );
+        pixel[ 2 ] = ( uint8_t ) ( i / 3 );
+        pixel[ 3 ] = ( uint8_t ) ( i % 7 < 2 ? 9 : i );
+    }
+}
+
+static void testRoundTrip( void )
+{
+    static const uint32_t types[] =
+    {
+        FOUR_CC( 'i', 't', '3', '2' ), FOUR_CC( 't', '8', 'm', 'k' ),
+        FOUR_CC( 'i', 'l', '3', '2' ), FOUR_CC( 'l', '8', 'm', 'k' )
+    };
+
+    uint8_t * large = malloc( 128 * 128 * 4 );
+    uint8_t * small = malloc( 32  * 32  * 4 );
+
+    fillAwkward( large, 128, 1 );
+    fillAwkward( small, 32,  2 );
+
+    IcnsElement elements[] =
+    {
+        { types[ 0 ], IcnsEncodingRLE,  large, 128, NULL, 0 },
+        { types[ 1 ], IcnsEncodingMask, large, 128, NULL, 0 },
+        { types[ 2 ], IcnsEncodingRLE,  small, 32,  NULL, 0 },
+        { types[ 3 ], IcnsEncodingMask, small, 32,  NULL, 0 }
+    };
+
+    size_t    size = icnsSize( elements, 4 );
+    uint8_t * icns = malloc( size );
+
+    CHECK_EQUAL( icnsWrite( elements, 4, icns, size - 1 ), 0    );
+    CHECK_EQUAL( icnsWrite( elements, 4, icns, size     ), size );
+
+    checkLayout( icns, size, types, 4 );
+
+    uint8_t * read = malloc( 128 * 128 * 4 );
+
+    memset( read, 0, 128 * 128 * 4 );
+    CHECK( icnsRead( icns, size, types[ 0 ], IcnsEncodingRLE,  128, read ) );
+    CHECK( icnsRead( icns, size, types[ 1 ], IcnsEncodingMask, 128, read ) );
+    CHECK( memcmp( read, large, 128 * 128 * 4 ) == 0 );
+
+    memset( read, 0, 32 * 32 * 4 );
+    CHECK( icnsRead( icns, size, types[ 2 ], IcnsEncodingRLE,  32, read ) );
+    CHECK( read[ 0 ] == 255 );
+    CHECK( icnsRead( icns, size, types[ 3 ], IcnsEncodingMask, 32, read ) );
+    CHECK( memcmp( read, small, 32 * 32 * 4 ) == 0 );
+
+    /* Missing, mismatched, truncated and damaged elements */
+
+    size_t          it32Size;
+    uint8_t       * it32 = ( uint8_t * ) findElement( icns, size, types[ 0 ], &it32Size );
+
+    CHECK( ! icnsRead( icns, size, FOUR_CC( 'i', 's', '3', '2' ), IcnsEncodingRLE,  16,  read ) );
+    CHECK( ! icnsRead( icns, size, types[ 1 ],                    IcnsEncodingMask, 64,  read ) );
+    CHECK( ! icnsRead( icns, size - 1, types[ 0 ],                IcnsEncodingRLE,  128, read ) );
+
+    it32[ 7 ] --;
+    CHECK( ! icnsRead( icns, size, types[ 0 ], IcnsEncodingRLE, 128, read ) );
+
+    free( read  );
+    free( icns  );
+    free( small );
+    free( large );
+}
+
+/******************************************************************************\
+ * Large elements as PNG
+\******************************************************************************/
+
+static uint8_t paeth( int a, int b, int c )
+{
+    int p = a + b - c, pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+
+    return ( uint8_t ) ( pa <= pb && pa <= pc ? a : pb <= pc ? b : c );
+}
+
+/* Decode a PNG file as written by pngEncode() - 8-bit RGBA, not interlaced -
+ * checking its structure and CRCs on the way. Return malloc'd R, G, B, A
+ * pixels, or NULL if anything is wrong.
+ */
+
+static uint8_t * decodePng( const uint8_t * png, size_t size, size_t width )
+{
+    static const uint8_t signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+    size_t    rowSize    = width * 4 + 1;
+    uint8_t * compressed = malloc( size );
+    uint8_t * filtered   = malloc( rowSize * width );
+    size_t    idatSize   = 0;
+    bool      valid      = size >= 8 && memcmp( png, signature, 8 ) == 0;
+    bool      header     = false, end = false;
+
+    for ( size_t offset = 8; valid && offset + 12 <= size && ! end; )
+    {
+        size_t          length = getBigEndian( png + offset );
+        const uint8_t * type   = png + offset + 4;
+        const uint8_t * data   = type + 4;
+
+        if ( length > size - offset - 12 ||
+             crc32( crc32( 0, NULL, 0 ), type, ( uInt ) length + 4 ) != getBigEndian( data + length ) )
+        {
+            valid = false;
+            break;
+        }
+
+        if ( memcmp( type, "IHDR", 4 ) == 0 )
+        {
+            header = length == 13 && getBigEndian( data ) == width && getBigEndian( data + 4 ) == width &&
+                     data[ 8 ] == 8 && data[ 9 ] == 6 && data[ 12 ] == 0;
+        }
+        else if ( memcmp( type, "IDAT", 4 ) == 0 )
+        {
+            memcpy( compressed + idatSize, data, length );
+            idatSize += length;
+        }
+        else if ( memcmp( type, "IEND", 4 ) == 0 )
+        {
+            end = offset + 12 == size;
+        }
+
+        offset += length + 12;
+    }
+
+    uLongf inflated = ( uLongf ) ( rowSize * width );
+
+    if ( ! valid || ! header || ! end ||
+         uncompress( filtered, &inflated, compressed, ( uLong ) idatSize ) != Z_OK ||
+         inflated != rowSize * width )
+    {
+        free( compressed );
+        free( filtered   );
+        return NULL;
+    }
+
+    uint8_t * rgba = malloc( width * width * 4 );
+
+    for ( size_t y = 0; y < width; y ++ )
+    {
+        const uint8_t * in    = filtered + y * rowSize + 1;
+        uint8_t       * out   = rgba + y * width * 4;
+        const uint8_t * above = y ? out - width * 4 : NULL;
+
+        for ( size_t x = 0; x < width * 4; x ++ )
+        {
+            int a = x >= 4 ? out  [ x - 4 ] : 0;
+            int b = above  ? above[ x     ] : 0;
+            int c = x >= 4 && above ? above[ x - 4 ] : 0;
+
+            switch ( filtered[ y * rowSize ] )
+            {
+                case 0:  out[ x ] = in[ x ];                                  break;
+                case 1:  out[ x ] = ( uint8_t ) ( in[ x ] + a );              break;
+                case 2:  out[ x ] = ( uint8_t ) ( in[ x ] + b );              break;
+                case 3:  out[ x ] = ( uint8_t ) ( in[ x ] + ( a + b ) / 2 );  break;
+                default: out[ x ] = ( uint8_t ) ( in[ x ] + paeth( a, b, c ) ); break;
+            }
+        }
+    }
+
+    free( compressed );
+    free( filtered   );
+
+    return rgba;
+}
+
+/* Premultiplied A, R, G, B pixels: opaque gradients, a transparent hole and
+ * a translucent band.
+ */
+
+static void fillLarge( uint8_t * pixels, size_t width )
+{
+    for ( size_t y = 0; y < width; y ++ )
+    {
+        for ( size_t x = 0; x < width; x ++ )
+        {
+            uint8_t * pixel = pixels + ( y * width + x ) * 4;
+            bool      hole  = x > width / 4 && x < width / 2 && y > width / 4 && y < width / 2;
+            size_t    alpha = hole ? 0 : y > width * 3 / 4 ? 40 + x % 200 : 255;
+
+            pixel[ 0 ] = ( uint8_t ) alpha;
+            pixel[ 1 ] = ( uint8_t ) ( x * 255 / width * alpha / 255 );
+            pixel[ 2 ] = ( uint8_t ) ( y * 255 / width * alpha / 255 );
+            pixel[ 3 ] = ( uint8_t ) ( ( x ^ y ) & 0xf0 ) * alpha / 255;
+        }
+    }
+}
+
+static void testLargeElements( void )
+{
+    static const uint32_t types [] = { FOUR_CC( 'i', 'c', '0', '9' ), FOUR_CC( 'i', 'c', '0', '8' ),
+                                       FOUR_CC( 'i', 't', '3', '2' ), FOUR_CC( 't', '8', 'm', 'k' ) };
+    static const size_t   widths[] = { 512, 256 };
+
+    uint8_t   * pixels[ 2 ];
+    uint8_t   * pngs  [ 2 ];
+    size_t      sizes [ 2 ];
+    IcnsElement elements[ 4 ];
+
+    for ( size_t i = 0; i < 2; i ++ )
+    {
+        pixels[ i ] = malloc( widths[ i ] * widths[ i ] * 4 );
+        fillLarge( pixels[ i ], widths[ i ] );
+
+        pngs[ i ] = pngEncode( pixels[ i ], widths[ i ], widths[ i ], widths[ i ] * 4, 1, &sizes[ i ] );
+        CHECK( pngs[ i ] != NULL );
+
+        elements[ i ] = ( IcnsElement ) { types[ i ], IcnsEncodingPNG, pixels[ i ], widths[ i ], pngs[ i ], sizes[ i ] };
+    }
+
+    uint8_t * medium = malloc( 128 * 128 * 4 );
+
+    fillLarge( medium, 128 );
+
+    elements[ 2 ] = ( IcnsElement ) { types[ 2 ], IcnsEncodingRLE,  medium, 128, NULL, 0 };
+    elements[ 3 ] = ( IcnsElement ) { types[ 3 ], IcnsEncodingMask, medium, 128, NULL, 0 };
+
+    size_t    size = icnsSize( elements, 4 );
+    uint8_t * icns = malloc( size );
+
+    CHECK_EQUAL( icnsWrite( elements, 4, icns, size ), size );
+    checkLayout( icns, size, types, 4 );
+
+    for ( size_t i = 0; i < 2; i ++ )
+    {
+        size_t          elementSize = 0;
+        const uint8_t * element     = findElement( icns, size, types[ i ], &elementSize );
+        size_t          width       = widths[ i ];
+
+        CHECK( element != NULL );
+        CHECK_EQUAL( elementSize, sizes[ i ] + 8 );
+        CHECK( sizes[ i ] < width * width );
+
+        if ( element == NULL || elementSize != sizes[ i ] + 8 ) continue;
+
+        CHECK( memcmp( element + 8, pngs[ i ], sizes[ i ] ) == 0 );
+
+        /* Straight alpha in the PNG, which premultiplied again must give
+         * back the source to within rounding.
+         */
+
+        uint8_t * rgba  = decodePng( element + 8, sizes[ i ], width );
+        size_t    worst = 0;
+
+        CHECK( rgba != NULL );
+        if ( rgba == NULL ) continue;
+
+        for ( size_t p = 0; p < width * width; p ++ )
+        {
+            const uint8_t * source = pixels[ i ] + p * 4;
+            const uint8_t * png    = rgba        + p * 4;
+
+            if ( png[ 3 ] != source[ 0 ] ) worst = 255;
+
+            for ( size_t c = 0; c < 3; c ++ )
+            {
+                size_t again      = ( png[ c ] * png[ 3 ] + 127 ) / 255;
+                size_t difference = again > source[ c + 1 ] ? again - source[ c + 1 ] : source[ c + 1 ] - again;
+
+                if ( difference > worst ) worst = difference;
+            }
+        }
+
+        CHECK( worst <= 1 );
+        free( rgba );
+    }
+
+    CHECK( ! icnsRead( icns, size, types[ 0 ], IcnsEncodingPNG, 512, pixels[ 0 ] ) );
+
+    free( icns   );
+    free( medium );
+
+    for ( size_t i = 0; i < 2; i ++ )
+    {
+        free( pixels[ i ] );
+        free( pngs  [ i ] );
+    }
+}
+
+int main( void )
+{
+    testSparkle();
+    testRoundTrip();
+    testLargeElements();
+
+    return testFinish( "IcnsWriterTests" );
+}
@@ -0,0 +1,263 @@
+/******************************************************************************\
+ * Tests: IconPyramidBenchmark.c
+ *
+ * Time to make every smaller size of a 512x512 icon, 256x256 down to 16x16,
+ * by halving with "IconPyramid.h" - splitting out the separate colour and mask
+ * planes of the old-style 128, 32 and 16 sizes as it goes - in microseconds
+ * per icon. On macOS, the same sizes are also made the way the icon writer
+ * used to, drawing the full size image into a fresh bitmap context with
+ * CoreGraphics for each size and again for each mask, and the two results are
+ * compared. This is built once for each set of kernels, so compare the
+ * "IconPyramidBenchmark" and "...Scalar" executables' figures.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "IconPyramid.h"
+
+#ifdef __APPLE__
+    #include <CoreGraphics/CoreGraphics.h>
+#endif
+
+#define SIZE   512
+#define LEVELS 5 /* 256, 128, 64, 32 and 16 */
+
+/* A smooth, partly transparent picture with some hard edges in it, as icons
+ * have, premultiplied.
+ */
+
+static void fillIcon( uint8_t * pixels )
+{
+    unsigned int seed = 1;
+
+    for ( size_t y = 0; y < SIZE; y ++ )
+    {
+        for ( size_t x = 0; x < SIZE; x ++ )
+        {
+            uint8_t * pixel = pixels + ( y * SIZE + x ) * 4;
+            bool      inset = x > 40 && x < SIZE - 40 && y > 60 && y < SIZE - 30;
+            uint8_t   alpha = inset ? 255 : ( uint8_t ) ( ( x + y ) / 4 );
+
+            pixel[ 0 ] = alpha;
+            pixel[ 1 ] = ( uint8_t ) ( ( x * alpha ) / SIZE );
+            pixel[ 2 ] = ( uint8_t ) ( ( y * alpha ) / SIZE );
+            pixel[ 3 ] = ( uint8_t ) ( rand_r( &seed ) % ( alpha + 1 ) );
+        }
+    }
+}
+
+/******************************************************************************\
+ * makePyramid()
+ *
+ * Make every level below the source, as the icon writer does.
+ *
+ * In:  512x512 source pixels;
+ *
+ *      Array of LEVELS pointers, each to space for a level's pixels;
+ *
+ *      Colour and mask planes for levels 1 to 4 (128x128 down to 16x16).
+ *
+ * Out: true if every level was made.
+\******************************************************************************/
+
+static bool makePyramid( const uint8_t * source, uint8_t ** levels, uint8_t ** colours, uint8_t ** masks )
+{
+    size_t size = SIZE;
+
+    for ( size_t level = 0; level < LEVELS; level ++, size /= 2 )
+    {
+        bool split = level > 0;
+
+        if ( ! iconPyramidHalve( source, size, size, size * 4, levels[ level ], size * 2,
+                                 split ? colours[ level ] : NULL,
+                                 split ? masks  [ level ] : NULL ) ) return false;
+
+        source = levels[ level ];
+    }
+
+    return true;
+}
+
+#ifdef __APPLE__
+
+    /* Draw the full size image into a new context of the given size and
+     * format, as the icon writer used to for each size.
+     */
+
+    static void drawSize( CGImageRef image, CGColorSpaceRef space, size_t size, bool mask, uint8_t * into )
+    {
+        size_t           pixelSize = mask ? 1 : 4;
+        CGImageAlphaInfo info      = mask ? kCGImageAlphaOnly
+                                          : size >= 256 ? kCGImageAlphaPremultipliedFirst
+                                                        : kCGImageAlphaNoneSkipFirst;
+        uint8_t        * buffer    = calloc( size * size, pixelSize );
+        CGContextRef     context   = CGBitmapContextCreate( buffer, size, size, 8, size * pixelSize, mask ? NULL : space, info );
+
+        CGContextDrawImage( context, CGRectMake( 0, 0, size, size ), image );
+        CGContextRelease( context );
+
+        if ( into ) memcpy( into, buffer, size * size * pixelSize );
+        free( buffer );
+
+        /* The unused alpha bytes of the old-style colour sizes may hold
+         * anything; make them match the pyramid's colour plane.
+         */
+
+        if ( into && info == kCGImageAlphaNoneSkipFirst )
+        {
+            for ( size_t pixel = 0; pixel < size * size; pixel ++ ) into[ pixel * 4 ] = 255;
+        }
+    }
+
+    static void drawSizes( CGImageRef image, CGColorSpaceRef space, uint8_t ** levels, uint8_t ** masks )
+    {
+        size_t size = SIZE / 2;
+
+        for ( size_t level = 0; level < LEVELS; level ++, size /= 2 )
+        {
+            if ( size == 64 ) continue; /* Not an icon size */
+
+            drawSize( image, space, size, false, levels ? levels[ level ] : NULL );
+            if ( size < 256 ) drawSize( image, space, size, true, masks ? masks[ level ] : NULL );
+        }
+    }
+
+    /* Out: Mean and largest difference between two planes of bytes */
+
+    static unsigned int difference( const uint8_t * first, const uint8_t * second, size_t count, double * mean )
+    {
+        unsigned int largest = 0;
+        double       total   = 0;
+
+        for ( size_t index = 0; index < count; index ++ )
+        {
+            unsigned int delta = first[ index ] > second[ index ] ? first[ index ] - second[ index ]
+                                                                  : second[ index ] - first[ index ];
+
+            total += delta;
+            if ( delta > largest ) largest = delta;
+        }
+
+        *mean = total / ( double ) count;
+        return largest;
+    }
+
+    static void compareWithCoreGraphics( uint8_t      * pixels,
+                                         uint8_t     ** levels,
+                                         uint8_t     ** colours,
+                                         uint8_t     ** masks,
+                                         unsigned int   rounds )
+    {
+        CGColorSpaceRef space    = CGColorSpaceCreateDeviceRGB();
+        CGContextRef    context  = CGBitmapContextCreate( pixels, SIZE, SIZE, 8, SIZE * 4, space, kCGImageAlphaPremultipliedFirst );
+        CGImageRef      image    = CGBitmapContextCreateImage( context );
+        uint8_t       * drawn[ LEVELS ];
+        uint8_t       * drawnMasks[ LEVELS ];
+        size_t          size     = SIZE / 2;
+        double          started  = testSeconds();
+
+        for ( unsigned int round = 0; round < rounds; round ++ ) drawSizes( image, space, NULL, NULL );
+
+        printf( "%-30s %9.1fus per icon\n", "CoreGraphics, each size", ( testSeconds() - started ) / rounds * 1e6 );
+
+        for ( size_t level = 0; level < LEVELS; level ++, size /= 2 )
+        {
+            drawn     [ level ] = calloc( size * size, 4 );
+            drawnMasks[ level ] = calloc( size * size, 1 );
+        }
+
+        drawSizes( image, space, drawn, drawnMasks );
+
+        size = SIZE / 2;
+
+        for ( size_t level = 0; level < LEVELS; level ++, size /= 2 )
+        {
+            double       mean;
+            unsigned int largest;
+
+            if ( size == 64 ) continue;
+
+            largest = difference( size < 256 ? colours[ level ] : levels[ level ], drawn[ level ], size * size * 4, &mean );
+            printf( "%3zux%-3zu against CoreGraphics: mean difference %.2f, largest %u\n", size, size, mean, largest );
+
+            if ( size < 256 )
+            {
+                largest = difference( masks[ level ], drawnMasks[ level ], size * size, &mean );
+                printf( "%3zux%-3zu mask:                 mean difference %.2f, largest %u\n", size, size, mean, largest );
+            }
+        }
+
+        for ( size_t level = 0; level < LEVELS; level ++ )
+        {
+            free( drawn     [ level ] );
+            free( drawnMasks[ level ] );
+        }
+
+        CGImageRelease     ( image   );
+        CGContextRelease   ( context );
+        CGColorSpaceRelease( space   );
+    }
+
+#endif
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    unsigned int rounds  = quick ? 10 : 2000;
+    uint8_t    * pixels  = malloc( SIZE * SIZE * 4 );
+    uint8_t    * levels [ LEVELS ] = { NULL };
+    uint8_t    * colours[ LEVELS ] = { NULL };
+    uint8_t    * masks  [ LEVELS ] = { NULL };
+    bool         ok      = pixels != NULL;
+    size_t       size    = SIZE / 2;
+    double       started;
+
+    for ( size_t level = 0; level < LEVELS; level ++, size /= 2 )
+    {
+        levels [ level ] = malloc( size * size * 4 );
+        colours[ level ] = malloc( size * size * 4 );
+        masks  [ level ] = malloc( size * size     );
+
+        ok = ok && levels[ level ] && colours[ level ] && masks[ level ];
+    }
+
+    if ( ! ok )
+    {
+        fprintf( stderr, "Out of memory\n" );
+        return EXIT_FAILURE;
+    }
+
+    fillIcon( pixels );
+
+    printf( "Kernels: %s, %ux%u down to 16x16\n\n", iconPyramidKernels(), SIZE, SIZE );
+
+    started = testSeconds();
+
+    for ( unsigned int round = 0; round < rounds; round ++ )
+    {
+        if ( ! makePyramid( pixels, levels, colours, masks ) )
+        {
+            fprintf( stderr, "Out of memory\n" );
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf( "%-30s %9.1fus per icon\n", "Pyramid", ( testSeconds() - started ) / rounds * 1e6 );
+
+    #ifdef __APPLE__
+        compareWithCoreGraphics( pixels, levels, colours, masks, rounds );
+    #endif
+
+    for ( size_t level = 0; level < LEVELS; level ++ )
+    {
+        free( levels [ level ] );
+        free( colours[ level ] );
+        free( masks  [ level ] );
+    }
+
+    free( pixels );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,270 @@
+/******************************************************************************\
+ * Tests: IconPyramidTests.c
+ *
+ * Tests for "IconPyramid.h". A small image is halved and checked against
+ * output worked out by hand from the [1 3 3 1] / 8 filter, including at the
+ * edges, where edge pixels repeat. Then images of many sizes, square or not
+ * and with odd halved dimensions, are checked against a plain reference
+ * implementation of the filter, which must match exactly; row padding must be
+ * ignored and left alone; and the colour and mask planes must split out the
+ * halved image's colour and alpha. This is built once with the compiler's
+ * default kernels and once in plain C, so both are held to the same output.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "IconPyramid.h"
+
+#define PADDING 12 /* Spare bytes at the end of padded rows */
+
+/* Premultiplied noise, so colour channels never exceed alpha */
+
+static void fillNoise( uint8_t * pixels, size_t width, size_t height, size_t rowBytes, unsigned int seed )
+{
+    for ( size_t y = 0; y < height; y ++ )
+    {
+        uint8_t * row = pixels + y * rowBytes;
+
+        for ( size_t x = 0; x < width; x ++ )
+        {
+            uint8_t alpha = ( uint8_t ) rand_r( &seed );
+
+            row[ x * 4 ] = alpha;
+            for ( int channel = 1; channel < 4; channel ++ ) row[ x * 4 + channel ] = ( uint8_t ) ( rand_r( &seed ) % ( alpha + 1 ) );
+        }
+    }
+}
+
+/******************************************************************************\
+ * reference()
+ *
+ * The filter written out directly: each destination channel is the sum of
+ * source channels weighted by the product of their [1 3 3 1] taps across and
+ * down, clamped to the edges, divided by 64 and rounded.
+\******************************************************************************/
+
+static size_t clamp( long value, size_t size )
+{
+    return value < 0 ? 0 : value >= ( long ) size ? size - 1 : ( size_t ) value;
+}
+
+static void reference( const uint8_t * source,
+                       size_t          sourceWidth,
+                       size_t          sourceHeight,
+                       size_t          sourceRowBytes,
+                       uint8_t       * destination )
+{
+    static const unsigned int taps[ 4 ] = { 1, 3, 3, 1 };
+
+    size_t width  = sourceWidth  / 2;
+    size_t height = sourceHeight / 2;
+
+    for ( size_t y = 0; y < height; y ++ )
+    {
+        for ( size_t x = 0; x < width; x ++ )
+        {
+            for ( size_t channel = 0; channel < 4; channel ++ )
+            {
+                unsigned int sum = 0;
+
+                for ( int j = 0; j < 4; j ++ )
+                {
+                    size_t          sy  = clamp( ( long ) ( y * 2 ) - 1 + j, sourceHeight );
+                    const uint8_t * row = source + sy * sourceRowBytes;
+
+                    for ( int i = 0; i < 4; i ++ )
+                    {
+                        size_t sx = clamp( ( long ) ( x * 2 ) - 1 + i, sourceWidth );
+
+                        sum += taps[ i ] * taps[ j ] * row[ sx * 4 + channel ];
+                    }
+                }
+
+                destination[ ( y * width + x ) * 4 + channel ] = ( uint8_t ) ( ( sum + 32 ) / 64 );
+            }
+        }
+    }
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+/* A single pixel of ( 64, 64, 32, 0 ) at ( 1, 1 ) in a 4x4 image. Across
+ * and down, destination 0 takes source 0 four times (once for itself and once
+ * repeated beyond the edge), 1 three times and 2 once; destination 1 takes
+ * source 1 once, 2 three times and 3 four times. So destination ( 0, 0 ) gets
+ * 9/64 of the pixel, ( 1, 0 ) and ( 0, 1 ) 3/64 and ( 1, 1 ) 1/64, rounded
+ * half up: 64 becomes 9, 3 and 1; 32 becomes 5, 2 and 1.
+ */
+
+static void testImpulse( void )
+{
+    uint8_t source[ 4 * 4 * 4 ] = { 0 };
+    uint8_t halved[ 2 * 2 * 4 ];
+
+    static const uint8_t expected[ 2 * 2 * 4 ] =
+    {
+        9, 9, 5, 0,    3, 3, 2, 0,
+        3, 3, 2, 0,    1, 1, 1, 0
+    };
+
+    source[ ( 1 * 4 + 1 ) * 4 + 0 ] = 64;
+    source[ ( 1 * 4 + 1 ) * 4 + 1 ] = 64;
+    source[ ( 1 * 4 + 1 ) * 4 + 2 ] = 32;
+
+    CHECK( iconPyramidHalve( source, 4, 4, 4 * 4, halved, 2 * 4, NULL, NULL ) );
+    CHECK( memcmp( halved, expected, sizeof( expected ) ) == 0 );
+}
+
+/* A 4x2 ramp of 0, 64, 128 and 255 in every channel. With only two rows, both
+ * repeat beyond the edges, so each column's vertical sum is eight times its
+ * value. Across, destination 0 is ( 4 * 0 + 3 * 64 + 128 ) / 8 = 40 and
+ * destination 1 is ( 64 + 3 * 128 + 4 * 255 ) / 8 = 183.5, rounding to 184.
+ */
+
+static void testEdges( void )
+{
+    static const uint8_t ramp[ 4 ] = { 0, 64, 128, 255 };
+
+    uint8_t source[ 4 * 2 * 4 ];
+    uint8_t halved[ 2 * 4 ];
+
+    for ( size_t pixel = 0; pixel < 8; pixel ++ ) memset( source + pixel * 4, ramp[ pixel % 4 ], 4 );
+
+    CHECK( iconPyramidHalve( source, 4, 2, 4 * 4, halved, 2 * 4, NULL, NULL ) );
+
+    for ( size_t channel = 0; channel < 4; channel ++ )
+    {
+        CHECK_EQUAL( halved[ channel     ], 40  );
+        CHECK_EQUAL( halved[ channel + 4 ], 184 );
+    }
+
+    /* Anything flat stays flat, right up to the edges */
+
+    memset( source, 200, sizeof( source ) );
+
+    CHECK( iconPyramidHalve( source, 4, 2, 4 * 4, halved, 2 * 4, NULL, NULL ) );
+
+    for ( size_t index = 0; index < sizeof( halved ); index ++ ) CHECK_EQUAL( halved[ index ], 200 );
+}
+
+/* Noise at many sizes, against the reference, with padded rows on both
+ * sides; the padding must be left as it was.
+ */
+
+static void testSizes( void )
+{
+    static const size_t sizes[][ 2 ] =
+    {
+        { 2,   2   }, { 4,   2   }, { 2,   4   }, { 6,   6   }, { 10,  2   },
+        { 2,   10  }, { 6,   4   }, { 14,  22  }, { 18,  6   }, { 34,  10  },
+        { 30,  30  }, { 64,  64  }, { 66,  34  }, { 130, 18  }, { 512, 512 }
+    };
+
+    for ( size_t item = 0; item < sizeof( sizes ) / sizeof( sizes[ 0 ] ); item ++ )
+    {
+        size_t    sourceWidth    = sizes[ item ][ 0 ];
+        size_t    sourceHeight   = sizes[ item ][ 1 ];
+        size_t    width          = sourceWidth  / 2;
+        size_t    height         = sourceHeight / 2;
+        size_t    sourceRowBytes = sourceWidth * 4 + PADDING;
+        size_t    rowBytes       = width       * 4 + PADDING;
+        uint8_t * source         = malloc( sourceRowBytes * sourceHeight );
+        uint8_t * halved         = malloc( rowBytes * height );
+        uint8_t * expected       = malloc( width * height * 4 );
+        size_t    wrong          = 0;
+        size_t    padding        = 0;
+
+        if ( source == NULL || halved == NULL || expected == NULL )
+        {
+            CHECK( false );
+            free( source ); free( halved ); free( expected );
+            continue;
+        }
+
+        fillNoise( source, sourceWidth, sourceHeight, sourceRowBytes, ( unsigned int ) item + 1 );
+        memset( halved, 0xA5, rowBytes * height );
+
+        reference( source, sourceWidth, sourceHeight, sourceRowBytes, expected );
+        CHECK( iconPyramidHalve( source, sourceWidth, sourceHeight, sourceRowBytes, halved, rowBytes, NULL, NULL ) );
+
+        for ( size_t y = 0; y < height; y ++ )
+        {
+            const uint8_t * row = halved + y * rowBytes;
+
+            if ( memcmp( row, expected + y * width * 4, width * 4 ) != 0 ) wrong ++;
+
+            for ( size_t index = width * 4; index < rowBytes; index ++ ) if ( row[ index ] != 0xA5 ) padding ++;
+        }
+
+        if ( wrong ) fprintf( stderr, "%zux%zu: %zu rows differ from the reference\n", sourceWidth, sourceHeight, wrong );
+
+        CHECK_EQUAL( wrong,   0 );
+        CHECK_EQUAL( padding, 0 );
+
+        free( source   );
+        free( halved   );
+        free( expected );
+    }
+}
+
+/* The split planes against the halved image, with and without a destination */
+
+static void testPlanes( void )
+{
+    enum { SOURCE_WIDTH = 36, SOURCE_HEIGHT = 20, WIDTH = 18, HEIGHT = 10 };
+
+    static uint8_t source[ SOURCE_WIDTH * SOURCE_HEIGHT * 4 ];
+    static uint8_t halved[ WIDTH * HEIGHT * 4 ];
+    static uint8_t colour[ WIDTH * HEIGHT * 4 ];
+    static uint8_t mask  [ WIDTH * HEIGHT     ];
+    static uint8_t colourOnly[ WIDTH * HEIGHT * 4 ];
+    static uint8_t maskOnly  [ WIDTH * HEIGHT     ];
+
+    size_t wrongColour = 0;
+    size_t wrongMask   = 0;
+
+    fillNoise( source, SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * 4, 99 );
+
+    CHECK( iconPyramidHalve( source, SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * 4, halved, WIDTH * 4, colour, mask ) );
+
+    for ( size_t pixel = 0; pixel < WIDTH * HEIGHT; pixel ++ )
+    {
+        if ( colour[ pixel * 4 ] != 255 ||
+             memcmp( colour + pixel * 4 + 1, halved + pixel * 4 + 1, 3 ) != 0 ) wrongColour ++;
+
+        if ( mask[ pixel ] != halved[ pixel * 4 ] ) wrongMask ++;
+    }
+
+    CHECK_EQUAL( wrongColour, 0 );
+    CHECK_EQUAL( wrongMask,   0 );
+
+    /* Just the planes, and just one plane at a time */
+
+    CHECK( iconPyramidHalve( source, SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * 4, NULL, 0, colourOnly, maskOnly ) );
+    CHECK( memcmp( colourOnly, colour, sizeof( colour ) ) == 0 );
+    CHECK( memcmp( maskOnly,   mask,   sizeof( mask   ) ) == 0 );
+
+    memset( colourOnly, 0, sizeof( colourOnly ) );
+    memset( maskOnly,   0, sizeof( maskOnly   ) );
+
+    CHECK( iconPyramidHalve( source, SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * 4, NULL, 0, colourOnly, NULL ) );
+    CHECK( iconPyramidHalve( source, SOURCE_WIDTH, SOURCE_HEIGHT, SOURCE_WIDTH * 4, NULL, 0, NULL, maskOnly ) );
+    CHECK( memcmp( colourOnly, colour, sizeof( colour ) ) == 0 );
+    CHECK( memcmp( maskOnly,   mask,   sizeof( mask   ) ) == 0 );
+}
+
+int main( void )
+{
+    printf( "Kernels: %s\n", iconPyramidKernels() );
+
+    testImpulse();
+    testEdges  ();
+    testSizes  ();
+    testPlanes ();
+
+    return testFinish( "IconPyramidTests" );
+}
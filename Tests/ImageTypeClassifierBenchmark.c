@@ -0,0 +1,122 @@
+/******************************************************************************\
+ * Tests: ImageTypeClassifierBenchmark.c
+ *
+ * Time "ImageTypeClassifier.h" against the per-file LaunchServices lookup it
+ * replaced: FSPathMakeRef(), the file's content type, then a conformance check
+ * against a fresh copy of ImageIO's type list. The LaunchServices side only
+ * exists on macOS; elsewhere the classifier is timed alone.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ImageTypeClassifier.h"
+
+#ifdef __APPLE__
+    #include <CoreServices/CoreServices.h>
+    #include <ImageIO/ImageIO.h>
+#endif
+
+/* A typical folder: mostly images, some other files, a few with no extension */
+
+static const char * const leafnames[] =
+{
+    "IMG_0001.JPG", "IMG_0002.jpg", "IMG_0003.HEIC", "scan.tiff",  "cover.png",
+    "notes.txt",    "track01.mp3",  "clip.mov",      "raw.CR3",    "Thumbs.db",
+    "README",       "icon",         "archive.zip",   "photo.webp", "a.b.c.gif",
+    "report.pdf"
+};
+
+#define LEAFNAMES ( sizeof( leafnames ) / sizeof( leafnames[ 0 ] ) )
+
+#ifdef __APPLE__
+
+    /* The old isImageFile(), less its Cocoa string handling */
+
+    static bool launchServicesIsImageFile( const char * fullPath )
+    {
+        FSRef     fileRef;
+        Boolean   isDirectory;
+        CFTypeRef uti    = NULL;
+        bool      result = false;
+
+        if ( FSPathMakeRef( ( const UInt8 * ) fullPath, &fileRef, &isDirectory ) != noErr ) return false;
+
+        ( void ) LSCopyItemAttribute( &fileRef, kLSRolesViewer, kLSItemContentType, &uti );
+        if ( uti == NULL ) return false;
+
+        CFArrayRef supportedTypes = CGImageSourceCopyTypeIdentifiers();
+        CFIndex    typeCount      = CFArrayGetCount( supportedTypes );
+
+        for ( CFIndex index = 0; index < typeCount && ! result; index ++ )
+        {
+            CFStringRef supportedUTI = CFArrayGetValueAtIndex( supportedTypes, index );
+
+            result = UTTypeConformsTo( supportedUTI, CFSTR( "public.image" ) ) &&
+                     UTTypeConformsTo( uti,          supportedUTI            );
+        }
+
+        CFRelease( supportedTypes );
+        CFRelease( uti            );
+
+        return result;
+    }
+
+#endif
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    unsigned int rounds  = quick ? 20 : 2000;
+    char       * scratch = testMakeDirectory( "ImageTypeClassifierBenchmark" );
+    char         paths[ LEAFNAMES ][ 4096 ];
+    size_t       images  = 0;
+
+    for ( size_t index = 0; index < LEAFNAMES; index ++ )
+    {
+        snprintf( paths[ index ], sizeof( paths[ index ] ), "%s/%s", scratch, leafnames[ index ] );
+        testWriteFile( paths[ index ], 64 );
+    }
+
+    imageTypeClassifierPrepare();
+
+    double started = testSeconds();
+
+    for ( unsigned int round = 0; round < rounds; round ++ )
+    {
+        for ( size_t index = 0; index < LEAFNAMES; index ++ )
+        {
+            images += imageTypeClassifierIsImageFile( paths[ index ], leafnames[ index ], true );
+        }
+    }
+
+    double classifier = ( testSeconds() - started ) / ( rounds * LEAFNAMES );
+
+    printf( "Classifier:      %8.3f us per file (%zu images)\n", classifier * 1e6, images / rounds );
+
+    #ifdef __APPLE__
+
+        images  = 0;
+        started = testSeconds();
+
+        for ( unsigned int round = 0; round < rounds; round ++ )
+        {
+            for ( size_t index = 0; index < LEAFNAMES; index ++ )
+            {
+                images += launchServicesIsImageFile( paths[ index ] );
+            }
+        }
+
+        double launchServices = ( testSeconds() - started ) / ( rounds * LEAFNAMES );
+
+        printf( "LaunchServices:  %8.3f us per file (%zu images), %.0fx slower\n",
+                launchServices * 1e6, images / rounds, launchServices / classifier );
+
+    #endif
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/******************************************************************************\
+ * Tests: ImageTypeClassifierTests.c
+ *
+ * Tests for "ImageTypeClassifier.h": classification by extension, sniffing of
+ * files with no extension (through symbolic links too) and package names.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ImageTypeClassifier.h"
+
+static const unsigned char pngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n', 0, 0, 0, 13 };
+
+/* Extensions are matched whatever their case; names with none are unknown */
+
+static void testNames( void )
+{
+    CHECK_EQUAL( imageTypeClassifyName( "photo.JPG"        ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyName( "photo.HeIc"       ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyName( "raw.cr3"          ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyName( "/a/b.png"         ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyName( "notes.txt"        ), imageTypeClassNo      );
+    CHECK_EQUAL( imageTypeClassifyName( "archive.tar.gz"   ), imageTypeClassNo      );
+    CHECK_EQUAL( imageTypeClassifyName( "trailing."        ), imageTypeClassNo      );
+    CHECK_EQUAL( imageTypeClassifyName( "noextension"      ), imageTypeClassUnknown );
+    CHECK_EQUAL( imageTypeClassifyName( ".hidden"          ), imageTypeClassUnknown );
+    CHECK_EQUAL( imageTypeClassifyName( "/a.d/noextension" ), imageTypeClassUnknown );
+}
+
+/* Files with no extension are sniffed only if asked, and a symbolic link to
+ * an image is an image.
+ */
+
+static void testSniffing( const char * scratch )
+{
+    char   image[ 4096 ], text[ 4096 ], link[ 4096 ];
+    FILE * file;
+
+    snprintf( image, sizeof( image ), "%s/image", scratch );
+    snprintf( text,  sizeof( text  ), "%s/text",  scratch );
+    snprintf( link,  sizeof( link  ), "%s/link",  scratch );
+
+    file = fopen( image, "wb" );
+    CHECK( file != NULL );
+    if ( file == NULL ) return;
+    fwrite( pngSignature, 1, sizeof( pngSignature ), file );
+    fclose( file );
+
+    CHECK( testWriteFile( text, 100 ) );
+    CHECK( symlink( image, link ) == 0 );
+
+    CHECK( imageTypeClassifierIsImageFile( image, NULL,   true  ) );
+    CHECK( imageTypeClassifierIsImageFile( image, "image", true ) );
+    CHECK( ! imageTypeClassifierIsImageFile( image, NULL, false ) );
+    CHECK( ! imageTypeClassifierIsImageFile( text,  NULL, true  ) );
+    CHECK( imageTypeClassifierIsImageFile( link,  NULL,   true  ) );
+
+    CHECK( imageTypeClassifierSniff( pngSignature, sizeof( pngSignature ) ) );
+    CHECK( ! imageTypeClassifierSniff( pngSignature, 4 ) );
+}
+
+/* A name only ever proves that a directory is a package; without an
+ * extension, the directory itself must be looked at.
+ */
+
+static void testPackages( const char * scratch )
+{
+    char plain[ 4096 ];
+
+    snprintf( plain, sizeof( plain ), "%s/Plain", scratch );
+    CHECK( mkdir( plain, 0755 ) == 0 );
+
+    CHECK_EQUAL( imageTypeClassifyPackageName( "Foo.app"           ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyPackageName( "Lib.PhotosLibrary" ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyPackageName( "Photos 2023.06"    ), imageTypeClassUnknown );
+    CHECK_EQUAL( imageTypeClassifyPackageName( "Plain"             ), imageTypeClassUnknown );
+
+    CHECK_EQUAL( imageTypeClassifyPackage( "/x/Foo.app",    NULL     ), imageTypeClassYes     );
+    CHECK_EQUAL( imageTypeClassifyPackage( "/x/Photos 2.1", NULL     ), imageTypeClassUnknown );
+    CHECK_EQUAL( imageTypeClassifyPackage( plain,           "Plain"  ), imageTypeClassNo      );
+}
+
+int main( void )
+{
+    char * scratch = testMakeDirectory( "ImageTypeClassifierTests" );
+
+    testNames   ();
+    testSniffing( scratch );
+    testPackages( scratch );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return testFinish( "ImageTypeClassifierTests" );
+}
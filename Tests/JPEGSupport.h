@@ -0,0 +1,82 @@
+/******************************************************************************\
+ * Tests: JPEGSupport.h
+ *
+ * Write synthetic JPEG files with libjpeg, for tests and benchmarks of the
+ * decoding utilities. Only usable where libjpeg is, so only included by code
+ * built with REDUCED_DECODE_LIBJPEG defined.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef JPEG_SUPPORT_H
+#define JPEG_SUPPORT_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <jpeglib.h>
+
+/******************************************************************************\
+ * jpegSupportWrite()
+ *
+ * Write an RGB JPEG of the given size, holding smooth gradients with a little
+ * fine detail, roughly as hard to compress as a photograph.
+ *
+ * In:  Full path of the file to write;
+ *
+ *      Width and height in pixels;
+ *
+ *      Quality, 1 to 100.
+ *
+ * Out: true if written.
+\******************************************************************************/
+
+static inline bool jpegSupportWrite( const char * path, uint32_t width, uint32_t height, int quality )
+{
+    struct jpeg_compress_struct   info;
+    struct jpeg_error_mgr         errors;
+    FILE                        * file = fopen( path, "wb" );
+    unsigned char               * row  = malloc( ( size_t ) width * 3 );
+
+    if ( file == NULL || row == NULL )
+    {
+        if ( file ) fclose( file );
+        free( row );
+        return false;
+    }
+
+    info.err = jpeg_std_error( &errors );
+    jpeg_create_compress( &info );
+    jpeg_stdio_dest( &info, file );
+
+    info.image_width      = width;
+    info.image_height     = height;
+    info.input_components = 3;
+    info.in_color_space   = JCS_RGB;
+
+    jpeg_set_defaults( &info );
+    jpeg_set_quality( &info, quality, TRUE );
+    jpeg_start_compress( &info, TRUE );
+
+    for ( uint32_t y = 0; y < height; y ++ )
+    {
+        for ( uint32_t x = 0; x < width * 3; x ++ )
+        {
+            row[ x ] = ( unsigned char ) ( 128 + 100 * sin( x * 0.003 + y * 0.002 ) + ( ( x ^ y ) & 7 ) );
+        }
+
+        jpeg_write_scanlines( &info, &row, 1 );
+    }
+
+    jpeg_finish_compress( &info );
+    jpeg_destroy_compress( &info );
+
+    free( row );
+
+    return fclose( file ) == 0;
+}
+
+#endif /* JPEG_SUPPORT_H */
@@ -0,0 +1,346 @@
+/******************************************************************************\
+ * Tests: MemoryGovernorTests.c
+ *
+ * Stress tests for "MemoryGovernor.h": many threads holding compositions and
+ * decoding beneath them, with some decodes far over budget, must all finish
+ * without deadlock while the budget and composition share hold throughout.
+ * The threads really allocate and touch what they reserve, and the growth in
+ * peak resident set size must stay within the budget plus the biggest decode
+ * granted over it, with some slack. A big reservation must not be starved
+ * by a stream of small ones, and an interactive reservation must go ahead of
+ * a bulk one waiting before it. A watchdog fails the test if anything hangs.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+#ifdef __GLIBC__
+    #include <malloc.h>
+#endif
+
+#include "MemoryGovernor.h"
+
+#define BUDGET        ( 4 * 1024 * 1024 )
+#define WORKERS       8
+#define ITERATIONS    300
+#define WATCHDOG      60 /* Seconds */
+#define RSS_SLACK     ( 4 * 1024 * 1024 ) /* Stacks, allocator overheads */
+
+/* What the test's threads hold, updated just after each reservation is
+ * granted and just before each release; always a subset of what the
+ * governor has granted.
+ */
+
+static pthread_mutex_t heldLock = PTHREAD_MUTEX_INITIALIZER;
+static size_t          heldBytes[ memoryGovernorKindCount ];
+static unsigned int    heldCount[ memoryGovernorKindCount ];
+static unsigned int    violations;
+
+static void reserve( MemoryGovernorKind kind, size_t bytes )
+{
+    memoryGovernorReserve( kind, bytes );
+
+    pthread_mutex_lock( &heldLock );
+
+    heldBytes[ kind ] += bytes;
+    heldCount[ kind ] ++;
+
+    /* Compositions stay within their share. The total may only exceed the
+     * budget when a decode too big to fit has been granted on its own.
+     */
+
+    size_t total = heldBytes[ memoryGovernorComposition ] + heldBytes[ memoryGovernorDecode ];
+
+    if ( heldBytes[ memoryGovernorComposition ] > BUDGET * MEMORY_GOVERNOR_COMPOSITION_SHARE ||
+         ( total > BUDGET && heldCount[ memoryGovernorDecode ] != 1 ) )
+    {
+        violations ++;
+    }
+
+    pthread_mutex_unlock( &heldLock );
+}
+
+static void release( MemoryGovernorKind kind, size_t bytes )
+{
+    pthread_mutex_lock( &heldLock );
+
+    heldBytes[ kind ] -= bytes;
+    heldCount[ kind ] --;
+
+    pthread_mutex_unlock( &heldLock );
+
+    memoryGovernorRelease( kind, bytes );
+}
+
+/* Allocate the given number of bytes and write to every page, as decoding
+ * or drawing would, so that they count towards the resident set size.
+ */
+
+static uint8_t * allocate( size_t bytes )
+{
+    static long pageSize;
+    uint8_t   * block = malloc( bytes );
+
+    if ( pageSize == 0 ) pageSize = sysconf( _SC_PAGESIZE );
+
+    if ( block == NULL )
+    {
+        violations ++;
+        return NULL;
+    }
+
+    for ( size_t offset = 0; offset < bytes; offset += ( size_t ) pageSize ) block[ offset ] = ( uint8_t ) offset;
+    block[ bytes - 1 ] = 1;
+
+    return block;
+}
+
+/* Hold a composition of up to a fifth of the budget while decoding a few
+ * images beneath it, one at a time; one decode in fifty is bigger than the
+ * whole budget. The memory reserved is really allocated and used.
+ */
+
+static void * worker( void * argument )
+{
+    unsigned int seed = ( unsigned int ) ( uintptr_t ) argument;
+
+    for ( unsigned int iteration = 0; iteration < ITERATIONS; iteration ++ )
+    {
+        size_t composition = 1 + rand_r( &seed ) % ( BUDGET / 5 );
+
+        reserve( memoryGovernorComposition, composition );
+
+        uint8_t * canvas = allocate( composition );
+
+        for ( unsigned int decode = 0; decode < 3; decode ++ )
+        {
+            size_t bytes = rand_r( &seed ) % 50 == 0 ? BUDGET * 2 : 1 + rand_r( &seed ) % ( BUDGET / 3 );
+
+            reserve( memoryGovernorDecode, bytes );
+
+            uint8_t * image = allocate( bytes );
+            sched_yield();
+            free( image );
+
+            release( memoryGovernorDecode, bytes );
+        }
+
+        free( canvas );
+        release( memoryGovernorComposition, composition );
+    }
+
+    return NULL;
+}
+
+/* Out: Peak resident set size of the process so far, in bytes */
+
+static size_t peakResidentBytes( void )
+{
+    struct rusage usage;
+
+    getrusage( RUSAGE_SELF, &usage );
+
+    #ifdef __APPLE__
+        return ( size_t ) usage.ru_maxrss;        /* Bytes     */
+    #else
+        return ( size_t ) usage.ru_maxrss * 1024; /* Kilobytes */
+    #endif
+}
+
+static void testNestedStress( void )
+{
+    pthread_t                threads[ WORKERS ];
+    MemoryGovernorStatistics before, after;
+    size_t                   peakBefore, peakAfter;
+
+    /* Hand big blocks straight back to the system when they're freed, as
+     * macOS does, rather than keeping them in per-thread arenas; otherwise
+     * what the allocator holds on to would be measured, not what the
+     * threads hold at once.
+     */
+
+    #ifdef __GLIBC__
+        mallopt( M_MMAP_THRESHOLD, 64 * 1024 );
+    #endif
+
+    memoryGovernorGetStatistics( &before );
+    peakBefore = peakResidentBytes();
+
+    for ( uintptr_t index = 0; index < WORKERS; index ++ )
+    {
+        pthread_create( &threads[ index ], NULL, worker, ( void * ) ( index * 7919 + 1 ) );
+    }
+
+    for ( unsigned int index = 0; index < WORKERS; index ++ ) pthread_join( threads[ index ], NULL );
+
+    memoryGovernorGetStatistics( &after );
+    peakAfter = peakResidentBytes();
+
+    /* At most, a whole budget's worth of reservations might be held, or a
+     * decode bigger than the budget alone with compositions of up to their
+     * share of it.
+     */
+
+    printf( "Peak resident set grew by %.1fMiB; limit %.1fMiB\n",
+            ( double ) ( peakAfter - peakBefore ) / 1048576, ( double ) ( BUDGET + BUDGET * 2 + RSS_SLACK ) / 1048576 );
+
+    CHECK      ( peakAfter - peakBefore <= BUDGET + BUDGET * 2 + RSS_SLACK                  );
+    CHECK_EQUAL( violations,                                      0                         );
+    CHECK_EQUAL( after.reserved,                                  0                         );
+    CHECK_EQUAL( after.reservedByKind[ memoryGovernorDecode ],    0                         );
+    CHECK_EQUAL( after.reservations - before.reservations,        WORKERS * ITERATIONS * 4  );
+    CHECK      ( after.waits        > before.waits                                          );
+    CHECK      ( after.oversized    > before.oversized                                      );
+}
+
+/* Small decodes arrive continuously while a big one waits; it must still be
+ * granted, once those ahead of it are released, long before they run out.
+ */
+
+#define SMALL_LIMIT 200000
+
+static volatile int bigGranted;
+
+static void * smallDecoder( void * argument )
+{
+    unsigned int * count = argument;
+
+    for ( *count = 0; *count < SMALL_LIMIT && ! __atomic_load_n( &bigGranted, __ATOMIC_ACQUIRE ); ( *count ) ++ )
+    {
+        reserve( memoryGovernorDecode, BUDGET / 4 );
+        sched_yield();
+        release( memoryGovernorDecode, BUDGET / 4 );
+    }
+
+    return NULL;
+}
+
+static void testNoStarvation( void )
+{
+    pthread_t    threads[ 3 ];
+    unsigned int counts [ 3 ];
+
+    for ( unsigned int index = 0; index < 3; index ++ )
+    {
+        pthread_create( &threads[ index ], NULL, smallDecoder, &counts[ index ] );
+    }
+
+    usleep( 10000 );
+
+    reserve( memoryGovernorDecode, BUDGET - 1 );
+    __atomic_store_n( &bigGranted, 1, __ATOMIC_RELEASE );
+    release( memoryGovernorDecode, BUDGET - 1 );
+
+    for ( unsigned int index = 0; index < 3; index ++ )
+    {
+        pthread_join( threads[ index ], NULL );
+        CHECK( counts[ index ] < SMALL_LIMIT );
+    }
+}
+
+/* A reservation waiting on the budget goes ahead once the budget is raised */
+
+static void * bigDecoder( void * argument )
+{
+    ( void ) argument;
+
+    memoryGovernorReserve( memoryGovernorDecode, BUDGET / 2 );
+    memoryGovernorRelease( memoryGovernorDecode, BUDGET / 2 );
+
+    return NULL;
+}
+
+static void testBudgetRaised( void )
+{
+    pthread_t                thread;
+    MemoryGovernorStatistics before, after;
+
+    memoryGovernorGetStatistics( &before );
+    memoryGovernorReserve( memoryGovernorDecode, BUDGET / 2 + 1 );
+
+    pthread_create( &thread, NULL, bigDecoder, NULL );
+
+    usleep( 10000 );
+    memoryGovernorSetBudget( BUDGET * 2 );
+
+    pthread_join( thread, NULL );
+    memoryGovernorRelease( memoryGovernorDecode, BUDGET / 2 + 1 );
+
+    memoryGovernorGetStatistics( &after );
+
+    CHECK_EQUAL( after.waits     - before.waits,     1 );
+    CHECK_EQUAL( after.oversized - before.oversized, 0 );
+
+    memoryGovernorSetBudget( BUDGET );
+}
+
+/* A bulk decode waits for the budget, then an interactive one arrives; once
+ * the budget is released the interactive one must be granted first. Each
+ * takes most of the budget, so only one can be held at once.
+ */
+
+static unsigned int grantedOrder;
+static unsigned int bulkOrder, interactiveOrder;
+
+static void * prioritisedDecoder( void * argument )
+{
+    MemoryGovernorPriority priority = ( MemoryGovernorPriority ) ( uintptr_t ) argument;
+
+    memoryGovernorReserveWithPriority( memoryGovernorDecode, priority, BUDGET * 3 / 4 );
+
+    unsigned int order = __atomic_fetch_add( &grantedOrder, 1, __ATOMIC_SEQ_CST );
+
+    if ( priority == memoryGovernorPriorityInteractive ) interactiveOrder = order;
+    else                                                 bulkOrder        = order;
+
+    usleep( 1000 );
+    memoryGovernorRelease( memoryGovernorDecode, BUDGET * 3 / 4 );
+
+    return NULL;
+}
+
+static void testInteractiveFirst( void )
+{
+    pthread_t                bulk, interactive;
+    MemoryGovernorStatistics before, after;
+
+    memoryGovernorGetStatistics( &before );
+    memoryGovernorReserve( memoryGovernorDecode, BUDGET );
+
+    pthread_create( &bulk, NULL, prioritisedDecoder, ( void * ) ( uintptr_t ) memoryGovernorPriorityBulk );
+    usleep( 10000 );
+
+    pthread_create( &interactive, NULL, prioritisedDecoder, ( void * ) ( uintptr_t ) memoryGovernorPriorityInteractive );
+    usleep( 10000 );
+
+    memoryGovernorRelease( memoryGovernorDecode, BUDGET );
+
+    pthread_join( interactive, NULL );
+    pthread_join( bulk,        NULL );
+
+    memoryGovernorGetStatistics( &after );
+
+    CHECK_EQUAL( interactiveOrder,           0 );
+    CHECK_EQUAL( bulkOrder,                  1 );
+    CHECK_EQUAL( after.waits - before.waits, 2 );
+    CHECK_EQUAL( after.jumps - before.jumps, 1 );
+    CHECK_EQUAL( after.reserved,             0 );
+}
+
+int main( void )
+{
+    alarm( WATCHDOG );
+
+    memoryGovernorSetBudget( BUDGET );
+
+    testNestedStress();
+    testNoStarvation();
+    testBudgetRaised();
+    testInteractiveFirst();
+
+    return testFinish( "MemoryGovernorTests" );
+}
@@ -0,0 +1,643 @@
+/******************************************************************************\
+ * Tests: PipelineBenchmark.c
+ *
+ * Folders per second through three ways of processing a batch of folders:
+ *
+ * - One operation per folder running every stage in turn, on a queue running
+ *   at most eight at once, as MainWindowController's did;
+ *
+ * - The staged pipeline as IconPipeline first had it, with a bounded buffer
+ *   in front of each stage, eight threads for each of the scan and write
+ *   stages and one thread per processor core for each of decode, composite
+ *   and encode;
+ *
+ * - The pipeline as IconPipeline has it now, with threads only for scanning
+ *   and writing and each scanned folder decoded, composited and encoded as
+ *   one task on "TaskScheduler.h", no more than two per core at once.
+ *
+ * IconPipeline is Objective-C, so this models it: folders are really scanned
+ * with "FolderScanner.h" and really given custom icons with
+ * "ResourceForkWriter.h", while decoding, compositing and encoding each use
+ * a fixed amount of processor time. Decoding and encoding split theirs across
+ * a parallel loop on the task scheduler, as the application's do, so in the
+ * first two models the scheduler's workers compete with the models' own
+ * threads. All are also run on a simulated slow volume, where each icon
+ * written waits as if for a file server. Also shown are the per-folder times
+ * from scanning to writing, the most folders holding decoded images at once,
+ * which is what costs memory, and the most threads using the processor at
+ * once, which is above the number of cores when they are oversubscribed.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <pthread.h>
+
+#include "FolderScanner.h"
+#include "ResourceForkWriter.h"
+#include "TaskScheduler.h"
+
+#define OPERATION_QUEUE_WIDTH 8  /* The old maxConcurrentOperationCount      */
+#define PIPELINE_IO_WORKERS   8  /* ICON_PIPELINE_IO_WORKERS                  */
+#define PIPELINE_BUFFER       2  /* ICON_PIPELINE_BUFFER_FACTOR               */
+#define ICNS_SIZE             2048 /* Some filesystems keep xattrs to a block */
+
+#define DECODE_SECONDS        0.0004 /* Processor time per folder per stage */
+#define COMPOSITE_SECONDS     0.0002
+#define ENCODE_SECONDS        0.0002
+#define LOOP_ITERATIONS       4      /* Of decoding's and encoding's loops   */
+
+#define SLOW_WRITE_MICROSECONDS 3000
+
+enum { stageScan, stageDecode, stageComposite, stageEncode, stageWrite, stageCount };
+
+typedef struct Batch
+{
+    char                      ** folders;
+    size_t                       count;
+    const FolderScannerBackend * backend;
+    uint32_t                     writeMicroseconds;
+    uint8_t                    * icns;
+
+    size_t                       next;     /* Next folder, one operation each */
+    double                     * latencies;
+    unsigned int                 decoded;  /* Folders holding decoded images */
+    unsigned int                 peakDecoded;
+    unsigned int                 burning;  /* Threads using the processor    */
+    unsigned int                 peakBurning;
+    unsigned int                 failures;
+
+} Batch;
+
+/******************************************************************************\
+ * The work for each folder
+\******************************************************************************/
+
+/* Raise a peak to the given value if it is higher */
+
+static void raisePeak( unsigned int * peak, unsigned int value )
+{
+    unsigned int seen = __atomic_load_n( peak, __ATOMIC_RELAXED );
+
+    while ( value > seen &&
+            ! __atomic_compare_exchange_n( peak, &seen, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+/* Use the given processor time, however many other threads are competing
+ * for it, as real decoding or drawing would.
+ */
+
+static void burnProcessor( Batch * batch, double seconds )
+{
+    struct timespec now;
+    double          until, value = 1.0;
+
+    raisePeak( &batch->peakBurning, __atomic_add_fetch( &batch->burning, 1, __ATOMIC_RELAXED ) );
+
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+    until = ( double ) now.tv_sec + ( double ) now.tv_nsec / 1e9 + seconds;
+
+    do
+    {
+        for ( int spin = 0; spin < 1000; spin ++ ) value = value * 1.0000001 + 1e-9;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now );
+    }
+    while ( ( double ) now.tv_sec + ( double ) now.tv_nsec / 1e9 < until );
+
+    __atomic_sub_fetch( &batch->burning, 1, __ATOMIC_RELAXED );
+
+    testSink = value;
+}
+
+/* The same, split across a parallel loop on the task scheduler */
+
+typedef struct Loop
+{
+    Batch  * batch;
+    double   seconds; /* Per iteration */
+
+} Loop;
+
+static void runLoopIteration( void * context, size_t index )
+{
+    Loop * loop = context;
+
+    ( void ) index;
+
+    burnProcessor( loop->batch, loop->seconds );
+}
+
+static void burnInLoop( Batch * batch, double seconds )
+{
+    Loop loop = { batch, seconds / LOOP_ITERATIONS };
+
+    taskSchedulerApply( LOOP_ITERATIONS, &loop, runLoopIteration );
+}
+
+static void runStage( Batch * batch, size_t folder, int stage )
+{
+    switch ( stage )
+    {
+        case stageScan:
+        {
+            FolderScannerOptions options = { .threadCount = 1, .backend = batch->backend };
+            FolderScannerRoot    root    = { .path = batch->folders[ folder ] };
+
+            if ( folderScannerRun( &root, 1, &options, NULL ) != 0 || root.filesFound == 0 )
+            {
+                __atomic_add_fetch( &batch->failures, 1, __ATOMIC_RELAXED );
+            }
+        }
+        break;
+
+        case stageDecode:
+        {
+            burnInLoop( batch, DECODE_SECONDS );
+            raisePeak( &batch->peakDecoded, __atomic_add_fetch( &batch->decoded, 1, __ATOMIC_RELAXED ) );
+        }
+        break;
+
+        case stageComposite:
+        {
+            burnProcessor( batch, COMPOSITE_SECONDS );
+        }
+        break;
+
+        case stageEncode:
+        {
+            burnInLoop( batch, ENCODE_SECONDS );
+            __atomic_sub_fetch( &batch->decoded, 1, __ATOMIC_RELAXED );
+        }
+        break;
+
+        default:
+        {
+            if ( batch->writeMicroseconds > 0 ) usleep( batch->writeMicroseconds );
+
+            if ( resourceForkSaveCustomIcon( batch->folders[ folder ], true, batch->icns, ICNS_SIZE ) != 0 )
+            {
+                __atomic_add_fetch( &batch->failures, 1, __ATOMIC_RELAXED );
+            }
+        }
+        break;
+    }
+}
+
+/******************************************************************************\
+ * One operation per folder: each of a fixed number of threads takes the next
+ * folder and runs every stage for it.
+\******************************************************************************/
+
+static void * runOperations( void * context )
+{
+    Batch * batch = context;
+    size_t  folder;
+
+    while ( ( folder = __atomic_fetch_add( &batch->next, 1, __ATOMIC_RELAXED ) ) < batch->count )
+    {
+        double started = testSeconds();
+
+        for ( int stage = 0; stage < stageCount; stage ++ ) runStage( batch, folder, stage );
+
+        batch->latencies[ folder ] = testSeconds() - started;
+    }
+
+    return NULL;
+}
+
+static void operationPerFolder( Batch * batch, unsigned int cores )
+{
+    pthread_t threads[ OPERATION_QUEUE_WIDTH ];
+
+    ( void ) cores;
+
+    for ( int index = 0; index < OPERATION_QUEUE_WIDTH; index ++ )
+    {
+        pthread_create( &threads[ index ], NULL, runOperations, batch );
+    }
+
+    for ( int index = 0; index < OPERATION_QUEUE_WIDTH; index ++ ) pthread_join( threads[ index ], NULL );
+}
+
+/******************************************************************************\
+ * Pipelines: as IconPipelineStage, a bounded buffer of folders in front of
+ * each stage with its own threads, with handing a folder on blocking while
+ * the next stage's buffer is full. The last worker of a stage to exit closes
+ * the next.
+ *
+ * On the task scheduler, scanned folders are instead handed to a task which
+ * decodes, composites and encodes them and puts them in the write stage's
+ * buffer, which has room for all there may be. A folder counts towards the
+ * limit of those being drawn until a write worker takes it, and the last
+ * scan worker to exit waits for every task before closing the write stage.
+\******************************************************************************/
+
+struct Drawings;
+
+typedef struct Stage
+{
+    pthread_mutex_t    lock;
+    pthread_cond_t     notEmpty;
+    pthread_cond_t     notFull;
+    size_t           * buffer;
+    size_t             capacity;
+    size_t             head;
+    size_t             queued;
+    bool               closed;
+    unsigned int       workers;
+    unsigned int       running;  /* Workers yet to exit */
+
+    int                stage;
+    struct Stage     * next;
+    Batch            * batch;
+    double           * started;  /* Per folder, set by the scan stage */
+    struct Drawings  * drawings; /* Scan and write, on the task scheduler */
+
+} Stage;
+
+typedef struct Drawing
+{
+    struct Drawings * drawings;
+    size_t            folder;
+
+} Drawing;
+
+typedef struct Drawings
+{
+    pthread_mutex_t   lock;
+    pthread_cond_t    changed;
+    unsigned int      drawing; /* Folders drawing or waiting to be written */
+    unsigned int      limit;
+    unsigned int      tasks;   /* Tasks submitted and yet to finish        */
+    uint64_t          tickets; /* Taken by scan workers waiting for room,  */
+    uint64_t          serving; /* so that they get it in turn              */
+
+    Batch           * batch;
+    Stage           * write;
+    Drawing         * each;    /* Per folder, the context of its task      */
+
+} Drawings;
+
+static void stageInit( Stage * stage, int kind, unsigned int workers, size_t capacity, Batch * batch, double * started )
+{
+    *stage = ( Stage )
+    {
+        .buffer   = calloc( capacity, sizeof( size_t ) ),
+        .capacity = capacity,
+        .workers  = workers,
+        .running  = workers,
+        .stage    = kind,
+        .batch    = batch,
+        .started  = started
+    };
+
+    pthread_mutex_init( &stage->lock,     NULL );
+    pthread_cond_init ( &stage->notEmpty, NULL );
+    pthread_cond_init ( &stage->notFull,  NULL );
+}
+
+static void stageDestroy( Stage * stage )
+{
+    pthread_cond_destroy ( &stage->notFull  );
+    pthread_cond_destroy ( &stage->notEmpty );
+    pthread_mutex_destroy( &stage->lock     );
+    free( stage->buffer );
+}
+
+static void stagePut( Stage * stage, size_t folder )
+{
+    pthread_mutex_lock( &stage->lock );
+
+    while ( stage->queued >= stage->capacity ) pthread_cond_wait( &stage->notFull, &stage->lock );
+
+    stage->buffer[ ( stage->head + stage->queued ++ ) % stage->capacity ] = folder;
+
+    pthread_cond_signal ( &stage->notEmpty );
+    pthread_mutex_unlock( &stage->lock     );
+}
+
+/* Out: false once the stage is closed and empty, else true with a folder */
+
+static bool stageTake( Stage * stage, size_t * folder )
+{
+    bool taken = false;
+
+    pthread_mutex_lock( &stage->lock );
+
+    while ( stage->queued == 0 && ! stage->closed ) pthread_cond_wait( &stage->notEmpty, &stage->lock );
+
+    if ( stage->queued > 0 )
+    {
+        *folder     = stage->buffer[ stage->head ];
+        stage->head = ( stage->head + 1 ) % stage->capacity;
+        stage->queued --;
+        taken       = true;
+
+        pthread_cond_signal( &stage->notFull );
+    }
+
+    pthread_mutex_unlock( &stage->lock );
+
+    return taken;
+}
+
+static void stageClose( Stage * stage )
+{
+    pthread_mutex_lock    ( &stage->lock     );
+    stage->closed = true;
+    pthread_cond_broadcast( &stage->notEmpty );
+    pthread_mutex_unlock  ( &stage->lock     );
+}
+
+/* Task body: draw a scanned folder and hand it on to be written */
+
+static void drawFolder( void * context )
+{
+    Drawing  * drawing  = context;
+    Drawings * drawings = drawing->drawings;
+
+    for ( int stage = stageDecode; stage <= stageEncode; stage ++ )
+    {
+        runStage( drawings->batch, drawing->folder, stage );
+    }
+
+    stagePut( drawings->write, drawing->folder );
+
+    pthread_mutex_lock    ( &drawings->lock    );
+    drawings->tasks --;
+    pthread_cond_broadcast( &drawings->changed );
+    pthread_mutex_unlock  ( &drawings->lock    );
+}
+
+/* Wait for room, in turn, then submit a task to draw the given folder */
+
+static void drawingSubmit( Drawings * drawings, size_t folder )
+{
+    Drawing * drawing = &drawings->each[ folder ];
+
+    pthread_mutex_lock( &drawings->lock );
+
+    uint64_t ticket = drawings->tickets ++;
+
+    while ( ticket != drawings->serving || drawings->drawing >= drawings->limit )
+    {
+        pthread_cond_wait( &drawings->changed, &drawings->lock );
+    }
+
+    drawings->serving ++;
+    drawings->drawing ++;
+    drawings->tasks   ++;
+
+    pthread_cond_broadcast( &drawings->changed );
+
+    pthread_mutex_unlock( &drawings->lock );
+
+    *drawing = ( Drawing ) { drawings, folder };
+
+    if ( taskSchedulerSubmit( taskSchedulerLaneUserInitiated, drawFolder, NULL, drawing ) != 0 )
+    {
+        drawFolder( drawing );
+    }
+}
+
+/* A drawn folder has been taken for writing, so another may be drawn */
+
+static void drawingTaken( Drawings * drawings )
+{
+    pthread_mutex_lock    ( &drawings->lock    );
+    drawings->drawing --;
+    pthread_cond_broadcast( &drawings->changed );
+    pthread_mutex_unlock  ( &drawings->lock    );
+}
+
+static void drawingsWait( Drawings * drawings )
+{
+    pthread_mutex_lock( &drawings->lock );
+
+    while ( drawings->tasks > 0 ) pthread_cond_wait( &drawings->changed, &drawings->lock );
+
+    pthread_mutex_unlock( &drawings->lock );
+}
+
+static void * runStageWorker( void * context )
+{
+    Stage * stage = context;
+    Batch * batch = stage->batch;
+    size_t  folder;
+    bool    last;
+
+    while ( stageTake( stage, &folder ) )
+    {
+        if ( stage->stage == stageScan ) stage->started[ folder ] = testSeconds();
+
+        if ( stage->stage == stageWrite && stage->drawings != NULL ) drawingTaken( stage->drawings );
+
+        runStage( batch, folder, stage->stage );
+
+        if      ( stage->next == NULL     ) batch->latencies[ folder ] = testSeconds() - stage->started[ folder ];
+        else if ( stage->drawings != NULL ) drawingSubmit( stage->drawings, folder );
+        else                                stagePut( stage->next, folder );
+    }
+
+    pthread_mutex_lock  ( &stage->lock );
+    last = ( -- stage->running == 0 );
+    pthread_mutex_unlock( &stage->lock );
+
+    if ( last && stage->next != NULL )
+    {
+        if ( stage->drawings != NULL ) drawingsWait( stage->drawings );
+
+        stageClose( stage->next );
+    }
+
+    return NULL;
+}
+
+/* Start every stage's workers, feed the batch into the first stage and wait
+ * for the workers to finish.
+ */
+
+static void runStages( Stage * stages, unsigned int count, Batch * batch )
+{
+    unsigned int total = 0, thread = 0;
+
+    for ( unsigned int stage = 0; stage < count; stage ++ ) total += stages[ stage ].workers;
+
+    pthread_t * threads = calloc( total, sizeof( pthread_t ) );
+
+    for ( unsigned int stage = 0; stage < count; stage ++ )
+    {
+        for ( unsigned int index = 0; index < stages[ stage ].workers; index ++ )
+        {
+            pthread_create( &threads[ thread ++ ], NULL, runStageWorker, &stages[ stage ] );
+        }
+    }
+
+    for ( size_t folder = 0; folder < batch->count; folder ++ ) stagePut( &stages[ 0 ], folder );
+
+    stageClose( &stages[ 0 ] );
+
+    for ( thread = 0; thread < total; thread ++ ) pthread_join( threads[ thread ], NULL );
+
+    free( threads );
+}
+
+static void stagedPipeline( Batch * batch, unsigned int cores )
+{
+    Stage    stages[ stageCount ];
+    double * started = calloc( batch->count, sizeof( double ) );
+
+    for ( int stage = 0; stage < stageCount; stage ++ )
+    {
+        unsigned int workers = ( stage == stageScan || stage == stageWrite ) ? PIPELINE_IO_WORKERS : cores;
+
+        stageInit( &stages[ stage ], stage, workers, workers * PIPELINE_BUFFER, batch, started );
+
+        if ( stage > 0 ) stages[ stage - 1 ].next = &stages[ stage ];
+    }
+
+    runStages( stages, stageCount, batch );
+
+    for ( int stage = 0; stage < stageCount; stage ++ ) stageDestroy( &stages[ stage ] );
+
+    free( started );
+}
+
+static void pipelineOnScheduler( Batch * batch, unsigned int cores )
+{
+    Stage    stages[ 2 ]; /* Scan, write */
+    double * started  = calloc( batch->count, sizeof( double ) );
+    Drawings drawings =
+    {
+        .lock    = PTHREAD_MUTEX_INITIALIZER,
+        .changed = PTHREAD_COND_INITIALIZER,
+        .limit   = cores * PIPELINE_BUFFER,
+        .batch   = batch,
+        .write   = &stages[ 1 ],
+        .each    = calloc( batch->count, sizeof( Drawing ) )
+    };
+
+    stageInit( &stages[ 0 ], stageScan,  PIPELINE_IO_WORKERS, PIPELINE_IO_WORKERS * PIPELINE_BUFFER, batch, started );
+    stageInit( &stages[ 1 ], stageWrite, PIPELINE_IO_WORKERS, PIPELINE_IO_WORKERS * PIPELINE_BUFFER + drawings.limit,
+               batch, started );
+
+    stages[ 0 ].next     = &stages[ 1 ];
+    stages[ 0 ].drawings = &drawings;
+    stages[ 1 ].drawings = &drawings;
+
+    runStages( stages, 2, batch );
+
+    stageDestroy( &stages[ 1 ] );
+    stageDestroy( &stages[ 0 ] );
+
+    free( drawings.each );
+    free( started );
+}
+
+/******************************************************************************\
+ * Running the models
+\******************************************************************************/
+
+typedef struct Model
+{
+    const char * name;
+    void      ( * run )( Batch * batch, unsigned int cores );
+
+} Model;
+
+static const Model models[] =
+{
+    { "Operation per folder",  operationPerFolder  },
+    { "Staged pipeline",       stagedPipeline      },
+    { "Pipeline on scheduler", pipelineOnScheduler }
+};
+
+static void report( const Model * model, Batch * batch, unsigned int cores )
+{
+    batch->next        = 0;
+    batch->decoded     = 0;
+    batch->peakDecoded = 0;
+    batch->burning     = 0;
+    batch->peakBurning = 0;
+    batch->failures    = 0;
+
+    double started = testSeconds();
+
+    model->run( batch, cores );
+
+    double elapsed = testSeconds() - started;
+    double p50     = percentileOf( batch->latencies, batch->count, 50 );
+    double p99     = percentileOf( batch->latencies, batch->count, 99 );
+
+    printf( "  %-22s %8.1f  %8.1fms %8.1fms  %7u  %7u\n",
+            model->name, batch->count / elapsed, p50 * 1e3, p99 * 1e3, batch->peakDecoded, batch->peakBurning );
+
+    if ( batch->failures > 0 )
+    {
+        fprintf( stderr, "%u folders could not be scanned or written\n", batch->failures );
+        exit( EXIT_FAILURE );
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    size_t       count   = quick ? 24 : 10000;
+    long         online  = sysconf( _SC_NPROCESSORS_ONLN );
+    unsigned int cores   = online > 0 ? ( unsigned int ) online : 1;
+    char       * scratch = testMakeDirectory( "PipelineBenchmark" );
+    Batch        batch   = { .count = count };
+    char         path[ 4096 ];
+
+    batch.folders   = calloc( count, sizeof( char * ) );
+    batch.latencies = calloc( count, sizeof( double ) );
+    batch.icns      = malloc( ICNS_SIZE );
+
+    for ( size_t index = 0; index < ICNS_SIZE; index ++ ) batch.icns[ index ] = ( uint8_t ) ( index * 7 );
+
+    /* Each folder holds a few images */
+
+    for ( size_t folder = 0; folder < count; folder ++ )
+    {
+        snprintf( path, sizeof( path ), "%s/folder%zu", scratch, folder );
+        mkdir( path, 0755 );
+        testMakeTree( path, 0, 0, 3, ".jpg", 64 );
+
+        batch.folders[ folder ] = strdup( path );
+    }
+
+    FolderScannerSlowBackend slow;
+
+    folderScannerSlowBackendInit( &slow, folderScannerPOSIXBackend(), 2000, 500, 4 );
+
+    printf( "%zu folders, %u processor cores\n", count, cores );
+    printf( "Threads is the most using the processor at once\n" );
+
+    for ( unsigned int volume = 0; volume < 2; volume ++ )
+    {
+        batch.backend           = volume == 0 ? NULL : &slow.backend;
+        batch.writeMicroseconds = volume == 0 ? 0    : SLOW_WRITE_MICROSECONDS;
+
+        printf( "\n%s volume            Folders/s  Time per folder, p50 p99  Decoded  Threads\n",
+                volume == 0 ? "Local" : "Slow " );
+
+        for ( size_t model = 0; model < sizeof( models ) / sizeof( models[ 0 ] ); model ++ )
+        {
+            report( &models[ model ], &batch, cores );
+        }
+    }
+
+    folderScannerSlowBackendDestroy( &slow );
+
+    for ( size_t folder = 0; folder < count; folder ++ ) free( batch.folders[ folder ] );
+
+    free( batch.folders   );
+    free( batch.latencies );
+    free( batch.icns      );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/******************************************************************************\
+ * Tests: PngEncoderBenchmark.c
+ *
+ * Size against time for "PngEncoder.h" at each zlib level, compressing the
+ * 512x512 and 256x256 icon family elements ('ic09', 'ic08') of three kinds of
+ * custom icon: a rotated photo thumbnail with its border and shadow on a
+ * transparent canvas, as the Classic style draws; a photo filling the canvas;
+ * and flat artwork. Sizes are shown as a percentage of the raw A, R, G, B
+ * data they replace. Icons.m uses level 1 unless told otherwise.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#include "PngEncoder.h"
+#include "RasterEngine.h"
+
+#define KINDS 3
+
+static const char * kindNames[ KINDS ] = { "Thumbnail", "Photo", "Artwork" };
+
+/* An opaque photo-like image: smooth gradients with a little sensor noise */
+
+static void fillPhoto( RasterImage * image, unsigned int seed )
+{
+    for ( uint32_t y = 0; y < image->height; y ++ )
+    {
+        uint8_t * row = image->pixels + y * image->rowBytes;
+
+        for ( uint32_t x = 0; x < image->width; x ++ )
+        {
+            double u = ( double ) x / image->width, v = ( double ) y / image->height;
+
+            row[ x * 4 ] = 255;
+
+            for ( int channel = 1; channel < 4; channel ++ )
+            {
+                double value = 128 + 70 * sin( u * 7 + channel + v * 3 ) + 40 * cos( v * 11 - u * channel ) +
+                               ( int ) ( rand_r( &seed ) % 9 ) - 4;
+
+                row[ x * 4 + channel ] = ( uint8_t ) fmin( 255, fmax( 0, value ) );
+            }
+        }
+    }
+}
+
+/* Draw one kind of icon at the canvas's size; false if out of memory */
+
+static bool drawIcon( RasterImage * canvas, int kind )
+{
+    uint32_t size  = canvas->width;
+    bool     drawn = true;
+
+    memset( canvas->pixels, 0, canvas->rowBytes * canvas->height );
+
+    switch ( kind )
+    {
+        case 0:
+        {
+            RasterImage photo;
+
+            if ( ! rasterImageCreate( &photo, size * 3 / 4, size * 9 / 16 ) ) return false;
+            fillPhoto( &photo, 1 );
+
+            RasterThumbnailStyle style =
+            {
+                .layoutSize    = size,
+                .thumbSize     = size * 0.78,
+                .borderSize    = size * 0.86,
+                .angle         = 0.06,
+                .fit           = true,
+                .shadowOffsetY = -( double ) size / 64,
+                .shadowSigma   = ( double ) size / 64,
+                .shadowColour  = { 85, 0, 0, 0 },
+                .filter        = rasterFilterBicubic
+            };
+
+            drawn = rasterDrawThumbnail( canvas, 0, 0, size, size, &photo, &style );
+            rasterImageFree( &photo );
+        }
+        break;
+
+        case 1:
+        {
+            fillPhoto( canvas, 2 );
+        }
+        break;
+
+        default:
+        {
+            static const uint8_t colours[ 3 ][ 4 ] = { { 255, 70, 130, 200 }, { 255, 240, 240, 240 }, { 160, 20, 20, 20 } };
+
+            for ( int shape = 0; shape < 3; shape ++ )
+            {
+                double          inset     = size * ( 0.08 + shape * 0.12 );
+                RasterTransform transform = { 1, 0, 0, 1, inset, inset * 1.2 };
+
+                rasterFillRect( canvas, &transform, size - inset * 2, size - inset * 2.4, colours[ shape ] );
+            }
+        }
+        break;
+    }
+
+    return drawn;
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick  = benchmarkIsQuick( argc, argv );
+    unsigned int rounds = quick ? 1 : 10;
+    RasterImage  canvases[ KINDS ][ 2 ];
+
+    static const uint32_t sizes [] = { 512, 256 };
+    static const int      levels[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+    for ( int kind = 0; kind < KINDS; kind ++ )
+    {
+        for ( int size = 0; size < 2; size ++ )
+        {
+            if ( ! rasterImageCreate( &canvases[ kind ][ size ], sizes[ size ], sizes[ size ] ) ||
+                 ! drawIcon( &canvases[ kind ][ size ], kind ) )
+            {
+                fprintf( stderr, "Out of memory\n" );
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf( "Size as %% of raw ARGB, and encoding time for 'ic09' plus 'ic08'\n\n" );
+    printf( "Level  %-16s  %-16s  %-16s\n", kindNames[ 0 ], kindNames[ 1 ], kindNames[ 2 ] );
+
+    for ( size_t item = 0; item < sizeof( levels ) / sizeof( levels[ 0 ] ); item ++ )
+    {
+        int level = levels[ item ];
+
+        if ( quick && level != 1 && level != 9 ) continue;
+
+        printf( "%5d", level );
+
+        for ( int kind = 0; kind < KINDS; kind ++ )
+        {
+            size_t bytes = 0, raw = 0;
+            double started = testSeconds();
+
+            for ( unsigned int round = 0; round < rounds; round ++ )
+            {
+                bytes = 0;
+                raw   = 0;
+
+                for ( int size = 0; size < 2; size ++ )
+                {
+                    const RasterImage * canvas = &canvases[ kind ][ size ];
+                    size_t              pngSize;
+                    uint8_t           * png    = pngEncode( canvas->pixels, canvas->width, canvas->height,
+                                                            canvas->rowBytes, level, &pngSize );
+
+                    if ( png == NULL )
+                    {
+                        fprintf( stderr, "Compression failed\n" );
+                        return EXIT_FAILURE;
+                    }
+
+                    bytes += pngSize;
+                    raw   += canvas->rowBytes * canvas->height;
+
+                    free( png );
+                }
+            }
+
+            double elapsed = ( testSeconds() - started ) / rounds;
+
+            printf( "  %5.1f%% %7.2fms", 100.0 * bytes / raw, elapsed * 1e3 );
+        }
+
+        printf( "\n" );
+    }
+
+    for ( int kind = 0; kind < KINDS; kind ++ )
+    {
+        for ( int size = 0; size < 2; size ++ ) rasterImageFree( &canvases[ kind ][ size ] );
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/******************************************************************************\
+ * Tests: RasterEngineBenchmark.c
+ *
+ * Throughput of each operation in "RasterEngine.h", in megapixels of output
+ * per second, at the sizes a 512x512 (1024x1024 on Retina) custom icon uses.
+ * This is built once for each set of kernels the machine can run, so compare
+ * the "RasterEngineBenchmark", "...Scalar" and "...AVX2" executables' figures.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#include "RasterEngine.h"
+
+#define SIZE 1024
+
+static void fillNoise( RasterImage * image, unsigned int seed, bool opaque )
+{
+    for ( uint32_t y = 0; y < image->height; y ++ )
+    {
+        uint8_t * row = image->pixels + y * image->rowBytes;
+
+        for ( uint32_t x = 0; x < image->width; x ++ )
+        {
+            uint8_t alpha = opaque ? 255 : ( uint8_t ) rand_r( &seed );
+
+            row[ x * 4 ] = alpha;
+            for ( int channel = 1; channel < 4; channel ++ ) row[ x * 4 + channel ] = ( uint8_t ) ( rand_r( &seed ) % ( alpha + 1 ) );
+        }
+    }
+}
+
+/* Print one operation's throughput from its total time and pixels output */
+
+static void report( const char * name, double seconds, double pixels )
+{
+    printf( "%-26s %8.1f Mpx/s  (%7.3fms each)\n", name, pixels / seconds / 1e6, seconds * 1e3 );
+}
+
+int main( int argc, char ** argv )
+{
+    bool                 quick  = benchmarkIsQuick( argc, argv );
+    unsigned int         rounds = quick ? 1 : 20;
+    RasterImage          canvas, thumbnail, layer;
+    RasterMask           mask;
+    RasterTransform      rotate = { cos( 0.06 ), sin( 0.06 ), -sin( 0.06 ), cos( 0.06 ), 60, 20 };
+    double               started;
+
+    static const uint8_t white [ 4 ] = { 255, 255, 255, 255 };
+    static const uint8_t shadow[ 4 ] = { 85,  0,   0,   0   };
+
+    if ( ! rasterImageCreate( &canvas,    SIZE, SIZE ) ||
+         ! rasterImageCreate( &thumbnail, 880,  660  ) ||
+         ! rasterImageCreate( &layer,     SIZE, SIZE ) ||
+         ! rasterMaskCreate ( &mask,      SIZE, SIZE ) )
+    {
+        fprintf( stderr, "Out of memory\n" );
+        return EXIT_FAILURE;
+    }
+
+    fillNoise( &canvas,    1, true  );
+    fillNoise( &thumbnail, 2, true  );
+    fillNoise( &layer,     3, false );
+
+    for ( size_t index = 0; index < mask.rowBytes * mask.height; index ++ ) mask.alpha[ index ] = ( uint8_t ) index;
+
+    printf( "Kernels: %s, %ux%u canvas\n\n", rasterEngineKernels(), SIZE, SIZE );
+
+    /* Each timed operation covers about the canvas, or the thumbnail's
+     * rotated area; throughput is per pixel of that.
+     */
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterFillRect( &canvas, &rotate, 900, 900, white );
+    report( "Fill rotated rectangle", ( testSeconds() - started ) / rounds, 900.0 * 900 );
+
+    static const struct { const char * name; RasterFilter filter; } filters[] =
+    {
+        { "Rotated blit, bilinear", rasterFilterBilinear },
+        { "Rotated blit, bicubic",  rasterFilterBicubic  }
+    };
+
+    for ( size_t item = 0; item < sizeof( filters ) / sizeof( filters[ 0 ] ); item ++ )
+    {
+        started = testSeconds();
+        for ( unsigned int round = 0; round < rounds; round ++ ) rasterDrawImage( &canvas, &thumbnail, &rotate, filters[ item ].filter );
+        report( filters[ item ].name, ( testSeconds() - started ) / rounds, 880.0 * 660 );
+    }
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterExtractAlpha( &layer, &mask, 0, 0 );
+    report( "Extract alpha", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterBoxBlur( &mask, 8 );
+    report( "Box blur, radius 8", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterGaussianBlur( &mask, 16 );
+    report( "Gaussian blur, sigma 16", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterDrawMask( &canvas, &mask, 0, 0, shadow, NULL );
+    report( "Draw mask", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterComposite( &canvas, &layer, 0, 0 );
+    report( "Composite", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    /* A whole Classic style thumbnail, filling the canvas */
+
+    RasterThumbnailStyle style =
+    {
+        .layoutSize    = SIZE,
+        .thumbSize     = 800,
+        .borderSize    = 880,
+        .angle         = 0.06,
+        .shadowOffsetY = -16,
+        .shadowSigma   = 16,
+        .shadowColour  = { 85, 0, 0, 0 },
+        .filter        = rasterFilterBicubic
+    };
+
+    started = testSeconds();
+    for ( unsigned int round = 0; round < rounds; round ++ ) rasterDrawThumbnail( &canvas, 0, 0, SIZE, SIZE, &thumbnail, &style );
+    report( "Whole thumbnail", ( testSeconds() - started ) / rounds, ( double ) SIZE * SIZE );
+
+    rasterImageFree( &canvas    );
+    rasterImageFree( &thumbnail );
+    rasterImageFree( &layer     );
+    rasterMaskFree ( &mask      );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,506 @@
+/******************************************************************************\
+ * Tests: RasterEngineTests.c
+ *
+ * Tests for "RasterEngine.h". Basic properties of each kernel are checked
+ * directly; then each preset icon style is drawn and compared with a golden
+ * image in "Golden", allowing a unit or two of difference for the filtered
+ * blits (see "RasterEngine.h"). This is built once for each set of kernels the
+ * machine can run, so every set is held to the same goldens. On macOS, each
+ * preset is also drawn with CoreGraphics, as the icon generator does, and
+ * must match closely.
+ *
+ * Run with "--write-goldens" to replace the golden images after a deliberate
+ * change to the engine's output. They are PAM files of premultiplied RGBA.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#include "RasterEngine.h"
+
+#ifdef __APPLE__
+    #include <CoreGraphics/CoreGraphics.h>
+#endif
+
+#define ICON_SIZE  128
+#define TOLERANCE  2   /* Largest difference from a golden image, per channel */
+
+/* The icon generator's layout constants (see "CustomIconGenerator.h") at
+ * standard pixel density.
+ */
+
+#define CANVAS_SIZE  512
+#define THUMB_BORDER 20
+#define BLUR_RADIUS  16
+#define BLUR_OFFSET  8
+#define ROTATION_PAD 40
+
+/* A preset icon style (see "IconStyleManager.m"), the thumbnails it is
+ * drawn with and where, as the icon generator would lay them out.
+ */
+
+typedef struct Preset
+{
+    const char * name;
+    bool         border;
+    bool         rotation;
+    bool         coverArt;
+    bool         crop;
+    unsigned int thumbnails;
+    double       slots[ 2 ][ 4 ];  /* x, y, width, height in icon pixels */
+    double       angles[ 2 ];
+    uint32_t     thumbnailWidth;
+    uint32_t     thumbnailHeight;
+
+} Preset;
+
+static const Preset presets[] =
+{
+    { "Classic", true,  true,  false, true,  2, { { 6, 30, 88, 88 }, { 34, 8, 88, 88 } }, { 0.06, -0.045 }, 96, 72  },
+    { "CD",      false, false, true,  true,  1, { { 0, 0, 128, 128 } },                  { 0 },            120, 120 },
+    { "DVD",     false, false, true,  false, 1, { { 0, 0, 128, 128 } },                  { 0 },            80,  120 }
+};
+
+#define PRESETS ( sizeof( presets ) / sizeof( presets[ 0 ] ) )
+
+/* As -getThumbnailGeometry: and the raster engine branch of the custom icon
+ * drawing code in "CustomIconGenerator.m"; every preset has a drop shadow.
+ */
+
+static RasterThumbnailStyle styleFor( const Preset * preset, unsigned int index )
+{
+    double thumbSize    = CANVAS_SIZE;
+    double borderSize   = 0;
+    double shadowOffset = 0;
+    double shadowBlur   = 0;
+    double scale        = preset->slots[ index ][ 2 ] / CANVAS_SIZE;
+
+    if ( preset->rotation ) thumbSize -= ROTATION_PAD;
+
+    if ( preset->coverArt == false )
+    {
+        shadowOffset = -BLUR_OFFSET;
+        shadowBlur   = BLUR_RADIUS;
+        thumbSize   -= BLUR_RADIUS + BLUR_OFFSET * 2;
+    }
+    else
+    {
+        shadowOffset = -( BLUR_OFFSET / 2 );
+        shadowBlur   = ( BLUR_RADIUS / 3 ) * ( BLUR_OFFSET / 2 );
+        thumbSize   -= BLUR_RADIUS * ( BLUR_OFFSET / 2 ) + ( BLUR_OFFSET / 2 );
+    }
+
+    if ( preset->border )
+    {
+        borderSize  = thumbSize;
+        thumbSize  -= THUMB_BORDER * 2;
+    }
+
+    RasterThumbnailStyle style =
+    {
+        .layoutSize    = CANVAS_SIZE,
+        .thumbSize     = thumbSize,
+        .borderSize    = borderSize,
+        .angle         = preset->angles[ index ],
+        .fit           = ! preset->crop,
+        .shadowOffsetX = 0,
+        .shadowOffsetY = shadowOffset * scale,
+        .shadowSigma   = shadowBlur * scale / 2,
+        .shadowColour  = { 85, 0, 0, 0 },
+        .filter        = rasterFilterBicubic
+    };
+
+    if ( preset->coverArt )
+    {
+        static const uint8_t grey[ 4 ] = { 255, 77, 77, 77 };
+        memcpy( style.shadowColour, grey, sizeof( grey ) );
+    }
+
+    return style;
+}
+
+/* An opaque thumbnail: smooth gradients, a hard-edged square and fine stripes,
+ * so both filtering and edges show up.
+ */
+
+static bool makeThumbnail( RasterImage * image, uint32_t width, uint32_t height, unsigned int seed )
+{
+    if ( ! rasterImageCreate( image, width, height ) ) return false;
+
+    for ( uint32_t y = 0; y < height; y ++ )
+    {
+        uint8_t * row = image->pixels + y * image->rowBytes;
+
+        for ( uint32_t x = 0; x < width; x ++ )
+        {
+            bool square = x > width / 4 && x < width / 2 && y > height / 4 && y < height / 2;
+
+            row[ x * 4 + 0 ] = 255;
+            row[ x * 4 + 1 ] = square ? 20  : ( uint8_t ) ( x * 255 / width );
+            row[ x * 4 + 2 ] = square ? 200 : ( uint8_t ) ( y * 255 / height );
+            row[ x * 4 + 3 ] = ( x + seed ) % 4 < 2 ? 40 : 220;
+        }
+    }
+
+    return true;
+}
+
+static bool drawPreset( const Preset * preset, RasterImage * icon )
+{
+    if ( ! rasterImageCreate( icon, ICON_SIZE, ICON_SIZE ) ) return false;
+
+    static const uint8_t plate[ 4 ] = { 255, 235, 240, 245 };
+    RasterTransform      identity   = { 1, 0, 0, 1, 0, 0 };
+
+    rasterFillRect( icon, &identity, ICON_SIZE, ICON_SIZE, plate );
+
+    for ( unsigned int index = 0; index < preset->thumbnails; index ++ )
+    {
+        RasterImage          thumbnail;
+        RasterThumbnailStyle style = styleFor( preset, index );
+        const double       * slot  = preset->slots[ index ];
+
+        if ( ! makeThumbnail( &thumbnail, preset->thumbnailWidth, preset->thumbnailHeight, index ) ) return false;
+
+        bool drawn = rasterDrawThumbnail( icon, slot[ 0 ], slot[ 1 ], slot[ 2 ], slot[ 3 ], &thumbnail, &style );
+
+        rasterImageFree( &thumbnail );
+        if ( ! drawn ) return false;
+    }
+
+    return true;
+}
+
+/* Golden images are PAM files, channels reordered from the engine's ARGB */
+
+static void goldenPath( const Preset * preset, char * path, size_t size )
+{
+    snprintf( path, size, "%s/RasterEngine-%s.pam", GOLDEN_DIRECTORY, preset->name );
+}
+
+static bool writeGolden( const char * path, const RasterImage * image )
+{
+    FILE * file = fopen( path, "wb" );
+
+    if ( file == NULL ) return false;
+
+    fprintf( file, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", image->width, image->height );
+
+    for ( uint32_t y = 0; y < image->height; y ++ )
+    {
+        const uint8_t * row = image->pixels + y * image->rowBytes;
+
+        for ( uint32_t x = 0; x < image->width; x ++ )
+        {
+            uint8_t rgba[ 4 ] = { row[ x * 4 + 1 ], row[ x * 4 + 2 ], row[ x * 4 + 3 ], row[ x * 4 + 0 ] };
+            fwrite( rgba, 1, 4, file );
+        }
+    }
+
+    return fclose( file ) == 0;
+}
+
+static bool readGolden( const char * path, RasterImage * image )
+{
+    FILE     * file = fopen( path, "rb" );
+    unsigned   width, height;
+    bool       read = false;
+
+    if ( file == NULL ) return false;
+
+    if ( fscanf( file, "P7 WIDTH %u HEIGHT %u DEPTH 4 MAXVAL 255 TUPLTYPE RGB_ALPHA ENDHDR", &width, &height ) == 2 &&
+         fgetc( file ) == '\n' && rasterImageCreate( image, width, height ) )
+    {
+        read = true;
+
+        for ( uint32_t y = 0; y < height && read; y ++ )
+        {
+            uint8_t * row = image->pixels + y * image->rowBytes;
+
+            for ( uint32_t x = 0; x < width && read; x ++ )
+            {
+                uint8_t rgba[ 4 ];
+
+                read = fread( rgba, 1, 4, file ) == 4;
+
+                row[ x * 4 + 0 ] = rgba[ 3 ];
+                row[ x * 4 + 1 ] = rgba[ 0 ];
+                row[ x * 4 + 2 ] = rgba[ 1 ];
+                row[ x * 4 + 3 ] = rgba[ 2 ];
+            }
+        }
+    }
+
+    fclose( file );
+    return read;
+}
+
+/* Largest and mean difference in any channel between two images */
+
+static unsigned int difference( const RasterImage * a, const RasterImage * b, double * mean )
+{
+    unsigned int largest = 0;
+    uint64_t     total   = 0;
+
+    for ( uint32_t y = 0; y < a->height; y ++ )
+    {
+        for ( uint32_t x = 0; x < a->width * 4; x ++ )
+        {
+            int delta = abs( a->pixels[ y * a->rowBytes + x ] - b->pixels[ y * b->rowBytes + x ] );
+
+            total += ( unsigned int ) delta;
+            if ( ( unsigned int ) delta > largest ) largest = ( unsigned int ) delta;
+        }
+    }
+
+    *mean = ( double ) total / ( a->width * a->height * 4 );
+    return largest;
+}
+
+/******************************************************************************\
+ * Kernel properties
+\******************************************************************************/
+
+/* A whole-pixel rectangle is filled exactly, with nothing beyond its edges */
+
+static void testFillRect( void )
+{
+    static const uint8_t colour[ 4 ] = { 255, 10, 20, 30 };
+
+    RasterImage     image;
+    RasterTransform transform = { 1, 0, 0, 1, 2, 3 };
+
+    CHECK( rasterImageCreate( &image, 8, 8 ) );
+    rasterFillRect( &image, &transform, 4, 2, colour );
+
+    CHECK( memcmp( image.pixels + ( 8 - 1 - 3 ) * image.rowBytes + 2 * 4, colour, 4 ) == 0 );
+    CHECK( memcmp( image.pixels + ( 8 - 1 - 4 ) * image.rowBytes + 5 * 4, colour, 4 ) == 0 );
+    CHECK_EQUAL( image.pixels[ ( 8 - 1 - 5 ) * image.rowBytes + 2 * 4 ], 0 );
+    CHECK_EQUAL( image.pixels[ ( 8 - 1 - 3 ) * image.rowBytes + 6 * 4 ], 0 );
+
+    rasterImageFree( &image );
+}
+
+/* Source-over: opaque pixels replace, transparent ones leave alone, half
+ * transparent black halves; across widths which exercise every loop tail.
+ */
+
+static void testComposite( void )
+{
+    for ( uint32_t width = 1; width <= 19; width ++ )
+    {
+        RasterImage destination, source;
+
+        CHECK( rasterImageCreate( &destination, width, 3 ) );
+        CHECK( rasterImageCreate( &source,      width, 3 ) );
+
+        for ( uint32_t x = 0; x < width; x ++ )
+        {
+            static const uint8_t under[ 4 ] = { 255, 200, 100, 50 };
+            static const uint8_t over [ 3 ][ 4 ] = { { 255, 1, 2, 3 }, { 0, 0, 0, 0 }, { 128, 0, 0, 0 } };
+
+            for ( uint32_t y = 0; y < 3; y ++ )
+            {
+                memcpy( destination.pixels + y * destination.rowBytes + x * 4, under,      4 );
+                memcpy( source.pixels      + y * source.rowBytes      + x * 4, over[ y ], 4 );
+            }
+        }
+
+        rasterComposite( &destination, &source, 0, 0 );
+
+        const uint8_t * last = destination.pixels + ( width - 1 ) * 4;
+
+        CHECK_EQUAL( last[ 1 ],                              1   );
+        CHECK_EQUAL( last[ destination.rowBytes + 1 ],       200 );
+        CHECK_EQUAL( last[ destination.rowBytes * 2 + 0 ],   255 );
+        CHECK_EQUAL( last[ destination.rowBytes * 2 + 1 ],   100 );
+
+        rasterImageFree( &destination );
+        rasterImageFree( &source      );
+    }
+}
+
+/* Blurs leave the middle of a solid area solid, spread it symmetrically and
+ * keep its total, less what each pass truncates (under a unit per pixel).
+ */
+
+static void testBlurs( void )
+{
+    RasterMask mask;
+
+    CHECK( rasterMaskCreate( &mask, 61, 41 ) );
+
+    for ( uint32_t y = 10; y < 31; y ++ ) memset( mask.alpha + y * mask.rowBytes + 10, 255, 41 );
+
+    uint64_t before = 0, after = 0;
+
+    for ( size_t index = 0; index < mask.rowBytes * mask.height; index ++ ) before += mask.alpha[ index ];
+
+    CHECK( rasterBoxBlur( &mask, 3 ) );
+
+    CHECK_EQUAL( mask.alpha[ 20 * mask.rowBytes + 30 ], 255 );
+    CHECK_EQUAL( mask.alpha[ 20 * mask.rowBytes + 8  ], mask.alpha[ 20 * mask.rowBytes + 52 ] );
+    CHECK_EQUAL( mask.alpha[ 8  * mask.rowBytes + 30 ], mask.alpha[ 32 * mask.rowBytes + 30 ] );
+
+    CHECK( rasterGaussianBlur( &mask, 2.5 ) );
+
+    for ( size_t index = 0; index < mask.rowBytes * mask.height; index ++ ) after += mask.alpha[ index ];
+
+    CHECK( llabs( ( long long ) after - ( long long ) before ) < ( long long ) before / 50 );
+    CHECK_EQUAL( mask.alpha[ 20 * mask.rowBytes + 30 ], 255 );
+
+    rasterMaskFree( &mask );
+}
+
+/******************************************************************************\
+ * Presets
+\******************************************************************************/
+
+#ifdef __APPLE__
+
+    /* The icon generator's CoreGraphics drawing for one thumbnail, without
+     * the sprite cache.
+     */
+
+    static void drawWithCoreGraphics( CGContextRef context, const Preset * preset, unsigned int index, const RasterImage * thumbnail )
+    {
+        RasterThumbnailStyle style  = styleFor( preset, index );
+        const double       * slot   = preset->slots[ index ];
+        double               scale  = slot[ 2 ] / CANVAS_SIZE;
+        CGColorSpaceRef      space  = CGColorSpaceCreateDeviceRGB();
+        CGContextRef         source = CGBitmapContextCreate( thumbnail->pixels, thumbnail->width, thumbnail->height, 8,
+                                                             thumbnail->rowBytes, space, kCGImageAlphaPremultipliedFirst );
+        CGImageRef           image  = CGBitmapContextCreateImage( source );
+        CGColorRef           grey   = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
+        CGRect               rect   = CGRectMake( -style.thumbSize / 2, -style.thumbSize / 2, style.thumbSize, style.thumbSize );
+
+        if ( style.fit )
+        {
+            double scaled = thumbnail->width * ( rect.size.height / thumbnail->height );
+
+            rect.origin.x   += ( rect.size.width - scaled ) / 2;
+            rect.size.width  = scaled;
+        }
+
+        CGContextSaveGState  ( context );
+        CGContextTranslateCTM( context, slot[ 0 ], slot[ 1 ] );
+        CGContextScaleCTM    ( context, scale, scale );
+        CGContextClipToRect  ( context, CGRectMake( 0, 0, CANVAS_SIZE, CANVAS_SIZE ) );
+
+        CGContextBeginTransparencyLayer( context, NULL );
+        CGContextTranslateCTM( context, CANVAS_SIZE / 2.0, CANVAS_SIZE / 2.0 );
+        CGContextRotateCTM   ( context, style.angle );
+
+        if ( preset->coverArt ) CGContextSetShadowWithColor( context, CGSizeMake( 0, style.shadowOffsetY ), style.shadowSigma * 2, grey );
+        else                    CGContextSetShadow         ( context, CGSizeMake( 0, style.shadowOffsetY ), style.shadowSigma * 2       );
+
+        if ( style.borderSize > 0 )
+        {
+            CGContextSetRGBFillColor( context, 1, 1, 1, 1 );
+            CGContextFillRect( context, CGRectMake( -style.borderSize / 2, -style.borderSize / 2, style.borderSize, style.borderSize ) );
+            CGContextSetShadowWithColor( context, CGSizeZero, 0, NULL );
+        }
+
+        CGContextDrawImage( context, rect, image );
+        CGContextEndTransparencyLayer( context );
+        CGContextRestoreGState( context );
+
+        CGColorRelease     ( grey   );
+        CGImageRelease     ( image  );
+        CGContextRelease   ( source );
+        CGColorSpaceRelease( space  );
+    }
+
+    static void compareWithCoreGraphics( const Preset * preset, const RasterImage * icon )
+    {
+        RasterImage     reference;
+        CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+
+        CHECK( rasterImageCreate( &reference, ICON_SIZE, ICON_SIZE ) );
+
+        CGContextRef context = CGBitmapContextCreate( reference.pixels, ICON_SIZE, ICON_SIZE, 8, reference.rowBytes,
+                                                      space, kCGImageAlphaPremultipliedFirst );
+
+        CGContextSetRGBFillColor( context, 235 / 255.0, 240 / 255.0, 245 / 255.0, 1 );
+        CGContextFillRect( context, CGRectMake( 0, 0, ICON_SIZE, ICON_SIZE ) );
+        CGContextSetInterpolationQuality( context, kCGInterpolationHigh );
+
+        for ( unsigned int index = 0; index < preset->thumbnails; index ++ )
+        {
+            RasterImage thumbnail;
+
+            CHECK( makeThumbnail( &thumbnail, preset->thumbnailWidth, preset->thumbnailHeight, index ) );
+            drawWithCoreGraphics( context, preset, index, &thumbnail );
+            rasterImageFree( &thumbnail );
+        }
+
+        CGContextFlush( context );
+
+        double       mean;
+        unsigned int largest = difference( icon, &reference, &mean );
+
+        printf( "%-8s against CoreGraphics: mean difference %.2f, largest %u\n", preset->name, mean, largest );
+        CHECK( mean < 3 );
+
+        CGContextRelease   ( context );
+        CGColorSpaceRelease( space   );
+        rasterImageFree( &reference );
+    }
+
+#endif
+
+static void testPresets( bool writeGoldens )
+{
+    for ( size_t item = 0; item < PRESETS; item ++ )
+    {
+        const Preset * preset = &presets[ item ];
+        RasterImage    icon, golden;
+        char           path[ 4096 ];
+
+        goldenPath( preset, path, sizeof( path ) );
+        CHECK( drawPreset( preset, &icon ) );
+
+        if ( writeGoldens )
+        {
+            CHECK( writeGolden( path, &icon ) );
+        }
+        else if ( readGolden( path, &golden ) )
+        {
+            double       mean;
+            unsigned int largest = golden.width == icon.width && golden.height == icon.height
+                                 ? difference( &icon, &golden, &mean )
+                                 : 256;
+
+            if ( largest > TOLERANCE ) fprintf( stderr, "%s: differs from %s by up to %u\n", preset->name, path, largest );
+            CHECK( largest <= TOLERANCE );
+
+            rasterImageFree( &golden );
+        }
+        else
+        {
+            fprintf( stderr, "Can't read %s\n", path );
+            CHECK( false );
+        }
+
+        #ifdef __APPLE__
+            compareWithCoreGraphics( preset, &icon );
+        #endif
+
+        rasterImageFree( &icon );
+    }
+}
+
+int main( int argc, char ** argv )
+{
+    printf( "Kernels: %s\n", rasterEngineKernels() );
+
+    testFillRect ();
+    testComposite();
+    testBlurs    ();
+    testPresets  ( argc > 1 && strcmp( argv[ 1 ], "--write-goldens" ) == 0 );
+
+    return testFinish( "RasterEngineTests" );
+}
@@ -0,0 +1,77 @@
+/******************************************************************************\
+ * Tests: ReducedDecodeBenchmark.c
+ *
+ * Time decoding a large JPEG at full size and at the reduced size planned for
+ * a thumbnail, with the portable libjpeg backend of "ReducedDecode.h", for a
+ * range of thumbnail sizes. Only built where libjpeg is available.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ReducedDecode.h"
+#include "JPEGSupport.h"
+
+static double timeDecode( const char * path, const ReducedDecodePlan * plan, unsigned int rounds, ReducedDecodeImage * image )
+{
+    double started = testSeconds();
+
+    for ( unsigned int round = 0; round < rounds; round ++ )
+    {
+        reducedDecodeImageFree( image );
+
+        if ( reducedDecodeJPEG( path, plan, image ) != 0 ) return -1;
+    }
+
+    return ( testSeconds() - started ) / rounds;
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    uint32_t     width   = quick ? 1200 : 6000;
+    uint32_t     height  = quick ?  800 : 4000;
+    unsigned int rounds  = quick ? 1 : 5;
+    char       * scratch = testMakeDirectory( "ReducedDecodeBenchmark" );
+    char         path[ 4096 ];
+
+    static const double targets[] = { 64, 128, 256, 512, 1024 };
+
+    snprintf( path, sizeof( path ), "%s/image.jpg", scratch );
+
+    if ( jpegSupportWrite( path, width, height, 90 ) == false )
+    {
+        fprintf( stderr, "Can't write %s\n", path );
+        return EXIT_FAILURE;
+    }
+
+    ReducedDecodeImage image = { 0 };
+    double             full  = timeDecode( path, NULL, rounds, &image );
+
+    printf( "%ux%u JPEG, full decode %.1fms\n\n", width, height, full * 1e3 );
+    printf( "Target  Crop  Decoded      Time      Speedup\n" );
+
+    for ( size_t item = 0; item < sizeof( targets ) / sizeof( targets[ 0 ] ); item ++ )
+    {
+        for ( int crop = 1; crop >= 0; crop -- )
+        {
+            ReducedDecodePlan plan;
+
+            reducedDecodePlan( width, height, targets[ item ], targets[ item ], crop, &plan );
+
+            double reduced = timeDecode( path, &plan, rounds, &image );
+
+            printf( "%6.0f  %-4s  %4ux%-4u  %7.1fms  %6.1fx\n",
+                    targets[ item ], crop ? "yes" : "no", image.width, image.height,
+                    reduced * 1e3, full / reduced );
+        }
+    }
+
+    reducedDecodeImageFree( &image );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+/******************************************************************************\
+ * Tests: ReducedDecodeTests.c
+ *
+ * Tests for "ReducedDecode.h": the scale and sizes planned for cropped and
+ * fitted targets; golden images of a small asymmetric picture drawn in each
+ * EXIF orientation, fitted, cropped and stretched; and, where libjpeg is
+ * available, that JPEGs decoded to a plan still cover the target.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#include "ReducedDecode.h"
+
+#ifdef REDUCED_DECODE_LIBJPEG
+    #include "JPEGSupport.h"
+#endif
+
+/* Plans for a 6000x4000 camera image in a 512x512 target */
+
+static void testPlans( void )
+{
+    ReducedDecodePlan plan;
+
+    /* Cropping draws the 4000x4000 square over the target: 512/4000 */
+
+    reducedDecodePlan( 6000, 4000, 512, 512, true, &plan );
+
+    CHECK( fabs( plan.scale - 0.128 ) < 1e-9 );
+    CHECK_EQUAL( plan.maximumPixelSize,     768 );
+    CHECK_EQUAL( plan.jpegScaleDenominator, 4   );
+
+    /* Fitting draws the whole 6000 pixel width in 512, needing 512x342; an
+     * eighth (750x500) covers that.
+     */
+
+    reducedDecodePlan( 6000, 4000, 512, 512, false, &plan );
+
+    CHECK( fabs( plan.scale - 512.0 / 6000.0 ) < 1e-9 );
+    CHECK_EQUAL( plan.maximumPixelSize,     512 );
+    CHECK_EQUAL( plan.jpegScaleDenominator, 8   );
+
+    /* An image no bigger than needed, or with no size, is decoded in full */
+
+    reducedDecodePlan( 400, 300, 512, 512, true, &plan );
+
+    CHECK_EQUAL( plan.maximumPixelSize,     0 );
+    CHECK_EQUAL( plan.jpegScaleDenominator, 1 );
+    CHECK( plan.scale > 1 );
+
+    reducedDecodePlan( 0, 300, 512, 512, true, &plan );
+
+    CHECK_EQUAL( plan.maximumPixelSize, 0 );
+    CHECK( plan.scale == 1 );
+
+    /* Denominators never leave the image short: 1000x1000 into 300x300 needs
+     * a quarter (250) to be rejected in favour of a half (500).
+     */
+
+    reducedDecodePlan( 1000, 1000, 300, 300, true, &plan );
+
+    CHECK_EQUAL( plan.jpegScaleDenominator, 2 );
+
+    /* Coverage, for picking among the images of a multi-resolution file */
+
+    CHECK(   reducedDecodeCovers( 512,  512, 512, 512, true  ) );
+    CHECK(   reducedDecodeCovers( 1024, 512, 512, 512, false ) );
+    CHECK( ! reducedDecodeCovers( 1024, 256, 512, 512, true  ) );
+    CHECK( ! reducedDecodeCovers( 256,  256, 512, 512, false ) );
+    CHECK( ! reducedDecodeCovers( 0,    256, 512, 512, false ) );
+}
+
+/* A 4x2 picture with a different value in every pixel, stored top row first
+ * as a decoder would produce it.
+ */
+
+#define PICTURE_WIDTH  4
+#define PICTURE_HEIGHT 2
+
+static const int picture[ PICTURE_HEIGHT ][ PICTURE_WIDTH ] =
+{
+    { 1, 2, 3, 4 },
+    { 5, 6, 7, 8 }
+};
+
+/* What a viewer should show at column x, row y (top row first) of the
+ * picture in the given EXIF orientation, straight from the EXIF definitions
+ * of what the stored rows and columns become.
+ */
+
+static int displayed( unsigned int orientation, int x, int y )
+{
+    const int w = PICTURE_WIDTH;
+    const int h = PICTURE_HEIGHT;
+
+    switch ( orientation )
+    {
+        default:
+        case 1: return picture[ y         ][ x         ];
+        case 2: return picture[ y         ][ w - 1 - x ];
+        case 3: return picture[ h - 1 - y ][ w - 1 - x ];
+        case 4: return picture[ h - 1 - y ][ x         ];
+        case 5: return picture[ x         ][ y         ];
+        case 6: return picture[ h - 1 - x ][ y         ];
+        case 7: return picture[ h - 1 - x ][ w - 1 - y ];
+        case 8: return picture[ x         ][ w - 1 - y ];
+    }
+}
+
+/* Draw the picture through a plan as CoreGraphics would with nearest
+ * neighbour sampling: each bitmap pixel's centre is mapped back into the
+ * picture, drawn into (0, 0, width, height) with its top row at the top.
+ * The bitmap is returned top row first; -1 marks pixels the picture missed.
+ */
+
+static void render( const ReducedDecodeDraw * draw, int * bitmap )
+{
+    const ReducedDecodeTransform * t           = &draw->transform;
+    double                         determinant = t->a * t->d - t->b * t->c;
+
+    for ( uint32_t row = 0; row < draw->height; row ++ )
+    {
+        for ( uint32_t column = 0; column < draw->width; column ++ )
+        {
+            double X = column + 0.5 - t->tx;
+            double Y = ( draw->height - 1 - row ) + 0.5 - t->ty;
+            double u = (   t->d * X - t->c * Y ) / determinant;
+            double v = ( - t->b * X + t->a * Y ) / determinant;
+            int    x = ( int ) floor( u );
+            int    y = PICTURE_HEIGHT - 1 - ( int ) floor( v );
+
+            bitmap[ row * draw->width + column ] =
+                x >= 0 && x < PICTURE_WIDTH && y >= 0 && y < PICTURE_HEIGHT ? picture[ y ][ x ] : -1;
+        }
+    }
+}
+
+/* Every orientation, fitted at the same size, at double size, cropped to a
+ * square (middle of landscape, top of portrait) and stretched, matches the
+ * picture as a viewer would show it, pixel for pixel.
+ */
+
+static void testOrientations( void )
+{
+    int bitmap[ 64 ];
+
+    for ( unsigned int orientation = 1; orientation <= 8; orientation ++ )
+    {
+        bool              turned = orientation >= 5;
+        int               width  = turned ? PICTURE_HEIGHT : PICTURE_WIDTH;
+        int               height = turned ? PICTURE_WIDTH  : PICTURE_HEIGHT;
+        ReducedDecodeDraw draw;
+        unsigned int      wrong  = 0;
+
+        for ( int scale = 1; scale <= 2; scale ++ )
+        {
+            reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, orientation, 1, 1,
+                                 8 * scale, 8 * scale, reducedDecodeFitWhole, &draw );
+
+            /* Fitting 4x2 into 8x8 doubles it; into 16x16, quadruples it */
+
+            CHECK_EQUAL( draw.width,  width  * 2 * scale );
+            CHECK_EQUAL( draw.height, height * 2 * scale );
+
+            if ( draw.width * draw.height > sizeof( bitmap ) / sizeof( bitmap[ 0 ] ) ) continue;
+
+            render( &draw, bitmap );
+
+            for ( int y = 0; y < ( int ) draw.height; y ++ )
+            {
+                for ( int x = 0; x < ( int ) draw.width; x ++ )
+                {
+                    wrong += bitmap[ y * draw.width + x ] != displayed( orientation, x / ( 2 * scale ), y / ( 2 * scale ) );
+                }
+            }
+        }
+
+        /* Cropped to 2x2: the middle two columns of a landscape result, or the
+         * top two rows of a portrait one.
+         */
+
+        reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, orientation, 1, 1,
+                             2, 2, reducedDecodeFitCrop, &draw );
+
+        CHECK_EQUAL( draw.width,  2 );
+        CHECK_EQUAL( draw.height, 2 );
+
+        render( &draw, bitmap );
+
+        for ( int y = 0; y < 2; y ++ )
+        {
+            for ( int x = 0; x < 2; x ++ )
+            {
+                wrong += bitmap[ y * 2 + x ] != displayed( orientation, turned ? x : x + 1, y );
+            }
+        }
+
+        /* Stretched unevenly: each result pixel becomes a 2x3 block */
+
+        reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, orientation, 1, 1,
+                             width * 2, height * 3, reducedDecodeFitStretch, &draw );
+
+        CHECK_EQUAL( draw.width,  width  * 2 );
+        CHECK_EQUAL( draw.height, height * 3 );
+
+        render( &draw, bitmap );
+
+        for ( int y = 0; y < ( int ) draw.height; y ++ )
+        {
+            for ( int x = 0; x < ( int ) draw.width; x ++ )
+            {
+                int wantX = x * width  / ( int ) draw.width;
+                int wantY = y * height / ( int ) draw.height;
+
+                wrong += bitmap[ y * draw.width + x ] != displayed( orientation, wantX, wantY );
+            }
+        }
+
+        if ( wrong != 0 ) fprintf( stderr, "Orientation %u: %u pixels wrong\n", orientation, wrong );
+
+        CHECK_EQUAL( wrong, 0 );
+    }
+}
+
+/* Pixels twice as tall as they are wide make the 4x2 picture square; turned
+ * on its side, it is still square. Out-of-range orientations are taken as 1.
+ */
+
+static void testPixelAspect( void )
+{
+    ReducedDecodeDraw draw;
+    int               bitmap[ 64 ];
+
+    reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, 1, 1, 2, 8, 8, reducedDecodeFitWhole, &draw );
+
+    CHECK_EQUAL( draw.width,  8 );
+    CHECK_EQUAL( draw.height, 8 );
+
+    render( &draw, bitmap );
+
+    CHECK_EQUAL( bitmap[ 0       ], 1 );
+    CHECK_EQUAL( bitmap[ 7       ], 4 );
+    CHECK_EQUAL( bitmap[ 3  * 8  ], 1 );
+    CHECK_EQUAL( bitmap[ 4  * 8  ], 5 );
+    CHECK_EQUAL( bitmap[ 63      ], 8 );
+
+    reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, 6, 1, 2, 8, 8, reducedDecodeFitWhole, &draw );
+
+    CHECK_EQUAL( draw.width,  8 );
+    CHECK_EQUAL( draw.height, 8 );
+
+    reducedDecodeOrient( PICTURE_WIDTH, PICTURE_HEIGHT, 9, 1, 1, 8, 8, reducedDecodeFitWhole, &draw );
+    render( &draw, bitmap );
+
+    CHECK_EQUAL( bitmap[ 0 ], 1 );
+}
+
+#ifdef REDUCED_DECODE_LIBJPEG
+
+/* Decoding to a plan gives the planned denominator's size, which covers the
+ * target, for odd sizes too; and a full decode gives the full size.
+ */
+
+static void testDecodes( const char * scratch )
+{
+    static const uint32_t sizes[][ 2 ] = { { 1201, 799 }, { 640, 480 }, { 333, 1000 } };
+    char                  path[ 4096 ];
+
+    snprintf( path, sizeof( path ), "%s/image.jpg", scratch );
+
+    for ( size_t item = 0; item < sizeof( sizes ) / sizeof( sizes[ 0 ] ); item ++ )
+    {
+        uint32_t           width  = sizes[ item ][ 0 ];
+        uint32_t           height = sizes[ item ][ 1 ];
+        ReducedDecodePlan  plan;
+        ReducedDecodeImage image;
+
+        CHECK( jpegSupportWrite( path, width, height, 90 ) );
+
+        for ( int crop = 0; crop < 2; crop ++ )
+        {
+            reducedDecodePlan( width, height, 128, 128, crop, &plan );
+
+            CHECK_EQUAL( reducedDecodeJPEG( path, &plan, &image ), 0 );
+            CHECK_EQUAL( image.width,  ( width  + plan.jpegScaleDenominator - 1 ) / plan.jpegScaleDenominator );
+            CHECK_EQUAL( image.height, ( height + plan.jpegScaleDenominator - 1 ) / plan.jpegScaleDenominator );
+            CHECK( reducedDecodeCovers( image.width, image.height, 128, 128, crop ) );
+
+            reducedDecodeImageFree( &image );
+        }
+
+        CHECK_EQUAL( reducedDecodeJPEG( path, NULL, &image ), 0 );
+        CHECK_EQUAL( image.width,  width  );
+        CHECK_EQUAL( image.height, height );
+
+        reducedDecodeImageFree( &image );
+    }
+
+    /* Missing and corrupt files fail cleanly */
+
+    ReducedDecodeImage image;
+
+    snprintf( path, sizeof( path ), "%s/missing.jpg", scratch );
+    CHECK_EQUAL( reducedDecodeJPEG( path, NULL, &image ), ENOENT );
+
+    snprintf( path, sizeof( path ), "%s/corrupt.jpg", scratch );
+    CHECK( testWriteFile( path, 100 ) );
+    CHECK_EQUAL( reducedDecodeJPEG( path, NULL, &image ), EINVAL );
+    CHECK( image.pixels == NULL );
+}
+
+#endif
+
+int main( void )
+{
+    char * scratch = testMakeDirectory( "ReducedDecodeTests" );
+
+    testPlans       ();
+    testOrientations();
+    testPixelAspect ();
+
+    #ifdef REDUCED_DECODE_LIBJPEG
+        testDecodes( scratch );
+    #endif
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return testFinish( "ReducedDecodeTests" );
+}
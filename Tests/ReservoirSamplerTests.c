@@ -0,0 +1,230 @@
+/******************************************************************************\
+ * Tests: ReservoirSamplerTests.c
+ *
+ * Tests for "ReservoirSampler.h": the same seed and input give the same
+ * sample; offering no more items than the sample size keeps them all; "keep
+ * first" mode keeps the first items in order and then refuses more; freeing
+ * a sampler empties it for reuse; and, over many seeds, each of n items
+ * offered ends up in a sample of k with probability k / n, and in the first
+ * slot with probability 1 / n, by chi-square tests. Seeds are fixed, so the
+ * results are the same on every run.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ReservoirSampler.h"
+
+#define ITEMS            20
+#define SEEDS            20000
+#define CHI_SQUARE_LIMIT 43.82 /* 19 degrees of freedom, p = 0.001 */
+
+/* Offer "item0" to "item<count - 1>" to a sampler and finish it */
+
+static size_t offer( ReservoirSampler * sampler, unsigned int count )
+{
+    char item[ 32 ];
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        snprintf( item, sizeof( item ), "item%u", index );
+        reservoirSamplerOffer( sampler, item );
+    }
+
+    return reservoirSamplerFinish( sampler );
+}
+
+/* Out: Index of a sampled item, from its name */
+
+static unsigned int itemNumber( const char * item )
+{
+    return ( unsigned int ) strtoul( item + 4, NULL, 10 );
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+static void testSameSeed( void )
+{
+    ReservoirSampler first, second;
+    unsigned int     differentSeeds = 0;
+
+    reservoirSamplerInit( &first,  4, 1234, false );
+    reservoirSamplerInit( &second, 4, 1234, false );
+
+    CHECK_EQUAL( offer( &first,  1000 ), 4 );
+    CHECK_EQUAL( offer( &second, 1000 ), 4 );
+
+    for ( size_t index = 0; index < 4; index ++ )
+    {
+        CHECK( strcmp( reservoirSamplerItem( &first, index ), reservoirSamplerItem( &second, index ) ) == 0 );
+    }
+
+    reservoirSamplerFree( &second );
+
+    /* Other seeds should mostly give other samples */
+
+    for ( uint64_t seed = 1; seed <= 10; seed ++ )
+    {
+        reservoirSamplerInit( &second, 4, seed, false );
+        offer( &second, 1000 );
+
+        for ( size_t index = 0; index < 4; index ++ )
+        {
+            if ( strcmp( reservoirSamplerItem( &first, index ), reservoirSamplerItem( &second, index ) ) != 0 )
+            {
+                differentSeeds ++;
+                break;
+            }
+        }
+
+        reservoirSamplerFree( &second );
+    }
+
+    CHECK( differentSeeds >= 9 );
+
+    reservoirSamplerFree( &first );
+}
+
+/* Up to 'capacity' items are all kept, in some order; capacities out of
+ * range are clamped.
+ */
+
+static void testKeepsEverything( void )
+{
+    ReservoirSampler sampler;
+
+    for ( unsigned int count = 0; count <= 4; count ++ )
+    {
+        unsigned int seen = 0;
+
+        reservoirSamplerInit( &sampler, 4, count, false );
+
+        CHECK_EQUAL( offer( &sampler, count ), count );
+
+        for ( size_t index = 0; index < count; index ++ ) seen |= 1u << itemNumber( reservoirSamplerItem( &sampler, index ) );
+
+        CHECK_EQUAL( seen, ( 1u << count ) - 1 );
+        CHECK( reservoirSamplerItem( &sampler, count ) == NULL );
+
+        reservoirSamplerFree( &sampler );
+    }
+
+    reservoirSamplerInit( &sampler, 0, 1, false );
+    CHECK_EQUAL( sampler.capacity, 1 );
+    CHECK_EQUAL( offer( &sampler, 10 ), 1 );
+    reservoirSamplerFree( &sampler );
+
+    reservoirSamplerInit( &sampler, RESERVOIR_SAMPLER_MAXIMUM + 5, 1, false );
+    CHECK_EQUAL( sampler.capacity, RESERVOIR_SAMPLER_MAXIMUM );
+    CHECK_EQUAL( offer( &sampler, 10 ), RESERVOIR_SAMPLER_MAXIMUM );
+    reservoirSamplerFree( &sampler );
+}
+
+static void testKeepFirst( void )
+{
+    ReservoirSampler sampler;
+    char             item[ 32 ];
+
+    reservoirSamplerInit( &sampler, 3, 99, true );
+
+    for ( unsigned int index = 0; index < 10; index ++ )
+    {
+        snprintf( item, sizeof( item ), "item%u", index );
+        CHECK_EQUAL( reservoirSamplerOffer( &sampler, item ), index < 3 );
+    }
+
+    CHECK_EQUAL( reservoirSamplerFinish( &sampler ), 3 );
+    CHECK_EQUAL( sampler.seen, 3 );
+
+    for ( size_t index = 0; index < 3; index ++ )
+    {
+        snprintf( item, sizeof( item ), "item%zu", index );
+        CHECK( strcmp( reservoirSamplerItem( &sampler, index ), item ) == 0 );
+    }
+
+    reservoirSamplerFree( &sampler );
+}
+
+static void testFree( void )
+{
+    ReservoirSampler sampler;
+
+    reservoirSamplerInit( &sampler, 4, 7, false );
+    offer( &sampler, 50 );
+    reservoirSamplerFree( &sampler );
+
+    CHECK_EQUAL( sampler.count, 0 );
+    CHECK( reservoirSamplerItem( &sampler, 0 ) == NULL );
+
+    for ( size_t index = 0; index < RESERVOIR_SAMPLER_MAXIMUM; index ++ ) CHECK( sampler.items[ index ] == NULL );
+
+    /* Freeing twice is harmless, and the sampler can be used again */
+
+    reservoirSamplerFree( &sampler );
+    reservoirSamplerInit( &sampler, 2, 7, true );
+
+    CHECK_EQUAL( offer( &sampler, 5 ), 2 );
+    CHECK( strcmp( reservoirSamplerItem( &sampler, 0 ), "item0" ) == 0 );
+
+    reservoirSamplerFree( &sampler );
+}
+
+/* Out: Chi-square statistic of observed counts against one expectation */
+
+static double chiSquare( const unsigned int * observed, size_t count, double expected )
+{
+    double total = 0;
+
+    for ( size_t index = 0; index < count; index ++ )
+    {
+        double difference = observed[ index ] - expected;
+        total += difference * difference / expected;
+    }
+
+    return total;
+}
+
+static void testUniform( void )
+{
+    unsigned int picked[ ITEMS ] = { 0 };
+    unsigned int first [ ITEMS ] = { 0 };
+    size_t       k               = 4;
+
+    for ( uint64_t seed = 0; seed < SEEDS; seed ++ )
+    {
+        ReservoirSampler sampler;
+
+        reservoirSamplerInit( &sampler, k, seed * 7919 + 1, false );
+
+        CHECK_EQUAL( offer( &sampler, ITEMS ), k );
+
+        for ( size_t index = 0; index < k; index ++ ) picked[ itemNumber( reservoirSamplerItem( &sampler, index ) ) ] ++;
+
+        first[ itemNumber( reservoirSamplerItem( &sampler, 0 ) ) ] ++;
+
+        reservoirSamplerFree( &sampler );
+    }
+
+    double sampled = chiSquare( picked, ITEMS, ( double ) SEEDS * k / ITEMS );
+    double leading = chiSquare( first,  ITEMS, ( double ) SEEDS     / ITEMS );
+
+    printf( "Chi-square over %u seeds: sampled %.2f, first slot %.2f (limit %.2f)\n",
+            SEEDS, sampled, leading, CHI_SQUARE_LIMIT );
+
+    CHECK( sampled < CHI_SQUARE_LIMIT );
+    CHECK( leading < CHI_SQUARE_LIMIT );
+}
+
+int main( void )
+{
+    testSameSeed       ();
+    testKeepsEverything();
+    testKeepFirst      ();
+    testFree           ();
+    testUniform        ();
+
+    return testFinish( "ReservoirSamplerTests" );
+}
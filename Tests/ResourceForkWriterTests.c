@@ -0,0 +1,307 @@
+/******************************************************************************\
+ * Tests: ResourceForkWriterTests.c
+ *
+ * Tests for "ResourceForkWriter.h": a fork built here must parse back with one
+ * resource, found as 'icns' ID -16455 with the icon family's exact bytes; a
+ * fork with more resources, as the Resource Manager writes, must be counted
+ * and searched too, and damage detected. Custom icons saved to a file and a
+ * folder through extended attributes must then be recognised, while a file
+ * whose fork holds more than an icon is left alone, with no hash kept.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <sys/xattr.h>
+
+#include "ResourceForkWriter.h"
+
+/* As in "ResourceForkWriter.c" */
+
+#ifdef __APPLE__
+    #define FORK_ATTRIBUTE        XATTR_RESOURCEFORK_NAME
+    #define FINDER_INFO_ATTRIBUTE XATTR_FINDERINFO_NAME
+    #define HASH_ATTRIBUTE        "uk.org.pond.addfoldericons.icnshash"
+
+    #define getAttribute( path, name, value, size ) getxattr   ( path, name, value, size, 0, XATTR_NOFOLLOW )
+    #define setAttribute( path, name, value, size ) setxattr   ( path, name, value, size, 0, XATTR_NOFOLLOW )
+    #define removeAttribute( path, name )           removexattr( path, name, XATTR_NOFOLLOW )
+#else
+    #define FORK_ATTRIBUTE        "user.com.apple.ResourceFork"
+    #define FINDER_INFO_ATTRIBUTE "user.com.apple.FinderInfo"
+    #define HASH_ATTRIBUTE        "user.uk.org.pond.addfoldericons.icnshash"
+
+    #define getAttribute( path, name, value, size ) lgetxattr   ( path, name, value, size )
+    #define setAttribute( path, name, value, size ) lsetxattr   ( path, name, value, size, 0 )
+    #define removeAttribute( path, name )           lremovexattr( path, name )
+#endif
+
+#define TEXT_TYPE 0x54455854 /* 'TEXT' */
+
+static void put16( uint8_t * bytes, uint16_t value )
+{
+    bytes[ 0 ] = ( uint8_t ) ( value >> 8 );
+    bytes[ 1 ] = ( uint8_t ) value;
+}
+
+static void put32( uint8_t * bytes, uint32_t value )
+{
+    put16( bytes,     ( uint16_t ) ( value >> 16 ) );
+    put16( bytes + 2, ( uint16_t ) value           );
+}
+
+static uint32_t get32( const uint8_t * bytes )
+{
+    return ( uint32_t ) bytes[ 0 ] << 24 | ( uint32_t ) bytes[ 1 ] << 16 | ( uint32_t ) bytes[ 2 ] << 8 | bytes[ 3 ];
+}
+
+/* A made-up icon family of the given size */
+
+static uint8_t * makeIcon( size_t size, unsigned int seed )
+{
+    uint8_t * icns = malloc( size );
+
+    for ( size_t i = 0; i < size; i ++ ) icns[ i ] = ( uint8_t ) rand_r( &seed );
+    return icns;
+}
+
+/* Build a fork as the Resource Manager might: two types, 'TEXT' with IDs 128
+ * and 129 then 'icns' with the custom icon, with the data in a different
+ * order to the map. Return its size.
+ */
+
+static size_t buildMixedFork( uint8_t * fork, const uint8_t * icns, size_t icnsSize )
+{
+    static const char * texts[] = { "first", "second" };
+
+    size_t    dataOffset = 256;
+    size_t    offsets[ 3 ];
+    size_t    data       = 0;
+    uint8_t * out        = fork + dataOffset;
+
+    memset( fork, 0, dataOffset );
+
+    for ( int i = 0; i < 2; i ++ )
+    {
+        offsets[ i ] = data;
+        put32( out + data, ( uint32_t ) strlen( texts[ i ] ) );
+        memcpy( out + data + 4, texts[ i ], strlen( texts[ i ] ) );
+        data += 4 + strlen( texts[ i ] );
+    }
+
+    offsets[ 2 ] = data;
+    put32( out + data, ( uint32_t ) icnsSize );
+    memcpy( out + data + 4, icns, icnsSize );
+    data += 4 + icnsSize;
+
+    /* Map: header, type list of two, three references */
+
+    size_t    mapOffset = dataOffset + data;
+    size_t    mapSize   = 28 + 2 + 2 * 8 + 3 * 12;
+    uint8_t * map       = fork + mapOffset;
+
+    memset( map, 0, mapSize );
+
+    put32( fork,      ( uint32_t ) dataOffset );
+    put32( fork + 4,  ( uint32_t ) mapOffset  );
+    put32( fork + 8,  ( uint32_t ) data       );
+    put32( fork + 12, ( uint32_t ) mapSize    );
+    memcpy( map, fork, 16 );
+
+    put16( map + 24, 28                   );
+    put16( map + 26, ( uint16_t ) mapSize );
+
+    uint8_t * types = map + 28;
+
+    put16( types,      1                       );
+    put32( types + 2,  TEXT_TYPE               );
+    put16( types + 6,  1                       );
+    put16( types + 8,  2 + 2 * 8               );
+    put32( types + 10, RESOURCE_FORK_ICON_TYPE );
+    put16( types + 14, 0                       );
+    put16( types + 16, 2 + 2 * 8 + 2 * 12      );
+
+    uint8_t * references = types + 2 + 2 * 8;
+
+    for ( int i = 0; i < 3; i ++ )
+    {
+        uint8_t * reference = references + i * 12;
+
+        put16( reference,     ( uint16_t ) ( i < 2 ? 128 + i : RESOURCE_FORK_ICON_ID ) );
+        put16( reference + 2, 0xFFFF                                                     );
+        put32( reference + 4, ( uint32_t ) offsets[ i ]                                  );
+    }
+
+    return mapOffset + mapSize;
+}
+
+/******************************************************************************\
+ * Parsing
+\******************************************************************************/
+
+static void testBuildAndFind( void )
+{
+    size_t          icnsSize = 5000;
+    uint8_t       * icns     = makeIcon( icnsSize, 1 );
+    size_t          size     = resourceForkSize( icnsSize );
+    uint8_t       * fork     = malloc( size + 1 );
+    const uint8_t * data     = NULL;
+    size_t          dataSize = 0;
+
+    CHECK_EQUAL( resourceForkBuild( icns, icnsSize, fork, size - 1 ), 0    );
+    CHECK_EQUAL( resourceForkBuild( icns, icnsSize, fork, size     ), size );
+
+    /* Header: data at 256 holding one length-prefixed resource, then the
+     * map, which runs to the end of the fork.
+     */
+
+    CHECK_EQUAL( get32( fork       ),                      256                );
+    CHECK_EQUAL( get32( fork + 4   ),                      256 + 4 + icnsSize );
+    CHECK_EQUAL( get32( fork + 8   ),                      4 + icnsSize       );
+    CHECK_EQUAL( get32( fork + 4   ) + get32( fork + 12 ), size               );
+    CHECK_EQUAL( get32( fork + 256 ),                      icnsSize           );
+
+    CHECK_EQUAL( resourceForkCount( fork, size ), 1 );
+
+    CHECK( resourceForkFind( fork, size, RESOURCE_FORK_ICON_TYPE, RESOURCE_FORK_ICON_ID, &data, &dataSize ) );
+    CHECK( data == fork + 260 );
+    CHECK_EQUAL( dataSize, icnsSize );
+    CHECK( data && memcmp( data, icns, icnsSize ) == 0 );
+
+    CHECK( ! resourceForkFind( fork, size, RESOURCE_FORK_ICON_TYPE, 128,                   &data, &dataSize ) );
+    CHECK( ! resourceForkFind( fork, size, TEXT_TYPE,               RESOURCE_FORK_ICON_ID, &data, &dataSize ) );
+
+    /* Truncated, or with the map or data pointing outside the fork */
+
+    CHECK_EQUAL( resourceForkCount( fork, size - 1 ), -1 );
+    CHECK_EQUAL( resourceForkCount( fork, 10       ), -1 );
+    CHECK( ! resourceForkFind( fork, size - 1, RESOURCE_FORK_ICON_TYPE, RESOURCE_FORK_ICON_ID, &data, &dataSize ) );
+
+    put32( fork + 8, ( uint32_t ) size );
+    CHECK_EQUAL( resourceForkCount( fork, size ), -1 );
+
+    free( fork );
+    free( icns );
+}
+
+static void testMixedFork( void )
+{
+    size_t          icnsSize = 300;
+    uint8_t       * icns     = makeIcon( icnsSize, 2 );
+    uint8_t       * fork     = malloc( 1024 );
+    size_t          size     = buildMixedFork( fork, icns, icnsSize );
+    const uint8_t * data     = NULL;
+    size_t          dataSize = 0;
+
+    CHECK_EQUAL( resourceForkCount( fork, size ), 3 );
+
+    CHECK( resourceForkFind( fork, size, RESOURCE_FORK_ICON_TYPE, RESOURCE_FORK_ICON_ID, &data, &dataSize ) );
+    CHECK_EQUAL( dataSize, icnsSize );
+    CHECK( data && memcmp( data, icns, icnsSize ) == 0 );
+
+    CHECK( resourceForkFind( fork, size, TEXT_TYPE, 129, &data, &dataSize ) );
+    CHECK( dataSize == 6 && memcmp( data, "second", 6 ) == 0 );
+    CHECK( ! resourceForkFind( fork, size, TEXT_TYPE, 130, &data, &dataSize ) );
+
+    free( fork );
+    free( icns );
+}
+
+/******************************************************************************\
+ * Saving
+\******************************************************************************/
+
+static bool hasAttribute( const char * path, const char * name )
+{
+    return getAttribute( path, name, NULL, 0 ) >= 0;
+}
+
+static void testSave( const char * scratch )
+{
+    char      file    [ 4096 ];
+    char      folder  [ 4096 ];
+    char      iconFile[ 4096 + 8 ];
+    size_t    icnsSize = 2000;
+    uint8_t * icns     = makeIcon( icnsSize, 3 );
+    uint8_t * other    = makeIcon( icnsSize, 4 );
+
+    snprintf( file,     sizeof( file     ), "%s/file",   scratch );
+    snprintf( folder,   sizeof( folder   ), "%s/folder", scratch );
+    snprintf( iconFile, sizeof( iconFile ), "%s/Icon\r", folder  );
+
+    testWriteFile( file, 10 );
+    mkdir( folder, 0755 );
+
+    /* Not every filing system has user extended attributes */
+
+    if ( setAttribute( file, HASH_ATTRIBUTE, "", 0 ) != 0 )
+    {
+        printf( "Extended attributes unavailable (%s), skipping save tests\n", strerror( errno ) );
+        free( icns  );
+        free( other );
+        return;
+    }
+
+    CHECK( ! resourceForkHasCustomIcon( file, false, icns, icnsSize ) );
+
+    CHECK_EQUAL( resourceForkSaveCustomIcon( file,   false, icns, icnsSize ), 0 );
+    CHECK_EQUAL( resourceForkSaveCustomIcon( folder, true,  icns, icnsSize ), 0 );
+
+    CHECK(   resourceForkHasCustomIcon( file,   false, icns,  icnsSize     ) );
+    CHECK(   resourceForkHasCustomIcon( folder, true,  icns,  icnsSize     ) );
+    CHECK( ! resourceForkHasCustomIcon( file,   false, other, icnsSize     ) );
+    CHECK( ! resourceForkHasCustomIcon( folder, true,  icns,  icnsSize - 1 ) );
+
+    /* The folder's icon lives in its "Icon\r" file; its fork parses back */
+
+    size_t    size = resourceForkSize( icnsSize );
+    uint8_t * fork = malloc( size );
+
+    CHECK_EQUAL( getAttribute( iconFile, FORK_ATTRIBUTE, fork, size ), size );
+    CHECK_EQUAL( resourceForkCount( fork, size ), 1 );
+    CHECK( hasAttribute( iconFile, HASH_ATTRIBUTE ) );
+    CHECK( hasAttribute( folder,   FINDER_INFO_ATTRIBUTE ) );
+
+    /* Without the hash, the fork itself is compared */
+
+    removeAttribute( file, HASH_ATTRIBUTE );
+    CHECK(   resourceForkHasCustomIcon( file, false, icns,  icnsSize ) );
+    CHECK( ! resourceForkHasCustomIcon( file, false, other, icnsSize ) );
+
+    /* A fork holding more than an icon isn't replaced, and a hash left over
+     * from an icon-only fork goes, as it would describe the wrong thing.
+     */
+
+    CHECK_EQUAL( resourceForkSaveCustomIcon( file, false, icns, icnsSize ), 0 );
+    CHECK( hasAttribute( file, HASH_ATTRIBUTE ) );
+
+    uint8_t * mixed     = malloc( size + 1024 );
+    size_t    mixedSize = buildMixedFork( mixed, icns, icnsSize );
+
+    setAttribute( file, FORK_ATTRIBUTE, mixed, mixedSize );
+
+    CHECK_EQUAL( resourceForkSaveCustomIcon( file, false, other, icnsSize ), EEXIST );
+    CHECK_EQUAL( getAttribute( file, FORK_ATTRIBUTE, NULL, 0 ), mixedSize );
+    CHECK( ! hasAttribute( file, HASH_ATTRIBUTE ) );
+    CHECK( ! resourceForkHasCustomIcon( file, false, icns, icnsSize ) );
+
+    free( mixed );
+    free( fork  );
+    free( other );
+    free( icns  );
+}
+
+int main( void )
+{
+    char * scratch = testMakeDirectory( "ResourceForkWriterTests" );
+
+    testBuildAndFind();
+    testMixedFork();
+    testSave( scratch );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return testFinish( "ResourceForkWriterTests" );
+}
@@ -0,0 +1,101 @@
+/******************************************************************************\
+ * Tests: ScanIndexBenchmark.c
+ *
+ * Time scans of a synthetic tree without the index, with a cold index (which
+ * is filled in as it goes) and with a warm one. Each scan is also repeated on
+ * a simulated slow volume, where reading directories is what costs.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ScanIndex.h"
+
+#define INDEX_SIZE ( 16 * 1024 * 1024 )
+
+static bool acceptJPEG( void * context, const char * fullPath, const char * leafname )
+{
+    ( void ) context;
+    ( void ) fullPath;
+
+    const char * dot = strrchr( leafname, '.' );
+
+    return dot != NULL && strcmp( dot, ".jpg" ) == 0;
+}
+
+static const FolderScannerCallbacks callbacks = { acceptJPEG, NULL, NULL };
+
+static double timeScan( const char                 * tree,
+                        ScanIndex                  * index,
+                        const FolderScannerBackend * backend,
+                        size_t                     * fromIndex )
+{
+    FolderScannerOptions options = { .threadCount = 4, .index = index, .backend = backend };
+    FolderScannerRoot    root    = { .path = tree };
+    double               started = testSeconds();
+
+    folderScannerRun( &root, 1, &options, &callbacks );
+
+    *fromIndex = root.directoriesFromIndex;
+    return testSeconds() - started;
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    unsigned int depth   = quick ? 2 : 4;
+    char       * scratch = testMakeDirectory( "ScanIndexBenchmark" );
+    char         tree[ 4096 ], indexPath[ 4096 ];
+    size_t       files;
+
+    snprintf( tree,      sizeof( tree      ), "%s/tree",  scratch );
+    snprintf( indexPath, sizeof( indexPath ), "%s/index", scratch );
+
+    mkdir( tree, 0755 );
+
+    files = testMakeTree( tree, depth, 5, 8, ".jpg", 64 );
+    testMakeTree( tree, depth, 5, 8, ".txt", 64 );
+    testAgeTree ( tree, 10 );
+
+    FolderScannerSlowBackend slow;
+
+    folderScannerSlowBackendInit( &slow, folderScannerPOSIXBackend(), 2000, 200, 2 );
+
+    printf( "%zu images in a tree %u deep\n\n", files, depth );
+    printf( "Volume   No index    Cold index  Warm index  (from index)\n" );
+
+    for ( unsigned int volume = 0; volume < 2; volume ++ )
+    {
+        const FolderScannerBackend * backend = volume == 0 ? NULL : &slow.backend;
+        int                          error   = 0;
+        size_t                       fromIndex;
+        double                       none, cold, warm;
+
+        unlink( indexPath );
+
+        ScanIndex * index = scanIndexOpen( indexPath, INDEX_SIZE, &error );
+
+        if ( index == NULL )
+        {
+            fprintf( stderr, "Can't open index: %s\n", strerror( error ) );
+            return EXIT_FAILURE;
+        }
+
+        none = timeScan( tree, NULL,  backend, &fromIndex );
+        cold = timeScan( tree, index, backend, &fromIndex );
+        warm = timeScan( tree, index, backend, &fromIndex );
+
+        printf( "%-8s %8.2fms  %8.2fms  %8.2fms  (%zu)\n",
+                volume == 0 ? "Local" : "Slow", none * 1e3, cold * 1e3, warm * 1e3, fromIndex );
+
+        scanIndexClose( index );
+    }
+
+    folderScannerSlowBackendDestroy( &slow );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
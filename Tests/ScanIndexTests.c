@@ -0,0 +1,200 @@
+/******************************************************************************\
+ * Tests: ScanIndexTests.c
+ *
+ * Tests for "ScanIndex.h": records too recent to trust, files changed in
+ * place, and indexed scans through "FolderScanner.h".
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "ScanIndex.h"
+
+#define INDEX_SIZE ( 1024 * 1024 )
+
+/* Record the two files of the given directory, as the scanner would */
+
+static bool storeDirectory( ScanIndex * index, const char * directory, ScanIndexKey * key )
+{
+    ScanIndexRecord record = { 0 };
+    char            path[ 4096 ];
+    bool            stored;
+
+    if ( scanIndexKeyForPath( directory, key ) == false ) return false;
+
+    for ( unsigned int file = 0; file < 2; file ++ )
+    {
+        FolderScannerEntry entry = { .type = folderScannerEntryTypeFile };
+        char               name[ 32 ];
+
+        snprintf( name, sizeof( name ), "file%u.jpg", file );
+        if ( snprintf( path, sizeof( path ), "%s/%s", directory, name ) >= ( int ) sizeof( path ) ) break;
+
+        entry.name = name;
+        CHECK_EQUAL( scanIndexRecordAddFile( &record, &entry, path ), 100 );
+    }
+
+    stored = scanIndexStore( index, key, &record );
+    scanIndexRecordFree( &record );
+
+    return stored;
+}
+
+/* A record stored in the same second as its directory last changed is not
+ * used; once the directory's time is older than the record, it is.
+ */
+
+static void testRacyTimes( ScanIndex * index, const char * directory )
+{
+    ScanIndexKey         key;
+    ScanIndexStatistics  statistics;
+    FolderScannerEntry * entries;
+    size_t               count;
+
+    CHECK( storeDirectory( index, directory, &key ) );
+
+    entries = scanIndexCopyEntries( index, &key, directory, &count );
+    CHECK( entries == NULL );
+    free( entries );
+
+    scanIndexGetStatistics( index, &statistics );
+    CHECK_EQUAL( statistics.unconfirmed, 1 );
+
+    testAgeTree( directory, 10 );
+    CHECK( storeDirectory( index, directory, &key ) );
+
+    entries = scanIndexCopyEntries( index, &key, directory, &count );
+    CHECK( entries != NULL );
+    CHECK_EQUAL( count, 2 );
+
+    if ( entries != NULL )
+    {
+        CHECK( strcmp( entries[ 0 ].name, "file0.jpg" ) == 0 );
+        CHECK_EQUAL( entries[ 1 ].size, 100 );
+        CHECK_EQUAL( entries[ 1 ].type, folderScannerEntryTypeFile );
+    }
+
+    free( entries );
+}
+
+/* Rewriting a file in place leaves its directory's time alone, but the
+ * directory's record is no longer used; whether the size or only the time of
+ * the file changed.
+ */
+
+static void testFilesChangedInPlace( ScanIndex * index, const char * directory )
+{
+    ScanIndexKey         key;
+    ScanIndexKey         after;
+    ScanIndexStatistics  statistics;
+    FolderScannerEntry * entries;
+    size_t               count;
+    char                 path[ 4096 ];
+
+    testAgeTree( directory, 10 );
+    CHECK( storeDirectory( index, directory, &key ) );
+
+    if ( snprintf( path, sizeof( path ), "%s/file1.jpg", directory ) >= ( int ) sizeof( path ) ) return;
+    CHECK( testWriteFile( path, 200 ) );
+
+    CHECK( scanIndexKeyForPath( directory, &after ) );
+    CHECK_EQUAL( after.modifiedSeconds,     key.modifiedSeconds     );
+    CHECK_EQUAL( after.modifiedNanoseconds, key.modifiedNanoseconds );
+
+    entries = scanIndexCopyEntries( index, &key, directory, &count );
+    CHECK( entries == NULL );
+    free( entries );
+
+    testAgeTree( directory, 10 );
+    CHECK( testWriteFile( path, 100 ) );
+    CHECK( storeDirectory( index, directory, &key ) );
+
+    entries = scanIndexCopyEntries( index, &key, directory, &count );
+    CHECK( entries != NULL );
+    free( entries );
+
+    struct timespec times[ 2 ] = { { 0, UTIME_OMIT }, { time( NULL ) - 5, 0 } };
+    CHECK( utimensat( AT_FDCWD, path, times, 0 ) == 0 );
+
+    entries = scanIndexCopyEntries( index, &key, directory, &count );
+    CHECK( entries == NULL );
+    free( entries );
+
+    scanIndexGetStatistics( index, &statistics );
+    CHECK_EQUAL( statistics.stale, 2 );
+}
+
+/* A second scan of an unchanged tree takes every directory from the index,
+ * and finds the same files as the first.
+ */
+
+static size_t foundCount;
+
+static bool foundFile( void * context, const char * fullPath, uint64_t size )
+{
+    ( void ) context;
+    ( void ) fullPath;
+    ( void ) size;
+
+    foundCount ++;
+    return true;
+}
+
+static void testIndexedScan( ScanIndex * index, const char * tree )
+{
+    FolderScannerCallbacks callbacks = { NULL, NULL, foundFile };
+    FolderScannerOptions   options   = { .threadCount = 2, .index = index };
+    FolderScannerRoot      root;
+
+    testMakeTree( tree, 2, 3, 4, ".jpg", 100 );
+    testAgeTree ( tree, 10 );
+
+    for ( unsigned int pass = 0; pass < 2; pass ++ )
+    {
+        memset( &root, 0, sizeof( root ) );
+        root.path  = tree;
+        foundCount = 0;
+
+        CHECK_EQUAL( folderScannerRun( &root, 1, &options, &callbacks ), 0 );
+        CHECK_EQUAL( root.status,               folderScannerStatusComplete );
+        CHECK_EQUAL( root.directoriesRead,      13                          );
+        CHECK_EQUAL( root.directoriesFromIndex, pass == 0 ? 0 : 13          );
+        CHECK_EQUAL( foundCount,                13 * 4                      );
+    }
+}
+
+int main( void )
+{
+    char * scratch = testMakeDirectory( "ScanIndexTests" );
+    char   indexPath[ 4096 ], directory[ 4096 ], tree[ 4096 ];
+    int    error   = 0;
+
+    snprintf( indexPath, sizeof( indexPath ), "%s/index",     scratch );
+    snprintf( directory, sizeof( directory ), "%s/directory", scratch );
+    snprintf( tree,      sizeof( tree      ), "%s/tree",      scratch );
+
+    mkdir( directory, 0755 );
+    mkdir( tree,      0755 );
+    testMakeTree( directory, 0, 0, 2, ".jpg", 100 );
+
+    ScanIndex * index = scanIndexOpen( indexPath, INDEX_SIZE, &error );
+
+    CHECK( index != NULL );
+
+    if ( index != NULL )
+    {
+        testRacyTimes          ( index, directory );
+        testFilesChangedInPlace( index, directory );
+
+        scanIndexReset( index );
+        testIndexedScan( index, tree );
+
+        scanIndexClose( index );
+    }
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return testFinish( "ScanIndexTests" );
+}
@@ -0,0 +1,155 @@
+/******************************************************************************\
+ * Tests: SharedTreeWalkBenchmark.c
+ *
+ * Time the two ways of sampling images for a deep chain of queued folders,
+ * each inside the one before: one scan per folder, as before, or one shared
+ * walk of the outermost folder offering each image to every queued folder
+ * above it, as SharedTreeWalk does. SharedTreeWalk itself is Objective-C, so
+ * this drives "FolderScanner.h" and "ReservoirSampler.h" the same way it does.
+ * Both are also run on a simulated slow volume.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "FolderScanner.h"
+#include "ReservoirSampler.h"
+
+#define SAMPLE_SIZE 4
+
+typedef struct Chain
+{
+    char             ** paths;   /* Queued folders, outermost first */
+    size_t            * lengths;
+    ReservoirSampler  * samplers;
+    size_t              count;
+
+} Chain;
+
+static bool foundForOne( void * context, const char * fullPath, uint64_t size )
+{
+    ( void ) size;
+
+    ( void ) reservoirSamplerOffer( context, fullPath );
+    return true;
+}
+
+/* Offer an image to every queued folder holding it; as in SharedTreeWalk the
+ * owners are the queued folders whose paths prefix the file's directory.
+ */
+
+static bool foundForAll( void * context, const char * fullPath, uint64_t size )
+{
+    Chain * chain = context;
+
+    ( void ) size;
+
+    for ( size_t index = 0; index < chain->count; index ++ )
+    {
+        if ( strncmp( fullPath, chain->paths[ index ], chain->lengths[ index ] ) != 0 ||
+             fullPath[ chain->lengths[ index ] ] != '/' )
+        {
+            break;
+        }
+
+        ( void ) reservoirSamplerOffer( &chain->samplers[ index ], fullPath );
+    }
+
+    return true;
+}
+
+static double run( Chain * chain, const FolderScannerBackend * backend, bool shared, size_t * directories )
+{
+    FolderScannerOptions options = { .threadCount = 4, .backend = backend };
+    double               started = testSeconds();
+
+    *directories = 0;
+
+    for ( size_t index = 0; index < chain->count; index ++ )
+    {
+        reservoirSamplerInit( &chain->samplers[ index ], SAMPLE_SIZE, 1, false );
+    }
+
+    for ( size_t index = 0; index < ( shared ? 1 : chain->count ); index ++ )
+    {
+        FolderScannerCallbacks callbacks = { NULL, NULL, shared ? foundForAll : foundForOne };
+        FolderScannerRoot      root      =
+        {
+            .path    = chain->paths[ index ],
+            .context = shared ? ( void * ) chain : ( void * ) &chain->samplers[ index ]
+        };
+
+        folderScannerRun( &root, 1, &options, &callbacks );
+        *directories += root.directoriesRead;
+    }
+
+    for ( size_t index = 0; index < chain->count; index ++ )
+    {
+        ( void ) reservoirSamplerFinish( &chain->samplers[ index ] );
+        reservoirSamplerFree  ( &chain->samplers[ index ] );
+    }
+
+    return testSeconds() - started;
+}
+
+int main( int argc, char ** argv )
+{
+    bool         quick   = benchmarkIsQuick( argc, argv );
+    unsigned int levels  = quick ? 4 : 12;
+    char       * scratch = testMakeDirectory( "SharedTreeWalkBenchmark" );
+    Chain        chain   = { .count = levels };
+    char         path[ 4096 ];
+
+    chain.paths    = calloc( levels, sizeof( char * ) );
+    chain.lengths  = calloc( levels, sizeof( size_t ) );
+    chain.samplers = calloc( levels, sizeof( ReservoirSampler ) );
+
+    /* Each queued folder holds the next, plus a small bushy subtree */
+
+    snprintf( path, sizeof( path ), "%s", scratch );
+
+    for ( unsigned int level = 0; level < levels; level ++ )
+    {
+        size_t length = strlen( path );
+
+        if ( snprintf( path + length, sizeof( path ) - length, "/level%u", level ) >= ( int ) ( sizeof( path ) - length ) ) break;
+
+        mkdir( path, 0755 );
+        testMakeTree( path, 2, 3, 4, ".jpg", 64 );
+
+        chain.paths  [ level ] = strdup( path );
+        chain.lengths[ level ] = strlen( path );
+    }
+
+    FolderScannerSlowBackend slow;
+
+    folderScannerSlowBackendInit( &slow, folderScannerPOSIXBackend(), 1000, 200, 2 );
+
+    printf( "%u nested queued folders\n\n", levels );
+    printf( "Volume   Per folder            Shared walk\n" );
+
+    for ( unsigned int volume = 0; volume < 2; volume ++ )
+    {
+        const FolderScannerBackend * backend = volume == 0 ? NULL : &slow.backend;
+        size_t                       perFolderReads, sharedReads;
+        double                       perFolder = run( &chain, backend, false, &perFolderReads );
+        double                       shared    = run( &chain, backend, true,  &sharedReads    );
+
+        printf( "%-8s %8.2fms (%5zu reads)  %8.2fms (%5zu reads)\n",
+                volume == 0 ? "Local" : "Slow", perFolder * 1e3, perFolderReads, shared * 1e3, sharedReads );
+    }
+
+    folderScannerSlowBackendDestroy( &slow );
+
+    for ( unsigned int level = 0; level < levels; level ++ ) free( chain.paths[ level ] );
+
+    free( chain.paths    );
+    free( chain.lengths  );
+    free( chain.samplers );
+
+    testRemoveTree( scratch );
+    free( scratch );
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+/******************************************************************************\
+ * Tests: SpriteCacheTests.m
+ *
+ * Tests for "SpriteCache.h": the same geometry, give or take floating point
+ * noise, gets the same sprite back, while changing any one field of it draws
+ * a new one; angles within half a step of each other quantise to the same
+ * sprite; the hit and miss counters follow along; sprites past the byte
+ * budget are discarded, while a style's worth fit in the application's own
+ * budget. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#import "SpriteCache.h"
+
+#define SPRITE_CACHE_BUDGET 33554432 /* See "CustomIconGenerator.h" */
+#define SPRITE_BYTES        ( 256 * 256 * 4 )
+
+/* A bordered, shadowed thumbnail slot, as the Classic style might have */
+
+static SpriteGeometry baseGeometry( void )
+{
+    SpriteGeometry geometry =
+    {
+        .slotSize       = CGSizeMake( 256, 256 ),
+        .slotPhase      = CGPointMake( 0.25, 0.5 ),
+        .layoutSize     = 512,
+        .casterSize     = CGSizeMake( 400, 400 ),
+        .border         = YES,
+        .shadowOffset   = CGSizeMake( 8, -8 ),
+        .shadowBlur     = 16,
+        .darkGreyShadow = NO,
+        .angle          = 0.03
+    };
+
+    return geometry;
+}
+
+/* Out: YES if the cache already held a sprite for the geometry, judged by
+ *      its counters. The sprite itself is returned in 'sprite' if that is
+ *      not NULL, else released.
+ */
+
+static BOOL hit( SpriteCache * cache, SpriteGeometry geometry, CGImageRef * sprite )
+{
+    uint64_t   hits  = cache.statistics.hits;
+    CGImageRef image = [ cache copySpriteFor: geometry ];
+
+    CHECK( image != NULL );
+
+    if ( sprite ) *sprite = image;
+    else          CGImageRelease( image );
+
+    return cache.statistics.hits > hits;
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+static void testHits( void )
+{
+    SpriteCache  * cache    = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_CACHE_BUDGET ];
+    SpriteGeometry geometry = baseGeometry();
+    SpriteGeometry noisy    = geometry;
+    CGImageRef     first, second;
+
+    CHECK( ! hit( cache, geometry, &first  ) );
+    CHECK(   hit( cache, geometry, &second ) );
+    CHECK( first == second );
+
+    CHECK_EQUAL( CGImageGetWidth ( first ), 257 );
+    CHECK_EQUAL( CGImageGetHeight( first ), 257 );
+
+    /* Sums that don't quite come out exact */
+
+    noisy.slotSize.width    += 1e-9;
+    noisy.slotPhase.y       -= 1e-9;
+    noisy.casterSize.height += 1e-9;
+    noisy.angle             += 1e-9;
+
+    CHECK( hit( cache, noisy, NULL ) );
+
+    SpriteCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.hits,   2 );
+    CHECK_EQUAL( statistics.misses, 1 );
+
+    [ cache removeAllSprites ];
+
+    CHECK( ! hit( cache, geometry, NULL ) );
+
+    CGImageRelease( first  );
+    CGImageRelease( second );
+}
+
+/* Each field of the geometry changed on its own must miss, else a slot would
+ * be drawn with some other slot's shadow or border; the original still hits.
+ */
+
+static void testKeyFields( void )
+{
+    SpriteCache  * cache = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_CACHE_BUDGET ];
+    SpriteGeometry base  = baseGeometry();
+    SpriteGeometry variants[ 13 ];
+
+    for ( size_t index = 0; index < 13; index ++ ) variants[ index ] = base;
+
+    variants[  0 ].slotSize.width      += 1;
+    variants[  1 ].slotSize.height     += 1;
+    variants[  2 ].slotPhase.x         += 0.25;
+    variants[  3 ].slotPhase.y         += 0.25;
+    variants[  4 ].layoutSize          += 1;
+    variants[  5 ].casterSize.width    += 1;
+    variants[  6 ].casterSize.height   += 1;
+    variants[  7 ].border               = NO;
+    variants[  8 ].shadowOffset.width  += 1;
+    variants[  9 ].shadowOffset.height += 1;
+    variants[ 10 ].shadowBlur          += 1;
+    variants[ 11 ].darkGreyShadow       = YES;
+    variants[ 12 ].angle                = [ SpriteCache quantisedAngle: base.angle + SPRITE_CACHE_ANGLE_STEP ];
+
+    CHECK( ! hit( cache, base, NULL ) );
+
+    for ( size_t index = 0; index < 13; index ++ )
+    {
+        BOOL cached = hit( cache, variants[ index ], NULL );
+
+        if ( cached ) printf( "Variant %zu hit\n", index );
+        CHECK( ! cached );
+    }
+
+    CHECK( hit( cache, base, NULL ) );
+
+    SpriteCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.hits,   1  );
+    CHECK_EQUAL( statistics.misses, 14 );
+}
+
+/* Angles quantise to the nearest step, so any within half a step of one
+ * another's quantised angle share its sprite; a little over half a step
+ * away, they don't. Around zero, this includes angles that round to -0.
+ */
+
+static void testAngles( void )
+{
+    SpriteCache  * cache     = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_CACHE_BUDGET ];
+    SpriteGeometry geometry  = baseGeometry();
+    CGFloat        centres[] = { 0, 0.03, -0.07 };
+
+    for ( size_t index = 0; index < sizeof( centres ) / sizeof( centres[ 0 ] ); index ++ )
+    {
+        CGFloat centre = centres[ index ];
+
+        geometry.angle = [ SpriteCache quantisedAngle: centre ];
+        CHECK( fabs( geometry.angle - centre ) < 1e-9 );
+        CHECK( ! hit( cache, geometry, NULL ) );
+
+        for ( CGFloat offset = -0.45; offset <= 0.45; offset += 0.05 )
+        {
+            CGFloat angle = centre + offset * SPRITE_CACHE_ANGLE_STEP;
+
+            geometry.angle = [ SpriteCache quantisedAngle: angle ];
+
+            CHECK( fabs( geometry.angle - angle ) <= SPRITE_CACHE_ANGLE_STEP / 2 );
+            CHECK( hit( cache, geometry, NULL ) );
+        }
+
+        geometry.angle = [ SpriteCache quantisedAngle: centre + 0.55 * SPRITE_CACHE_ANGLE_STEP ];
+        CHECK( ! hit( cache, geometry, NULL ) );
+
+        geometry.angle = [ SpriteCache quantisedAngle: centre - 0.55 * SPRITE_CACHE_ANGLE_STEP ];
+        CHECK( ! hit( cache, geometry, NULL ) );
+    }
+}
+
+/* NSCache only promises to keep roughly to its budget, so check that most of
+ * many sprites past a small budget are gone, and that one slot's sprites for
+ * every angle a thumbnail might take (+/- 0.075 radians; see ROTATION_PAD in
+ * "CustomIconGenerator.h") all stay within the application's budget.
+ */
+
+static void testBudget( void )
+{
+    SpriteCache  * small    = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_BYTES * 4    ];
+    SpriteCache  * real     = [ [ SpriteCache alloc ] initWithByteBudget: SPRITE_CACHE_BUDGET ];
+    SpriteGeometry geometry = baseGeometry();
+    unsigned int   kept     = 0;
+
+    geometry.slotPhase = CGPointZero;
+
+    for ( unsigned int pass = 0; pass < 2; pass ++ )
+    {
+        for ( int step = -8; step <= 8; step ++ )
+        {
+            geometry.angle = [ SpriteCache quantisedAngle: step * SPRITE_CACHE_ANGLE_STEP ];
+
+            if ( hit( small, geometry, NULL ) ) kept ++;
+            CHECK( hit( real, geometry, NULL ) == ( pass == 1 ) );
+        }
+    }
+
+    printf( "Small budget kept %u of 17 sprites\n", kept );
+
+    CHECK( kept <= 8 );
+    CHECK_EQUAL( real.statistics.hits,   17 );
+    CHECK_EQUAL( real.statistics.misses, 17 );
+}
+
+int main( void )
+{
+    @autoreleasepool
+    {
+        testHits     ();
+        testKeyFields();
+        testAngles   ();
+        testBudget   ();
+    }
+
+    return testFinish( "SpriteCacheTests" );
+}
@@ -0,0 +1,245 @@
+/******************************************************************************\
+ * Tests: TaskSchedulerTests.c
+ *
+ * Tests for "TaskScheduler.h": cancelling a lane while every worker is busy
+ * must call the cancellation function of each task queued in it, and only
+ * those, leaving other lanes' tasks to run; and resetting the latency
+ * histograms, including while tasks are running and statistics are being
+ * read on other threads, must leave them empty and counting afresh. A
+ * watchdog fails the test if anything hangs.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <pthread.h>
+
+#include "TaskScheduler.h"
+
+#define TASKS    20
+#define ROUNDS   200
+#define WATCHDOG 60 /* Seconds */
+
+static unsigned int ran;
+static unsigned int cancelled;
+
+static void countRun( void * context )
+{
+    ( void ) context;
+    __atomic_add_fetch( &ran, 1, __ATOMIC_SEQ_CST );
+}
+
+static void countCancelled( void * context )
+{
+    ( void ) context;
+    __atomic_add_fetch( &cancelled, 1, __ATOMIC_SEQ_CST );
+}
+
+/* Wait for a counter to reach a value, for up to a few seconds */
+
+static unsigned int waitFor( unsigned int * counter, unsigned int value )
+{
+    double until = testSeconds() + 5;
+
+    while ( __atomic_load_n( counter, __ATOMIC_SEQ_CST ) < value && testSeconds() < until ) usleep( 1000 );
+
+    return __atomic_load_n( counter, __ATOMIC_SEQ_CST );
+}
+
+/******************************************************************************\
+ * Keeping every worker busy: gate tasks, in the interactive lane which all
+ * workers serve, run until the gate is opened.
+\******************************************************************************/
+
+static pthread_mutex_t gateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  gateOpen = PTHREAD_COND_INITIALIZER;
+static bool            gateOpened;
+static unsigned int    waiting;
+
+static void waitAtGate( void * context )
+{
+    ( void ) context;
+
+    pthread_mutex_lock( &gateLock );
+
+    waiting ++;
+
+    while ( ! gateOpened ) pthread_cond_wait( &gateOpen, &gateLock );
+
+    waiting --;
+
+    pthread_mutex_unlock( &gateLock );
+}
+
+static void closeGate( unsigned int workers )
+{
+    gateOpened = false;
+
+    for ( unsigned int worker = 0; worker < workers; worker ++ )
+    {
+        CHECK_EQUAL( taskSchedulerSubmit( taskSchedulerLaneInteractive, waitAtGate, NULL, NULL ), 0 );
+    }
+
+    double until = testSeconds() + 5;
+
+    for ( ;; )
+    {
+        pthread_mutex_lock( &gateLock );
+        unsigned int arrived = waiting;
+        pthread_mutex_unlock( &gateLock );
+
+        if ( arrived == workers || testSeconds() >= until ) break;
+
+        usleep( 1000 );
+    }
+}
+
+static void openGate( void )
+{
+    pthread_mutex_lock    ( &gateLock );
+    gateOpened = true;
+    pthread_cond_broadcast( &gateOpen );
+    pthread_mutex_unlock  ( &gateLock );
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+static void testCancelLane( unsigned int workers )
+{
+    TaskSchedulerStatistics before, after;
+
+    taskSchedulerGetStatistics( &before );
+
+    ran       = 0;
+    cancelled = 0;
+
+    closeGate( workers );
+
+    for ( unsigned int task = 0; task < TASKS; task ++ )
+    {
+        CHECK_EQUAL( taskSchedulerSubmit( taskSchedulerLaneUserInitiated, countRun, countCancelled, NULL ), 0 );
+        CHECK_EQUAL( taskSchedulerSubmit( taskSchedulerLaneBackground,    countRun, countCancelled, NULL ), 0 );
+    }
+
+    CHECK_EQUAL( taskSchedulerCancelLane( taskSchedulerLaneUserInitiated ), TASKS );
+    CHECK_EQUAL( cancelled, TASKS );
+    CHECK_EQUAL( ran,       0     );
+
+    openGate();
+
+    CHECK_EQUAL( waitFor( &ran, TASKS ), TASKS );
+
+    taskSchedulerGetStatistics( &after );
+
+    CHECK_EQUAL( cancelled, TASKS );
+    CHECK_EQUAL( after.lanes[ taskSchedulerLaneUserInitiated ].cancelled -
+                 before.lanes[ taskSchedulerLaneUserInitiated ].cancelled, TASKS );
+    CHECK_EQUAL( after.lanes[ taskSchedulerLaneBackground ].cancelled -
+                 before.lanes[ taskSchedulerLaneBackground ].cancelled, 0 );
+}
+
+/* Reset and read the histograms over and over while tasks run */
+
+static bool finished;
+
+static void * resetter( void * context )
+{
+    TaskSchedulerStatistics statistics;
+
+    ( void ) context;
+
+    while ( ! __atomic_load_n( &finished, __ATOMIC_ACQUIRE ) )
+    {
+        taskSchedulerResetLatencies();
+        taskSchedulerGetStatistics( &statistics );
+    }
+
+    return NULL;
+}
+
+/* Out: Latencies recorded in a lane's "took" histogram, once they reach the
+ *      given number or a few seconds have passed.
+ */
+
+static uint64_t tookCount( TaskSchedulerLane lane, uint64_t expected )
+{
+    TaskSchedulerStatistics statistics;
+    double                  until = testSeconds() + 5;
+
+    do
+    {
+        taskSchedulerGetStatistics( &statistics );
+
+        if ( statistics.lanes[ lane ].took.count >= expected ) break;
+
+        usleep( 1000 );
+    }
+    while ( testSeconds() < until );
+
+    return statistics.lanes[ lane ].took.count;
+}
+
+static void testResetLatencies( void )
+{
+    TaskSchedulerStatistics statistics;
+    pthread_t               thread;
+
+    ran = 0;
+
+    pthread_create( &thread, NULL, resetter, NULL );
+
+    for ( unsigned int task = 0; task < ROUNDS; task ++ )
+    {
+        CHECK_EQUAL( taskSchedulerSubmit( taskSchedulerLaneInteractive, countRun, NULL, NULL ), 0 );
+    }
+
+    CHECK_EQUAL( waitFor( &ran, ROUNDS ), ROUNDS );
+
+    __atomic_store_n( &finished, true, __ATOMIC_RELEASE );
+    pthread_join( thread, NULL );
+
+    /* Latencies are recorded just after each task returns */
+
+    usleep( 10000 );
+    taskSchedulerResetLatencies();
+    taskSchedulerGetStatistics( &statistics );
+
+    for ( unsigned int lane = 0; lane < taskSchedulerLaneCount; lane ++ )
+    {
+        CHECK_EQUAL( statistics.lanes[ lane ].waited.count, 0 );
+        CHECK_EQUAL( statistics.lanes[ lane ].took.count,   0 );
+        CHECK_EQUAL( statistics.lanes[ lane ].took.maximum, 0 );
+    }
+
+    ran = 0;
+
+    for ( unsigned int task = 0; task < TASKS; task ++ )
+    {
+        CHECK_EQUAL( taskSchedulerSubmit( taskSchedulerLaneInteractive, countRun, NULL, NULL ), 0 );
+    }
+
+    CHECK_EQUAL( waitFor( &ran, TASKS ), TASKS );
+    CHECK_EQUAL( tookCount( taskSchedulerLaneInteractive, TASKS ), TASKS );
+}
+
+int main( void )
+{
+    TaskSchedulerStatistics statistics;
+
+    alarm( WATCHDOG );
+
+    taskSchedulerGetStatistics( &statistics );
+
+    CHECK( statistics.workers > 0 );
+
+    if ( statistics.workers > 0 )
+    {
+        testCancelLane( statistics.workers );
+        testResetLatencies();
+    }
+
+    return testFinish( "TaskSchedulerTests" );
+}
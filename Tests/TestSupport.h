@@ -0,0 +1,307 @@
+/******************************************************************************\
+ * Tests: TestSupport.h
+ *
+ * Minimal checking, timing and scratch-file helpers shared by the tests and
+ * benchmarks of the portable C utilities in "Shared Sources". Each test or
+ * benchmark is a single source file built into its own executable, so
+ * everything here is static, and unused parts cost nothing.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned int testChecks;
+static unsigned int testFailures;
+
+/* Check a condition, reporting where it failed but carrying on */
+
+#define CHECK( condition )                                                     \
+    do                                                                         \
+    {                                                                          \
+        testChecks ++;                                                         \
+        if ( ! ( condition ) )                                                 \
+        {                                                                      \
+            testFailures ++;                                                   \
+            fprintf( stderr, "%s:%d: check failed: %s\n",                      \
+                     __FILE__, __LINE__, #condition );                         \
+        }                                                                      \
+    }                                                                          \
+    while ( 0 )
+
+/* As CHECK(), for two integers, printing both if they differ */
+
+#define CHECK_EQUAL( actual, expected )                                        \
+    do                                                                         \
+    {                                                                          \
+        long long testActual   = ( long long ) ( actual   );                   \
+        long long testExpected = ( long long ) ( expected );                   \
+                                                                               \
+        testChecks ++;                                                         \
+        if ( testActual != testExpected )                                      \
+        {                                                                      \
+            testFailures ++;                                                   \
+            fprintf( stderr, "%s:%d: %s is %lld, expected %lld\n",             \
+                     __FILE__, __LINE__, #actual, testActual, testExpected );  \
+        }                                                                      \
+    }                                                                          \
+    while ( 0 )
+
+/******************************************************************************\
+ * testFinish()
+ *
+ * Report the number of checks and failures.
+ *
+ * In:  Name of the test program.
+ *
+ * Out: Exit status for main() - non-zero if anything failed.
+\******************************************************************************/
+
+static inline int testFinish( const char * name )
+{
+    printf( "%s: %u checks, %u failed\n", name, testChecks, testFailures );
+
+    return testFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/******************************************************************************\
+ * testSeconds()
+ *
+ * Out: Monotonic wall-clock time in seconds.
+\******************************************************************************/
+
+static inline double testSeconds( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( double ) now.tv_sec + ( double ) now.tv_nsec / 1e9;
+}
+
+/******************************************************************************\
+ * testBurn()
+ *
+ * Keep the CPU busy for the given time, as a stand-in for CPU-bound work.
+\******************************************************************************/
+
+static volatile double testSink;
+
+static inline void testBurn( double seconds )
+{
+    double until = testSeconds() + seconds;
+    double value = 1.0;
+
+    while ( testSeconds() < until ) value = value * 1.0000001 + 1e-9;
+
+    testSink = value;
+}
+
+/******************************************************************************\
+ * benchmarkIsQuick()
+ *
+ * Benchmarks are run by ctest with "--quick", just to check that they still
+ * work; run them by hand without it for real figures.
+ *
+ * Out: true if "--quick" was given.
+\******************************************************************************/
+
+static inline bool benchmarkIsQuick( int argc, char ** argv )
+{
+    for ( int index = 1; index < argc; index ++ )
+    {
+        if ( strcmp( argv[ index ], "--quick" ) == 0 ) return true;
+    }
+
+    return false;
+}
+
+/******************************************************************************\
+ * compareDoubles(), percentileOf()
+ *
+ * Sort an array of values and return the given percentile of it.
+\******************************************************************************/
+
+static inline int compareDoubles( const void * first, const void * second )
+{
+    double a = *( const double * ) first;
+    double b = *( const double * ) second;
+
+    return a < b ? -1 : a > b;
+}
+
+static inline double percentileOf( double * values, size_t count, double percentage )
+{
+    if ( count == 0 ) return 0;
+
+    qsort( values, count, sizeof( double ), compareDoubles );
+
+    size_t index = ( size_t ) ( ( double ) ( count - 1 ) * percentage / 100.0 + 0.5 );
+
+    return values[ index ];
+}
+
+/******************************************************************************\
+ * testMakeDirectory()
+ *
+ * Make a new, empty scratch directory under the system temporary directory.
+ *
+ * In:  Prefix for its leafname.
+ *
+ * Out: Full path, to be freed by the caller; exits on failure.
+\******************************************************************************/
+
+static inline char * testMakeDirectory( const char * prefix )
+{
+    const char * base = getenv( "TMPDIR" );
+    char       * path = NULL;
+
+    if ( base == NULL || *base == '\0' ) base = "/tmp";
+
+    if ( asprintf( &path, "%s/%s.XXXXXX", base, prefix ) < 0 || mkdtemp( path ) == NULL )
+    {
+        perror( "testMakeDirectory" );
+        exit( EXIT_FAILURE );
+    }
+
+    return path;
+}
+
+/******************************************************************************\
+ * testWriteFile()
+ *
+ * Write a file of the given size, filled with a repeating pattern.
+ *
+ * In:  Full path;
+ *
+ *      Size in bytes.
+ *
+ * Out: true if written.
+\******************************************************************************/
+
+static inline bool testWriteFile( const char * path, size_t size )
+{
+    FILE * file = fopen( path, "wb" );
+
+    if ( file == NULL ) return false;
+
+    for ( size_t index = 0; index < size; index ++ ) fputc( ( int ) ( index & 0xFF ), file );
+
+    return fclose( file ) == 0;
+}
+
+/******************************************************************************\
+ * testMakeTree()
+ *
+ * Build a synthetic folder tree: each directory holds the given number of
+ * files with the given extension, and, above the given depth, the given
+ * number of subdirectories.
+ *
+ * In:  Root, which must already exist;
+ *
+ *      Levels of subdirectories below the root;
+ *
+ *      Subdirectories per directory;
+ *
+ *      Files per directory;
+ *
+ *      Extension for the files, including the dot;
+ *
+ *      Size of each file in bytes.
+ *
+ * Out: Number of files made.
+\******************************************************************************/
+
+static inline size_t testMakeTree( const char   * root,
+                                   unsigned int   depth,
+                                   unsigned int   fanout,
+                                   unsigned int   files,
+                                   const char   * extension,
+                                   size_t         size )
+{
+    char   path[ 4096 ];
+    size_t made = 0;
+
+    for ( unsigned int index = 0; index < files; index ++ )
+    {
+        if ( snprintf( path, sizeof( path ), "%s/file%u%s", root, index, extension ) >= ( int ) sizeof( path ) ) break;
+        if ( testWriteFile( path, size ) ) made ++;
+    }
+
+    if ( depth == 0 ) return made;
+
+    for ( unsigned int index = 0; index < fanout; index ++ )
+    {
+        if ( snprintf( path, sizeof( path ), "%s/dir%u", root, index ) >= ( int ) sizeof( path ) ) break;
+
+        if ( mkdir( path, 0755 ) == 0 || errno == EEXIST )
+        {
+            made += testMakeTree( path, depth - 1, fanout, files, extension, size );
+        }
+    }
+
+    return made;
+}
+
+/******************************************************************************\
+ * testRemoveTree()
+ *
+ * Delete a scratch directory and everything in it.
+\******************************************************************************/
+
+static inline int testRemoveEntry( const char * path, const struct stat * info, int flag, struct FTW * walk )
+{
+    ( void ) info;
+    ( void ) flag;
+    ( void ) walk;
+
+    return remove( path );
+}
+
+static inline void testRemoveTree( const char * path )
+{
+    nftw( path, testRemoveEntry, 16, FTW_DEPTH | FTW_PHYS );
+}
+
+/******************************************************************************\
+ * testAgeTree()
+ *
+ * Set the modification times of a scratch directory and everything in it to
+ * the given number of seconds ago, so that indexed scans can trust them.
+\******************************************************************************/
+
+static time_t testAgeTreeSeconds;
+
+static inline int testAgeEntry( const char * path, const struct stat * info, int flag, struct FTW * walk )
+{
+    struct timespec times[ 2 ] = { { testAgeTreeSeconds, 0 }, { testAgeTreeSeconds, 0 } };
+
+    ( void ) info;
+    ( void ) flag;
+    ( void ) walk;
+
+    return utimensat( AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW );
+}
+
+static inline void testAgeTree( const char * path, unsigned int seconds )
+{
+    testAgeTreeSeconds = time( NULL ) - ( time_t ) seconds;
+
+    nftw( path, testAgeEntry, 16, FTW_DEPTH | FTW_PHYS );
+}
+
+#endif /* TEST_SUPPORT_H */
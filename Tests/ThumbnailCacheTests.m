@@ -0,0 +1,185 @@
+/******************************************************************************\
+ * Tests: ThumbnailCacheTests.m
+ *
+ * Tests for "ThumbnailCache.h": hits and misses as the preview and apply
+ * paths would see them, keys which change with the file, least recently used
+ * eviction within the byte budget, and the disk tier surviving into a new
+ * cache. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#import "ThumbnailCache.h"
+
+/* A square opaque test image of the given size */
+
+static CGImageRef createImage( size_t size )
+{
+    CGColorSpaceRef space   = CGColorSpaceCreateDeviceRGB();
+    CGContextRef    context = CGBitmapContextCreate( NULL, size, size, 8, 0, space, kCGImageAlphaPremultipliedLast );
+
+    CGContextSetRGBFillColor( context, 0.2, 0.4, 0.6, 1 );
+    CGContextFillRect( context, CGRectMake( 0, 0, size, size ) );
+
+    CGImageRef image = CGBitmapContextCreateImage( context );
+
+    CGContextRelease   ( context );
+    CGColorSpaceRelease( space   );
+
+    return image;
+}
+
+static BOOL isCached( ThumbnailCache * cache, NSString * path, CGSize size, ThumbnailCacheMode mode )
+{
+    CGImageRef image = [ cache copyImageForPath: path pixelSize: size mode: mode ];
+
+    if ( image == NULL ) return NO;
+
+    CGImageRelease( image );
+    return YES;
+}
+
+/* A thumbnail stored by one path (e.g. a preview row) is found by another
+ * (e.g. the real icon) asking for the same size and fit, but not for any
+ * other size or fit, nor once the file has changed.
+ */
+
+static void testHits( NSString * path )
+{
+    ThumbnailCache * cache = [ [ ThumbnailCache alloc ] initWithByteBudget: 1024 * 1024 diskDirectory: nil diskBudget: 0 ];
+    CGImageRef       image = createImage( 16 );
+    CGSize           size  = CGSizeMake( 16, 16 );
+
+    CHECK( ! isCached( cache, path, size, thumbnailCacheModeCrop ) );
+
+    [ cache storeImage: image forPath: path pixelSize: size mode: thumbnailCacheModeCrop ];
+
+    CHECK(   isCached( cache, path, size,                  thumbnailCacheModeCrop ) );
+    CHECK(   isCached( cache, path, CGSizeMake( 15.5, 16 ), thumbnailCacheModeCrop ) );
+    CHECK( ! isCached( cache, path, CGSizeMake( 32,   32 ), thumbnailCacheModeCrop ) );
+    CHECK( ! isCached( cache, path, size,                  thumbnailCacheModeFit  ) );
+
+    ThumbnailCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.hits,   2 );
+    CHECK_EQUAL( statistics.misses, 3 );
+    CHECK_EQUAL( statistics.stores, 1 );
+    CHECK_EQUAL( statistics.count,  1 );
+
+    CHECK( testWriteFile( [ path fileSystemRepresentation ], 200 ) );
+    CHECK( ! isCached( cache, path, size, thumbnailCacheModeCrop ) );
+
+    CGImageRelease( image );
+}
+
+/* With room for two thumbnails, storing a third evicts whichever was used
+ * least recently; a thumbnail bigger than the whole budget isn't kept.
+ */
+
+static void testEviction( NSString * pathA, NSString * pathB, NSString * pathC )
+{
+    CGImageRef       image  = createImage( 16 );
+    size_t           bytes  = CGImageGetBytesPerRow( image ) * CGImageGetHeight( image );
+    CGSize           size   = CGSizeMake( 16, 16 );
+    ThumbnailCache * cache  = [ [ ThumbnailCache alloc ] initWithByteBudget: bytes * 2 diskDirectory: nil diskBudget: 0 ];
+
+    [ cache storeImage: image forPath: pathA pixelSize: size mode: thumbnailCacheModeCrop ];
+    [ cache storeImage: image forPath: pathB pixelSize: size mode: thumbnailCacheModeCrop ];
+
+    CHECK( isCached( cache, pathA, size, thumbnailCacheModeCrop ) );
+
+    [ cache storeImage: image forPath: pathC pixelSize: size mode: thumbnailCacheModeCrop ];
+
+    CHECK(   isCached( cache, pathA, size, thumbnailCacheModeCrop ) );
+    CHECK( ! isCached( cache, pathB, size, thumbnailCacheModeCrop ) );
+    CHECK(   isCached( cache, pathC, size, thumbnailCacheModeCrop ) );
+
+    ThumbnailCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.evictions, 1         );
+    CHECK_EQUAL( statistics.count,     2         );
+    CHECK_EQUAL( statistics.bytesUsed, bytes * 2 );
+
+    CGImageRef big = createImage( 64 );
+
+    [ cache storeImage: big forPath: pathB pixelSize: size mode: thumbnailCacheModeFit ];
+    CHECK( ! isCached( cache, pathB, size, thumbnailCacheModeFit ) );
+    CHECK_EQUAL( cache.statistics.count, 2 );
+
+    [ cache removeAllImages ];
+    CHECK_EQUAL( cache.statistics.count,     0 );
+    CHECK_EQUAL( cache.statistics.bytesUsed, 0 );
+
+    CGImageRelease( big   );
+    CGImageRelease( image );
+}
+
+/* Thumbnails are written to the disk tier in the background; once there, a
+ * new cache over the same directory finds them.
+ */
+
+static void testDiskTier( NSString * path, NSString * directory )
+{
+    CGImageRef image = createImage( 16 );
+    CGSize     size  = CGSizeMake( 16, 16 );
+
+    @autoreleasepool
+    {
+        ThumbnailCache * cache = [ [ ThumbnailCache alloc ] initWithByteBudget: 1024 * 1024 diskDirectory: directory diskBudget: 1024 * 1024 ];
+
+        [ cache storeImage: image forPath: path pixelSize: size mode: thumbnailCacheModeStretch ];
+    }
+
+    BOOL written = NO;
+
+    for ( unsigned int attempt = 0; attempt < 500 && ! written; attempt ++ )
+    {
+        NSArray * files = [ [ NSFileManager defaultManager ] contentsOfDirectoryAtPath: directory error: NULL ];
+
+        written = [ [ files filteredArrayUsingPredicate: [ NSPredicate predicateWithFormat: @"self ENDSWITH '.png'" ] ] count ] == 1;
+        if ( ! written ) usleep( 10000 );
+    }
+
+    CHECK( written );
+
+    ThumbnailCache * cache = [ [ ThumbnailCache alloc ] initWithByteBudget: 1024 * 1024 diskDirectory: directory diskBudget: 1024 * 1024 ];
+
+    CHECK( isCached( cache, path, size, thumbnailCacheModeStretch ) );
+    CHECK( isCached( cache, path, size, thumbnailCacheModeStretch ) );
+
+    ThumbnailCacheStatistics statistics = cache.statistics;
+
+    CHECK_EQUAL( statistics.diskHits, 1 );
+    CHECK_EQUAL( statistics.hits,     1 );
+    CHECK_EQUAL( statistics.misses,   0 );
+
+    CGImageRelease( image );
+}
+
+int main( void )
+{
+    @autoreleasepool
+    {
+        char     * scratch   = testMakeDirectory( "ThumbnailCacheTests" );
+        NSString * root      = [ NSString stringWithUTF8String: scratch ];
+        NSString * pathA     = [ root stringByAppendingPathComponent: @"a.jpg" ];
+        NSString * pathB     = [ root stringByAppendingPathComponent: @"b.jpg" ];
+        NSString * pathC     = [ root stringByAppendingPathComponent: @"c.jpg" ];
+        NSString * directory = [ root stringByAppendingPathComponent: @"disk" ];
+
+        testWriteFile( [ pathA fileSystemRepresentation ], 100 );
+        testWriteFile( [ pathB fileSystemRepresentation ], 100 );
+        testWriteFile( [ pathC fileSystemRepresentation ], 100 );
+
+        testEviction( pathA, pathB, pathC );
+        testDiskTier( pathB, directory );
+        testHits    ( pathA );
+
+        testRemoveTree( scratch );
+        free( scratch );
+    }
+
+    return testFinish( "ThumbnailCacheTests" );
+}
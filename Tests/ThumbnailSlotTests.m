@@ -0,0 +1,473 @@
+/******************************************************************************\
+ * Tests: ThumbnailSlotTests.m
+ *
+ * Custom icons used to draw each thumbnail, with its border, shadow and
+ * rotation, into a CGLayer the size of the whole canvas, from an image decoded
+ * at that size, and then scale the layer down into its slot. They are now
+ * drawn straight into their slots from images decoded at slot size, inside a
+ * transparency layer bounded to what is drawn, with the shadow scaled to
+ * match (see -allocCustomIconFrom:withBackground:errorsTo: in
+ * "CustomIconGenerator.m"). Both ways are written out here, as the generator
+ * does them without the sprite cache, and each preset icon style is drawn
+ * with every number of thumbnails it can show, at standard and Retina pixel
+ * density; the results must match to within a small mean difference, and no
+ * pixel may be far out. macOS only.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include <math.h>
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/* The icon generator's layout constants (see "GlobalConstants.h" and
+ * "CustomIconGenerator.h"), at standard pixel density.
+ */
+
+#define CANVAS_SIZE  512
+#define THUMB_BORDER 20
+#define BLUR_RADIUS  16
+#define BLUR_OFFSET  8
+#define ROTATION_PAD 40
+
+#define MEAN_TOLERANCE    1.5 /* Mean difference per channel                 */
+#define LARGEST_TOLERANCE 128 /* Largest, where edges are antialiased apart */
+
+/* A preset icon style (see "IconStyleManager.m"); every preset has a drop
+ * shadow.
+ */
+
+typedef struct Preset
+{
+    const char * name;
+    bool         border;
+    bool         rotation;
+    bool         coverArt;
+    bool         crop;
+
+} Preset;
+
+static const Preset presets[] =
+{
+    { "Classic", true,  true,  false, true  },
+    { "CD",      false, false, true,  true  },
+    { "DVD",     false, false, true,  false }
+};
+
+#define PRESETS ( sizeof( presets ) / sizeof( presets[ 0 ] ) )
+
+/* Slots for OS X 10.10 or later, from "CustomIconGenerator.m", and fixed
+ * stand-ins for the random rotation of each thumbnail.
+ */
+
+static const CGRect locations[ 4 ][ 4 ] =
+{
+    { { { 123, 90  }, { 268, 276 } } },
+    { { { 268, 134 }, { 216, 216 } }, { { 32, 134 }, { 216, 216 } } },
+    { { { 264, 0   }, { 248, 248 } }, { { 0,  0   }, { 248, 248 } }, { { 132, 264 }, { 248, 248 } } },
+    { { { 264, 0   }, { 248, 248 } }, { { 0,  0   }, { 248, 248 } }, { { 264, 264 }, { 248, 248 } }, { { 0, 264 }, { 248, 248 } } }
+};
+
+static const CGFloat angles[ 4 ] = { 0.06, -0.045, 0.07, -0.02 };
+
+/* With more than one thumbnail, slots grow by a third of the room made for
+ * shadow and rotation, and move by half that, times these, across and down
+ * (from the switch statement in -getSlots:forThumbnailCount:).
+ */
+
+static const signed char moves[ 4 ][ 4 ][ 2 ] =
+{
+    { { 0, 0 } },
+    { { -2, -1 }, { 0, -1 } },
+    { { -2,  0 }, { 0,  0 }, { -1, -2 } },
+    { { -2,  0 }, { 0,  0 }, { -2, -2 }, { 0, -2 } }
+};
+
+/******************************************************************************\
+ * Layout, as -getThumbnailGeometry: and -getSlots:forThumbnailCount:
+\******************************************************************************/
+
+typedef struct Geometry
+{
+    CGFloat canvasSize;
+    CGFloat thumbSize;
+    CGFloat borderSize;
+    CGSize  shadowOffset;
+    CGFloat shadowBlur;
+
+} Geometry;
+
+static Geometry geometryFor( const Preset * preset, int dpi )
+{
+    Geometry geometry = { CANVAS_SIZE * dpi, CANVAS_SIZE * dpi, 0, CGSizeZero, 0 };
+
+    if ( preset->rotation ) geometry.thumbSize -= ROTATION_PAD * dpi;
+
+    if ( preset->coverArt == false )
+    {
+        geometry.shadowOffset = CGSizeMake( 0, -BLUR_OFFSET * dpi );
+        geometry.shadowBlur   = BLUR_RADIUS * dpi;
+        geometry.thumbSize   -= ( BLUR_RADIUS + BLUR_OFFSET * 2 ) * dpi;
+    }
+    else
+    {
+        geometry.shadowOffset = CGSizeMake( 0, -( BLUR_OFFSET / 2 ) * dpi );
+        geometry.shadowBlur   = ( BLUR_RADIUS / 3 ) * ( BLUR_OFFSET / 2 ) * dpi;
+        geometry.thumbSize   -= ( BLUR_RADIUS * ( BLUR_OFFSET / 2 ) + ( BLUR_OFFSET / 2 ) ) * dpi;
+    }
+
+    if ( preset->border )
+    {
+        geometry.borderSize  = geometry.thumbSize;
+        geometry.thumbSize  -= THUMB_BORDER * 2 * dpi;
+    }
+
+    return geometry;
+}
+
+static void slotsFor( const Preset * preset, unsigned int count, int dpi, CGRect * slots )
+{
+    CGFloat adjust = ( BLUR_RADIUS + BLUR_OFFSET * 2 + ( preset->rotation ? ROTATION_PAD : 0 ) ) / 3.0;
+
+    if ( preset->coverArt )
+    {
+        slots[ 0 ] = CGRectMake( 0, 0, CANVAS_SIZE * dpi, CANVAS_SIZE * dpi );
+        return;
+    }
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        CGRect slot = locations[ count - 1 ][ index ];
+
+        if ( count > 1 )
+        {
+            slot.origin.x    += moves[ count - 1 ][ index ][ 0 ] * adjust / 2;
+            slot.origin.y    += moves[ count - 1 ][ index ][ 1 ] * adjust / 2;
+            slot.size.width  += adjust;
+            slot.size.height += adjust;
+        }
+
+        slots[ index ] = CGRectMake( slot.origin.x * dpi, slot.origin.y * dpi, slot.size.width * dpi, slot.size.height * dpi );
+    }
+}
+
+/* As thumbnailRect() */
+
+static CGRect thumbnailRect( CGImageRef image, CGRect rect, bool fit )
+{
+    if ( fit )
+    {
+        size_t width  = CGImageGetWidth ( image );
+        size_t height = CGImageGetHeight( image );
+
+        if ( width > height )
+        {
+            CGFloat scaled = height * ( rect.size.width / width );
+
+            rect.origin.y    += ( rect.size.height - scaled ) / 2;
+            rect.size.height  = scaled;
+        }
+        else
+        {
+            CGFloat scaled = width * ( rect.size.height / height );
+
+            rect.origin.x   += ( rect.size.width - scaled ) / 2;
+            rect.size.width  = scaled;
+        }
+    }
+
+    return rect;
+}
+
+/******************************************************************************\
+ * Images
+\******************************************************************************/
+
+static CGContextRef createContext( size_t width, size_t height )
+{
+    CGColorSpaceRef space   = CGColorSpaceCreateDeviceRGB();
+    CGContextRef    context = CGBitmapContextCreate( NULL, width, height, 8, 0, space, kCGImageAlphaPremultipliedFirst );
+
+    CGColorSpaceRelease( space );
+
+    return context;
+}
+
+/* A landscape photograph stand-in: a smooth gradient with some hard edges */
+
+static CGImageRef createPicture( unsigned int seed )
+{
+    CGContextRef context = createContext( 1200, 900 );
+    CGFloat      tint    = ( seed % 4 ) / 4.0;
+
+    for ( unsigned int row = 0; row < 90; row ++ )
+    {
+        CGContextSetRGBFillColor( context, tint, row / 90.0, 1 - row / 90.0, 1 );
+        CGContextFillRect( context, CGRectMake( 0, row * 10, 1200, 10 ) );
+    }
+
+    CGContextSetRGBFillColor( context, 1, 1 - tint, 0.2, 1 );
+    CGContextFillEllipseInRect( context, CGRectMake( 200 + seed * 90, 150, 500, 500 ) );
+    CGContextSetRGBFillColor( context, 0.1, 0.1, 0.1, 1 );
+    CGContextFillRect( context, CGRectMake( 700, 100 + seed * 60, 300, 40 ) );
+
+    CGImageRef picture = CGBitmapContextCreateImage( context );
+    CGContextRelease( context );
+
+    return picture;
+}
+
+/* As createThumbnail(): crop to fill the given size, or fit within it */
+
+static CGImageRef createThumbnail( CGImageRef picture, CGSize pixelSize, bool crop )
+{
+    CGFloat width  = CGImageGetWidth ( picture );
+    CGFloat height = CGImageGetHeight( picture );
+    CGFloat scale  = crop ? MAX( pixelSize.width / width, pixelSize.height / height )
+                          : MIN( pixelSize.width / width, pixelSize.height / height );
+    size_t  outW   = crop ? ( size_t ) round( pixelSize.width  ) : ( size_t ) MAX( 1, round( width  * scale ) );
+    size_t  outH   = crop ? ( size_t ) round( pixelSize.height ) : ( size_t ) MAX( 1, round( height * scale ) );
+
+    CGContextRef context = createContext( outW, outH );
+
+    CGContextSetInterpolationQuality( context, kCGInterpolationHigh );
+    CGContextDrawImage
+    (
+        context,
+        CGRectMake( ( outW - width * scale ) / 2, ( outH - height * scale ) / 2, width * scale, height * scale ),
+        picture
+    );
+
+    CGImageRef thumbnail = CGBitmapContextCreateImage( context );
+    CGContextRelease( context );
+
+    return thumbnail;
+}
+
+/* Fill the canvas as an opaque base plate, with the usual quality settings */
+
+static CGContextRef createCanvas( const Geometry * geometry, unsigned int count )
+{
+    CGContextRef context = createContext( geometry->canvasSize, geometry->canvasSize );
+
+    CGContextSetShouldAntialias     ( context, true                 );
+    CGContextSetInterpolationQuality( context, kCGInterpolationHigh );
+
+    if ( count < 3 ) CGContextSetRGBFillColor( context, 1.00, 1.00, 1.00, 1.0 );
+    else             CGContextSetRGBFillColor( context, 0.62, 0.77, 0.85, 1.0 );
+
+    CGContextFillRect( context, CGRectMake( 0, 0, geometry->canvasSize, geometry->canvasSize ) );
+
+    return context;
+}
+
+/******************************************************************************\
+ * The old way: a canvas-sized CGLayer per thumbnail, scaled into its slot.
+\******************************************************************************/
+
+static CGContextRef drawWithLayers( const Preset * preset, unsigned int count, int dpi, CGImageRef * pictures )
+{
+    Geometry     geometry = geometryFor( preset, dpi );
+    CGFloat      canvas   = geometry.canvasSize;
+    CGContextRef context  = createCanvas( &geometry, count );
+    CGColorRef   grey     = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
+    CGRect       slots[ 4 ];
+
+    slotsFor( preset, count, dpi, slots );
+
+    CGContextBeginTransparencyLayer( context, NULL );
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        CGLayerRef   layer    = CGLayerCreateWithContext( context, CGSizeMake( canvas, canvas ), NULL );
+        CGContextRef layerCtx = CGLayerGetContext( layer );
+        CGFloat      size     = geometry.thumbSize;
+        CGImageRef   image    = createThumbnail( pictures[ index ], CGSizeMake( size, size ), preset->crop );
+
+        CGContextSetShouldAntialias     ( layerCtx, true                 );
+        CGContextSetInterpolationQuality( layerCtx, kCGInterpolationHigh );
+
+        CGContextBeginTransparencyLayer( layerCtx, NULL );
+        CGContextTranslateCTM( layerCtx, canvas / 2, canvas / 2 );
+
+        if ( preset->rotation ) CGContextRotateCTM( layerCtx, angles[ index ] );
+
+        if ( preset->coverArt ) CGContextSetShadowWithColor( layerCtx, geometry.shadowOffset, geometry.shadowBlur, grey );
+        else                    CGContextSetShadow         ( layerCtx, geometry.shadowOffset, geometry.shadowBlur       );
+
+        if ( geometry.borderSize > 0 )
+        {
+            CGFloat border = geometry.borderSize;
+
+            CGContextSetRGBFillColor( layerCtx, 1, 1, 1, 1.0 );
+            CGContextFillRect( layerCtx, CGRectMake( -border / 2, -border / 2, border, border ) );
+            CGContextSetShadowWithColor( layerCtx, CGSizeZero, 0, NULL );
+        }
+
+        CGContextDrawImage( layerCtx, thumbnailRect( image, CGRectMake( -size / 2, -size / 2, size, size ), ! preset->crop ), image );
+        CGContextEndTransparencyLayer( layerCtx );
+
+        CGContextDrawLayerInRect( context, slots[ index ], layer );
+
+        CGImageRelease( image );
+        CGLayerRelease( layer );
+    }
+
+    CGContextEndTransparencyLayer( context );
+    CGColorRelease( grey );
+
+    return context;
+}
+
+/******************************************************************************\
+ * The new way: straight into each slot, as the generator does without the
+ * sprite cache.
+\******************************************************************************/
+
+static CGContextRef drawInSlots( const Preset * preset, unsigned int count, int dpi, CGImageRef * pictures )
+{
+    Geometry     geometry  = geometryFor( preset, dpi );
+    CGFloat      canvas    = geometry.canvasSize;
+    CGFloat      thumbSize = geometry.thumbSize;
+    CGFloat      border    = geometry.borderSize;
+    CGRect       pixelRect = CGRectMake( 0, 0, canvas, canvas );
+    CGContextRef context   = createCanvas( &geometry, count );
+    CGColorRef   grey      = CGColorCreateGenericRGB( 0.3, 0.3, 0.3, 1 );
+    CGRect       slots[ 4 ];
+
+    slotsFor( preset, count, dpi, slots );
+
+    CGContextBeginTransparencyLayer( context, NULL );
+
+    for ( unsigned int index = 0; index < count; index ++ )
+    {
+        CGRect     slot   = slots[ index ];
+        CGFloat    scaleX = slot.size.width  / canvas;
+        CGFloat    scaleY = slot.size.height / canvas;
+        CGFloat    angle  = preset->rotation ? angles[ index ] : 0;
+        CGImageRef image  = createThumbnail( pictures[ index ], CGSizeMake( thumbSize * scaleX, thumbSize * scaleY ), preset->crop );
+        CGFloat    extent = MAX( border, thumbSize ) / 2 * ( fabs( cos( angle ) ) + fabs( sin( angle ) ) ) +
+                            fabs( geometry.shadowOffset.height ) + geometry.shadowBlur * 2;
+        CGRect     bounds = CGRectIntersection
+        (
+            CGRectMake( canvas / 2.0 - extent, canvas / 2.0 - extent, extent * 2, extent * 2 ),
+            pixelRect
+        );
+
+        CGContextSaveGState  ( context );
+        CGContextTranslateCTM( context, slot.origin.x, slot.origin.y );
+        CGContextScaleCTM    ( context, scaleX, scaleY );
+        CGContextClipToRect  ( context, pixelRect );
+
+        CGContextBeginTransparencyLayerWithRect( context, bounds, NULL );
+        CGContextTranslateCTM( context, canvas / 2.0, canvas / 2.0 );
+        CGContextRotateCTM   ( context, angle );
+
+        CGSize  offset = CGSizeMake( geometry.shadowOffset.width * scaleX, geometry.shadowOffset.height * scaleY );
+        CGFloat blur   = geometry.shadowBlur * sqrt( scaleX * scaleY );
+
+        if ( preset->coverArt ) CGContextSetShadowWithColor( context, offset, blur, grey );
+        else                    CGContextSetShadow         ( context, offset, blur       );
+
+        if ( border > 0 )
+        {
+            CGContextSetRGBFillColor( context, 1, 1, 1, 1.0 );
+            CGContextFillRect( context, CGRectMake( -border / 2, -border / 2, border, border ) );
+            CGContextSetShadowWithColor( context, CGSizeZero, 0, NULL );
+        }
+
+        CGContextDrawImage( context, thumbnailRect( image, CGRectMake( -thumbSize / 2, -thumbSize / 2, thumbSize, thumbSize ), ! preset->crop ), image );
+
+        CGContextEndTransparencyLayer( context );
+        CGContextRestoreGState( context );
+
+        CGImageRelease( image );
+    }
+
+    CGContextEndTransparencyLayer( context );
+    CGColorRelease( grey );
+
+    return context;
+}
+
+/******************************************************************************\
+ * The tests
+\******************************************************************************/
+
+/* Out: Largest difference between two same-sized contexts in any channel,
+ *      with the mean difference per channel written to 'mean'.
+ */
+
+static unsigned int difference( CGContextRef first, CGContextRef second, double * mean )
+{
+    size_t          width    = CGBitmapContextGetWidth      ( first  );
+    size_t          height   = CGBitmapContextGetHeight     ( first  );
+    size_t          rowBytes = CGBitmapContextGetBytesPerRow( first  );
+    size_t          otherRow = CGBitmapContextGetBytesPerRow( second );
+    const uint8_t * a        = CGBitmapContextGetData       ( first  );
+    const uint8_t * b        = CGBitmapContextGetData       ( second );
+    unsigned int    largest  = 0;
+    double          total    = 0;
+
+    for ( size_t y = 0; y < height; y ++ )
+    {
+        for ( size_t x = 0; x < width * 4; x ++ )
+        {
+            int delta = abs( ( int ) a[ y * rowBytes + x ] - ( int ) b[ y * otherRow + x ] );
+
+            total += delta;
+            if ( ( unsigned int ) delta > largest ) largest = ( unsigned int ) delta;
+        }
+    }
+
+    *mean = total / ( ( double ) width * height * 4 );
+    return largest;
+}
+
+static void testPresets( void )
+{
+    CGImageRef pictures[ 4 ];
+
+    for ( unsigned int index = 0; index < 4; index ++ ) pictures[ index ] = createPicture( index );
+
+    for ( size_t item = 0; item < PRESETS; item ++ )
+    {
+        const Preset * preset  = &presets[ item ];
+        unsigned int   maximum = preset->coverArt ? 1 : 4;
+
+        for ( unsigned int count = 1; count <= maximum; count ++ )
+        {
+            for ( int dpi = 1; dpi <= 2; dpi ++ )
+            {
+                CGContextRef layered = drawWithLayers( preset, count, dpi, pictures );
+                CGContextRef slotted = drawInSlots   ( preset, count, dpi, pictures );
+                double       mean;
+                unsigned int largest = difference( layered, slotted, &mean );
+
+                printf( "%-8s %u image%s at %dx: mean difference %.2f, largest %u\n",
+                        preset->name, count, count == 1 ? " " : "s", dpi, mean, largest );
+
+                CHECK( mean    <  MEAN_TOLERANCE    );
+                CHECK( largest <= LARGEST_TOLERANCE );
+
+                CGContextRelease( layered );
+                CGContextRelease( slotted );
+            }
+        }
+    }
+
+    for ( unsigned int index = 0; index < 4; index ++ ) CGImageRelease( pictures[ index ] );
+}
+
+int main( void )
+{
+    @autoreleasepool
+    {
+        testPresets();
+    }
+
+    return testFinish( "ThumbnailSlotTests" );
+}
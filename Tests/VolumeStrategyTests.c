@@ -0,0 +1,153 @@
+/******************************************************************************\
+ * Tests: VolumeStrategyTests.c
+ *
+ * Tests for choosing how to scan a root from its volume: the strategy that
+ * folderScannerChooseStrategy() picks for each kind and latency class of
+ * volume, never using more threads than asked for; and scans adapting to
+ * volumes, where a local tree and the same tree behind medium and high
+ * latency simulated file servers must each be profiled into the right class,
+ * scanned with the matching strategy, and recorded in that volume's totals.
+ *
+ * (C) Hipposoft 2026 <ahodgkin@rowing.org.uk>
+\******************************************************************************/
+
+#include "TestSupport.h"
+
+#include "FolderScanner.h"
+#include "VolumeProfile.h"
+
+/* Synthetic tree: 1 + 3 directories of 4 files each */
+
+#define TREE_DEPTH        1
+#define TREE_FANOUT       3
+#define TREE_FILES        4
+#define TREE_DIRECTORIES  4
+
+#define THREADS           4 /* Asked for, where not stated otherwise */
+
+#define MEDIUM_OPEN_MICROSECONDS  5000
+#define HIGH_OPEN_MICROSECONDS   25000
+
+/* Each kind and latency class of volume, with and without limits on threads
+ * and a batch size of its own.
+ */
+
+static void testChooseStrategy( void )
+{
+    static const struct
+    {
+        VolumeKind    kind;
+        VolumeLatency latency;
+        unsigned int  threadCount;
+        size_t        batchSize;
+        unsigned int  expectedThreads;
+        size_t        expectedBatchSize;
+    }
+    cases[] =
+    {
+        { volumeKindLocal,   volumeLatencyLow,     THREADS, 0,   THREADS, FOLDER_SCANNER_DEFAULT_BATCH_SIZE        },
+        { volumeKindLocal,   volumeLatencyLow,     0,       512, 0,       512                                      },
+        { volumeKindUnknown, volumeLatencyUnknown, THREADS, 0,   THREADS, FOLDER_SCANNER_DEFAULT_BATCH_SIZE        },
+        { volumeKindLocal,   volumeLatencyMedium,  THREADS, 512, FOLDER_SCANNER_MEDIUM_LATENCY_THREADS,
+                                                                          FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE },
+        { volumeKindLocal,   volumeLatencyMedium,  0,       0,   FOLDER_SCANNER_MEDIUM_LATENCY_THREADS,
+                                                                          FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE },
+        { volumeKindLocal,   volumeLatencyMedium,  1,       0,   1,       FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE },
+        { volumeKindLocal,   volumeLatencyHigh,    THREADS, 512, FOLDER_SCANNER_HIGH_LATENCY_THREADS,
+                                                                          FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE   },
+        { volumeKindNetwork, volumeLatencyLow,     THREADS, 0,   FOLDER_SCANNER_HIGH_LATENCY_THREADS,
+                                                                          FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE   },
+        { volumeKindNetwork, volumeLatencyUnknown, 0,       0,   FOLDER_SCANNER_HIGH_LATENCY_THREADS,
+                                                                          FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE   },
+        { volumeKindNetwork, volumeLatencyHigh,    1,       0,   1,       FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE   }
+    };
+
+    for ( size_t index = 0; index < sizeof( cases ) / sizeof( cases[ 0 ] ); index ++ )
+    {
+        VolumeProfile         volume   = { .kind = cases[ index ].kind, .latency = cases[ index ].latency };
+        FolderScannerStrategy strategy = { 0 };
+
+        folderScannerChooseStrategy( &volume, cases[ index ].threadCount, cases[ index ].batchSize, &strategy );
+
+        CHECK_EQUAL( strategy.threadCount, cases[ index ].expectedThreads   );
+        CHECK_EQUAL( strategy.batchSize,   cases[ index ].expectedBatchSize );
+    }
+}
+
+/* Scan the tree adapting to its volume, through the given backend, and check
+ * the latency class found, the strategy followed and the totals recorded.
+ */
+
+static void checkAdaptiveScan( const char                 * tree,
+                               const FolderScannerBackend * backend,
+                               VolumeLatency                expectedLatency,
+                               unsigned int                 expectedThreads,
+                               size_t                       expectedBatchSize )
+{
+    FolderScannerOptions options = { .threadCount = THREADS, .backend = backend, .adaptToVolume = true };
+    FolderScannerRoot    root    = { .path = tree };
+    VolumeProfile        volumes[ VOLUME_PROFILE_TABLE_SIZE ];
+
+    volumeProfileForget();
+
+    CHECK_EQUAL( folderScannerRun( &root, 1, &options, NULL ), 0 );
+
+    CHECK_EQUAL( root.status,               folderScannerStatusComplete      );
+    CHECK_EQUAL( root.filesFound,           ( 1 + TREE_FANOUT ) * TREE_FILES );
+    CHECK_EQUAL( root.volume.latency,       expectedLatency                  );
+    CHECK_EQUAL( root.strategy.threadCount, expectedThreads                  );
+    CHECK_EQUAL( root.strategy.batchSize,   expectedBatchSize                );
+    CHECK      ( root.volume.kind != volumeKindNetwork );
+    CHECK      ( root.volume.fileSystem[ 0 ] != '\0'   );
+
+    size_t count = volumeProfileCopyAll( volumes, VOLUME_PROFILE_TABLE_SIZE );
+
+    CHECK_EQUAL( count, 1 );
+
+    if ( count == 1 )
+    {
+        CHECK_EQUAL( volumes[ 0 ].device,          root.volume.device );
+        CHECK_EQUAL( volumes[ 0 ].latency,         expectedLatency    );
+        CHECK_EQUAL( volumes[ 0 ].scans,           1                  );
+        CHECK_EQUAL( volumes[ 0 ].directoriesRead, TREE_DIRECTORIES   );
+        CHECK_EQUAL( volumes[ 0 ].entriesSeen,     root.entriesSeen   );
+    }
+}
+
+/* The same tree read directly, then as if from slower and slower servers */
+
+static void testAdaptiveScans( const char * tree )
+{
+    FolderScannerSlowBackend medium, high;
+
+    CHECK_EQUAL( folderScannerSlowBackendInit( &medium, folderScannerPOSIXBackend(), MEDIUM_OPEN_MICROSECONDS, 0, 0 ), 0 );
+    CHECK_EQUAL( folderScannerSlowBackendInit( &high,   folderScannerPOSIXBackend(), HIGH_OPEN_MICROSECONDS,   0, 0 ), 0 );
+
+    checkAdaptiveScan( tree, folderScannerPOSIXBackend(), volumeLatencyLow, THREADS, FOLDER_SCANNER_DEFAULT_BATCH_SIZE );
+
+    checkAdaptiveScan( tree, &medium.backend, volumeLatencyMedium,
+                       FOLDER_SCANNER_MEDIUM_LATENCY_THREADS, FOLDER_SCANNER_MEDIUM_LATENCY_BATCH_SIZE );
+
+    checkAdaptiveScan( tree, &high.backend, volumeLatencyHigh,
+                       FOLDER_SCANNER_HIGH_LATENCY_THREADS, FOLDER_SCANNER_HIGH_LATENCY_BATCH_SIZE );
+
+    volumeProfileForget();
+
+    folderScannerSlowBackendDestroy( &high   );
+    folderScannerSlowBackendDestroy( &medium );
+}
+
+int main( void )
+{
+    char * tree = testMakeDirectory( "VolumeStrategyTests" );
+
+    testMakeTree( tree, TREE_DEPTH, TREE_FANOUT, TREE_FILES, ".jpg", 64 );
+
+    testChooseStrategy();
+    testAdaptiveScans( tree );
+
+    testRemoveTree( tree );
+    free( tree );
+
+    return testFinish( "VolumeStrategyTests" );
+}
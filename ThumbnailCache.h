@@ -0,0 +1,63 @@
+//
+//  ThumbnailCache.h
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of decoded, oriented and cropped (or fitted) image thumbnails, so that
+//  an image drawn into a preview row and then into the real icon, or into the
+//  same row again after a style change, is only decoded once. Entries are keyed
+//  by the image's path, file size and modification time, the thumbnail's pixel
+//  size and how it was fitted into that size; a changed file is never matched.
+//
+//  Thumbnails are held in memory up to a byte budget, least recently used
+//  first out. Optionally, a directory of PNG files acts as a second, larger
+//  tier which survives between runs. All methods are thread-safe.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+/* How a thumbnail was made to fit its pixel size */
+
+typedef NS_ENUM( NSInteger, ThumbnailCacheMode )
+{
+    thumbnailCacheModeCrop = 0, /* Square crop filling the size         */
+    thumbnailCacheModeFit,      /* Whole image within it, aspect intact */
+    thumbnailCacheModeStretch   /* Whole image stretched to fill it     */
+};
+
+typedef struct ThumbnailCacheStatistics
+{
+    uint64_t   hits;       /* Found in memory            */
+    uint64_t   diskHits;   /* Found on disk (not memory) */
+    uint64_t   misses;
+    uint64_t   stores;
+    uint64_t   evictions;  /* From memory                */
+    NSUInteger count;      /* Thumbnails in memory       */
+    size_t     bytesUsed;  /* By those thumbnails        */
+    size_t     bytesBudget;
+
+} ThumbnailCacheStatistics;
+
+@interface ThumbnailCache : NSObject
+
+- ( instancetype ) initWithByteBudget: ( size_t     ) byteBudget
+                        diskDirectory: ( NSString * ) diskDirectory
+                           diskBudget: ( size_t     ) diskBudget;
+
+- ( CGImageRef   ) copyImageForPath: ( NSString         * ) path
+                          pixelSize: ( CGSize             ) pixelSize
+                               mode: ( ThumbnailCacheMode ) mode CF_RETURNS_RETAINED;
+
+- ( void         )       storeImage: ( CGImageRef         ) image
+                            forPath: ( NSString         * ) path
+                          pixelSize: ( CGSize             ) pixelSize
+                               mode: ( ThumbnailCacheMode ) mode;
+
+- ( void         )  removeAllImages;
+
+@property ( readonly ) ThumbnailCacheStatistics statistics;
+
+@end
@@ -0,0 +1,541 @@
+//
+//  ThumbnailCache.m
+//  Add Folder Icons
+//
+//  Created by Andrew Hodgkinson on 16/10/26.
+//  Copyright © 2026 Hipposoft. All rights reserved.
+//
+//  Cache of decoded, oriented and cropped (or fitted) image thumbnails, so that
+//  an image drawn into a preview row and then into the real icon, or into the
+//  same row again after a style change, is only decoded once. See the header
+//  file for details.
+//
+
+#import "ThumbnailCache.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#import <ImageIO/ImageIO.h>
+#import <CoreServices/CoreServices.h>
+
+#import <pthread.h>
+#import <sys/stat.h>
+#import <sys/time.h>
+
+/* The disk tier is pruned back to its budget after this many stores */
+
+#define DISK_PRUNE_INTERVAL 64
+
+/* An entry in the memory tier, on a doubly linked list with the most recently
+ * used entry at its head.
+ */
+
+@interface ThumbnailCacheEntry : NSObject
+{
+    @public
+
+    NSString                                * key;
+    CGImageRef                                image;
+    size_t                                    bytes;
+    __unsafe_unretained ThumbnailCacheEntry * previous;
+    ThumbnailCacheEntry                     * next;
+}
+@end
+
+@implementation ThumbnailCacheEntry
+
+- ( void ) dealloc
+{
+    if ( image ) CGImageRelease( image );
+}
+
+@end
+
+@interface ThumbnailCache()
+{
+    pthread_mutex_t                              lock;
+    NSMutableDictionary                        * entries; /* Key => ThumbnailCacheEntry */
+    ThumbnailCacheEntry                        * head;
+    __unsafe_unretained ThumbnailCacheEntry    * tail;
+    ThumbnailCacheStatistics                     counters;
+    NSUInteger                                   storesSincePrune;
+}
+
+@property ( readonly ) NSString         * diskDirectory;
+@property ( readonly ) size_t             diskBudget;
+@property ( readonly ) dispatch_queue_t   diskQueue;
+
++ ( NSString * ) keyForPath: ( NSString         * ) path
+                  pixelSize: ( CGSize             ) pixelSize
+                       mode: ( ThumbnailCacheMode ) mode;
+
+- ( NSString * ) diskPathForKey: ( NSString * ) key;
+
+- ( void ) unlink:   ( ThumbnailCacheEntry * ) entry;
+- ( void ) pushHead: ( ThumbnailCacheEntry * ) entry;
+- ( void ) insertImage: ( CGImageRef ) image forKey: ( NSString * ) key;
+- ( void ) pruneDiskTier;
+
+@end
+
+@implementation ThumbnailCache
+
+/******************************************************************************\
+ * -initWithByteBudget:diskDirectory:diskBudget:
+ *
+ * Initialise a cache.
+ *
+ * In:  ( size_t ) byteBudget
+ *      Most bytes of decoded pixels to hold in memory;
+ *
+ *      ( NSString * ) diskDirectory
+ *      Full POSIX path of a directory for the disk tier, created if need be,
+ *      or nil for a memory-only cache. The directory should be used for
+ *      nothing else, since it is pruned of old files;
+ *
+ *      ( size_t ) diskBudget
+ *      Most bytes of PNG files to keep in the disk tier.
+\******************************************************************************/
+
+- ( instancetype ) initWithByteBudget: ( size_t     ) byteBudget
+                        diskDirectory: ( NSString * ) diskDirectory
+                           diskBudget: ( size_t     ) diskBudget
+{
+    if ( ( self = [ super init ] ) )
+    {
+        pthread_mutex_init( &lock, NULL );
+
+        entries                = [ NSMutableDictionary dictionaryWithCapacity: 0 ];
+        counters.bytesBudget   = byteBudget;
+
+        _diskBudget            = diskBudget;
+
+        if ( diskDirectory != nil &&
+             [ [ NSFileManager defaultManager ] createDirectoryAtPath: diskDirectory
+                                          withIntermediateDirectories: YES
+                                                           attributes: nil
+                                                                error: NULL ] )
+        {
+            _diskDirectory = [ diskDirectory copy ];
+            _diskQueue     = dispatch_queue_create( "uk.org.pond.addfoldericons.thumbnailcache", DISPATCH_QUEUE_SERIAL );
+
+            dispatch_async( _diskQueue, ^{ [ self pruneDiskTier ]; } );
+        }
+    }
+
+    return self;
+}
+
+- ( void ) dealloc
+{
+    pthread_mutex_destroy( &lock );
+}
+
+/******************************************************************************\
+ * -copyImageForPath:pixelSize:mode:
+ *
+ * Look for a thumbnail, in memory and then on disk. A thumbnail found on disk
+ * is brought into memory.
+ *
+ * In:  ( NSString * ) path
+ *      Full POSIX path of the source image;
+ *
+ *      ( CGSize ) pixelSize
+ *      Thumbnail size in pixels, as given when it was stored (rounded up to
+ *      whole pixels when compared);
+ *
+ *      ( ThumbnailCacheMode ) mode
+ *      How the image was fitted into that size.
+ *
+ * Out: Thumbnail which the caller must release, or NULL if not cached.
+\******************************************************************************/
+
+- ( CGImageRef ) copyImageForPath: ( NSString         * ) path
+                        pixelSize: ( CGSize             ) pixelSize
+                             mode: ( ThumbnailCacheMode ) mode
+{
+    NSString   * key   = [ ThumbnailCache keyForPath: path pixelSize: pixelSize mode: mode ];
+    CGImageRef   image = NULL;
+
+    if ( key == nil ) return NULL;
+
+    pthread_mutex_lock( &lock );
+
+    ThumbnailCacheEntry * entry = entries[ key ];
+
+    if ( entry != nil )
+    {
+        [ self unlink:   entry ];
+        [ self pushHead: entry ];
+
+        image = CGImageRetain( entry->image );
+        counters.hits ++;
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    if ( image != NULL ) return image;
+
+    if ( self.diskDirectory == nil )
+    {
+        pthread_mutex_lock( &lock );
+        counters.misses ++;
+        pthread_mutex_unlock( &lock );
+
+        return NULL;
+    }
+
+    /* Try the disk tier. Touch any file found so that pruning, which removes
+     * the least recently modified files first, treats it as recently used.
+     */
+
+    NSString         * diskPath = [ self diskPathForKey: key ];
+    CGImageSourceRef   source   = CGImageSourceCreateWithURL( ( __bridge CFURLRef ) [ NSURL fileURLWithPath: diskPath ], NULL );
+
+    if ( source != NULL )
+    {
+        NSDictionary * options = @{ ( id ) kCGImageSourceShouldCacheImmediately: @YES };
+
+        image = CGImageSourceCreateImageAtIndex( source, 0, ( __bridge CFDictionaryRef ) options );
+        CFRelease( source );
+
+        if ( image != NULL ) ( void ) utimes( [ diskPath fileSystemRepresentation ], NULL );
+    }
+
+    pthread_mutex_lock( &lock );
+
+    if ( image != NULL )
+    {
+        counters.diskHits ++;
+        [ self insertImage: image forKey: key ];
+    }
+    else
+    {
+        counters.misses ++;
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    return image;
+}
+
+/******************************************************************************\
+ * -storeImage:forPath:pixelSize:mode:
+ *
+ * Add a thumbnail to the cache, replacing any older one with the same key. It
+ * is written to the disk tier, if in use, in the background.
+ *
+ * In:  ( CGImageRef ) image
+ *      The thumbnail; it is retained, not copied;
+ *
+ *      Other parameters are as for -copyImageForPath:pixelSize:mode:.
+\******************************************************************************/
+
+- ( void ) storeImage: ( CGImageRef         ) image
+              forPath: ( NSString         * ) path
+            pixelSize: ( CGSize             ) pixelSize
+                 mode: ( ThumbnailCacheMode ) mode
+{
+    NSString * key = [ ThumbnailCache keyForPath: path pixelSize: pixelSize mode: mode ];
+
+    if ( key == nil || image == NULL ) return;
+
+    BOOL prune = NO;
+
+    pthread_mutex_lock( &lock );
+
+    [ self insertImage: image forKey: key ];
+    counters.stores ++;
+
+    if ( ++ storesSincePrune >= DISK_PRUNE_INTERVAL )
+    {
+        storesSincePrune = 0;
+        prune            = YES;
+    }
+
+    pthread_mutex_unlock( &lock );
+
+    if ( self.diskDirectory == nil ) return;
+
+    NSString * diskPath = [ self diskPathForKey: key ];
+
+    CGImageRetain( image );
+
+    dispatch_async( self.diskQueue, ^{
+
+        @autoreleasepool
+        {
+            /* Write to a temporary name and rename, so that a reader never
+             * sees a partly written file.
+             */
+
+            NSString              * temporary   = [ diskPath stringByAppendingString: @".tmp" ];
+            CGImageDestinationRef   destination = CGImageDestinationCreateWithURL
+            (
+                ( __bridge CFURLRef ) [ NSURL fileURLWithPath: temporary ],
+                kUTTypePNG,
+                1,
+                NULL
+            );
+
+            if ( destination != NULL )
+            {
+                CGImageDestinationAddImage( destination, image, NULL );
+
+                if ( CGImageDestinationFinalize( destination ) )
+                {
+                    ( void ) rename( [ temporary fileSystemRepresentation ], [ diskPath fileSystemRepresentation ] );
+                }
+                else
+                {
+                    ( void ) unlink( [ temporary fileSystemRepresentation ] );
+                }
+
+                CFRelease( destination );
+            }
+
+            CGImageRelease( image );
+
+            if ( prune ) [ self pruneDiskTier ];
+        }
+    });
+}
+
+/******************************************************************************\
+ * -removeAllImages
+ *
+ * Empty the memory tier. The disk tier is left alone.
+\******************************************************************************/
+
+- ( void ) removeAllImages
+{
+    pthread_mutex_lock( &lock );
+
+    [ entries removeAllObjects ];
+
+    head               = nil;
+    tail               = nil;
+    counters.count     = 0;
+    counters.bytesUsed = 0;
+
+    pthread_mutex_unlock( &lock );
+}
+
+/******************************************************************************\
+ * -statistics
+ *
+ * Out: A snapshot of the cache's counters.
+\******************************************************************************/
+
+- ( ThumbnailCacheStatistics ) statistics
+{
+    ThumbnailCacheStatistics snapshot;
+
+    pthread_mutex_lock( &lock );
+    snapshot = counters;
+    pthread_mutex_unlock( &lock );
+
+    return snapshot;
+}
+
+/******************************************************************************\
+ * +keyForPath:pixelSize:mode:
+ *
+ * Build a cache key from a source image's identity and the thumbnail wanted.
+ *
+ * Out: The key, or nil if the source image can't be examined.
+\******************************************************************************/
+
++ ( NSString * ) keyForPath: ( NSString         * ) path
+                  pixelSize: ( CGSize             ) pixelSize
+                       mode: ( ThumbnailCacheMode ) mode
+{
+    struct stat info;
+
+    if ( path == nil || stat( [ path fileSystemRepresentation ], &info ) != 0 ) return nil;
+
+    return [
+        NSString stringWithFormat: @"%llu:%lld.%09ld:%ldx%ld:%ld:%@",
+                                   ( unsigned long long ) info.st_size,
+                                   ( long long          ) info.st_mtimespec.tv_sec,
+                                   ( long               ) info.st_mtimespec.tv_nsec,
+                                   ( long               ) ceil( pixelSize.width  ),
+                                   ( long               ) ceil( pixelSize.height ),
+                                   ( long               ) mode,
+                                   path
+    ];
+}
+
+/******************************************************************************\
+ * -diskPathForKey:
+ *
+ * Out: Full POSIX path of the disk tier file for the given key; the leafname
+ *      is a SHA-256 digest of the key, since keys include whole paths.
+\******************************************************************************/
+
+- ( NSString * ) diskPathForKey: ( NSString * ) key
+{
+    const char    * utf8 = [ key UTF8String ];
+    unsigned char   digest[ CC_SHA256_DIGEST_LENGTH ];
+    char            hex[ CC_SHA256_DIGEST_LENGTH * 2 + 1 ];
+
+    CC_SHA256( utf8, ( CC_LONG ) strlen( utf8 ), digest );
+
+    for ( size_t index = 0; index < CC_SHA256_DIGEST_LENGTH; index ++ )
+    {
+        snprintf( hex + index * 2, 3, "%02x", digest[ index ] );
+    }
+
+    return [ self.diskDirectory stringByAppendingPathComponent: [ NSString stringWithFormat: @"%s.png", hex ] ];
+}
+
+/******************************************************************************\
+ * -unlink:, -pushHead:
+ *
+ * Remove an entry from the recently used list, or add one at its head. Call
+ * with the lock held.
+\******************************************************************************/
+
+- ( void ) unlink: ( ThumbnailCacheEntry * ) entry
+{
+    ThumbnailCacheEntry * retained = entry; /* Keep alive while relinking */
+
+    if ( entry->previous ) entry->previous->next = entry->next;
+    else                   head                  = entry->next;
+
+    if ( entry->next     ) entry->next->previous = entry->previous;
+    else                   tail                  = entry->previous;
+
+    entry->previous = nil;
+    entry->next     = nil;
+
+    ( void ) retained;
+}
+
+- ( void ) pushHead: ( ThumbnailCacheEntry * ) entry
+{
+    entry->previous = nil;
+    entry->next     = head;
+
+    if ( head ) head->previous = entry;
+    else        tail           = entry;
+
+    head = entry;
+}
+
+/******************************************************************************\
+ * -insertImage:forKey:
+ *
+ * Add or replace an entry at the head of the recently used list, then evict
+ * least recently used entries until the memory tier is within budget. A
+ * single thumbnail bigger than the whole budget is not kept. Call with the
+ * lock held.
+\******************************************************************************/
+
+- ( void ) insertImage: ( CGImageRef ) image forKey: ( NSString * ) key
+{
+    ThumbnailCacheEntry * old = entries[ key ];
+
+    if ( old != nil )
+    {
+        [ self unlink: old ];
+        [ entries removeObjectForKey: key ];
+
+        counters.count     --;
+        counters.bytesUsed -= old->bytes;
+    }
+
+    size_t bytes = CGImageGetBytesPerRow( image ) * CGImageGetHeight( image );
+    if ( bytes > counters.bytesBudget ) return;
+
+    ThumbnailCacheEntry * entry = [ [ ThumbnailCacheEntry alloc ] init ];
+
+    entry->key   = key;
+    entry->image = CGImageRetain( image );
+    entry->bytes = bytes;
+
+    entries[ key ] = entry;
+    [ self pushHead: entry ];
+
+    counters.count     ++;
+    counters.bytesUsed += bytes;
+
+    while ( counters.bytesUsed > counters.bytesBudget && tail != nil )
+    {
+        ThumbnailCacheEntry * victim = tail;
+
+        [ self unlink: victim ];
+        [ entries removeObjectForKey: victim->key ];
+
+        counters.count     --;
+        counters.bytesUsed -= victim->bytes;
+        counters.evictions ++;
+    }
+}
+
+/******************************************************************************\
+ * -pruneDiskTier
+ *
+ * Delete the least recently modified files in the disk tier until it is back
+ * within budget, along with any temporary files left behind by a crash. Runs
+ * on the disk queue.
+\******************************************************************************/
+
+- ( void ) pruneDiskTier
+{
+    NSFileManager * fileMgr = [ [ NSFileManager alloc ] init ];
+    NSArray       * keys    = @[ NSURLContentModificationDateKey, NSURLFileSizeKey ];
+    NSArray       * files   = [ fileMgr contentsOfDirectoryAtURL: [ NSURL fileURLWithPath: self.diskDirectory ]
+                                      includingPropertiesForKeys: keys
+                                                         options: NSDirectoryEnumerationSkipsHiddenFiles
+                                                           error: NULL ];
+    size_t          total   = 0;
+
+    NSMutableArray * pngs = [ NSMutableArray arrayWithCapacity: [ files count ] ];
+
+    for ( NSURL * file in files )
+    {
+        if ( [ [ file pathExtension ] isEqualToString: @"tmp" ] )
+        {
+            ( void ) [ fileMgr removeItemAtURL: file error: NULL ];
+        }
+        else if ( [ [ file pathExtension ] isEqualToString: @"png" ] )
+        {
+            NSNumber * size = nil;
+
+            [ file getResourceValue: &size forKey: NSURLFileSizeKey error: NULL ];
+            total += [ size unsignedLongLongValue ];
+
+            [ pngs addObject: file ];
+        }
+    }
+
+    if ( total <= self.diskBudget ) return;
+
+    [
+        pngs sortUsingComparator: ^ NSComparisonResult ( NSURL * a, NSURL * b )
+        {
+            NSDate * dateA = nil;
+            NSDate * dateB = nil;
+
+            [ a getResourceValue: &dateA forKey: NSURLContentModificationDateKey error: NULL ];
+            [ b getResourceValue: &dateB forKey: NSURLContentModificationDateKey error: NULL ];
+
+            return [ dateA compare: dateB ];
+        }
+    ];
+
+    for ( NSURL * file in pngs )
+    {
+        if ( total <= self.diskBudget ) break;
+
+        NSNumber * size = nil;
+        [ file getResourceValue: &size forKey: NSURLFileSizeKey error: NULL ];
+
+        if ( [ fileMgr removeItemAtURL: file error: NULL ] )
+        {
+            total -= MIN( total, ( size_t ) [ size unsignedLongLongValue ] );
+        }
+    }
+}
+
+@end